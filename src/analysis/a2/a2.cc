@@ -20,21 +20,29 @@
  */
 #include "mpmc_queue.cc"
 #include "a2_impl.h"
+#include "a2_h1d_fill.h"
 #include "util/assert.h"
 #include "util/perf.h"
 #include <cpp11-on-multicore/common/benaphore.h>
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <cstdio>
 #include <cstdlib>
 #include <fstream>
+#include <functional>
+#include <map>
 #include <mutex>
 #include <queue>
 #include <random>
+#include <tuple>
 #include <vector>
-#include <zstr.hpp>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 /* Circumvent compile errors related to the 'Q' numeric literal suffix.
  * See https://svn.boost.org/trac10/ticket/9240 and
@@ -150,6 +158,17 @@ ParamVec push_param_vector(Arena *arena, s32 size, double value)
     return result;
 }
 
+ValidIndexes *push_valid_indexes(Arena *arena, s32 capacity)
+{
+    assert(capacity >= 0);
+
+    auto result = arena->pushStruct<ValidIndexes>();
+    result->indexes = arena->pushArray<s32>(capacity);
+    result->count = 0;
+
+    return result;
+}
+
 void assign_input(Operator *op, PipeVectors input, s32 inputIndex)
 {
     assert(inputIndex < op->inputCount);
@@ -280,7 +299,42 @@ void extractor_begin_event(DataSource *ds)
     auto ex = reinterpret_cast<Extractor *>(ds->d);
     clear_completion(&ex->filter);
     ex->currentCompletions = 0;
-    invalidate_all(ds->output.data);
+
+    if (ds->validIndexes)
+        invalidate_valid(ds->output.data, ds->validIndexes);
+    else
+        invalidate_all(ds->output.data);
+}
+
+inline void extractor_process_data_word(DataSource *ds, Extractor *ex, u32 dataWord, u32 wordIndex)
+{
+    if (process_data(&ex->filter, dataWord, wordIndex))
+    {
+        ex->currentCompletions++;
+
+        if (ex->currentCompletions >= ex->requiredCompletions)
+        {
+            ex->currentCompletions = 0;
+            u64  address = extract(&ex->filter, MultiWordFilter::CacheA);
+            double value = static_cast<double>(extract(&ex->filter, MultiWordFilter::CacheD));
+
+            assert(address < static_cast<u64>(ds->output.data.size));
+
+            if (!is_param_valid(ds->output.data[address]))
+            {
+                if (!(ex->options & DataSourceOptions::NoAddedRandom))
+                    value += RealDist01(ex->rng);
+
+                ds->output.data[address] = value;
+                ds->hitCounts[address]++;
+
+                if (ds->validIndexes)
+                    push_valid_index(ds->validIndexes, static_cast<s32>(address));
+            }
+        }
+
+        clear_completion(&ex->filter);
+    }
 }
 
 void extractor_process_module_data(DataSource *ds, const u32 *data, u32 size)
@@ -294,31 +348,177 @@ void extractor_process_module_data(DataSource *ds, const u32 *data, u32 size)
          wordIndex < size;
          wordIndex++)
     {
-        u32 dataWord = data[wordIndex];
+        extractor_process_data_word(ds, ex, data[wordIndex], wordIndex);
+    }
+}
+
+// ExtractorDispatch
+
+ExtractorDispatch *make_extractor_dispatch(
+    Arena *arena,
+    DataSource *sources,
+    s32 sourceCount,
+    int moduleIndex)
+{
+    struct Entry
+    {
+        u32 matchMask;
+        u32 matchValue;
+        u16 extractorIndex;
+    };
+
+    std::vector<DataSource *> extractors;
+    std::vector<Entry> entries;
+
+    for (s32 si = 0; si < sourceCount; si++)
+    {
+        DataSource *ds = sources + si;
+
+        if (ds->moduleIndex != moduleIndex || ds->type != DataSource_Extractor)
+            continue;
+
+        auto ex = reinterpret_cast<Extractor *>(ds->d);
+
+        // An extractor without subfilters completes on every data word. Leave
+        // this special case to extractor_process_module_data().
+        if (ex->filter.filterCount == 0)
+            return nullptr;
+
+        const u16 extractorIndex = static_cast<u16>(extractors.size());
+        extractors.push_back(ds);
+
+        for (s32 fi = 0; fi < ex->filter.filterCount; fi++)
+        {
+            const auto &subfilter = ex->filter.filters[fi];
+            entries.push_back({ subfilter.matchMask, subfilter.matchValue, extractorIndex });
+        }
+    }
+
+    if (extractors.size() < 2)
+        return nullptr;
+
+    std::sort(entries.begin(), entries.end(), [] (const Entry &a, const Entry &b) {
+        return std::tie(a.matchMask, a.matchValue, a.extractorIndex)
+            < std::tie(b.matchMask, b.matchValue, b.extractorIndex);
+    });
+
+    // Multiple subfilters of the same extractor can share mask and value.
+    entries.erase(
+        std::unique(entries.begin(), entries.end(), [] (const Entry &a, const Entry &b) {
+            return (a.matchMask == b.matchMask
+                    && a.matchValue == b.matchValue
+                    && a.extractorIndex == b.extractorIndex);
+        }),
+        entries.end());
+
+    s32 groupCount = 0;
+    s32 valueCount = 0;
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (i == 0 || entries[i].matchMask != entries[i - 1].matchMask)
+            groupCount++;
+
+        if (i == 0 || entries[i].matchMask != entries[i - 1].matchMask
+            || entries[i].matchValue != entries[i - 1].matchValue)
+        {
+            valueCount++;
+        }
+    }
+
+    auto result = arena->pushStruct<ExtractorDispatch>();
+    *result = {};
+
+    result->groups = arena->pushArray<ExtractorDispatch::MaskGroup>(groupCount);
+    result->values = arena->pushArray<u32>(valueCount);
+    result->firstTarget = arena->pushArray<s32>(valueCount + 1);
+    result->targets = arena->pushArray<u16>(entries.size());
+    result->extractors = arena->pushArray<DataSource *>(extractors.size());
+    result->extractorCount = extractors.size();
+    result->lastSeen = arena->pushArray<u32>(extractors.size());
+    result->wordSerial = 0;
+
+    std::copy(extractors.begin(), extractors.end(), result->extractors);
+    std::fill(result->lastSeen, result->lastSeen + result->extractorCount, 0u);
+
+    s32 valueIndex = -1;
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const auto &entry = entries[i];
+        const bool newGroup = (i == 0 || entry.matchMask != entries[i - 1].matchMask);
+
+        if (newGroup || entry.matchValue != entries[i - 1].matchValue)
+        {
+            valueIndex++;
+            result->values[valueIndex] = entry.matchValue;
+            result->firstTarget[valueIndex] = i;
+        }
+
+        if (newGroup)
+        {
+            auto &group = result->groups[result->groupCount++];
+            group.matchMask = entry.matchMask;
+            group.firstValue = valueIndex;
+            group.valueCount = 0;
+        }
+
+        auto &group = result->groups[result->groupCount - 1];
+        group.valueCount = valueIndex - group.firstValue + 1;
+
+        result->targets[i] = entry.extractorIndex;
+    }
+
+    result->firstTarget[valueCount] = entries.size();
+
+    assert(result->groupCount == groupCount);
+    assert(valueIndex + 1 == valueCount);
+
+    return result;
+}
+
+void extractor_dispatch_process_module_data(
+    ExtractorDispatch *dispatch, const u32 *data, u32 size)
+{
+    assert(memory::is_aligned(data, ModuleDataAlignment));
+
+    for (u32 wordIndex = 0; wordIndex < size; wordIndex++)
+    {
+        const u32 dataWord = data[wordIndex];
+
+        if (unlikely(++dispatch->wordSerial == 0))
+        {
+            std::fill(dispatch->lastSeen, dispatch->lastSeen + dispatch->extractorCount, 0u);
+            dispatch->wordSerial = 1;
+        }
 
-        if (process_data(&ex->filter, dataWord, wordIndex))
+        for (s32 gi = 0; gi < dispatch->groupCount; gi++)
         {
-            ex->currentCompletions++;
+            const auto &group = dispatch->groups[gi];
+            const u32 *valuesBegin = dispatch->values + group.firstValue;
+            const u32 *valuesEnd   = valuesBegin + group.valueCount;
+            const u32 *it = std::lower_bound(valuesBegin, valuesEnd, dataWord & group.matchMask);
 
-            if (ex->currentCompletions >= ex->requiredCompletions)
+            if (it == valuesEnd || *it != (dataWord & group.matchMask))
+                continue;
+
+            const s32 valueIndex = it - dispatch->values;
+
+            for (s32 ti = dispatch->firstTarget[valueIndex];
+                 ti < dispatch->firstTarget[valueIndex + 1];
+                 ti++)
             {
-                ex->currentCompletions = 0;
-                u64  address = extract(&ex->filter, MultiWordFilter::CacheA);
-                double value = static_cast<double>(extract(&ex->filter, MultiWordFilter::CacheD));
+                const u16 extractorIndex = dispatch->targets[ti];
 
-                assert(address < static_cast<u64>(ds->output.data.size));
+                if (dispatch->lastSeen[extractorIndex] == dispatch->wordSerial)
+                    continue;
 
-                if (!is_param_valid(ds->output.data[address]))
-                {
-                    if (!(ex->options & DataSourceOptions::NoAddedRandom))
-                        value += RealDist01(ex->rng);
+                dispatch->lastSeen[extractorIndex] = dispatch->wordSerial;
 
-                    ds->output.data[address] = value;
-                    ds->hitCounts[address]++;
-                }
+                DataSource *ds = dispatch->extractors[extractorIndex];
+                auto ex = reinterpret_cast<Extractor *>(ds->d);
+                extractor_process_data_word(ds, ex, dataWord, wordIndex);
             }
-
-            clear_completion(&ex->filter);
         }
     }
 }
@@ -378,7 +578,11 @@ DataSource make_datasource_listfilter_extractor(
 void listfilter_extractor_begin_event(DataSource *ds)
 {
     assert(ds->type == DataSource_ListFilterExtractor);
-    invalidate_all(ds->output.data);
+
+    if (ds->validIndexes)
+        invalidate_valid(ds->output.data, ds->validIndexes);
+    else
+        invalidate_all(ds->output.data);
 }
 
 const u32 *listfilter_extractor_process_module_data(DataSource *ds, const u32 *data, u32 dataSize)
@@ -432,6 +636,9 @@ const u32 *listfilter_extractor_process_module_data(DataSource *ds, const u32 *d
 
             ds->output.data[address] = value;
             ds->hitCounts[address]++;
+
+            if (ds->validIndexes)
+                push_valid_index(ds->validIndexes, static_cast<s32>(address));
         }
 
         if (curPtr >= data + dataSize)
@@ -497,8 +704,35 @@ inline double calibrate(
 struct CalibrationData
 {
     ParamVec calibFactors;
+
+    // Set by a2_link_valid_indexes() if the input has a valid index list.
+    const ValidIndexes *inputValid;
+    ValidIndexes *outputValid;
 };
 
+void calibration_step_sparse(Operator *op, CalibrationData *d)
+{
+    auto input = op->inputs[0];
+    auto output = op->outputs[0];
+
+    invalidate_valid(output, d->outputValid);
+
+    // The calibration of a valid parameter is valid so the output list is the
+    // input list.
+    for (s32 i = 0; i < d->inputValid->count; i++)
+    {
+        s32 idx = d->inputValid->indexes[i];
+
+        output[idx] = calibrate(
+            input[idx], op->inputLowerLimits[0][idx],
+            op->outputLowerLimits[0][idx], d->calibFactors[idx]);
+
+        d->outputValid->indexes[i] = idx;
+    }
+
+    d->outputValid->count = d->inputValid->count;
+}
+
 void calibration_step(Operator *op, A2 *)
 {
     a2_trace("\n");
@@ -508,6 +742,13 @@ void calibration_step(Operator *op, A2 *)
     assert(op->type == Operator_Calibration);
 
     auto d = reinterpret_cast<CalibrationData *>(op->d);
+
+    if (d->inputValid)
+    {
+        calibration_step_sparse(op, d);
+        return;
+    }
+
     s32 maxIdx = op->inputs[0].size;
 
     for (s32 idx = 0; idx < maxIdx; idx++)
@@ -614,6 +855,8 @@ Operator make_calibration(
 
     auto cdata = arena->pushStruct<CalibrationData>();
     cdata->calibFactors = push_param_vector(arena, input.data.size);
+    cdata->inputValid = nullptr;
+    cdata->outputValid = nullptr;
 
     double calibRange = unitMax - unitMin;
 
@@ -652,6 +895,8 @@ Operator make_calibration(
 
     auto cdata = arena->pushStruct<CalibrationData>();
     cdata->calibFactors = push_param_vector(arena, input.data.size);
+    cdata->inputValid = nullptr;
+    cdata->outputValid = nullptr;
 
     for (s32 i = 0; i < input.data.size; i++)
     {
@@ -2317,26 +2562,40 @@ Operator make_expression_operator(
         {
             register_symbol(d->symtab_step, addVector, prefix,
                             input.data.data, input.data.size);
+            register_symbol(d->symtab_compiled, addVector, prefix,
+                            input.data.data, input.data.size);
 
             register_symbol(d->symtab_step, addVector, prefix + ".lower_limits",
                             input.lowerLimits.data, input.lowerLimits.size);
+            register_symbol(d->symtab_compiled, addVector, prefix + ".lower_limits",
+                            input.lowerLimits.data, input.lowerLimits.size);
 
             register_symbol(d->symtab_step, addVector, prefix + ".upper_limits",
                             input.upperLimits.data, input.upperLimits.size);
+            register_symbol(d->symtab_compiled, addVector, prefix + ".upper_limits",
+                            input.upperLimits.data, input.upperLimits.size);
 
             register_symbol(d->symtab_step, addConstant, prefix + ".size",
                             input.lowerLimits.size);
+            register_symbol(d->symtab_compiled, addConstant, prefix + ".size",
+                            input.lowerLimits.size);
         }
         else
         {
             register_symbol(d->symtab_step, addScalar, prefix,
                             input.data.data[pi]);
+            register_symbol(d->symtab_compiled, addScalar, prefix,
+                            input.data.data[pi]);
 
             register_symbol(d->symtab_step, addScalar, prefix + ".lower_limit",
                             input.lowerLimits.data[pi]);
+            register_symbol(d->symtab_compiled, addScalar, prefix + ".lower_limit",
+                            input.lowerLimits.data[pi]);
 
             register_symbol(d->symtab_step, addScalar, prefix + ".upper_limit",
                             input.upperLimits.data[pi]);
+            register_symbol(d->symtab_compiled, addScalar, prefix + ".upper_limit",
+                            input.upperLimits.data[pi]);
         }
     }
 
@@ -2372,14 +2631,23 @@ Operator make_expression_operator(
         register_symbol(d->symtab_step, addVector, outSpec.name,
                         result.outputs[out_idx].data, result.outputs[out_idx].size);
 
+        register_symbol(d->symtab_compiled, addVector, outSpec.name,
+                        result.outputs[out_idx].data, result.outputs[out_idx].size);
+
         register_symbol(d->symtab_step, addVector, outSpec.name + ".lower_limits",
                         result.outputLowerLimits[out_idx].data, result.outputLowerLimits[out_idx].size);
+        register_symbol(d->symtab_compiled, addVector, outSpec.name + ".lower_limits",
+                        result.outputLowerLimits[out_idx].data, result.outputLowerLimits[out_idx].size);
 
         register_symbol(d->symtab_step, addVector, outSpec.name + ".upper_limits",
                         result.outputUpperLimits[out_idx].data, result.outputUpperLimits[out_idx].size);
+        register_symbol(d->symtab_compiled, addVector, outSpec.name + ".upper_limits",
+                        result.outputUpperLimits[out_idx].data, result.outputUpperLimits[out_idx].size);
 
         register_symbol(d->symtab_step, addConstant, outSpec.name + ".size",
                         result.outputs[out_idx].size);
+        register_symbol(d->symtab_compiled, addConstant, outSpec.name + ".size",
+                        result.outputs[out_idx].size);
 
         register_symbol(d->symtab_step, createString, outSpec.name + ".unit",
                         outSpec.unit);
@@ -2406,6 +2674,25 @@ void expression_operator_compile_step_expression(Operator *op)
     auto d = reinterpret_cast<ExpressionOperatorData *>(op->d);
 
     d->expr_step.compile();
+
+    d->expr_step_compiled.reset();
+    d->expr_step_fallback_reason.clear();
+
+    if (std::getenv("MVME_DISABLE_EXPR_COMPILER"))
+    {
+        d->expr_step_fallback_reason = "disabled via MVME_DISABLE_EXPR_COMPILER";
+        return;
+    }
+
+    try
+    {
+        d->expr_step_compiled = std::make_unique<expr_compiler::Program>(
+            expr_compiler::compile(d->expr_step.getExpressionString(), d->symtab_compiled));
+    }
+    catch (const expr_compiler::UnsupportedExpression &e)
+    {
+        d->expr_step_fallback_reason = e.what();
+    }
 }
 
 void expression_operator_step(Operator *op, A2 *)
@@ -2417,7 +2704,10 @@ void expression_operator_step(Operator *op, A2 *)
     /* References to the input and output have been bound in
      * make_expression_operator(). No need to pass anything here, just evaluate
      * the step expression. */
-    d->expr_step.eval();
+    if (d->expr_step_compiled)
+        d->expr_step_compiled->run();
+    else
+        d->expr_step.eval();
 }
 
 /* ===============================================
@@ -2733,7 +3023,7 @@ inline bool range_check_update(H1D *histo, double x)
     return false;
 }
 
-inline void HistoFillDirect::fill_h1d(H1D *histo, double x)
+void HistoFillDirect::fill_h1d(H1D *histo, double x)
 {
     assert(histo);
 
@@ -2744,12 +3034,36 @@ inline void HistoFillDirect::fill_h1d(H1D *histo, double x)
         //s32 bin = static_cast<s32>(get_bin_unchecked(histo->binning, histo->size, x));
         s32 bin = static_cast<s32>(get_bin_unchecked(x, histo->binning.min, histo->binningFactor));
 
-        histo->data[bin]++;
+        increment_bin(histo, bin);
         histo->entryCount++;
     }
 }
 
-inline void HistoFillDirect::fill_h2d(H2D *histo, double x, double y)
+void HistoFillDirect::fill_h1d_sink(H1DSinkData *d, const ParamVec &input)
+{
+    assert(input.size == d->histos.size);
+    assert(d->binMins && d->binMaxs && d->binFactors);
+
+    static const H1DFillKernel kernel = get_h1d_fill_kernel();
+
+    kernel(d->histos.data, input.data, d->binMins, d->binMaxs, d->binFactors, input.size);
+}
+
+void HistoFillDirect::fill_h1d_sink_sparse(H1DSinkData *d, const ParamVec &input,
+                                          const ValidIndexes &valid)
+{
+    assert(input.size == d->histos.size);
+
+    for (s32 i = 0; i < valid.count; i++)
+    {
+        s32 idx = valid.indexes[i];
+        fill_h1d(&d->histos[idx], input[idx]);
+    }
+}
+
+// Returns the linear bin number for (x, y) if both values are in range.
+// Otherwise updates overflow/underflow of the histo and returns -1.
+inline s32 h2d_linear_bin_or_update(H2D *histo, double x, double y)
 {
     if (x < histo->binnings[H2D::XAxis].min)
     {
@@ -2801,7 +3115,19 @@ inline void HistoFillDirect::fill_h2d(H2D *histo, double x, double y)
 
         assert(0 <= linearBin && linearBin < histo->size);
 
-        histo->data[linearBin]++;
+        return linearBin;
+    }
+
+    return -1;
+}
+
+void HistoFillDirect::fill_h2d(H2D *histo, double x, double y)
+{
+    s32 linearBin = h2d_linear_bin_or_update(histo, x, y);
+
+    if (linearBin >= 0)
+    {
+        increment_bin(histo, linearBin);
         histo->entryCount++;
     }
 }
@@ -2810,176 +3136,405 @@ inline void HistoFillDirect::fill_h2d(H2D *histo, double x, double y)
 // HistoFillBuffered
 //
 
-inline bool is_full(const FillBuffer &buffer)
+namespace
 {
-    return buffer.used >= buffer.bins.size();
-}
 
-void flush(H1D *histo, FillBuffer &buffer)
+// Returns the number of bits needed to store the values [0, n).
+inline u32 bits_needed(u64 n)
 {
-    //std::sort(std::begin(buffer.bins), std::end(buffer.bins));
+    u32 result = 0;
 
-    for (size_t i=0; i<buffer.used; i++)
-    {
-        s32 bin = buffer.bins[i];
-        histo->data[bin]++;
-    }
+    while ((u64(1) << result) < n)
+        result++;
 
-    histo->entryCount += buffer.used;
-    buffer.used = 0;
+    return result;
 }
 
-HistoFillBuffered::HistoFillBuffered()
-    : m_arena(1024 * 1024 * 256)
-{}
+} // end anon namespace
+
+const u32 HistoFillBuffered::DefaultCapacity;
+const u32 HistoFillBuffered::BucketBits;
 
 void HistoFillBuffered::begin_run(A2 *a2)
 {
-    m_arena.reset();
+    m_buffers.clear();
+
+    std::vector<FillBuffer **> bufferPointers;
+    std::vector<size_t> keyOffsets;
+    size_t keyCount = 0;
+    u32 maxCapacity = 0;
 
-    std::vector<H1D *> histos_1d;
+    auto add_buffer = [&] (FillBuffer **dest, H1D *h1ds, H2D *h2d,
+                           s32 histoCount, s32 maxHistoSize, s32 keysPerEvent)
+    {
+        *dest = nullptr;
+
+        const u32 binBits = bits_needed(maxHistoSize);
+        const u32 keyBits = binBits + bits_needed(histoCount);
+
+        if (keyBits > 32)
+            return;
 
-    for (unsigned ei=0; ei<a2->operatorCounts.size(); ++ei)
+        FillBuffer buffer = {};
+        buffer.used = 0;
+        buffer.capacity = std::max(DefaultCapacity, static_cast<u32>(keysPerEvent));
+        buffer.binBits = binBits;
+        buffer.bucketShift = keyBits > BucketBits ? keyBits - BucketBits : 0;
+        buffer.h1ds = h1ds;
+        buffer.h2d = h2d;
+
+        m_buffers.push_back(buffer);
+        bufferPointers.push_back(dest);
+        keyOffsets.push_back(keyCount);
+        keyCount += buffer.capacity;
+        maxCapacity = std::max(maxCapacity, buffer.capacity);
+    };
+
+    for (s32 ei = 0; ei < MaxVMEEvents; ei++)
     {
-        const auto opCount = a2->operatorCounts[ei];
+        const int opCount = a2->operatorCounts[ei];
 
-        for (unsigned opIdx = 0; opIdx < opCount; ++opIdx)
+        for (int opIdx = 0; opIdx < opCount; opIdx++)
         {
-            const auto &op = a2->operators[ei][opIdx];
+            Operator *op = a2->operators[ei] + opIdx;
 
-            if (op.type == Operator_H1DSink)
+            switch (op->type)
             {
-                auto d = reinterpret_cast<H1DSinkData *>(op.d);
+                case Operator_H1DSink:
+                case Operator_H1DSink_idx:
+                    {
+                        // H1DSinkData_idx derives from H1DSinkData
+                        auto d = reinterpret_cast<H1DSinkData *>(op->d);
+                        s32 maxHistoSize = 0;
 
-                for (auto &h1d: d->histos)
-                    histos_1d.push_back(&h1d);
+                        for (const auto &histo: d->histos)
+                            maxHistoSize = std::max(maxHistoSize, histo.size);
 
-            }
-            else if (op.type == Operator_H1DSink_idx)
-            {
-                auto d = reinterpret_cast<H1DSinkData_idx *>(op.d);
+                        add_buffer(&d->fillBuffer, d->histos.data, nullptr,
+                                   d->histos.size, maxHistoSize, d->histos.size);
+                    } break;
+
+                case Operator_H2DSink:
+                    {
+                        auto d = reinterpret_cast<H2DSinkData *>(op->d);
+                        add_buffer(&d->fillBuffer, nullptr, &d->histo, 1, d->histo.size, 1);
+                    } break;
 
-                histos_1d.push_back(&d->histos[d->inputIndex]);
+                default:
+                    break;
             }
         }
     }
 
-    // Sort so that std::lower_bound() works.
-    std::sort(std::begin(histos_1d), std::end(histos_1d));
+    m_keyStorage.resize(keyCount);
+    m_scratch.resize(maxCapacity);
 
-    m_histos =  push_copy_typed_block(&m_arena, histos_1d);
-    m_buffers = push_typed_block<FillBuffer, size_t>(&m_arena, m_histos.size);
+    for (size_t bi = 0; bi < m_buffers.size(); bi++)
+    {
+        m_buffers[bi].keys = m_keyStorage.data() + keyOffsets[bi];
+        *bufferPointers[bi] = &m_buffers[bi];
+    }
 }
 
 void HistoFillBuffered::end_run(A2 *)
 {
-    for (size_t i=0; i<m_histos.size; i++)
-    {
-        auto histo = m_histos[i];
-        auto &buffer = m_buffers[i];
-        flush(histo, buffer);
-    }
+    flush();
 }
 
-void HistoFillBuffered::fill_h1d(H1D *histo, double x)
+void HistoFillBuffered::release(A2 *a2)
 {
-    if (range_check_update(histo, x))
+    for (s32 ei = 0; ei < MaxVMEEvents; ei++)
     {
-        auto it = std::lower_bound(m_histos.begin(), m_histos.end(), histo);
-        assert(it != m_histos.end());
-        auto idx = it - m_histos.begin();
-
-        auto &buffer = m_buffers[idx];
-        assert(buffer.used < buffer.bins.size());
-
-        assert(0 <= get_bin(*histo, x) && get_bin(*histo, x) < histo->size);
+        const int opCount = a2->operatorCounts[ei];
 
-        s32 bin = static_cast<s32>(get_bin_unchecked(x, histo->binning.min, histo->binningFactor));
-        buffer.bins[buffer.used++] = bin;
+        for (int opIdx = 0; opIdx < opCount; opIdx++)
+        {
+            Operator *op = a2->operators[ei] + opIdx;
 
-        if (is_full(buffer))
-            flush(histo, buffer);
+            if (op->type == Operator_H1DSink || op->type == Operator_H1DSink_idx)
+                reinterpret_cast<H1DSinkData *>(op->d)->fillBuffer = nullptr;
+            else if (op->type == Operator_H2DSink)
+                reinterpret_cast<H2DSinkData *>(op->d)->fillBuffer = nullptr;
+        }
     }
-}
 
-void HistoFillBuffered::fill_h2d(H2D *histo, double x, double y)
-{
-    HistoFillDirect().fill_h2d(histo, x, y);
+    m_buffers = {};
+    m_keyStorage = {};
+    m_scratch = {};
 }
 
-inline double get_value(H1D histo, double x)
+void HistoFillBuffered::flush()
 {
-    s32 bin = get_bin(histo, x);
-    return (bin < 0) ? 0.0 : histo.data[bin];
+    for (auto &buffer: m_buffers)
+        flush(&buffer);
 }
 
-void clear_histo(H1D *histo)
+void HistoFillBuffered::flush(FillBuffer *buffer)
 {
-    histo->binningFactor = 0.0;
-    histo->entryCount = 0.0;
+    if (!buffer->used)
+        return;
 
-    if (histo->underflow)
-        *histo->underflow = 0.0;
+    // Counting sort by the high bits of the keys. The order inside a bucket is
+    // kept but is not relevant: a bucket covers a small enough memory region.
+    std::array<u32, (1u << BucketBits) + 1> bucketStarts = {};
 
-    if (histo->overflow)
-        *histo->overflow = 0.0;
+    for (u32 i = 0; i < buffer->used; i++)
+        bucketStarts[(buffer->keys[i] >> buffer->bucketShift) + 1]++;
+
+    for (size_t i = 1; i < bucketStarts.size(); i++)
+        bucketStarts[i] += bucketStarts[i - 1];
 
-    for (s32 i = 0; i < histo->size; i++)
+    u32 *sorted = m_scratch.data();
+
+    for (u32 i = 0; i < buffer->used; i++)
     {
-        histo->data[i] = 0.0;
+        u32 key = buffer->keys[i];
+        sorted[bucketStarts[key >> buffer->bucketShift]++] = key;
     }
-}
-
-/* Note: The H1D instances in the 'histos' variable are copied. This means
- * during runtime only the H1D structures inside H1DSinkData are updated.
- * Histogram storage itself is not copied. It is assumed that this storage is
- * handled separately.
- * The implementation could be changed to store an array of pointers to H1D.
- * Then the caller would have to keep the H1D instances around too.
- */
-Operator make_h1d_sink(
-    Arena *arena,
-    PipeVectors inPipe,
-    TypedBlock<H1D, s32> histos)
-{
-    assert(inPipe.data.size == histos.size);
-    auto result = make_operator(arena, Operator_H1DSink, 1, 0);
-    assign_input(&result, inPipe, 0);
 
-    auto d = arena->pushStruct<H1DSinkData>();
-    result.d = d;
+    if (buffer->h2d)
+    {
+        auto histo = buffer->h2d;
 
-    d->histos = push_typed_block<H1D, s32>(arena, histos.size);
+        for (u32 i = 0; i < buffer->used; i++)
+        {
+            assert(static_cast<s32>(sorted[i]) < histo->size);
+            increment_bin(histo, sorted[i]);
+        }
 
-    for (s32 i = 0; i < histos.size; i++)
+        histo->entryCount += buffer->used;
+    }
+    else
     {
-        d->histos[i] = histos[i];
+        const u32 binMask = static_cast<u32>((u64(1) << buffer->binBits) - 1);
+
+        for (u32 i = 0; i < buffer->used; i++)
+        {
+            auto &histo = buffer->h1ds[sorted[i] >> buffer->binBits];
+            u32 bin = sorted[i] & binMask;
+
+            assert(static_cast<s32>(bin) < histo.size);
+            increment_bin(&histo, bin);
+            histo.entryCount++;
+        }
     }
 
-    return result;
+    buffer->used = 0;
 }
 
-void h1d_sink_step(Operator *op, A2 *a2)
+void HistoFillBuffered::fill_h1d_sink(H1DSinkData *d, const ParamVec &input)
 {
-    a2_trace("\n");
-    auto d = reinterpret_cast<H1DSinkData *>(op->d);
-    s32 maxIdx = op->inputs[0].size;
+    assert(input.size == d->histos.size);
 
-    for (s32 idx = 0; idx < maxIdx; idx++)
+    auto buffer = d->fillBuffer;
+    make_room(buffer, input.size);
+
+    for (s32 idx = 0; idx < input.size; idx++)
     {
-        a2->histoFillStrategy.fill_h1d(&d->histos[idx], op->inputs[0][idx]);
+        auto histo = &d->histos[idx];
+        double x = input[idx];
+
+        if (range_check_update(histo, x))
+        {
+            assert(0 <= get_bin(*histo, x) && get_bin(*histo, x) < histo->size);
+
+            u32 bin = static_cast<u32>(get_bin_unchecked(x, histo->binning.min, histo->binningFactor));
+            buffer->keys[buffer->used++] = (static_cast<u32>(idx) << buffer->binBits) | bin;
+        }
     }
 }
 
-void h1d_sink_step_idx(Operator *op, A2 *a2)
+void HistoFillBuffered::fill_h1d_sink_sparse(H1DSinkData *d, const ParamVec &input,
+                                             const ValidIndexes &valid)
 {
-    a2_trace("\n");
-    auto d = reinterpret_cast<H1DSinkData_idx *>(op->d);
+    assert(input.size == d->histos.size);
 
-    assert(d->histos.size == 1);
-    assert(d->inputIndex < op->inputs[0].size);
+    auto buffer = d->fillBuffer;
+    make_room(buffer, valid.count);
+
+    for (s32 i = 0; i < valid.count; i++)
+    {
+        s32 idx = valid.indexes[i];
+        auto histo = &d->histos[idx];
+        double x = input[idx];
 
-    a2->histoFillStrategy.fill_h1d(&d->histos[0], op->inputs[0][d->inputIndex]);
+        if (range_check_update(histo, x))
+        {
+            assert(0 <= get_bin(*histo, x) && get_bin(*histo, x) < histo->size);
+
+            u32 bin = static_cast<u32>(get_bin_unchecked(x, histo->binning.min, histo->binningFactor));
+            buffer->keys[buffer->used++] = (static_cast<u32>(idx) << buffer->binBits) | bin;
+        }
+    }
+}
+
+void HistoFillBuffered::fill_h1d_sink_idx(H1DSinkData_idx *d, double x)
+{
+    auto histo = &d->histos[0];
+
+    if (range_check_update(histo, x))
+    {
+        auto buffer = d->fillBuffer;
+        make_room(buffer, 1);
+
+        assert(0 <= get_bin(*histo, x) && get_bin(*histo, x) < histo->size);
+
+        u32 bin = static_cast<u32>(get_bin_unchecked(x, histo->binning.min, histo->binningFactor));
+        buffer->keys[buffer->used++] = bin;
+    }
+}
+
+void HistoFillBuffered::fill_h2d_sink(H2DSinkData *d, double x, double y)
+{
+    s32 linearBin = h2d_linear_bin_or_update(&d->histo, x, y);
+
+    if (linearBin >= 0)
+    {
+        auto buffer = d->fillBuffer;
+        make_room(buffer, 1);
+        buffer->keys[buffer->used++] = static_cast<u32>(linearBin);
+    }
+}
+
+//
+// HistoFillStrategy
+//
+
+const char *to_string(HistoFillStrategyType type)
+{
+    switch (type)
+    {
+        case HistoFillStrategyType::Direct:
+            return "Direct";
+
+        case HistoFillStrategyType::Buffered:
+            return "Buffered";
+    }
+
+    return "";
+}
+
+const char *HistoFillStrategy::name() const
+{
+    switch (m_type)
+    {
+        case HistoFillStrategyType::Direct:
+            return HistoFillDirect::name();
+
+        case HistoFillStrategyType::Buffered:
+            return HistoFillBuffered::name();
+    }
+
+    return "";
+}
+
+void HistoFillStrategy::begin_run(A2 *a2)
+{
+    if (m_type == HistoFillStrategyType::Buffered)
+        m_buffered.begin_run(a2);
+    else
+        m_buffered.release(a2);
+}
+
+void HistoFillStrategy::end_run(A2 *a2)
+{
+    m_buffered.end_run(a2);
+}
+
+inline double get_value(H1D histo, double x)
+{
+    s32 bin = get_bin(histo, x);
+    if (bin < 0)
+        return 0.0;
+    return histo.data ? histo.data[bin] : histo.compact->get(bin);
+}
+
+void clear_histo(H1D *histo)
+{
+    histo->binningFactor = 0.0;
+    histo->entryCount = 0.0;
+
+    if (histo->underflow)
+        *histo->underflow = 0.0;
+
+    if (histo->overflow)
+        *histo->overflow = 0.0;
+
+    if (histo->data)
+    {
+        for (s32 i = 0; i < histo->size; i++)
+        {
+            histo->data[i] = 0.0;
+        }
+    }
+
+    if (histo->compact)
+        histo->compact->clear();
+
+    if (histo->tileGenerations && histo->size > 0)
+    {
+        for (s32 tile = 0; tile <= ((histo->size - 1) >> histo->tileShift); tile++)
+            ++histo->tileGenerations[tile];
+    }
+}
+
+/* Note: The H1D instances in the 'histos' variable are copied. This means
+ * during runtime only the H1D structures inside H1DSinkData are updated.
+ * Histogram storage itself is not copied. It is assumed that this storage is
+ * handled separately.
+ * The implementation could be changed to store an array of pointers to H1D.
+ * Then the caller would have to keep the H1D instances around too.
+ */
+Operator make_h1d_sink(
+    Arena *arena,
+    PipeVectors inPipe,
+    TypedBlock<H1D, s32> histos)
+{
+    assert(inPipe.data.size == histos.size);
+    auto result = make_operator(arena, Operator_H1DSink, 1, 0);
+    assign_input(&result, inPipe, 0);
+
+    auto d = arena->pushStruct<H1DSinkData>();
+    result.d = d;
+
+    d->histos = push_typed_block<H1D, s32>(arena, histos.size);
+    d->binMins = push_param_vector(arena, histos.size).data;
+    d->binMaxs = push_param_vector(arena, histos.size).data;
+    d->binFactors = push_param_vector(arena, histos.size).data;
+    d->fillBuffer = nullptr;
+    d->inputValid = nullptr;
+
+    for (s32 i = 0; i < histos.size; i++)
+    {
+        d->histos[i] = histos[i];
+        d->binMins[i] = histos[i].binning.min;
+        d->binMaxs[i] = histos[i].binning.min + histos[i].binning.range;
+        d->binFactors[i] = histos[i].binningFactor;
+    }
+
+    return result;
+}
+
+void h1d_sink_step(Operator *op, A2 *a2)
+{
+    a2_trace("\n");
+    auto d = reinterpret_cast<H1DSinkData *>(op->d);
+
+    if (d->inputValid)
+        a2->histoFillStrategy.fill_h1d_sink_sparse(d, op->inputs[0], *d->inputValid);
+    else
+        a2->histoFillStrategy.fill_h1d_sink(d, op->inputs[0]);
+}
+
+void h1d_sink_step_idx(Operator *op, A2 *a2)
+{
+    a2_trace("\n");
+    auto d = reinterpret_cast<H1DSinkData_idx *>(op->d);
+
+    assert(d->histos.size == 1);
+    assert(d->inputIndex < op->inputs[0].size);
+
+    a2->histoFillStrategy.fill_h1d_sink_idx(d, op->inputs[0][d->inputIndex]);
 }
 
 Operator make_h1d_sink_idx(
@@ -2998,6 +3553,9 @@ Operator make_h1d_sink_idx(
     result.d = d;
 
     d->histos = push_typed_block<H1D, s32>(arena, histos.size);
+    d->binMins = d->binMaxs = d->binFactors = nullptr;
+    d->fillBuffer = nullptr;
+    d->inputValid = nullptr;
     d->inputIndex = inputIndex;
 
     for (s32 i = 0; i < histos.size; i++)
@@ -3024,7 +3582,7 @@ Operator make_h2d_sink(
     assign_input(&result, xInput, 0);
     assign_input(&result, yInput, 1);
 
-    auto d = arena->push<H2DSinkData>({ histo, xIndex, yIndex });
+    auto d = arena->push<H2DSinkData>({ histo, xIndex, yIndex, nullptr });
     result.d = d;
 
     return result;
@@ -3036,8 +3594,8 @@ void h2d_sink_step(Operator *op, A2 *a2)
 
     auto d = reinterpret_cast<H2DSinkData *>(op->d);
 
-    a2->histoFillStrategy.fill_h2d(
-        &d->histo,
+    a2->histoFillStrategy.fill_h2d_sink(
+        d,
         op->inputs[0][d->xIndex],
         op->inputs[1][d->yIndex]);
 }
@@ -3335,6 +3893,9 @@ Operator make_export_sink(
         case ExportSinkFormat::Sparse:
             result = make_operator(arena, Operator_ExportSinkSparse, inputCount, 0);
             break;
+        case ExportSinkFormat::Columnar:
+            result = make_operator(arena, Operator_ExportSinkColumnar, inputCount, 0);
+            break;
     }
 
     auto d = arena->pushObject<ExportSinkData>();
@@ -3360,8 +3921,6 @@ Operator make_export_sink(
     return result;
 }
 
-static const size_t CompressionBufferSize = 1u << 20;
-
 /* NOTE: About error handling in the ExportSink:
  * - std::ofstream by default has exceptions disabled. The method rdstate() can
  *   be used to query the status of the error bits after each operation.
@@ -3369,33 +3928,53 @@ static const size_t CompressionBufferSize = 1u << 20;
  * - The zstr implementation enables exceptions by default and from looking at
  *   the code the implementation assumes that exceptions stay enabled.
  *
- * > The export sink code enables exceptions both for the low level ofstream
+ * > The ExportSinkWriter enables exceptions both for the low level ofstream
  *   and for the zstr ostream.
  *
- *   All I/O operations must be wrapped in a try/catch block. Additionally any
- *   further I/O operations are only performed if the good() method of the
- *   stream returns true. This means after the first I/O exception is caught no
- *   further attempts at writing to the file are performed.
+ *   Opening the file happens on the analysis thread in begin_run() and errors
+ *   are reported directly. All further I/O is done by the writer thread.
+ *   Errors there are passed to setLastError() and the writer stops writing
+ *   to the file. The step functions check writer.good() and skip serializing
+ *   the event data once an error occured.
  */
 
+// The condition input is the last input if it's used.
+static s32 export_sink_data_input_count(const Operator *op, const ExportSinkData *d)
+{
+    return d->condIndex >= 0 ? op->inputCount - 1 : op->inputCount;
+}
+
 void export_sink_begin_run(Operator *op, Logger logger)
 {
     a2_trace("\n");
     assert(op->type == Operator_ExportSinkFull
-           || op->type == Operator_ExportSinkSparse);
+           || op->type == Operator_ExportSinkSparse
+           || op->type == Operator_ExportSinkColumnar);
 
     auto d = reinterpret_cast<ExportSinkData *>(op->d);
 
-    d->ostream.reset(new std::ofstream(d->filename, std::ios::binary | std::ios::trunc));
-
-    // Enable ios exceptions for the lowest level output stream. This operation can throw.
     try
     {
-        d->ostream->exceptions(std::ios::failbit | std::ios::badbit);
+        if (op->type == Operator_ExportSinkColumnar)
+        {
+            // Column chunks are compressed individually, the file itself is
+            // not compressed.
+            std::vector<u16> dimensions;
+
+            for (s32 ii = 0; ii < export_sink_data_input_count(op, d); ii++)
+                dimensions.push_back(static_cast<u16>(op->inputs[ii].size));
 
-        if (d->compressionLevel != 0)
+            d->writer.open(d->filename, 0,
+                           [d] (const std::string &msg) { d->setLastError(msg); });
+
+            d->columnar = std::make_unique<ColumnarExportEncoder>(
+                dimensions, d->compressionLevel);
+            d->columnar->begin(d->writer);
+        }
+        else
         {
-            d->z_ostream.reset(new zstr::ostream(*d->ostream));
+            d->writer.open(d->filename, d->compressionLevel,
+                           [d] (const std::string &msg) { d->setLastError(msg); });
         }
 
         std::ostringstream ss;
@@ -3417,12 +3996,9 @@ void export_sink_full_step(Operator *op, A2 *)
     assert(op->type == Operator_ExportSinkFull);
 
     auto d = reinterpret_cast<ExportSinkData *>(op->d);
+    auto &writer = d->writer;
 
-    std::ostream *outp = (d->compressionLevel != 0
-                          ? d->z_ostream.get()
-                          : d->ostream.get());
-
-    if (!outp) return;
+    if (!writer.isOpen() || !writer.good()) return;
 
     s32 dataInputCount = op->inputCount;
 
@@ -3437,36 +4013,25 @@ void export_sink_full_step(Operator *op, A2 *)
         dataInputCount = op->inputCount - 1;
     }
 
-    try
-    {
-        if (outp->good())
-        {
-            for (s32 inputIndex = 0;
-                 inputIndex < dataInputCount && outp->good();
-                 inputIndex++)
-            {
-                auto input = op->inputs[inputIndex];
-                assert(input.size <= std::numeric_limits<u16>::max());
+    size_t bytesWritten = 0;
 
-                size_t bytes = input.size * sizeof(double);
+    for (s32 inputIndex = 0; inputIndex < dataInputCount; inputIndex++)
+    {
+        auto input = op->inputs[inputIndex];
+        assert(input.size <= std::numeric_limits<u16>::max());
 
-                outp->write(reinterpret_cast<char *>(input.data), bytes);
+        size_t bytes = input.size * sizeof(double);
 
-                d->bytesWritten += bytes;
-            }
+        writer.write(input.data, bytes);
 
-            d->eventsWritten++;
-        }
-    }
-    catch (const std::exception &e)
-    {
-        std::ostringstream ss;
-        ss << "Error writing to output file " << d->filename << ": " << e.what();
-        d->setLastError(ss.str());
+        bytesWritten += bytes;
     }
+
+    d->bytesWritten.fetch_add(bytesWritten, std::memory_order_relaxed);
+    d->eventsWritten.fetch_add(1, std::memory_order_relaxed);
 }
 
-static size_t write_indexed_parameter_vector(std::ostream &out, const ParamVec &vec)
+static size_t write_indexed_parameter_vector(ExportSinkWriter &out, const ParamVec &vec)
 {
     assert(vec.size >= 0);
     assert(vec.size <= std::numeric_limits<u16>::max());
@@ -3483,7 +4048,7 @@ static size_t write_indexed_parameter_vector(std::ostream &out, const ParamVec &
     // Write a size prefix and two arrays with length 'validCount', one
     // containing 16-bit index values, the other containing the corresponding
     // parameter values.
-    out.write(reinterpret_cast<char *>(&validCount), sizeof(validCount));
+    out.write(&validCount, sizeof(validCount));
     bytesWritten += sizeof(validCount);
 
     for (u16 i = 0; i < static_cast<u16>(vec.size); i++)
@@ -3491,7 +4056,7 @@ static size_t write_indexed_parameter_vector(std::ostream &out, const ParamVec &
         if (is_param_valid(vec[i]))
         {
             // 16-bit index value
-            out.write(reinterpret_cast<char *>(&i), sizeof(i));
+            out.write(&i, sizeof(i));
             bytesWritten += sizeof(i);
         }
     }
@@ -3501,7 +4066,7 @@ static size_t write_indexed_parameter_vector(std::ostream &out, const ParamVec &
         if (is_param_valid(vec[i]))
         {
             // 64-bit double value
-            out.write(reinterpret_cast<char *>(vec.data + i), sizeof(double));
+            out.write(vec.data + i, sizeof(double));
             bytesWritten += sizeof(double);
         }
     }
@@ -3509,18 +4074,44 @@ static size_t write_indexed_parameter_vector(std::ostream &out, const ParamVec &
     return bytesWritten;
 }
 
+/* Same output format as above but using the valid index list of the input
+ * instead of testing each parameter. */
+static size_t write_indexed_parameter_vector(ExportSinkWriter &out, const ParamVec &vec,
+                                             const ValidIndexes &valid)
+{
+    assert(vec.size <= std::numeric_limits<u16>::max());
+
+    size_t bytesWritten = 0;
+    u16 validCount = static_cast<u16>(valid.count);
+
+    out.write(&validCount, sizeof(validCount));
+    bytesWritten += sizeof(validCount);
+
+    for (s32 i = 0; i < valid.count; i++)
+    {
+        u16 index = static_cast<u16>(valid.indexes[i]);
+        out.write(&index, sizeof(index));
+        bytesWritten += sizeof(index);
+    }
+
+    for (s32 i = 0; i < valid.count; i++)
+    {
+        out.write(vec.data + valid.indexes[i], sizeof(double));
+        bytesWritten += sizeof(double);
+    }
+
+    return bytesWritten;
+}
+
 void export_sink_sparse_step(Operator *op, A2 *)
 {
     a2_trace("\n");
     assert(op->type == Operator_ExportSinkSparse);
 
     auto d = reinterpret_cast<ExportSinkData *>(op->d);
+    auto &writer = d->writer;
 
-    std::ostream *outp = (d->compressionLevel != 0
-                          ? d->z_ostream.get()
-                          : d->ostream.get());
-
-    if (!outp) return;
+    if (!writer.isOpen() || !writer.good()) return;
 
     s32 dataInputCount = op->inputCount;
 
@@ -3535,44 +4126,105 @@ void export_sink_sparse_step(Operator *op, A2 *)
         dataInputCount = op->inputCount - 1;
     }
 
-    try
+    size_t bytesWritten = 0;
+
+    for (s32 inputIndex = 0; inputIndex < dataInputCount; inputIndex++)
     {
-        if (outp->good())
+        auto input = op->inputs[inputIndex];
+        assert(input.size <= std::numeric_limits<u16>::max());
+
+        const ValidIndexes *valid =
+            (static_cast<size_t>(inputIndex) < d->inputValid.size()
+             ? d->inputValid[inputIndex] : nullptr);
+
+        bytesWritten += (valid
+                         ? write_indexed_parameter_vector(writer, input, *valid)
+                         : write_indexed_parameter_vector(writer, input));
+    }
+
+    d->bytesWritten.fetch_add(bytesWritten, std::memory_order_relaxed);
+    d->eventsWritten.fetch_add(1, std::memory_order_relaxed);
+}
+
+void export_sink_columnar_step(Operator *op, A2 *)
+{
+    a2_trace("\n");
+    assert(op->type == Operator_ExportSinkColumnar);
+
+    auto d = reinterpret_cast<ExportSinkData *>(op->d);
+    auto &writer = d->writer;
+
+    if (!writer.isOpen() || !writer.good() || !d->columnar) return;
+
+    // Test the condition input if it's used
+    if (d->condIndex >= 0)
+    {
+        assert(d->condIndex < op->inputs[op->inputCount - 1].size);
+
+        if (!is_param_valid(op->inputs[op->inputCount - 1][d->condIndex]))
+            return;
+    }
+
+    auto &encoder = *d->columnar;
+    const s32 dataInputCount = export_sink_data_input_count(op, d);
+    size_t valueCount = 0;
+
+    for (s32 inputIndex = 0; inputIndex < dataInputCount; inputIndex++)
+    {
+        auto input = op->inputs[inputIndex];
+        const u32 firstColumn = encoder.getFirstColumn(inputIndex);
+
+        const ValidIndexes *valid =
+            (static_cast<size_t>(inputIndex) < d->inputValid.size()
+             ? d->inputValid[inputIndex] : nullptr);
+
+        if (valid)
         {
-            for (s32 inputIndex = 0;
-                 inputIndex < dataInputCount && outp->good();
-                 inputIndex++)
+            for (s32 i = 0; i < valid->count; i++)
             {
-                auto input = op->inputs[inputIndex];
-                assert(input.size <= std::numeric_limits<u16>::max());
-
-                size_t bytes = write_indexed_parameter_vector(*outp, input);
-                d->bytesWritten += bytes;
+                s32 paramIndex = valid->indexes[i];
+                encoder.setValue(firstColumn + paramIndex, input[paramIndex]);
             }
 
-            d->eventsWritten++;
+            valueCount += valid->count;
+        }
+        else
+        {
+            for (s32 paramIndex = 0; paramIndex < input.size; paramIndex++)
+            {
+                if (is_param_valid(input[paramIndex]))
+                {
+                    encoder.setValue(firstColumn + paramIndex, input[paramIndex]);
+                    ++valueCount;
+                }
+            }
         }
     }
-    catch (const std::exception &e)
-    {
-        std::ostringstream ss;
-        ss << "Error writing to output file " << d->filename << ": " << e.what();
-        d->setLastError(ss.str());
-    }
+
+    encoder.endRow(writer);
+
+    d->bytesWritten.fetch_add(valueCount * sizeof(double), std::memory_order_relaxed);
+    d->eventsWritten.fetch_add(1, std::memory_order_relaxed);
 }
 
 void export_sink_end_run(Operator *op)
 {
     a2_trace("\n");
     assert(op->type == Operator_ExportSinkFull
-           || op->type == Operator_ExportSinkSparse);
+           || op->type == Operator_ExportSinkSparse
+           || op->type == Operator_ExportSinkColumnar);
 
     auto d = reinterpret_cast<ExportSinkData *>(op->d);
 
-    // The destructors being called as a result of clearing the unique_ptrs
-    // should not throw.
-    d->z_ostream = {};
-    d->ostream   = {};
+    // Write the last row group and the footer.
+    if (d->columnar && d->writer.isOpen())
+        d->columnar->finish(d->writer);
+
+    d->columnar = {};
+
+    // Writes out the buffered data and closes the file. Errors are reported
+    // via setLastError().
+    d->writer.finish();
 }
 
 /* ===============================================
@@ -3620,6 +4272,7 @@ const std::array<OperatorFunctions, OperatorTypeCount> &get_operator_table()
 
     result[Operator_ExportSinkFull]   = { export_sink_full_step,   export_sink_begin_run, export_sink_end_run };
     result[Operator_ExportSinkSparse] = { export_sink_sparse_step, export_sink_begin_run, export_sink_end_run };
+    result[Operator_ExportSinkColumnar] = { export_sink_columnar_step, export_sink_begin_run, export_sink_end_run };
 
     result[Operator_RangeFilter] = { range_filter_step };
     result[Operator_RangeFilter_idx] = { range_filter_step_idx };
@@ -3657,9 +4310,14 @@ A2::A2(memory::Arena *arena)
 
     dataSourceCounts.fill(0);
     dataSources.fill(nullptr);
+
+    for (auto &moduleDispatch: extractorDispatch)
+        moduleDispatch.fill(nullptr);
     operatorCounts.fill(0);
     operators.fill(nullptr);
     operatorRanks.fill(0);
+    operatorFusion.fill(nullptr);
+    operatorProfiles.fill(nullptr);
 }
 
 A2::~A2()
@@ -3694,70 +4352,557 @@ A2 *make_a2(
     return result;
 }
 
-// run begin_event() on all sources for the given eventIndex
-void a2_begin_event(A2 *a2, int eventIndex)
+void a2_build_extractor_dispatch(A2 *a2, memory::Arena *arena)
 {
-    assert(eventIndex < MaxVMEEvents);
-
-    int srcCount = a2->dataSourceCounts[eventIndex];
-
-    a2_trace("ei=%d, dataSources=%d\n", eventIndex, srcCount);
-
-    for (int srcIdx = 0; srcIdx < srcCount; srcIdx++)
+    for (int ei = 0; ei < MaxVMEEvents; ei++)
     {
-        DataSource *ds = a2->dataSources[eventIndex] + srcIdx;
-
-        switch (static_cast<DataSourceType>(ds->type))
+        for (int mi = 0; mi < MaxVMEModules; mi++)
         {
-            case DataSource_Extractor:
-                extractor_begin_event(ds);
-                break;
-
-            case DataSource_ListFilterExtractor:
-                listfilter_extractor_begin_event(ds);
-                break;
+            a2->extractorDispatch[ei][mi] = make_extractor_dispatch(
+                arena, a2->dataSources[ei], a2->dataSourceCounts[ei], mi);
         }
     }
 }
 
-#if 0
-void a2_process_module_prefix(A2 *a2, int eventIndex, int moduleIndex, const u32 *data, u32 dataSize)
+/* ===============================================
+ * Operator fusion
+ * =============================================== */
+
+namespace
 {
-}
 
-void a2_process_module_suffix(A2 *a2, int eventIndex, int moduleIndex, const u32 *data, u32 dataSize)
+bool is_fusable_elementwise_operator(const Operator &op)
 {
+    switch (op.type)
+    {
+        case Operator_Calibration:
+        case Operator_Calibration_sse:
+        case Operator_RangeFilter:
+        case Operator_KeepPrevious:
+            return op.inputCount == 1 && op.outputCount == 1
+                && op.inputs[0].size == op.outputs[0].size;
+    }
+
+    return false;
 }
-#endif
 
-// hand module data to all sources for eventIndex and moduleIndex
-void a2_process_module_data(A2 *a2, int eventIndex, int moduleIndex, const u32 *data, u32 dataSize)
+bool is_fusable_sink(const Operator &op)
 {
-    assert(eventIndex < MaxVMEEvents);
-    assert(moduleIndex < MaxVMEModules);
-
-#ifndef NDEBUG
-    int nprocessed = 0;
-#endif
+    return op.type == Operator_H1DSink
+        && op.inputCount == 1
+        && reinterpret_cast<H1DSinkData *>(op.d)->histos.size == op.inputs[0].size;
+}
 
-    const int srcCount = a2->dataSourceCounts[eventIndex];
+void step_fused_chain(A2 *a2, Operator *operators, FusedChain *chain)
+{
+    const Operator *head = operators + chain->operatorIndexes[0];
+    Operator *tail = operators + chain->operatorIndexes[chain->operatorIndexes.size - 1];
+    const bool sinkTail = (tail->type == Operator_H1DSink);
 
-    // State for the data consuming ListFilterExtractors
-    const u32 *curPtr = data;
-    const u32 *endPtr = data + dataSize;
+    const ParamVec input = head->inputs[0];
+    const s32 stageCount = chain->stages.size;
+    const FusedChain::Stage *stages = chain->stages.data;
+    const double invalid_p = invalid_param();
 
-    for (int srcIdx = 0; srcIdx < srcCount; srcIdx++)
+    for (s32 pi = 0; pi < input.size; pi++)
     {
-        DataSource *ds = a2->dataSources[eventIndex] + srcIdx;
+        double v = input[pi];
 
-        if (ds->moduleIndex != moduleIndex)
-            continue;
+        for (s32 si = 0; si < stageCount; si++)
+        {
+            const auto &stage = stages[si];
+
+            switch (stage.type)
+            {
+                case Operator_Calibration:
+                case Operator_Calibration_sse:
+                    {
+                        auto d = reinterpret_cast<CalibrationData *>(stage.d);
+                        v = calibrate(v, stage.inputLowerLimits[pi],
+                                      stage.outputLowerLimits[pi], d->calibFactors[pi]);
+                    } break;
+
+                case Operator_RangeFilter:
+                    {
+                        auto d = reinterpret_cast<RangeFilterData *>(stage.d);
+                        if (in_range(d->thresholds, v) == d->invert)
+                            v = invalid_p;
+                    } break;
+
+                case Operator_KeepPrevious:
+                    {
+                        auto d = reinterpret_cast<KeepPreviousData *>(stage.d);
+                        double prev = d->previousInput[pi];
+
+                        if (!d->keepValid || is_param_valid(v))
+                            d->previousInput[pi] = v;
+
+                        v = prev;
+                    } break;
+
+                InvalidDefaultCase;
+            }
+
+            if (!stage.storeOutput || stage.storeOutput->load(std::memory_order_relaxed))
+                stage.output[pi] = v;
+        }
+    }
+
+    if (sinkTail)
+    {
+        // The sink input is the output of the last stage.
+        a2->histoFillStrategy.fill_h1d_sink(
+            reinterpret_cast<H1DSinkData *>(tail->d), tail->inputs[0]);
+    }
+}
+
+} // end anon namespace
+
+FusionReport a2_fuse_operators(A2 *a2, memory::Arena *arena)
+{
+    FusionReport report;
+
+    for (int ei = 0; ei < MaxVMEEvents; ei++)
+    {
+        const int opCount = a2->operatorCounts[ei];
+        Operator *operators = a2->operators[ei];
+
+        a2->operatorFusion[ei] = nullptr;
+
+        if (!opCount)
+            continue;
+
+        // Number of operator inputs consuming each operators first output.
+        std::vector<s32> consumerCounts(opCount, 0);
+        // Index of the last seen consumer of each operators first output.
+        std::vector<s32> consumers(opCount, -1);
+
+        for (int ci = 0; ci < opCount; ci++)
+        {
+            const Operator &consumer = operators[ci];
+
+            for (int ii = 0; ii < consumer.inputCount; ii++)
+            {
+                for (int pi = 0; pi < opCount; pi++)
+                {
+                    const Operator &producer = operators[pi];
+
+                    if (producer.outputCount > 0
+                        && consumer.inputs[ii].data == producer.outputs[0].data)
+                    {
+                        consumerCounts[pi]++;
+                        consumers[pi] = ci;
+                    }
+                }
+            }
+        }
+
+        // The fusable consumer of op or -1.
+        auto next_in_chain = [&] (int opIdx) -> int
+        {
+            const Operator &op = operators[opIdx];
+
+            if (!is_fusable_elementwise_operator(op) || consumerCounts[opIdx] != 1)
+                return -1;
+
+            const int ci = consumers[opIdx];
+            const Operator &consumer = operators[ci];
+
+            if (consumer.inputCount != 1
+                || consumer.inputs[0].data != op.outputs[0].data
+                || consumer.inputs[0].size != op.outputs[0].size
+                || consumer.conditionIndex != op.conditionIndex)
+            {
+                return -1;
+            }
+
+            if (is_fusable_elementwise_operator(consumer) || is_fusable_sink(consumer))
+                return ci;
+
+            return -1;
+        };
+
+        // Chain heads are fusable operators not fed by a fusable predecessor.
+        std::vector<bool> hasPredecessor(opCount, false);
+
+        for (int opIdx = 0; opIdx < opCount; opIdx++)
+        {
+            int ci = next_in_chain(opIdx);
+            if (ci >= 0)
+                hasPredecessor[ci] = true;
+        }
+
+        FusedChain **fusion = nullptr;
+
+        for (int opIdx = 0; opIdx < opCount; opIdx++)
+        {
+            if (hasPredecessor[opIdx] || !is_fusable_elementwise_operator(operators[opIdx]))
+                continue;
+
+            std::vector<s32> chainIndexes = { opIdx };
+
+            for (int ci = next_in_chain(opIdx); ci >= 0; ci = next_in_chain(ci))
+                chainIndexes.push_back(ci);
+
+            if (chainIndexes.size() < 2)
+                continue;
+
+            if (!fusion)
+            {
+                fusion = arena->pushArray<FusedChain *>(opCount);
+                std::fill(fusion, fusion + opCount, nullptr);
+            }
+
+            const Operator &tail = operators[chainIndexes.back()];
+            const bool sinkTail = is_fusable_sink(tail);
+
+            auto chain = arena->pushStruct<FusedChain>();
+            chain->operatorIndexes = push_copy_typed_block<s32, s32>(arena, chainIndexes);
+            chain->stages = push_typed_block<FusedChain::Stage, s32>(
+                arena, static_cast<s32>(chainIndexes.size() - (sinkTail ? 1 : 0)));
+            chain->lastStepActive = false;
+
+            for (s32 si = 0; si < chain->stages.size; si++)
+            {
+                const Operator &op = operators[chainIndexes[si]];
+                const bool lastStage = (si == chain->stages.size - 1);
+                chain->stages[si] =
+                {
+                    op.type,
+                    op.d,
+                    op.inputLowerLimits[0].data,
+                    op.outputLowerLimits[0].data,
+                    op.outputs[0].data,
+                    lastStage ? nullptr : arena->pushObject<std::atomic<bool>>(false),
+                };
+            }
+
+            for (auto ci: chainIndexes)
+                fusion[ci] = chain;
+
+            report.chains.push_back({ ei, chainIndexes });
+        }
+
+        a2->operatorFusion[ei] = fusion;
+    }
+
+    return report;
+}
+
+void a2_unfuse_operators(A2 *a2)
+{
+    a2->operatorFusion.fill(nullptr);
+}
+
+void a2_set_operator_output_observed(A2 *a2, const Operator *op, bool observed)
+{
+    for (int ei = 0; ei < MaxVMEEvents; ei++)
+    {
+        const Operator *operators = a2->operators[ei];
+        const int opCount = a2->operatorCounts[ei];
+
+        if (!operators || std::less<const Operator *>()(op, operators)
+            || !std::less<const Operator *>()(op, operators + opCount))
+        {
+            continue;
+        }
+
+        const s32 opIdx = op - operators;
+        FusedChain **fusion = a2->operatorFusion[ei];
+        FusedChain *chain = fusion ? fusion[opIdx] : nullptr;
+
+        if (!chain)
+            return;
+
+        for (s32 si = 0; si < chain->stages.size; si++)
+        {
+            if (chain->operatorIndexes[si] == opIdx && chain->stages[si].storeOutput)
+                chain->stages[si].storeOutput->store(observed, std::memory_order_relaxed);
+        }
+
+        return;
+    }
+}
+
+/* ===============================================
+ * Sparse valid index propagation
+ * =============================================== */
+
+namespace
+{
+
+void unlink_operator_valid_indexes(Operator *op)
+{
+    switch (op->type)
+    {
+        case Operator_Calibration:
+            {
+                auto d = reinterpret_cast<CalibrationData *>(op->d);
+                d->inputValid = nullptr;
+                d->outputValid = nullptr;
+            } break;
+
+        case Operator_H1DSink:
+            reinterpret_cast<H1DSinkData *>(op->d)->inputValid = nullptr;
+            break;
+
+        case Operator_ExportSinkSparse:
+        case Operator_ExportSinkColumnar:
+            reinterpret_cast<ExportSinkData *>(op->d)->inputValid.clear();
+            break;
+    }
+}
+
+} // end anon namespace
+
+void a2_link_valid_indexes(A2 *a2, memory::Arena *arena)
+{
+    for (int ei = 0; ei < MaxVMEEvents; ei++)
+    {
+        // Maps the data pointer of a dense vector to its valid index list.
+        std::map<const double *, ValidIndexes *> validMap;
+
+        auto find_valid = [&validMap] (const ParamVec &pv) -> ValidIndexes *
+        {
+            auto it = validMap.find(pv.data);
+            return it != validMap.end() ? it->second : nullptr;
+        };
+
+        for (int si = 0; si < a2->dataSourceCounts[ei]; si++)
+        {
+            DataSource *ds = a2->dataSources[ei] + si;
+
+            if (!ds->validIndexes)
+            {
+                // The list starts out empty so the dense vector must not
+                // contain valid parameters.
+                ds->validIndexes = push_valid_indexes(arena, ds->output.data.size);
+                invalidate_all(ds->output.data);
+            }
+
+            validMap[ds->output.data.data] = ds->validIndexes;
+        }
+
+        FusedChain **fusion = a2->operatorFusion[ei];
+
+        for (int opIdx = 0; opIdx < a2->operatorCounts[ei]; opIdx++)
+        {
+            Operator *op = a2->operators[ei] + opIdx;
+
+            if (fusion && fusion[opIdx])
+            {
+                // Fused kernels process the complete arrays.
+                unlink_operator_valid_indexes(op);
+                continue;
+            }
+
+            switch (op->type)
+            {
+                case Operator_Calibration:
+                    {
+                        auto d = reinterpret_cast<CalibrationData *>(op->d);
+                        d->inputValid = find_valid(op->inputs[0]);
+
+                        if (!d->inputValid)
+                        {
+                            d->outputValid = nullptr;
+                        }
+                        else if (!d->outputValid)
+                        {
+                            d->outputValid = push_valid_indexes(arena, op->outputs[0].size);
+                            invalidate_all(op->outputs[0]);
+                        }
+
+                        if (d->outputValid)
+                            validMap[op->outputs[0].data] = d->outputValid;
+                    } break;
+
+                case Operator_H1DSink:
+                    reinterpret_cast<H1DSinkData *>(op->d)->inputValid = find_valid(op->inputs[0]);
+                    break;
+
+                case Operator_ExportSinkSparse:
+                case Operator_ExportSinkColumnar:
+                    {
+                        auto d = reinterpret_cast<ExportSinkData *>(op->d);
+                        d->inputValid.resize(op->inputCount);
+
+                        for (s32 ii = 0; ii < op->inputCount; ii++)
+                            d->inputValid[ii] = find_valid(op->inputs[ii]);
+                    } break;
+            }
+        }
+    }
+}
+
+/* ===============================================
+ * Operator profiling
+ * =============================================== */
+
+namespace
+{
+
+inline u64 profile_counter_now()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+} // end anon namespace
+
+void a2_merge_profiling(A2 *dest, const A2 *src)
+{
+    for (int ei = 0; ei < MaxVMEEvents; ei++)
+    {
+        auto destProfiles = dest->operatorProfiles[ei];
+        auto srcProfiles = src->operatorProfiles[ei];
+
+        if (!destProfiles || !srcProfiles)
+            continue;
+
+        assert(dest->operatorCounts[ei] == src->operatorCounts[ei]);
+
+        if (dest->operatorCounts[ei] != src->operatorCounts[ei])
+            continue;
+
+        for (int opIdx = 0; opIdx < dest->operatorCounts[ei]; opIdx++)
+        {
+            if (dest->operators[ei][opIdx].type != src->operators[ei][opIdx].type)
+                continue;
+
+            destProfiles[opIdx].time += srcProfiles[opIdx].time;
+            destProfiles[opIdx].stepCount += srcProfiles[opIdx].stepCount;
+            destProfiles[opIdx].condSkipCount += srcProfiles[opIdx].condSkipCount;
+        }
+    }
+}
+
+const char *a2_profile_counter_unit()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return "cycles";
+#else
+    return "ns";
+#endif
+}
+
+void a2_enable_profiling(A2 *a2, memory::Arena *arena)
+{
+    for (int ei = 0; ei < MaxVMEEvents; ei++)
+    {
+        const int opCount = a2->operatorCounts[ei];
+
+        if (!opCount)
+        {
+            a2->operatorProfiles[ei] = nullptr;
+            continue;
+        }
+
+        a2->operatorProfiles[ei] = arena->pushArray<OperatorProfile>(opCount);
+        std::fill_n(a2->operatorProfiles[ei], opCount, OperatorProfile{});
+    }
+}
+
+void a2_disable_profiling(A2 *a2)
+{
+    a2->operatorProfiles.fill(nullptr);
+}
+
+void a2_reset_profiling(A2 *a2)
+{
+    for (int ei = 0; ei < MaxVMEEvents; ei++)
+    {
+        if (auto profiles = a2->operatorProfiles[ei])
+            std::fill_n(profiles, a2->operatorCounts[ei], OperatorProfile{});
+    }
+}
+
+void a2_unlink_valid_indexes(A2 *a2)
+{
+    for (int ei = 0; ei < MaxVMEEvents; ei++)
+    {
+        for (int si = 0; si < a2->dataSourceCounts[ei]; si++)
+            a2->dataSources[ei][si].validIndexes = nullptr;
+
+        for (int opIdx = 0; opIdx < a2->operatorCounts[ei]; opIdx++)
+            unlink_operator_valid_indexes(a2->operators[ei] + opIdx);
+    }
+}
+
+// run begin_event() on all sources for the given eventIndex
+void a2_begin_event(A2 *a2, int eventIndex)
+{
+    assert(eventIndex < MaxVMEEvents);
+
+    int srcCount = a2->dataSourceCounts[eventIndex];
+
+    a2_trace("ei=%d, dataSources=%d\n", eventIndex, srcCount);
+
+    for (int srcIdx = 0; srcIdx < srcCount; srcIdx++)
+    {
+        DataSource *ds = a2->dataSources[eventIndex] + srcIdx;
+
+        switch (static_cast<DataSourceType>(ds->type))
+        {
+            case DataSource_Extractor:
+                extractor_begin_event(ds);
+                break;
+
+            case DataSource_ListFilterExtractor:
+                listfilter_extractor_begin_event(ds);
+                break;
+        }
+    }
+}
+
+#if 0
+void a2_process_module_prefix(A2 *a2, int eventIndex, int moduleIndex, const u32 *data, u32 dataSize)
+{
+}
+
+void a2_process_module_suffix(A2 *a2, int eventIndex, int moduleIndex, const u32 *data, u32 dataSize)
+{
+}
+#endif
+
+// hand module data to all sources for eventIndex and moduleIndex
+void a2_process_module_data(A2 *a2, int eventIndex, int moduleIndex, const u32 *data, u32 dataSize)
+{
+    assert(eventIndex < MaxVMEEvents);
+    assert(moduleIndex < MaxVMEModules);
+
+#ifndef NDEBUG
+    int nprocessed = 0;
+#endif
+
+    const int srcCount = a2->dataSourceCounts[eventIndex];
+
+    // State for the data consuming ListFilterExtractors
+    const u32 *curPtr = data;
+    const u32 *endPtr = data + dataSize;
+
+    auto dispatch = a2->extractorDispatch[eventIndex][moduleIndex];
+
+    if (dispatch)
+        extractor_dispatch_process_module_data(dispatch, data, dataSize);
+
+    for (int srcIdx = 0; srcIdx < srcCount; srcIdx++)
+    {
+        DataSource *ds = a2->dataSources[eventIndex] + srcIdx;
+
+        if (ds->moduleIndex != moduleIndex)
+            continue;
 
         switch (static_cast<DataSourceType>(ds->type))
         {
             case DataSource_Extractor:
                 {
-                    extractor_process_module_data(ds, data, dataSize);
+                    if (!dispatch)
+                        extractor_process_module_data(ds, data, dataSize);
                 } break;
             case DataSource_ListFilterExtractor:
                 {
@@ -3823,6 +4968,28 @@ struct OperatorRangeWorkQueue
     {}
 };
 
+void a2_begin_run_operator(Operator *op, Logger logger)
+{
+    assert(op);
+    assert(op->type < get_operator_table().size());
+
+    if (get_operator_table()[op->type].begin_run)
+    {
+        get_operator_table()[op->type].begin_run(op, logger);
+    }
+}
+
+void a2_end_run_operator(Operator *op)
+{
+    assert(op);
+    assert(op->type < get_operator_table().size());
+
+    if (get_operator_table()[op->type].end_run)
+    {
+        get_operator_table()[op->type].end_run(op);
+    }
+}
+
 void a2_begin_run(A2 *a2, Logger logger)
 {
     // call begin_run functions stored in the OperatorTable
@@ -3832,15 +4999,7 @@ void a2_begin_run(A2 *a2, Logger logger)
 
         for (int opIdx = 0; opIdx < opCount; opIdx++)
         {
-            Operator *op = a2->operators[ei] + opIdx;
-
-            assert(op);
-            assert(op->type < get_operator_table().size());
-
-            if (get_operator_table()[op->type].begin_run)
-            {
-                get_operator_table()[op->type].begin_run(op, logger);
-            }
+            a2_begin_run_operator(a2->operators[ei] + opIdx, logger);
         }
     }
 
@@ -3858,15 +5017,7 @@ void a2_end_run(A2 *a2)
 
         for (int opIdx = 0; opIdx < opCount; opIdx++)
         {
-            Operator *op = a2->operators[ei] + opIdx;
-
-            assert(op);
-            assert(op->type < get_operator_table().size());
-
-            if (get_operator_table()[op->type].end_run)
-            {
-                get_operator_table()[op->type].end_run(op);
-            }
+            a2_end_run_operator(a2->operators[ei] + opIdx);
         }
     }
 
@@ -3888,16 +5039,54 @@ void a2_end_event(A2 *a2, int eventIndex)
 
     a2_trace("ei=%d, stepping %d operators\n", eventIndex, opCount);
 
+    FusedChain **fusion = a2->operatorFusion[eventIndex];
+    OperatorProfile *profiles = a2->operatorProfiles[eventIndex];
+
     for (int opIdx = 0; opIdx < opCount; opIdx++)
     {
         Operator *op = operators + opIdx;
+        const u64 tStep = profiles ? profile_counter_now() : 0u;
+        const s32 steppedBefore = opSteppedCount;
 
         a2_trace("  op@%p\n", op);
 
         assert(op);
         assert(op->type < get_operator_table().size());
 
-        if (likely(op->type != Invalid_OperatorType))
+        if (fusion && fusion[opIdx])
+        {
+            // The whole chain is processed when reaching its first operator.
+            FusedChain *chain = fusion[opIdx];
+
+            if (chain->operatorIndexes[0] == opIdx)
+            {
+                chain->lastStepActive = (op->conditionIndex < 0
+                                         || a2->conditionBits.test(op->conditionIndex));
+
+                if (chain->lastStepActive)
+                {
+                    step_fused_chain(a2, operators, chain);
+                }
+                else
+                {
+                    // Outputs which are not stored while the chain is active
+                    // are left alone here too.
+                    for (s32 si = 0; si < chain->stages.size; si++)
+                    {
+                        const auto &stage = chain->stages[si];
+
+                        if (!stage.storeOutput || stage.storeOutput->load(std::memory_order_relaxed))
+                            invalidate_outputs(operators + chain->operatorIndexes[si]);
+                    }
+                }
+            }
+
+            if (chain->lastStepActive)
+                opSteppedCount++;
+            else
+                opCondSkipped++;
+        }
+        else if (likely(op->type != Invalid_OperatorType))
         {
             assert(get_operator_table()[op->type].step);
 
@@ -3917,6 +5106,13 @@ void a2_end_event(A2 *a2, int eventIndex)
             {
                 // condition is false -> invalidate all outputs
                 invalidate_outputs(op);
+
+                if (op->type == Operator_Calibration)
+                {
+                    if (auto valid = reinterpret_cast<CalibrationData *>(op->d)->outputValid)
+                        valid->count = 0;
+                }
+
                 opCondSkipped++;
             }
         }
@@ -3924,6 +5120,17 @@ void a2_end_event(A2 *a2, int eventIndex)
         {
             InvalidCodePath;
         }
+
+        if (unlikely(profiles != nullptr))
+        {
+            auto &profile = profiles[opIdx];
+            profile.time += profile_counter_now() - tStep;
+
+            if (opSteppedCount != steppedBefore)
+                profile.stepCount++;
+            else
+                profile.condSkipCount++;
+        }
     }
 
     assert(opSteppedCount + opCondSkipped == opCount);
@@ -3961,6 +5168,8 @@ void a2_timetick(A2 *a2)
 {
     a2_trace("\n");
 
+    a2_flush_histograms(a2);
+
     for (int ei = 0; ei < MaxVMEEvents; ei++)
     {
         const int opCount = a2->operatorCounts[ei];
@@ -3980,6 +5189,11 @@ void a2_timetick(A2 *a2)
     }
 }
 
+void a2_flush_histograms(A2 *a2)
+{
+    a2->histoFillStrategy.flush();
+}
+
 /* Threaded histosink implementation.
 -----------------------------------------------------------------------------
 
@@ -1,15 +1,21 @@
 #ifndef __MVME_A2_H__
 #define __MVME_A2_H__
 
+#include <atomic>
 #include <boost/dynamic_bitset.hpp>
 #include <cassert>
 #include <cpp11-on-multicore/common/rwlock.h>
 #include <pcg_random.hpp>
+#include <vector>
 
 #ifdef liba2_shared_EXPORTS
 #include "a2_export.h"
 #endif
 
+#include "a2_compact_bins.h"
+#include "a2_export_columnar.h"
+#include "a2_export_writer.h"
+#include "a2_expr_compiler.h"
 #include "a2_exprtk.h"
 #include "a2_param.h"
 #include "listfilter.h"
@@ -45,6 +51,46 @@ inline void invalidate_all(double *params, s32 count)
 ParamVec push_param_vector(memory::Arena *arena, s32 size);
 ParamVec push_param_vector(memory::Arena *arena, s32 size, double value);
 
+/* Optional sparse representation of a parameter vector: the indexes of the
+ * valid parameters in ascending order. The dense vector must not contain
+ * valid parameters at other indexes. Producers invalidate the listed
+ * parameters at the start of the next step instead of the whole vector.
+ * Set up by a2_link_valid_indexes(). */
+struct ValidIndexes
+{
+    s32 *indexes;
+    s32 count;
+};
+
+ValidIndexes *push_valid_indexes(memory::Arena *arena, s32 capacity);
+
+/* Adds index to the list keeping it sorted. Parameters usually arrive in
+ * ascending order so this is a single comparison in the common case. The
+ * index must not already be contained in the list. */
+inline void push_valid_index(ValidIndexes *valid, s32 index)
+{
+    s32 i = valid->count++;
+
+    while (i > 0 && valid->indexes[i - 1] > index)
+    {
+        valid->indexes[i] = valid->indexes[i - 1];
+        --i;
+    }
+
+    valid->indexes[i] = index;
+}
+
+/* Invalidates the listed parameters of pv and clears the list. */
+inline void invalidate_valid(ParamVec pv, ValidIndexes *valid)
+{
+    const double invalid_p = invalid_param();
+
+    for (s32 i = 0; i < valid->count; i++)
+        pv[valid->indexes[i]] = invalid_p;
+
+    valid->count = 0;
+}
+
 struct Thresholds
 {
     double min;
@@ -79,6 +125,8 @@ struct DataSource
 {
     PipeVectors output;
     ParamVec hitCounts;
+    // Optional sparse representation of output.data.
+    ValidIndexes *validIndexes;
     void *d;
     u8 moduleIndex;
     u8 type;
@@ -163,6 +211,60 @@ void extractor_process_module_data(DataSource *ex, const u32 *data, u32 size);
 void listfilter_extractor_begin_event(DataSource *ex);
 const u32 *listfilter_extractor_process_module_data(DataSource *ex, const u32 *data, u32 dataSize);
 
+/* Combined single pass dispatch of module data words to all Extractor type
+ * data sources attached to one module.
+ *
+ * The subfilters of all extractors are grouped by their matchMask. Within a
+ * group the matchValues are sorted so that a data word is tested once per
+ * distinct mask using a binary search. The word is then only handed to the
+ * extractors owning a matching subfilter. With many extractors per module
+ * most words match only a few of them.
+ *
+ * The extracted values are the same as when calling
+ * extractor_process_module_data() for each of the extractors. */
+struct ExtractorDispatch
+{
+    struct MaskGroup
+    {
+        u32 matchMask;
+        // Range of this groups entries in the values array.
+        s32 firstValue;
+        s32 valueCount;
+    };
+
+    MaskGroup *groups;
+    s32 groupCount;
+
+    // Distinct matchValues, sorted in ascending order per group.
+    u32 *values;
+
+    // The extractors to hand a word matching values[i] to are
+    // targets[firstTarget[i]] to targets[firstTarget[i + 1] - 1].
+    s32 *firstTarget;
+    u16 *targets;
+
+    DataSource **extractors;
+    s32 extractorCount;
+
+    // Used to hand each word only once to extractors having subfilters in
+    // multiple mask groups.
+    u32 *lastSeen;
+    u32 wordSerial;
+};
+
+/* Builds the dispatch structure for the Extractor type sources in the given
+ * array that are attached to moduleIndex. Returns nullptr if there are less
+ * than two such extractors or if any of them has no subfilters. In these
+ * cases extractor_process_module_data() should be used. */
+ExtractorDispatch *make_extractor_dispatch(
+    memory::Arena *arena,
+    DataSource *sources,
+    s32 sourceCount,
+    int moduleIndex);
+
+void extractor_dispatch_process_module_data(
+    ExtractorDispatch *dispatch, const u32 *data, u32 size);
+
 
 /* ===============================================
  * Operators
@@ -406,6 +508,13 @@ struct ExpressionOperatorData
     a2_exprtk::Expression expr_begin;
     a2_exprtk::Expression expr_step;
 
+    /* Bytecode version of expr_step. Null if the step expression uses
+     * constructs not supported by the compiler in which case exprtk is used
+     * to evaluate the expression. */
+    expr_compiler::SymbolTable symtab_compiled;
+    std::unique_ptr<expr_compiler::Program> expr_step_compiled;
+    std::string expr_step_fallback_reason;
+
     std::vector<std::string> output_names;
     std::vector<std::string> output_units;
 };
@@ -434,7 +543,11 @@ Operator make_expression_operator(
     ExpressionOperatorBuildOptions options = ExpressionOperatorBuildOptions::FullBuild);
 
 /* Can be used after calling make_expression_operator() with the InitOnly
- * option to complete building the operator. */
+ * option to complete building the operator.
+ * The step expression is compiled using exprtk first to get proper error
+ * reporting. Then compilation to bytecode is attempted. If this succeeds the
+ * bytecode version is used in expression_operator_step(). Set the environment
+ * variable MVME_DISABLE_EXPR_COMPILER to always use exprtk. */
 void expression_operator_compile_step_expression(Operator *op);
 
 struct A2;
@@ -500,6 +613,17 @@ struct H1D: public ParamVec
     double entryCount;
     double *underflow;
     double *overflow;
+
+    /* Optional compact storage. If set and data is null the bin counts are
+     * kept in data32 which must equal compact->data32(). On promotion data is
+     * set to the double storage. Use increment_bin() to update bins. */
+    u32 *data32;
+    CompactBins *compact;
+
+    /* Optional tile modification counters, see TileGenerations. Updated by
+     * increment_bin() and add_to_bin(). */
+    u32 *tileGenerations;
+    u32 tileShift;
 };
 
 Operator make_h1d_sink(
@@ -513,9 +637,26 @@ Operator make_h1d_sink_idx(
     TypedBlock<H1D, s32> histos,
     s32 inputIndex);
 
+struct FillBuffer;
+
 struct H1DSinkData
 {
     TypedBlock<H1D, s32> histos;
+
+    /* Copies of the histo binnings in structure of arrays form for the
+     * vectorized fill kernels. See a2_h1d_fill.h. Not set for
+     * Operator_H1DSink_idx. */
+    double *binMins;
+    double *binMaxs;
+    double *binFactors;
+
+    /* Set by HistoFillBuffered::begin_run() if the sinks increments are
+     * buffered. */
+    FillBuffer *fillBuffer;
+
+    /* Valid indexes of the input if available. Only the listed histograms
+     * are filled in this case. Not used for Operator_H1DSink_idx. */
+    const ValidIndexes *inputValid;
 };
 
 struct H1DSinkData_idx: public H1DSinkData
@@ -538,6 +679,14 @@ struct H2D: public ParamVec
     double entryCount;
     double underflow;
     double overflow;
+
+    // See H1D::compact
+    u32 *data32;
+    CompactBins *compact;
+
+    // See H1D::tileGenerations
+    u32 *tileGenerations;
+    u32 tileShift;
 };
 
 struct H2DSinkData
@@ -545,6 +694,9 @@ struct H2DSinkData
     H2D histo;
     s32 xIndex;
     s32 yIndex;
+
+    // See H1DSinkData::fillBuffer
+    FillBuffer *fillBuffer;
 };
 
 Operator make_h2d_sink(
@@ -614,6 +766,13 @@ enum class ExportSinkFormat
      * Use this if only a couple of channels respond per event. In this case it
      * will produce much smaller data than the Full format. */
     Sparse,
+
+    /* Columnar format:
+     * Events are grouped into row groups. Each parameter of each input is
+     * stored as a separate column chunk with min/max statistics and optional
+     * zlib compression. Allows readers to only read the columns they need.
+     * See ColumnarExportEncoder for the file layout. */
+    Columnar,
 };
 
 struct ExportSinkData
@@ -628,19 +787,25 @@ struct ExportSinkData
     //  9:  Z_BEST_COMPRESSION
     int compressionLevel;
 
-    // The lowest level output stream. Right now always a std::ofstream
-    // working on this operators output filename.
-    std::unique_ptr<std::ostream> ostream;
+    // Buffers the output data and writes it to the output file from a
+    // separate thread.
+    ExportSinkWriter writer;
 
-    // ostream used when compression is enabled.
-    std::unique_ptr<std::ostream> z_ostream;
+    // Used by the columnar format. Created in begin_run.
+    std::unique_ptr<ColumnarExportEncoder> columnar;
 
     // Condition input index. If negative the condition input will be unused.
     s32 condIndex = -1;
 
-    // runtime state
-    u64 eventsWritten = 0;
-    u64 bytesWritten  = 0;
+    // Valid indexes of the data inputs if available. Used by the sparse
+    // format to write only the valid parameters.
+    std::vector<const ValidIndexes *> inputValid;
+
+    // runtime state. Updated by the analysis thread, read by the UI.
+    // bytesWritten is the uncompressed size of the event data passed to the
+    // writer.
+    std::atomic<u64> eventsWritten = { 0 };
+    std::atomic<u64> bytesWritten  = { 0 };
     std::string lastError;
 
     mutable NonRecursiveRWLock lastErrorLock;
@@ -696,47 +861,205 @@ struct HistoFillDirect
 
     void fill_h1d(H1D *histo, double x);
     void fill_h2d(H2D *histo, double x, double y);
+
+    /* Fills d->histos[i] with input[i] for all histos of the sink using the
+     * vectorized kernel selected for the CPU. */
+    void fill_h1d_sink(H1DSinkData *d, const ParamVec &input);
+
+    /* Fills only the histograms listed in valid. */
+    void fill_h1d_sink_sparse(H1DSinkData *d, const ParamVec &input, const ValidIndexes &valid);
 };
 
+/* Pending bin increments of a histogram sink. Each entry is a key of the form
+ * (histoIndex << binBits) | bin where histoIndex is the index of the H1D in
+ * the sinks histos array (always 0 for H1DSink_idx and H2DSink) and bin is the
+ * linear bin number inside that histogram.
+ * When flushing, the keys are bucketed by their high bits (a single counting
+ * sort pass) so that the increments are applied in increasing memory order,
+ * one cache friendly region after the other. */
 struct FillBuffer
 {
-    static const size_t FillBufferSize = 1024;
+    u32 *keys;
+    u32 used;
+    u32 capacity;
+    u32 binBits;
+    u32 bucketShift;
+
+    // Target histograms. Exactly one of these is set.
+    H1D *h1ds;
+    H2D *h2d;
+};
 
-    unsigned used; // number of slots used
-    std::array<s32, FillBufferSize> bins; // bin values to increment
+enum class HistoFillStrategyType
+{
+    /* Increments histogram bins immediately. */
+    Direct,
+
+    /* Buffers bin indexes per sink and applies them in batches. Helps with
+     * large histograms (especially H2D) where most increments miss the CPU
+     * caches. Increments are applied when a sinks buffer is full, on
+     * a2_timetick(), a2_flush_histograms() and a2_end_run(). Underflow and
+     * overflow counters are updated immediately. */
+    Buffered,
 };
 
+const char *to_string(HistoFillStrategyType type);
+
 class HistoFillBuffered
 {
     public:
         static const char *name() { return "HistoFillBuffered"; }
 
-        HistoFillBuffered();
+        // Number of keys buffered per sink unless a single event of the sink
+        // can produce more.
+        static const u32 DefaultCapacity = 4096;
+
+        // Number of buckets used when reordering the buffered keys.
+        static const u32 BucketBits = 8;
+
+        /* Allocates buffers for all histogram sinks of the a2 instance and
+         * sets the sinks fillBuffer pointers. Sinks whose keys would not fit
+         * into 32 bits are not buffered and filled directly. */
+        void begin_run(A2 *a2);
+        void end_run(A2 *a2);
+
+        /* Unsets the sinks fillBuffer pointers and frees the buffer memory. */
+        void release(A2 *a2);
+
+        void flush();
+        void flush(FillBuffer *buffer);
+
+        void fill_h1d_sink(H1DSinkData *d, const ParamVec &input);
+        void fill_h1d_sink_sparse(H1DSinkData *d, const ParamVec &input, const ValidIndexes &valid);
+        void fill_h1d_sink_idx(H1DSinkData_idx *d, double x);
+        void fill_h2d_sink(H2DSinkData *d, double x, double y);
+
+    private:
+        inline void make_room(FillBuffer *buffer, u32 count)
+        {
+            if (buffer->capacity - buffer->used < count)
+                flush(buffer);
+        }
+
+        std::vector<FillBuffer> m_buffers;
+        std::vector<u32> m_keyStorage;
+        std::vector<u32> m_scratch;
+};
+
+/* The histogram fill strategy of an a2 instance. The type can be changed
+ * between runs and takes effect on the next a2_begin_run(). */
+class HistoFillStrategy
+{
+    public:
+        HistoFillStrategyType type() const { return m_type; }
+        void setType(HistoFillStrategyType type) { m_type = type; }
+        const char *name() const;
 
         void begin_run(A2 *a2);
         void end_run(A2 *a2);
 
-        void fill_h1d(H1D *histo, double x);
-        void fill_h2d(H2D *histo, double x, double y);
+        /* Applies all buffered increments. No-op for the Direct strategy. */
+        void flush() { m_buffered.flush(); }
+
+        inline void fill_h1d_sink(H1DSinkData *d, const ParamVec &input)
+        {
+            if (d->fillBuffer)
+                m_buffered.fill_h1d_sink(d, input);
+            else
+                HistoFillDirect().fill_h1d_sink(d, input);
+        }
+
+        inline void fill_h1d_sink_sparse(H1DSinkData *d, const ParamVec &input,
+                                         const ValidIndexes &valid)
+        {
+            if (d->fillBuffer)
+                m_buffered.fill_h1d_sink_sparse(d, input, valid);
+            else
+                HistoFillDirect().fill_h1d_sink_sparse(d, input, valid);
+        }
+
+        inline void fill_h1d_sink_idx(H1DSinkData_idx *d, double x)
+        {
+            if (d->fillBuffer)
+                m_buffered.fill_h1d_sink_idx(d, x);
+            else
+                HistoFillDirect().fill_h1d(&d->histos[0], x);
+        }
+
+        inline void fill_h2d_sink(H2DSinkData *d, double x, double y)
+        {
+            if (d->fillBuffer)
+                m_buffered.fill_h2d_sink(d, x, y);
+            else
+                HistoFillDirect().fill_h2d(&d->histo, x, y);
+        }
 
     private:
-        memory::Arena m_arena;
+        HistoFillStrategyType m_type = HistoFillStrategyType::Direct;
+        HistoFillBuffered m_buffered;
+};
+
+/* A linear chain of elementwise array operators executed by a single fused
+ * kernel. Each operator of the chain consumes the complete output of the
+ * previous operator and is its only consumer. The kernel makes one pass over
+ * the input array and passes values from stage to stage in registers. Only the
+ * output of the last elementwise stage, which is read by the histogram sink
+ * ending the chain or by operators outside of the chain, is always stored.
+ * Intermediate outputs are stored while observed. See a2_fuse_operators(). */
+struct FusedChain
+{
+    struct Stage
+    {
+        u8 type;
+        void *d;
+        const double *inputLowerLimits;
+        const double *outputLowerLimits;
+        double *output;
+        /* Null for the last elementwise stage. Otherwise the output is only
+         * stored while the flag is set, see a2_set_operator_output_observed(). */
+        std::atomic<bool> *storeOutput;
+    };
 
-        TypedBlock<H1D *, size_t> m_histos;
-        TypedBlock<FillBuffer, size_t> m_buffers;
+    /* Indexes into A2::operators[eventIndex] in chain order. The kernel is
+     * run when the first operator is reached. */
+    TypedBlock<s32, s32> operatorIndexes;
+    TypedBlock<Stage, s32> stages;
+
+    bool lastStepActive;
 };
 
-using TheHistoFillStrategy = HistoFillDirect;
+/* Per operator runtime counters recorded by a2_end_event() if profiling is
+ * enabled. Time is measured in units of a2_profile_counter_unit(). The time
+ * of a fused chain is accounted to the first operator of the chain. */
+struct OperatorProfile
+{
+    u64 time;
+    u64 stepCount;
+    u64 condSkipCount;
+};
 
 struct A2
 {
     std::array<u8, MaxVMEEvents> dataSourceCounts;
     std::array<DataSource *, MaxVMEEvents> dataSources;
 
+    /* Optional combined dispatch structures for the Extractors of each
+     * module. If present for a module the Extractors of that module are
+     * processed via the dispatcher instead of one by one. */
+    std::array<std::array<ExtractorDispatch *, MaxVMEModules>, MaxVMEEvents> extractorDispatch;
+
     std::array<u8, MaxVMEEvents> operatorCounts;
     std::array<Operator *, MaxVMEEvents> operators;
     std::array<u8 *, MaxVMEEvents> operatorRanks;
 
+    /* Optional per operator fusion info set up by a2_fuse_operators(). Null
+     * entries are operators stepped individually. */
+    std::array<FusedChain **, MaxVMEEvents> operatorFusion;
+
+    /* Optional profiling counters, parallel to the operators arrays. Set up
+     * by a2_enable_profiling(). */
+    std::array<OperatorProfile *, MaxVMEEvents> operatorProfiles;
+
     using BlockType = unsigned long;
     using BitsetAllocator = memory::ArenaAllocator<BlockType>;
     using ConditionBitset = boost::dynamic_bitset<BlockType, BitsetAllocator>;
@@ -746,7 +1069,7 @@ struct A2
      * BitsetAllocator. */
     ConditionBitset conditionBits;
 
-    TheHistoFillStrategy histoFillStrategy;
+    HistoFillStrategy histoFillStrategy;
 
     explicit A2(memory::Arena *arena);
     ~A2();
@@ -761,13 +1084,86 @@ struct A2
 
 using Logger = std::function<void (const std::string &msg)>;
 
+/* Creates the ExtractorDispatch structures for all modules of all events.
+ * Must be called after the data sources have been set up. */
+void a2_build_extractor_dispatch(A2 *a2, memory::Arena *arena);
+
+struct FusionReport
+{
+    struct Chain
+    {
+        int eventIndex;
+        // Indexes into A2::operators[eventIndex] in chain order.
+        std::vector<s32> operatorIndexes;
+    };
+
+    std::vector<Chain> chains;
+};
+
+/* Finds chains of elementwise operators (Calibration, RangeFilter,
+ * KeepPrevious, optionally terminated by an H1DSink) where each intermediate
+ * output is consumed only by the next operator in the chain and all
+ * operators share the same condition. The chains are then executed by fused
+ * kernels in a2_end_event().
+ * The outputs of intermediate chain operators are not updated unless marked
+ * via a2_set_operator_output_observed().
+ * Must be called again after operators have been replaced or added. */
+FusionReport a2_fuse_operators(A2 *a2, memory::Arena *arena);
+
+/* Marks the output of op as being read outside of the a2 system, e.g. by a
+ * parameter display. Intermediate operators of fused chains only update
+ * their outputs while marked. Has no effect on operators which are not part
+ * of a fused chain. The marks are lost when calling a2_fuse_operators().
+ * May be called while events are being processed. */
+void a2_set_operator_output_observed(A2 *a2, const Operator *op, bool observed);
+
+/* Removes all fusion info. Operators are stepped individually again. */
+void a2_unfuse_operators(A2 *a2);
+
+/* Sets up sparse valid index propagation: data sources record the indexes
+ * of the parameters they produce. Calibrations forward the lists, H1DSinks
+ * and sparse ExportSinks then only process the listed parameters.
+ * Operators which are part of a fused chain are not linked so this must be
+ * called after a2_fuse_operators(). Must be called again after operators
+ * have been replaced or added. */
+void a2_link_valid_indexes(A2 *a2, memory::Arena *arena);
+
+/* Removes all valid index lists. Dense processing is used again. */
+void a2_unlink_valid_indexes(A2 *a2);
+
+/* Allocates zeroed profiling counters for all operators. Existing counters
+ * are discarded. Must be called again after operators have been added. */
+void a2_enable_profiling(A2 *a2, memory::Arena *arena);
+void a2_disable_profiling(A2 *a2);
+void a2_reset_profiling(A2 *a2);
+
+/* Adds the profiling counters of src to dest. Both instances must have the
+ * same operator layout. */
+void a2_merge_profiling(A2 *dest, const A2 *src);
+
+/* Returns the unit of OperatorProfile::time: "cycles" if the CPU timestamp
+ * counter is used, "ns" otherwise. */
+const char *a2_profile_counter_unit();
+
 void a2_begin_run(A2 *a2, Logger logger);
 void a2_begin_event(A2 *a2, int eventIndex);
 void a2_process_module_data(A2 *a2, int eventIndex, int moduleIndex, const u32 *data, u32 dataSize);
 void a2_end_event(A2 *a2, int eventIndex);
+/* Flushes buffered histogram increments and samples FlowRate monitors. */
 void a2_timetick(A2 *a2);
+
+/* Makes all events processed so far visible in the histograms by flushing
+ * buffered increments. Used in single stepping mode and before merging
+ * histogram shards. */
+void a2_flush_histograms(A2 *a2);
+
 void a2_end_run(A2 *a2);
 
+/* Run the begin_run/end_run function of a single operator. Used when
+ * operators of an existing A2 instance are replaced. */
+void a2_begin_run_operator(Operator *op, Logger logger);
+void a2_end_run_operator(Operator *op);
+
 //
 // Stuff used for debugging and tests
 //
@@ -798,7 +1194,16 @@ void write_histo(Out &out, H1D histo)
     write_value(out, histo.binning.range);
     write_value(out, histo.underflow);
     write_value(out, histo.overflow);
-    write_array(out, histo.data, histo.size);
+
+    if (histo.data)
+    {
+        write_array(out, histo.data, histo.size);
+    }
+    else
+    {
+        for (s32 i = 0; i < histo.size; i++)
+            write_value(out, histo.compact->get(i));
+    }
 }
 
 template<typename Out>
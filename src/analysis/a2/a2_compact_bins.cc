@@ -0,0 +1,116 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "a2_compact_bins.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace a2
+{
+
+namespace
+{
+
+// True if value can be stored in an u32 counter without loss.
+inline bool is_count(double value)
+{
+    return (value >= 0.0 && value <= CompactBins::MaxCount
+            && std::floor(value) == value);
+}
+
+} // end anon namespace
+
+const u32 CompactBins::MaxCount;
+
+CompactBins::CompactBins(u32 *data, s32 size)
+    : m_data32(data)
+    , m_size(size)
+    , m_promoted(nullptr)
+{
+    assert(data);
+    assert(size >= 0);
+}
+
+CompactBins::CompactBins(s32 size)
+    : m_data32(nullptr)
+    , m_size(size)
+    , m_promoted(nullptr)
+    , m_ownedData(new u32[size]())
+{
+    assert(size >= 0);
+    m_data32 = m_ownedData.get();
+}
+
+double *CompactBins::promote()
+{
+    if (auto d = promoted())
+        return d;
+
+    m_promotedData.reset(new double[m_size]);
+    std::copy(m_data32, m_data32 + m_size, m_promotedData.get());
+    m_promoted.store(m_promotedData.get(), std::memory_order_release);
+
+    return m_promotedData.get();
+}
+
+void CompactBins::set(s32 bin, double value)
+{
+    assert(0 <= bin && bin < m_size);
+
+    if (!isPromoted() && is_count(value))
+        m_data32[bin] = static_cast<u32>(value);
+    else
+        promote()[bin] = value;
+}
+
+void CompactBins::add(s32 bin, double value)
+{
+    assert(0 <= bin && bin < m_size);
+
+    if (!isPromoted())
+    {
+        double sum = m_data32[bin] + value;
+
+        if (is_count(sum))
+        {
+            m_data32[bin] = static_cast<u32>(sum);
+            return;
+        }
+    }
+
+    promote()[bin] += value;
+}
+
+void CompactBins::clear()
+{
+    std::fill(m_data32, m_data32 + m_size, 0u);
+
+    if (auto d = promoted())
+        std::fill(d, d + m_size, 0.0);
+}
+
+size_t CompactBins::storageSize() const
+{
+    return m_size * (sizeof(u32) + (isPromoted() ? sizeof(double) : 0u));
+}
+
+} // namespace a2
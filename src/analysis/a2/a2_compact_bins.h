@@ -0,0 +1,151 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef __MVME_A2_COMPACT_BINS_H__
+#define __MVME_A2_COMPACT_BINS_H__
+
+#include <atomic>
+#include <limits>
+#include <memory>
+
+#include "a2_tile_generations.h"
+#include "util/perf.h"
+#include "util/typedefs.h"
+
+namespace a2
+{
+
+/* Compact histogram bin storage using one u32 counter per bin. Halves the
+ * memory and cache footprint compared to double bins when doing unweighted
+ * counting.
+ *
+ * When a counter would overflow or a value not representable as an u32 count
+ * is stored the storage is promoted: a double array is allocated, the counts
+ * are copied over and from then on only the doubles are used. The promotion
+ * is published atomically so that readers on other threads switch to the
+ * double storage without locking. The u32 memory stays valid until the
+ * object is destroyed. There is no way back from the promoted state.
+ *
+ * Modifications must only be done from the thread filling the histogram or
+ * while no filling takes place. */
+class CompactBins
+{
+    public:
+        static const u32 MaxCount = std::numeric_limits<u32>::max();
+
+        /* Uses externally owned counter memory of the given size. The
+         * counters are not cleared. */
+        CompactBins(u32 *data, s32 size);
+
+        /* Allocates size zero-initialized counters. */
+        explicit CompactBins(s32 size);
+
+        CompactBins(const CompactBins &) = delete;
+        CompactBins &operator=(const CompactBins &) = delete;
+
+        s32 size() const { return m_size; }
+        u32 *data32() const { return m_data32; }
+
+        /* Returns the double storage if the bins have been promoted, nullptr
+         * otherwise. */
+        double *promoted() const { return m_promoted.load(std::memory_order_acquire); }
+        bool isPromoted() const { return promoted() != nullptr; }
+
+        /* Converts the counts to double storage. Returns the double storage.
+         * Subsequent calls return the existing storage. */
+        double *promote();
+
+        inline double get(s32 bin) const
+        {
+            if (auto d = promoted())
+                return d[bin];
+            return m_data32[bin];
+        }
+
+        /* Set/add promote the storage if the result can not be represented by
+         * an u32 counter. */
+        void set(s32 bin, double value);
+        void add(s32 bin, double value);
+
+        /* Zeroes all bins. Promoted storage stays promoted. */
+        void clear();
+
+        /* Memory used for the bins in bytes. */
+        size_t storageSize() const;
+
+    private:
+        u32 *m_data32;
+        s32 m_size;
+        std::atomic<double *> m_promoted;
+        std::unique_ptr<u32[]> m_ownedData;
+        std::unique_ptr<double[]> m_promotedData;
+};
+
+/* Increments a bin of a histogram using either double storage in
+ * histo->data or compact storage in histo->data32 (the counters of
+ * histo->compact). On counter overflow the compact storage is promoted and
+ * histo->data is updated to point to the doubles. Works for H1D and H2D.
+ * Marks the tile containing the bin as modified. */
+template<typename Histo>
+inline void increment_bin(Histo *histo, s32 bin)
+{
+    if (likely(histo->data != nullptr))
+    {
+        histo->data[bin]++;
+        mark_tile(histo, bin);
+        return;
+    }
+
+    u32 &count = histo->data32[bin];
+
+    if (likely(count < CompactBins::MaxCount))
+    {
+        ++count;
+    }
+    else
+    {
+        histo->data = histo->compact->promote();
+        histo->data[bin]++;
+    }
+
+    mark_tile(histo, bin);
+}
+
+/* Adds value to a bin of a histogram using either double or compact
+ * storage. */
+template<typename Histo>
+inline void add_to_bin(Histo *histo, s32 bin, double value)
+{
+    if (histo->data)
+    {
+        histo->data[bin] += value;
+    }
+    else
+    {
+        histo->compact->add(bin, value);
+        histo->data = histo->compact->promoted();
+    }
+
+    mark_tile(histo, bin);
+}
+
+} // namespace a2
+
+#endif /* __MVME_A2_COMPACT_BINS_H__ */
@@ -0,0 +1,189 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "a2_export_columnar.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <zlib.h>
+
+namespace a2
+{
+
+namespace
+{
+
+static const char FileMagic[] = "MVMECOL1";
+static const size_t FileMagicSize = 8;
+
+} // end anon namespace
+
+const u32 ColumnarExportEncoder::FormatVersion;
+const u32 ColumnarExportEncoder::DefaultRowGroupSize;
+const size_t ColumnarExportEncoder::MaxRowGroupBytes;
+
+ColumnarExportEncoder::ColumnarExportEncoder(const std::vector<u16> &arrayDimensions,
+                                             int compressionLevel,
+                                             u32 rowGroupSize)
+    : m_dimensions(arrayDimensions)
+    , m_compressionLevel(compressionLevel)
+    , m_rowGroupSize(std::max(rowGroupSize, static_cast<u32>(1)))
+{
+    u32 columnCount = 0;
+
+    for (auto dim: m_dimensions)
+    {
+        m_firstColumns.push_back(columnCount);
+        columnCount += dim;
+    }
+
+    m_columns.resize(columnCount);
+
+    for (auto &col: m_columns)
+        col.validBits.resize((m_rowGroupSize + 7) / 8);
+}
+
+void ColumnarExportEncoder::write(ExportSinkWriter &out, const void *data, size_t size)
+{
+    out.write(data, size);
+    m_offset += size;
+}
+
+void ColumnarExportEncoder::begin(ExportSinkWriter &out)
+{
+    write(out, FileMagic, FileMagicSize);
+}
+
+void ColumnarExportEncoder::writeRowGroup(ExportSinkWriter &out)
+{
+    if (m_rowInGroup == 0)
+        return;
+
+    const u32 rowCount = m_rowInGroup;
+    const size_t bitmapSize = (rowCount + 7) / 8;
+
+    RowGroupInfo group;
+    group.firstRow = m_rowsWritten;
+    group.rowCount = rowCount;
+    group.chunks.reserve(m_columns.size());
+
+    for (auto &col: m_columns)
+    {
+        ChunkInfo chunk = {};
+        chunk.offset = m_offset;
+        chunk.codec = Codec_None;
+        chunk.validCount = col.values.size();
+        chunk.min = std::numeric_limits<double>::quiet_NaN();
+        chunk.max = std::numeric_limits<double>::quiet_NaN();
+
+        if (chunk.validCount)
+        {
+            auto mm = std::minmax_element(col.values.begin(), col.values.end());
+            chunk.min = *mm.first;
+            chunk.max = *mm.second;
+
+            const bool allValid = (chunk.validCount == rowCount);
+            const size_t valuesSize = col.values.size() * sizeof(double);
+
+            m_rawChunk.resize((allValid ? 0 : bitmapSize) + valuesSize);
+            u8 *dest = m_rawChunk.data();
+
+            if (!allValid)
+            {
+                std::memcpy(dest, col.validBits.data(), bitmapSize);
+                dest += bitmapSize;
+            }
+
+            std::memcpy(dest, col.values.data(), valuesSize);
+
+            const u8 *chunkData = m_rawChunk.data();
+            chunk.rawSize = m_rawChunk.size();
+            chunk.storedSize = chunk.rawSize;
+
+            if (m_compressionLevel != 0)
+            {
+                uLongf compressedSize = compressBound(chunk.rawSize);
+                m_compressedChunk.resize(compressedSize);
+
+                int res = compress2(m_compressedChunk.data(), &compressedSize,
+                                    m_rawChunk.data(), chunk.rawSize,
+                                    m_compressionLevel);
+
+                // The chunk is stored uncompressed if compression fails.
+                if (res == Z_OK && compressedSize < chunk.rawSize)
+                {
+                    chunk.codec = Codec_Zlib;
+                    chunk.storedSize = compressedSize;
+                    chunkData = m_compressedChunk.data();
+                }
+            }
+
+            write(out, chunkData, chunk.storedSize);
+        }
+
+        group.chunks.push_back(chunk);
+
+        std::fill(col.validBits.begin(), col.validBits.begin() + bitmapSize, 0u);
+        col.values.clear();
+    }
+
+    m_rowGroups.emplace_back(std::move(group));
+    m_rowsWritten += rowCount;
+    m_rowInGroup = 0;
+    m_groupValues = 0;
+}
+
+void ColumnarExportEncoder::finish(ExportSinkWriter &out)
+{
+    writeRowGroup(out);
+
+    const u64 footerOffset = m_offset;
+
+    write(out, FormatVersion);
+    write(out, static_cast<u32>(m_dimensions.size()));
+
+    for (auto dim: m_dimensions)
+        write(out, dim);
+
+    write(out, static_cast<u32>(m_rowGroups.size()));
+
+    for (const auto &group: m_rowGroups)
+    {
+        write(out, group.firstRow);
+        write(out, group.rowCount);
+
+        for (const auto &chunk: group.chunks)
+        {
+            write(out, chunk.offset);
+            write(out, chunk.storedSize);
+            write(out, chunk.rawSize);
+            write(out, chunk.codec);
+            write(out, chunk.validCount);
+            write(out, chunk.min);
+            write(out, chunk.max);
+        }
+    }
+
+    write(out, footerOffset);
+    write(out, FileMagic, FileMagicSize);
+}
+
+} // namespace a2
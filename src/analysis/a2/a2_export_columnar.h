@@ -0,0 +1,178 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef __MVME_A2_EXPORT_COLUMNAR_H__
+#define __MVME_A2_EXPORT_COLUMNAR_H__
+
+#include <vector>
+
+#include "a2_export_writer.h"
+#include "util/typedefs.h"
+
+namespace a2
+{
+
+/* Encoder for the columnar ExportSink format.
+ *
+ * Events (rows) are collected into row groups. Inside a row group the values
+ * of each parameter of each exported array form one column chunk. Readers can
+ * use the footer at the end of the file to locate and read only the column
+ * chunks they are interested in.
+ *
+ * All numbers are little-endian. Layout of the file:
+ *
+ *   magic            "MVMECOL1"
+ *   column chunks    for each row group, for each column
+ *   footer
+ *   footerOffset     u64, file offset of the footer
+ *   magic            "MVMECOL1"
+ *
+ * Footer:
+ *   version          u32, currently 1
+ *   arrayCount       u32
+ *   dimensions       u16 for each array
+ *   rowGroupCount    u32
+ *   for each row group:
+ *     firstRow       u64
+ *     rowCount       u32
+ *     for each column (arrays in order, parameters in order):
+ *       offset       u64, file offset of the chunk
+ *       storedSize   u32, size of the chunk in the file
+ *       rawSize      u32, size after decompression
+ *       codec        u8, 0: uncompressed, 1: zlib
+ *       validCount   u32, number of rows with a valid value
+ *       min, max     f64, of the valid values, NaN if there are none
+ *
+ * Uncompressed column chunk:
+ *   validity bitmap  (rowCount + 7) / 8 bytes. Bit (row % 8) of byte
+ *                    (row / 8) is set if the row contains a valid value.
+ *                    Omitted if all rows are valid.
+ *   values           validCount f64 values in row order.
+ *
+ * Chunks without valid values are not stored (storedSize = rawSize = 0). If
+ * compression is enabled a chunk is stored uncompressed if zlib cannot make it
+ * smaller.
+ */
+class ColumnarExportEncoder
+{
+    public:
+        static const u32 FormatVersion = 1;
+        static const u32 DefaultRowGroupSize = 1u << 16;
+
+        /* A row group is finished early once this many bytes of values have
+         * been collected. Limits the memory used for wide exports. */
+        static const size_t MaxRowGroupBytes = 32u << 20;
+
+        enum Codec: u8
+        {
+            Codec_None,
+            Codec_Zlib,
+        };
+
+        /* One column per parameter of each array. The compressionLevel is
+         * interpreted as in ExportSinkData and applies to each column
+         * chunk. */
+        ColumnarExportEncoder(const std::vector<u16> &arrayDimensions,
+                              int compressionLevel,
+                              u32 rowGroupSize = DefaultRowGroupSize);
+
+        /* Writes the file magic. */
+        void begin(ExportSinkWriter &out);
+
+        /* Index of the first column of the given array. */
+        u32 getFirstColumn(size_t arrayIndex) const { return m_firstColumns[arrayIndex]; }
+
+        /* Sets the value of a column in the current row. Must be called at
+         * most once per column and row. Columns without a value are
+         * invalid. */
+        void setValue(u32 column, double value)
+        {
+            auto &col = m_columns[column];
+            col.validBits[m_rowInGroup >> 3] |= static_cast<u8>(1u << (m_rowInGroup & 7));
+            col.values.push_back(value);
+            ++m_groupValues;
+        }
+
+        /* Finishes the current row. Writes the row group once it's full. */
+        void endRow(ExportSinkWriter &out)
+        {
+            if (++m_rowInGroup >= m_rowGroupSize
+                || m_groupValues * sizeof(double) >= MaxRowGroupBytes)
+            {
+                writeRowGroup(out);
+            }
+        }
+
+        /* Writes the last row group and the footer. */
+        void finish(ExportSinkWriter &out);
+
+    private:
+        struct Column
+        {
+            std::vector<u8> validBits;
+            std::vector<double> values;
+        };
+
+        struct ChunkInfo
+        {
+            u64 offset;
+            u32 storedSize;
+            u32 rawSize;
+            u8 codec;
+            u32 validCount;
+            double min;
+            double max;
+        };
+
+        struct RowGroupInfo
+        {
+            u64 firstRow;
+            u32 rowCount;
+            std::vector<ChunkInfo> chunks;
+        };
+
+        void writeRowGroup(ExportSinkWriter &out);
+        void write(ExportSinkWriter &out, const void *data, size_t size);
+
+        template<typename T>
+        void write(ExportSinkWriter &out, T value)
+        {
+            write(out, &value, sizeof(value));
+        }
+
+        std::vector<u16> m_dimensions;
+        std::vector<u32> m_firstColumns;
+        std::vector<Column> m_columns;
+        std::vector<RowGroupInfo> m_rowGroups;
+        int m_compressionLevel;
+        u32 m_rowGroupSize;
+        u32 m_rowInGroup = 0;
+        size_t m_groupValues = 0;
+        u64 m_rowsWritten = 0;
+        u64 m_offset = 0;
+
+        // Reused chunk buffers.
+        std::vector<u8> m_rawChunk;
+        std::vector<u8> m_compressedChunk;
+};
+
+} // namespace a2
+
+#endif /* __MVME_A2_EXPORT_COLUMNAR_H__ */
@@ -0,0 +1,321 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "a2_export_writer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <zstr.hpp>
+
+namespace a2
+{
+
+namespace
+{
+
+struct Block
+{
+    std::vector<char> data;
+    size_t used = 0;
+};
+
+} // end anon namespace
+
+struct ExportSinkWriter::Private
+{
+    ExportSinkWriter *q;
+    size_t blockSize;
+    size_t blockCount;
+    std::string filename;
+    ErrorCallback errorCallback;
+
+    // The streams are used by the writer thread only. They are closed by
+    // finish() after the thread has been joined.
+    std::unique_ptr<std::ofstream> ostream;
+    std::unique_ptr<std::ostream> z_ostream;
+    std::ostream *outp = nullptr;
+
+    std::vector<Block> blocks;
+    Block *staging = nullptr;
+
+    std::mutex mutex;
+    std::condition_variable fullCond;
+    std::condition_variable freeCond;
+    std::deque<Block *> fullBlocks;
+    std::deque<Block *> freeBlocks;
+    bool quit = false;
+
+    std::thread writerThread;
+
+    std::atomic<u64> fileBytesWritten;
+    std::atomic<u64> blocksWritten;
+    std::atomic<u64> stallCount;
+    std::atomic<u64> stallNanoseconds;
+    std::atomic<size_t> queueDepth;
+
+    void reportError(const char *what)
+    {
+        std::ostringstream ss;
+        ss << "Error writing to output file " << filename << ": " << what;
+
+        // Only the first error is reported.
+        if (!q->m_error.exchange(true) && errorCallback)
+            errorCallback(ss.str());
+    }
+
+    void writerLoop()
+    {
+        while (true)
+        {
+            Block *block = nullptr;
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                fullCond.wait(lock, [this] { return !fullBlocks.empty() || quit; });
+
+                if (fullBlocks.empty())
+                    break;
+
+                block = fullBlocks.front();
+                fullBlocks.pop_front();
+                queueDepth = fullBlocks.size();
+            }
+
+            if (q->good())
+            {
+                try
+                {
+                    outp->write(block->data.data(), block->used);
+                    ++blocksWritten;
+                    fileBytesWritten = static_cast<u64>(ostream->tellp());
+                }
+                catch (const std::exception &e)
+                {
+                    reportError(e.what());
+                }
+            }
+
+            block->used = 0;
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                freeBlocks.push_back(block);
+            }
+
+            freeCond.notify_one();
+        }
+    }
+
+    void queueStagingBlock()
+    {
+        assert(staging);
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            fullBlocks.push_back(staging);
+            queueDepth = fullBlocks.size();
+        }
+
+        staging = nullptr;
+        fullCond.notify_one();
+    }
+
+    void acquireStagingBlock()
+    {
+        assert(!staging);
+
+        std::unique_lock<std::mutex> lock(mutex);
+
+        if (freeBlocks.empty())
+        {
+            auto tStart = std::chrono::steady_clock::now();
+            freeCond.wait(lock, [this] { return !freeBlocks.empty(); });
+            auto elapsed = std::chrono::steady_clock::now() - tStart;
+
+            ++stallCount;
+            stallNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                elapsed).count();
+        }
+
+        staging = freeBlocks.front();
+        freeBlocks.pop_front();
+    }
+};
+
+ExportSinkWriter::ExportSinkWriter(size_t blockSize, size_t blockCount)
+    : d(std::make_unique<Private>())
+    , m_error(false)
+{
+    d->q = this;
+    d->blockSize = std::max(blockSize, static_cast<size_t>(1));
+    d->blockCount = std::max(blockCount, static_cast<size_t>(2));
+    d->fileBytesWritten = 0;
+    d->blocksWritten = 0;
+    d->stallCount = 0;
+    d->stallNanoseconds = 0;
+    d->queueDepth = 0;
+}
+
+ExportSinkWriter::~ExportSinkWriter()
+{
+    finish();
+}
+
+void ExportSinkWriter::open(const std::string &filename, int compressionLevel,
+                            ErrorCallback errorCallback)
+{
+    finish();
+
+    d->filename = filename;
+    d->errorCallback = errorCallback;
+    m_error = false;
+
+    // See the note about error handling in export_sink_begin_run(). Both the
+    // ofstream and the zstr stream have exceptions enabled.
+    d->ostream = std::make_unique<std::ofstream>(filename, std::ios::binary | std::ios::trunc);
+    d->ostream->exceptions(std::ios::failbit | std::ios::badbit);
+
+    if (compressionLevel != 0)
+        d->z_ostream = std::make_unique<zstr::ostream>(*d->ostream);
+
+    d->outp = d->z_ostream ? d->z_ostream.get() : d->ostream.get();
+    d->fileBytesWritten = 0;
+
+    if (d->blocks.empty())
+    {
+        d->blocks.resize(d->blockCount);
+
+        for (auto &block: d->blocks)
+            block.data.resize(d->blockSize);
+    }
+
+    d->freeBlocks.clear();
+    d->fullBlocks.clear();
+    d->quit = false;
+
+    for (auto &block: d->blocks)
+    {
+        block.used = 0;
+        d->freeBlocks.push_back(&block);
+    }
+
+    d->acquireStagingBlock();
+    m_stagingPos = d->staging->data.data();
+    m_stagingEnd = m_stagingPos + d->staging->data.size();
+
+    d->writerThread = std::thread(&Private::writerLoop, d.get());
+    m_isOpen = true;
+}
+
+void ExportSinkWriter::writeSlow(const char *data, size_t size)
+{
+    while (size && d->staging)
+    {
+        if (!good())
+        {
+            // Keep reusing the staging block. The data is not going to be
+            // written anyways.
+            m_stagingPos = d->staging->data.data();
+            return;
+        }
+
+        size_t toCopy = std::min(size, static_cast<size_t>(m_stagingEnd - m_stagingPos));
+        std::memcpy(m_stagingPos, data, toCopy);
+        m_stagingPos += toCopy;
+        data += toCopy;
+        size -= toCopy;
+
+        if (m_stagingPos == m_stagingEnd)
+        {
+            d->staging->used = d->staging->data.size();
+            d->queueStagingBlock();
+            d->acquireStagingBlock();
+            m_stagingPos = d->staging->data.data();
+            m_stagingEnd = m_stagingPos + d->staging->data.size();
+        }
+    }
+}
+
+void ExportSinkWriter::finish()
+{
+    if (!m_isOpen)
+        return;
+
+    m_isOpen = false;
+
+    d->staging->used = m_stagingPos - d->staging->data.data();
+
+    if (d->staging->used)
+        d->queueStagingBlock();
+
+    d->staging = nullptr;
+    m_stagingPos = m_stagingEnd = nullptr;
+
+    {
+        std::unique_lock<std::mutex> lock(d->mutex);
+        d->quit = true;
+    }
+
+    d->fullCond.notify_one();
+    d->writerThread.join();
+
+    // Destroying the zstr stream flushes the remaining compressed data.
+    // Errors during the flush cannot be detected. Closing the ofstream can
+    // throw as exceptions are enabled.
+    try
+    {
+        d->z_ostream = {};
+
+        if (d->ostream->is_open())
+        {
+            d->ostream->flush();
+            d->fileBytesWritten = static_cast<u64>(d->ostream->tellp());
+            d->ostream->close();
+        }
+    }
+    catch (const std::exception &e)
+    {
+        d->reportError(e.what());
+    }
+
+    d->ostream = {};
+}
+
+ExportSinkWriter::Counters ExportSinkWriter::getCounters() const
+{
+    Counters result;
+    result.fileBytesWritten = d->fileBytesWritten;
+    result.blocksWritten = d->blocksWritten;
+    result.stallCount = d->stallCount;
+    result.stallNanoseconds = d->stallNanoseconds;
+    result.queueDepth = d->queueDepth;
+    result.blockCount = d->blockCount;
+    return result;
+}
+
+} // namespace a2
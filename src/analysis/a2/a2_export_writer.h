@@ -0,0 +1,142 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef __MVME_A2_EXPORT_WRITER_H__
+#define __MVME_A2_EXPORT_WRITER_H__
+
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "util/typedefs.h"
+
+namespace a2
+{
+
+/* Output file writer used by the ExportSink operators.
+ *
+ * The analysis thread appends event data to an in-memory staging block. Full
+ * blocks are handed to a writer thread which compresses them (if enabled) and
+ * writes them to the output file. A fixed number of blocks cycles between the
+ * two threads: while the writer thread works on one block the analysis thread
+ * fills the next one.
+ *
+ * If the writer thread cannot keep up and all blocks are queued the analysis
+ * thread has to wait for a block to be returned. These stalls are counted and
+ * timed to make the backpressure visible.
+ *
+ * I/O errors are reported via the error callback which is invoked from the
+ * writer thread. After the first error no more data is written to the file
+ * and good() returns false.
+ *
+ * The writer can be opened and finished multiple times, once per run. The
+ * counters are kept across runs and can be read from any thread.
+ */
+class ExportSinkWriter
+{
+    public:
+        static const size_t DefaultBlockSize  = 1u << 20;
+        static const size_t DefaultBlockCount = 4;
+
+        using ErrorCallback = std::function<void (const std::string &msg)>;
+
+        struct Counters
+        {
+            // Bytes written to the current output file. These are compressed
+            // bytes if compression is enabled.
+            u64 fileBytesWritten = 0;
+            u64 blocksWritten = 0;
+
+            // Number of times the analysis thread had to wait for a free
+            // block and the total time spent waiting.
+            u64 stallCount = 0;
+            u64 stallNanoseconds = 0;
+
+            // Full blocks waiting to be written by the writer thread.
+            size_t queueDepth = 0;
+            size_t blockCount = 0;
+        };
+
+        /* Nothing is allocated until open() is called. At least two blocks
+         * are used. */
+        explicit ExportSinkWriter(size_t blockSize = DefaultBlockSize,
+                                  size_t blockCount = DefaultBlockCount);
+
+        /* Calls finish(). */
+        ~ExportSinkWriter();
+
+        ExportSinkWriter(const ExportSinkWriter &) = delete;
+        ExportSinkWriter &operator=(const ExportSinkWriter &) = delete;
+
+        /* Appends data to the current staging block. Full blocks are queued
+         * for the writer thread. Waits for a free block if all blocks are
+         * queued. Data is silently dropped once an error occured or after
+         * finish() has been called. */
+        void write(const void *data, size_t size)
+        {
+            if (size <= static_cast<size_t>(m_stagingEnd - m_stagingPos))
+            {
+                std::memcpy(m_stagingPos, data, size);
+                m_stagingPos += size;
+            }
+            else
+            {
+                writeSlow(reinterpret_cast<const char *>(data), size);
+            }
+        }
+
+        /* Opens the output file and starts the writer thread. Finishes the
+         * previous file if the writer is still open. Throws std::exception if
+         * the file cannot be opened. The compressionLevel is interpreted as in
+         * ExportSinkData. */
+        void open(const std::string &filename, int compressionLevel,
+                  ErrorCallback errorCallback);
+
+        bool isOpen() const { return m_isOpen; }
+        bool good() const { return !m_error.load(std::memory_order_relaxed); }
+
+        /* Queues the partially filled staging block, waits for the writer
+         * thread to write out all queued blocks and closes the output file.
+         * Must be called from the thread calling write(). */
+        void finish();
+
+        /* Can be called from any thread. */
+        Counters getCounters() const;
+
+    private:
+        void writeSlow(const char *data, size_t size);
+
+        struct Private;
+        std::unique_ptr<Private> d;
+
+        // Free space in the current staging block. Only accessed by the
+        // thread calling write().
+        char *m_stagingPos = nullptr;
+        char *m_stagingEnd = nullptr;
+        bool m_isOpen = false;
+
+        std::atomic<bool> m_error;
+};
+
+} // namespace a2
+
+#endif /* __MVME_A2_EXPORT_WRITER_H__ */
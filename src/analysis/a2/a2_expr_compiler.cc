@@ -0,0 +1,1810 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "a2_expr_compiler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <sstream>
+
+#include "a2_param.h"
+
+namespace a2
+{
+namespace expr_compiler
+{
+
+namespace
+{
+
+std::string to_lower(std::string str)
+{
+    std::transform(str.begin(), str.end(), str.begin(),
+                   [] (unsigned char c) { return std::tolower(c); });
+    return str;
+}
+
+//
+// Runtime semantics. These mirror the implementations used by exprtk.
+//
+
+// Value of the exprtk 'epsilon' constant.
+static const double Epsilon = 0.0000000001;
+
+inline bool is_true(double v) { return v != 0.0; }
+
+inline double op_abs(double v) { return v < 0.0 ? -v : v; }
+
+double fn_abs(double v) { return op_abs(v); }
+double fn_sqrt(double v) { return std::sqrt(v); }
+double fn_exp(double v) { return std::exp(v); }
+double fn_log(double v) { return std::log(v); }
+double fn_log10(double v) { return std::log10(v); }
+double fn_sin(double v) { return std::sin(v); }
+double fn_cos(double v) { return std::cos(v); }
+double fn_tan(double v) { return std::tan(v); }
+double fn_asin(double v) { return std::asin(v); }
+double fn_acos(double v) { return std::acos(v); }
+double fn_atan(double v) { return std::atan(v); }
+double fn_floor(double v) { return std::floor(v); }
+double fn_ceil(double v) { return std::ceil(v); }
+double fn_round(double v) { return v < 0.0 ? std::ceil(v - 0.5) : std::floor(v + 0.5); }
+double fn_not(double v) { return v == 0.0 ? 1.0 : 0.0; }
+double fn_is_valid(double p) { return static_cast<double>(is_param_valid(p)); }
+double fn_is_invalid(double p) { return static_cast<double>(!is_param_valid(p)); }
+double fn_is_nan(double d) { return static_cast<double>(std::isnan(d)); }
+
+double fn_pow(double a, double b) { return std::pow(a, b); }
+double fn_atan2(double a, double b) { return std::atan2(a, b); }
+double fn_valid_or(double p, double def) { return is_param_valid(p) ? p : def; }
+
+using Function1 = double (*)(double);
+using Function2 = double (*)(double, double);
+
+const std::map<std::string, Function1> &unary_functions()
+{
+    static const std::map<std::string, Function1> result =
+    {
+        { "abs",        fn_abs },
+        { "sqrt",       fn_sqrt },
+        { "exp",        fn_exp },
+        { "log",        fn_log },
+        { "log10",      fn_log10 },
+        { "sin",        fn_sin },
+        { "cos",        fn_cos },
+        { "tan",        fn_tan },
+        { "asin",       fn_asin },
+        { "acos",       fn_acos },
+        { "atan",       fn_atan },
+        { "floor",      fn_floor },
+        { "ceil",       fn_ceil },
+        { "round",      fn_round },
+        { "not",        fn_not },
+        { "is_valid",   fn_is_valid },
+        { "is_invalid", fn_is_invalid },
+        { "is_nan",     fn_is_nan },
+    };
+
+    return result;
+}
+
+/* The expression operator runtime library functions. Unlike the exprtk
+ * builtins these are not evaluated at compile time for literal arguments. */
+bool is_runtime_library_function(const std::string &name)
+{
+    return (name == "is_valid" || name == "is_invalid" || name == "is_nan"
+            || name == "valid_or");
+}
+
+const std::map<std::string, Function2> &binary_functions()
+{
+    static const std::map<std::string, Function2> result =
+    {
+        { "pow",        fn_pow },
+        { "atan2",      fn_atan2 },
+        { "valid_or",   fn_valid_or },
+    };
+
+    return result;
+}
+
+//
+// Bytecode
+//
+
+enum class Op: u8
+{
+    Mov,        // r[d] = r[a]
+    LoadExt,    // r[d] = *ext[a]
+    StoreExt,   // *ext[d] = r[a]
+    Add,        // r[d] = r[a] op r[b]
+    Sub,
+    Mul,
+    Div,
+    Mod,
+    Pow,
+    Lt,
+    Le,
+    Gt,
+    Ge,
+    Eq,
+    Ne,
+    And,
+    Or,
+    Min,
+    Max,
+    Neg,        // r[d] = -r[a]
+    Call1,      // r[d] = fn1[c](r[a])
+    Call2,      // r[d] = fn2[c](r[a], r[b])
+    LoadElem,   // r[d] = vec[a][r[b]]
+    StoreElem,  // vec[d][r[a]] = r[b]
+    Jmp,        // pc = c
+    Jz,         // if (!is_true(r[a])) pc = c
+
+    // Whole array operations on the first c elements.
+    VFill,      // vec[d][i] = r[a]
+    VCopy,      // vec[d][i] = vec[a][i]
+    VNeg,       // vec[d][i] = -vec[a][i]
+    VBinVV,     // vec[d][i] = vec[a][i] sub vec[b][i]
+    VBinVS,     // vec[d][i] = vec[a][i] sub r[b]
+    VBinSV,     // vec[d][i] = r[a] sub vec[b][i]
+};
+
+struct Instr
+{
+    Op op;
+    Op sub; // arithmetic operation of the VBin instructions
+    s32 d, a, b, c;
+};
+
+struct VectorRef
+{
+    double *data;
+    s32 size;
+};
+
+//
+// Lexer
+//
+
+struct Token
+{
+    enum Type
+    {
+        End,
+        Number,
+        Ident,
+        Symbol,
+    };
+
+    Type type = End;
+    std::string text;
+    double number = 0.0;
+    size_t pos = 0;
+};
+
+[[noreturn]] void unsupported(const std::string &what, size_t pos)
+{
+    std::ostringstream ss;
+    ss << what << " (at offset " << pos << ")";
+    throw UnsupportedExpression(ss.str());
+}
+
+std::vector<Token> tokenize(const std::string &str)
+{
+    static const char *Symbols[] =
+    {
+        ":=", "+=", "-=", "*=", "/=", "%=", "==", "!=", "<>", "<=", ">=",
+        "<", ">", "=", "+", "-", "*", "/", "%", "^", "(", ")", "[", "]",
+        "{", "}", ",", ";", "?", ":", "&", "|",
+    };
+
+    std::vector<Token> result;
+    size_t i = 0;
+    const size_t len = str.size();
+
+    auto is_ident_start = [] (char c) { return std::isalpha(static_cast<unsigned char>(c)) || c == '_'; };
+    auto is_ident_char = [] (char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.'; };
+    auto is_digit = [] (char c) { return std::isdigit(static_cast<unsigned char>(c)); };
+
+    while (i < len)
+    {
+        char c = str[i];
+
+        if (std::isspace(static_cast<unsigned char>(c)))
+        {
+            i++;
+            continue;
+        }
+
+        // comments
+        if (c == '#' || (c == '/' && i + 1 < len && str[i + 1] == '/'))
+        {
+            while (i < len && str[i] != '\n')
+                i++;
+            continue;
+        }
+
+        if (c == '/' && i + 1 < len && str[i + 1] == '*')
+        {
+            auto end = str.find("*/", i + 2);
+            if (end == std::string::npos)
+                unsupported("unterminated comment", i);
+            i = end + 2;
+            continue;
+        }
+
+        Token token;
+        token.pos = i;
+
+        if (is_digit(c) || (c == '.' && i + 1 < len && is_digit(str[i + 1])))
+        {
+            size_t start = i;
+
+            while (i < len && is_digit(str[i])) i++;
+
+            if (i < len && str[i] == '.')
+            {
+                i++;
+                while (i < len && is_digit(str[i])) i++;
+            }
+
+            if (i < len && (str[i] == 'e' || str[i] == 'E'))
+            {
+                size_t j = i + 1;
+
+                if (j < len && (str[j] == '+' || str[j] == '-'))
+                    j++;
+
+                if (j < len && is_digit(str[j]))
+                {
+                    i = j;
+                    while (i < len && is_digit(str[i])) i++;
+                }
+            }
+
+            token.type = Token::Number;
+            token.text = str.substr(start, i - start);
+            token.number = std::strtod(token.text.c_str(), nullptr);
+
+            // Implicit multiplication like '2x' is not supported.
+            if (i < len && is_ident_start(str[i]))
+                unsupported("implicit multiplication", i);
+        }
+        else if (is_ident_start(c))
+        {
+            size_t start = i;
+            while (i < len && is_ident_char(str[i])) i++;
+            token.type = Token::Ident;
+            token.text = to_lower(str.substr(start, i - start));
+        }
+        else
+        {
+            for (auto sym: Symbols)
+            {
+                if (str.compare(i, std::strlen(sym), sym) == 0)
+                {
+                    token.type = Token::Symbol;
+                    token.text = sym;
+                    i += token.text.size();
+                    break;
+                }
+            }
+
+            if (token.type != Token::Symbol)
+                unsupported(std::string("unsupported character '") + c + "'", i);
+        }
+
+        result.emplace_back(token);
+    }
+
+    Token end;
+    end.pos = len;
+    result.emplace_back(end);
+
+    return result;
+}
+
+//
+// Expression tree
+//
+
+struct Node
+{
+    enum Kind
+    {
+        Constant,   // value
+        Register,   // index = local variable register
+        ExtScalar,  // index = external scalar
+        Vector,     // index = vector, size = vector size
+        Element,    // index = vector, args[0] = element index
+        Unary,      // op, args[0]
+        Binary,     // op, args[0], args[1]
+        Ternary,    // args[0] ? args[1] : args[2]
+        Call1,      // fn1, args[0]
+        Call2,      // fn2, args[0], args[1]
+    };
+
+    Kind kind = Constant;
+    Op op = Op::Mov;
+    double value = 0.0;
+    s32 index = -1;
+    Function1 fn1 = nullptr;
+    Function2 fn2 = nullptr;
+
+    // Number of elements for vector valued nodes, -1 for scalars.
+    s32 size = -1;
+
+    std::vector<std::unique_ptr<Node>> args;
+
+    bool isVector() const { return size >= 0; }
+};
+
+using NodePtr = std::unique_ptr<Node>;
+
+//
+// Parser and code generator
+//
+
+class Compiler
+{
+    public:
+        Compiler(const std::string &expr, const SymbolTable &symtab)
+            : m_tokens(tokenize(expr))
+            , m_symtab(symtab)
+        {
+            for (const auto &v: symtab.vectors())
+                m_vectors.push_back({ v.data, v.size });
+
+            for (const auto &s: symtab.scalars())
+                m_ext.push_back(s.value);
+        }
+
+        void compile()
+        {
+            m_scopes.emplace_back();
+
+            while (!atEnd())
+                parseStatement();
+        }
+
+        std::vector<Instr> m_code;
+        std::vector<double> m_registers;
+        std::vector<double *> m_ext;
+        std::vector<VectorRef> m_vectors;
+        std::vector<std::unique_ptr<double[]>> m_vectorStorage;
+        std::vector<Function1> m_fn1;
+        std::vector<Function2> m_fn2;
+
+    private:
+        struct Loop
+        {
+            std::vector<size_t> breaks;
+            std::vector<size_t> continues;
+        };
+
+        std::vector<Token> m_tokens;
+        size_t m_pos = 0;
+        const SymbolTable &m_symtab;
+        std::vector<std::map<std::string, s32>> m_scopes;
+        std::map<u64, s32> m_constantRegisters;
+        std::vector<Loop> m_loops;
+
+        //
+        // Token helpers
+        //
+
+        const Token &cur() const { return m_tokens[m_pos]; }
+        const Token &peek(size_t n = 1) const
+        {
+            return m_tokens[std::min(m_pos + n, m_tokens.size() - 1)];
+        }
+
+        bool atEnd() const { return cur().type == Token::End; }
+
+        bool isSymbol(const char *sym, size_t n = 0) const
+        {
+            const auto &t = peek(n);
+            return t.type == Token::Symbol && t.text == sym;
+        }
+
+        bool isKeyword(const char *kw) const
+        {
+            return cur().type == Token::Ident && cur().text == kw;
+        }
+
+        bool accept(const char *sym)
+        {
+            if (isSymbol(sym))
+            {
+                m_pos++;
+                return true;
+            }
+            return false;
+        }
+
+        void expect(const char *sym)
+        {
+            if (!accept(sym))
+                unsupported(std::string("expected '") + sym + "'", cur().pos);
+        }
+
+        //
+        // Registers, vectors, code emission
+        //
+
+        s32 newRegister(double init = 0.0)
+        {
+            m_registers.push_back(init);
+            return static_cast<s32>(m_registers.size() - 1);
+        }
+
+        s32 constantRegister(double value)
+        {
+            u64 bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+
+            auto it = m_constantRegisters.find(bits);
+
+            if (it != m_constantRegisters.end())
+                return it->second;
+
+            s32 reg = newRegister(value);
+            m_constantRegisters[bits] = reg;
+            return reg;
+        }
+
+        s32 tempVector(s32 size)
+        {
+            m_vectorStorage.emplace_back(new double[std::max(size, 1)]());
+            m_vectors.push_back({ m_vectorStorage.back().get(), size });
+            return static_cast<s32>(m_vectors.size() - 1);
+        }
+
+        size_t emit(Op op, s32 d = 0, s32 a = 0, s32 b = 0, s32 c = 0, Op sub = Op::Mov)
+        {
+            m_code.push_back({ op, sub, d, a, b, c });
+            return m_code.size() - 1;
+        }
+
+        void patchJump(size_t instrIndex)
+        {
+            m_code[instrIndex].c = static_cast<s32>(m_code.size());
+        }
+
+        //
+        // Symbol lookup
+        //
+
+        s32 findLocal(const std::string &name) const
+        {
+            for (auto it = m_scopes.rbegin(); it != m_scopes.rend(); ++it)
+            {
+                auto jt = it->find(name);
+                if (jt != it->end())
+                    return jt->second;
+            }
+            return -1;
+        }
+
+        template<typename Container>
+        static s32 findSymbol(const Container &symbols, const std::string &name)
+        {
+            for (size_t i = 0; i < symbols.size(); i++)
+            {
+                if (to_lower(symbols[i].name) == name)
+                    return static_cast<s32>(i);
+            }
+            return -1;
+        }
+
+        NodePtr makeConstant(double value)
+        {
+            auto node = std::make_unique<Node>();
+            node->kind = Node::Constant;
+            node->value = value;
+            return node;
+        }
+
+        NodePtr lookupSymbol(const std::string &name, size_t pos)
+        {
+            auto node = std::make_unique<Node>();
+
+            s32 idx = findLocal(name);
+
+            if (idx >= 0)
+            {
+                node->kind = Node::Register;
+                node->index = idx;
+                return node;
+            }
+
+            if ((idx = findSymbol(m_symtab.vectors(), name)) >= 0)
+            {
+                node->kind = Node::Vector;
+                node->index = idx;
+                node->size = m_symtab.vectors()[idx].size;
+                return node;
+            }
+
+            if ((idx = findSymbol(m_symtab.scalars(), name)) >= 0)
+            {
+                node->kind = Node::ExtScalar;
+                node->index = idx;
+                return node;
+            }
+
+            if ((idx = findSymbol(m_symtab.constants(), name)) >= 0)
+                return makeConstant(m_symtab.constants()[idx].value);
+
+            if (name == "pi")       return makeConstant(3.14159265358979323846);
+            if (name == "epsilon")  return makeConstant(Epsilon);
+            if (name == "inf")      return makeConstant(std::numeric_limits<double>::infinity());
+            if (name == "true")     return makeConstant(1.0);
+            if (name == "false")    return makeConstant(0.0);
+
+            unsupported("unknown symbol '" + name + "'", pos);
+        }
+
+        //
+        // Expressions
+        //
+
+        struct BinaryOp
+        {
+            const char *symbol;
+            Op op;
+            int left, right; // exprtk precedence levels
+        };
+
+        const BinaryOp *currentBinaryOp() const
+        {
+            static const BinaryOp Ops[] =
+            {
+                { "or",  Op::Or,   1,  2 },
+                { "|",   Op::Or,   1,  2 },
+                { "and", Op::And,  3,  4 },
+                { "&",   Op::And,  3,  4 },
+                { "<",   Op::Lt,   5,  6 },
+                { "<=",  Op::Le,   5,  6 },
+                { ">",   Op::Gt,   5,  6 },
+                { ">=",  Op::Ge,   5,  6 },
+                { "=",   Op::Eq,   5,  6 },
+                { "==",  Op::Eq,   5,  6 },
+                { "!=",  Op::Ne,   5,  6 },
+                { "<>",  Op::Ne,   5,  6 },
+                { "+",   Op::Add,  7,  8 },
+                { "-",   Op::Sub,  7,  8 },
+                { "*",   Op::Mul, 10, 11 },
+                { "/",   Op::Div, 10, 11 },
+                { "%",   Op::Mod, 10, 11 },
+                { "^",   Op::Pow, 12, 12 },
+            };
+
+            const auto &t = cur();
+
+            if (t.type != Token::Symbol && t.type != Token::Ident)
+                return nullptr;
+
+            for (const auto &op: Ops)
+            {
+                if (t.text == op.symbol)
+                    return &op;
+            }
+
+            return nullptr;
+        }
+
+        /* Operations supported on arrays. exprtk does not implement the
+         * modulo operation on arrays. */
+        static bool isArithmetic(Op op)
+        {
+            switch (op)
+            {
+                case Op::Add: case Op::Sub: case Op::Mul:
+                case Op::Div: case Op::Pow:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        static bool isScalarConstant(const Node &node)
+        {
+            return node.kind == Node::Constant && !node.isVector();
+        }
+
+        /* True if exprtk represents the node as a variable node: scalar
+         * variables and array elements with a constant index. */
+        static bool isExprtkVariable(const Node &node)
+        {
+            return (node.kind == Node::Register
+                    || node.kind == Node::ExtScalar
+                    || (node.kind == Node::Element && isScalarConstant(*node.args[0])));
+        }
+
+        /* Mirrors the simplifications exprtk applies when synthesizing a
+         * scalar binary node with one literal operand and a non-variable
+         * operand, e.g. 'input0[i] * 0'. These do not follow IEEE semantics:
+         * the result is 0 even if input0[i] is NaN or inf. exprtk is always
+         * built with exprtk_disable_enhanced_features (see a2_exprtk.cc),
+         * so variable operands are not simplified.
+         * Returns nullptr if no simplification applies. */
+        NodePtr simplifyLiteralOperand(Op op, NodePtr &lhs, NodePtr &rhs)
+        {
+            const bool lc = isScalarConstant(*lhs);
+            const bool rc = isScalarConstant(*rhs);
+
+            if (lc == rc || lhs->isVector() || rhs->isVector())
+                return {};
+
+            const double c = lc ? lhs->value : rhs->value;
+            auto &other = lc ? rhs : lhs;
+
+            if (isExprtkVariable(*other))
+                return {};
+
+            if (c == 1.0 && op == Op::Mul)
+                return std::move(other);
+
+            if (c != 0.0)
+                return {};
+
+            switch (op)
+            {
+                case Op::Mul:
+                    return makeConstant(0.0);
+
+                case Op::Div:
+                    return makeConstant(lc ? 0.0 : std::numeric_limits<double>::quiet_NaN());
+
+                case Op::Add:
+                    return std::move(other);
+
+                default:
+                    break;
+            }
+
+            return {};
+        }
+
+        /* exprtk evaluates operators and builtin functions with literal
+         * operands at compile time. The folded values can then take part in
+         * the literal operand simplifications. */
+        static bool foldConstants(Op op, const Node &lhs, const Node &rhs, double &result)
+        {
+            if (!isScalarConstant(lhs) || !isScalarConstant(rhs))
+                return false;
+
+            const double a = lhs.value;
+            const double b = rhs.value;
+
+            switch (op)
+            {
+                case Op::Add: result = a + b; break;
+                case Op::Sub: result = a - b; break;
+                case Op::Mul: result = a * b; break;
+                case Op::Div: result = a / b; break;
+                case Op::Mod: result = std::fmod(a, b); break;
+                case Op::Pow: result = std::pow(a, b); break;
+                case Op::Lt:  result = (a <  b) ? 1.0 : 0.0; break;
+                case Op::Le:  result = (a <= b) ? 1.0 : 0.0; break;
+                case Op::Gt:  result = (a >  b) ? 1.0 : 0.0; break;
+                case Op::Ge:  result = (a >= b) ? 1.0 : 0.0; break;
+                case Op::Eq:  result = (a == b) ? 1.0 : 0.0; break;
+                case Op::Ne:  result = (a != b) ? 1.0 : 0.0; break;
+                case Op::And: result = (is_true(a) && is_true(b)) ? 1.0 : 0.0; break;
+                case Op::Or:  result = (is_true(a) || is_true(b)) ? 1.0 : 0.0; break;
+                case Op::Min: result = std::min(a, b); break;
+                case Op::Max: result = std::max(a, b); break;
+                default: return false;
+            }
+
+            return true;
+        }
+
+        static bool isAddSub(Op op) { return op == Op::Add || op == Op::Sub; }
+        static bool isMulDiv(Op op) { return op == Op::Mul || op == Op::Div; }
+
+        /* True for nodes exprtk represents as a binary node with one literal
+         * operand. */
+        static bool isLiteralOperandNode(const Node &node)
+        {
+            if (node.kind != Node::Binary || node.isVector())
+                return false;
+
+            const auto &a = *node.args[0];
+            const auto &b = *node.args[1];
+
+            if (isScalarConstant(a) == isScalarConstant(b))
+                return false;
+
+            return !isExprtkVariable(isScalarConstant(a) ? b : a);
+        }
+
+        /* exprtk reassociates chains like '(x * 2) / 3' into 'x * (2 / 3)'
+         * which changes the rounding of the result. These are left to exprtk
+         * instead of reimplementing its rewrite rules. */
+        static bool isReassociatedByExprtk(Op op, const Node &lhs, const Node &rhs)
+        {
+            const bool lc = isScalarConstant(lhs);
+            const bool rc = isScalarConstant(rhs);
+
+            if (lc == rc)
+                return false;
+
+            const auto &other = lc ? rhs : lhs;
+
+            if (!isLiteralOperandNode(other))
+                return false;
+
+            return ((isAddSub(op) && isAddSub(other.op))
+                    || (isMulDiv(op) && isMulDiv(other.op))
+                    || (op == Op::Pow && other.op == Op::Pow && rc));
+        }
+
+        NodePtr makeBinary(Op op, NodePtr lhs, NodePtr rhs, size_t pos)
+        {
+            double folded = 0.0;
+
+            if (foldConstants(op, *lhs, *rhs, folded))
+                return makeConstant(folded);
+
+            if (isReassociatedByExprtk(op, *lhs, *rhs))
+                unsupported("reassociated constant operands", pos);
+
+            if (auto simplified = simplifyLiteralOperand(op, lhs, rhs))
+                return simplified;
+
+            auto node = std::make_unique<Node>();
+            node->kind = Node::Binary;
+            node->op = op;
+
+            if (lhs->isVector() || rhs->isVector())
+            {
+                if (!isArithmetic(op))
+                    unsupported("non-arithmetic array operation", pos);
+
+                if (lhs->isVector() && rhs->isVector())
+                    node->size = std::min(lhs->size, rhs->size);
+                else
+                    node->size = lhs->isVector() ? lhs->size : rhs->size;
+            }
+
+            node->args.emplace_back(std::move(lhs));
+            node->args.emplace_back(std::move(rhs));
+
+            return node;
+        }
+
+        NodePtr parseExpression(int precedence = 0)
+        {
+            auto lhs = parseBranch(precedence);
+
+            while (auto binOp = currentBinaryOp())
+            {
+                if (binOp->left < precedence)
+                    break;
+
+                size_t pos = cur().pos;
+                m_pos++;
+                auto rhs = parseExpression(binOp->right);
+                lhs = makeBinary(binOp->op, std::move(lhs), std::move(rhs), pos);
+
+                if (precedence == 0 && isSymbol("?"))
+                    lhs = parseTernary(std::move(lhs));
+            }
+
+            return lhs;
+        }
+
+        NodePtr parseTernary(NodePtr condition)
+        {
+            size_t pos = cur().pos;
+            expect("?");
+            auto consequent = parseExpression();
+            expect(":");
+            auto alternative = parseExpression();
+
+            if (condition->isVector() || consequent->isVector() || alternative->isVector())
+                unsupported("array operand in ternary operator", pos);
+
+            if (isScalarConstant(*condition))
+                return is_true(condition->value) ? std::move(consequent) : std::move(alternative);
+
+            auto node = std::make_unique<Node>();
+            node->kind = Node::Ternary;
+            node->args.emplace_back(std::move(condition));
+            node->args.emplace_back(std::move(consequent));
+            node->args.emplace_back(std::move(alternative));
+            return node;
+        }
+
+        NodePtr parseBranch(int precedence)
+        {
+            NodePtr result;
+            const auto &t = cur();
+
+            if (t.type == Token::Number)
+            {
+                result = makeConstant(t.number);
+                m_pos++;
+            }
+            else if (t.type == Token::Ident)
+            {
+                result = parseSymbol();
+            }
+            else if (accept("("))
+            {
+                result = parseExpression();
+                expect(")");
+            }
+            else if (accept("-"))
+            {
+                auto operand = parseExpression(11);
+
+                if (isScalarConstant(*operand))
+                {
+                    result = makeConstant(-operand->value);
+                }
+                else
+                {
+                    auto node = std::make_unique<Node>();
+                    node->kind = Node::Unary;
+                    node->op = Op::Neg;
+                    node->size = operand->size;
+                    node->args.emplace_back(std::move(operand));
+                    result = std::move(node);
+                }
+            }
+            else if (accept("+"))
+            {
+                result = parseExpression(13);
+            }
+            else
+            {
+                unsupported("unexpected token '" + t.text + "'", t.pos);
+            }
+
+            if (precedence == 0 && isSymbol("?"))
+                result = parseTernary(std::move(result));
+
+            return result;
+        }
+
+        NodePtr parseSymbol()
+        {
+            const auto name = cur().text;
+            const size_t pos = cur().pos;
+            m_pos++;
+
+            static const char *Keywords[] =
+            {
+                "var", "if", "else", "for", "while", "break", "continue",
+                "return", "repeat", "until", "switch", "case", "default",
+            };
+
+            for (auto kw: Keywords)
+            {
+                if (name == kw)
+                    unsupported("keyword '" + name + "' in expression", pos);
+            }
+
+            // function calls
+            if (isSymbol("("))
+                return parseCall(name, pos);
+
+            auto node = lookupSymbol(name, pos);
+
+            if (node->kind == Node::Vector && isSymbol("["))
+            {
+                m_pos++;
+
+                // 'vec[]' is the size of the vector
+                if (accept("]"))
+                    return makeConstant(node->size);
+
+                auto index = parseExpression();
+                expect("]");
+
+                if (index->isVector())
+                    unsupported("array used as index", pos);
+
+                node->kind = Node::Element;
+                node->size = -1;
+                node->args.emplace_back(std::move(index));
+            }
+            else if (isSymbol("["))
+            {
+                unsupported("indexing a non-array symbol", pos);
+            }
+
+            return node;
+        }
+
+        NodePtr parseCall(const std::string &name, size_t pos)
+        {
+            expect("(");
+
+            std::vector<NodePtr> args;
+
+            if (!isSymbol(")"))
+            {
+                do
+                {
+                    args.emplace_back(parseExpression());
+
+                    if (args.back()->isVector())
+                        unsupported("array argument to function '" + name + "'", pos);
+
+                } while (accept(","));
+            }
+
+            expect(")");
+
+            auto node = std::make_unique<Node>();
+
+            if (name == "make_invalid" && args.empty())
+                return makeConstant(invalid_param());
+
+            if ((name == "min" || name == "max") && args.size() >= 2)
+            {
+                // exprtk folds variadic min/max from left to right
+                const Op op = (name == "min") ? Op::Min : Op::Max;
+                NodePtr result = std::move(args[0]);
+
+                for (size_t i = 1; i < args.size(); i++)
+                    result = makeBinary(op, std::move(result), std::move(args[i]), pos);
+
+                return result;
+            }
+
+            if (args.size() == 1)
+            {
+                auto it = unary_functions().find(name);
+
+                if (it != unary_functions().end())
+                {
+                    if (isScalarConstant(*args[0]) && !is_runtime_library_function(name))
+                        return makeConstant(it->second(args[0]->value));
+
+                    node->kind = Node::Call1;
+                    node->fn1 = it->second;
+                    node->args = std::move(args);
+                    return node;
+                }
+            }
+            else if (args.size() == 2)
+            {
+                auto it = binary_functions().find(name);
+
+                if (it != binary_functions().end())
+                {
+                    if (isScalarConstant(*args[0]) && isScalarConstant(*args[1])
+                        && !is_runtime_library_function(name))
+                    {
+                        return makeConstant(it->second(args[0]->value, args[1]->value));
+                    }
+
+                    node->kind = Node::Call2;
+                    node->fn2 = it->second;
+                    node->args = std::move(args);
+                    return node;
+                }
+            }
+
+            unsupported("unsupported function '" + name + "'", pos);
+        }
+
+        //
+        // Scalar code generation. Returns the register holding the result.
+        //
+
+        s32 genScalar(const Node &node)
+        {
+            assert(!node.isVector());
+
+            switch (node.kind)
+            {
+                case Node::Constant:
+                    return constantRegister(node.value);
+
+                case Node::Register:
+                    return node.index;
+
+                case Node::ExtScalar:
+                    {
+                        s32 d = newRegister();
+                        emit(Op::LoadExt, d, node.index);
+                        return d;
+                    }
+
+                case Node::Element:
+                    {
+                        s32 idx = genScalar(*node.args[0]);
+                        s32 d = newRegister();
+                        emit(Op::LoadElem, d, node.index, idx);
+                        return d;
+                    }
+
+                case Node::Unary:
+                    {
+                        s32 a = genScalar(*node.args[0]);
+                        s32 d = newRegister();
+                        emit(node.op, d, a);
+                        return d;
+                    }
+
+                case Node::Binary:
+                    {
+                        s32 a = genScalar(*node.args[0]);
+                        s32 b = genScalar(*node.args[1]);
+                        s32 d = newRegister();
+                        emit(node.op, d, a, b);
+                        return d;
+                    }
+
+                case Node::Ternary:
+                    {
+                        s32 d = newRegister();
+                        s32 cond = genScalar(*node.args[0]);
+                        size_t jz = emit(Op::Jz, 0, cond);
+                        emit(Op::Mov, d, genScalar(*node.args[1]));
+                        size_t jmp = emit(Op::Jmp);
+                        patchJump(jz);
+                        emit(Op::Mov, d, genScalar(*node.args[2]));
+                        patchJump(jmp);
+                        return d;
+                    }
+
+                case Node::Call1:
+                    {
+                        s32 a = genScalar(*node.args[0]);
+                        s32 d = newRegister();
+                        m_fn1.push_back(node.fn1);
+                        emit(Op::Call1, d, a, 0, static_cast<s32>(m_fn1.size() - 1));
+                        return d;
+                    }
+
+                case Node::Call2:
+                    {
+                        s32 a = genScalar(*node.args[0]);
+                        s32 b = genScalar(*node.args[1]);
+                        s32 d = newRegister();
+                        m_fn2.push_back(node.fn2);
+                        emit(Op::Call2, d, a, b, static_cast<s32>(m_fn2.size() - 1));
+                        return d;
+                    }
+
+                case Node::Vector:
+                    break;
+            }
+
+            assert(false);
+            return -1;
+        }
+
+        //
+        // Array code generation.
+        //
+
+        /* An operand of an array operation: either a vector or a scalar
+         * register. */
+        struct Operand
+        {
+            bool isVector;
+            s32 index;
+        };
+
+        Operand genOperand(const Node &node)
+        {
+            if (!node.isVector())
+                return { false, genScalar(node) };
+
+            if (node.kind == Node::Vector)
+                return { true, node.index };
+
+            s32 dest = tempVector(node.size);
+            genVectorInto(node, dest, node.size);
+            return { true, dest };
+        }
+
+        void emitVectorBinary(Op op, s32 dest, Operand a, Operand b, s32 count)
+        {
+            if (a.isVector && b.isVector)
+                emit(Op::VBinVV, dest, a.index, b.index, count, op);
+            else if (a.isVector)
+                emit(Op::VBinVS, dest, a.index, b.index, count, op);
+            else
+            {
+                assert(b.isVector);
+                emit(Op::VBinSV, dest, a.index, b.index, count, op);
+            }
+        }
+
+        /* Evaluates the vector valued node into the first count elements of
+         * the dest vector. */
+        void genVectorInto(const Node &node, s32 dest, s32 count)
+        {
+            assert(node.isVector());
+            assert(count <= node.size);
+
+            switch (node.kind)
+            {
+                case Node::Vector:
+                    if (node.index != dest)
+                        emit(Op::VCopy, dest, node.index, 0, count);
+                    break;
+
+                case Node::Unary:
+                    {
+                        auto a = genOperand(*node.args[0]);
+                        emit(Op::VNeg, dest, a.index, 0, count);
+                    } break;
+
+                case Node::Binary:
+                    {
+                        auto a = genOperand(*node.args[0]);
+                        auto b = genOperand(*node.args[1]);
+                        emitVectorBinary(node.op, dest, a, b, count);
+                    } break;
+
+                default:
+                    assert(false);
+            }
+        }
+
+        //
+        // Statements
+        //
+
+        void parseStatement()
+        {
+            if (accept(";"))
+                return;
+
+            if (isSymbol("{"))
+            {
+                parseBlock();
+            }
+            else if (isKeyword("var"))
+            {
+                parseVarDefinition();
+            }
+            else if (isKeyword("if"))
+            {
+                parseIf();
+                return;
+            }
+            else if (isKeyword("for"))
+            {
+                parseFor();
+                return;
+            }
+            else if (isKeyword("while"))
+            {
+                parseWhile();
+                return;
+            }
+            else if (isKeyword("break") || isKeyword("continue"))
+            {
+                if (m_loops.empty())
+                    unsupported(cur().text + " outside of loop", cur().pos);
+
+                size_t jmp = emit(Op::Jmp);
+
+                if (cur().text == "break")
+                    m_loops.back().breaks.push_back(jmp);
+                else
+                    m_loops.back().continues.push_back(jmp);
+
+                m_pos++;
+            }
+            else
+            {
+                parseAssignmentOrExpression();
+            }
+
+            if (!accept(";") && !atEnd() && !isSymbol("}") && !isKeyword("else"))
+                unsupported("expected ';'", cur().pos);
+        }
+
+        void parseBlock()
+        {
+            expect("{");
+            m_scopes.emplace_back();
+
+            while (!isSymbol("}"))
+            {
+                if (atEnd())
+                    unsupported("expected '}'", cur().pos);
+
+                parseStatement();
+            }
+
+            m_scopes.pop_back();
+            expect("}");
+        }
+
+        void parseVarDefinition()
+        {
+            m_pos++; // 'var'
+
+            if (cur().type != Token::Ident)
+                unsupported("expected variable name", cur().pos);
+
+            const auto name = cur().text;
+            const size_t pos = cur().pos;
+            m_pos++;
+
+            if (isSymbol("["))
+                unsupported("local arrays", pos);
+
+            s32 src = -1;
+
+            if (accept(":="))
+            {
+                auto init = parseExpression();
+
+                if (init->isVector())
+                    unsupported("array initializer for scalar", pos);
+
+                src = genScalar(*init);
+            }
+            else
+            {
+                src = constantRegister(0.0);
+            }
+
+            // Register allocated after evaluating the initializer so that
+            // 'var x := x + 1' refers to an outer x.
+            s32 reg = newRegister();
+            emit(Op::Mov, reg, src);
+            m_scopes.back()[name] = reg;
+        }
+
+        void parseIf()
+        {
+            m_pos++; // 'if'
+            expect("(");
+            auto cond = parseExpression();
+            expect(")");
+
+            if (cond->isVector())
+                unsupported("array condition", cur().pos);
+
+            size_t jz = emit(Op::Jz, 0, genScalar(*cond));
+
+            parseBody();
+
+            // 'if (x) y := 1; else y := 2;'
+            if (isSymbol(";") && peek().type == Token::Ident && peek().text == "else")
+                m_pos++;
+
+            if (isKeyword("else"))
+            {
+                m_pos++;
+                size_t jmp = emit(Op::Jmp);
+                patchJump(jz);
+
+                if (isKeyword("if"))
+                    parseIf();
+                else
+                    parseBody();
+
+                patchJump(jmp);
+            }
+            else
+            {
+                patchJump(jz);
+            }
+        }
+
+        /* Body of if/for/while: either a block or a single statement. */
+        void parseBody()
+        {
+            if (isSymbol("{"))
+            {
+                parseBlock();
+            }
+            else
+            {
+                m_scopes.emplace_back();
+                parseStatement();
+                m_scopes.pop_back();
+            }
+        }
+
+        void parseFor()
+        {
+            m_pos++; // 'for'
+            expect("(");
+            m_scopes.emplace_back();
+
+            // init
+            if (isKeyword("var"))
+                parseVarDefinition();
+            else if (!isSymbol(";"))
+                parseAssignmentOrExpression();
+            expect(";");
+
+            // condition
+            const size_t condStart = m_code.size();
+            auto cond = parseExpression();
+            expect(";");
+
+            if (cond->isVector())
+                unsupported("array condition", cur().pos);
+
+            size_t jz = emit(Op::Jz, 0, genScalar(*cond));
+
+            // The increment is parsed now but emitted after the body.
+            const size_t incrTokenStart = m_pos;
+            skipBalanced(")");
+            const size_t bodyTokenStart = m_pos;
+
+            m_loops.emplace_back();
+            parseBody();
+            const size_t afterBody = m_pos;
+
+            const size_t continueTarget = m_code.size();
+            m_pos = incrTokenStart;
+            if (!isSymbol(")"))
+                parseAssignmentOrExpression();
+            expect(")");
+
+            if (m_pos != bodyTokenStart)
+                unsupported("malformed for loop", cur().pos);
+
+            m_pos = afterBody;
+
+            emit(Op::Jmp, 0, 0, 0, static_cast<s32>(condStart));
+            finishLoop(continueTarget);
+            patchJump(jz);
+
+            m_scopes.pop_back();
+        }
+
+        void parseWhile()
+        {
+            m_pos++; // 'while'
+            expect("(");
+            const size_t condStart = m_code.size();
+            auto cond = parseExpression();
+            expect(")");
+
+            if (cond->isVector())
+                unsupported("array condition", cur().pos);
+
+            size_t jz = emit(Op::Jz, 0, genScalar(*cond));
+
+            m_loops.emplace_back();
+            parseBody();
+
+            emit(Op::Jmp, 0, 0, 0, static_cast<s32>(condStart));
+            finishLoop(condStart);
+            patchJump(jz);
+        }
+
+        void finishLoop(size_t continueTarget)
+        {
+            auto loop = m_loops.back();
+            m_loops.pop_back();
+
+            for (auto idx: loop.continues)
+                m_code[idx].c = static_cast<s32>(continueTarget);
+
+            for (auto idx: loop.breaks)
+                patchJump(idx);
+        }
+
+        /* Advances to the token after the matching closing symbol. Used to
+         * skip over the increment part of for loops. */
+        void skipBalanced(const char *closing)
+        {
+            int depth = 0;
+
+            while (!atEnd())
+            {
+                if (isSymbol("(") || isSymbol("[") || isSymbol("{"))
+                    depth++;
+                else if (isSymbol(")") || isSymbol("]") || isSymbol("}"))
+                {
+                    if (depth == 0 && isSymbol(closing))
+                    {
+                        m_pos++;
+                        return;
+                    }
+                    depth--;
+                }
+                m_pos++;
+            }
+
+            unsupported(std::string("expected '") + closing + "'", cur().pos);
+        }
+
+        static bool assignmentOp(const Token &t, Op &op)
+        {
+            if (t.type != Token::Symbol)
+                return false;
+
+            if (t.text == ":=") { op = Op::Mov; return true; }
+            if (t.text == "+=") { op = Op::Add; return true; }
+            if (t.text == "-=") { op = Op::Sub; return true; }
+            if (t.text == "*=") { op = Op::Mul; return true; }
+            if (t.text == "/=") { op = Op::Div; return true; }
+            if (t.text == "%=") { op = Op::Mod; return true; }
+            return false;
+        }
+
+        void parseAssignmentOrExpression()
+        {
+            const size_t start = m_pos;
+
+            if (cur().type == Token::Ident)
+            {
+                const auto name = cur().text;
+                const size_t pos = cur().pos;
+                m_pos++;
+
+                NodePtr index;
+
+                if (isSymbol("[") && !isSymbol("]", 1))
+                {
+                    m_pos++;
+                    index = parseExpression();
+                    expect("]");
+                }
+
+                Op op;
+
+                if (assignmentOp(cur(), op))
+                {
+                    m_pos++;
+                    auto rhs = parseExpression();
+                    genAssignment(name, pos, std::move(index), op, std::move(rhs));
+                    return;
+                }
+            }
+
+            // Not an assignment. Expression statements have no side effects
+            // so no code needs to be generated.
+            m_pos = start;
+            parseExpression();
+        }
+
+        void genAssignment(const std::string &name, size_t pos, NodePtr index, Op op, NodePtr rhs)
+        {
+            auto target = lookupSymbol(name, pos);
+
+            if (index)
+            {
+                if (target->kind != Node::Vector)
+                    unsupported("indexing a non-array symbol", pos);
+
+                if (index->isVector() || rhs->isVector())
+                    unsupported("array used in element assignment", pos);
+
+                s32 idx = genScalar(*index);
+                s32 value = genScalar(*rhs);
+
+                if (op != Op::Mov)
+                {
+                    s32 current = newRegister();
+                    emit(Op::LoadElem, current, target->index, idx);
+                    s32 result = newRegister();
+                    emit(op, result, current, value);
+                    value = result;
+                }
+
+                emit(Op::StoreElem, target->index, idx, value);
+                return;
+            }
+
+            switch (target->kind)
+            {
+                case Node::Register:
+                    {
+                        if (rhs->isVector())
+                            unsupported("array assigned to scalar", pos);
+
+                        s32 value = genScalar(*rhs);
+
+                        if (op == Op::Mov)
+                            emit(Op::Mov, target->index, value);
+                        else
+                            emit(op, target->index, target->index, value);
+                    } break;
+
+                case Node::ExtScalar:
+                    {
+                        if (rhs->isVector())
+                            unsupported("array assigned to scalar", pos);
+
+                        s32 value = genScalar(*rhs);
+
+                        if (op != Op::Mov)
+                        {
+                            s32 current = newRegister();
+                            emit(Op::LoadExt, current, target->index);
+                            s32 result = newRegister();
+                            emit(op, result, current, value);
+                            value = result;
+                        }
+
+                        emit(Op::StoreExt, target->index, value);
+                    } break;
+
+                case Node::Vector:
+                    {
+                        const s32 dest = target->index;
+                        const s32 destSize = target->size;
+
+                        if (op != Op::Mov && !isArithmetic(op))
+                            unsupported("non-arithmetic array operation", pos);
+
+                        if (!rhs->isVector())
+                        {
+                            s32 value = genScalar(*rhs);
+
+                            if (op == Op::Mov)
+                                emit(Op::VFill, dest, value, 0, destSize);
+                            else
+                                emit(Op::VBinVS, dest, dest, value, destSize, op);
+                        }
+                        else
+                        {
+                            // exprtk processes min(destSize, rhsSize) elements
+                            const s32 count = std::min(destSize, rhs->size);
+
+                            if (op == Op::Mov)
+                            {
+                                genVectorInto(*rhs, dest, count);
+                            }
+                            else
+                            {
+                                auto b = genOperand(*rhs);
+                                emitVectorBinary(op, dest, { true, dest }, b, count);
+                            }
+                        }
+                    } break;
+
+                default:
+                    unsupported("assignment to constant '" + name + "'", pos);
+            }
+        }
+};
+
+template<typename F>
+inline void vbin_vv(double *d, const double *a, const double *b, s32 n, F f)
+{
+    for (s32 i = 0; i < n; i++)
+        d[i] = f(a[i], b[i]);
+}
+
+template<typename F>
+inline void vbin_vs(double *d, const double *a, double b, s32 n, F f)
+{
+    for (s32 i = 0; i < n; i++)
+        d[i] = f(a[i], b);
+}
+
+template<typename F>
+inline void vbin_sv(double *d, double a, const double *b, s32 n, F f)
+{
+    for (s32 i = 0; i < n; i++)
+        d[i] = f(a, b[i]);
+}
+
+/* Dispatches to the array kernel K for the arithmetic operation op. */
+template<typename Kernel, typename A, typename B>
+inline void vbin_dispatch(Op op, double *d, A a, B b, s32 n, Kernel kernel)
+{
+    switch (op)
+    {
+        case Op::Add: kernel(d, a, b, n, [] (double x, double y) { return x + y; }); break;
+        case Op::Sub: kernel(d, a, b, n, [] (double x, double y) { return x - y; }); break;
+        case Op::Mul: kernel(d, a, b, n, [] (double x, double y) { return x * y; }); break;
+        case Op::Div: kernel(d, a, b, n, [] (double x, double y) { return x / y; }); break;
+        case Op::Pow: kernel(d, a, b, n, [] (double x, double y) { return std::pow(x, y); }); break;
+        default: assert(false);
+    }
+}
+
+} // end anon namespace
+
+//
+// SymbolTable
+//
+
+void SymbolTable::addScalar(const std::string &name, double &value)
+{
+    m_scalars.push_back({ name, &value });
+}
+
+void SymbolTable::addConstant(const std::string &name, double value)
+{
+    m_constants.push_back({ name, value });
+}
+
+void SymbolTable::addVector(const std::string &name, double *data, s32 size)
+{
+    m_vectors.push_back({ name, data, size });
+}
+
+//
+// Program
+//
+
+struct Program::Private
+{
+    std::vector<Instr> code;
+    std::vector<double> registers;
+    std::vector<double *> ext;
+    std::vector<VectorRef> vectors;
+    std::vector<std::unique_ptr<double[]>> vectorStorage;
+    std::vector<Function1> fn1;
+    std::vector<Function2> fn2;
+};
+
+Program::Program()
+    : m_d(std::make_unique<Private>())
+{}
+
+Program::~Program()
+{}
+
+Program::Program(Program &&) = default;
+Program &Program::operator=(Program &&) = default;
+
+size_t Program::instructionCount() const
+{
+    return m_d->code.size();
+}
+
+void Program::run()
+{
+    const Instr *code = m_d->code.data();
+    const s32 codeSize = static_cast<s32>(m_d->code.size());
+    double *r = m_d->registers.data();
+    double * const *ext = m_d->ext.data();
+    const VectorRef *vec = m_d->vectors.data();
+    const Function1 *fn1 = m_d->fn1.data();
+    const Function2 *fn2 = m_d->fn2.data();
+
+    s32 pc = 0;
+
+    while (pc < codeSize)
+    {
+        const Instr &in = code[pc++];
+
+        switch (in.op)
+        {
+            case Op::Mov:       r[in.d] = r[in.a]; break;
+            case Op::LoadExt:   r[in.d] = *ext[in.a]; break;
+            case Op::StoreExt:  *ext[in.d] = r[in.a]; break;
+            case Op::Add:       r[in.d] = r[in.a] + r[in.b]; break;
+            case Op::Sub:       r[in.d] = r[in.a] - r[in.b]; break;
+            case Op::Mul:       r[in.d] = r[in.a] * r[in.b]; break;
+            case Op::Div:       r[in.d] = r[in.a] / r[in.b]; break;
+            case Op::Mod:       r[in.d] = std::fmod(r[in.a], r[in.b]); break;
+            case Op::Pow:       r[in.d] = std::pow(r[in.a], r[in.b]); break;
+            case Op::Lt:        r[in.d] = (r[in.a] <  r[in.b]) ? 1.0 : 0.0; break;
+            case Op::Le:        r[in.d] = (r[in.a] <= r[in.b]) ? 1.0 : 0.0; break;
+            case Op::Gt:        r[in.d] = (r[in.a] >  r[in.b]) ? 1.0 : 0.0; break;
+            case Op::Ge:        r[in.d] = (r[in.a] >= r[in.b]) ? 1.0 : 0.0; break;
+            case Op::Eq:        r[in.d] = (r[in.a] == r[in.b]) ? 1.0 : 0.0; break;
+            case Op::Ne:        r[in.d] = (r[in.a] != r[in.b]) ? 1.0 : 0.0; break;
+            case Op::And:       r[in.d] = (is_true(r[in.a]) && is_true(r[in.b])) ? 1.0 : 0.0; break;
+            case Op::Or:        r[in.d] = (is_true(r[in.a]) || is_true(r[in.b])) ? 1.0 : 0.0; break;
+            case Op::Min:       r[in.d] = std::min(r[in.a], r[in.b]); break;
+            case Op::Max:       r[in.d] = std::max(r[in.a], r[in.b]); break;
+            case Op::Neg:       r[in.d] = -r[in.a]; break;
+            case Op::Call1:     r[in.d] = fn1[in.c](r[in.a]); break;
+            case Op::Call2:     r[in.d] = fn2[in.c](r[in.a], r[in.b]); break;
+
+            case Op::LoadElem:
+                {
+                    const auto &v = vec[in.a];
+                    const s64 idx = static_cast<s64>(r[in.b]);
+                    r[in.d] = (0 <= idx && idx < v.size)
+                        ? v.data[idx]
+                        : std::numeric_limits<double>::quiet_NaN();
+                } break;
+
+            case Op::StoreElem:
+                {
+                    const auto &v = vec[in.d];
+                    const s64 idx = static_cast<s64>(r[in.a]);
+                    if (0 <= idx && idx < v.size)
+                        v.data[idx] = r[in.b];
+                } break;
+
+            case Op::Jmp:
+                pc = in.c;
+                break;
+
+            case Op::Jz:
+                if (!is_true(r[in.a]))
+                    pc = in.c;
+                break;
+
+            case Op::VFill:
+                std::fill(vec[in.d].data, vec[in.d].data + in.c, r[in.a]);
+                break;
+
+            case Op::VCopy:
+                std::copy(vec[in.a].data, vec[in.a].data + in.c, vec[in.d].data);
+                break;
+
+            case Op::VNeg:
+                {
+                    double *d = vec[in.d].data;
+                    const double *a = vec[in.a].data;
+                    for (s32 i = 0; i < in.c; i++)
+                        d[i] = -a[i];
+                } break;
+
+            case Op::VBinVV:
+                vbin_dispatch(in.sub, vec[in.d].data, vec[in.a].data, vec[in.b].data, in.c,
+                              [] (double *d, const double *a, const double *b, s32 n, auto f)
+                              { vbin_vv(d, a, b, n, f); });
+                break;
+
+            case Op::VBinVS:
+                vbin_dispatch(in.sub, vec[in.d].data, vec[in.a].data, r[in.b], in.c,
+                              [] (double *d, const double *a, double b, s32 n, auto f)
+                              { vbin_vs(d, a, b, n, f); });
+                break;
+
+            case Op::VBinSV:
+                vbin_dispatch(in.sub, vec[in.d].data, r[in.a], vec[in.b].data, in.c,
+                              [] (double *d, double a, const double *b, s32 n, auto f)
+                              { vbin_sv(d, a, b, n, f); });
+                break;
+        }
+    }
+}
+
+Program compile(const std::string &expr, const SymbolTable &symtab)
+{
+    Compiler compiler(expr, symtab);
+    compiler.compile();
+
+    Program result;
+    result.m_d->code = std::move(compiler.m_code);
+    result.m_d->registers = std::move(compiler.m_registers);
+    result.m_d->ext = std::move(compiler.m_ext);
+    result.m_d->vectors = std::move(compiler.m_vectors);
+    result.m_d->vectorStorage = std::move(compiler.m_vectorStorage);
+    result.m_d->fn1 = std::move(compiler.m_fn1);
+    result.m_d->fn2 = std::move(compiler.m_fn2);
+
+    return result;
+}
+
+} // namespace expr_compiler
+} // namespace a2
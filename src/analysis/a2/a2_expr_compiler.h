@@ -0,0 +1,149 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef __MVME_A2_EXPR_COMPILER_H__
+#define __MVME_A2_EXPR_COMPILER_H__
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "util/typedefs.h"
+
+/* Compiler for the subset of the exprtk language commonly used in expression
+ * operator step scripts. The script is translated to a compact bytecode which
+ * is executed by a simple interpreter. Whole array expressions like
+ *
+ *   output0 := input0 * 2 + 1;
+ *
+ * are executed using instructions operating on complete arrays, scalar code
+ * (loops, element access, conditionals) uses a register based instruction
+ * set. Both are considerably faster than evaluating the exprtk node tree.
+ *
+ * Supported:
+ * - Comments: #, // and C-style block comments.
+ * - Statements: var definitions of scalars, assignments (:=, +=, -=, *=, /=,
+ *   %=) to scalars, array elements and whole arrays, if/else if/else, for and
+ *   while loops, break, continue, blocks.
+ * - Operators: + - * / % ^, unary -, < <= > >= = == != <>, and, or, &, |,
+ *   the ternary operator.
+ * - Functions: abs, sqrt, exp, log, log10, sin, cos, tan, asin, acos, atan,
+ *   floor, ceil, round, not, pow, atan2, min, max, the expression operator
+ *   runtime library (is_valid, is_invalid, is_nan, valid_or, make_invalid).
+ * - Constants: pi, epsilon, inf, true, false.
+ * - Array size via 'name[]'.
+ *
+ * Anything else (strings, local arrays, return statements, other functions,
+ * ...) makes compile() throw an UnsupportedExpression exception. Callers are
+ * expected to fall back to exprtk in this case.
+ *
+ * The script must already have been accepted by the exprtk parser. Syntax
+ * checking is not a goal of this compiler, syntax errors are reported as
+ * UnsupportedExpression.
+ *
+ * Like exprtk, operators and builtin functions with literal operands are
+ * evaluated at compile time and scalar operations with a literal operand are
+ * simplified instead of following IEEE semantics, unless the other operand is
+ * a variable or an array element with a constant index: 'input0[i] * 0' and
+ * '0 / input0[i]' are 0, 'input0[i] / 0' is NaN and 'input0[i] + 0' is
+ * input0[i], even if input0[i] is NaN, inf or -0. Chains of literal operations
+ * like '(input0[i] * 2) / 3' which exprtk reassociates are not supported.
+ *
+ * Differences to exprtk: out of range array reads yield NaN and out of range
+ * writes are ignored instead of being undefined behavior.
+ */
+
+namespace a2
+{
+namespace expr_compiler
+{
+
+struct UnsupportedExpression: public std::runtime_error
+{
+    using std::runtime_error::runtime_error;
+};
+
+/* The variables available to the script. Names are matched case-insensitive
+ * like in exprtk. The referenced memory must stay valid for the lifetime of
+ * the compiled program. */
+class SymbolTable
+{
+    public:
+        void addScalar(const std::string &name, double &value);
+        void addConstant(const std::string &name, double value);
+        void addVector(const std::string &name, double *data, s32 size);
+
+        struct Scalar
+        {
+            std::string name;
+            double *value;
+        };
+
+        struct Constant
+        {
+            std::string name;
+            double value;
+        };
+
+        struct Vector
+        {
+            std::string name;
+            double *data;
+            s32 size;
+        };
+
+        const std::vector<Scalar> &scalars() const { return m_scalars; }
+        const std::vector<Constant> &constants() const { return m_constants; }
+        const std::vector<Vector> &vectors() const { return m_vectors; }
+
+    private:
+        std::vector<Scalar> m_scalars;
+        std::vector<Constant> m_constants;
+        std::vector<Vector> m_vectors;
+};
+
+class Program
+{
+    public:
+        Program();
+        ~Program();
+
+        Program(Program &&);
+        Program &operator=(Program &&);
+
+        void run();
+
+        size_t instructionCount() const;
+
+    private:
+        friend Program compile(const std::string &expr, const SymbolTable &symtab);
+
+        struct Private;
+        std::unique_ptr<Private> m_d;
+};
+
+/* Throws UnsupportedExpression if the script cannot be compiled. */
+Program compile(const std::string &expr, const SymbolTable &symtab);
+
+} // namespace expr_compiler
+} // namespace a2
+
+#endif /* __MVME_A2_EXPR_COMPILER_H__ */
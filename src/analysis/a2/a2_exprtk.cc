@@ -20,9 +20,11 @@
  */
 #include "a2_exprtk.h"
 
-#ifndef NDEBUG
-#define exprtk_disable_enhanced_features    // reduces compilation time at cost of runtime performance
-#endif
+// Disabled in all build types: the enhanced features change how literal
+// operands are simplified and a2_expr_compiler.cc mirrors the results of the
+// basic mode. Also reduces compilation time. Scripts supported by the
+// expression compiler do not use the exprtk runtime.
+#define exprtk_disable_enhanced_features
 #define exprtk_disable_rtl_io_file          // we do not ever want to use the fileio package
 #include <exprtk/exprtk.hpp>
 
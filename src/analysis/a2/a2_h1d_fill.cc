@@ -0,0 +1,255 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "a2_h1d_fill.h"
+
+#include <algorithm>
+#include <cassert>
+
+#ifdef A2_H1D_FILL_HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace a2
+{
+
+namespace
+{
+
+/* Number of inputs handled per block. The masks of a block are kept in a
+ * single u64. */
+static const s32 BlockSize = 64;
+
+struct BlockResult
+{
+    s32 bins[BlockSize];
+    u64 inRange;
+    u64 underflow;
+    u64 overflow;
+};
+
+inline int lowest_set_bit(u64 mask)
+{
+    return __builtin_ctzll(mask);
+}
+
+/* Scalar part shared by all kernels: applies the increments of a block. */
+inline void apply_block(H1D *histos, const BlockResult &br)
+{
+    for (u64 mask = br.inRange; mask; mask &= mask - 1)
+    {
+        int i = lowest_set_bit(mask);
+        auto &histo = histos[i];
+
+        assert(0 <= br.bins[i] && br.bins[i] < histo.size);
+
+        increment_bin(&histo, br.bins[i]);
+        histo.entryCount++;
+    }
+
+    for (u64 mask = br.underflow; mask; mask &= mask - 1)
+    {
+        auto &histo = histos[lowest_set_bit(mask)];
+
+        if (histo.underflow)
+            ++(*histo.underflow);
+    }
+
+    for (u64 mask = br.overflow; mask; mask &= mask - 1)
+    {
+        auto &histo = histos[lowest_set_bit(mask)];
+
+        if (histo.overflow)
+            ++(*histo.overflow);
+    }
+}
+
+/* Handles inputs [first, count) of a block one by one. Used by the vectorized
+ * kernels for the remaining inputs not filling a complete SIMD register. */
+inline void compute_block_scalar(
+    BlockResult &br, s32 first, s32 count,
+    const double *x, const double *binMins, const double *binMaxs, const double *binFactors)
+{
+    for (s32 i = first; i < count; i++)
+    {
+        const u64 bit = u64(1) << i;
+
+        // Note: all comparisons are false for NaN inputs.
+        if (x[i] < binMins[i])
+            br.underflow |= bit;
+        else if (x[i] >= binMaxs[i])
+            br.overflow |= bit;
+        else if (x[i] == x[i])
+        {
+            br.inRange |= bit;
+            br.bins[i] = static_cast<s32>((x[i] - binMins[i]) * binFactors[i]);
+        }
+    }
+}
+
+} // end anon namespace
+
+void h1d_fill_scalar(H1D *histos, const double *x, const double *binMins,
+                     const double *binMaxs, const double *binFactors, s32 count)
+{
+    for (s32 blockStart = 0; blockStart < count; blockStart += BlockSize)
+    {
+        const s32 blockCount = std::min(BlockSize, count - blockStart);
+
+        BlockResult br;
+        br.inRange = br.underflow = br.overflow = 0;
+
+        compute_block_scalar(br, 0, blockCount,
+                             x + blockStart, binMins + blockStart,
+                             binMaxs + blockStart, binFactors + blockStart);
+
+        apply_block(histos + blockStart, br);
+    }
+}
+
+#ifdef A2_H1D_FILL_HAVE_X86_KERNELS
+__attribute__((target("sse2")))
+void h1d_fill_sse2(H1D *histos, const double *x, const double *binMins,
+                   const double *binMaxs, const double *binFactors, s32 count)
+{
+    for (s32 blockStart = 0; blockStart < count; blockStart += BlockSize)
+    {
+        const s32 blockCount = std::min(BlockSize, count - blockStart);
+        const double *bx    = x + blockStart;
+        const double *bmin  = binMins + blockStart;
+        const double *bmax  = binMaxs + blockStart;
+        const double *bfact = binFactors + blockStart;
+
+        BlockResult br;
+        br.inRange = br.underflow = br.overflow = 0;
+
+        s32 i = 0;
+
+        for (; i + 2 <= blockCount; i += 2)
+        {
+            __m128d vx   = _mm_loadu_pd(bx + i);
+            __m128d vmin = _mm_loadu_pd(bmin + i);
+            __m128d vmax = _mm_loadu_pd(bmax + i);
+
+            __m128d under = _mm_cmplt_pd(vx, vmin);
+            __m128d geMin = _mm_cmpge_pd(vx, vmin);
+            __m128d ltMax = _mm_cmplt_pd(vx, vmax);
+            __m128d over  = _mm_andnot_pd(under, _mm_cmpge_pd(vx, vmax));
+            __m128d in    = _mm_and_pd(geMin, ltMax);
+
+            __m128d vbin = _mm_mul_pd(_mm_sub_pd(vx, vmin), _mm_loadu_pd(bfact + i));
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(br.bins + i), _mm_cvttpd_epi32(vbin));
+
+            br.inRange   |= u64(_mm_movemask_pd(in)) << i;
+            br.underflow |= u64(_mm_movemask_pd(under)) << i;
+            br.overflow  |= u64(_mm_movemask_pd(over)) << i;
+        }
+
+        compute_block_scalar(br, i, blockCount, bx, bmin, bmax, bfact);
+        apply_block(histos + blockStart, br);
+    }
+}
+
+__attribute__((target("avx2")))
+void h1d_fill_avx2(H1D *histos, const double *x, const double *binMins,
+                   const double *binMaxs, const double *binFactors, s32 count)
+{
+    for (s32 blockStart = 0; blockStart < count; blockStart += BlockSize)
+    {
+        const s32 blockCount = std::min(BlockSize, count - blockStart);
+        const double *bx    = x + blockStart;
+        const double *bmin  = binMins + blockStart;
+        const double *bmax  = binMaxs + blockStart;
+        const double *bfact = binFactors + blockStart;
+
+        BlockResult br;
+        br.inRange = br.underflow = br.overflow = 0;
+
+        s32 i = 0;
+
+        for (; i + 4 <= blockCount; i += 4)
+        {
+            __m256d vx   = _mm256_loadu_pd(bx + i);
+            __m256d vmin = _mm256_loadu_pd(bmin + i);
+            __m256d vmax = _mm256_loadu_pd(bmax + i);
+
+            __m256d under = _mm256_cmp_pd(vx, vmin, _CMP_LT_OQ);
+            __m256d geMin = _mm256_cmp_pd(vx, vmin, _CMP_GE_OQ);
+            __m256d ltMax = _mm256_cmp_pd(vx, vmax, _CMP_LT_OQ);
+            __m256d over  = _mm256_andnot_pd(under, _mm256_cmp_pd(vx, vmax, _CMP_GE_OQ));
+            __m256d in    = _mm256_and_pd(geMin, ltMax);
+
+            __m256d vbin = _mm256_mul_pd(_mm256_sub_pd(vx, vmin), _mm256_loadu_pd(bfact + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(br.bins + i), _mm256_cvttpd_epi32(vbin));
+
+            br.inRange   |= u64(_mm256_movemask_pd(in)) << i;
+            br.underflow |= u64(_mm256_movemask_pd(under)) << i;
+            br.overflow  |= u64(_mm256_movemask_pd(over)) << i;
+        }
+
+        compute_block_scalar(br, i, blockCount, bx, bmin, bmax, bfact);
+        apply_block(histos + blockStart, br);
+    }
+}
+#endif // A2_H1D_FILL_HAVE_X86_KERNELS
+
+namespace
+{
+
+struct KernelInfo
+{
+    H1DFillKernel kernel;
+    const char *name;
+};
+
+KernelInfo select_h1d_fill_kernel()
+{
+#ifdef A2_H1D_FILL_HAVE_X86_KERNELS
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+        return { h1d_fill_avx2, "avx2" };
+
+    if (__builtin_cpu_supports("sse2"))
+        return { h1d_fill_sse2, "sse2" };
+#endif
+
+    return { h1d_fill_scalar, "scalar" };
+}
+
+const KernelInfo &get_kernel_info()
+{
+    static const KernelInfo info = select_h1d_fill_kernel();
+    return info;
+}
+
+} // end anon namespace
+
+H1DFillKernel get_h1d_fill_kernel()
+{
+    return get_kernel_info().kernel;
+}
+
+const char *get_h1d_fill_kernel_name()
+{
+    return get_kernel_info().name;
+}
+
+} // namespace a2
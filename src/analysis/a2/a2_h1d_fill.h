@@ -0,0 +1,79 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef __MVME_A2_H1D_FILL_H__
+#define __MVME_A2_H1D_FILL_H__
+
+#include "a2.h"
+
+/* Kernels filling an array of H1D histograms from an input vector of the same
+ * size: histos[i] is filled with x[i].
+ *
+ * The vectorized kernels first compute the bin numbers and the
+ * underflow/overflow/in-range masks for a block of inputs using SIMD
+ * instructions. The increments are then done in a scalar loop visiting only
+ * the histograms that need to be updated. Invalid (NaN) inputs are skipped
+ * without branching per channel which helps with sparse module data.
+ *
+ * The binning parameters are passed as separate arrays (structure of arrays)
+ * so that they can be loaded directly into SIMD registers:
+ *   binMins[i]    = histos[i].binning.min
+ *   binMaxs[i]    = histos[i].binning.min + histos[i].binning.range
+ *   binFactors[i] = histos[i].binningFactor
+ *
+ * The results are identical to calling HistoFillDirect::fill_h1d() for each
+ * histogram.
+ */
+
+namespace a2
+{
+
+using H1DFillKernel = void (*)(
+    H1D *histos,
+    const double *x,
+    const double *binMins,
+    const double *binMaxs,
+    const double *binFactors,
+    s32 count);
+
+void h1d_fill_scalar(H1D *histos, const double *x, const double *binMins,
+                     const double *binMaxs, const double *binFactors, s32 count);
+
+/* The SIMD kernels are only available on x86. */
+#if defined(__x86_64__) || defined(__i386__)
+#define A2_H1D_FILL_HAVE_X86_KERNELS 1
+
+/* Must only be called if the CPU supports SSE2. */
+void h1d_fill_sse2(H1D *histos, const double *x, const double *binMins,
+                   const double *binMaxs, const double *binFactors, s32 count);
+
+/* Must only be called if the CPU supports AVX2. */
+void h1d_fill_avx2(H1D *histos, const double *x, const double *binMins,
+                   const double *binMaxs, const double *binFactors, s32 count);
+#endif
+
+/* Returns the fastest kernel supported by the CPU. The check is done once on
+ * the first call. On other architectures h1d_fill_scalar is returned. */
+H1DFillKernel get_h1d_fill_kernel();
+const char *get_h1d_fill_kernel_name();
+
+} // namespace a2
+
+#endif /* __MVME_A2_H1D_FILL_H__ */
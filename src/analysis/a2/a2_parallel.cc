@@ -0,0 +1,548 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "a2_parallel.h"
+#include "a2_impl.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace a2
+{
+
+bool a2_can_run_in_parallel(const A2 *a2)
+{
+    for (int ei = 0; ei < MaxVMEEvents; ei++)
+    {
+        const int opCount = a2->operatorCounts[ei];
+
+        for (int opIdx = 0; opIdx < opCount; opIdx++)
+        {
+            switch (static_cast<OperatorType>(a2->operators[ei][opIdx].type))
+            {
+                // Output depends on the previous event.
+                case Operator_KeepPrevious:
+                case Operator_KeepPrevious_idx:
+
+                // Sampling is done on timeticks using state accumulated
+                // across events.
+                case Operator_RateMonitor_PrecalculatedRate:
+                case Operator_RateMonitor_CounterDifference:
+                case Operator_RateMonitor_FlowRate:
+
+                // Output file contents must be in event order.
+                case Operator_ExportSinkFull:
+                case Operator_ExportSinkSparse:
+                case Operator_ExportSinkColumnar:
+                    return false;
+
+                default:
+                    break;
+            }
+        }
+    }
+
+    return true;
+}
+
+void a2_shard_histograms(A2 *a2, memory::Arena *arena)
+{
+    for (int ei = 0; ei < MaxVMEEvents; ei++)
+    {
+        const int opCount = a2->operatorCounts[ei];
+
+        for (int opIdx = 0; opIdx < opCount; opIdx++)
+        {
+            Operator *op = a2->operators[ei] + opIdx;
+
+            switch (op->type)
+            {
+                case Operator_H1DSink:
+                case Operator_H1DSink_idx:
+                    {
+                        // H1DSinkData_idx derives from H1DSinkData
+                        auto d = reinterpret_cast<H1DSinkData *>(op->d);
+
+                        for (auto &histo: d->histos)
+                        {
+                            histo.data = push_param_vector(arena, histo.size, 0.0).data;
+                            histo.data32 = nullptr;
+                            histo.compact = nullptr;
+                            histo.tileGenerations = nullptr;
+                            histo.entryCount = 0.0;
+
+                            if (histo.underflow)
+                                histo.underflow = arena->push<double>(0.0);
+
+                            if (histo.overflow)
+                                histo.overflow = arena->push<double>(0.0);
+                        }
+                    } break;
+
+                case Operator_H2DSink:
+                    {
+                        auto d = reinterpret_cast<H2DSinkData *>(op->d);
+                        d->histo.data = push_param_vector(arena, d->histo.size, 0.0).data;
+                        d->histo.data32 = nullptr;
+                        d->histo.compact = nullptr;
+                        d->histo.tileGenerations = nullptr;
+                        d->histo.entryCount = 0.0;
+                        d->histo.underflow = 0.0;
+                        d->histo.overflow = 0.0;
+                    } break;
+
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+namespace
+{
+
+// Shards always use double storage, dest may use compact storage.
+template<typename Histo>
+inline void merge_and_clear_bins(Histo *dest, Histo *shard)
+{
+    assert(dest->size == shard->size);
+    assert(shard->data);
+
+    for (s32 i = 0; i < dest->size; i++)
+    {
+        if (shard->data[i] != 0.0)
+        {
+            add_to_bin(dest, i, shard->data[i]);
+            shard->data[i] = 0.0;
+        }
+    }
+}
+
+inline void merge_and_clear(double *dest, double *shard)
+{
+    if (dest && shard)
+    {
+        *dest += *shard;
+        *shard = 0.0;
+    }
+}
+
+} // end anon namespace
+
+namespace
+{
+
+// Compares the parts of the operators relevant for merging.
+bool operators_match(const Operator *a, const Operator *b)
+{
+    if (a->type != b->type)
+        return false;
+
+    switch (a->type)
+    {
+        case Operator_H1DSink:
+        case Operator_H1DSink_idx:
+            {
+                auto da = reinterpret_cast<const H1DSinkData *>(a->d);
+                auto db = reinterpret_cast<const H1DSinkData *>(b->d);
+
+                if (da->histos.size != db->histos.size)
+                    return false;
+
+                for (s32 hi = 0; hi < da->histos.size; hi++)
+                {
+                    if (da->histos[hi].size != db->histos[hi].size)
+                        return false;
+                }
+            } break;
+
+        case Operator_H2DSink:
+            {
+                auto &ha = reinterpret_cast<const H2DSinkData *>(a->d)->histo;
+                auto &hb = reinterpret_cast<const H2DSinkData *>(b->d)->histo;
+
+                if (ha.size != hb.size)
+                    return false;
+            } break;
+
+        default:
+            break;
+    }
+
+    return true;
+}
+
+} // end anon namespace
+
+bool a2_layouts_match(const A2 *a, const A2 *b)
+{
+    for (int ei = 0; ei < MaxVMEEvents; ei++)
+    {
+        if (a->dataSourceCounts[ei] != b->dataSourceCounts[ei]
+            || a->operatorCounts[ei] != b->operatorCounts[ei])
+        {
+            return false;
+        }
+
+        for (int dsIdx = 0; dsIdx < a->dataSourceCounts[ei]; dsIdx++)
+        {
+            if (a->dataSources[ei][dsIdx].hitCounts.size
+                != b->dataSources[ei][dsIdx].hitCounts.size)
+            {
+                return false;
+            }
+        }
+
+        for (int opIdx = 0; opIdx < a->operatorCounts[ei]; opIdx++)
+        {
+            if (!operators_match(a->operators[ei] + opIdx, b->operators[ei] + opIdx))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+void a2_merge_histograms(A2 *dest, A2 *shard)
+{
+    for (int ei = 0; ei < MaxVMEEvents; ei++)
+    {
+        const int opCount = dest->operatorCounts[ei];
+
+        assert(opCount == shard->operatorCounts[ei]);
+
+        if (opCount != shard->operatorCounts[ei])
+            continue;
+
+        for (int opIdx = 0; opIdx < opCount; opIdx++)
+        {
+            Operator *destOp  = dest->operators[ei] + opIdx;
+            Operator *shardOp = shard->operators[ei] + opIdx;
+
+            assert(operators_match(destOp, shardOp));
+
+            if (!operators_match(destOp, shardOp))
+                continue;
+
+            switch (destOp->type)
+            {
+                case Operator_H1DSink:
+                case Operator_H1DSink_idx:
+                    {
+                        auto dd = reinterpret_cast<H1DSinkData *>(destOp->d);
+                        auto sd = reinterpret_cast<H1DSinkData *>(shardOp->d);
+
+                        for (s32 hi = 0; hi < dd->histos.size; hi++)
+                        {
+                            auto &dh = dd->histos[hi];
+                            auto &sh = sd->histos[hi];
+
+                            merge_and_clear_bins(&dh, &sh);
+                            merge_and_clear(dh.underflow, sh.underflow);
+                            merge_and_clear(dh.overflow, sh.overflow);
+                            dh.entryCount += sh.entryCount;
+                            sh.entryCount = 0.0;
+                        }
+                    } break;
+
+                case Operator_H2DSink:
+                    {
+                        auto &dh = reinterpret_cast<H2DSinkData *>(destOp->d)->histo;
+                        auto &sh = reinterpret_cast<H2DSinkData *>(shardOp->d)->histo;
+
+                        merge_and_clear_bins(&dh, &sh);
+                        merge_and_clear(&dh.underflow, &sh.underflow);
+                        merge_and_clear(&dh.overflow, &sh.overflow);
+                        merge_and_clear(&dh.entryCount, &sh.entryCount);
+                    } break;
+
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+void a2_merge_hit_counts(A2 *dest, A2 *shard)
+{
+    for (int ei = 0; ei < MaxVMEEvents; ei++)
+    {
+        const int dsCount = dest->dataSourceCounts[ei];
+
+        assert(dsCount == shard->dataSourceCounts[ei]);
+
+        if (dsCount != shard->dataSourceCounts[ei])
+            continue;
+
+        for (int dsIdx = 0; dsIdx < dsCount; dsIdx++)
+        {
+            auto &dh = dest->dataSources[ei][dsIdx].hitCounts;
+            auto &sh = shard->dataSources[ei][dsIdx].hitCounts;
+
+            assert(dh.size == sh.size);
+
+            if (dh.size != sh.size)
+                continue;
+
+            for (s32 i = 0; i < dh.size; i++)
+            {
+                dh[i] += sh[i];
+                sh[i] = 0.0;
+            }
+        }
+    }
+}
+
+//
+// A2WorkerPool
+//
+
+namespace
+{
+
+/* A number of complete events. Module data is copied into one contiguous
+ * buffer. */
+struct EventBatch
+{
+    struct ModuleEntry
+    {
+        s32 moduleIndex;
+        u32 offset;
+        u32 size;
+    };
+
+    struct EventEntry
+    {
+        s32 eventIndex;
+        u32 firstModule;
+        u32 moduleCount;
+    };
+
+    std::vector<u32> words;
+    std::vector<ModuleEntry> modules;
+    std::vector<EventEntry> events;
+
+    void clear()
+    {
+        words.clear();
+        modules.clear();
+        events.clear();
+    }
+};
+
+template<typename T>
+class BlockingQueue
+{
+    public:
+        void push(T t)
+        {
+            {
+                std::unique_lock<std::mutex> guard(m_mutex);
+                m_queue.push_back(t);
+            }
+            m_cond.notify_one();
+        }
+
+        T pop()
+        {
+            std::unique_lock<std::mutex> guard(m_mutex);
+            m_cond.wait(guard, [this] { return !m_queue.empty(); });
+            T result = m_queue.front();
+            m_queue.pop_front();
+            return result;
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+        std::deque<T> m_queue;
+};
+
+void process_batch(A2 *a2, const EventBatch &batch)
+{
+    for (const auto &event: batch.events)
+    {
+        a2_begin_event(a2, event.eventIndex);
+
+        for (u32 mi = event.firstModule; mi < event.firstModule + event.moduleCount; mi++)
+        {
+            const auto &module = batch.modules[mi];
+
+            a2_process_module_data(
+                a2, event.eventIndex, module.moduleIndex,
+                batch.words.data() + module.offset, module.size);
+        }
+
+        a2_end_event(a2, event.eventIndex);
+    }
+}
+
+} // end anon namespace
+
+struct A2WorkerPool::Private
+{
+    std::vector<A2 *> workers;
+    std::vector<std::thread> threads;
+    size_t eventsPerBatch;
+
+    std::vector<std::unique_ptr<EventBatch>> batchStorage;
+    BlockingQueue<EventBatch *> freeBatches;
+    BlockingQueue<EventBatch *> fullBatches;
+
+    // The batch currently being filled by the producer.
+    EventBatch *current = nullptr;
+
+    std::mutex inFlightMutex;
+    std::condition_variable inFlightCond;
+    size_t batchesInFlight = 0;
+
+    void workerLoop(A2 *a2)
+    {
+        // A nullptr batch is used to tell the worker to quit.
+        while (auto batch = fullBatches.pop())
+        {
+            process_batch(a2, *batch);
+            batch->clear();
+            freeBatches.push(batch);
+
+            {
+                std::unique_lock<std::mutex> guard(inFlightMutex);
+                --batchesInFlight;
+            }
+            inFlightCond.notify_all();
+        }
+    }
+
+    void submitCurrent()
+    {
+        if (current && !current->events.empty())
+        {
+            {
+                std::unique_lock<std::mutex> guard(inFlightMutex);
+                ++batchesInFlight;
+            }
+
+            fullBatches.push(current);
+            current = nullptr;
+        }
+    }
+};
+
+A2WorkerPool::A2WorkerPool(const std::vector<A2 *> &workers, size_t eventsPerBatch)
+    : m_d(std::make_unique<Private>())
+{
+    assert(!workers.empty());
+    assert(eventsPerBatch > 0);
+
+    m_d->workers = workers;
+    m_d->eventsPerBatch = eventsPerBatch;
+
+    // Two batches per worker so that the producer can fill the next batch
+    // while the workers are busy. If all batches are in use the producer
+    // blocks in beginEvent().
+    const size_t batchCount = workers.size() * 2;
+
+    for (size_t i = 0; i < batchCount; i++)
+    {
+        m_d->batchStorage.emplace_back(std::make_unique<EventBatch>());
+        m_d->freeBatches.push(m_d->batchStorage.back().get());
+    }
+
+    for (auto a2: workers)
+    {
+        m_d->threads.emplace_back([this, a2] { m_d->workerLoop(a2); });
+    }
+}
+
+A2WorkerPool::~A2WorkerPool()
+{
+    sync();
+
+    for (size_t i = 0; i < m_d->threads.size(); i++)
+        m_d->fullBatches.push(nullptr);
+
+    for (auto &t: m_d->threads)
+    {
+        if (t.joinable())
+            t.join();
+    }
+}
+
+void A2WorkerPool::beginEvent(int eventIndex)
+{
+    if (!m_d->current)
+        m_d->current = m_d->freeBatches.pop();
+
+    auto &batch = *m_d->current;
+
+    batch.events.push_back(
+        {
+            eventIndex,
+            static_cast<u32>(batch.modules.size()),
+            0u
+        });
+}
+
+void A2WorkerPool::processModuleData(int eventIndex, int moduleIndex, const u32 *data, u32 size)
+{
+    assert(m_d->current);
+    assert(!m_d->current->events.empty());
+    assert(m_d->current->events.back().eventIndex == eventIndex);
+    (void) eventIndex;
+
+    auto &batch = *m_d->current;
+
+    batch.modules.push_back(
+        {
+            moduleIndex,
+            static_cast<u32>(batch.words.size()),
+            size
+        });
+
+    batch.words.insert(batch.words.end(), data, data + size);
+    batch.events.back().moduleCount++;
+}
+
+void A2WorkerPool::endEvent(int eventIndex)
+{
+    assert(m_d->current);
+    assert(m_d->current->events.back().eventIndex == eventIndex);
+    (void) eventIndex;
+
+    if (m_d->current->events.size() >= m_d->eventsPerBatch)
+        m_d->submitCurrent();
+}
+
+void A2WorkerPool::sync()
+{
+    m_d->submitCurrent();
+
+    std::unique_lock<std::mutex> guard(m_d->inFlightMutex);
+    m_d->inFlightCond.wait(guard, [this] { return m_d->batchesInFlight == 0; });
+}
+
+size_t A2WorkerPool::workerCount() const
+{
+    return m_d->threads.size();
+}
+
+} // namespace a2
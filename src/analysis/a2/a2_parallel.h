@@ -0,0 +1,115 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef __MVME_A2_PARALLEL_H__
+#define __MVME_A2_PARALLEL_H__
+
+#include <memory>
+#include <vector>
+
+#include "a2.h"
+
+/* Parallel a2 event processing.
+ *
+ * Multiple A2 instances are built from the same analysis, one per worker
+ * thread. Complete events are copied into batches and handed to the workers.
+ * Each worker steps its own operators and fills private copies (shards) of
+ * the histograms. The shards are added to the real histogram memory by
+ * a2_merge_histograms() while the workers are idle, e.g. on timeticks or at
+ * the end of a run.
+ *
+ * Histogram contents are the same as with sequential processing because
+ * filling is commutative. Operators carrying state from one event to the next
+ * (KeepPrevious, RateMonitors, ExportSinks) depend on the event order and
+ * prevent parallel processing. Use a2_can_run_in_parallel() to check for
+ * these.
+ *
+ * Note: unless the DataSourceOptions::NoAddedRandom option is set the random
+ * values added to extracted data depend on which worker processed an event.
+ * The histograms are then statistically equivalent instead of identical.
+ */
+
+namespace a2
+{
+
+/* Returns false if the A2 instance contains operators that depend on the
+ * order in which events are processed. */
+bool a2_can_run_in_parallel(const A2 *a2);
+
+/* Replaces the storage of all H1D and H2D sinks in the given A2 instance with
+ * zero-initialized memory pushed onto the arena. */
+void a2_shard_histograms(A2 *a2, memory::Arena *arena);
+
+/* Returns true if both instances have the same data sources and operators
+ * at the same positions: same operator types, same number of histograms and
+ * histogram sizes and same hit count sizes. This is required for merging.
+ * Instances built from the same analysis by a full build match. */
+bool a2_layouts_match(const A2 *a, const A2 *b);
+
+/* Adds the histogram contents of the shard instance to the histograms of the
+ * dest instance and clears the shard. Both instances must have been built
+ * from the same analysis. Buffered increments of the shard are not included:
+ * call a2_flush_histograms() on the shard first.
+ * Operators which do not match in type or histogram size are skipped. Events
+ * with different operator counts are skipped entirely. */
+void a2_merge_histograms(A2 *dest, A2 *shard);
+
+/* Adds the data source hit counts of the shard instance to the dest instance
+ * and clears them in the shard. Only needed if the shard processes events on
+ * its own instead of receiving copies of the events seen by the dest
+ * instance, e.g. for chunked parallel replays.
+ * Data sources with different hit count sizes are skipped. */
+void a2_merge_hit_counts(A2 *dest, A2 *shard);
+
+class A2WorkerPool
+{
+    public:
+        /* The number of events collected before a batch is handed to a worker.
+         * Amortizes the synchronization cost over many small events. */
+        static const size_t DefaultEventsPerBatch = 256;
+
+        /* Starts one thread per A2 instance. The instances are not owned by
+         * the pool and must outlive it. */
+        explicit A2WorkerPool(const std::vector<A2 *> &workers,
+                              size_t eventsPerBatch = DefaultEventsPerBatch);
+        ~A2WorkerPool();
+
+        A2WorkerPool(const A2WorkerPool &) = delete;
+        A2WorkerPool &operator=(const A2WorkerPool &) = delete;
+
+        void beginEvent(int eventIndex);
+        void processModuleData(int eventIndex, int moduleIndex, const u32 *data, u32 size);
+        void endEvent(int eventIndex);
+
+        /* Hands off the currently filled batch and blocks until all workers are
+         * idle. Afterwards the worker A2 instances may be accessed from the
+         * calling thread until the next call to beginEvent(). */
+        void sync();
+
+        size_t workerCount() const;
+
+    private:
+        struct Private;
+        std::unique_ptr<Private> m_d;
+};
+
+} // namespace a2
+
+#endif /* __MVME_A2_PARALLEL_H__ */
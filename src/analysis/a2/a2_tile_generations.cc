@@ -0,0 +1,60 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "a2_tile_generations.h"
+
+#include <cassert>
+
+namespace a2
+{
+
+const u32 TileGenerations::DefaultTileShift;
+
+TileGenerations::TileGenerations(s32 binCount, u32 tileShift)
+    : m_binCount(binCount)
+    , m_tileCount(binCount > 0 ? ((binCount - 1) >> tileShift) + 1 : 0)
+    , m_tileShift(tileShift)
+{
+    assert(binCount >= 0);
+    m_counters.reset(new u32[m_tileCount]());
+}
+
+u64 TileGenerations::sum(s32 beginBin, s32 endBin) const
+{
+    u64 result = 0u;
+
+    if (beginBin >= endBin)
+        return result;
+
+    const s32 lastTile = (endBin - 1) >> m_tileShift;
+
+    for (s32 tile = beginBin >> m_tileShift; tile <= lastTile; tile++)
+        result += m_counters[tile];
+
+    return result;
+}
+
+void TileGenerations::markAll()
+{
+    for (s32 tile = 0; tile < m_tileCount; tile++)
+        ++m_counters[tile];
+}
+
+} // namespace a2
@@ -0,0 +1,86 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef __MVME_A2_TILE_GENERATIONS_H__
+#define __MVME_A2_TILE_GENERATIONS_H__
+
+#include <memory>
+
+#include "util/typedefs.h"
+
+namespace a2
+{
+
+/* Modification counters for tiles of histogram bin storage.
+ *
+ * The bins are grouped into tiles of 2^tileShift consecutive storage bins.
+ * Whenever a bin is modified the counter of the tile containing it is
+ * incremented. Readers remember the counters they have seen and only need to
+ * look at the bins of tiles whose counter changed since then. This is used by
+ * the GUI to only recompute cached render data that is out of date.
+ *
+ * Like the bins themselves the counters are written without synchronization
+ * by the thread filling the histogram. Readers should load the counters
+ * before reading the bin contents. */
+class TileGenerations
+{
+    public:
+        static const u32 DefaultTileShift = 6;
+
+        explicit TileGenerations(s32 binCount, u32 tileShift = DefaultTileShift);
+
+        TileGenerations(const TileGenerations &) = delete;
+        TileGenerations &operator=(const TileGenerations &) = delete;
+
+        u32 *data() const { return m_counters.get(); }
+        u32 tileShift() const { return m_tileShift; }
+        s32 binCount() const { return m_binCount; }
+        s32 tileCount() const { return m_tileCount; }
+
+        inline void mark(s32 bin) { ++m_counters[bin >> m_tileShift]; }
+
+        /* Sum of the counters of the tiles overlapping the storage bins
+         * [beginBin, endBin). Changes whenever any of these bins is
+         * modified. */
+        u64 sum(s32 beginBin, s32 endBin) const;
+
+        /* Increments all counters. Used when all bins are modified at once,
+         * e.g. when clearing the histogram. */
+        void markAll();
+
+    private:
+        std::unique_ptr<u32[]> m_counters;
+        s32 m_binCount;
+        s32 m_tileCount;
+        u32 m_tileShift;
+};
+
+/* Increments the tile counter of the given bin of an H1D or H2D if the
+ * histogram has tile counters. */
+template<typename Histo>
+inline void mark_tile(Histo *histo, s32 bin)
+{
+    if (histo->tileGenerations)
+        ++histo->tileGenerations[bin >> histo->tileShift];
+}
+
+} // namespace a2
+
+#endif /* __MVME_A2_TILE_GENERATIONS_H__ */
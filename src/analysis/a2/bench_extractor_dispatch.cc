@@ -0,0 +1,150 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/* Compares processing module data with one Extractor after the other against
+ * the combined ExtractorDispatch for a growing number of extractors attached
+ * to the same module.
+ *
+ * The extractors use single channel filters as commonly used with the MDPP
+ * modules: "0001 XXXX XXTC CCCC DDDD DDDD DDDD DDDD" with T and C fixed per
+ * extractor. The module data contains one data word for each of the 64
+ * possible T/C combinations plus a header and an end of event word.
+ */
+
+#include "a2.h"
+#include "a2_impl.h"
+#include "memory.h"
+#include "util/sizes.h"
+
+#include <benchmark/benchmark.h>
+#include <bitset>
+#include <random>
+
+using namespace a2;
+using namespace data_filter;
+using namespace memory;
+
+using benchmark::Counter;
+
+namespace
+{
+
+static const u32 MaxExtractors = 64;
+
+std::vector<u32> make_module_data()
+{
+    std::mt19937 gen(1234);
+    std::uniform_int_distribution<u32> valueDist(0, 0xffff);
+
+    std::vector<u32> result;
+
+    result.push_back(0x40000000 | 64); // header
+
+    for (u32 tc = 0; tc < MaxExtractors; tc++)
+        result.push_back(0x10000000 | (tc << 16) | valueDist(gen));
+
+    result.push_back(0xc0000000 | 0x1234); // end of event
+
+    return result;
+}
+
+void make_extractors(Arena *arena, A2 *a2, u32 extractorCount)
+{
+    a2->dataSources[0] = arena->pushArray<DataSource>(extractorCount);
+    a2->dataSourceCounts[0] = extractorCount;
+
+    for (u32 ei = 0; ei < extractorCount; ei++)
+    {
+        // "0001 XXXX XX" followed by the 6 bits of the extractor index
+        std::string filterString = "0001XXXXXX" + std::bitset<6>(ei).to_string()
+            + "DDDDDDDDDDDDDDDD";
+
+        MultiWordFilter filter = { make_filter(filterString) };
+
+        a2->dataSources[0][ei] = make_datasource_extractor(
+            arena, filter, 1, 1234 + ei, 0, DataSourceOptions::NoAddedRandom);
+    }
+}
+
+void BM_extractors(benchmark::State &state, bool useDispatch)
+{
+    const u32 extractorCount = state.range(0);
+    const auto moduleData = make_module_data();
+
+    Arena arena(Kilobytes(256));
+    auto a2 = arena.pushObject<A2>(&arena);
+    make_extractors(&arena, a2, extractorCount);
+
+    if (useDispatch)
+    {
+        a2_build_extractor_dispatch(a2, &arena);
+
+        if (extractorCount > 1 && !a2->extractorDispatch[0][0])
+        {
+            state.SkipWithError("no dispatch structure was built");
+            return;
+        }
+    }
+
+    double moduleDataWords = 0.0;
+
+    while (state.KeepRunning())
+    {
+        a2_begin_event(a2, 0);
+        a2_process_module_data(a2, 0, 0, moduleData.data(), moduleData.size());
+        moduleDataWords += moduleData.size();
+        benchmark::ClobberMemory();
+    }
+
+    // Every extractor must have extracted exactly its channel value.
+    for (u32 ei = 0; ei < extractorCount; ei++)
+    {
+        const auto &output = a2->dataSources[0][ei].output.data;
+        const double expected = moduleData[1 + ei] & 0xffff;
+
+        if (output[0] != expected)
+        {
+            state.SkipWithError("wrong extraction result");
+            return;
+        }
+    }
+
+    state.counters["extractors"] = extractorCount;
+    state.counters["wR"] = Counter(moduleDataWords, Counter::kIsRate);
+    state.counters["mem"] = Counter(arena.used());
+}
+
+void BM_extractors_separate(benchmark::State &state)
+{
+    BM_extractors(state, false);
+}
+
+void BM_extractors_dispatch(benchmark::State &state)
+{
+    BM_extractors(state, true);
+}
+
+} // end anon namespace
+
+BENCHMARK(BM_extractors_separate)->RangeMultiplier(2)->Range(1, MaxExtractors);
+BENCHMARK(BM_extractors_dispatch)->RangeMultiplier(2)->Range(1, MaxExtractors);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,192 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/* Compares filling the histograms of a 64 channel H1D sink one by one using
+ * HistoFillDirect::fill_h1d() against the kernels from a2_h1d_fill.h.
+ *
+ * Inputs are 16 bit values as produced by an MDPP-32 in amplitude mode with
+ * the histograms covering the full range using 64k bins. 'dense' inputs have
+ * all channels set, 'sparse' inputs have 4 out of 64 channels set, the others
+ * are invalid. The values form two peaks per channel on top of a flat
+ * background which partially lies outside the histogram range.
+ */
+
+#include "a2.h"
+#include "a2_h1d_fill.h"
+#include "a2_impl.h"
+#include "memory.h"
+#include "util/sizes.h"
+
+#include <benchmark/benchmark.h>
+#include <random>
+
+using namespace a2;
+using namespace memory;
+
+using benchmark::Counter;
+
+namespace
+{
+
+static const s32 Channels = 64;
+static const s32 Bins = 1 << 16;
+
+// Number of different input vectors cycled through during the benchmark.
+static const size_t InputSets = 256;
+
+struct Setup
+{
+    Arena arena;
+    H1DSinkData *d;
+    std::vector<std::vector<double>> inputs;
+
+    explicit Setup(s32 validChannels)
+        : arena(Megabytes(40))
+    {
+        H1D histos[Channels] = {};
+
+        for (s32 i = 0; i < Channels; i++)
+        {
+            auto &h = histos[i];
+            h.data = push_param_vector(&arena, Bins, 0.0).data;
+            h.size = Bins;
+            h.binning = { 0.0, static_cast<double>(Bins) };
+            h.binningFactor = h.size / h.binning.range;
+            h.underflow = arena.push<double>(0.0);
+            h.overflow = arena.push<double>(0.0);
+        }
+
+        PipeVectors input = {};
+        input.data = push_param_vector(&arena, Channels, invalid_param());
+        input.lowerLimits = push_param_vector(&arena, Channels, 0.0);
+        input.upperLimits = push_param_vector(&arena, Channels, Bins);
+
+        auto sink = make_h1d_sink(&arena, input, { histos, Channels });
+        d = reinterpret_cast<H1DSinkData *>(sink.d);
+
+        // Two peaks per channel on top of a flat background. About 2% of the
+        // values are out of range.
+        std::mt19937 gen(1234);
+        std::normal_distribution<double> peak1Dist(Bins * 0.25, Bins * 0.01);
+        std::normal_distribution<double> peak2Dist(Bins * 0.6, Bins * 0.02);
+        std::uniform_real_distribution<double> backgroundDist(-Bins * 0.01, Bins * 1.01);
+        std::uniform_int_distribution<s32> channelDist(0, Channels - 1);
+        std::uniform_int_distribution<s32> sourceDist(0, 9);
+
+        auto make_value = [&] ()
+        {
+            switch (sourceDist(gen))
+            {
+                case 0:  return backgroundDist(gen);
+                case 1:
+                case 2:
+                case 3:  return peak2Dist(gen);
+                default: return peak1Dist(gen);
+            }
+        };
+
+        for (size_t si = 0; si < InputSets; si++)
+        {
+            std::vector<double> values(Channels, invalid_param());
+
+            if (validChannels == Channels)
+            {
+                for (auto &v: values)
+                    v = make_value();
+            }
+            else
+            {
+                for (s32 i = 0; i < validChannels; i++)
+                    values[channelDist(gen)] = make_value();
+            }
+
+            inputs.emplace_back(values);
+        }
+    }
+};
+
+void BM_h1d_fill_direct(benchmark::State &state)
+{
+    Setup setup(state.range(0));
+    HistoFillDirect fill;
+    size_t inputIndex = 0;
+
+    while (state.KeepRunning())
+    {
+        const auto &input = setup.inputs[inputIndex++ % InputSets];
+
+        for (s32 i = 0; i < Channels; i++)
+            fill.fill_h1d(&setup.d->histos[i], input[i]);
+    }
+
+    state.counters["eR"] = Counter(state.iterations(), Counter::kIsRate);
+}
+
+void BM_h1d_fill_kernel(benchmark::State &state, H1DFillKernel kernel)
+{
+    Setup setup(state.range(0));
+    size_t inputIndex = 0;
+
+    while (state.KeepRunning())
+    {
+        const auto &input = setup.inputs[inputIndex++ % InputSets];
+
+        kernel(setup.d->histos.data, input.data(), setup.d->binMins,
+               setup.d->binMaxs, setup.d->binFactors, Channels);
+    }
+
+    state.counters["eR"] = Counter(state.iterations(), Counter::kIsRate);
+}
+
+void BM_h1d_fill_scalar(benchmark::State &state)
+{
+    BM_h1d_fill_kernel(state, h1d_fill_scalar);
+}
+
+#ifdef A2_H1D_FILL_HAVE_X86_KERNELS
+void BM_h1d_fill_sse2(benchmark::State &state)
+{
+    BM_h1d_fill_kernel(state, h1d_fill_sse2);
+}
+
+void BM_h1d_fill_avx2(benchmark::State &state)
+{
+    if (!__builtin_cpu_supports("avx2"))
+    {
+        state.SkipWithError("avx2 not supported by the CPU");
+        return;
+    }
+
+    BM_h1d_fill_kernel(state, h1d_fill_avx2);
+}
+#endif
+
+} // end anon namespace
+
+// Arg is the number of valid channels per event: sparse (4) and dense (64).
+BENCHMARK(BM_h1d_fill_direct)->Arg(4)->Arg(Channels);
+BENCHMARK(BM_h1d_fill_scalar)->Arg(4)->Arg(Channels);
+#ifdef A2_H1D_FILL_HAVE_X86_KERNELS
+BENCHMARK(BM_h1d_fill_sse2)->Arg(4)->Arg(Channels);
+BENCHMARK(BM_h1d_fill_avx2)->Arg(4)->Arg(Channels);
+#endif
+
+BENCHMARK_MAIN();
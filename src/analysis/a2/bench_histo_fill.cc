@@ -0,0 +1,132 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/* Compares the Direct and Buffered histogram fill strategies on a single
+ * H2DSink using double and compact u32 bin storage. The histogram has
+ * Arg x Arg bins. The values are spread uniformly over the whole histogram so
+ * that most direct increments miss the caches once the histogram is larger
+ * than the last level cache.
+ */
+
+#include "a2.h"
+#include "a2_impl.h"
+#include "memory.h"
+#include "util/sizes.h"
+
+#include <benchmark/benchmark.h>
+#include <random>
+
+using namespace a2;
+using namespace memory;
+
+using benchmark::Counter;
+
+namespace
+{
+
+static const s32 InputRange = 1 << 16;
+static const size_t InputSets = 1 << 16;
+
+void BM_h2d_fill(benchmark::State &state, HistoFillStrategyType fillType, bool compact = false)
+{
+    const s32 bins = state.range(0);
+
+    Arena arena(Megabytes(4));
+    std::vector<double> histoData(compact ? 0 : static_cast<size_t>(bins) * bins);
+    std::unique_ptr<CompactBins> compactBins(compact ? new CompactBins(bins * bins) : nullptr);
+
+    auto a2 = arena.pushObject<A2>(&arena);
+    a2->histoFillStrategy.setType(fillType);
+
+    PipeVectors input = {};
+    input.data = push_param_vector(&arena, 2, invalid_param());
+    input.lowerLimits = push_param_vector(&arena, 2, 0.0);
+    input.upperLimits = push_param_vector(&arena, 2, InputRange);
+
+    H2D h2d = {};
+    h2d.data = compact ? nullptr : histoData.data();
+    h2d.data32 = compact ? compactBins->data32() : nullptr;
+    h2d.compact = compactBins.get();
+    h2d.size = bins * bins;
+    h2d.binCounts[H2D::XAxis] = bins;
+    h2d.binCounts[H2D::YAxis] = bins;
+    h2d.binnings[H2D::XAxis] = { 0.0, InputRange };
+    h2d.binnings[H2D::YAxis] = { 0.0, InputRange };
+    h2d.binningFactors[H2D::XAxis] = bins / static_cast<double>(InputRange);
+    h2d.binningFactors[H2D::YAxis] = bins / static_cast<double>(InputRange);
+
+    a2->operators[0] = arena.pushArray<Operator>(1);
+    a2->operatorRanks[0] = arena.pushArray<u8>(1);
+    a2->operators[0][0] = make_h2d_sink(&arena, input, input, 0, 1, h2d);
+    a2->operatorRanks[0][0] = 1;
+    a2->operatorCounts[0] = 1;
+
+    std::mt19937 gen(1234);
+    std::uniform_real_distribution<double> valueDist(0.0, InputRange);
+    std::vector<double> values(InputSets * 2);
+
+    for (auto &v: values)
+        v = valueDist(gen);
+
+    a2_begin_run(a2, {});
+    size_t inputIndex = 0;
+
+    while (state.KeepRunning())
+    {
+        auto si = (inputIndex++ % InputSets) * 2;
+        input.data[0] = values[si];
+        input.data[1] = values[si + 1];
+        a2_end_event(a2, 0);
+    }
+
+    a2_end_run(a2);
+
+    state.counters["eR"] = Counter(state.iterations(), Counter::kIsRate);
+}
+
+void BM_h2d_fill_direct(benchmark::State &state)
+{
+    BM_h2d_fill(state, HistoFillStrategyType::Direct);
+}
+
+void BM_h2d_fill_buffered(benchmark::State &state)
+{
+    BM_h2d_fill(state, HistoFillStrategyType::Buffered);
+}
+
+void BM_h2d_fill_direct_compact(benchmark::State &state)
+{
+    BM_h2d_fill(state, HistoFillStrategyType::Direct, true);
+}
+
+void BM_h2d_fill_buffered_compact(benchmark::State &state)
+{
+    BM_h2d_fill(state, HistoFillStrategyType::Buffered, true);
+}
+
+} // end anon namespace
+
+BENCHMARK(BM_h2d_fill_direct)->Arg(256)->Arg(1024)->Arg(4096);
+BENCHMARK(BM_h2d_fill_buffered)->Arg(256)->Arg(1024)->Arg(4096);
+BENCHMARK(BM_h2d_fill_direct_compact)->Arg(256)->Arg(1024)->Arg(4096);
+BENCHMARK(BM_h2d_fill_buffered_compact)->Arg(256)->Arg(1024)->Arg(4096);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,250 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "gtest/gtest.h"
+#include "a2.h"
+#include "a2_compact_bins.h"
+#include "a2_impl.h"
+#include "util/sizes.h"
+
+#include <random>
+
+using namespace a2;
+using namespace memory;
+
+TEST(a2CompactBins, SetAndAdd)
+{
+    CompactBins bins(4);
+
+    ASSERT_EQ(bins.storageSize(), 4 * sizeof(u32));
+
+    bins.set(0, 42.0);
+    bins.add(0, 8.0);
+    bins.add(1, 1.0);
+
+    ASSERT_FALSE(bins.isPromoted());
+    ASSERT_EQ(bins.get(0), 50.0);
+    ASSERT_EQ(bins.get(1), 1.0);
+    ASSERT_EQ(bins.data32()[0], 50u);
+
+    // Not representable as a count
+    bins.add(2, 0.5);
+
+    ASSERT_TRUE(bins.isPromoted());
+    ASSERT_EQ(bins.get(0), 50.0);
+    ASSERT_EQ(bins.get(1), 1.0);
+    ASSERT_EQ(bins.get(2), 0.5);
+    ASSERT_EQ(bins.storageSize(), 4 * (sizeof(u32) + sizeof(double)));
+
+    bins.clear();
+
+    ASSERT_TRUE(bins.isPromoted());
+
+    for (s32 i = 0; i < bins.size(); i++)
+        ASSERT_EQ(bins.get(i), 0.0);
+}
+
+TEST(a2CompactBins, NegativeValuePromotes)
+{
+    CompactBins bins(2);
+    bins.set(1, -1.0);
+
+    ASSERT_TRUE(bins.isPromoted());
+    ASSERT_EQ(bins.get(1), -1.0);
+}
+
+TEST(a2CompactBins, IncrementPromotesOnOverflow)
+{
+    CompactBins bins(2);
+    bins.set(1, CompactBins::MaxCount - 1);
+
+    H1D histo = {};
+    histo.size = 2;
+    histo.data32 = bins.data32();
+    histo.compact = &bins;
+
+    increment_bin(&histo, 1);
+
+    ASSERT_EQ(histo.data, nullptr);
+    ASSERT_EQ(bins.data32()[1], CompactBins::MaxCount);
+
+    increment_bin(&histo, 1);
+    increment_bin(&histo, 0);
+
+    ASSERT_NE(histo.data, nullptr);
+    ASSERT_EQ(histo.data, bins.promoted());
+    ASSERT_EQ(bins.get(1), CompactBins::MaxCount + 1.0);
+    ASSERT_EQ(bins.get(0), 1.0);
+}
+
+TEST(a2CompactBins, TileGenerations)
+{
+    const s32 Bins = 200;
+    TileGenerations tiles(Bins, 4);
+
+    ASSERT_EQ(tiles.tileCount(), 13);
+    ASSERT_EQ(tiles.sum(0, Bins), 0u);
+
+    CompactBins bins(Bins);
+
+    H1D histo = {};
+    histo.size = Bins;
+    histo.data32 = bins.data32();
+    histo.compact = &bins;
+    histo.tileGenerations = tiles.data();
+    histo.tileShift = tiles.tileShift();
+
+    increment_bin(&histo, 17);
+    increment_bin(&histo, 17);
+
+    ASSERT_EQ(tiles.data()[1], 2u);
+    ASSERT_EQ(tiles.sum(0, 16), 0u);
+    ASSERT_EQ(tiles.sum(16, 32), 2u);
+    ASSERT_EQ(tiles.sum(31, 33), 2u);
+
+    // Promoting add
+    add_to_bin(&histo, 199, 0.5);
+
+    ASSERT_NE(histo.data, nullptr);
+    ASSERT_EQ(tiles.data()[12], 1u);
+
+    // Double storage path
+    increment_bin(&histo, 199);
+
+    ASSERT_EQ(tiles.data()[12], 2u);
+    ASSERT_EQ(tiles.sum(0, Bins), 4u);
+
+    tiles.markAll();
+
+    ASSERT_EQ(tiles.sum(0, Bins), 4u + tiles.tileCount());
+    ASSERT_EQ(tiles.sum(0, 0), 0u);
+}
+
+namespace
+{
+
+static const s32 Channels = 33;
+static const s32 Bins = 1000;
+
+struct SinkSetup
+{
+    std::vector<double> data = std::vector<double>(Channels * Bins);
+    std::vector<std::unique_ptr<CompactBins>> compact;
+    std::vector<double> underflows = std::vector<double>(Channels);
+    std::vector<double> overflows = std::vector<double>(Channels);
+    H1DSinkData *d;
+
+    SinkSetup(Arena *arena, PipeVectors input, bool useCompact)
+    {
+        std::vector<H1D> histos(Channels);
+
+        for (s32 i = 0; i < Channels; i++)
+        {
+            auto &h = histos[i];
+            h = {};
+            h.size = Bins;
+            h.binning = { 10.0, Bins - 20.0 };
+            h.binningFactor = h.size / h.binning.range;
+            h.underflow = &underflows[i];
+            h.overflow = &overflows[i];
+
+            if (useCompact)
+            {
+                compact.emplace_back(std::make_unique<CompactBins>(Bins));
+                h.compact = compact.back().get();
+                h.data32 = h.compact->data32();
+            }
+            else
+            {
+                h.data = data.data() + i * Bins;
+            }
+        }
+
+        auto sink = make_h1d_sink(arena, input, { histos.data(), Channels });
+        d = reinterpret_cast<H1DSinkData *>(sink.d);
+    }
+
+    double get(s32 histo, s32 bin) const
+    {
+        return compact.empty() ? data[histo * Bins + bin] : compact[histo]->get(bin);
+    }
+};
+
+void test_fill(HistoFillStrategyType fillType)
+{
+    Arena arena(Megabytes(1));
+
+    PipeVectors input = {};
+    input.data = push_param_vector(&arena, Channels, invalid_param());
+    input.lowerLimits = push_param_vector(&arena, Channels, 0.0);
+    input.upperLimits = push_param_vector(&arena, Channels, Bins);
+
+    SinkSetup expected(&arena, input, false);
+    SinkSetup actual(&arena, input, true);
+
+    auto a2 = arena.pushObject<A2>(&arena);
+    a2->histoFillStrategy.setType(fillType);
+    a2->operators[0] = arena.pushArray<Operator>(1);
+    a2->operatorRanks[0] = arena.pushArray<u8>(1);
+    a2->operators[0][0] = make_h1d_sink(&arena, input, actual.d->histos);
+    a2->operatorRanks[0][0] = 1;
+    a2->operatorCounts[0] = 1;
+
+    auto sinkData = reinterpret_cast<H1DSinkData *>(a2->operators[0][0].d);
+
+    a2_begin_run(a2, {});
+
+    std::mt19937 gen(1234);
+    std::normal_distribution<double> valueDist(Bins * 0.5, Bins * 0.3);
+
+    for (int event = 0; event < 10000; event++)
+    {
+        for (s32 i = 0; i < Channels; i++)
+            input.data[i] = valueDist(gen);
+
+        HistoFillDirect().fill_h1d_sink(expected.d, input.data);
+        a2_end_event(a2, 0);
+    }
+
+    a2_end_run(a2);
+
+    for (s32 hi = 0; hi < Channels; hi++)
+    {
+        ASSERT_EQ(expected.d->histos[hi].entryCount, sinkData->histos[hi].entryCount);
+        ASSERT_EQ(expected.underflows[hi], actual.underflows[hi]);
+        ASSERT_EQ(expected.overflows[hi], actual.overflows[hi]);
+        ASSERT_FALSE(actual.compact[hi]->isPromoted());
+
+        for (s32 bin = 0; bin < Bins; bin++)
+            ASSERT_EQ(expected.get(hi, bin), actual.get(hi, bin));
+    }
+}
+
+} // end anon namespace
+
+TEST(a2CompactBins, DirectFillMatchesDoubleStorage)
+{
+    test_fill(HistoFillStrategyType::Direct);
+}
+
+TEST(a2CompactBins, BufferedFillMatchesDoubleStorage)
+{
+    test_fill(HistoFillStrategyType::Buffered);
+}
@@ -0,0 +1,301 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "gtest/gtest.h"
+#include "a2_export_columnar.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <zlib.h>
+
+using namespace a2;
+
+namespace
+{
+
+struct Chunk
+{
+    u64 offset;
+    u32 storedSize;
+    u32 rawSize;
+    u8 codec;
+    u32 validCount;
+    double min;
+    double max;
+};
+
+struct RowGroup
+{
+    u64 firstRow;
+    u32 rowCount;
+    std::vector<Chunk> chunks;
+};
+
+struct ParsedFile
+{
+    std::vector<u8> data;
+    std::vector<u16> dimensions;
+    std::vector<RowGroup> rowGroups;
+};
+
+// Minimal reader following the layout documented in a2_export_columnar.h.
+struct Reader
+{
+    const std::vector<u8> &data;
+    size_t pos;
+
+    template<typename T>
+    T read()
+    {
+        T result;
+        assert(pos + sizeof(T) <= data.size());
+        std::memcpy(&result, data.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return result;
+    }
+};
+
+ParsedFile parse_file(const std::string &filename)
+{
+    ParsedFile result;
+
+    std::ifstream in(filename, std::ios::binary);
+    result.data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+
+    const auto &data = result.data;
+
+    EXPECT_GE(data.size(), 24u);
+    EXPECT_EQ(std::memcmp(data.data(), "MVMECOL1", 8), 0);
+    EXPECT_EQ(std::memcmp(data.data() + data.size() - 8, "MVMECOL1", 8), 0);
+
+    Reader r{ data, data.size() - 16 };
+    r.pos = r.read<u64>();
+
+    EXPECT_EQ(r.read<u32>(), ColumnarExportEncoder::FormatVersion);
+
+    u32 arrayCount = r.read<u32>();
+    size_t columnCount = 0;
+
+    for (u32 i = 0; i < arrayCount; i++)
+    {
+        result.dimensions.push_back(r.read<u16>());
+        columnCount += result.dimensions.back();
+    }
+
+    u32 rowGroupCount = r.read<u32>();
+
+    for (u32 gi = 0; gi < rowGroupCount; gi++)
+    {
+        RowGroup group;
+        group.firstRow = r.read<u64>();
+        group.rowCount = r.read<u32>();
+
+        for (size_t ci = 0; ci < columnCount; ci++)
+        {
+            Chunk chunk;
+            chunk.offset = r.read<u64>();
+            chunk.storedSize = r.read<u32>();
+            chunk.rawSize = r.read<u32>();
+            chunk.codec = r.read<u8>();
+            chunk.validCount = r.read<u32>();
+            chunk.min = r.read<double>();
+            chunk.max = r.read<double>();
+            group.chunks.push_back(chunk);
+        }
+
+        result.rowGroups.emplace_back(std::move(group));
+    }
+
+    return result;
+}
+
+// Returns one value per row, NaN for invalid rows.
+std::vector<double> read_column(const ParsedFile &file, const RowGroup &group, const Chunk &chunk)
+{
+    std::vector<double> result(group.rowCount, std::numeric_limits<double>::quiet_NaN());
+
+    if (!chunk.validCount)
+        return result;
+
+    std::vector<u8> raw(chunk.rawSize);
+
+    if (chunk.codec == ColumnarExportEncoder::Codec_Zlib)
+    {
+        uLongf rawSize = chunk.rawSize;
+        EXPECT_EQ(uncompress(raw.data(), &rawSize, file.data.data() + chunk.offset,
+                             chunk.storedSize), Z_OK);
+        EXPECT_EQ(rawSize, chunk.rawSize);
+    }
+    else
+    {
+        EXPECT_EQ(chunk.storedSize, chunk.rawSize);
+        std::memcpy(raw.data(), file.data.data() + chunk.offset, chunk.rawSize);
+    }
+
+    const size_t valuesSize = chunk.validCount * sizeof(double);
+    const bool hasBitmap = chunk.rawSize > valuesSize;
+    const u8 *bits = raw.data();
+    const u8 *values = raw.data() + (hasBitmap ? (group.rowCount + 7) / 8 : 0);
+
+    for (u32 row = 0, vi = 0; row < group.rowCount; row++)
+    {
+        if (!hasBitmap || (bits[row / 8] & (1u << (row % 8))))
+            std::memcpy(&result[row], values + sizeof(double) * vi++, sizeof(double));
+    }
+
+    return result;
+}
+
+// Value of parameter p in row r. Parameter 0 is always valid, parameter 1 is
+// valid in every third row, parameter 2 never.
+double expected_value(size_t array, u32 p, u64 r)
+{
+    if (p == 0 || (p == 1 && r % 3 == 0))
+        return array * 1000.0 + p * 100.0 + (r % 50);
+
+    return std::numeric_limits<double>::quiet_NaN();
+}
+
+void run_roundtrip(int compressionLevel)
+{
+    const std::string filename = "test_a2_export_columnar.bin";
+    const std::vector<u16> dimensions = { 3, 3 };
+    const u64 rows = 1000;
+    const u32 rowGroupSize = 300;
+
+    ExportSinkWriter writer(512, 2);
+    writer.open(filename, 0, {});
+
+    ColumnarExportEncoder encoder(dimensions, compressionLevel, rowGroupSize);
+    encoder.begin(writer);
+
+    for (u64 r = 0; r < rows; r++)
+    {
+        for (size_t a = 0; a < dimensions.size(); a++)
+        {
+            for (u32 p = 0; p < dimensions[a]; p++)
+            {
+                double value = expected_value(a, p, r);
+
+                if (!std::isnan(value))
+                    encoder.setValue(encoder.getFirstColumn(a) + p, value);
+            }
+        }
+
+        encoder.endRow(writer);
+    }
+
+    encoder.finish(writer);
+    writer.finish();
+    ASSERT_TRUE(writer.good());
+
+    auto file = parse_file(filename);
+
+    ASSERT_EQ(file.dimensions, dimensions);
+    ASSERT_EQ(file.rowGroups.size(), 4u);
+    ASSERT_EQ(file.rowGroups.back().firstRow, 900u);
+    ASSERT_EQ(file.rowGroups.back().rowCount, 100u);
+
+    for (const auto &group: file.rowGroups)
+    {
+        ASSERT_EQ(group.chunks.size(), 6u);
+
+        for (size_t a = 0; a < dimensions.size(); a++)
+        {
+            for (u32 p = 0; p < dimensions[a]; p++)
+            {
+                const auto &chunk = group.chunks[a * 3 + p];
+                auto values = read_column(file, group, chunk);
+
+                u32 validCount = 0;
+
+                for (u32 row = 0; row < group.rowCount; row++)
+                {
+                    double expected = expected_value(a, p, group.firstRow + row);
+
+                    if (std::isnan(expected))
+                    {
+                        ASSERT_TRUE(std::isnan(values[row]));
+                    }
+                    else
+                    {
+                        ASSERT_EQ(values[row], expected);
+                        ++validCount;
+                    }
+                }
+
+                ASSERT_EQ(chunk.validCount, validCount);
+
+                if (validCount)
+                {
+                    ASSERT_EQ(chunk.min, a * 1000.0 + p * 100.0);
+                    ASSERT_EQ(chunk.max, a * 1000.0 + p * 100.0 + 49);
+                }
+                else
+                {
+                    ASSERT_EQ(chunk.storedSize, 0u);
+                    ASSERT_TRUE(std::isnan(chunk.min));
+                }
+
+                if (compressionLevel != 0 && validCount)
+                {
+                    ASSERT_EQ(chunk.codec, ColumnarExportEncoder::Codec_Zlib);
+                }
+            }
+        }
+    }
+
+    std::remove(filename.c_str());
+}
+
+} // end anon namespace
+
+TEST(a2ColumnarExport, RoundTrip)
+{
+    run_roundtrip(0);
+}
+
+TEST(a2ColumnarExport, RoundTripCompressed)
+{
+    run_roundtrip(1);
+}
+
+TEST(a2ColumnarExport, Empty)
+{
+    const std::string filename = "test_a2_export_columnar_empty.bin";
+
+    ExportSinkWriter writer;
+    writer.open(filename, 0, {});
+
+    ColumnarExportEncoder encoder({ 16 }, 0);
+    encoder.begin(writer);
+    encoder.finish(writer);
+    writer.finish();
+
+    auto file = parse_file(filename);
+
+    ASSERT_EQ(file.dimensions, std::vector<u16>{ 16 });
+    ASSERT_TRUE(file.rowGroups.empty());
+
+    std::remove(filename.c_str());
+}
@@ -0,0 +1,150 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "gtest/gtest.h"
+#include "a2_export_writer.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <zstr.hpp>
+
+using namespace a2;
+
+namespace
+{
+
+std::vector<char> make_data(size_t size)
+{
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int> dist(0, 255);
+    std::vector<char> result(size);
+
+    for (auto &c: result)
+        c = static_cast<char>(dist(rng));
+
+    return result;
+}
+
+// Writes the data in chunks of varying size, some of them larger than the
+// block size.
+void write_chunked(ExportSinkWriter &writer, const std::vector<char> &data)
+{
+    static const size_t ChunkSizes[] = { 1, 7, 64, 100, 3, 513 };
+    size_t pos = 0;
+
+    for (size_t i = 0; pos < data.size(); i++)
+    {
+        size_t n = std::min(ChunkSizes[i % 6], data.size() - pos);
+        writer.write(data.data() + pos, n);
+        pos += n;
+    }
+}
+
+template<typename Stream>
+std::vector<char> read_all(Stream &in)
+{
+    return std::vector<char>(std::istreambuf_iterator<char>(in),
+                             std::istreambuf_iterator<char>());
+}
+
+} // end anon namespace
+
+TEST(a2ExportSinkWriter, Uncompressed)
+{
+    const std::string filename = "test_a2_export_writer_uncompressed.bin";
+    const auto data = make_data(100000);
+    std::string error;
+
+    ExportSinkWriter writer(256, 2);
+    writer.open(filename, 0, [&error] (const std::string &msg) { error = msg; });
+
+    ASSERT_TRUE(writer.isOpen());
+
+    write_chunked(writer, data);
+    writer.finish();
+
+    ASSERT_FALSE(writer.isOpen());
+    ASSERT_TRUE(writer.good());
+    ASSERT_TRUE(error.empty());
+
+    auto counters = writer.getCounters();
+    ASSERT_EQ(counters.fileBytesWritten, data.size());
+    ASSERT_EQ(counters.blocksWritten, (data.size() + 255) / 256);
+    ASSERT_EQ(counters.queueDepth, 0u);
+    ASSERT_EQ(counters.blockCount, 2u);
+
+    std::ifstream in(filename, std::ios::binary);
+    ASSERT_EQ(read_all(in), data);
+
+    std::remove(filename.c_str());
+}
+
+TEST(a2ExportSinkWriter, Compressed)
+{
+    const std::string filename = "test_a2_export_writer_compressed.bin";
+    const auto data = make_data(1u << 20);
+
+    ExportSinkWriter writer(1000, 3);
+    writer.open(filename, -1, {});
+    write_chunked(writer, data);
+    writer.finish();
+
+    ASSERT_TRUE(writer.good());
+
+    zstr::ifstream in(filename, std::ios::binary);
+    ASSERT_EQ(read_all(in), data);
+
+    std::remove(filename.c_str());
+}
+
+TEST(a2ExportSinkWriter, Reopen)
+{
+    const std::string filename = "test_a2_export_writer_reopen.bin";
+    const auto data = make_data(5000);
+
+    ExportSinkWriter writer(128, 2);
+    writer.open(filename, 0, {});
+    write_chunked(writer, data);
+
+    // Reopening finishes the previous file and truncates it.
+    writer.open(filename, 0, {});
+    writer.write(data.data(), 10);
+    writer.finish();
+
+    std::ifstream in(filename, std::ios::binary);
+    ASSERT_EQ(read_all(in), std::vector<char>(data.begin(), data.begin() + 10));
+
+    std::remove(filename.c_str());
+}
+
+TEST(a2ExportSinkWriter, OpenError)
+{
+    ExportSinkWriter writer;
+
+    ASSERT_ANY_THROW(writer.open("nonexistent_directory/output.bin", 0, {}));
+    ASSERT_FALSE(writer.isOpen());
+
+    // Writes to a writer that is not open are ignored.
+    char c = 42;
+    writer.write(&c, sizeof(c));
+    writer.finish();
+}
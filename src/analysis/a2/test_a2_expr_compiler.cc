@@ -0,0 +1,265 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "gtest/gtest.h"
+#include "a2.h"
+#include "a2_expr_compiler.h"
+#include "a2_impl.h"
+#include "util/sizes.h"
+
+#include <cstring>
+#include <iostream>
+
+using namespace a2;
+using namespace memory;
+
+#define ArrayCount(x) (sizeof(x) / sizeof(*x))
+
+namespace
+{
+
+double inputData[] =
+{
+    0.0, 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0,
+    8.0, 9.0, 10.0, 11.0, 12.0, invalid_param() /* @[13] */, -14.5, 15.25,
+};
+
+const s32 inputSize = ArrayCount(inputData);
+
+double scalarData[] = { 42.5 };
+
+// Both outputs get the size of input0.
+const char *ExprBegin =
+    "return ["
+    " 'output0', input0.unit, input0.size, input0.lower_limits, input0.upper_limits,"
+    " 'output1', input0.unit, input0.size, input0.lower_limits, input0.upper_limits"
+    " ];";
+
+Operator make_test_operator(Arena *arena, const std::string &exprStep)
+{
+    std::vector<PipeVectors> inputs =
+    {
+        {
+            ParamVec{inputData, inputSize},
+            push_param_vector(arena, inputSize, 0.0),
+            push_param_vector(arena, inputSize, 20.0),
+        },
+        {
+            ParamVec{scalarData, 1},
+            push_param_vector(arena, 1, -100.0),
+            push_param_vector(arena, 1, 100.0),
+        },
+    };
+
+    return make_expression_operator(
+        arena, inputs,
+        { NoParamIndex, 0 },
+        { "input0", "input1" },
+        { "apples", "oranges" },
+        ExprBegin, exprStep);
+}
+
+void clear_outputs(Operator *op)
+{
+    for (s32 oi = 0; oi < op->outputCount; oi++)
+        fill(op->outputs[oi], 0.0);
+}
+
+// Compares bit patterns to also catch differing NaN payloads.
+void expect_same_outputs(const std::vector<std::vector<double>> &expected, Operator *op,
+                         const std::string &expr)
+{
+    for (s32 oi = 0; oi < op->outputCount; oi++)
+    {
+        for (s32 i = 0; i < op->outputs[oi].size; i++)
+        {
+            EXPECT_EQ(std::memcmp(&expected[oi][i], &op->outputs[oi][i], sizeof(double)), 0)
+                << "expr=" << expr << ", output=" << oi << ", index=" << i
+                << ", exprtk=" << expected[oi][i] << ", compiled=" << op->outputs[oi][i];
+        }
+    }
+}
+
+} // end anon namespace
+
+TEST(a2ExprCompiler, MatchesExprtk)
+{
+    const std::vector<std::string> scripts =
+    {
+        "output0 := input0;",
+        "output0 := input0 * 2 + 1; output1 := -input0 / 3;",
+        "output0 := input0 + input1; output1 := input1 - input0 ^ 2;",
+        "output0 := input0 / 4; output1 := (input0 + 1) * (input0 - 1);",
+        "output0 := input0; output0 += 10; output1 := 5; output1 *= input0;",
+
+        "for (var i := 0; i < input0[]; i += 1) { output0[i] := is_valid(input0[i]) ? input0[i] * 2 : 0; }",
+        "for (var i := 0; i < input0.size; i += 1) { output0[i] := valid_or(input0[i], -1); }",
+        "for (var i := 0; i < input0.size; i += 1) {"
+        "  if (is_invalid(input0[i])) { output0[i] := make_invalid(); continue; }"
+        "  output0[i] := sqrt(abs(input0[i])) + log(1 + abs(input0[i]));"
+        "  if (input0[i] > 10) break;"
+        "}",
+        "var i := 0; while (i < input0.size) { output1[i] := round(input0[i] / 3); i += 1; }",
+        "var s := 0;"
+        "for (var i := 0; i < input0.size; i += 1) { if (is_valid(input0[i])) s += input0[i]; }"
+        "output0[0] := s; output0[1] := s / input0.size;",
+        "output0[0] := min(input0[1], input0[2], input0[3]); output0[1] := max(input0[14], input1);",
+        "output0[0] := 2 ^ 3 ^ 2; output0[1] := -2 ^ 2; output0[2] := 1 - 2 - 3;",
+        "output0[0] := 1 + 2 * 3 > 6 and 0 or 1; output0[1] := input0[3] == 3 + 1e-12;",
+        "output0[0] := not(input0[0]); output0[1] := input1 > 40 ? 1 : 2; output0[2] := input0[7] % 4;",
+        "output0[0] := input1.lower_limit; output0[1] := input1.upper_limit; output0[2] := input0.upper_limits[3];",
+        "output0[0] := pi; output0[1] := epsilon; output0[2] := floor(-2.5); output0[3] := ceil(2.1);",
+        "// comment\n OUTPUT0 := Input0 * 2; # another comment\n /* block */",
+        "if (input1 < 0) { output0 := 1; } else if (input1 < 50) { output0 := 2; } else { output0 := 3; }",
+
+        // exprtk simplifies operations with a literal zero operand instead of
+        // following IEEE semantics unless the other operand is a variable.
+        "output0[0] := input0[13] * 0 + 5; output0[1] := 0 * input0[13]; output0[2] := input0[14] * -0;",
+        "for (var i := 0; i < input0[]; i += 1) { output0[i] := input0[i] * 0; output1[i] := 0 * input0[i]; }",
+        "for (var i := 0; i < input0[]; i += 1) { output0[i] := input0[i] / 0; output1[i] := 0 / input0[i]; }",
+        "for (var i := 0; i < input0[]; i += 1) { output0[i] := -input0[i] + 0; output1[i] := 0 + -input0[i]; }",
+        "for (var i := 0; i < input0[]; i += 1) { output0[i] := (input0[i] * 2) - 0; output1[i] := sqrt(input0[i] - 20) * (1 - 1); }",
+        "var x := inf; output0[0] := x * 0; output0[1] := 0 * x; output0[2] := x * (1 - 1); output0[3] := (x + 1) * 0;",
+        "var x := -0; output0[0] := x + 0; output0[1] := 0 + x; output0[2] := x - 0; output0[3] := -x + 0;",
+        "output0[0] := input1 / 0; output0[1] := 0 / input1; output0[2] := input0[13] / 0; output0[3] := input0[1 + 12] * 0;",
+        "for (var i := 0; i < input0[]; i += 1) { output0[i] := input0[i] * abs(0); output1[i] := input0[i] * is_nan(1); }",
+        "for (var i := 0; i < input0[]; i += 1) { output0[i] := input0[i] * min(0, 1); output1[i] := input0[i] * (true ? 0 : 1); }",
+        "for (var i := 0; i < input0[]; i += 1) { output0[i] := input0[i] * (2 < 1); output1[i] := input0[i] * pow(0, 1); }",
+        "for (var i := 0; i < input0[]; i += 1) { output0[i] := input0[i] * (1 * 1); output1[i] := (input0[i] * 1) * 0; }",
+        "output0[0] := (input1 > 0 ? inf : 1) * 0; output0[1] := abs(input0[13]) * 0; output0[2] := input0[2 * 7] * 0;",
+    };
+
+    for (const auto &script: scripts)
+    {
+        Arena arena(Kilobytes(256));
+        auto op = make_test_operator(&arena, script);
+        auto d = reinterpret_cast<ExpressionOperatorData *>(op.d);
+
+        ASSERT_TRUE(d->expr_step_compiled) << script << ": " << d->expr_step_fallback_reason;
+
+        clear_outputs(&op);
+        d->expr_step.eval();
+
+        std::vector<std::vector<double>> expected;
+
+        for (s32 oi = 0; oi < op.outputCount; oi++)
+        {
+            expected.emplace_back(op.outputs[oi].data,
+                                  op.outputs[oi].data + op.outputs[oi].size);
+        }
+
+        clear_outputs(&op);
+        expression_operator_step(&op);
+
+        expect_same_outputs(expected, &op, script);
+    }
+}
+
+TEST(a2ExprCompiler, FallbackToExprtk)
+{
+    const std::vector<std::string> scripts =
+    {
+        "output0 := input0; return [1];",
+        "var x[3] := {1, 2, 3}; output0[0] := x[1];",
+        "output0[0] := sum(input0);",
+        "var s := 'hello'; output0[0] := 1;",
+        "output0[0] := frac(input1);",
+        "output0 := input0 % 4;",
+        "output0[0] := clamp(0, input1, 10);",
+        // exprtk reassociates literal operands of chained operations
+        "for (var i := 0; i < input0[]; i += 1) { output0[i] := (input0[i] * 2) * 0; }",
+        "for (var i := 0; i < input0[]; i += 1) { output0[i] := input0[i] * 3 / 7; }",
+        "for (var i := 0; i < input0[]; i += 1) { output0[i] := 0.1 + (input0[i] + 0.2); }",
+    };
+
+    for (const auto &script: scripts)
+    {
+        Arena arena(Kilobytes(256));
+        auto op = make_test_operator(&arena, script);
+        auto d = reinterpret_cast<ExpressionOperatorData *>(op.d);
+
+        EXPECT_FALSE(d->expr_step_compiled) << script;
+        EXPECT_FALSE(d->expr_step_fallback_reason.empty()) << script;
+
+        // Must still produce output via exprtk.
+        expression_operator_step(&op);
+    }
+}
+
+TEST(a2ExprCompiler, VectorSizeMismatch)
+{
+    double a[4] = { 1, 2, 3, 4 };
+    double b[2] = { 10, 20 };
+    double c[3] = { 0, 0, 0 };
+
+    expr_compiler::SymbolTable symtab;
+    symtab.addVector("a", a, 4);
+    symtab.addVector("b", b, 2);
+    symtab.addVector("c", c, 3);
+
+    // The number of elements processed is the minimum of the sizes.
+    auto prog = expr_compiler::compile("c := a + b;", symtab);
+    prog.run();
+
+    ASSERT_EQ(c[0], 11.0);
+    ASSERT_EQ(c[1], 22.0);
+    ASSERT_EQ(c[2], 0.0);
+
+    prog = expr_compiler::compile("c := 7;", symtab);
+    prog.run();
+
+    ASSERT_EQ(c[0], 7.0);
+    ASSERT_EQ(c[1], 7.0);
+    ASSERT_EQ(c[2], 7.0);
+
+    // Out of range reads yield NaN, writes are ignored.
+    double k = 100.0;
+    symtab.addScalar("k", k);
+    prog = expr_compiler::compile("c[0] := a[k]; c[k] := 1; c[-1] := 1;", symtab);
+    prog.run();
+
+    ASSERT_TRUE(std::isnan(c[0]));
+    ASSERT_EQ(c[1], 7.0);
+    ASSERT_EQ(c[2], 7.0);
+}
+
+TEST(a2ExprCompiler, ScalarAssignment)
+{
+    double x = 1.0;
+    double y = 0.0;
+
+    expr_compiler::SymbolTable symtab;
+    symtab.addScalar("x", x);
+    symtab.addScalar("y", y);
+    symtab.addConstant("k", 3.0);
+
+    auto prog = expr_compiler::compile("y := x * k; x += 1;", symtab);
+
+    prog.run();
+    ASSERT_EQ(y, 3.0);
+    ASSERT_EQ(x, 2.0);
+
+    prog.run();
+    ASSERT_EQ(y, 6.0);
+    ASSERT_EQ(x, 3.0);
+
+    ASSERT_THROW(expr_compiler::compile("k := 1;", symtab), expr_compiler::UnsupportedExpression);
+    ASSERT_THROW(expr_compiler::compile("y := z;", symtab), expr_compiler::UnsupportedExpression);
+}
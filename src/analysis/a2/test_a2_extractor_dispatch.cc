@@ -0,0 +1,161 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "gtest/gtest.h"
+#include "a2.h"
+#include "a2_impl.h"
+#include "util/sizes.h"
+
+#include <random>
+
+using namespace a2;
+using namespace data_filter;
+using namespace memory;
+
+namespace
+{
+
+// Mixed set of filters: single word filters sharing a mask, filters with
+// different masks, a word index filter, multi word filters and filters
+// requiring multiple completions.
+A2 *build_test_a2(Arena *arena)
+{
+    auto a2 = arena->pushObject<A2>(arena);
+
+    std::vector<std::pair<MultiWordFilter, u32>> filters =
+    {
+        { { make_filter("0001 XXXX XX00 AAAA DDDD DDDD DDDD DDDD") }, 0 },
+        { { make_filter("0001 XXXX XX01 AAAA DDDD DDDD DDDD DDDD") }, 0 },
+        { { make_filter("0001 XXXX XX1A AAAA DDDD DDDD DDDD DDDD") }, 0 },
+        { { make_filter("0001 XXXX XX10 0000 DDDD DDDD DDDD DDDD") }, 0 },
+        { { make_filter("11DD DDDD DDDD DDDD DDDD DDDD DDDD DDDD") }, 0 },
+        { { make_filter("0100 XXXX XXXX XXXX XXXX XXDD DDDD DDDD", 0) }, 0 },
+        { { make_filter("0001 XXXX XX00 0000 DDDD DDDD DDDD DDDD"),
+            make_filter("0001 XXXX XX00 0001 DDDD DDDD DDDD DDDD") }, 0 },
+        { { make_filter("0001 XXXX XX00 AAAA DDDD DDDD DDDD DDDD"),
+            make_filter("0001 XXXX XX00 AAAA DDDD DDDD DDDD DDDD") }, 0 },
+        { { make_filter("0001 XXXX XX01 AAAA DDDD DDDD DDDD DDDD") }, 3 },
+    };
+
+    a2->dataSources[0] = arena->pushArray<DataSource>(filters.size());
+    a2->dataSourceCounts[0] = filters.size();
+
+    for (size_t i = 0; i < filters.size(); i++)
+    {
+        a2->dataSources[0][i] = make_datasource_extractor(
+            arena, filters[i].first, filters[i].second, 1234 + i, 0,
+            DataSourceOptions::NoAddedRandom);
+    }
+
+    return a2;
+}
+
+std::vector<u32> generate_module_data(std::mt19937 &gen)
+{
+    std::uniform_int_distribution<u32> sizeDist(0, 40);
+    std::uniform_int_distribution<u32> typeDist(0, 3);
+    std::uniform_int_distribution<u32> addressDist(0, 63);
+    std::uniform_int_distribution<u32> valueDist(0, 0xffff);
+
+    std::vector<u32> result;
+    const u32 size = sizeDist(gen);
+
+    for (u32 wi = 0; wi < size; wi++)
+    {
+        switch (typeDist(gen))
+        {
+            case 0: result.push_back(0x40000000 | valueDist(gen)); break;
+            case 1: result.push_back(0xc0000000 | valueDist(gen)); break;
+            default:
+                result.push_back(0x10000000 | (addressDist(gen) << 16) | valueDist(gen));
+                break;
+        }
+    }
+
+    return result;
+}
+
+} // end anon namespace
+
+TEST(a2ExtractorDispatch, MatchesSeparateProcessing)
+{
+    Arena arena(Kilobytes(256));
+
+    auto separateA2 = build_test_a2(&arena);
+    auto dispatchA2 = build_test_a2(&arena);
+
+    a2_build_extractor_dispatch(dispatchA2, &arena);
+
+    ASSERT_NE(dispatchA2->extractorDispatch[0][0], nullptr);
+    ASSERT_EQ(dispatchA2->extractorDispatch[0][1], nullptr);
+
+    std::mt19937 gen(42);
+
+    for (int event = 0; event < 10000; event++)
+    {
+        auto data = generate_module_data(gen);
+
+        a2_begin_event(separateA2, 0);
+        a2_begin_event(dispatchA2, 0);
+
+        a2_process_module_data(separateA2, 0, 0, data.data(), data.size());
+        a2_process_module_data(dispatchA2, 0, 0, data.data(), data.size());
+
+        for (s32 si = 0; si < separateA2->dataSourceCounts[0]; si++)
+        {
+            const auto &expected = separateA2->dataSources[0][si].output.data;
+            const auto &actual   = dispatchA2->dataSources[0][si].output.data;
+
+            ASSERT_EQ(expected.size, actual.size);
+
+            for (s32 pi = 0; pi < expected.size; pi++)
+            {
+                ASSERT_EQ(is_param_valid(expected[pi]), is_param_valid(actual[pi]));
+
+                if (is_param_valid(expected[pi]))
+                    ASSERT_EQ(expected[pi], actual[pi]);
+            }
+        }
+    }
+
+    for (s32 si = 0; si < separateA2->dataSourceCounts[0]; si++)
+    {
+        const auto &expected = separateA2->dataSources[0][si].hitCounts;
+        const auto &actual   = dispatchA2->dataSources[0][si].hitCounts;
+
+        for (s32 pi = 0; pi < expected.size; pi++)
+            ASSERT_EQ(expected[pi], actual[pi]);
+    }
+}
+
+TEST(a2ExtractorDispatch, NotBuiltForSingleExtractor)
+{
+    Arena arena(Kilobytes(256));
+
+    auto a2 = arena.pushObject<A2>(&arena);
+    a2->dataSources[0] = arena.pushArray<DataSource>(1);
+    a2->dataSourceCounts[0] = 1;
+    a2->dataSources[0][0] = make_datasource_extractor(
+        &arena, { make_filter("xxxx aaaa xxxx dddd") }, 1, 1234, 0);
+
+    a2_build_extractor_dispatch(a2, &arena);
+
+    ASSERT_EQ(a2->extractorDispatch[0][0], nullptr);
+}
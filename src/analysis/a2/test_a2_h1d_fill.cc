@@ -0,0 +1,148 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "gtest/gtest.h"
+#include "a2.h"
+#include "a2_h1d_fill.h"
+#include "a2_impl.h"
+#include "util/sizes.h"
+
+#include <random>
+
+using namespace a2;
+using namespace memory;
+
+namespace
+{
+
+// Not a multiple of the SIMD width or the kernel block size.
+static const s32 Channels = 71;
+static const s32 Bins = 100;
+
+H1DSinkData *make_test_sink(Arena *arena)
+{
+    std::vector<H1D> histos(Channels);
+
+    for (s32 i = 0; i < Channels; i++)
+    {
+        auto &h = histos[i];
+        h = {};
+        h.data = push_param_vector(arena, Bins, 0.0).data;
+        h.size = Bins;
+        // Different binnings per channel including an odd range and an
+        // empty range.
+        h.binning = { -5.0 + i, i % 7 == 0 ? 0.0 : 20.0 + i * 0.37 };
+        h.binningFactor = h.size / h.binning.range;
+
+        // Some histos without underflow/overflow counters.
+        if (i % 3)
+        {
+            h.underflow = arena->push<double>(0.0);
+            h.overflow = arena->push<double>(0.0);
+        }
+    }
+
+    PipeVectors input = {};
+    input.data = push_param_vector(arena, Channels, invalid_param());
+    input.lowerLimits = push_param_vector(arena, Channels, 0.0);
+    input.upperLimits = push_param_vector(arena, Channels, 0.0);
+
+    auto sink = make_h1d_sink(arena, input, { histos.data(), Channels });
+    return reinterpret_cast<H1DSinkData *>(sink.d);
+}
+
+void expect_equal_histos(H1DSinkData *expected, H1DSinkData *actual)
+{
+    for (s32 i = 0; i < Channels; i++)
+    {
+        const auto &eh = expected->histos[i];
+        const auto &ah = actual->histos[i];
+
+        ASSERT_EQ(eh.entryCount, ah.entryCount);
+
+        for (s32 bin = 0; bin < Bins; bin++)
+            ASSERT_EQ(eh.data[bin], ah.data[bin]);
+
+        if (eh.underflow)
+        {
+            ASSERT_EQ(*eh.underflow, *ah.underflow);
+            ASSERT_EQ(*eh.overflow, *ah.overflow);
+        }
+    }
+}
+
+void test_kernel(H1DFillKernel kernel)
+{
+    Arena arena(Megabytes(1));
+
+    auto expected = make_test_sink(&arena);
+    auto actual   = make_test_sink(&arena);
+
+    std::mt19937 gen(1234);
+    std::uniform_real_distribution<double> valueDist(-20.0, 120.0);
+    std::uniform_int_distribution<int> validDist(0, 3);
+
+    HistoFillDirect fill;
+
+    for (int event = 0; event < 10000; event++)
+    {
+        std::vector<double> input(Channels);
+
+        for (auto &x: input)
+            x = validDist(gen) ? valueDist(gen) : invalid_param();
+
+        // Exact bin edges
+        input[1] = expected->binMins[1];
+        input[2] = expected->binMaxs[2];
+
+        for (s32 i = 0; i < Channels; i++)
+            fill.fill_h1d(&expected->histos[i], input[i]);
+
+        kernel(actual->histos.data, input.data(), actual->binMins,
+               actual->binMaxs, actual->binFactors, Channels);
+    }
+
+    expect_equal_histos(expected, actual);
+}
+
+} // end anon namespace
+
+TEST(a2H1DFill, ScalarKernelMatchesHistoFillDirect)
+{
+    test_kernel(h1d_fill_scalar);
+}
+
+#ifdef A2_H1D_FILL_HAVE_X86_KERNELS
+TEST(a2H1DFill, SSE2KernelMatchesHistoFillDirect)
+{
+    if (!__builtin_cpu_supports("sse2"))
+        return;
+
+    test_kernel(h1d_fill_sse2);
+}
+
+TEST(a2H1DFill, AVX2KernelMatchesHistoFillDirect)
+{
+    if (!__builtin_cpu_supports("avx2"))
+        return;
+
+    test_kernel(h1d_fill_avx2);
+}
+#endif
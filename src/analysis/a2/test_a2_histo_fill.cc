@@ -0,0 +1,246 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "gtest/gtest.h"
+#include "a2.h"
+#include "a2_impl.h"
+#include "util/sizes.h"
+
+#include <random>
+
+using namespace a2;
+using namespace memory;
+
+namespace
+{
+
+static const s32 Channels = 16;
+static const s32 H1DBins = 1 << 12;
+static const s32 H2DBins = 1 << 10;
+
+struct SinkSetup
+{
+    std::vector<double> h1dData = std::vector<double>(Channels * H1DBins);
+    std::vector<double> h1dUnderflows = std::vector<double>(Channels);
+    std::vector<double> h1dOverflows = std::vector<double>(Channels);
+    std::vector<double> h1dIdxData = std::vector<double>(H1DBins);
+    std::vector<double> h2dData = std::vector<double>(H2DBins * H2DBins);
+
+    PipeVectors input;
+    A2 *a2;
+
+    H1DSinkData *h1dSink() const { return reinterpret_cast<H1DSinkData *>(a2->operators[0][0].d); }
+    H1DSinkData_idx *h1dSinkIdx() const { return reinterpret_cast<H1DSinkData_idx *>(a2->operators[0][1].d); }
+    H2DSinkData *h2dSink() const { return reinterpret_cast<H2DSinkData *>(a2->operators[0][2].d); }
+
+    // Builds an H1DSink, an H1DSink_idx and an H2DSink all connected to the
+    // same input pipe.
+    SinkSetup(Arena *arena, HistoFillStrategyType fillType)
+    {
+        a2 = arena->pushObject<A2>(arena);
+        a2->histoFillStrategy.setType(fillType);
+
+        input = {};
+        input.data = push_param_vector(arena, Channels, invalid_param());
+        input.lowerLimits = push_param_vector(arena, Channels, 0.0);
+        input.upperLimits = push_param_vector(arena, Channels, H1DBins);
+
+        std::vector<H1D> histos(Channels);
+
+        for (s32 i = 0; i < Channels; i++)
+        {
+            auto &h = histos[i];
+            h = {};
+            h.data = h1dData.data() + i * H1DBins;
+            h.size = H1DBins;
+            // Smaller than the data range to produce under- and overflows.
+            h.binning = { 10.0, H1DBins - 20.0 };
+            h.binningFactor = h.size / h.binning.range;
+            h.underflow = &h1dUnderflows[i];
+            h.overflow = &h1dOverflows[i];
+        }
+
+        H1D idxHisto = {};
+        idxHisto.data = h1dIdxData.data();
+        idxHisto.size = H1DBins;
+        idxHisto.binning = { 0.0, H1DBins };
+        idxHisto.binningFactor = 1.0;
+
+        H2D h2d = {};
+        h2d.data = h2dData.data();
+        h2d.size = H2DBins * H2DBins;
+        h2d.binCounts[H2D::XAxis] = H2DBins;
+        h2d.binCounts[H2D::YAxis] = H2DBins;
+        h2d.binnings[H2D::XAxis] = { 0.0, H1DBins };
+        h2d.binnings[H2D::YAxis] = { 0.0, H1DBins };
+        h2d.binningFactors[H2D::XAxis] = H2DBins / static_cast<double>(H1DBins);
+        h2d.binningFactors[H2D::YAxis] = H2DBins / static_cast<double>(H1DBins);
+
+        a2->operators[0] = arena->pushArray<Operator>(3);
+        a2->operatorRanks[0] = arena->pushArray<u8>(3);
+        a2->operators[0][0] = make_h1d_sink(arena, input, { histos.data(), Channels });
+        a2->operators[0][1] = make_h1d_sink_idx(arena, input, { &idxHisto, 1 }, 3);
+        a2->operators[0][2] = make_h2d_sink(arena, input, input, 0, 1, h2d);
+        a2->operatorCounts[0] = 3;
+
+        for (s32 i = 0; i < 3; i++)
+            a2->operatorRanks[0][i] = 1;
+    }
+
+    void step(const std::vector<double> &values)
+    {
+        std::copy(values.begin(), values.end(), input.data.data);
+        a2_begin_event(a2, 0);
+        a2_end_event(a2, 0);
+    }
+};
+
+std::vector<std::vector<double>> generate_events(size_t eventCount)
+{
+    std::mt19937 gen(42);
+    std::normal_distribution<double> valueDist(H1DBins * 0.5, H1DBins * 0.3);
+    std::uniform_int_distribution<int> validDist(0, 3);
+
+    std::vector<std::vector<double>> result(eventCount, std::vector<double>(Channels));
+
+    for (auto &values: result)
+        for (auto &x: values)
+            x = validDist(gen) ? valueDist(gen) : invalid_param();
+
+    return result;
+}
+
+void expect_equal_histos(const SinkSetup &expected, const SinkSetup &actual)
+{
+    ASSERT_EQ(expected.h1dData, actual.h1dData);
+    ASSERT_EQ(expected.h1dUnderflows, actual.h1dUnderflows);
+    ASSERT_EQ(expected.h1dOverflows, actual.h1dOverflows);
+    ASSERT_EQ(expected.h1dIdxData, actual.h1dIdxData);
+    ASSERT_EQ(expected.h2dData, actual.h2dData);
+
+    for (s32 i = 0; i < Channels; i++)
+        ASSERT_EQ(expected.h1dSink()->histos[i].entryCount, actual.h1dSink()->histos[i].entryCount);
+
+    ASSERT_EQ(expected.h1dSinkIdx()->histos[0].entryCount, actual.h1dSinkIdx()->histos[0].entryCount);
+    ASSERT_EQ(expected.h2dSink()->histo.entryCount, actual.h2dSink()->histo.entryCount);
+    ASSERT_EQ(expected.h2dSink()->histo.underflow, actual.h2dSink()->histo.underflow);
+    ASSERT_EQ(expected.h2dSink()->histo.overflow, actual.h2dSink()->histo.overflow);
+}
+
+} // end anon namespace
+
+TEST(a2HistoFill, BufferedMatchesDirect)
+{
+    Arena arena(Megabytes(1));
+    SinkSetup direct(&arena, HistoFillStrategyType::Direct);
+    SinkSetup buffered(&arena, HistoFillStrategyType::Buffered);
+
+    a2_begin_run(direct.a2, {});
+    a2_begin_run(buffered.a2, {});
+
+    ASSERT_EQ(direct.h1dSink()->fillBuffer, nullptr);
+    ASSERT_NE(buffered.h1dSink()->fillBuffer, nullptr);
+    ASSERT_NE(buffered.h1dSinkIdx()->fillBuffer, nullptr);
+    ASSERT_NE(buffered.h2dSink()->fillBuffer, nullptr);
+
+    // Enough events to fill the buffers multiple times.
+    for (const auto &values: generate_events(50000))
+    {
+        direct.step(values);
+        buffered.step(values);
+    }
+
+    a2_end_run(direct.a2);
+    a2_end_run(buffered.a2);
+
+    expect_equal_histos(direct, buffered);
+}
+
+TEST(a2HistoFill, BufferedIsFlushedOnTimetick)
+{
+    Arena arena(Megabytes(1));
+    SinkSetup direct(&arena, HistoFillStrategyType::Direct);
+    SinkSetup buffered(&arena, HistoFillStrategyType::Buffered);
+
+    a2_begin_run(direct.a2, {});
+    a2_begin_run(buffered.a2, {});
+
+    for (const auto &values: generate_events(100))
+    {
+        direct.step(values);
+        buffered.step(values);
+    }
+
+    // Not enough events to fill a buffer: nothing has been applied yet.
+    ASSERT_GT(direct.h2dSink()->histo.entryCount, 0.0);
+    ASSERT_EQ(buffered.h2dSink()->histo.entryCount, 0.0);
+
+    a2_timetick(buffered.a2);
+
+    expect_equal_histos(direct, buffered);
+}
+
+TEST(a2HistoFill, BufferedIsFlushedExplicitly)
+{
+    Arena arena(Megabytes(1));
+    SinkSetup direct(&arena, HistoFillStrategyType::Direct);
+    SinkSetup buffered(&arena, HistoFillStrategyType::Buffered);
+
+    a2_begin_run(direct.a2, {});
+    a2_begin_run(buffered.a2, {});
+
+    // Single stepping: each event must be visible after the flush.
+    for (const auto &values: generate_events(10))
+    {
+        direct.step(values);
+        buffered.step(values);
+        a2_flush_histograms(buffered.a2);
+
+        expect_equal_histos(direct, buffered);
+    }
+}
+
+TEST(a2HistoFill, SwitchingToDirectReleasesBuffers)
+{
+    Arena arena(Megabytes(1));
+    SinkSetup setup(&arena, HistoFillStrategyType::Buffered);
+
+    a2_begin_run(setup.a2, {});
+    ASSERT_NE(setup.h2dSink()->fillBuffer, nullptr);
+    ASSERT_STREQ(setup.a2->histoFillStrategy.name(), HistoFillBuffered::name());
+    a2_end_run(setup.a2);
+
+    setup.a2->histoFillStrategy.setType(HistoFillStrategyType::Direct);
+    a2_begin_run(setup.a2, {});
+    ASSERT_EQ(setup.h1dSink()->fillBuffer, nullptr);
+    ASSERT_EQ(setup.h1dSinkIdx()->fillBuffer, nullptr);
+    ASSERT_EQ(setup.h2dSink()->fillBuffer, nullptr);
+    ASSERT_STREQ(setup.a2->histoFillStrategy.name(), HistoFillDirect::name());
+
+    setup.step(generate_events(1)[0]);
+
+    double entries = 0.0;
+
+    for (const auto &histo: setup.h1dSink()->histos)
+        entries += histo.entryCount;
+
+    ASSERT_GT(entries, 0.0);
+    a2_end_run(setup.a2);
+}
@@ -0,0 +1,285 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "gtest/gtest.h"
+#include "a2.h"
+#include "a2_impl.h"
+#include "util/sizes.h"
+
+#include <cstring>
+#include <random>
+
+using namespace a2;
+using namespace memory;
+
+namespace
+{
+
+static const s32 Channels = 16;
+static const s32 Bins = 1 << 10;
+static const s32 OpCount = 8;
+
+PipeVectors output_pipe(const Operator &op)
+{
+    return { op.outputs[0], op.outputLowerLimits[0], op.outputUpperLimits[0] };
+}
+
+/* Operator layout:
+ *   0: Calibration(input)       -> chain A head
+ *   1: RangeFilter(0)
+ *   2: KeepPrevious(1)
+ *   3: H1DSink(2)               -> chain A tail
+ *   4: Calibration(input)       -> not fused: output consumed twice
+ *   5: H1DSink(4)
+ *   6: RangeFilter(4)           -> chain B head
+ *   7: Calibration(6)           -> chain B tail, output checked directly
+ *
+ * The outputs of 0, 1 and 6 are intermediate chain outputs.
+ */
+struct ChainSetup
+{
+    std::vector<double> histoData = std::vector<double>(2 * Channels * Bins);
+    std::vector<double> underflows = std::vector<double>(2 * Channels);
+    std::vector<double> overflows = std::vector<double>(2 * Channels);
+
+    PipeVectors input;
+    A2 *a2;
+
+    Operator *ops() const { return a2->operators[0]; }
+
+    TypedBlock<H1D, s32> make_histos(Arena *arena, s32 offset)
+    {
+        auto result = push_typed_block<H1D, s32>(arena, Channels);
+
+        for (s32 i = 0; i < Channels; i++)
+        {
+            auto &h = result[i];
+            h = {};
+            h.data = histoData.data() + (offset + i) * Bins;
+            h.size = Bins;
+            h.binning = { 0.0, 100.0 };
+            h.binningFactor = h.size / h.binning.range;
+            h.underflow = &underflows[offset + i];
+            h.overflow = &overflows[offset + i];
+        }
+
+        return result;
+    }
+
+    ChainSetup(Arena *arena)
+    {
+        a2 = arena->pushObject<A2>(arena);
+
+        input = {};
+        input.data = push_param_vector(arena, Channels, invalid_param());
+        input.lowerLimits = push_param_vector(arena, Channels, 0.0);
+        input.upperLimits = push_param_vector(arena, Channels, 1000.0);
+
+        a2->operators[0] = arena->pushArray<Operator>(OpCount);
+        a2->operatorRanks[0] = arena->pushArray<u8>(OpCount);
+        a2->operatorCounts[0] = OpCount;
+
+        auto ops = a2->operators[0];
+
+        ops[0] = make_calibration(arena, input, 0.0, 100.0);
+        ops[1] = make_range_filter(arena, output_pipe(ops[0]), { 10.0, 90.0 }, false);
+        ops[2] = make_keep_previous(arena, output_pipe(ops[1]), true);
+        ops[3] = make_h1d_sink(arena, output_pipe(ops[2]), make_histos(arena, 0));
+        ops[4] = make_calibration(arena, input, -50.0, 50.0);
+        ops[5] = make_h1d_sink(arena, output_pipe(ops[4]), make_histos(arena, Channels));
+        ops[6] = make_range_filter(arena, output_pipe(ops[4]), { -20.0, 20.0 }, true);
+        ops[7] = make_calibration(arena, output_pipe(ops[6]), 0.0, 1.0);
+
+        const u8 ranks[OpCount] = { 1, 2, 3, 4, 1, 2, 2, 3 };
+        std::copy(ranks, ranks + OpCount, a2->operatorRanks[0]);
+    }
+
+    void step(const std::vector<double> &values)
+    {
+        std::copy(values.begin(), values.end(), input.data.data);
+        a2_begin_event(a2, 0);
+        a2_end_event(a2, 0);
+    }
+};
+
+std::vector<std::vector<double>> generate_events(size_t eventCount)
+{
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> valueDist(0.0, 1000.0);
+    std::uniform_int_distribution<int> validDist(0, 3);
+
+    std::vector<std::vector<double>> result(eventCount, std::vector<double>(Channels));
+
+    for (auto &values: result)
+        for (auto &x: values)
+            x = validDist(gen) ? valueDist(gen) : invalid_param();
+
+    return result;
+}
+
+bool is_intermediate_output(s32 opIdx)
+{
+    return opIdx == 0 || opIdx == 1 || opIdx == 6;
+}
+
+bool same_bits(const ParamVec &a, const ParamVec &b)
+{
+    return a.size == b.size
+        && std::memcmp(a.data, b.data, a.size * sizeof(double)) == 0;
+}
+
+} // end anon namespace
+
+TEST(a2OperatorFusion, FindsChains)
+{
+    Arena arena(Megabytes(1));
+    ChainSetup setup(&arena);
+
+    auto report = a2_fuse_operators(setup.a2, &arena);
+
+    ASSERT_EQ(report.chains.size(), 2u);
+
+    ASSERT_EQ(report.chains[0].eventIndex, 0);
+    ASSERT_EQ(report.chains[0].operatorIndexes, (std::vector<s32>{ 0, 1, 2, 3 }));
+
+    ASSERT_EQ(report.chains[1].eventIndex, 0);
+    ASSERT_EQ(report.chains[1].operatorIndexes, (std::vector<s32>{ 6, 7 }));
+
+    auto fusion = setup.a2->operatorFusion[0];
+    ASSERT_NE(fusion, nullptr);
+    ASSERT_EQ(fusion[4], nullptr);
+    ASSERT_EQ(fusion[5], nullptr);
+    ASSERT_EQ(fusion[0], fusion[3]);
+    ASSERT_EQ(fusion[6], fusion[7]);
+
+    a2_unfuse_operators(setup.a2);
+    ASSERT_EQ(setup.a2->operatorFusion[0], nullptr);
+}
+
+TEST(a2OperatorFusion, DifferentConditionsAreNotFused)
+{
+    Arena arena(Megabytes(1));
+    ChainSetup setup(&arena);
+
+    setup.ops()[2].conditionIndex = 0;
+
+    auto report = a2_fuse_operators(setup.a2, &arena);
+
+    ASSERT_EQ(report.chains.size(), 2u);
+    ASSERT_EQ(report.chains[0].operatorIndexes, (std::vector<s32>{ 0, 1 }));
+    ASSERT_EQ(report.chains[1].operatorIndexes, (std::vector<s32>{ 6, 7 }));
+}
+
+TEST(a2OperatorFusion, FusedMatchesUnfused)
+{
+    for (auto fillType: { HistoFillStrategyType::Direct, HistoFillStrategyType::Buffered })
+    {
+        for (bool observed: { false, true })
+        {
+            Arena arena(Megabytes(4));
+            ChainSetup plain(&arena);
+            ChainSetup fused(&arena);
+
+            plain.a2->histoFillStrategy.setType(fillType);
+            fused.a2->histoFillStrategy.setType(fillType);
+
+            a2_fuse_operators(fused.a2, &arena);
+
+            for (s32 opIdx = 0; opIdx < OpCount; opIdx++)
+                a2_set_operator_output_observed(fused.a2, fused.ops() + opIdx, observed);
+
+            a2_begin_run(plain.a2, {});
+            a2_begin_run(fused.a2, {});
+
+            for (const auto &values: generate_events(20000))
+            {
+                plain.step(values);
+                fused.step(values);
+
+                // Intermediate outputs are only stored while observed.
+                for (s32 opIdx = 0; opIdx < OpCount; opIdx++)
+                {
+                    if (plain.ops()[opIdx].outputCount > 0
+                        && (observed || !is_intermediate_output(opIdx)))
+                    {
+                        ASSERT_TRUE(same_bits(plain.ops()[opIdx].outputs[0],
+                                              fused.ops()[opIdx].outputs[0])) << opIdx;
+                    }
+                }
+            }
+
+            a2_end_run(plain.a2);
+            a2_end_run(fused.a2);
+
+            ASSERT_EQ(plain.histoData, fused.histoData);
+            ASSERT_EQ(plain.underflows, fused.underflows);
+            ASSERT_EQ(plain.overflows, fused.overflows);
+        }
+    }
+}
+
+TEST(a2OperatorFusion, IntermediateOutputsAreStoredWhileObserved)
+{
+    Arena arena(Megabytes(1));
+    ChainSetup setup(&arena);
+
+    a2_fuse_operators(setup.a2, &arena);
+    a2_begin_run(setup.a2, {});
+
+    const auto &calibrated = setup.ops()[0].outputs[0];
+    const auto &filtered = setup.ops()[1].outputs[0];
+
+    // Calibration [0, 1000] -> [0, 100], then the range filter [10, 90).
+    std::vector<double> values(Channels, 500.0);
+    values[1] = 50.0;
+    setup.step(values);
+
+    ASSERT_FALSE(is_param_valid(calibrated[0]));
+    ASSERT_FALSE(is_param_valid(filtered[0]));
+
+    // KeepPrevious is the last elementwise stage of the chain. It outputs the
+    // values of the previous event.
+    ASSERT_FALSE(is_param_valid(setup.ops()[2].outputs[0][0]));
+    setup.step(values);
+    ASSERT_DOUBLE_EQ(setup.ops()[2].outputs[0][0], 50.0);
+
+    a2_set_operator_output_observed(setup.a2, setup.ops() + 0, true);
+    a2_set_operator_output_observed(setup.a2, setup.ops() + 1, true);
+    setup.step(values);
+
+    ASSERT_DOUBLE_EQ(calibrated[0], 50.0);
+    ASSERT_DOUBLE_EQ(filtered[0], 50.0);
+    ASSERT_DOUBLE_EQ(calibrated[1], 5.0);
+    ASSERT_FALSE(is_param_valid(filtered[1]));
+
+    // Unobserved outputs keep their last values.
+    a2_set_operator_output_observed(setup.a2, setup.ops() + 0, false);
+    values[0] = 100.0;
+    setup.step(values);
+
+    ASSERT_DOUBLE_EQ(calibrated[0], 50.0);
+    ASSERT_DOUBLE_EQ(filtered[0], 10.0);
+
+    // Operators outside of chains are not affected.
+    a2_set_operator_output_observed(setup.a2, setup.ops() + 4, false);
+    a2_set_operator_output_observed(setup.a2, setup.ops() + 5, true);
+
+    a2_end_run(setup.a2);
+}
@@ -0,0 +1,288 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "gtest/gtest.h"
+#include "a2.h"
+#include "a2_impl.h"
+#include "a2_parallel.h"
+#include "util/sizes.h"
+
+#include <random>
+
+using namespace a2;
+using namespace memory;
+
+namespace
+{
+
+static const s32 Bins = 16;
+static const s32 Channels = 16;
+
+// Storage for the histograms of one sequential or primary A2 instance.
+struct HistoStorage
+{
+    std::vector<double> h1dData = std::vector<double>(Channels * Bins);
+    std::vector<double> h1dUnderflows = std::vector<double>(Channels);
+    std::vector<double> h1dOverflows = std::vector<double>(Channels);
+    std::vector<double> h2dData = std::vector<double>(Bins * Bins);
+};
+
+// Builds: Extractor -> H1DSink[Channels] and Extractor[0], Extractor[1] -> H2DSink
+A2 *build_test_a2(Arena *arena, HistoStorage &storage)
+{
+    auto a2 = arena->pushObject<A2>(arena);
+
+    data_filter::MultiWordFilter filter = { data_filter::make_filter("xxxx aaaa xxxx dddd") };
+
+    a2->dataSources[0] = arena->pushArray<DataSource>(1);
+    a2->dataSources[0][0] = make_datasource_extractor(
+        arena,
+        filter,
+        0,      // requiredCompletions
+        1234,   // rngSeed
+        0,      // moduleIndex
+        DataSourceOptions::NoAddedRandom);
+    a2->dataSourceCounts[0] = 1;
+
+    const auto &extractorOutput = a2->dataSources[0][0].output;
+
+    std::vector<H1D> histos(Channels);
+
+    for (s32 i = 0; i < Channels; i++)
+    {
+        auto &h = histos[i];
+        h = {};
+        h.data = storage.h1dData.data() + i * Bins;
+        h.size = Bins;
+        // Upper range smaller than the data range to produce overflows.
+        h.binning = { 0.0, Bins - 2.0 };
+        h.binningFactor = h.size / h.binning.range;
+        h.underflow = &storage.h1dUnderflows[i];
+        h.overflow  = &storage.h1dOverflows[i];
+    }
+
+    H2D h2d = {};
+    h2d.data = storage.h2dData.data();
+    h2d.size = Bins * Bins;
+    h2d.binCounts[H2D::XAxis] = Bins;
+    h2d.binCounts[H2D::YAxis] = Bins;
+    h2d.binnings[H2D::XAxis] = { 0.0, Bins };
+    h2d.binnings[H2D::YAxis] = { 0.0, Bins };
+    h2d.binningFactors[H2D::XAxis] = 1.0;
+    h2d.binningFactors[H2D::YAxis] = 1.0;
+
+    a2->operators[0] = arena->pushArray<Operator>(2);
+    a2->operatorRanks[0] = arena->pushArray<u8>(2);
+    a2->operators[0][0] = make_h1d_sink(arena, extractorOutput, { histos.data(), Channels });
+    a2->operators[0][1] = make_h2d_sink(arena, extractorOutput, extractorOutput, 0, 1, h2d);
+    a2->operatorRanks[0][0] = 1;
+    a2->operatorRanks[0][1] = 1;
+    a2->operatorCounts[0] = 2;
+
+    return a2;
+}
+
+std::vector<std::vector<u32>> generate_events(size_t eventCount)
+{
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<u32> wordCountDist(0, 8);
+    std::uniform_int_distribution<u32> nibbleDist(0, 15);
+
+    std::vector<std::vector<u32>> result(eventCount);
+
+    for (auto &event: result)
+    {
+        auto wordCount = wordCountDist(gen);
+
+        for (u32 wi = 0; wi < wordCount; wi++)
+            event.push_back((nibbleDist(gen) << 8) | nibbleDist(gen));
+    }
+
+    return result;
+}
+
+} // end anon namespace
+
+TEST(a2Parallel, ShardedResultMatchesSequential)
+{
+    const auto events = generate_events(10000);
+
+    // sequential reference
+    Arena seqArena(Kilobytes(256));
+    HistoStorage seqStorage;
+    auto seqA2 = build_test_a2(&seqArena, seqStorage);
+
+    for (const auto &event: events)
+    {
+        a2_begin_event(seqA2, 0);
+        a2_process_module_data(seqA2, 0, 0, event.data(), event.size());
+        a2_end_event(seqA2, 0);
+    }
+
+    // parallel: a primary instance holding the real histograms plus sharded
+    // worker instances
+    Arena primaryArena(Kilobytes(256));
+    HistoStorage primaryStorage;
+    auto primaryA2 = build_test_a2(&primaryArena, primaryStorage);
+
+    ASSERT_TRUE(a2_can_run_in_parallel(primaryA2));
+
+    const size_t WorkerCount = 3;
+    std::vector<std::unique_ptr<Arena>> workerArenas;
+    std::vector<HistoStorage> workerStorage(WorkerCount);
+    std::vector<A2 *> workers;
+
+    for (size_t i = 0; i < WorkerCount; i++)
+    {
+        workerArenas.emplace_back(std::make_unique<Arena>(Kilobytes(256)));
+        auto a2 = build_test_a2(workerArenas.back().get(), workerStorage[i]);
+        a2_shard_histograms(a2, workerArenas.back().get());
+        workers.push_back(a2);
+    }
+
+    {
+        // Small batches to make sure multiple batches are in flight.
+        A2WorkerPool pool(workers, 7);
+
+        for (size_t ei = 0; ei < events.size(); ei++)
+        {
+            const auto &event = events[ei];
+            pool.beginEvent(0);
+            pool.processModuleData(0, 0, event.data(), event.size());
+            pool.endEvent(0);
+
+            // merge in between to simulate timeticks
+            if (ei == events.size() / 2)
+            {
+                pool.sync();
+
+                for (auto worker: workers)
+                    a2_merge_histograms(primaryA2, worker);
+            }
+        }
+
+        pool.sync();
+
+        for (auto worker: workers)
+            a2_merge_histograms(primaryA2, worker);
+    }
+
+    ASSERT_EQ(seqStorage.h1dData, primaryStorage.h1dData);
+    ASSERT_EQ(seqStorage.h1dUnderflows, primaryStorage.h1dUnderflows);
+    ASSERT_EQ(seqStorage.h1dOverflows, primaryStorage.h1dOverflows);
+    ASSERT_EQ(seqStorage.h2dData, primaryStorage.h2dData);
+
+    // The histogram storage the worker instances were built with must not
+    // have been touched.
+    for (const auto &storage: workerStorage)
+    {
+        for (double d: storage.h1dData)
+            ASSERT_EQ(d, 0.0);
+    }
+
+    auto seqH1D = reinterpret_cast<H1DSinkData *>(seqA2->operators[0][0].d);
+    auto primaryH1D = reinterpret_cast<H1DSinkData *>(primaryA2->operators[0][0].d);
+
+    for (s32 i = 0; i < Channels; i++)
+        ASSERT_EQ(seqH1D->histos[i].entryCount, primaryH1D->histos[i].entryCount);
+
+    auto seqH2D = reinterpret_cast<H2DSinkData *>(seqA2->operators[0][1].d);
+    auto primaryH2D = reinterpret_cast<H2DSinkData *>(primaryA2->operators[0][1].d);
+
+    ASSERT_EQ(seqH2D->histo.entryCount, primaryH2D->histo.entryCount);
+}
+
+TEST(a2Parallel, OrderDependentOperatorsPreventParallelism)
+{
+    Arena arena(Kilobytes(256));
+    HistoStorage storage;
+    auto a2 = build_test_a2(&arena, storage);
+
+    ASSERT_TRUE(a2_can_run_in_parallel(a2));
+
+    a2->operators[0][1] = make_keep_previous(&arena, a2->dataSources[0][0].output, false);
+
+    ASSERT_FALSE(a2_can_run_in_parallel(a2));
+}
+
+TEST(a2Parallel, MergeHitCounts)
+{
+    const auto events = generate_events(1000);
+
+    Arena arena(Kilobytes(256));
+    HistoStorage seqStorage, primaryStorage, shardStorage;
+    auto seqA2 = build_test_a2(&arena, seqStorage);
+    auto primaryA2 = build_test_a2(&arena, primaryStorage);
+    auto shardA2 = build_test_a2(&arena, shardStorage);
+
+    // The shard processes the second half of the events on its own.
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        const auto &event = events[i];
+        auto a2 = i < events.size() / 2 ? primaryA2 : shardA2;
+
+        for (auto dest: { seqA2, a2 })
+        {
+            a2_begin_event(dest, 0);
+            a2_process_module_data(dest, 0, 0, event.data(), event.size());
+            a2_end_event(dest, 0);
+        }
+    }
+
+    a2_merge_hit_counts(primaryA2, shardA2);
+
+    const auto &seqHits = seqA2->dataSources[0][0].hitCounts;
+    const auto &primaryHits = primaryA2->dataSources[0][0].hitCounts;
+    const auto &shardHits = shardA2->dataSources[0][0].hitCounts;
+
+    ASSERT_EQ(seqHits.size, primaryHits.size);
+
+    for (s32 i = 0; i < seqHits.size; i++)
+    {
+        ASSERT_EQ(seqHits[i], primaryHits[i]);
+        ASSERT_EQ(shardHits[i], 0.0);
+    }
+}
+
+TEST(a2Parallel, LayoutsMatch)
+{
+    Arena arena(Kilobytes(256));
+    HistoStorage storageA, storageB;
+    auto a = build_test_a2(&arena, storageA);
+    auto b = build_test_a2(&arena, storageB);
+
+    ASSERT_TRUE(a2_layouts_match(a, b));
+
+    // Swapped operator order as produced by an incremental rebuild appending
+    // new sinks.
+    std::swap(b->operators[0][0], b->operators[0][1]);
+    ASSERT_FALSE(a2_layouts_match(a, b));
+    std::swap(b->operators[0][0], b->operators[0][1]);
+
+    // Differing histogram count.
+    auto h1dData = reinterpret_cast<H1DSinkData *>(b->operators[0][0].d);
+    h1dData->histos.size--;
+    ASSERT_FALSE(a2_layouts_match(a, b));
+    h1dData->histos.size++;
+
+    // Differing operator count.
+    b->operatorCounts[0]--;
+    ASSERT_FALSE(a2_layouts_match(a, b));
+}
@@ -0,0 +1,128 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "gtest/gtest.h"
+#include "a2.h"
+#include "a2_impl.h"
+#include "util/sizes.h"
+
+using namespace a2;
+using namespace memory;
+
+namespace
+{
+
+static const s32 Channels = 16;
+static const s32 OpCount = 3;
+
+PipeVectors output_pipe(const Operator &op)
+{
+    return { op.outputs[0], op.outputLowerLimits[0], op.outputUpperLimits[0] };
+}
+
+A2 *make_test_a2(Arena *arena)
+{
+    auto a2 = arena->pushObject<A2>(arena);
+    a2->conditionBits.resize(1);
+
+    PipeVectors input = {};
+    input.data = push_param_vector(arena, Channels, 1.0);
+    input.lowerLimits = push_param_vector(arena, Channels, 0.0);
+    input.upperLimits = push_param_vector(arena, Channels, 10.0);
+
+    a2->operators[0] = arena->pushArray<Operator>(OpCount);
+    a2->operatorRanks[0] = arena->pushArray<u8>(OpCount);
+    a2->operatorCounts[0] = OpCount;
+
+    auto ops = a2->operators[0];
+
+    ops[0] = make_calibration(arena, input, 0.0, 100.0);
+    ops[1] = make_calibration(arena, output_pipe(ops[0]), 0.0, 1.0);
+    ops[2] = make_calibration(arena, input, 0.0, 1.0);
+    ops[2].conditionIndex = 0;
+
+    const u8 ranks[OpCount] = { 1, 2, 1 };
+    std::copy(ranks, ranks + OpCount, a2->operatorRanks[0]);
+
+    return a2;
+}
+
+} // end anon namespace
+
+TEST(a2Profiling, CountsSteps)
+{
+    Arena arena(Kilobytes(64));
+    auto a2 = make_test_a2(&arena);
+
+    // Disabled by default.
+    ASSERT_EQ(a2->operatorProfiles[0], nullptr);
+
+    a2_enable_profiling(a2, &arena);
+
+    ASSERT_NE(a2->operatorProfiles[0], nullptr);
+    ASSERT_EQ(a2->operatorProfiles[1], nullptr);
+
+    const int EventCount = 1000;
+
+    for (int event = 0; event < EventCount; event++)
+    {
+        a2->conditionBits.set(0, event % 4 == 0);
+        a2_begin_event(a2, 0);
+        a2_end_event(a2, 0);
+    }
+
+    auto profiles = a2->operatorProfiles[0];
+
+    ASSERT_EQ(profiles[0].stepCount, EventCount);
+    ASSERT_EQ(profiles[0].condSkipCount, 0u);
+    ASSERT_GT(profiles[0].time, 0u);
+
+    ASSERT_EQ(profiles[1].stepCount, EventCount);
+
+    ASSERT_EQ(profiles[2].stepCount, EventCount / 4);
+    ASSERT_EQ(profiles[2].condSkipCount, EventCount - EventCount / 4);
+
+    auto other = make_test_a2(&arena);
+    a2_enable_profiling(other, &arena);
+
+    a2_begin_event(other, 0);
+    a2_end_event(other, 0);
+
+    a2_merge_profiling(a2, other);
+
+    ASSERT_EQ(profiles[0].stepCount, EventCount + 1);
+    ASSERT_EQ(profiles[2].condSkipCount, EventCount - EventCount / 4 + 1);
+
+    a2_reset_profiling(a2);
+
+    for (s32 i = 0; i < OpCount; i++)
+    {
+        ASSERT_EQ(profiles[i].time, 0u);
+        ASSERT_EQ(profiles[i].stepCount, 0u);
+        ASSERT_EQ(profiles[i].condSkipCount, 0u);
+    }
+
+    a2_disable_profiling(a2);
+    ASSERT_EQ(a2->operatorProfiles[0], nullptr);
+
+    a2_begin_event(a2, 0);
+    a2_end_event(a2, 0);
+    ASSERT_EQ(profiles[0].stepCount, 0u);
+}
@@ -0,0 +1,257 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "gtest/gtest.h"
+#include "a2.h"
+#include "a2_impl.h"
+#include "util/sizes.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+
+using namespace a2;
+using namespace data_filter;
+using namespace memory;
+
+namespace
+{
+
+static const s32 Channels = 16;
+static const s32 Bins = 1 << 10;
+static const s32 OpCount = 5;
+
+PipeVectors output_pipe(const Operator &op)
+{
+    return { op.outputs[0], op.outputLowerLimits[0], op.outputUpperLimits[0] };
+}
+
+/* Two extractors with 16 channels each and the operators
+ *   0: Calibration(ds0)
+ *   1: H1DSink(0)
+ *   2: H1DSink(ds1)
+ *   3: Calibration(ds1) with condition bit 0
+ *   4: ExportSinkSparse(ds0, 0, 3)
+ */
+struct SourceSetup
+{
+    std::vector<double> histoData = std::vector<double>(2 * Channels * Bins);
+    std::vector<double> underflows = std::vector<double>(2 * Channels);
+    std::vector<double> overflows = std::vector<double>(2 * Channels);
+
+    A2 *a2;
+
+    Operator *ops() const { return a2->operators[0]; }
+    DataSource *sources() const { return a2->dataSources[0]; }
+
+    TypedBlock<H1D, s32> make_histos(Arena *arena, s32 offset)
+    {
+        auto result = push_typed_block<H1D, s32>(arena, Channels);
+
+        for (s32 i = 0; i < Channels; i++)
+        {
+            auto &h = result[i];
+            h = {};
+            h.data = histoData.data() + (offset + i) * Bins;
+            h.size = Bins;
+            h.binning = { 0.0, 100.0 };
+            h.binningFactor = h.size / h.binning.range;
+            h.underflow = &underflows[offset + i];
+            h.overflow = &overflows[offset + i];
+        }
+
+        return result;
+    }
+
+    SourceSetup(Arena *arena, const std::string &exportFilename)
+    {
+        a2 = arena->pushObject<A2>(arena);
+        a2->conditionBits.resize(1);
+
+        a2->dataSources[0] = arena->pushArray<DataSource>(2);
+        a2->dataSourceCounts[0] = 2;
+
+        a2->dataSources[0][0] = make_datasource_extractor(
+            arena, { make_filter("0001 XXXX XX00 AAAA DDDD DDDD DDDD DDDD") }, 1, 1234, 0,
+            DataSourceOptions::NoAddedRandom);
+
+        a2->dataSources[0][1] = make_datasource_extractor(
+            arena, { make_filter("0001 XXXX XX01 AAAA DDDD DDDD DDDD DDDD") }, 1, 1235, 0,
+            DataSourceOptions::NoAddedRandom);
+
+        a2->operators[0] = arena->pushArray<Operator>(OpCount);
+        a2->operatorRanks[0] = arena->pushArray<u8>(OpCount);
+        a2->operatorCounts[0] = OpCount;
+
+        auto ops = a2->operators[0];
+
+        ops[0] = make_calibration(arena, sources()[0].output, 0.0, 100.0);
+        ops[1] = make_h1d_sink(arena, output_pipe(ops[0]), make_histos(arena, 0));
+        ops[2] = make_h1d_sink(arena, sources()[1].output, make_histos(arena, Channels));
+        ops[3] = make_calibration(arena, sources()[1].output, -1.0, 1.0);
+        ops[3].conditionIndex = 0;
+
+        auto exportInputs = push_typed_block<PipeVectors, s32>(arena, 3);
+        exportInputs[0] = sources()[0].output;
+        exportInputs[1] = output_pipe(ops[0]);
+        exportInputs[2] = output_pipe(ops[3]);
+
+        ops[4] = make_export_sink(arena, exportFilename, 0, ExportSinkFormat::Sparse,
+                                  exportInputs);
+
+        const u8 ranks[OpCount] = { 1, 2, 1, 1, 2 };
+        std::copy(ranks, ranks + OpCount, a2->operatorRanks[0]);
+    }
+
+    void step(const std::vector<u32> &data, bool condition)
+    {
+        a2_begin_event(a2, 0);
+        a2_process_module_data(a2, 0, 0, data.data(), data.size());
+        a2->conditionBits.set(0, condition);
+        a2_end_event(a2, 0);
+    }
+};
+
+std::vector<u32> generate_module_data(std::mt19937 &gen)
+{
+    std::uniform_int_distribution<u32> sizeDist(0, 8);
+    std::uniform_int_distribution<u32> typeDist(0, 1);
+    std::uniform_int_distribution<u32> addressDist(0, Channels - 1);
+    std::uniform_int_distribution<u32> valueDist(0, 0xffff);
+
+    std::vector<u32> result;
+    const u32 size = sizeDist(gen);
+
+    for (u32 wi = 0; wi < size; wi++)
+    {
+        result.push_back(0x10000000 | (typeDist(gen) << 20)
+                         | (addressDist(gen) << 16) | valueDist(gen));
+    }
+
+    return result;
+}
+
+bool same_bits(const ParamVec &a, const ParamVec &b)
+{
+    return a.size == b.size
+        && std::memcmp(a.data, b.data, a.size * sizeof(double)) == 0;
+}
+
+std::string read_file(const std::string &filename)
+{
+    std::ifstream in(filename, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+} // end anon namespace
+
+TEST(a2ValidIndexes, PushKeepsOrder)
+{
+    Arena arena(Kilobytes(4));
+    auto valid = push_valid_indexes(&arena, 8);
+
+    ASSERT_EQ(valid->count, 0);
+
+    for (s32 idx: { 3, 5, 1, 7, 0, 4 })
+        push_valid_index(valid, idx);
+
+    ASSERT_EQ(valid->count, 6);
+    ASSERT_EQ(std::vector<s32>(valid->indexes, valid->indexes + valid->count),
+              (std::vector<s32>{ 0, 1, 3, 4, 5, 7 }));
+
+    auto pv = push_param_vector(&arena, 8, 1.0);
+    invalidate_valid(pv, valid);
+
+    ASSERT_EQ(valid->count, 0);
+
+    for (s32 i = 0; i < pv.size; i++)
+        ASSERT_EQ(is_param_valid(pv[i]), i == 2 || i == 6);
+}
+
+TEST(a2ValidIndexes, SparseMatchesDense)
+{
+    for (auto fillType: { HistoFillStrategyType::Direct, HistoFillStrategyType::Buffered })
+    {
+        const std::string denseFilename = "test_a2_valid_indexes_dense.bin";
+        const std::string sparseFilename = "test_a2_valid_indexes_sparse.bin";
+
+        {
+            Arena arena(Megabytes(1));
+            SourceSetup dense(&arena, denseFilename);
+            SourceSetup sparse(&arena, sparseFilename);
+
+            dense.a2->histoFillStrategy.setType(fillType);
+            sparse.a2->histoFillStrategy.setType(fillType);
+
+            a2_link_valid_indexes(sparse.a2, &arena);
+
+            ASSERT_NE(sparse.sources()[0].validIndexes, nullptr);
+            ASSERT_NE(sparse.sources()[1].validIndexes, nullptr);
+
+            auto logger = [] (const std::string &msg) { std::cout << msg << std::endl; };
+
+            a2_begin_run(dense.a2, logger);
+            a2_begin_run(sparse.a2, logger);
+
+            std::mt19937 gen(42);
+            std::bernoulli_distribution condDist(0.5);
+
+            for (int event = 0; event < 20000; event++)
+            {
+                auto data = generate_module_data(gen);
+                bool condition = condDist(gen);
+
+                dense.step(data, condition);
+                sparse.step(data, condition);
+
+                for (s32 si = 0; si < 2; si++)
+                {
+                    ASSERT_TRUE(same_bits(dense.sources()[si].output.data,
+                                          sparse.sources()[si].output.data));
+                }
+
+                ASSERT_TRUE(same_bits(dense.ops()[0].outputs[0], sparse.ops()[0].outputs[0]));
+                ASSERT_TRUE(same_bits(dense.ops()[3].outputs[0], sparse.ops()[3].outputs[0]));
+            }
+
+            a2_end_run(dense.a2);
+            a2_end_run(sparse.a2);
+
+            ASSERT_EQ(dense.histoData, sparse.histoData);
+            ASSERT_EQ(dense.underflows, sparse.underflows);
+            ASSERT_EQ(dense.overflows, sparse.overflows);
+
+            a2_unlink_valid_indexes(sparse.a2);
+            ASSERT_EQ(sparse.sources()[0].validIndexes, nullptr);
+        }
+
+        auto denseExport = read_file(denseFilename);
+        auto sparseExport = read_file(sparseFilename);
+
+        ASSERT_FALSE(denseExport.empty());
+        ASSERT_EQ(denseExport, sparseExport);
+
+        std::remove(denseFilename.c_str());
+        std::remove(sparseFilename.c_str());
+    }
+}
@@ -2,6 +2,7 @@
 #include "a2.h"
 #include "a2/a2_impl.h"
 #include "analysis.h"
+#include "analysis_util.h"
 
 #include <algorithm>
 #include <cstdio>
@@ -632,6 +633,16 @@ DEF_OP_MAGIC(histo1d_sink_magic)
 
         a2::H1D a2_histo = {};
         a2_histo.data = histo->data();
+        if (auto compact = histo->getCompactBins())
+        {
+            a2_histo.data32 = compact->data32();
+            a2_histo.compact = compact;
+        }
+        if (auto tiles = histo->getTileGenerations())
+        {
+            a2_histo.tileGenerations = tiles->data();
+            a2_histo.tileShift = tiles->tileShift();
+        }
         a2_histo.size = histo->getNumberOfBins();
         a2_histo.binning.min = histo->getXMin();
         a2_histo.binning.range = histo->getXMax() - histo->getXMin();
@@ -703,6 +714,16 @@ DEF_OP_MAGIC(histo2d_sink_magic)
     a2::H2D a2_histo = {};
 
     a2_histo.data = histo->data();
+    if (auto compact = histo->getCompactBins())
+    {
+        a2_histo.data32 = compact->data32();
+        a2_histo.compact = compact;
+    }
+    if (auto tiles = histo->getTileGenerations())
+    {
+        a2_histo.tileGenerations = tiles->data();
+        a2_histo.tileShift = tiles->tileShift();
+    }
     a2_histo.size = binnings[H2D::XAxis].getBins() * binnings[H2D::YAxis].getBins();
 
     for (s32 axis = 0; axis < H2D::AxisCount; axis++)
@@ -1099,6 +1120,9 @@ void a2_adapter_build_datasources(
             ds_cnt++;
         }
     }
+
+    // Combined single pass processing of the Extractors of each module.
+    a2::a2_build_extractor_dispatch(state->a2, arena);
 }
 
 struct OperatorInfo
@@ -1160,6 +1184,61 @@ bool has_input_from_error_set(const OperatorPtr &op,
     return result;
 }
 
+/* Creates the a2 operator for the given analysis operator and sets up its
+ * condition bit indexes. Returns an operator of type
+ * a2::Invalid_OperatorType if the adapter function did not produce a valid
+ * operator. Exceptions thrown by the adapter function are passed on. */
+a2::Operator a2_adapter_make_operator(
+    memory::Arena *arena,
+    A2AdapterState *state,
+    const OperatorPtr &op,
+    const RunInfo &runInfo)
+{
+    auto a2_op = a2_adapter_magic(arena, state, op, runInfo);
+
+    assert(a2_op.conditionIndex == a2::Operator::NoCondition);
+
+    if (a2::Invalid_OperatorType == a2_op.type || a2_op.type >= a2::OperatorTypeCount)
+    {
+        a2_op.type = a2::Invalid_OperatorType;
+        return a2_op;
+    }
+
+    /* If the operator is a condition set the index of the first bit to
+     * write when evaluating the condition.
+     * This is part of the active side where the condition bit is
+     * written to. */
+    if (auto a1_cond = qobject_cast<ConditionInterface *>(op.get()))
+    {
+        assert(is_condition_operator(a2_op));
+
+        auto d = reinterpret_cast<a2::ConditionBaseData *>(a2_op.d);
+
+        /* It's not an error if the bit index is not setup yet as it's
+         * only known during the second pass build phase. */
+        if (state->conditionBitIndexes.contains(a1_cond))
+        {
+            d->firstBitIndex = state->conditionBitIndexes.value(a1_cond);
+        }
+    }
+
+    /* Check for active condition and set the corresponding bit index
+     * on the operator.
+     * This is part of the passive side where a condition has to be
+     * checked. */
+    if (auto link = state->a1->getConditionLink(op))
+    {
+        // Check if the conditions bit index is known
+        if (state->conditionBitIndexes.contains(link.condition.get()))
+        {
+            a2_op.conditionIndex =
+                state->conditionBitIndexes.value(link.condition.get()) + link.subIndex;
+        }
+    }
+
+    return a2_op;
+}
+
 void a2_adapter_build_single_operator(
     memory::Arena *arena,
     A2AdapterState *state,
@@ -1204,44 +1283,10 @@ void a2_adapter_build_single_operator(
 
     try
     {
-        auto a2_op = a2_adapter_magic(arena, state, opInfo.op, runInfo);
+        auto a2_op = a2_adapter_make_operator(arena, state, opInfo.op, runInfo);
 
-        assert(a2_op.conditionIndex == a2::Operator::NoCondition);
-
-        if (a2::Invalid_OperatorType != a2_op.type && a2_op.type < a2::OperatorTypeCount)
+        if (a2::Invalid_OperatorType != a2_op.type)
         {
-            /* If the operator is a condition set the index of the first bit to
-             * write when evaluating the condition.
-             * This is part of the active side where the condition bit is
-             * written to. */
-            if (auto a1_cond = qobject_cast<ConditionInterface *>(opInfo.op.get()))
-            {
-                assert(is_condition_operator(a2_op));
-
-                auto d = reinterpret_cast<a2::ConditionBaseData *>(a2_op.d);
-
-                /* It's not an error if the bit index is not setup yet as it's
-                 * only known during the second pass build phase. */
-                if (state->conditionBitIndexes.contains(a1_cond))
-                {
-                    d->firstBitIndex = state->conditionBitIndexes.value(a1_cond);
-                }
-            }
-
-            /* Check for active condition and set the corresponding bit index
-             * on the operator.
-             * This is part of the passive side where a condition has to be
-             * checked. */
-            if (auto link = state->a1->getConditionLink(opInfo.op))
-            {
-                // Check if the conditions bit index is known
-                if (state->conditionBitIndexes.contains(link.condition.get()))
-                {
-                    a2_op.conditionIndex =
-                        state->conditionBitIndexes.value(link.condition.get()) + link.subIndex;
-                }
-            }
-
             opInfo.a2OperatorType = a2_op.type;
             u8 &opCount = state->a2->operatorCounts[eventIndex];
 
@@ -1642,4 +1687,243 @@ A2AdapterState a2_adapter_build(
     return result;
 }
 
+namespace
+{
+
+struct OperatorSlot
+{
+    s32 eventIndex = -1;
+    s32 opIndex = -1;
+};
+
+/* Returns the position of the given operator in the A2 operator arrays. */
+OperatorSlot find_operator_slot(const a2::A2 *a2, const a2::Operator *a2_op)
+{
+    for (s32 ei = 0; ei < a2::MaxVMEEvents; ei++)
+    {
+        const a2::Operator *ops = a2->operators[ei];
+
+        if (ops && ops <= a2_op && a2_op < ops + a2->operatorCounts[ei])
+            return { ei, static_cast<s32>(a2_op - ops) };
+    }
+
+    return {};
+}
+
+} // end anon namespace
+
+A2AdapterRebuildResult a2_adapter_rebuild_operators(
+    memory::Arena *arena,
+    A2AdapterState *state,
+    const QSet<OperatorInterface *> &changedOperators,
+    const analysis::OperatorVector &operators,
+    const vme_analysis_common::VMEIdToIndex &vmeMap,
+    const RunInfo &runInfo,
+    a2::Logger logger)
+{
+    A2AdapterRebuildResult result = {};
+
+    assert(state->a1);
+    assert(state->a2);
+
+    // Error handling, i.e. removing dependents of failed operators, is only
+    // done by the full build.
+    if (!state->operatorErrors.isEmpty())
+        return result;
+
+    auto filteredOperators = a2_adapter_filter_operators(operators);
+
+    // Every operator of the existing build has to be part of the new build.
+    // Removing operators would require compacting the operator arrays.
+    {
+        QSet<OperatorInterface *> filteredSet;
+
+        for (const auto &op: filteredOperators)
+            filteredSet.insert(op.get());
+
+        for (auto a1_op: state->operatorMap.hash.keys())
+        {
+            if (!filteredSet.contains(a1_op))
+                return result;
+        }
+    }
+
+    // Rebuilding an operator allocates new output vectors so all operators
+    // consuming those outputs have to be rebuilt too.
+    QSet<OperatorInterface *> toRebuild;
+
+    for (auto op: changedOperators)
+    {
+        toRebuild.insert(op);
+        collect_dependent_operators(op, toRebuild);
+    }
+
+    struct Replacement
+    {
+        OperatorPtr op;
+        a2::Operator *dest;
+        a2::Operator previous;
+    };
+
+    std::vector<Replacement> replacements;
+    std::array<QVector<OperatorPtr>, a2::MaxVMEEvents> newSinks;
+
+    for (const auto &op: filteredOperators)
+    {
+        const s32 eventIndex = vmeMap.value(op->getEventId()).eventIndex;
+
+        assert(eventIndex < a2::MaxVMEEvents);
+
+        if (auto a2_op = state->operatorMap.value(op.get(), nullptr))
+        {
+            if (!toRebuild.contains(op.get()))
+                continue;
+
+            auto slot = find_operator_slot(state->a2, a2_op);
+
+            if (slot.eventIndex != eventIndex
+                || state->a2->operatorRanks[eventIndex][slot.opIndex] != op->getRank())
+            {
+                return result;
+            }
+
+            replacements.push_back({ op, a2_op, *a2_op });
+        }
+        else if (is_sink(op))
+        {
+            if (state->a2->operatorCounts[eventIndex] + newSinks[eventIndex].size()
+                >= std::numeric_limits<u8>::max())
+            {
+                return result;
+            }
+
+            newSinks[eventIndex].push_back(op);
+        }
+        else
+        {
+            return result;
+        }
+    }
+
+    auto restore = [&replacements] ()
+    {
+        for (auto &r: replacements)
+            *r.dest = r.previous;
+    };
+
+    // Replace operators in rank order. The replacement is installed right
+    // away so that dependent operators pick up the new output vectors via
+    // find_output_pipe().
+    for (auto &r: replacements)
+    {
+        a2::Operator a2_op = {};
+
+        try
+        {
+            a2_op = a2_adapter_make_operator(arena, state, r.op, runInfo);
+        }
+        catch (const std::runtime_error &)
+        {
+            a2_op.type = a2::Invalid_OperatorType;
+        }
+
+        if (a2_op.type == a2::Invalid_OperatorType
+            || is_condition_operator(a2_op) != is_condition_operator(r.previous)
+            || (is_condition_operator(a2_op)
+                && (get_number_of_condition_bits_used(a2_op)
+                    != get_number_of_condition_bits_used(r.previous))))
+        {
+            restore();
+            return result;
+        }
+
+        *r.dest = a2_op;
+    }
+
+    std::array<QVector<a2::Operator>, a2::MaxVMEEvents> newSinkOps;
+
+    for (s32 ei = 0; ei < a2::MaxVMEEvents; ei++)
+    {
+        for (const auto &op: newSinks[ei])
+        {
+            a2::Operator a2_op = {};
+
+            try
+            {
+                a2_op = a2_adapter_make_operator(arena, state, op, runInfo);
+            }
+            catch (const std::runtime_error &)
+            {
+                a2_op.type = a2::Invalid_OperatorType;
+            }
+
+            if (a2_op.type == a2::Invalid_OperatorType)
+            {
+                restore();
+                return result;
+            }
+
+            newSinkOps[ei].push_back(a2_op);
+        }
+    }
+
+    // Success. From here on the build is modified.
+
+    for (auto &r: replacements)
+    {
+        a2::a2_end_run_operator(&r.previous);
+        a2::a2_begin_run_operator(r.dest, logger);
+    }
+
+    // Append new sinks by moving the operators of the event into larger
+    // arrays. Operators are stepped in array order and sinks have no
+    // dependents so appending keeps the rank order requirement intact.
+    for (s32 ei = 0; ei < a2::MaxVMEEvents; ei++)
+    {
+        if (newSinks[ei].isEmpty())
+            continue;
+
+        const s32 oldCount = state->a2->operatorCounts[ei];
+        const s32 newCount = oldCount + newSinks[ei].size();
+
+        auto ops   = arena->pushArray<a2::Operator>(newCount);
+        auto ranks = arena->pushArray<u8>(newCount);
+
+        std::copy(state->a2->operators[ei], state->a2->operators[ei] + oldCount, ops);
+        std::copy(state->a2->operatorRanks[ei], state->a2->operatorRanks[ei] + oldCount, ranks);
+
+        for (s32 i = 0; i < oldCount; i++)
+        {
+            auto a1_op = state->operatorMap.value(state->a2->operators[ei] + i, nullptr);
+            assert(a1_op);
+            state->operatorMap.remove(a1_op);
+            state->operatorMap.insert(a1_op, ops + i);
+        }
+
+        for (s32 i = 0; i < newSinks[ei].size(); i++)
+        {
+            const s32 opIndex = oldCount + i;
+            ops[opIndex] = newSinkOps[ei][i];
+            ranks[opIndex] = newSinks[ei][i]->getRank();
+            state->operatorMap.insert(newSinks[ei][i].get(), ops + opIndex);
+            a2::a2_begin_run_operator(ops + opIndex, logger);
+        }
+
+        state->a2->operators[ei] = ops;
+        state->a2->operatorRanks[ei] = ranks;
+        state->a2->operatorCounts[ei] = newCount;
+
+        result.sinksAdded += newSinks[ei].size();
+    }
+
+    // Reassign histogram fill buffers as sink data has been replaced.
+    state->a2->histoFillStrategy.end_run(state->a2);
+    state->a2->histoFillStrategy.begin_run(state->a2);
+
+    result.ok = true;
+    result.operatorsRebuilt = replacements.size();
+
+    return result;
+}
+
 } // namespace analysis
@@ -26,6 +26,7 @@
 #include "../util/bihash.h"
 
 #include <iterator>
+#include <QSet>
 
 namespace analysis
 {
@@ -72,6 +73,53 @@ A2AdapterState a2_adapter_build(
     const vme_analysis_common::VMEIdToIndex &vmeMap,
     const RunInfo &runInfo);
 
+struct A2AdapterRebuildResult
+{
+    // False if an incremental rebuild was not possible.
+    bool ok = false;
+
+    // Number of existing a2 operators that were replaced.
+    s32 operatorsRebuilt = 0;
+
+    // Number of sinks added to the a2 operator arrays.
+    s32 sinksAdded = 0;
+};
+
+/*
+ * Incrementally updates an existing a2 build after analysis edits.
+ *
+ * The a2 operators of the changed operators and of all operators depending on
+ * them are rebuilt in the given arena, which must be the arena the existing
+ * build was created in, and replace the previous a2 operators in place. Sinks
+ * that are not part of the build yet are appended to the operator arrays of
+ * their event. Data sources, untouched operators and histogram memory are
+ * left as they are.
+ *
+ * The resulting operator layout may differ from the one of a full build which
+ * sorts the operators by rank and type. Instances which are merged by
+ * operator position, e.g. the a2 worker instances, must not be combined with
+ * an incrementally rebuilt instance. See a2::a2_layouts_match().
+ *
+ * If the changes cannot be applied incrementally the existing build is left
+ * unmodified and the result has ok=false. A full a2_adapter_build() is
+ * required in this case. This happens if operators have been removed or
+ * disabled, the build contained operator errors, operator ranks, events or
+ * condition bit counts changed, an operator other than a sink was added or an
+ * operator failed to build.
+ *
+ * operators must be sorted by rank and beginRun() must have been called on
+ * the changed operators. No events must be processed by the a2 instance while
+ * this is running. Histograms should be flushed beforehand.
+ */
+A2AdapterRebuildResult a2_adapter_rebuild_operators(
+    memory::Arena *arena,
+    A2AdapterState *state,
+    const QSet<OperatorInterface *> &changedOperators,
+    const analysis::OperatorVector &operators,
+    const vme_analysis_common::VMEIdToIndex &vmeMap,
+    const RunInfo &runInfo,
+    a2::Logger logger = {});
+
 a2::PipeVectors find_output_pipe(const A2AdapterState *state, analysis::Pipe *pipe);
 
 template<typename T, typename SizeType>
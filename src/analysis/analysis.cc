@@ -29,6 +29,7 @@
 #include <zstr/src/zstr.hpp>
 
 #include "analysis/a2_adapter.h"
+#include "analysis/a2/a2_parallel.h"
 #include "analysis/a2/multiword_datafilter.h"
 #include "analysis/analysis_serialization.h"
 #include "analysis/analysis_util.h"
@@ -78,6 +79,30 @@ A2AdapterState a2_adapter_build_memory_wrapper(
     return result;
 }
 
+QStringList describe_fused_chains(const A2AdapterState *state, const a2::FusionReport &report)
+{
+    QStringList result;
+
+    for (const auto &chain: report.chains)
+    {
+        QStringList names;
+
+        for (auto opIdx: chain.operatorIndexes)
+        {
+            auto a2_op = state->a2->operators[chain.eventIndex] + opIdx;
+
+            if (auto op = state->operatorMap.value(a2_op, nullptr))
+                names.push_back(op->objectName());
+            else
+                names.push_back(QSL("<unknown>"));
+        }
+
+        result.push_back(names.join(QSL(" -> ")));
+    }
+
+    return result;
+}
+
 a2::data_filter::DataFilter a2_dataFilter_from_json(const QJsonObject &json)
 {
     return a2::data_filter::make_filter(
@@ -2671,12 +2696,17 @@ void Histo1DSink::beginRun(const RunInfo &runInfo, Logger)
     {
         binCountChanged = false;
     }
-    bool structureChanged = histoCountChanged || binCountChanged;
+    const bool compactStorage = getAnalysis() && getAnalysis()->useCompactHistoStorage();
+    bool storageChanged = (!m_histos.isEmpty()
+                           && m_histos[0]->usesCompactStorage() != compactStorage);
+    bool structureChanged = histoCountChanged || binCountChanged || storageChanged;
 
     m_histos.resize(histoCount);
 
+    const size_t binSize = compactStorage ? sizeof(u32) : sizeof(double);
+
     // Space for the histos plus space to allow proper alignment
-    size_t requiredMemory = (histoCount * m_bins * sizeof(double)
+    size_t requiredMemory = (histoCount * m_bins * binSize
                              + histoCount * HistoMemAlignment);
 
     if (!m_histoArena || m_histoArena->size() < requiredMemory)
@@ -2706,6 +2736,12 @@ void Histo1DSink::beginRun(const RunInfo &runInfo, Logger)
             histoMem = histo->getSharedMemory();
             assert(histoMem.size == m_bins);
         }
+        else if (compactStorage)
+        {
+            auto counts = m_histoArena->pushArray<u32>(m_bins, HistoMemAlignment);
+            histoMem = { m_histoArena, nullptr, m_bins };
+            histoMem.compact = std::make_shared<a2::CompactBins>(counts, m_bins);
+        }
         else
         {
             histoMem =
@@ -2716,7 +2752,10 @@ void Histo1DSink::beginRun(const RunInfo &runInfo, Logger)
             };
         }
 
-        assert(histoMem.data);
+        if (structureChanged)
+            histoMem.tiles = std::make_shared<a2::TileGenerations>(m_bins);
+
+        assert(histoMem.data || histoMem.compact);
 
         double xMin = m_xLimitMin;
         double xMax = m_xLimitMax;
@@ -2883,14 +2922,19 @@ void Histo2DSink::beginRun(const RunInfo &runInfo, Logger)
             yMax = m_inputY.inputPipe->parameters[m_inputY.paramIndex].upperLimit;
         }
 
+        const bool compactStorage = getAnalysis() && getAnalysis()->useCompactHistoStorage();
+
         if (!m_histo)
         {
             m_histo = std::make_shared<Histo2D>(m_xBins, xMin, xMax,
                                                 m_yBins, yMin, yMax);
-
+            m_histo->setCompactStorage(compactStorage);
         }
         else
         {
+            // Switching the storage mode implicitly clears
+            m_histo->setCompactStorage(compactStorage);
+
             if (m_histo->getAxisBinning(Qt::XAxis).getBins() != static_cast<u32>(m_xBins)
                 || m_histo->getAxisBinning(Qt::YAxis).getBins() != static_cast<u32>(m_yBins)
                 || !runInfo.keepAnalysisState)
@@ -3380,6 +3424,11 @@ QString ExportSink::getDataFilePath(const RunInfo &runInfo) const
 
 QString ExportSink::getDataFileExtension() const
 {
+    // Column chunks are compressed individually. The file itself is never
+    // compressed.
+    if (m_format == Format::Columnar)
+        return QSL(".mvcol");
+
     QString result = ".bin";
 
     if (m_compressionLevel != 0)
@@ -3729,6 +3778,7 @@ Analysis::Analysis(QObject *parent)
 
 Analysis::~Analysis()
 {
+    stopA2Workers();
 }
 
 //
@@ -4744,6 +4794,15 @@ void Analysis::beginRun(const RunInfo &runInfo,
         << ", localFlags =" << to_string(getObjectFlags())
         ;
 
+    // The worker instances reference memory of the current a2 build. Merge
+    // their histogram shards and stop them before anything is rebuilt.
+    stopA2Workers();
+
+    // Histogram memory of rebuilt sinks may be reused below. Apply pending
+    // buffered increments first.
+    if (m_a2State)
+        a2::a2_flush_histograms(m_a2State->a2);
+
     m_runInfo = runInfo;
     m_vmeMap = vmeMap;
 
@@ -4806,6 +4865,7 @@ void Analysis::beginRun(const RunInfo &runInfo,
     }
 
     u32 operatorsBuilt = 0;
+    QSet<OperatorInterface *> changedOperators;
 
     for (auto &op: m_operators)
     {
@@ -4831,6 +4891,7 @@ void Analysis::beginRun(const RunInfo &runInfo,
 
             op->beginRun(runInfo, logger);
             op->clearObjectFlags(ObjectFlags::NeedsRebuild);
+            changedOperators.insert(op.get());
             operatorsBuilt++;
         }
         else if (!runInfo.keepAnalysisState)
@@ -4846,31 +4907,143 @@ void Analysis::beginRun(const RunInfo &runInfo,
 
     // Build the a2 system
 
-    // a2 arena swap
-    m_a2ArenaIndex = (m_a2ArenaIndex + 1) % m_a2Arenas.size();
-    m_a2Arenas[m_a2ArenaIndex]->reset();
-
-    m_a2WorkArena->reset();
-
-    qDebug() << __PRETTY_FUNCTION__ << "########## a2 active ##########";
-    qDebug() << __PRETTY_FUNCTION__ << "a2: using arena" << (u32)m_a2ArenaIndex;
+    auto a2Logger = [logger] (const std::string &str) {
+        if (logger)
+            logger(QString::fromStdString(str));
+    };
 
-    m_a2State = std::make_unique<A2AdapterState>(
-        a2_adapter_build_memory_wrapper(
-            m_a2Arenas[m_a2ArenaIndex],
-            m_a2WorkArena,
-            this,
-            m_sources,
+    auto tA2Start = ClockType::now();
+    A2BuildInfo buildInfo = {};
+
+    // Edits done while keeping the analysis state only rebuild the affected
+    // a2 operators in place. This avoids the full build which can take
+    // seconds for large analyses.
+    // The incremental build appends new sinks to the operator arrays while a
+    // full build sorts them by rank and type. The a2 worker instances are
+    // always built from scratch and are merged into the primary instance by
+    // operator position, so both have to be created by a full build when
+    // parallel processing may be used.
+    const bool mayUseA2Workers = getA2WorkerCount() > 1 || useParallelReplay();
+
+    // Observers of operator outputs may access the a2 state and its fusion
+    // info from other threads.
+    QMutexLocker observedGuard(&m_observedOperatorsMutex);
+
+    if (!fullBuild && m_a2State && runInfo.keepAnalysisState && sourcesBuilt == 0
+        && !mayUseA2Workers)
+    {
+        // Fusion info references operator indexes which may change.
+        if (!changedOperators.isEmpty())
+            a2::a2_unfuse_operators(m_a2State->a2);
+
+        auto rebuildResult = a2_adapter_rebuild_operators(
+            m_a2Arenas[m_a2ArenaIndex].get(),
+            m_a2State.get(),
+            changedOperators,
             m_operators,
             m_vmeMap,
-            runInfo));
+            runInfo,
+            a2Logger);
 
-    assert(m_a2State);
+        buildInfo.incremental = rebuildResult.ok;
+        buildInfo.operatorCount = rebuildResult.operatorsRebuilt + rebuildResult.sinksAdded;
+    }
 
-    a2::a2_begin_run(m_a2State->a2, [logger] (const std::string &str) {
-        if (logger)
-            logger(QString::fromStdString(str));
-    });
+    if (!buildInfo.incremental)
+    {
+        // a2 arena swap
+        m_a2ArenaIndex = (m_a2ArenaIndex + 1) % m_a2Arenas.size();
+        m_a2Arenas[m_a2ArenaIndex]->reset();
+
+        m_a2WorkArena->reset();
+
+        qDebug() << __PRETTY_FUNCTION__ << "########## a2 active ##########";
+        qDebug() << __PRETTY_FUNCTION__ << "a2: using arena" << (u32)m_a2ArenaIndex;
+
+        m_a2State = std::make_unique<A2AdapterState>(
+            a2_adapter_build_memory_wrapper(
+                m_a2Arenas[m_a2ArenaIndex],
+                m_a2WorkArena,
+                this,
+                m_sources,
+                m_operators,
+                m_vmeMap,
+                runInfo));
+
+        assert(m_a2State);
+
+        m_a2State->a2->histoFillStrategy.setType(getA2HistoFillStrategy());
+
+        a2::a2_begin_run(m_a2State->a2, a2Logger);
+
+        buildInfo.operatorCount = m_a2State->operatorMap.size();
+    }
+
+    if (buildInfo.incremental && changedOperators.isEmpty())
+    {
+        // Nothing was rebuilt, the existing fusion info is still valid.
+        buildInfo.fusedChains = m_lastA2BuildInfo.fusedChains;
+    }
+    else if (useA2OperatorFusion())
+    {
+        auto report = a2::a2_fuse_operators(
+            m_a2State->a2, m_a2Arenas[m_a2ArenaIndex].get());
+
+        // Fusing resets the observed flags of the chain stages.
+        for (auto it = m_observedOperators.begin(); it != m_observedOperators.end(); ++it)
+            setA2OperatorOutputObserved(it.key(), true);
+
+        buildInfo.fusedChains = describe_fused_chains(m_a2State.get(), report);
+
+        for (const auto &chain: buildInfo.fusedChains)
+            qDebug() << __PRETTY_FUNCTION__ << "fused operator chain:" << chain;
+
+        if (!buildInfo.fusedChains.isEmpty() && logger)
+        {
+            logger(QSL("Analysis: fused %1 operator chains")
+                   .arg(buildInfo.fusedChains.size()));
+        }
+    }
+
+    observedGuard.unlock();
+
+    // Sparse index lists must be linked after fusion as fused operators are
+    // excluded. Relinking picks up rebuilt operators.
+    if (useA2SparseIndexes() && !(buildInfo.incremental && changedOperators.isEmpty()))
+        a2::a2_link_valid_indexes(m_a2State->a2, m_a2Arenas[m_a2ArenaIndex].get());
+
+    if (useA2OperatorProfiling())
+        a2::a2_enable_profiling(m_a2State->a2, m_a2Arenas[m_a2ArenaIndex].get());
+    else
+        a2::a2_disable_profiling(m_a2State->a2);
+
+    buildInfo.seconds = std::chrono::duration<double>(ClockType::now() - tA2Start).count();
+    m_lastA2BuildInfo = buildInfo;
+
+    qDebug() << __PRETTY_FUNCTION__ << "a2 build: incremental =" << buildInfo.incremental
+        << ", operators =" << buildInfo.operatorCount
+        << ", took" << buildInfo.seconds * 1000.0 << "ms";
+
+    if (buildInfo.incremental && logger)
+    {
+        logger(QSL("Analysis: rebuilt %1 operators in %2 ms")
+               .arg(buildInfo.operatorCount)
+               .arg(buildInfo.seconds * 1000.0, 0, 'f', 2));
+    }
+
+    if (getA2WorkerCount() > 1)
+    {
+        if (a2::a2_can_run_in_parallel(m_a2State->a2))
+        {
+            startA2Workers(getA2WorkerCount(), runInfo, logger);
+        }
+        else if (logger)
+        {
+            logger(QSL("Analysis contains operators depending on the event order"
+                       " (PreviousValue, RateMonitor, ExportSink)."
+                       " Using single threaded processing."));
+        }
+    }
 
     auto tEnd = ClockType::now();
     std::chrono::duration<float> elapsed = tEnd - tStart;
@@ -4896,6 +5069,7 @@ void Analysis::beginRun(BeginRunOption option, Logger logger)
 
 void Analysis::endRun()
 {
+    stopA2Workers();
     a2::a2_end_run(m_a2State->a2);
 
 #if ENABLE_ANALYSIS_DEBUG
@@ -4922,9 +5096,16 @@ void Analysis::endRun()
 //
 // Processing
 //
+/* With parallel processing active the data sources of the primary A2
+ * instance are still run on the calling thread. This keeps the extracted
+ * values and hit counts available to the EventServer and the UI. Operators and
+ * sinks are only stepped by the workers. */
 void Analysis::beginEvent(int eventIndex)
 {
     a2_begin_event(m_a2State->a2, eventIndex);
+
+    if (m_a2WorkerPool)
+        m_a2WorkerPool->beginEvent(eventIndex);
 }
 
 void Analysis::processModulePrefix(int eventIndex, int moduleIndex, const u32 *data, u32 size)
@@ -4939,6 +5120,9 @@ void Analysis::processModulePrefix(int eventIndex, int moduleIndex, const u32 *d
 void Analysis::processModuleData(int eventIndex, int moduleIndex, const u32 *data, u32 size)
 {
     a2_process_module_data(m_a2State->a2, eventIndex, moduleIndex, data, size);
+
+    if (m_a2WorkerPool)
+        m_a2WorkerPool->processModuleData(eventIndex, moduleIndex, data, size);
 }
 
 void Analysis::processModuleSuffix(int eventIndex, int moduleIndex, const u32 *data, u32 size)
@@ -4952,12 +5136,16 @@ void Analysis::processModuleSuffix(int eventIndex, int moduleIndex, const u32 *d
 
 void Analysis::endEvent(int eventIndex)
 {
-    a2_end_event(m_a2State->a2, eventIndex);
+    if (m_a2WorkerPool)
+        m_a2WorkerPool->endEvent(eventIndex);
+    else
+        a2_end_event(m_a2State->a2, eventIndex);
 }
 
 void Analysis::processTimetick()
 {
     m_timetickCount += 1.0;
+    syncHistograms();
     a2_timetick(m_a2State->a2);
 }
 
@@ -5197,6 +5385,375 @@ QVector<bool> Analysis::getUserLevelsHidden(const QUuid &eventId) const
     return ret;
 }
 
+void Analysis::setA2WorkerCount(int count)
+{
+    count = std::max(count, 1);
+
+    if (count != getA2WorkerCount())
+    {
+        setProperty("A2WorkerCount", count);
+        setObjectFlags(ObjectFlags::NeedsRebuild);
+        setModified();
+    }
+}
+
+int Analysis::getA2WorkerCount() const
+{
+    return std::max(property("A2WorkerCount").toInt(), 1);
+}
+
+int Analysis::getActiveA2WorkerCount() const
+{
+    return static_cast<int>(m_a2WorkerStates.size());
+}
+
+void Analysis::setA2HistoFillStrategy(a2::HistoFillStrategyType type)
+{
+    if (type != getA2HistoFillStrategy())
+    {
+        setProperty("A2HistoFillStrategy", QString(a2::to_string(type)));
+        setObjectFlags(ObjectFlags::NeedsRebuild);
+        setModified();
+    }
+}
+
+a2::HistoFillStrategyType Analysis::getA2HistoFillStrategy() const
+{
+    auto typeString = property("A2HistoFillStrategy").toString();
+
+    if (typeString == a2::to_string(a2::HistoFillStrategyType::Buffered))
+        return a2::HistoFillStrategyType::Buffered;
+
+    return a2::HistoFillStrategyType::Direct;
+}
+
+void Analysis::setCompactHistoStorage(bool enable)
+{
+    if (enable != useCompactHistoStorage())
+    {
+        setProperty("CompactHistoStorage", enable);
+        setObjectFlags(ObjectFlags::NeedsRebuild);
+        setModified();
+    }
+}
+
+bool Analysis::useCompactHistoStorage() const
+{
+    return property("CompactHistoStorage").toBool();
+}
+
+void Analysis::setA2OperatorFusion(bool enable)
+{
+    if (enable != useA2OperatorFusion())
+    {
+        setProperty("A2OperatorFusion", enable);
+        setObjectFlags(ObjectFlags::NeedsRebuild);
+        setModified();
+    }
+}
+
+bool Analysis::useA2OperatorFusion() const
+{
+    auto value = property("A2OperatorFusion");
+    return value.isValid() ? value.toBool() : true;
+}
+
+void Analysis::observeOperatorOutputs(OperatorInterface *op)
+{
+    QMutexLocker guard(&m_observedOperatorsMutex);
+
+    if (++m_observedOperators[op] == 1)
+        setA2OperatorOutputObserved(op, true);
+}
+
+void Analysis::unobserveOperatorOutputs(OperatorInterface *op)
+{
+    QMutexLocker guard(&m_observedOperatorsMutex);
+
+    auto it = m_observedOperators.find(op);
+
+    if (it == m_observedOperators.end())
+        return;
+
+    if (--it.value() <= 0)
+    {
+        m_observedOperators.erase(it);
+        setA2OperatorOutputObserved(op, false);
+    }
+}
+
+// Must be called with m_observedOperatorsMutex locked.
+void Analysis::setA2OperatorOutputObserved(OperatorInterface *op, bool observed)
+{
+    if (!m_a2State)
+        return;
+
+    if (auto a2_op = m_a2State->operatorMap.value(op, nullptr))
+        a2::a2_set_operator_output_observed(m_a2State->a2, a2_op, observed);
+}
+
+void Analysis::setA2SparseIndexes(bool enable)
+{
+    if (enable != useA2SparseIndexes())
+    {
+        setProperty("A2SparseIndexes", enable);
+        setObjectFlags(ObjectFlags::NeedsRebuild);
+        setModified();
+    }
+}
+
+bool Analysis::useA2SparseIndexes() const
+{
+    auto value = property("A2SparseIndexes");
+    return value.isValid() ? value.toBool() : true;
+}
+
+void Analysis::setA2OperatorProfiling(bool enable)
+{
+    if (enable != useA2OperatorProfiling())
+    {
+        setProperty("A2OperatorProfiling", enable);
+        setModified();
+    }
+}
+
+bool Analysis::useA2OperatorProfiling() const
+{
+    return property("A2OperatorProfiling").toBool();
+}
+
+void Analysis::setParallelReplay(bool enable)
+{
+    if (enable != useParallelReplay())
+    {
+        setProperty("ParallelReplay", enable);
+        setModified();
+    }
+}
+
+bool Analysis::useParallelReplay() const
+{
+    return property("ParallelReplay").toBool();
+}
+
+Analysis::A2ProfileInfo Analysis::getA2ProfileInfo() const
+{
+    A2ProfileInfo result;
+
+    if (!m_a2State)
+        return result;
+
+    // The primary instance and the workers are built from the same operators
+    // so their profiling arrays have the same layout.
+    std::vector<a2::A2 *> instances = { m_a2State->a2 };
+
+    for (const auto &workerState: m_a2WorkerStates)
+        instances.push_back(workerState.a2);
+
+    QMap<QString, A2OperatorProfile> typeTotals;
+
+    for (int ei = 0; ei < a2::MaxVMEEvents; ei++)
+    {
+        auto a2 = m_a2State->a2;
+
+        if (!a2->operatorProfiles[ei])
+            continue;
+
+        result.enabled = true;
+
+        for (int opIdx = 0; opIdx < a2->operatorCounts[ei]; opIdx++)
+        {
+            A2OperatorProfile entry;
+            entry.eventIndex = ei;
+            entry.operatorCount = 1;
+
+            for (auto instance: instances)
+            {
+                if (!instance->operatorProfiles[ei] || opIdx >= instance->operatorCounts[ei])
+                    continue;
+
+                const auto &profile = instance->operatorProfiles[ei][opIdx];
+                entry.time += profile.time;
+                entry.stepCount += profile.stepCount;
+                entry.condSkipCount += profile.condSkipCount;
+            }
+
+            if (auto op = m_a2State->operatorMap.value(a2->operators[ei] + opIdx, nullptr))
+            {
+                entry.id = op->getId();
+                entry.name = op->objectName();
+                entry.className = getClassName(op);
+            }
+            else
+            {
+                entry.name = QSL("<unknown>");
+            }
+
+            auto &typeTotal = typeTotals[entry.className];
+            typeTotal.name = typeTotal.className = entry.className;
+            typeTotal.operatorCount++;
+            typeTotal.time += entry.time;
+            typeTotal.stepCount += entry.stepCount;
+            typeTotal.condSkipCount += entry.condSkipCount;
+
+            result.operators.push_back(entry);
+        }
+    }
+
+    result.operatorTypes = typeTotals.values().toVector();
+
+    auto by_time_desc = [] (const A2OperatorProfile &a, const A2OperatorProfile &b)
+    {
+        return a.time > b.time;
+    };
+
+    std::sort(result.operators.begin(), result.operators.end(), by_time_desc);
+    std::sort(result.operatorTypes.begin(), result.operatorTypes.end(), by_time_desc);
+
+    if (result.enabled)
+        result.timeUnit = QString::fromLatin1(a2::a2_profile_counter_unit());
+
+    return result;
+}
+
+void Analysis::syncHistograms()
+{
+    if (m_a2WorkerPool)
+        m_a2WorkerPool->sync();
+
+    for (auto &workerState: m_a2WorkerStates)
+    {
+        a2::a2_flush_histograms(workerState.a2);
+        a2::a2_merge_histograms(m_a2State->a2, workerState.a2);
+
+        if (m_a2ChunkWorkers)
+            a2::a2_merge_hit_counts(m_a2State->a2, workerState.a2);
+    }
+
+    if (m_a2State)
+        a2::a2_flush_histograms(m_a2State->a2);
+}
+
+void Analysis::startA2Workers(int workerCount, const RunInfo &runInfo, Logger logger)
+{
+    assert(!m_a2WorkerPool);
+    assert(workerCount > 1);
+
+    auto workers = buildA2Workers(workerCount, runInfo);
+
+    if (workers.empty())
+        return;
+
+    m_a2WorkerPool = std::make_unique<a2::A2WorkerPool>(workers);
+
+    if (logger)
+        logger(QSL("Using %1 analysis worker threads").arg(workerCount));
+}
+
+std::vector<a2::A2 *> Analysis::takeA2ChunkWorkers(int workerCount, Logger logger)
+{
+    if (!m_a2State || workerCount <= 1 || !a2::a2_can_run_in_parallel(m_a2State->a2))
+        return {};
+
+    // Replace any event batch workers started in beginRun().
+    stopA2Workers();
+
+    auto workers = buildA2Workers(workerCount, m_runInfo);
+
+    if (workers.empty())
+        return {};
+
+    m_a2ChunkWorkers = true;
+
+    if (logger)
+        logger(QSL("Using %1 parallel replay threads").arg(workerCount));
+
+    return workers;
+}
+
+std::vector<a2::A2 *> Analysis::buildA2Workers(int workerCount, const RunInfo &runInfo)
+{
+    assert(m_a2WorkerStates.empty());
+
+    std::vector<a2::A2 *> workers;
+
+    for (int wi = 0; wi < workerCount; wi++)
+    {
+        if (m_a2WorkerArenas.size() <= static_cast<size_t>(wi))
+            m_a2WorkerArenas.emplace_back(std::make_unique<memory::Arena>(A2ArenaSegmentSize));
+
+        auto &arena = m_a2WorkerArenas[wi];
+        arena->reset();
+        m_a2WorkArena->reset();
+
+        // Building again from the same analysis objects yields the same
+        // operator layout as a fully built primary instance which is
+        // required for merging. beginRun() does not use incremental builds
+        // when workers may be used. The histogram pointers still reference
+        // the real histogram memory and are replaced by
+        // a2_shard_histograms().
+        m_a2WorkerStates.emplace_back(
+            a2_adapter_build_memory_wrapper(
+                arena,
+                m_a2WorkArena,
+                this,
+                m_sources,
+                m_operators,
+                m_vmeMap,
+                runInfo));
+
+        auto a2 = m_a2WorkerStates.back().a2;
+
+        if (!a2::a2_layouts_match(m_a2State->a2, a2))
+        {
+            qDebug() << __PRETTY_FUNCTION__
+                << "a2 worker layout differs from the primary instance,"
+                << "using single threaded processing";
+            m_a2WorkerStates.clear();
+            return {};
+        }
+
+        a2::a2_shard_histograms(a2, arena.get());
+
+        if (useA2OperatorFusion())
+            a2::a2_fuse_operators(a2, arena.get());
+
+        if (useA2SparseIndexes())
+            a2::a2_link_valid_indexes(a2, arena.get());
+
+        if (useA2OperatorProfiling())
+            a2::a2_enable_profiling(a2, arena.get());
+
+        a2->histoFillStrategy.setType(getA2HistoFillStrategy());
+        a2::a2_begin_run(a2, {});
+        workers.push_back(a2);
+    }
+
+    return workers;
+}
+
+void Analysis::stopA2Workers()
+{
+    if (m_a2WorkerPool)
+    {
+        m_a2WorkerPool->sync();
+        m_a2WorkerPool = {};
+    }
+
+    for (auto &workerState: m_a2WorkerStates)
+    {
+        a2::a2_end_run(workerState.a2);
+        a2::a2_merge_histograms(m_a2State->a2, workerState.a2);
+        a2::a2_merge_profiling(m_a2State->a2, workerState.a2);
+
+        if (m_a2ChunkWorkers)
+            a2::a2_merge_hit_counts(m_a2State->a2, workerState.a2);
+    }
+
+    m_a2WorkerStates.clear();
+    m_a2ChunkWorkers = false;
+}
+
 static const double maxRawHistoBins = (1 << 16);
 
 RawDataDisplay make_raw_data_display(std::shared_ptr<Extractor> extractor,
@@ -41,6 +41,8 @@
 #include <memory>
 #include <pcg_random.hpp>
 #include <QDir>
+#include <QHash>
+#include <QMutex>
 #include <QUuid>
 #include <qwt_interval.h>
 
@@ -52,6 +54,11 @@ namespace memory
 class Arena;
 };
 
+namespace a2
+{
+class A2WorkerPool;
+};
+
 /*
  *   Operators vs Sources vs Sinks:
  *   - Data Sources have no input but are directly attached to a module.
@@ -1705,7 +1712,7 @@ class LIBMVME_EXPORT ExportSink: public SinkInterface
         QString getDataFilePath(const RunInfo &runInfo) const; // exports/sums_and_coords/data_<runInfo.runid>.bin.gz
         QString getDataFileName(const RunInfo &runInfo) const; // data_<runInfo.runId>.bin.gz
         QString getExportFileBasename() const;  // sums_and_coords
-        QString getDataFileExtension() const;   // .bin.gz / .bin
+        QString getDataFileExtension() const;   // .bin.gz / .bin / .mvcol
 
         QVector<std::shared_ptr<Slot>> getDataInputs() const { return m_dataInputs; }
 
@@ -2004,6 +2011,59 @@ class LIBMVME_EXPORT Analysis: public QObject
         A2AdapterState *getA2AdapterState() { return m_a2State.get(); }
         const A2AdapterState *getA2AdapterState() const { return m_a2State.get(); }
 
+        struct A2BuildInfo
+        {
+            // True if only changed operators were rebuilt into the existing a2
+            // instance. See a2_adapter_rebuild_operators().
+            bool incremental = false;
+
+            // Number of a2 operators built or, for incremental builds, the
+            // number of rebuilt and added operators.
+            s32 operatorCount = 0;
+
+            // Time taken by the a2 part of beginRun().
+            double seconds = 0.0;
+
+            // Operator chains fused by a2_fuse_operators(). One entry per
+            // chain listing the operator names, e.g. "cal -> filter -> h1d".
+            QStringList fusedChains;
+        };
+
+        /* Information about the a2 build done in the last beginRun() call. */
+        A2BuildInfo getLastA2BuildInfo() const { return m_lastA2BuildInfo; }
+
+        struct A2OperatorProfile
+        {
+            // Operator id. Null for per operator type totals.
+            QUuid id;
+            // Operator name or the class name for per type totals.
+            QString name;
+            QString className;
+            s32 eventIndex = -1;
+            // Number of a2 operators accumulated into this entry.
+            s32 operatorCount = 0;
+            u64 time = 0;
+            u64 stepCount = 0;
+            u64 condSkipCount = 0;
+        };
+
+        struct A2ProfileInfo
+        {
+            bool enabled = false;
+            // Unit of the time values: "cycles" or "ns".
+            QString timeUnit;
+            // Per operator counters summed over all a2 worker instances.
+            // Sorted by descending time.
+            QVector<A2OperatorProfile> operators;
+            // Totals per operator class. Sorted by descending time.
+            QVector<A2OperatorProfile> operatorTypes;
+        };
+
+        /* Collects the per operator profiling counters of the current run.
+         * The counters are read while the analysis may be running so the
+         * values are approximate. See setA2OperatorProfiling(). */
+        A2ProfileInfo getA2ProfileInfo() const;
+
         RunInfo getRunInfo() const { return m_runInfo; }
         void setRunInfo(const RunInfo &ri) { m_runInfo = ri; }
 
@@ -2024,11 +2084,97 @@ class LIBMVME_EXPORT Analysis: public QObject
         void setUserLevelsHidden(const QUuid &eventId, const QVector<bool> &hidden);
         QVector<bool> getUserLevelsHidden(const QUuid &eventId) const;
 
+        /* Number of threads used for a2 operator processing. Values <= 1
+         * disable parallel processing. Takes effect on the next beginRun().
+         * Analyses containing operators which depend on the event order fall
+         * back to single threaded processing. See a2/a2_parallel.h. */
+        void setA2WorkerCount(int count);
+        int getA2WorkerCount() const;
+
+        /* Number of worker threads used by the current a2 build. 0 if
+         * processing is done on the calling thread. */
+        int getActiveA2WorkerCount() const;
+
+        /* Histogram fill strategy used by the a2 system. Buffered filling
+         * can be faster for large histograms. Takes effect on the next
+         * beginRun(). See a2::HistoFillStrategyType. */
+        void setA2HistoFillStrategy(a2::HistoFillStrategyType type);
+        a2::HistoFillStrategyType getA2HistoFillStrategy() const;
+
+        /* Use u32 bin counters instead of doubles for histogram sinks. Cuts
+         * the histogram memory footprint in half. Storage is promoted to
+         * doubles if a bin overflows or a non-integral value is stored.
+         * Takes effect on the next beginRun(). See a2/a2_compact_bins.h. */
+        void setCompactHistoStorage(bool enable);
+        bool useCompactHistoStorage() const;
+
+        /* Fuse chains of elementwise operators (calibration, range filter,
+         * previous value, 1D histogram) into single kernels. Enabled by
+         * default. Takes effect on the next beginRun(). See
+         * a2::a2_fuse_operators().
+         * The outputs of operators in the middle of a fused chain are only
+         * updated while they are observed, see observeOperatorOutputs(). */
+        void setA2OperatorFusion(bool enable);
+        bool useA2OperatorFusion() const;
+
+        /* Keeps the a2 outputs of the operator up to date while it is being
+         * displayed. Only needed for operators inside fused chains but safe
+         * to use for any operator. Calls are counted, each call to
+         * observeOperatorOutputs() must be paired with a call to
+         * unobserveOperatorOutputs(). The operator pointer is only used as a
+         * key and never dereferenced. Can be called during a run. */
+        void observeOperatorOutputs(OperatorInterface *op);
+        void unobserveOperatorOutputs(OperatorInterface *op);
+
+        /* Track the indexes of the valid parameters produced by data sources
+         * and calibrations so that histogram sinks, sparse export sinks and
+         * the event server only process the hit channels. Enabled by
+         * default. Takes effect on the next beginRun(). See
+         * a2::a2_link_valid_indexes(). */
+        void setA2SparseIndexes(bool enable);
+        bool useA2SparseIndexes() const;
+
+        /* Measure the time spent in each operators step function. Adds a
+         * timestamp counter read per operator and event. Disabled by
+         * default. The counters are reset on each beginRun(). */
+        void setA2OperatorProfiling(bool enable);
+        bool useA2OperatorProfiling() const;
+
+        /* Makes all events processed so far visible in the histograms: waits
+         * for the a2 workers to process all events handed to them, flushes
+         * buffered histogram increments and merges the workers histogram
+         * shards into the real histograms. Must be called from the thread
+         * driving the analysis. */
+        void syncHistograms();
+
+        /* Parse and analyse MVLC replay data in parallel chunks. Requires
+         * a worker count > 1. Takes effect on the next replay. See
+         * mvlc_parallel_replay.h. */
+        void setParallelReplay(bool enable);
+        bool useParallelReplay() const;
+
+        /* Support for chunked parallel replays: replaces the a2 workers
+         * started by beginRun() with workerCount A2 instances which are not
+         * driven by the Analysis. Each instance has private histogram shards
+         * and must be stepped directly by exactly one thread of the caller.
+         * syncHistograms() and endRun() merge the shards and the data source
+         * hit counts into the primary instance and must only be called while
+         * none of the instances is being stepped.
+         * Returns an empty vector if the analysis contains operators
+         * depending on the event order. */
+        std::vector<a2::A2 *> takeA2ChunkWorkers(int workerCount, Logger logger);
+
     private:
+        void startA2Workers(int workerCount, const RunInfo &runInfo, Logger logger);
+        std::vector<a2::A2 *> buildA2Workers(int workerCount, const RunInfo &runInfo);
+        void stopA2Workers();
+
         void updateRank(OperatorInterface *op,
                         QSet<OperatorInterface *> &updated,
                         QSet<OperatorInterface *> &visited);
 
+        void setA2OperatorOutputObserved(OperatorInterface *op, bool observed);
+
         SourceVector m_sources;
         OperatorVector m_operators;
         DirectoryVector m_directories;
@@ -2047,6 +2193,21 @@ class LIBMVME_EXPORT Analysis: public QObject
         u8 m_a2ArenaIndex;
         std::unique_ptr<memory::Arena> m_a2WorkArena;
         std::unique_ptr<A2AdapterState> m_a2State;
+        A2BuildInfo m_lastA2BuildInfo;
+
+        // Observe counts of operators whose outputs are displayed. Guards the
+        // fusion info of m_a2State against concurrent updates.
+        QHash<OperatorInterface *, int> m_observedOperators;
+        QMutex m_observedOperatorsMutex;
+
+        // Parallel a2 processing. Each worker uses its own A2 instance built
+        // into its own arena.
+        std::vector<std::unique_ptr<memory::Arena>> m_a2WorkerArenas;
+        std::vector<A2AdapterState> m_a2WorkerStates;
+        std::unique_ptr<a2::A2WorkerPool> m_a2WorkerPool;
+        // True if the worker instances are driven externally, see
+        // takeA2ChunkWorkers().
+        bool m_a2ChunkWorkers = false;
 };
 
 struct LIBMVME_EXPORT RawDataDisplay
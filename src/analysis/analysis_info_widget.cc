@@ -26,6 +26,7 @@
 #include <QPushButton>
 #include <QTimer>
 
+#include "analysis/analysis.h"
 #include "util/counters.h"
 #include "util/strings.h"
 #include "mvlc_stream_worker.h"
@@ -76,9 +77,17 @@ struct AnalysisInfoWidgetPrivate
     QVector<QLabel *> mvlcLabels;
     mesytec::mvlc::readout_parser::ReadoutParserCounters prevMVLCCounters;
 
+    QWidget *profileInfoWidget;
+    QLabel *profileOperatorsLabel;
+    QLabel *profileTypesLabel;
+
     void updateMVLCWidget(const mesytec::mvlc::readout_parser::ReadoutParserCounters &counters, double dt);
+    void updateProfileWidget();
 };
 
+// Number of operators listed in the profile info.
+static const int ProfileTopOperators = 10;
+
 #if (QT_VERSION >= QT_VERSION_CHECK(5, 8, 0))
 static const std::chrono::milliseconds WidgetUpdatePeriod(1000);
 #else
@@ -161,10 +170,31 @@ AnalysisInfoWidget::AnalysisInfoWidget(MVMEContext *context, QWidget *parent)
         mvlcLayout->addRow(noteLabel);
     }
 
+    // Operator profiling. Only visible if enabled in the analysis processing
+    // options.
+    m_d->profileInfoWidget = new QGroupBox("Operator Profile:");
+    {
+        auto profileLayout = make_layout<QFormLayout, 0, 2>(m_d->profileInfoWidget);
+
+        m_d->profileOperatorsLabel = new QLabel;
+        m_d->profileTypesLabel = new QLabel;
+
+        for (auto label: { m_d->profileOperatorsLabel, m_d->profileTypesLabel })
+        {
+            label->setTextInteractionFlags(Qt::TextSelectableByMouse);
+            label->setSizePolicy({
+                QSizePolicy::MinimumExpanding, QSizePolicy::MinimumExpanding});
+        }
+
+        profileLayout->addRow(QSL("top operators"), m_d->profileOperatorsLabel);
+        profileLayout->addRow(QSL("by operator type"), m_d->profileTypesLabel);
+    }
+
     // outer widget layout
     auto outerLayout = new QVBoxLayout(this);
     outerLayout->addLayout(layout);
     outerLayout->addWidget(m_d->mvlcInfoWidget);
+    outerLayout->addWidget(m_d->profileInfoWidget);
     outerLayout->addStretch(1);
 
     update();
@@ -400,11 +430,60 @@ void AnalysisInfoWidget::update()
         m_d->mvlcInfoWidget->setVisible(false);
     }
 
+    m_d->updateProfileWidget();
+
     m_d->prevCounters = counters;
     m_d->lastUpdateTime = QDateTime::currentDateTime();
     m_d->updateTimer.start(WidgetUpdatePeriod);
 }
 
+void AnalysisInfoWidgetPrivate::updateProfileWidget()
+{
+    auto analysis = context->getAnalysis();
+    auto info = analysis ? analysis->getA2ProfileInfo() : analysis::Analysis::A2ProfileInfo();
+
+    profileInfoWidget->setVisible(info.enabled);
+
+    if (!info.enabled)
+        return;
+
+    u64 totalTime = 0;
+
+    for (const auto &entry: info.operatorTypes)
+        totalTime += entry.time;
+
+    auto format_entry = [&info, totalTime] (const analysis::Analysis::A2OperatorProfile &entry)
+    {
+        double percent = totalTime ? entry.time * 100.0 / totalTime : 0.0;
+        double perStep = entry.stepCount ? static_cast<double>(entry.time) / entry.stepCount : 0.0;
+
+        return QSL("%1 (%2): %3%, %4 %5/step, steps=%6, skipped=%7")
+            .arg(entry.name)
+            .arg(entry.eventIndex >= 0
+                 ? QSL("event=%1").arg(entry.eventIndex)
+                 : QSL("%1 ops").arg(entry.operatorCount))
+            .arg(percent, 0, 'f', 1)
+            .arg(perStep, 0, 'f', 0)
+            .arg(info.timeUnit)
+            .arg(entry.stepCount)
+            .arg(entry.condSkipCount);
+    };
+
+    QStringList lines;
+
+    for (int i = 0; i < std::min(info.operators.size(), ProfileTopOperators); i++)
+        lines += format_entry(info.operators[i]);
+
+    profileOperatorsLabel->setText(lines.join("\n"));
+
+    lines.clear();
+
+    for (const auto &entry: info.operatorTypes)
+        lines += format_entry(entry);
+
+    profileTypesLabel->setText(lines.join("\n"));
+}
+
 void AnalysisInfoWidgetPrivate::updateMVLCWidget(
     const mesytec::mvlc::readout_parser::ReadoutParserCounters &counters, double dt)
 {
@@ -49,6 +49,77 @@ namespace analysis
 namespace detail
 {
 
+namespace
+{
+
+/* Set in the saved bin count (1D) or x bin count (2D) if the bin data is
+ * stored as u32 counters instead of doubles. Sessions written before compact
+ * histogram storage existed never have this bit set. */
+const u32 CompactBinsFlag = 1u << 31;
+
+/* Writes the raw bin data. The prefix has to be written by the caller using
+ * compact_bins_flag() to determine the storage type. */
+void save_bins(QDataStream &out, const double *data, const a2::CompactBins *compact, u32 binCount)
+{
+    if (compact && !compact->isPromoted())
+    {
+        out.writeRawData(reinterpret_cast<const char *>(compact->data32()),
+                         binCount * sizeof(u32));
+    }
+    else
+    {
+        out.writeRawData(reinterpret_cast<const char *>(data),
+                         binCount * sizeof(double));
+    }
+}
+
+u32 compact_bins_flag(const a2::CompactBins *compact)
+{
+    return (compact && !compact->isPromoted()) ? CompactBinsFlag : 0u;
+}
+
+/* Reads raw bin data saved by save_bins() into either double storage or
+ * compact storage, converting between the two if needed. */
+void load_bins(QDataStream &in, bool savedCompact, double *data, a2::CompactBins *compact,
+               u32 binCount)
+{
+    if (savedCompact && compact && !compact->isPromoted())
+    {
+        in.readRawData(reinterpret_cast<char *>(compact->data32()),
+                       binCount * sizeof(u32));
+        return;
+    }
+
+    if (!savedCompact && data)
+    {
+        in.readRawData(reinterpret_cast<char *>(data), binCount * sizeof(double));
+        return;
+    }
+
+    std::vector<double> values(binCount);
+
+    if (savedCompact)
+    {
+        std::vector<u32> counts(binCount);
+        in.readRawData(reinterpret_cast<char *>(counts.data()), binCount * sizeof(u32));
+        std::copy(counts.begin(), counts.end(), values.begin());
+    }
+    else
+    {
+        in.readRawData(reinterpret_cast<char *>(values.data()), binCount * sizeof(double));
+    }
+
+    for (u32 bin = 0; bin < binCount; bin++)
+    {
+        if (compact)
+            compact->set(bin, values[bin]);
+        else
+            data[bin] = values[bin];
+    }
+}
+
+} // end anon namespace
+
 // Histo1DSink save/load
 void save(QDataStream &out, const Histo1DSink *obj)
 {
@@ -62,9 +133,9 @@ void save(QDataStream &out, const Histo1DSink *obj)
     {
         if (const auto &histo = obj->getHisto(hi).get())
         {
-            out << static_cast<u32>(histo->getNumberOfBins());
-            out.writeRawData(reinterpret_cast<const char *>(histo->data()),
-                             histo->getNumberOfBins() * sizeof(double));
+            auto compact = histo->getCompactBins();
+            out << (static_cast<u32>(histo->getNumberOfBins()) | compact_bins_flag(compact));
+            save_bins(out, histo->data(), compact, histo->getNumberOfBins());
         }
         else
         {
@@ -91,13 +162,15 @@ void load(QDataStream &in, Histo1DSink *obj)
         u32 binCount = 0;
         in >> binCount;
 
+        const bool savedCompact = binCount & CompactBinsFlag;
+        binCount &= ~CompactBinsFlag;
+
         if (binCount != histo->getNumberOfBins())
         {
             throw std::runtime_error("1d histo bin mismatch");
         }
 
-        in.readRawData(reinterpret_cast<char *>(histo->data()),
-                       binCount * sizeof(double));
+        load_bins(in, savedCompact, histo->data(), histo->getCompactBins(), binCount);
     }
 }
 
@@ -106,13 +179,14 @@ void save(QDataStream &out, const Histo2DSink *obj)
 {
     assert(obj);
 
-    // xBins, yBins, y * x * sizeof(double)
+    // xBins, yBins, y * x * sizeof(double) or y * x * sizeof(u32) for
+    // compact storage
 
     if (const auto &histo = obj->getHisto().get())
     {
-        out << histo->getNumberOfXBins() << histo->getNumberOfYBins();
-        out.writeRawData(reinterpret_cast<const char *>(histo->data()),
-                         obj->getHistoBinsX() * obj->getHistoBinsY() * sizeof(double));
+        auto compact = histo->getCompactBins();
+        out << (histo->getNumberOfXBins() | compact_bins_flag(compact)) << histo->getNumberOfYBins();
+        save_bins(out, histo->data(), compact, obj->getHistoBinsX() * obj->getHistoBinsY());
     }
     else
     {
@@ -130,14 +204,16 @@ void load(QDataStream &in, Histo2DSink *obj)
 
     in >> xBins >> yBins;
 
+    const bool savedCompact = xBins & CompactBinsFlag;
+    xBins &= ~CompactBinsFlag;
+
     if (xBins != histo->getNumberOfXBins()
         || yBins != histo->getNumberOfYBins())
     {
         throw std::runtime_error("2d histo bin mismatch");
     }
 
-    in.readRawData(reinterpret_cast<char *>(histo->data()),
-                    xBins * yBins * sizeof(double));
+    load_bins(in, savedCompact, histo->data(), histo->getCompactBins(), xBins * yBins);
 }
 
 // RateMonitorSink save/load
@@ -24,10 +24,13 @@
 #include <memory>
 #include <QApplication>
 #include <QComboBox>
+#include <QCheckBox>
 #include <QClipboard>
 #include <QCursor>
 #include <QDesktopServices>
+#include <QDialogButtonBox>
 #include <QFileDialog>
+#include <QFormLayout>
 #include <QGuiApplication>
 #include <QHBoxLayout>
 #include <QJsonObject>
@@ -38,11 +41,13 @@
 #include <QMimeData>
 #include <QProgressDialog>
 #include <QScrollArea>
+#include <QSpinBox>
 #include <QSplitter>
 #include <QStackedWidget>
 #include <QStandardPaths>
 #include <QStatusBar>
 #include <QtConcurrent>
+#include <QThread>
 #include <QTimer>
 #include <QToolBar>
 #include <QToolButton>
@@ -149,6 +154,7 @@ struct AnalysisWidgetPrivate
     QPair<bool, QString> actionSave();
     QPair<bool, QString> actionSaveAs();
     void actionClearHistograms();
+    void actionProcessingOptions();
 
     void actionSaveSession();
     void actionLoadSession();
@@ -644,6 +650,104 @@ void AnalysisWidgetPrivate::actionClearHistograms()
     }
 }
 
+void AnalysisWidgetPrivate::actionProcessingOptions()
+{
+    auto analysis = m_context->getAnalysis();
+
+    QDialog dialog(m_q);
+    dialog.setWindowTitle(QSL("Analysis Processing Options"));
+
+    auto spin_workerCount = new QSpinBox;
+    spin_workerCount->setMinimum(1);
+    spin_workerCount->setMaximum(std::max(1, QThread::idealThreadCount()));
+    spin_workerCount->setValue(analysis->getA2WorkerCount());
+
+    auto combo_histoFill = new QComboBox;
+    combo_histoFill->addItem(QSL("Direct"),
+                             static_cast<int>(a2::HistoFillStrategyType::Direct));
+    combo_histoFill->addItem(QSL("Buffered (faster for large histograms)"),
+                             static_cast<int>(a2::HistoFillStrategyType::Buffered));
+    combo_histoFill->setCurrentIndex(combo_histoFill->findData(
+            static_cast<int>(analysis->getA2HistoFillStrategy())));
+
+    auto cb_compactStorage = new QCheckBox(QSL("Use u32 bin counters"));
+    cb_compactStorage->setChecked(analysis->useCompactHistoStorage());
+    cb_compactStorage->setToolTip(
+        QSL("Halves histogram memory usage. Bins are converted to double precision"
+            " if a counter overflows. Changing this setting clears all histograms."));
+
+    auto cb_operatorFusion = new QCheckBox(QSL("Fuse operator chains"));
+    cb_operatorFusion->setChecked(analysis->useA2OperatorFusion());
+    cb_operatorFusion->setToolTip(
+        QSL("Processes chains of calibration, range filter, previous value and 1D"
+            " histogram operators in a single pass. Outputs inside a chain are"
+            " only updated while they are displayed."));
+
+    auto cb_sparseIndexes = new QCheckBox(QSL("Process only hit channels"));
+    cb_sparseIndexes->setChecked(analysis->useA2SparseIndexes());
+    cb_sparseIndexes->setToolTip(
+        QSL("Data sources record which channels were hit in an event. Calibrations,"
+            " 1D histograms, sparse exports and the event server then skip the"
+            " channels without data."));
+
+    auto cb_profiling = new QCheckBox(QSL("Measure operator run times"));
+    cb_profiling->setChecked(analysis->useA2OperatorProfiling());
+    cb_profiling->setToolTip(
+        QSL("Records the time spent in each operator. The results are shown in the"
+            " Analysis Info window. Adds a small overhead to the processing."));
+
+    auto cb_parallelReplay = new QCheckBox(QSL("Parse and analyse replays in parallel chunks"));
+    cb_parallelReplay->setChecked(analysis->useParallelReplay());
+    cb_parallelReplay->setToolTip(
+        QSL("MVLC listfile replays are split into chunks which are parsed and analysed"
+            " by the worker threads. The event server and single stepping do not receive"
+            " data in this mode."));
+
+    auto label_workerInfo = new QLabel(
+        QSL("Analyses using PreviousValue, RateMonitor or ExportSink operators"
+            " are always processed single threaded."));
+    label_workerInfo->setWordWrap(true);
+
+    auto bb = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
+    QObject::connect(bb, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    QObject::connect(bb, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+
+    auto layout = new QFormLayout(&dialog);
+    layout->addRow(QSL("Worker Threads"), spin_workerCount);
+    layout->addRow(label_workerInfo);
+    layout->addRow(QSL("Histogram Filling"), combo_histoFill);
+    layout->addRow(QSL("Compact Histogram Storage"), cb_compactStorage);
+    layout->addRow(QSL("Operator Fusion"), cb_operatorFusion);
+    layout->addRow(QSL("Sparse Processing"), cb_sparseIndexes);
+    layout->addRow(QSL("Operator Profiling"), cb_profiling);
+    layout->addRow(QSL("Parallel Replay"), cb_parallelReplay);
+    layout->addRow(bb);
+
+    if (dialog.exec() != QDialog::Accepted)
+        return;
+
+    auto histoFill = static_cast<a2::HistoFillStrategyType>(
+        combo_histoFill->currentData().toInt());
+
+    if (spin_workerCount->value() != analysis->getA2WorkerCount()
+        || histoFill != analysis->getA2HistoFillStrategy()
+        || cb_compactStorage->isChecked() != analysis->useCompactHistoStorage()
+        || cb_operatorFusion->isChecked() != analysis->useA2OperatorFusion()
+        || cb_sparseIndexes->isChecked() != analysis->useA2SparseIndexes()
+        || cb_profiling->isChecked() != analysis->useA2OperatorProfiling()
+        || cb_parallelReplay->isChecked() != analysis->useParallelReplay())
+    {
+        AnalysisPauser pauser(m_context);
+        analysis->setA2WorkerCount(spin_workerCount->value());
+        analysis->setA2HistoFillStrategy(histoFill);
+        analysis->setCompactHistoStorage(cb_compactStorage->isChecked());
+        analysis->setA2OperatorFusion(cb_operatorFusion->isChecked());
+        analysis->setA2SparseIndexes(cb_sparseIndexes->isChecked());
+        analysis->setA2OperatorProfiling(cb_profiling->isChecked());
+        analysis->setParallelReplay(cb_parallelReplay->isChecked());
+    }
+}
+
 void handle_session_error(const QString &title, const QString &message)
 {
     SessionErrorDialog dialog(title, message);
@@ -1119,6 +1223,9 @@ AnalysisWidget::AnalysisWidget(MVMEContext *ctx, QWidget *parent)
             show_and_activate(widget);
         });
 
+        m_d->m_toolbar->addAction(QIcon(":/gear.png"), QSL("Processing Options"),
+                                  this, [this]() { m_d->actionProcessingOptions(); });
+
         // pause, resume, step actions and MVLC parser debugging
         m_d->mvlcParserDebugHandler = new MVLCParserDebugHandler(this);
 
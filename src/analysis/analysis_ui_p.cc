@@ -1569,6 +1569,7 @@ OperatorConfigurationWidget::OperatorConfigurationWidget(OperatorInterface *op,
             combo_exportFormat = new QComboBox;
             combo_exportFormat->addItem("Indexed / Sparse", static_cast<int>(ExportSink::Format::Sparse));
             combo_exportFormat->addItem("Plain / Full",     static_cast<int>(ExportSink::Format::Full));
+            combo_exportFormat->addItem("Columnar",         static_cast<int>(ExportSink::Format::Columnar));
 
             formLayout->addRow("Format", combo_exportFormat);
 
@@ -1593,6 +1594,15 @@ OperatorConfigurationWidget::OperatorConfigurationWidget(OperatorInterface *op,
                         ));
             stack->addWidget(label);
 
+            label = make_framed_description_label(QSL(
+                        "Columnar format stores each parameter in a separate"
+                        " column, split into groups of events. Each column chunk"
+                        " carries min/max statistics and is compressed on its own.\n"
+                        "Readers can load only the parameters they need instead"
+                        " of reading every event."
+                        ));
+            stack->addWidget(label);
+
             connect(combo_exportFormat, static_cast<void (QComboBox::*) (int)>(&QComboBox::currentIndexChanged),
                     stack, &QStackedWidget::setCurrentIndex);
 
@@ -2540,7 +2550,13 @@ PipeDisplay::PipeDisplay(Analysis *analysis, Pipe *pipe, bool showDecimals, QWid
     , m_pipe(pipe)
     , m_showDecimals(showDecimals)
     , m_parameterTable(new QTableWidget)
+    , m_observedOperator(qobject_cast<OperatorInterface *>(pipe->source))
 {
+    // Outputs of operators inside fused chains are only updated while
+    // observed.
+    if (m_observedOperator)
+        m_analysis->observeOperatorOutputs(m_observedOperator);
+
     auto layout = new QGridLayout(this);
     s32 row = 0;
 
@@ -2558,10 +2574,22 @@ PipeDisplay::PipeDisplay(Analysis *analysis, Pipe *pipe, bool showDecimals, QWid
     refresh();
 }
 
+PipeDisplay::~PipeDisplay()
+{
+    if (m_analysis && m_observedOperator)
+        m_analysis->unobserveOperatorOutputs(m_observedOperator);
+}
+
 void PipeDisplay::refresh()
 {
     setWindowTitle(m_pipe->parameters.name);
 
+    if (!m_analysis)
+    {
+        m_parameterTable->setRowCount(0);
+        return;
+    }
+
     if (auto a2State = m_analysis->getA2AdapterState())
     {
         a2::PipeVectors pipe = find_output_pipe(a2State, m_pipe);
@@ -2680,6 +2708,8 @@ ExportSinkStatusMonitor::ExportSinkStatusMonitor(const std::shared_ptr<ExportSin
     , label_fileSize(new QLabel)
     , label_eventsWritten(new QLabel)
     , label_bytesWritten(new QLabel)
+    , label_writeQueue(new QLabel)
+    , label_writerStalls(new QLabel)
     , label_status(new QLabel)
     , pb_openDirectory(new QPushButton(QIcon(":/folder_orange.png"), QSL("Open")))
 {
@@ -2701,6 +2731,8 @@ ExportSinkStatusMonitor::ExportSinkStatusMonitor(const std::shared_ptr<ExportSin
         l->addRow(QSL("Output File Size"),  label_fileSize);
         l->addRow(QSL("Bytes Written"),     label_bytesWritten);
         l->addRow(QSL("Events Written"),    label_eventsWritten);
+        l->addRow(QSL("Write Queue"),       label_writeQueue);
+        l->addRow(QSL("Writer Stalls"),     label_writerStalls);
         l->addRow(QSL("Status"),            label_status);
     }
 
@@ -2736,8 +2768,18 @@ void ExportSinkStatusMonitor::update()
         label_outputDirectory->setText(m_sink->getOutputPrefixPath());
         label_fileName->setText(fileName);
         label_fileSize->setText(format_number(fileSize, QSL("B"), UnitScaling::Binary));
-        label_eventsWritten->setText(QString::number(d->eventsWritten));
-        label_bytesWritten->setText(format_number(d->bytesWritten, QSL("B"), UnitScaling::Binary));
+        label_eventsWritten->setText(QString::number(d->eventsWritten.load()));
+        label_bytesWritten->setText(format_number(d->bytesWritten.load(), QSL("B"), UnitScaling::Binary));
+
+        // Full blocks waiting for the writer thread. Stalls happen when the
+        // analysis has to wait for the writer to return a block.
+        auto counters = d->writer.getCounters();
+        label_writeQueue->setText(QSL("%1 / %2 blocks")
+                                  .arg(counters.queueDepth)
+                                  .arg(counters.blockCount));
+        label_writerStalls->setText(QSL("%1 (%2 ms)")
+                                    .arg(counters.stallCount)
+                                    .arg(counters.stallNanoseconds / 1000000));
 
         auto lastError = QString::fromStdString(d->getLastError());
 
@@ -32,6 +32,7 @@
 #include <QGroupBox>
 #include <QLineEdit>
 #include <QPlainTextEdit>
+#include <QPointer>
 #include <QPushButton>
 #include <QRadioButton>
 #include <QSpinBox>
@@ -343,6 +344,7 @@ class PipeDisplay: public QWidget
     Q_OBJECT
     public:
         PipeDisplay(Analysis *analysis, Pipe *pipe, bool showDecimals = true, QWidget *parent = nullptr);
+        ~PipeDisplay() override;
 
         void setShowDecimals(bool showDecimals) { m_showDecimals = showDecimals; }
         bool doesShowDecimals() const { return m_showDecimals; }
@@ -351,10 +353,13 @@ class PipeDisplay: public QWidget
         void refresh();
 
     private:
-        Analysis *m_analysis;
+        QPointer<Analysis> m_analysis;
         Pipe *m_pipe;
         bool m_showDecimals;
         QTableWidget *m_parameterTable;
+        // The operator producing the pipe. Its outputs are observed while
+        // the display is open.
+        OperatorInterface *m_observedOperator;
 };
 
 class CalibrationItemDelegate: public QStyledItemDelegate
@@ -393,6 +398,8 @@ class ExportSinkStatusMonitor: public QWidget
                *label_fileSize,
                *label_eventsWritten,
                *label_bytesWritten,
+               *label_writeQueue,
+               *label_writerStalls,
                *label_status;
 
         QPushButton *pb_openDirectory;
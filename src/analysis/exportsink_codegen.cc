@@ -214,6 +214,7 @@ mu::data ExportSinkCodeGenerator::Private::makeGlobalTemplateData()
     mu::data array_info_list = mu::data::type::list;
 
     size_t arrayIndex = 0;
+    s32 columnCount = 0;
 
     for (auto slot: dataInputs)
     {
@@ -244,6 +245,7 @@ mu::data ExportSinkCodeGenerator::Private::makeGlobalTemplateData()
 
         array_info_list.push_back(array_info);
 
+        columnCount += pipe->getSize();
         arrayIndex++;
     }
 
@@ -254,10 +256,12 @@ mu::data ExportSinkCodeGenerator::Private::makeGlobalTemplateData()
     result["struct_name"]           = struct_name.toStdString();
     result["array_count"]           = QString::number(dataInputs.size()).toStdString();
     result["array_info"]            = mu::data{array_info_list};
+    result["column_count"]          = QString::number(columnCount).toStdString();
     result["mvme_version"]          = GIT_VERSION;
     result["export_date"]           = QDateTime::currentDateTime().toString().toStdString();
     result["sparse?"]               = sink->getFormat() == ExportSink::Format::Sparse;
     result["full?"]                 = sink->getFormat() == ExportSink::Format::Full;
+    result["columnar?"]             = sink->getFormat() == ExportSink::Format::Columnar;
 
     return result;
 }
@@ -276,8 +280,17 @@ void ExportSinkCodeGenerator::Private::generate(RenderFunction render,
         case ExportSink::Format::Sparse:
             fmtString = QSL("sparse");
             break;
+
+        case ExportSink::Format::Columnar:
+            fmtString = QSL("columnar");
+            break;
     }
 
+    // The histogram generators of the row based formats share a template.
+    // The columnar version reads the data column by column.
+    const bool isColumnar = (sink->getFormat() == ExportSink::Format::Columnar);
+    const QString histosTemplatePrefix = isColumnar ? QSL("columnar_") : QString();
+
     const QString headerFilePath = sink->getOutputPrefixPath() + "/" + sink->getExportFileBasename() + ".h";
     const QString implFilePath   = sink->getOutputPrefixPath() + "/" + sink->getExportFileBasename() + ".cpp";
     const QString pyFilePath     = sink->getOutputPrefixPath() + "/" + sink->getExportFileBasename() + ".py";
@@ -306,14 +319,14 @@ void ExportSinkCodeGenerator::Private::generate(RenderFunction render,
         render(QSL(":/analysis/export_templates/CMakeLists.txt.mustache"),
                        data, exportDir.filePath("CMakeLists.txt"), 0, logger);
 
-        render(QSL(":/analysis/export_templates/cpp_root_generate_histos.cpp.mustache"),
+        render(QSL(":/analysis/export_templates/cpp_%1root_generate_histos.cpp.mustache").arg(histosTemplatePrefix),
                        data, exportDir.filePath("root_generate_histos.cpp"), 0, logger);
 
         render(QSL(":/analysis/export_templates/cpp_%1_root_generate_tree.cpp.mustache").arg(fmtString),
                        data, exportDir.filePath("root_generate_tree.cpp"), 0, logger);
 
-        // copy c++ libs
-        if (sink->getCompressionLevel() != 0)
+        // copy c++ libs. The columnar reader uses zlib directly.
+        if (sink->getCompressionLevel() != 0 && !isColumnar)
         {
             mu::data data = mu::data::type::object;
 
@@ -338,7 +351,7 @@ void ExportSinkCodeGenerator::Private::generate(RenderFunction render,
                data, exportDir.filePath("export_dump.py"), TemplateRenderFlags::SetExecutable,
                logger);
 
-        render(QSL(":/analysis/export_templates/pyroot_generate_histos.py.mustache"),
+        render(QSL(":/analysis/export_templates/pyroot_%1generate_histos.py.mustache").arg(histosTemplatePrefix),
                data, exportDir.filePath("pyroot_generate_histos.py"), TemplateRenderFlags::SetExecutable,
                logger);
     }
@@ -34,6 +34,7 @@
 
 #include <QApplication>
 #include <QHeaderView>
+#include <QPointer>
 #include <QTabWidget>
 #include <QTextBrowser>
 
@@ -1146,7 +1147,10 @@ struct ExpressionOperatorDialog::Private
     // scripts
     a2::Operator m_a2Op;
     bool m_lastStepCompileSucceeded = false;
-
+    // Operators producing the input pipes. Their outputs are observed while
+    // the dialog is open so that sampling the inputs yields current values.
+    QSet<OperatorInterface *> m_observedInputs;
+    QPointer<Analysis> m_observingAnalysis;
 
     QTabWidget *m_tabWidget;
 
@@ -1171,6 +1175,8 @@ struct ExpressionOperatorDialog::Private
     void refreshOutputPipesViews();
 
     void postInputsModified();
+    void updateObservedInputs();
+    void unobserveInputs();
 
     void onAddSlotButtonClicked();
     void onRemoveSlotButtonClicked();
@@ -1533,6 +1539,7 @@ void ExpressionOperatorDialog::Private::updateModelFromOperator()
 
     model_compileBeginExpression();
     model_compileStepExpression();
+    updateObservedInputs();
 }
 
 void ExpressionOperatorDialog::Private::updateModelFromGUI()
@@ -1616,6 +1623,57 @@ void ExpressionOperatorDialog::Private::postInputsModified()
     updateModelFromGUI();
     model_compileBeginExpression();
     model_compileStepExpression();
+    updateObservedInputs();
+}
+
+void ExpressionOperatorDialog::Private::updateObservedInputs()
+{
+    QSet<OperatorInterface *> inputs;
+
+    for (auto a1_pipe: m_model->a1_inputPipes)
+    {
+        if (a1_pipe)
+        {
+            if (auto op = qobject_cast<OperatorInterface *>(a1_pipe->source))
+                inputs.insert(op);
+        }
+    }
+
+    auto analysis = m_eventWidget->getAnalysis();
+
+    if (analysis != m_observingAnalysis)
+    {
+        unobserveInputs();
+        m_observingAnalysis = analysis;
+    }
+
+    if (!m_observingAnalysis)
+        return;
+
+    for (auto op: m_observedInputs)
+    {
+        if (!inputs.contains(op))
+            m_observingAnalysis->unobserveOperatorOutputs(op);
+    }
+
+    for (auto op: inputs)
+    {
+        if (!m_observedInputs.contains(op))
+            m_observingAnalysis->observeOperatorOutputs(op);
+    }
+
+    m_observedInputs = inputs;
+}
+
+void ExpressionOperatorDialog::Private::unobserveInputs()
+{
+    if (m_observingAnalysis)
+    {
+        for (auto op: m_observedInputs)
+            m_observingAnalysis->unobserveOperatorOutputs(op);
+    }
+
+    m_observedInputs.clear();
 }
 
 void ExpressionOperatorDialog::Private::refreshInputPipesViews()
@@ -2120,6 +2178,7 @@ ExpressionOperatorDialog::ExpressionOperatorDialog(const std::shared_ptr<Express
 
 ExpressionOperatorDialog::~ExpressionOperatorDialog()
 {
+    m_d->unobserveInputs();
 }
 
 void ExpressionOperatorDialog::apply()
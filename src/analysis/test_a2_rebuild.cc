@@ -0,0 +1,150 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include <memory>
+#include "gtest/gtest.h"
+#include "analysis/analysis.h"
+
+using namespace analysis;
+
+namespace
+{
+
+// Single event, single module: data source with 4 address and 4 data bits,
+// a calibration of its output and a 1D histogram of the calibrated values.
+struct TestAnalysis
+{
+    QUuid eventId = QUuid::createUuid();
+    QUuid moduleId = QUuid::createUuid();
+    vme_analysis_common::VMEIdToIndex vmeMap;
+    std::unique_ptr<Analysis> analysis;
+    std::shared_ptr<Extractor> source;
+    std::shared_ptr<Histo1DSink> calSink;
+
+    explicit TestAnalysis(int workerCount)
+        : analysis(std::make_unique<Analysis>())
+    {
+        vmeMap.insert(eventId, { 0, -1 });
+        vmeMap.insert(moduleId, { 0, 0 });
+
+        analysis->setA2WorkerCount(workerCount);
+
+        source = std::make_shared<Extractor>();
+        source->setFilter(MultiWordDataFilter({ DataFilter("AAAADDDD") }));
+        analysis->addSource(eventId, moduleId, source);
+
+        auto cal = std::make_shared<CalibrationMinMax>();
+        cal->connectArrayToInputSlot(0, source->getOutput(0));
+
+        for (s32 addr = 0; addr < 16; addr++)
+            cal->setCalibration(addr, 0.0, 16.0);
+
+        analysis->addOperator(eventId, 0, cal);
+
+        calSink = std::make_shared<Histo1DSink>();
+        calSink->connectArrayToInputSlot(0, cal->getOutput(0));
+        analysis->addOperator(eventId, 0, calSink);
+    }
+
+    // One data word for each of the 16 addresses per event.
+    void processEvents(int count)
+    {
+        std::vector<u32> data;
+
+        for (u32 addr = 0; addr < 16; addr++)
+            data.push_back((addr << 4) | (addr & 0xf));
+
+        for (int i = 0; i < count; i++)
+        {
+            analysis->beginEvent(0);
+            analysis->processModuleData(0, 0, data.data(), data.size());
+            analysis->endEvent(0);
+        }
+    }
+};
+
+double entry_count(const Histo1DSink &sink, s32 histoIndex)
+{
+    return sink.m_histos.value(histoIndex)->calcStatistics().entryCount;
+}
+
+void test_add_sink_below_max_rank(int workerCount)
+{
+    const int EventCount = 1000;
+
+    TestAnalysis t(workerCount);
+
+    RunInfo runInfo;
+    runInfo.runId = "test";
+    t.analysis->beginRun(runInfo, t.vmeMap);
+    ASSERT_TRUE(t.analysis->getA2AdapterState()->operatorErrors.isEmpty());
+
+    t.processEvents(EventCount);
+
+    // The new sink has a lower rank than the calibration sink. A full build
+    // places it before the calibration sink, the incremental build appends it.
+    auto rawSink = std::make_shared<Histo1DSink>();
+    rawSink->connectArrayToInputSlot(0, t.source->getOutput(0));
+    t.analysis->addOperator(t.eventId, 0, rawSink);
+    t.analysis->beginRun(Analysis::KeepState);
+
+    const auto buildInfo = t.analysis->getLastA2BuildInfo();
+
+    if (workerCount > 1)
+    {
+        // Worker instances are merged by operator position and require a
+        // full build of the primary instance.
+        ASSERT_FALSE(buildInfo.incremental);
+        ASSERT_EQ(t.analysis->getActiveA2WorkerCount(), workerCount);
+    }
+    else
+    {
+        ASSERT_TRUE(buildInfo.incremental);
+    }
+
+    t.processEvents(EventCount);
+    t.analysis->syncHistograms();
+
+    for (s32 hi = 0; hi < 16; hi++)
+    {
+        ASSERT_EQ(entry_count(*t.calSink, hi), 2 * EventCount) << "histo " << hi;
+        ASSERT_EQ(entry_count(*rawSink, hi), EventCount) << "histo " << hi;
+    }
+
+    t.analysis->endRun();
+
+    for (s32 hi = 0; hi < 16; hi++)
+    {
+        ASSERT_EQ(entry_count(*t.calSink, hi), 2 * EventCount) << "histo " << hi;
+        ASSERT_EQ(entry_count(*rawSink, hi), EventCount) << "histo " << hi;
+    }
+}
+
+} // end anon namespace
+
+TEST(A2Rebuild, AddSinkBelowMaxRankIncremental)
+{
+    test_add_sink_below_max_rank(1);
+}
+
+TEST(A2Rebuild, AddSinkBelowMaxRankWithWorkers)
+{
+    test_add_sink_below_max_rank(4);
+}
@@ -2269,6 +2269,7 @@ void EventWidgetPrivate::appendTreesToView(UserLevelTrees trees)
     {
         tree->setEventWidget(m_q);
         tree->setUserLevel(levelIndex);
+        tree->setObjectCounters(&m_objectCounters);
 
         // mouse interaction
         QObject::connect(tree, &QTreeWidget::itemClicked,
@@ -4450,237 +4451,264 @@ void EventWidgetPrivate::doPeriodicUpdate()
     periodicUpdateHistoCounters(dt_s);
     periodicUpdateEventRate(dt_s);
 
+    m_objectCounters.dt_s = dt_s;
+
+    // Repaint the trees. The views only request the text of the visible
+    // nodes.
+    for (const auto &trees: m_levelTrees)
+    {
+        for (auto tree: trees.getObjectTrees())
+            tree->viewport()->update();
+    }
+
     m_prevAnalysisTimeticks = currentAnalysisTimeticks;
 }
 
-void EventWidgetPrivate::periodicUpdateExtractorCounters(double dt_s)
+namespace
 {
-    auto analysis = m_context->getAnalysis();
-    auto a2State = analysis->getA2AdapterState();
 
-    //
-    // level 0: operator tree (Extractor hitcounts)
-    //
-    for (auto iter = QTreeWidgetItemIterator(m_levelTrees[0].operatorTree);
-         *iter; ++iter)
+// Stores the current counts in the entry and calculates the rates using the
+// counts of the previous snapshot.
+template<typename GetCount>
+void update_counters_entry(ObjectCounters::Entry &entry, s32 size, double dt_s,
+                           GetCount getCount)
+{
+    entry.counts.resize(size);
+    entry.rates.resize(size);
+
+    for (s32 i = 0; i < size; ++i)
     {
-        auto node(*iter);
+        double count = getCount(i);
+        entry.rates[i] = calc_delta0(count, entry.counts[i]) / dt_s;
+        entry.counts[i] = count;
+    }
+}
 
-        if (node->type() == NodeType_Source)
-        {
-            auto source = qobject_cast<SourceInterface *>(get_pointer<PipeSourceInterface>(
-                    node, DataRole_AnalysisObject));
+QString make_rate_string(double rate)
+{
+    return format_number(rate, QSL("cps"), UnitScaling::Decimal, 0, 'g', 3);
+}
 
-            if (!source)
-                continue;
+QVariant make_parameter_node_text(const TreeNode *node, const ObjectCounters &counters)
+{
+    auto sourceNode = node->parent();
 
-            if (source->getModuleId().isNull()) // source not assigned to a module
-                continue;
+    if (!sourceNode || sourceNode->type() != NodeType_Source)
+        return {};
 
-            auto ds_a2 = a2State->sourceMap.value(source, nullptr);
+    auto source = qobject_cast<SourceInterface *>(get_pointer<PipeSourceInterface>(
+            sourceNode, DataRole_AnalysisObject));
 
-            if (!ds_a2)
-                continue;
+    auto it = counters.extractors.find(source);
 
-            auto hitCounts = to_qvector(ds_a2->hitCounts);
+    if (it == counters.extractors.end())
+        return {};
 
-            if (hitCounts.size() != node->childCount())
-                continue;
+    s32 addr = node->data(0, DataRole_ParameterIndex).toInt();
 
-            auto &prevHitCounts = m_extractorCounters[source].hitCounts;
+    if (addr < 0 || addr >= it->counts.size())
+        return {};
 
-            prevHitCounts.resize(hitCounts.size());
+    QString addrString = QSL("%1").arg(addr, 2);
 
-            auto hitCountDeltas = calc_deltas0(hitCounts, prevHitCounts);
-            auto hitCountRates = hitCountDeltas;
-            std::for_each(hitCountRates.begin(), hitCountRates.end(),
-                          [dt_s](double &d) { d /= dt_s; });
+    QStringList paramNames;
 
-            Q_ASSERT(hitCounts.size() == node->childCount());
+    if (auto ex = qobject_cast<Extractor *>(source))
+        paramNames = ex->getParameterNames();
+    else if (auto ex = qobject_cast<ListFilterExtractor *>(source))
+        paramNames = ex->getParameterNames();
 
-            QStringList paramNames;
+    if (addr < paramNames.size())
+    {
+        addrString += " " + paramNames[addr];
+    }
 
-            if (auto ex = qobject_cast<Extractor *>(source))
-                paramNames = ex->getParameterNames();
-            else if (auto ex = qobject_cast<ListFilterExtractor *>(source))
-                paramNames = ex->getParameterNames();
+    addrString.replace(QSL(" "), QSL("&nbsp;"));
 
-            for (s32 addr = 0; addr < node->childCount(); ++addr)
-            {
-                Q_ASSERT(node->child(addr)->type() == NodeType_OutputPipeParameter);
+    double hitCount = it->counts[addr];
 
-                QString addrString = QSL("%1").arg(addr, 2);
+    if (hitCount <= 0.0)
+        return addrString;
 
-                if (addr < paramNames.size())
-                {
-                    addrString += " " + paramNames[addr];
-                }
+    double rate = it->rates[addr];
 
-                addrString.replace(QSL(" "), QSL("&nbsp;"));
+    if (!std::isfinite(rate)) rate = 0.0;
 
-                double hitCount = hitCounts[addr];
-                auto childNode = node->child(addr);
+    return QString("%1 (hits=%2, rate=%3, dt=%4 s)")
+        .arg(addrString)
+        .arg(hitCount)
+        .arg(make_rate_string(rate))
+        .arg(counters.dt_s);
+}
 
-                if (hitCount <= 0.0)
-                {
-                    childNode->setText(0, addrString);
-                }
-                else
-                {
-                    double rate = hitCountRates[addr];
+QVariant make_histo1d_node_text(const TreeNode *node, const ObjectCounters &counters)
+{
+    auto sinkNode = node->parent();
 
-                    if (!std::isfinite(rate)) rate = 0.0;
+    if (!sinkNode || sinkNode->type() != NodeType_Histo1DSink)
+        return {};
 
-                    auto rateString = format_number(rate, QSL("cps"), UnitScaling::Decimal,
-                                                    0, 'g', 3);
+    auto histoSink = get_pointer<Histo1DSink>(sinkNode, DataRole_AnalysisObject);
+    auto it = counters.histo1DSinks.find(histoSink);
 
-                    childNode->setText(0, QString("%1 (hits=%2, rate=%3, dt=%4 s)")
-                                       .arg(addrString)
-                                       .arg(hitCount)
-                                       .arg(rateString)
-                                       .arg(dt_s)
-                                      );
-                }
-            }
+    if (it == counters.histo1DSinks.end())
+        return {};
 
-            prevHitCounts = hitCounts;
-        }
-    }
+    s32 addr = node->data(0, DataRole_HistoAddress).toInt();
+
+    if (addr < 0 || addr >= it->counts.size())
+        return {};
+
+    QString numberString = QString("%1").arg(addr, 2).replace(QSL(" "), QSL("&nbsp;"));
+
+    double entryCount = it->counts[addr];
+
+    if (entryCount <= 0.0)
+        return numberString;
+
+    double rate = it->rates[addr];
+    if (std::isnan(rate)) rate = 0.0;
+
+    return QString("%1 (entries=%2, rate=%3, dt=%4 s)")
+        .arg(numberString)
+        .arg(entryCount)
+        .arg(make_rate_string(rate))
+        .arg(counters.dt_s);
 }
 
-void EventWidgetPrivate::periodicUpdateHistoCounters(double dt_s)
+QVariant make_histo2d_sink_node_text(const TreeNode *node, const ObjectCounters &counters)
 {
-    auto analysis = m_context->getAnalysis();
-    auto a2State = analysis->getA2AdapterState();
+    auto sink = get_pointer<Histo2DSink>(const_cast<TreeNode *>(node), DataRole_AnalysisObject);
+    auto it = counters.histo2DSinks.find(sink);
 
-    //
-    // level > 0: display trees (histo counts)
-    //
-    for (auto trees: m_levelTrees)
-    {
-        for (auto iter = QTreeWidgetItemIterator(trees.sinkTree);
-             *iter; ++iter)
-        {
-            auto node(*iter);
+    if (it == counters.histo2DSinks.end() || it->counts.isEmpty())
+        return {};
 
-            if (node->type() == NodeType_Histo1DSink)
-            {
-                auto histoSink = qobject_cast<Histo1DSink *>(get_pointer<OperatorInterface>(
-                        node, DataRole_AnalysisObject));
+    double entryCount = it->counts[0];
 
-                if (!histoSink)
-                    continue;
+    if (entryCount <= 0.0)
+    {
+        return QString("<b>%1</b> %2")
+            .arg(sink->getShortName())
+            .arg(sink->objectName());
+    }
 
-                if (histoSink->m_histos.size() != node->childCount())
-                    continue;
+    double countRate = it->rates[0];
+    if (std::isnan(countRate)) countRate = 0.0;
 
+    return QString("<b>%1</b> %2 (entries=%3, rate=%4, dt=%5)")
+        .arg(sink->getShortName())
+        .arg(sink->objectName())
+        .arg(entryCount, 0, 'g', 3)
+        .arg(make_rate_string(countRate))
+        .arg(counters.dt_s);
+}
 
-                QVector<double> entryCounts;
+} // end anon namespace
 
-                if (auto sinkData = get_runtime_h1dsink_data(*a2State, histoSink))
-                {
-                    entryCounts.reserve(sinkData->histos.size);
-                    std::transform(std::begin(sinkData->histos), std::end(sinkData->histos),
-                                   std::back_inserter(entryCounts),
-                                   [] (const auto &histo) { return histo.entryCount; });
-                }
+QVariant TreeNode::data(int column, int role) const
+{
+    if (column == 0 && role == Qt::DisplayRole)
+    {
+        auto tree = qobject_cast<ObjectTree *>(treeWidget());
+        auto counters = tree ? tree->getObjectCounters() : nullptr;
 
-                auto &prevEntryCounts = m_histo1DSinkCounters[histoSink].hitCounts;
+        if (counters)
+        {
+            QVariant result;
 
-                prevEntryCounts.resize(entryCounts.size());
+            switch (type())
+            {
+                case NodeType_OutputPipeParameter:
+                    result = make_parameter_node_text(this, *counters);
+                    break;
 
-                auto entryCountDeltas = calc_deltas0(entryCounts, prevEntryCounts);
-                auto entryCountRates = entryCountDeltas;
-                std::for_each(entryCountRates.begin(), entryCountRates.end(),
-                              [dt_s](double &d) { d /= dt_s; });
+                case NodeType_Histo1D:
+                    result = make_histo1d_node_text(this, *counters);
+                    break;
 
-                auto maxCount = std::min(entryCounts.size(), node->childCount());
+                case NodeType_Histo2DSink:
+                    result = make_histo2d_sink_node_text(this, *counters);
+                    break;
+            }
 
-                for (s32 addr = 0; addr < maxCount; ++addr)
-                {
-                    Q_ASSERT(node->child(addr)->type() == NodeType_Histo1D);
+            if (result.isValid())
+                return result;
+        }
+    }
 
-                    QString numberString = QString("%1").arg(addr, 2).replace(QSL(" "), QSL("&nbsp;"));
+    return CheckStateNotifyingNode::data(column, role);
+}
 
-                    double entryCount = entryCounts[addr];
-                    auto childNode = node->child(addr);
+void EventWidgetPrivate::periodicUpdateExtractorCounters(double dt_s)
+{
+    auto analysis = m_context->getAnalysis();
+    auto a2State = analysis->getA2AdapterState();
 
-                    if (entryCount <= 0.0)
-                    {
-                        childNode->setText(0, numberString);
-                    }
-                    else
-                    {
-                        double rate = entryCountRates[addr];
-                        if (std::isnan(rate)) rate = 0.0;
-
-                        auto rateString = format_number(rate, QSL("cps"), UnitScaling::Decimal,
-                                                        0, 'g', 3);
-
-                        childNode->setText(0, QString("%1 (entries=%2, rate=%3, dt=%4 s)")
-                                           .arg(numberString)
-                                           .arg(entryCount)
-                                           .arg(rateString)
-                                           .arg(dt_s)
-                                          );
-                    }
-                }
+    // Take a snapshot of the extractor hit counts. Entries of sources that
+    // do not exist anymore are dropped, existing entries are reused.
+    auto prevCounters = std::move(m_objectCounters.extractors);
+    m_objectCounters.extractors.clear();
 
-                prevEntryCounts = entryCounts;
-            }
-            else if (node->type() == NodeType_Histo2DSink)
-            {
-                auto sink = get_pointer<Histo2DSink>(node, DataRole_AnalysisObject);
-                auto histo = sink ? sink->m_histo : nullptr;
+    for (const auto &source: analysis->getSourcesByEvent(m_eventId))
+    {
+        if (source->getModuleId().isNull()) // source not assigned to a module
+            continue;
 
-                // hack: do not update node text while it is selected.
-                // This may fix the issue where inline editing of the
-                // histoname was overriden by these periodic timer udpates.
+        auto ds_a2 = a2State->sourceMap.value(source.get(), nullptr);
 
-                if (histo && !node->isSelected())
-                {
-                    double entryCount = 0.0;
+        if (!ds_a2)
+            continue;
 
-                    if (auto sinkData = get_runtime_h2dsink_data(*a2State, sink))
-                        entryCount = sinkData->histo.entryCount;
+        auto &entry = m_objectCounters.extractors[source.get()];
+        entry = prevCounters.take(source.get());
 
-                    auto &prevEntryCounts = m_histo2DSinkCounters[sink].hitCounts;
-                    prevEntryCounts.resize(1);
+        update_counters_entry(entry, ds_a2->hitCounts.size, dt_s,
+                              [ds_a2] (s32 i) { return ds_a2->hitCounts[i]; });
+    }
+}
 
-                    double prevEntryCount = prevEntryCounts[0];
+void EventWidgetPrivate::periodicUpdateHistoCounters(double dt_s)
+{
+    auto analysis = m_context->getAnalysis();
+    auto a2State = analysis->getA2AdapterState();
 
-                    double countDelta = calc_delta0(entryCount, prevEntryCount);
-                    double countRate = countDelta / dt_s;
+    auto prevH1DCounters = std::move(m_objectCounters.histo1DSinks);
+    auto prevH2DCounters = std::move(m_objectCounters.histo2DSinks);
+    m_objectCounters.histo1DSinks.clear();
+    m_objectCounters.histo2DSinks.clear();
 
-                    if (entryCount <= 0.0)
-                    {
-                        node->setText(0, QString("<b>%1</b> %2")
-                                      .arg(sink->getShortName())
-                                      .arg(sink->objectName())
-                                     );
-                    }
-                    else
-                    {
-                        if (std::isnan(countRate)) countRate = 0.0;
-
-                        auto rateString = format_number(countRate, QSL("cps"), UnitScaling::Decimal,
-                                                        0, 'g', 3);
-
-                        node->setText(0, QString("<b>%1</b> %2 (entries=%3, rate=%4, dt=%5)")
-                                      .arg(sink->getShortName())
-                                      .arg(sink->objectName())
-                                      .arg(entryCount, 0, 'g', 3)
-                                      .arg(rateString)
-                                      .arg(dt_s)
-                                     );
-                    }
+    for (const auto &op: analysis->getOperators(m_eventId))
+    {
+        if (auto histoSink = qobject_cast<Histo1DSink *>(op.get()))
+        {
+            auto &entry = m_objectCounters.histo1DSinks[histoSink];
+            entry = prevH1DCounters.take(histoSink);
 
-                    prevEntryCounts[0] = entryCount;
-                }
+            if (auto sinkData = get_runtime_h1dsink_data(*a2State, histoSink))
+            {
+                update_counters_entry(entry, sinkData->histos.size, dt_s,
+                                      [sinkData] (s32 i) { return sinkData->histos[i].entryCount; });
+            }
+            else
+            {
+                entry = {};
             }
         }
-    }
+        else if (auto sink = qobject_cast<Histo2DSink *>(op.get()))
+        {
+            auto &entry = m_objectCounters.histo2DSinks[sink];
+            entry = prevH2DCounters.take(sink);
+
+            double entryCount = 0.0;
 
+            if (auto sinkData = get_runtime_h2dsink_data(*a2State, sink))
+                entryCount = sinkData->histo.entryCount;
+
+            update_counters_entry(entry, 1, dt_s,
+                                  [entryCount] (s32) { return entryCount; });
+        }
+    }
 }
 
 void EventWidgetPrivate::periodicUpdateEventRate(double dt_s)
@@ -89,6 +89,30 @@ class TreeNode: public CheckStateNotifyingNode
             }
             return CheckStateNotifyingNode::operator<(other);
         }
+
+        // Produces the display text of extractor parameter, histogram and
+        // Histo2DSink nodes from the ObjectCounters of the tree.
+        virtual QVariant data(int column, int role) const override;
+};
+
+/* Periodically updated extractor hit counts and histo sink entry counts and
+ * their rates. The EventWidget only takes snapshots of the counters. The
+ * node texts are created on demand by TreeNode::data(), i.e. only for the
+ * rows the views actually paint. */
+struct ObjectCounters
+{
+    struct Entry
+    {
+        QVector<double> counts;
+        QVector<double> rates;
+    };
+
+    QHash<SourceInterface *, Entry> extractors;
+    QHash<Histo1DSink *, Entry> histo1DSinks;
+    QHash<Histo2DSink *, Entry> histo2DSinks;
+
+    // Time between the last two snapshots.
+    double dt_s = 0.0;
 };
 
 /* Specialized tree for the EventWidget.
@@ -125,6 +149,9 @@ class ObjectTree: public QTreeWidget, public CheckStateObserver
 
         void setCheckStateChangeHandler(const CheckStateChangeHandler &csh) { m_csh = csh; }
 
+        const ObjectCounters *getObjectCounters() const { return m_counters; }
+        void setObjectCounters(const ObjectCounters *counters) { m_counters = counters; }
+
         virtual void checkStateChanged(QTreeWidgetItem *node, const QVariant &prev) override
         {
             if (m_csh)
@@ -142,6 +169,7 @@ class ObjectTree: public QTreeWidget, public CheckStateObserver
         EventWidget *m_eventWidget = nullptr;
         s32 m_userLevel = 0;
         CheckStateChangeHandler m_csh;
+        const ObjectCounters *m_counters = nullptr;
 };
 
 class OperatorTree: public ObjectTree
@@ -290,14 +318,7 @@ struct EventWidgetPrivate
     QToolBar* m_eventSelectAreaToolBar;
 
     // Periodically updated extractor hit counts and histo sink entry counts.
-    struct ObjectCounters
-    {
-        QVector<double> hitCounts;
-    };
-
-    QHash<SourceInterface *, ObjectCounters> m_extractorCounters;
-    QHash<Histo1DSink *, ObjectCounters> m_histo1DSinkCounters;
-    QHash<Histo2DSink *, ObjectCounters> m_histo2DSinkCounters;
+    ObjectCounters m_objectCounters;
     MVMEStreamProcessorCounters m_prevStreamProcessorCounters;
 
     double m_prevAnalysisTimeticks = 0.0;
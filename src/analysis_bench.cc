@@ -169,6 +169,49 @@ QJsonObject collect_streamproc_counters(const MVMEStreamProcessorCounters &count
     return streamProcCounters;
 }
 
+QJsonObject to_json(const analysis::Analysis::A2OperatorProfile &entry)
+{
+    QJsonObject result;
+
+    if (!entry.id.isNull())
+        result["id"] = entry.id.toString();
+
+    result["name"] = entry.name;
+    result["className"] = entry.className;
+
+    if (entry.eventIndex >= 0)
+        result["eventIndex"] = entry.eventIndex;
+    else
+        result["operatorCount"] = entry.operatorCount;
+
+    result["time"] = static_cast<qint64>(entry.time);
+    result["stepCount"] = static_cast<qint64>(entry.stepCount);
+    result["condSkipCount"] = static_cast<qint64>(entry.condSkipCount);
+
+    return result;
+}
+
+QJsonObject collect_operator_profile(const MVMEContext &mvmeContext)
+{
+    auto info = mvmeContext.getAnalysis()->getA2ProfileInfo();
+
+    QJsonArray operatorsArray;
+    QJsonArray typesArray;
+
+    for (const auto &entry: info.operators)
+        operatorsArray.append(to_json(entry));
+
+    for (const auto &entry: info.operatorTypes)
+        typesArray.append(to_json(entry));
+
+    QJsonObject result;
+    result["timeUnit"] = info.timeUnit;
+    result["operators"] = operatorsArray;
+    result["operatorTypes"] = typesArray;
+
+    return result;
+}
+
 } // end anon namespace
 
 QJsonObject make_analysis_benchmark_info(const MVMEContext &mvmeContext)
@@ -177,6 +220,10 @@ QJsonObject make_analysis_benchmark_info(const MVMEContext &mvmeContext)
     reportJ["H1DSinks"] = collect_h1d_stats(mvmeContext);
     reportJ["H2DSinks"] = collect_h2d_stats(mvmeContext);
 
+    // Sorted by descending time.
+    if (mvmeContext.getAnalysis()->getA2ProfileInfo().enabled)
+        reportJ["OperatorProfile"] = collect_operator_profile(mvmeContext);
+
     if (auto streamWorker = mvmeContext.getMVMEStreamWorker())
     {
         auto countersJ = collect_streamproc_counters(streamWorker->getCounters());
@@ -110,6 +110,9 @@ DAQControlWidget::DAQControlWidget(QWidget *parent)
     , rb_clearData(new QRadioButton("Clear"))
     , bg_daqData(new QButtonGroup(this))
     , spin_runDuration(new QSpinBox(this))
+    , combo_replayRangeUnit(new QComboBox(this))
+    , spin_replayBegin(new QSpinBox(this))
+    , spin_replayEnd(new QSpinBox(this))
 {
     bg_daqData->addButton(rb_keepData);
     bg_daqData->addButton(rb_clearData);
@@ -214,7 +217,33 @@ DAQControlWidget::DAQControlWidget(QWidget *parent)
         emit listFileOutputInfoModified(m_listFileOutputInfo);
     });
 
+    combo_replayRangeUnit->addItem(QSL("Full listfile"), ReplayRange::All);
+    combo_replayRangeUnit->addItem(QSL("Seconds"), ReplayRange::Timeticks);
+    combo_replayRangeUnit->addItem(QSL("Events"), ReplayRange::Events);
 
+    auto emit_replay_range = [this] ()
+    {
+        ReplayRange range;
+        range.unit = static_cast<ReplayRange::Unit>(combo_replayRangeUnit->currentData().toInt());
+        range.begin = spin_replayBegin->value();
+
+        // A 'to' value of 0 is shown as "end" and means replay until the end
+        // of the listfile.
+        if (spin_replayEnd->value() > 0)
+            range.end = spin_replayEnd->value();
+
+        emit replayRangeModified(range);
+        updateWidget();
+    };
+
+    connect(combo_replayRangeUnit, qOverload<int>(&QComboBox::currentIndexChanged),
+            this, emit_replay_range);
+
+    connect(spin_replayBegin, qOverload<int>(&QSpinBox::valueChanged),
+            this, emit_replay_range);
+
+    connect(spin_replayEnd, qOverload<int>(&QSpinBox::valueChanged),
+            this, emit_replay_range);
 
     //
     // layout
@@ -277,6 +306,31 @@ DAQControlWidget::DAQControlWidget(QWidget *parent)
         stateFrameLayout->addRow(QSL("Run duration:"), l);
     }
 
+    // replay range
+    {
+        for (auto spin: { spin_replayBegin, spin_replayEnd })
+        {
+            spin->setMinimum(0);
+            spin->setMaximum(std::numeric_limits<int>::max());
+        }
+
+        spin_replayEnd->setSpecialValueText(QSL("end"));
+
+        auto l = make_hbox<0, 2>();
+        l->addWidget(combo_replayRangeUnit);
+        l->addWidget(new QLabel(QSL("from")));
+        l->addWidget(spin_replayBegin);
+        l->addWidget(new QLabel(QSL("to")));
+        l->addWidget(spin_replayEnd);
+        l->addStretch(1);
+        stateFrameLayout->addRow(QSL("Replay range:"), l);
+
+        combo_replayRangeUnit->setToolTip(
+            QSL("Replay only a part of the listfile. Requires the listfile index"
+                " written by this version of mvme. The range is rounded outwards"
+                " to the nearest index checkpoints."));
+    }
+
     // vme controller
     {
         auto ctrlLayout = new QGridLayout;
@@ -557,6 +611,14 @@ void DAQControlWidget::updateWidget()
     rb_clearData->setEnabled(daqState == DAQState::Idle);
     spin_runDuration->setEnabled(daqState == DAQState::Idle && globalMode == GlobalMode::DAQ);
 
+    {
+        const bool enableRange = isDAQIdle && isReplay;
+        const bool isPartial = combo_replayRangeUnit->currentData().toInt() != ReplayRange::All;
+        combo_replayRangeUnit->setEnabled(enableRange);
+        spin_replayBegin->setEnabled(enableRange && isPartial);
+        spin_replayEnd->setEnabled(enableRange && isPartial);
+    }
+
     QString stateString;
 
     switch (controllerState)
@@ -667,6 +729,10 @@ void DAQControlWidget::updateWidget()
                 auto str = format_number(fi.size(), QSL("B"), UnitScaling::Binary,
                                          // fieldWidth, format, precision
                                          0, 'f', 2);
+
+                if (auto ratio = stats.getListFileCompressionRatio())
+                    str += QSL(" (compression ratio %1)").arg(ratio, 0, 'f', 2);
+
                 label_listfileSize->setText(str);
             } break;
 
@@ -704,6 +770,7 @@ DAQRunSettingsDialog::DAQRunSettingsDialog(const ListFileOutputInfo &settings, Q
     , spin_runNumber(new QSpinBox(this))
     , cb_useRunNumber(new QCheckBox(this))
     , cb_useTimestamp(new QCheckBox(this))
+    , spin_compressionThreads(new QSpinBox(this))
     , le_exampleName(new QLineEdit(this))
     , m_bb(new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this))
 {
@@ -712,6 +779,11 @@ DAQRunSettingsDialog::DAQRunSettingsDialog(const ListFileOutputInfo &settings, Q
 
     le_exampleName->setReadOnly(true);
     spin_runNumber->setMinimum(1);
+    spin_compressionThreads->setRange(0, 64);
+    spin_compressionThreads->setSpecialValueText(QSL("Listfile writer thread"));
+    spin_compressionThreads->setToolTip(QSL(
+            "Number of threads compressing LZ4 listfiles in parallel.\n"
+            "Only used by the MVLC with LZ4 compression."));
 
     auto re_prefix = QRegularExpression(QSL("^[^\\\\/]+$"));
     le_prefix->setValidator(new QRegularExpressionValidator(re_prefix, le_prefix));
@@ -721,6 +793,7 @@ DAQRunSettingsDialog::DAQRunSettingsDialog(const ListFileOutputInfo &settings, Q
     spin_runNumber->setValue(settings.runNumber);
     cb_useRunNumber->setChecked(settings.flags & ListFileOutputInfo::UseRunNumber);
     cb_useTimestamp->setChecked(settings.flags & ListFileOutputInfo::UseTimestamp);
+    spin_compressionThreads->setValue(settings.compressionThreads);
 
     connect(le_prefix, &QLineEdit::textEdited, this, [this](const QString &text) {
         m_settings.prefix = text;
@@ -757,6 +830,11 @@ DAQRunSettingsDialog::DAQRunSettingsDialog(const ListFileOutputInfo &settings, Q
         updateExample();
     });
 
+    connect(spin_compressionThreads, static_cast<void (QSpinBox::*)(int num)>(&QSpinBox::valueChanged),
+            this, [this] (int num) {
+                m_settings.compressionThreads = num;
+            });
+
     QObject::connect(m_bb, &QDialogButtonBox::accepted, this, &QDialog::accept);
     QObject::connect(m_bb, &QDialogButtonBox::rejected, this, &QDialog::reject);
 
@@ -767,6 +845,8 @@ DAQRunSettingsDialog::DAQRunSettingsDialog(const ListFileOutputInfo &settings, Q
     widgetLayout->addRow(QSL("Next Run Number"), spin_runNumber);
     widgetLayout->addRow(QSL("Use Timestamp"), cb_useTimestamp);
     widgetLayout->addRow(make_separator_frame());
+    widgetLayout->addRow(QSL("LZ4 Compression Threads"), spin_compressionThreads);
+    widgetLayout->addRow(make_separator_frame());
     widgetLayout->addRow(QSL("Example filename"), le_exampleName);
     widgetLayout->addRow(m_bb);
 
@@ -787,6 +867,8 @@ WorkspaceSettingsDialog::WorkspaceSettingsDialog(const std::shared_ptr<QSettings
     , le_eventServerListenAddress(new QLineEdit)
     , spin_jsonRPCListenPort(new QSpinBox)
     , spin_eventServerListenPort(new QSpinBox)
+    , spin_eventServerQueueCapacity(new QSpinBox)
+    , combo_eventServerOverflowPolicy(new QComboBox)
     , cb_ignoreStartupErrors(new QCheckBox("Ignore VME Init Startup Errors"))
     , m_bb(new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this))
     , m_settings(settings)
@@ -831,6 +913,12 @@ WorkspaceSettingsDialog::WorkspaceSettingsDialog(const std::shared_ptr<QSettings
     gb_eventServer->setCheckable(true);
     spin_eventServerListenPort->setMinimum(1);
     spin_eventServerListenPort->setMaximum((1 << 16) - 1);
+    spin_eventServerQueueCapacity->setMinimum(16);
+    spin_eventServerQueueCapacity->setMaximum(1 << 20);
+    spin_eventServerQueueCapacity->setSuffix(QSL(" messages"));
+    combo_eventServerOverflowPolicy->addItem(QSL("Block (wait for clients)"), QSL("block"));
+    combo_eventServerOverflowPolicy->addItem(QSL("Drop newest data"), QSL("drop_newest"));
+    combo_eventServerOverflowPolicy->addItem(QSL("Disconnect slow clients"), QSL("disconnect"));
 
     {
         auto label = new QLabel(QSL(
@@ -846,6 +934,8 @@ WorkspaceSettingsDialog::WorkspaceSettingsDialog(const std::shared_ptr<QSettings
         l->addRow(label);
         l->addRow(QSL("Listen Address"), le_eventServerListenAddress);
         l->addRow(QSL("Listen Port"), spin_eventServerListenPort);
+        l->addRow(QSL("Client Queue Size"), spin_eventServerQueueCapacity);
+        l->addRow(QSL("Queue Overflow"), combo_eventServerOverflowPolicy);
     }
 
     widgetLayout->addWidget(gb_jsonRPC);
@@ -873,6 +963,11 @@ void WorkspaceSettingsDialog::populate()
     gb_eventServer->setChecked(m_settings->value(QSL("EventServer/Enabled")).toBool());
     le_eventServerListenAddress->setText(m_settings->value(QSL("EventServer/ListenAddress")).toString());
     spin_eventServerListenPort->setValue(m_settings->value(QSL("EventServer/ListenPort")).toInt());
+    spin_eventServerQueueCapacity->setValue(m_settings->value(QSL("EventServer/QueueCapacity")).toInt());
+
+    int policyIndex = combo_eventServerOverflowPolicy->findData(
+        m_settings->value(QSL("EventServer/OverflowPolicy")).toString());
+    combo_eventServerOverflowPolicy->setCurrentIndex(std::max(policyIndex, 0));
 }
 
 void WorkspaceSettingsDialog::accept()
@@ -889,6 +984,9 @@ void WorkspaceSettingsDialog::accept()
     m_settings->setValue(QSL("EventServer/Enabled"), gb_eventServer->isChecked());
     m_settings->setValue(QSL("EventServer/ListenAddress"), le_eventServerListenAddress->text());
     m_settings->setValue(QSL("EventServer/ListenPort"), spin_eventServerListenPort->value());
+    m_settings->setValue(QSL("EventServer/QueueCapacity"), spin_eventServerQueueCapacity->value());
+    m_settings->setValue(QSL("EventServer/OverflowPolicy"),
+                         combo_eventServerOverflowPolicy->currentData().toString());
 
     m_settings->sync();
 
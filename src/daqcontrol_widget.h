@@ -37,6 +37,7 @@
 #include <QWidget>
 
 #include "globals.h"
+#include "listfile_index.h"
 #include "mvme_stream_worker.h"
 
 class QFormLayout;
@@ -54,6 +55,7 @@ class DAQControlWidget: public QWidget
         void reconnectVMEController();
         void forceResetVMEController();
         void listFileOutputInfoModified(const ListFileOutputInfo &lfo);
+        void replayRangeModified(const ReplayRange &range);
         // Signalling that the user wants to change the specific settings.
         void changeVMEControllerSettings();
         void changeDAQRunSettings();
@@ -117,6 +119,10 @@ class DAQControlWidget: public QWidget
         QRadioButton *rb_keepData, *rb_clearData;
         QButtonGroup *bg_daqData;
         QSpinBox *spin_runDuration;
+
+        QComboBox *combo_replayRangeUnit;
+        QSpinBox *spin_replayBegin,
+                 *spin_replayEnd;
 };
 
 class DAQRunSettingsDialog: public QDialog
@@ -135,6 +141,7 @@ class DAQRunSettingsDialog: public QDialog
         QSpinBox *spin_runNumber;
         QCheckBox *cb_useRunNumber;
         QCheckBox *cb_useTimestamp;
+        QSpinBox *spin_compressionThreads;
         QLineEdit *le_exampleName;
         QDialogButtonBox *m_bb;
 };
@@ -161,7 +168,10 @@ class WorkspaceSettingsDialog: public QDialog
                   *le_expTitle;
 
         QSpinBox *spin_jsonRPCListenPort,
-                 *spin_eventServerListenPort;
+                 *spin_eventServerListenPort,
+                 *spin_eventServerQueueCapacity;
+
+        QComboBox *combo_eventServerOverflowPolicy;
 
         QCheckBox *cb_ignoreStartupErrors;
 
@@ -28,6 +28,7 @@
 #include <mesytec-mvlc/mvlc_impl_eth.h>
 #include <mesytec-mvlc/mvlc_readout.h>
 
+#include "event_server/server/event_server.h"
 #include "mesytec-mvlc/mvlc_eth_interface.h"
 #include "mvlc_readout_worker.h"
 #include "mvme_context.h"
@@ -71,14 +72,16 @@ struct DAQStatsWidgetPrivate
            *label_mvlcLostPackets,
            *label_mvlcEthThrottling,
 
-           *label_mvlcStackErrors
+           *label_mvlcStackErrors,
+           *label_eventServerClients
                ;
 
     QWidget *genericWidget,
             *sisWidget,
             *mvlcUSBWidget,
             *mvlcETHWidget,
-            *mvlcStackErrorsWidget;
+            *mvlcStackErrorsWidget,
+            *eventServerWidget;
 
     void update_generic(const DAQStats &stats, const DAQStats &prevStats,
                         double dt_s, double elapsed_s)
@@ -278,6 +281,23 @@ struct DAQStatsWidgetPrivate
         label_mvlcStackErrors->setText(text);
     }
 
+    void updateEventServerClients(const EventServer *eventServer)
+    {
+        QStringList lines;
+
+        for (const auto &counters: eventServer->getClientCounters())
+        {
+            lines.append(QString("%1: sent %2 MB, queue %3/%4, dropped %5")
+                         .arg(counters.peerAddress)
+                         .arg(counters.bytesSent / static_cast<double>(Megabytes(1)), 0, 'f', 2)
+                         .arg(counters.queueDepth)
+                         .arg(counters.queueCapacity)
+                         .arg(counters.messagesDropped));
+        }
+
+        label_eventServerClients->setText(lines.join(QSL("\n")));
+    }
+
     void updateWidget(VMEReadoutWorker *readoutWorker)
     {
         auto controller = readoutWorker->getVMEController();
@@ -291,6 +311,9 @@ struct DAQStatsWidgetPrivate
         mvlcETHWidget->setVisible(is_MVLC_ETH);
         mvlcStackErrorsWidget->setVisible(mvlc != nullptr);
 
+        auto eventServer = context->getEventServer();
+        eventServerWidget->setVisible(eventServer && eventServer->getNumberOfClients() > 0);
+
         auto daqStats  = context->getDAQStats();
         auto startTime = daqStats.startTime;
         auto endTime   = (context->getDAQState() == DAQState::Idle
@@ -345,6 +368,9 @@ struct DAQStatsWidgetPrivate
             prevCounters.mvlcReadoutCounters = mvlcReadoutCounters;
         }
 
+        if (eventServer)
+            updateEventServerClients(eventServer);
+
         lastUpdateTime = QDateTime::currentDateTime();
     }
 };
@@ -372,6 +398,7 @@ DAQStatsWidget::DAQStatsWidget(MVMEContext *context, QWidget *parent)
     m_d->label_mvlcLostPackets = new QLabel;
     m_d->label_mvlcEthThrottling = new QLabel;
     m_d->label_mvlcStackErrors = new QLabel;
+    m_d->label_eventServerClients = new QLabel;
 
     QList<QLabel *> labels =
     {
@@ -386,6 +413,7 @@ DAQStatsWidget::DAQStatsWidget(MVMEContext *context, QWidget *parent)
         m_d->label_mvlcLostPackets,
         m_d->label_mvlcEthThrottling,
         m_d->label_mvlcStackErrors,
+        m_d->label_eventServerClients,
     };
 
     for (auto label: labels)
@@ -398,12 +426,14 @@ DAQStatsWidget::DAQStatsWidget(MVMEContext *context, QWidget *parent)
     m_d->mvlcUSBWidget = new QWidget;
     m_d->mvlcETHWidget = new QWidget;
     m_d->mvlcStackErrorsWidget = new QWidget;
+    m_d->eventServerWidget = new QWidget;
 
     auto genericLayout = make_layout<QFormLayout, 0, 2>(m_d->genericWidget);
     auto sisLayout = make_layout<QFormLayout, 0, 2>(m_d->sisWidget);
     auto mvlcUSBLayout = make_layout<QFormLayout, 0, 2>(m_d->mvlcUSBWidget);
     auto mvlcETHLayout = make_layout<QFormLayout, 0, 2>(m_d->mvlcETHWidget);
     auto mvlcStackErrorsLayout = make_layout<QFormLayout, 0, 2>(m_d->mvlcStackErrorsWidget);
+    auto eventServerLayout = make_layout<QFormLayout, 0, 2>(m_d->eventServerWidget);
 
     auto vboxLayout = make_layout<QVBoxLayout, 0, 0>(this);
     vboxLayout->addWidget(m_d->genericWidget);
@@ -411,6 +441,7 @@ DAQStatsWidget::DAQStatsWidget(MVMEContext *context, QWidget *parent)
     vboxLayout->addWidget(m_d->mvlcUSBWidget);
     vboxLayout->addWidget(m_d->mvlcETHWidget);
     vboxLayout->addWidget(m_d->mvlcStackErrorsWidget);
+    vboxLayout->addWidget(m_d->eventServerWidget);
 
     genericLayout->addRow("Running time:", m_d->label_daqDuration);
     genericLayout->addRow("Buffers read:", m_d->label_buffersRead);
@@ -428,6 +459,8 @@ DAQStatsWidget::DAQStatsWidget(MVMEContext *context, QWidget *parent)
 
     mvlcStackErrorsLayout->addRow("MVLC Stack Errors:", m_d->label_mvlcStackErrors);
 
+    eventServerLayout->addRow("Event server clients:", m_d->label_eventServerClients);
+
     setSizePolicy(QSizePolicy::Minimum, QSizePolicy::Minimum);
 
     updateWidget();
@@ -22,7 +22,10 @@
 #define __DATA_BUFFER_QUEUE_H__
 #include "databuffer.h"
 #include "threading.h"
+#include "util/lockfree_ring.h"
 
-using ThreadSafeDataBufferQueue = ThreadSafeQueue<DataBuffer *>;
+// Hand-off of DataBuffers between the readout/replay workers and the stream
+// worker. See util/lockfree_ring.h.
+using ThreadSafeDataBufferQueue = mesytec::mvme::LockFreeRing<DataBuffer *>;
 
 #endif /* __DATA_BUFFER_QUEUE_H__ */
@@ -1,5 +1,6 @@
 #include <QApplication>
 #include <QTimer>
+#include <QJsonArray>
 #include <QJsonDocument>
 
 #include "analysis_bench.h"
@@ -7,6 +8,7 @@
 #include "mvme_context.h"
 #include "mvme_context_lib.h"
 #include "daqcontrol.h"
+#include "mvlc_stream_worker.h"
 #include "util/qt_metaobject.h"
 
 /*
@@ -35,9 +37,13 @@ int main(int argc, char *argv[])
 
     auto args = app.arguments();
 
+    // Replays the listfile twice, first with dynamic then with static consumer
+    // dispatch in the MVLC stream worker, and reports the event rates.
+    const bool compareDispatch = args.removeAll("--compare-dispatch") > 0;
+
     if (args.size() < 2)
     {
-        qout << "Usage: " << args[0] << " <listfile> [<analysis>]" << endl;
+        qout << "Usage: " << args[0] << " [--compare-dispatch] <listfile> [<analysis>]" << endl;
         return 1;
     }
 
@@ -65,8 +71,11 @@ int main(int argc, char *argv[])
                 return 1;
         }
 
+        // Record per operator run times for the report. Disabled when
+        // comparing dispatch modes to keep the measurement overhead out.
+        mvmeContext.getAnalysis()->setA2OperatorProfiling(!compareDispatch);
+
         DAQControl daqControl(&mvmeContext);
-        daqControl.startDAQ();
 
         QObject::connect(&mvmeContext, &MVMEContext::mvmeStreamWorkerStateChanged,
                          [&app] (MVMEStreamWorkerState state)
@@ -75,7 +84,44 @@ int main(int argc, char *argv[])
                                  app.quit();
                          });
 
-        ret = app.exec();
+        if (compareDispatch)
+        {
+            auto mvlcWorker = qobject_cast<MVLC_StreamWorker *>(
+                mvmeContext.getMVMEStreamWorker());
+
+            if (!mvlcWorker)
+                throw std::runtime_error("--compare-dispatch requires an MVLC listfile");
+
+            double rates[2] = {};
+
+            for (bool staticDispatch: { false, true })
+            {
+                mvlcWorker->setStaticConsumerDispatch(staticDispatch);
+                daqControl.startDAQ();
+
+                if ((ret = app.exec()))
+                    break;
+
+                const auto counters = mvlcWorker->getCounters();
+                const double secs = counters.startTime.msecsTo(counters.stopTime) / 1000.0;
+                const double rate = secs > 0.0 ? counters.totalEvents / secs : 0.0;
+
+                rates[staticDispatch] = rate;
+
+                qout << "dispatch=" << (staticDispatch ? "static" : "dynamic")
+                    << ", events=" << counters.totalEvents
+                    << ", elapsed=" << secs << " s"
+                    << ", rate=" << rate << " events/s" << endl;
+            }
+
+            if (rates[0] > 0.0)
+                qout << "static/dynamic event rate ratio: " << rates[1] / rates[0] << endl;
+        }
+        else
+        {
+            daqControl.startDAQ();
+            ret = app.exec();
+        }
 
 
         qout << ">>>>> Begin LogBuffer:" << endl;
@@ -94,6 +140,29 @@ int main(int argc, char *argv[])
             << ", data=" << countersJ["data_mb"].toDouble() << " MB"
             << ", rate=" << countersJ["rate_mbs"].toDouble() << " MB/s" << endl;
 
+        // Hot operators. The profile entries are sorted by descending time.
+        {
+            const auto profileJ = reportJ["OperatorProfile"].toObject();
+            const auto operatorsJ = profileJ["operators"].toArray();
+            const auto timeUnit = profileJ["timeUnit"].toString();
+            const int maxEntries = 10;
+
+            if (!operatorsJ.isEmpty())
+                qout << "Top operators by " << timeUnit << ":" << endl;
+
+            for (int i = 0; i < std::min(operatorsJ.size(), maxEntries); i++)
+            {
+                const auto opJ = operatorsJ[i].toObject();
+                const auto steps = opJ["stepCount"].toDouble();
+
+                qout << "  " << opJ["className"].toString() << " " << opJ["name"].toString()
+                    << ": total=" << opJ["time"].toDouble()
+                    << ", steps=" << steps
+                    << ", per step=" << (steps > 0 ? opJ["time"].toDouble() / steps : 0.0)
+                    << endl;
+            }
+        }
+
         auto reportFilename = QSL("mvme_replay_bench-%1-%2.json")
             .arg(QFileInfo(listfileFilename).baseName())
             .arg(QDateTime::currentDateTime().toString(Qt::ISODate))
@@ -229,6 +229,9 @@ int main(int argc, char *argv[])
     }
 
     Context ctx;
+    ClientHelloInfo hello;
+    hello.batched = false;
+    bool sendHello = false;
 
     while (true)
     {
@@ -236,6 +239,10 @@ int main(int argc, char *argv[])
         {
             { "single-run",             no_argument, nullptr,    0 },
             { "print-data",             no_argument, nullptr,    0 },
+            { "batched",                no_argument, nullptr,    0 },
+            { "compact",                no_argument, nullptr,    0 },
+            { "lz4",                    no_argument, nullptr,    0 },
+            { "event",                  required_argument, nullptr, 0 },
             { "help",                   no_argument, nullptr,    0 },
             { nullptr, 0, nullptr, 0 },
         };
@@ -255,19 +262,47 @@ int main(int argc, char *argv[])
 
         if (opt_name == "single-run") ctx.setSingleRun(true);
         if (opt_name == "print-data") ctx.setPrintData(true);
+        if (opt_name == "batched") { hello.batched = true; sendHello = true; }
+        if (opt_name == "compact") { hello.batched = hello.compact = true; sendHello = true; }
+        if (opt_name == "lz4")
+        {
+#ifdef MVME_EVENT_SERVER_LZ4
+            hello.batched = hello.compact = hello.lz4 = true;
+            sendHello = true;
+#else
+            cerr << "Error: --lz4 requires building with -DMVME_EVENT_SERVER_LZ4 -llz4" << endl;
+            return 1;
+#endif
+        }
+        if (opt_name == "event")
+        {
+            EventSubscription sub;
+            sub.eventIndex = std::stoi(optarg);
+            hello.subscriptions.push_back(sub);
+            sendHello = true;
+        }
         if (opt_name == "help") showHelp = true;
     }
 
     if (showHelp)
     {
         cout << "Usage: " << argv[0]
-            << " [--single-run] [--print-data] [host=localhost] [port=13801]"
+            << " [--single-run] [--print-data] [--batched] [--compact] [--lz4]"
+            << " [--event <eventIndex>]..."
+            << " [host=localhost] [port=13801]"
             << endl << endl
             ;
 
         cout << "  If single-run is set the process will exit after receiving" << endl
              << "  data from one run. Otherwise it will wait for the next run to" << endl
              << "  start." << endl << endl
+             << "  --batched requests EventDataBatch messages instead of one" << endl
+             << "  message per event. --event subscribes to the data of the given" << endl
+             << "  event only and can be repeated. Both require a server supporting" << endl
+             << "  protocol version 2." << endl << endl
+             << "  --compact implies --batched and requests the compact bitmap and" << endl
+             << "  delta/varint payload encodings. --lz4 additionally requests LZ4" << endl
+             << "  compression of each batch. Both require protocol version 3." << endl << endl
              ;
 
         return 0;
@@ -316,6 +351,28 @@ int main(int argc, char *argv[])
         {
             read_message(sockfd, msg);
             ctx.handleMessage(msg);
+
+            if (msg.type == MessageType::ServerInfo && sendHello)
+            {
+                auto clientHello = hello;
+
+                if (ctx.getServerProtocolVersion() < 3 && clientHello.compact)
+                {
+                    cout << "Warning: the server does not support compact encodings." << endl;
+                    clientHello.compact = clientHello.lz4 = false;
+                }
+
+                if (clientHello.lz4 && !ctx.serverSupportsLZ4())
+                {
+                    cout << "Warning: the server does not support LZ4 compression." << endl;
+                    clientHello.lz4 = false;
+                }
+
+                if (ctx.getServerProtocolVersion() >= 2)
+                    send_client_hello(sockfd, clientHello);
+                else
+                    cout << "Warning: the server does not support batching and subscriptions." << endl;
+            }
         }
         catch (const mvme::event_server::connection_closed &)
         {
@@ -39,6 +39,12 @@
 
 #include <unistd.h>
 
+// Optional LZ4 compression of CompactEventDataBatch messages. Define
+// MVME_EVENT_SERVER_LZ4 and link against liblz4 to enable it.
+#ifdef MVME_EVENT_SERVER_LZ4
+#include <lz4frame.h>
+#endif
+
 // header-only json parser library
 #include <nlohmann/json.hpp>
 
@@ -294,6 +300,39 @@ static void read_message(int fd, Message &msg)
     assert(msg.isValid());
 }
 
+// Writes exactly size bytes from the source buffer to the file descriptor fd.
+// Throws std::system_error in case a write fails.
+static void write_data(int fd, const uint8_t *src, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t bytesWritten = write(fd, src, size);
+
+        if (bytesWritten < 0)
+        {
+            throw std::system_error(errno, std::system_category(), "write_data");
+        }
+
+        size -= bytesWritten;
+        src += bytesWritten;
+    }
+}
+
+// Writes a single message consisting of the message frame and the given
+// contents to the file descriptor fd.
+__attribute__((__used__))
+static void write_message(int fd, MessageType type, const std::string &contents)
+{
+    uint8_t headerBuffer[MessageFrameSize];
+    uint32_t size = contents.size();
+
+    memcpy(headerBuffer,                &type, sizeof(type));
+    memcpy(headerBuffer + sizeof(type), &size, sizeof(size));
+
+    write_data(fd, headerBuffer, sizeof(headerBuffer));
+    write_data(fd, reinterpret_cast<const uint8_t *>(contents.data()), contents.size());
+}
+
 // Connects via TCP to the given host and service (the port in our case).
 // Returns the socket file descriptor on success, throws if an error occured.
 inline int connect_to(const char *host, const char *service)
@@ -656,6 +695,98 @@ static StreamInfo parse_stream_info(const json &j)
     return result;
 }
 
+// Subscription to the data of one event. If dataSourceIndexes is empty all
+// data sources of the event are sent.
+struct EventSubscription
+{
+    int eventIndex = -1;
+    std::vector<int> dataSourceIndexes;
+};
+
+// Contents of the ClientHello message sent by protocol version 2 clients.
+//
+// If batched is true the server sends EventDataBatch messages instead of one
+// EventData message per event. Subscriptions limit the data sent to the
+// client to the listed events and data sources. An empty list of
+// subscriptions means that the data of all events is sent.
+//
+// Protocol version 3 adds two more options which only apply to batched
+// transfers: compact selects the compact data source encodings described by
+// PayloadEncoding, lz4 additionally compresses each batch. Only request lz4 if
+// the server announced support for it in its ServerInfo message and the
+// client was built with MVME_EVENT_SERVER_LZ4.
+struct ClientHelloInfo
+{
+    int protocolVersion = ProtocolVersion;
+    bool batched = true;
+    bool compact = false;
+    bool lz4 = false;
+    std::vector<EventSubscription> subscriptions;
+};
+
+inline json to_json(const ClientHelloInfo &hello)
+{
+    json result;
+    result["protocol_version"] = hello.protocolVersion;
+    result["batched"] = hello.batched;
+    result["compact"] = hello.compact;
+    result["lz4"] = hello.lz4;
+    result["subscriptions"] = json::array();
+
+    for (const auto &sub: hello.subscriptions)
+    {
+        json subj;
+        subj["eventIndex"] = sub.eventIndex;
+        subj["dataSources"] = sub.dataSourceIndexes;
+        result["subscriptions"].push_back(subj);
+    }
+
+    return result;
+}
+
+static ClientHelloInfo parse_client_hello(const json &j)
+{
+    ClientHelloInfo result;
+
+    try
+    {
+        result.protocolVersion = j.value("protocol_version", MinProtocolVersion);
+        result.batched = j.value("batched", false);
+        result.compact = j.value("compact", false);
+        result.lz4 = j.value("lz4", false);
+
+        if (j.count("subscriptions"))
+        {
+            for (const auto &subj: j["subscriptions"])
+            {
+                EventSubscription sub;
+                sub.eventIndex = subj["eventIndex"];
+
+                if (subj.count("dataSources"))
+                {
+                    for (const auto &dsj: subj["dataSources"])
+                        sub.dataSourceIndexes.push_back(dsj);
+                }
+
+                result.subscriptions.emplace_back(sub);
+            }
+        }
+    }
+    catch (const json::exception &e)
+    {
+        throw protocol_error(e.what());
+    }
+
+    return result;
+}
+
+// Sends a ClientHello message to the server. Only do this if the server
+// announced protocol version 2 or later in its ServerInfo message.
+inline void send_client_hello(int fd, const ClientHelloInfo &hello)
+{
+    write_message(fd, MessageType::ClientHello, to_json(hello).dump());
+}
+
 // Helper to deal with incoming packed, indexed arrays.
 // The firstIndex member points to a buffer containing packed (index, value)
 // pairs with their data types specified in the members indexType and
@@ -710,6 +841,619 @@ void print(Out &out, const DataSourceContents &dsc)
     }
 }
 
+//
+// Compact payload encodings
+//
+
+// Stores value at dest using the given storage type. The counterpart of
+// read_storage().
+inline void write_storage(StorageType st, uint64_t value, uint8_t *dest)
+{
+    switch (st)
+    {
+        case StorageType::st_uint8_t:
+            { uint8_t v = value; memcpy(dest, &v, sizeof(v)); } break;
+        case StorageType::st_uint16_t:
+            { uint16_t v = value; memcpy(dest, &v, sizeof(v)); } break;
+        case StorageType::st_uint32_t:
+            { uint32_t v = value; memcpy(dest, &v, sizeof(v)); } break;
+        case StorageType::st_uint64_t:
+            memcpy(dest, &value, sizeof(value)); break;
+    }
+}
+
+inline void append_storage(StorageType st, uint64_t value, std::vector<uint8_t> &dest)
+{
+    const size_t offset = dest.size();
+    dest.resize(offset + get_storage_type_size(st));
+    write_storage(st, value, dest.data() + offset);
+}
+
+inline uint64_t zigzag_encode(int64_t v)
+{
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+inline int64_t zigzag_decode(uint64_t v)
+{
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1u);
+}
+
+inline size_t varint_size(uint64_t v)
+{
+    size_t result = 1;
+
+    while (v >= 0x80u)
+    {
+        v >>= 7;
+        ++result;
+    }
+
+    return result;
+}
+
+inline uint64_t extract_varint(BufferIterator &it)
+{
+    uint64_t result = 0;
+
+    for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+        uint8_t b = it.extractU8();
+        result |= static_cast<uint64_t>(b & 0x7fu) << shift;
+
+        if (!(b & 0x80u))
+            return result;
+    }
+
+    throw data_consistency_error("varint too long");
+}
+
+// Compact encoding of the data of one data source:
+//   u8  dataSourceIndex
+//   u8  PayloadEncoding
+//   u16 elementCount
+//   Pairs:       elementCount (index, value) pairs
+//   Bitmap:      (dsd.size + 7) / 8 bytes of bitmap, LSB first, followed by
+//                elementCount values in ascending index order
+//   DeltaVarint: elementCount zigzag varints, each the difference to the
+//                previous index (starting from 0), followed by elementCount
+//                values
+// Values are stored using dsd.valueType, pair indexes using dsd.indexType.
+//
+// Encodes the (index, value) pairs in dsc using the smallest encoding and
+// appends the result to dest. scratch is used to sort the entries for the
+// bitmap encoding.
+inline PayloadEncoding encode_data_source_compact(
+    const DataSourceDescription &dsd, uint8_t dsIndex,
+    const DataSourceContents &dsc, std::vector<uint8_t> &dest,
+    std::vector<std::pair<uint32_t, uint64_t>> &scratch)
+{
+    const size_t entrySize = get_entry_size(dsc);
+    const size_t indexSize = get_storage_type_size(dsc.indexType);
+    const size_t valueSize = get_storage_type_size(dsc.valueType);
+    const size_t bitmapBytes = (dsd.size + 7) / 8;
+
+    scratch.resize(dsc.count);
+
+    size_t varintBytes = 0;
+    int64_t prevIndex = 0;
+    bool sorted = true;
+
+    for (size_t i = 0; i < dsc.count; i++)
+    {
+        const uint8_t *entry = dsc.firstIndex + i * entrySize;
+        uint32_t index = read_storage<uint32_t>(dsc.indexType, entry);
+
+        if (index >= dsd.size)
+            throw data_consistency_error("data source index out of range");
+
+        scratch[i] = { index, read_storage<uint64_t>(dsc.valueType, entry + indexSize) };
+        varintBytes += varint_size(zigzag_encode(static_cast<int64_t>(index) - prevIndex));
+        sorted = sorted && (i == 0 || index > prevIndex);
+        prevIndex = index;
+    }
+
+    const size_t pairsSize = dsc.count * entrySize;
+    const size_t bitmapSize = bitmapBytes + dsc.count * valueSize;
+    const size_t deltaSize = varintBytes + dsc.count * valueSize;
+
+    auto encoding = PayloadEncoding::Pairs;
+    size_t dataSize = pairsSize;
+
+    if (bitmapSize < pairsSize && bitmapSize <= deltaSize)
+    {
+        // Values are stored in ascending index order. Duplicate indexes cannot
+        // be represented in the bitmap and are sent as pairs.
+        if (!sorted)
+            std::sort(scratch.begin(), scratch.end());
+
+        auto same_index = [] (const std::pair<uint32_t, uint64_t> &a,
+                              const std::pair<uint32_t, uint64_t> &b)
+        {
+            return a.first == b.first;
+        };
+
+        if (sorted || std::adjacent_find(scratch.begin(), scratch.end(), same_index) == scratch.end())
+        {
+            encoding = PayloadEncoding::Bitmap;
+            dataSize = bitmapSize;
+        }
+    }
+    else if (deltaSize < pairsSize)
+    {
+        encoding = PayloadEncoding::DeltaVarint;
+        dataSize = deltaSize;
+    }
+
+    const size_t headerOffset = dest.size();
+    dest.resize(headerOffset + 2 * sizeof(uint8_t) + sizeof(uint16_t) + dataSize);
+
+    uint8_t *out = dest.data() + headerOffset;
+    *out++ = dsIndex;
+    *out++ = static_cast<uint8_t>(encoding);
+    memcpy(out, &dsc.count, sizeof(uint16_t));
+    out += sizeof(uint16_t);
+
+    switch (encoding)
+    {
+        case PayloadEncoding::Pairs:
+            if (pairsSize)
+                memcpy(out, dsc.firstIndex, pairsSize);
+            break;
+
+        case PayloadEncoding::Bitmap:
+            {
+                memset(out, 0, bitmapBytes);
+
+                for (const auto &entry: scratch)
+                    out[entry.first / 8] |= 1u << (entry.first % 8);
+
+                out += bitmapBytes;
+
+                for (const auto &entry: scratch)
+                {
+                    write_storage(dsc.valueType, entry.second, out);
+                    out += valueSize;
+                }
+            } break;
+
+        case PayloadEncoding::DeltaVarint:
+            {
+                prevIndex = 0;
+
+                for (const auto &entry: scratch)
+                {
+                    uint64_t v = zigzag_encode(static_cast<int64_t>(entry.first) - prevIndex);
+                    prevIndex = entry.first;
+
+                    while (v >= 0x80u)
+                    {
+                        *out++ = static_cast<uint8_t>(v) | 0x80u;
+                        v >>= 7;
+                    }
+
+                    *out++ = static_cast<uint8_t>(v);
+                }
+
+                for (const auto &entry: scratch)
+                {
+                    write_storage(dsc.valueType, entry.second, out);
+                    out += valueSize;
+                }
+            } break;
+    }
+
+    return encoding;
+}
+
+// Decodes the data source at the current position of the iterator, following
+// the dataSourceIndex byte which must have been extracted by the caller.
+// Appends the elements as packed (index, value) pairs using the types from
+// dsd to pairsOut. Returns the number of elements.
+inline uint16_t decode_data_source_compact(
+    const DataSourceDescription &dsd, BufferIterator &in, std::vector<uint8_t> &pairsOut)
+{
+    auto encoding = static_cast<PayloadEncoding>(in.extractU8());
+    uint16_t count = in.extractU16();
+
+    const size_t indexSize = get_storage_type_size(dsd.indexType);
+    const size_t valueSize = get_storage_type_size(dsd.valueType);
+    const size_t entrySize = indexSize + valueSize;
+    const size_t entriesOffset = pairsOut.size();
+
+    pairsOut.resize(entriesOffset + count * entrySize);
+    uint8_t *out = pairsOut.data() + entriesOffset;
+
+    switch (encoding)
+    {
+        case PayloadEncoding::Pairs:
+            {
+                if (count * entrySize > in.bytesLeft())
+                    throw end_of_buffer();
+
+                for (uint16_t i = 0; i < count; i++)
+                {
+                    if (read_storage<uint32_t>(dsd.indexType, in.buffp + i * entrySize) >= dsd.size)
+                        throw data_consistency_error("data source index out of range");
+                }
+
+                if (count)
+                    memcpy(out, in.buffp, count * entrySize);
+
+                in.skip(count * entrySize);
+            } break;
+
+        case PayloadEncoding::Bitmap:
+            {
+                const size_t bitmapBytes = (dsd.size + 7) / 8;
+
+                if (bitmapBytes + count * valueSize > in.bytesLeft())
+                    throw end_of_buffer();
+
+                const uint8_t *bitmap = in.buffp;
+                const uint8_t *values = bitmap + bitmapBytes;
+                uint16_t found = 0;
+
+                for (size_t byteIndex = 0; byteIndex < bitmapBytes; byteIndex++)
+                {
+                    for (unsigned bits = bitmap[byteIndex]; bits; bits &= bits - 1)
+                    {
+                        uint32_t index = byteIndex * 8 + __builtin_ctz(bits);
+
+                        if (found == count || index >= dsd.size)
+                            throw data_consistency_error("bitmap does not match the element count");
+
+                        write_storage(dsd.indexType, index, out);
+                        memcpy(out + indexSize, values, valueSize);
+                        out += entrySize;
+                        values += valueSize;
+                        ++found;
+                    }
+                }
+
+                if (found != count)
+                    throw data_consistency_error("bitmap does not match the element count");
+
+                in.skip(bitmapBytes + count * valueSize);
+            } break;
+
+        case PayloadEncoding::DeltaVarint:
+            {
+                int64_t index = 0;
+
+                for (uint16_t i = 0; i < count; i++)
+                {
+                    index += zigzag_decode(extract_varint(in));
+
+                    if (index < 0 || index >= dsd.size)
+                        throw data_consistency_error("data source index out of range");
+
+                    write_storage(dsd.indexType, index, out + i * entrySize);
+                }
+
+                if (count * valueSize > in.bytesLeft())
+                    throw end_of_buffer();
+
+                for (uint16_t i = 0; i < count; i++)
+                    memcpy(out + i * entrySize + indexSize, in.buffp + i * valueSize, valueSize);
+
+                in.skip(count * valueSize);
+            } break;
+
+        default:
+            throw data_consistency_error(
+                "unknown payload encoding " + std::to_string(static_cast<unsigned>(encoding)));
+    }
+
+    return count;
+}
+
+#ifdef MVME_EVENT_SERVER_LZ4
+// Compresses size bytes from src into a single LZ4 frame appended to dest.
+inline void lz4_compress(const uint8_t *src, size_t size, std::vector<uint8_t> &dest)
+{
+    LZ4F_preferences_t prefs = {};
+    prefs.frameInfo.contentSize = size;
+
+    const size_t offset = dest.size();
+    dest.resize(offset + LZ4F_compressFrameBound(size, &prefs));
+
+    size_t res = LZ4F_compressFrame(dest.data() + offset, dest.size() - offset, src, size, &prefs);
+
+    if (LZ4F_isError(res))
+        throw exception(std::string("LZ4 compression failed: ") + LZ4F_getErrorName(res));
+
+    dest.resize(offset + res);
+}
+
+// Decompresses the LZ4 frame in src into exactly destSize bytes at dest.
+inline void lz4_decompress(const uint8_t *src, size_t srcSize, uint8_t *dest, size_t destSize)
+{
+    LZ4F_dctx *ctx = nullptr;
+
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&ctx, LZ4F_VERSION)))
+        throw exception("could not create LZ4 decompression context");
+
+    size_t produced = 0;
+    size_t res = 1;
+
+    while (srcSize > 0 && res != 0)
+    {
+        size_t srcLen = srcSize;
+        size_t dstLen = destSize - produced;
+
+        res = LZ4F_decompress(ctx, dest + produced, &dstLen, src, &srcLen, nullptr);
+
+        if (LZ4F_isError(res))
+        {
+            LZ4F_freeDecompressionContext(ctx);
+            throw data_consistency_error(std::string("LZ4 decompression failed: ")
+                                         + LZ4F_getErrorName(res));
+        }
+
+        produced += dstLen;
+        src += srcLen;
+        srcSize -= srcLen;
+
+        if (srcLen == 0 && dstLen == 0)
+            break;
+    }
+
+    LZ4F_freeDecompressionContext(ctx);
+
+    if (produced != destSize || res != 0)
+        throw data_consistency_error("LZ4 decompressed size mismatch");
+}
+#endif
+
+//
+// Server side batching
+//
+
+// Event and data source selection built from the subscriptions of a
+// ClientHello message.
+struct SubscriptionFilter
+{
+    bool all = true;
+    std::vector<bool> events;
+    // Per event data source selection. Empty means all data sources.
+    std::vector<std::vector<bool>> dataSources;
+
+    bool wantsEvent(int eventIndex) const
+    {
+        return all || (eventIndex >= 0
+                       && static_cast<size_t>(eventIndex) < events.size()
+                       && events[eventIndex]);
+    }
+
+    bool wantsDataSource(int eventIndex, size_t dsIndex) const
+    {
+        if (all) return true;
+        const auto &sel = dataSources[eventIndex];
+        return sel.empty() || (dsIndex < sel.size() && sel[dsIndex]);
+    }
+};
+
+// Subscriptions to negative event indexes or indexes >= maxEvents are
+// ignored.
+inline SubscriptionFilter make_subscription_filter(const ClientHelloInfo &hello, size_t maxEvents)
+{
+    SubscriptionFilter result;
+    result.all = hello.subscriptions.empty();
+
+    for (const auto &es: hello.subscriptions)
+    {
+        if (es.eventIndex < 0 || static_cast<size_t>(es.eventIndex) >= maxEvents)
+            continue;
+
+        size_t ei = es.eventIndex;
+
+        if (result.events.size() <= ei)
+        {
+            result.events.resize(ei + 1);
+            result.dataSources.resize(ei + 1);
+        }
+
+        result.events[ei] = true;
+
+        for (int dsIndex: es.dataSourceIndexes)
+        {
+            if (dsIndex < 0)
+                continue;
+
+            auto &sel = result.dataSources[ei];
+
+            if (sel.size() <= static_cast<size_t>(dsIndex))
+                sel.resize(dsIndex + 1);
+
+            sel[dsIndex] = true;
+        }
+    }
+
+    return result;
+}
+
+// How the server sends event data to a client. Clients which did not send a
+// ClientHello keep the defaults and receive one EventData message per event
+// like protocol version 1 clients.
+struct ClientOptions
+{
+    int protocolVersion = MinProtocolVersion;
+    bool batched = false;
+    bool compact = false;   // CompactEventDataBatch instead of EventDataBatch
+    bool lz4 = false;       // LZ4 compression of compact batches
+};
+
+// Limits the options requested in the ClientHello to what the negotiated
+// protocol version and this build support.
+inline ClientOptions negotiate_client_options(const ClientHelloInfo &hello)
+{
+    ClientOptions result;
+    result.protocolVersion = std::min(hello.protocolVersion, ProtocolVersion);
+    result.batched = hello.batched && result.protocolVersion >= 2;
+    result.compact = result.batched && hello.compact && result.protocolVersion >= 3;
+#ifdef MVME_EVENT_SERVER_LZ4
+    result.lz4 = result.compact && hello.lz4;
+#endif
+    return result;
+}
+
+// Builds the compact encodings of the data sources of one event. src and
+// spans describe the data source blocks (u8 dataSourceIndex, u16
+// elementCount, pairs) of an EventData message. The encodings are written
+// to dest, their locations to destSpans.
+inline void encode_event_compact(
+    const EventDataDescription &edd, const uint8_t *src,
+    const std::vector<std::pair<size_t, size_t>> &spans,
+    std::vector<uint8_t> &dest, std::vector<std::pair<size_t, size_t>> &destSpans,
+    std::vector<std::pair<uint32_t, uint64_t>> &scratch)
+{
+    dest.clear();
+    destSpans.resize(spans.size());
+
+    for (size_t dsIndex = 0; dsIndex < spans.size(); dsIndex++)
+    {
+        // Skip over the u8 dataSourceIndex and read the u16 elementCount.
+        const uint8_t *dsBegin = src + spans[dsIndex].first;
+        const auto &dsd = edd.dataSources[dsIndex];
+
+        DataSourceContents dsc;
+        dsc.indexType = dsd.indexType;
+        dsc.valueType = dsd.valueType;
+        memcpy(&dsc.count, dsBegin + sizeof(uint8_t), sizeof(dsc.count));
+        dsc.firstIndex = dsBegin + sizeof(uint8_t) + sizeof(uint16_t);
+
+        const size_t begin = dest.size();
+        encode_data_source_compact(dsd, dsIndex, dsc, dest, scratch);
+        destSpans[dsIndex] = { begin, dest.size() - begin };
+    }
+}
+
+// Message frame and u32 eventCount.
+static const size_t BatchHeaderSize = MessageFrameSize + sizeof(uint32_t);
+// Message frame, u8 flags and u32 payloadSize. The payload starts with the u32
+// eventCount.
+static const size_t CompactPayloadOffset = MessageFrameSize + sizeof(uint8_t) + sizeof(uint32_t);
+static const size_t CompactBatchHeaderSize = CompactPayloadOffset + sizeof(uint32_t);
+
+// Collects events into an EventDataBatch or CompactEventDataBatch message.
+class EventBatchBuilder
+{
+    public:
+        explicit EventBatchBuilder(bool compact = false)
+        {
+            setCompact(compact);
+        }
+
+        // Discards the events collected so far.
+        void setCompact(bool compact)
+        {
+            m_compact = compact;
+            m_headerSize = compact ? CompactBatchHeaderSize : BatchHeaderSize;
+            m_buffer.resize(m_headerSize);
+            m_eventCount = 0;
+        }
+
+        bool isCompact() const { return m_compact; }
+        uint32_t eventCount() const { return m_eventCount; }
+        size_t size() const { return m_buffer.size(); }
+
+        // True once the batch should be sent out.
+        bool isFull() const
+        {
+            return m_buffer.size() >= BatchMaxBytes || m_eventCount >= BatchMaxEvents;
+        }
+
+        // Appends an event. src and spans describe the data source blocks of
+        // the event: either those of an EventData message or the compact
+        // encodings built by encode_event_compact(). Only the data sources
+        // accepted by the filter are copied.
+        void appendEvent(int eventIndex, const uint8_t *src,
+                         const std::vector<std::pair<size_t, size_t>> &spans,
+                         const SubscriptionFilter &filter)
+        {
+            const size_t sizeOffset = m_buffer.size();
+
+            m_buffer.resize(m_buffer.size() + sizeof(uint32_t));
+            m_buffer.push_back(static_cast<uint8_t>(eventIndex));
+
+            for (size_t dsIndex = 0; dsIndex < spans.size(); dsIndex++)
+            {
+                if (!filter.wantsDataSource(eventIndex, dsIndex))
+                    continue;
+
+                const auto &span = spans[dsIndex];
+                m_buffer.insert(m_buffer.end(), src + span.first, src + span.first + span.second);
+            }
+
+            uint32_t eventSize = m_buffer.size() - sizeOffset - sizeof(uint32_t);
+            memcpy(m_buffer.data() + sizeOffset, &eventSize, sizeof(eventSize));
+
+            ++m_eventCount;
+        }
+
+        // Returns the complete message including the message frame and starts
+        // a new batch. lz4 is only used for compact batches and if built with
+        // MVME_EVENT_SERVER_LZ4.
+        std::vector<uint8_t> takeMessage(bool lz4 = false)
+        {
+            const size_t capacity = m_buffer.capacity();
+
+            memcpy(m_buffer.data() + m_headerSize - sizeof(uint32_t),
+                   &m_eventCount, sizeof(m_eventCount));
+
+            std::vector<uint8_t> result;
+            MessageType type = MessageType::EventDataBatch;
+
+            if (m_compact)
+            {
+                type = MessageType::CompactEventDataBatch;
+                uint8_t flags = 0u;
+                uint32_t payloadSize = m_buffer.size() - CompactPayloadOffset;
+
+#ifdef MVME_EVENT_SERVER_LZ4
+                if (lz4)
+                {
+                    // The uncompressed buffer is kept for reuse.
+                    result.resize(CompactPayloadOffset);
+                    lz4_compress(m_buffer.data() + CompactPayloadOffset, payloadSize, result);
+                    flags |= CompactBatch_LZ4;
+                }
+#else
+                (void) lz4;
+#endif
+
+                if (!flags)
+                    result = std::move(m_buffer);
+
+                result[MessageFrameSize] = flags;
+                memcpy(result.data() + MessageFrameSize + sizeof(flags),
+                       &payloadSize, sizeof(payloadSize));
+            }
+            else
+            {
+                result = std::move(m_buffer);
+            }
+
+            uint32_t contentsSize = result.size() - MessageFrameSize;
+            memcpy(result.data(), &type, sizeof(type));
+            memcpy(result.data() + sizeof(type), &contentsSize, sizeof(contentsSize));
+
+            m_buffer.clear();
+            m_buffer.reserve(capacity);
+            m_buffer.resize(m_headerSize);
+            m_eventCount = 0;
+
+            return result;
+        }
+
+    private:
+        bool m_compact = false;
+        size_t m_headerSize = BatchHeaderSize;
+        std::vector<uint8_t> m_buffer;
+        uint32_t m_eventCount = 0;
+};
+
 // Base class for event_server clients.
 class Client
 {
@@ -717,6 +1461,10 @@ class Client
         void handleMessage(const Message &msg);
         void reset();
         const StreamInfo &getStreamInfo() const { return m_streamInfo; }
+        // Protocol version announced by the server in the ServerInfo message.
+        int getServerProtocolVersion() const { return m_serverProtocolVersion; }
+        // True if the server can LZ4 compress CompactEventDataBatch messages.
+        bool serverSupportsLZ4() const { return m_serverSupportsLZ4; }
         virtual ~Client() {}
 
     protected:
@@ -735,16 +1483,27 @@ class Client
         void _serverInfo(const Message &msg);
         void _beginRun(const Message &msg);
         void _eventData(const Message &msg);
+        void _eventDataBatch(const Message &msg);
+        void _compactEventDataBatch(const Message &msg);
         void _endRun(const Message &msg);
 
         MessageType m_prevMsgType = MessageType::Invalid;
+        int m_serverProtocolVersion = MinProtocolVersion;
+        bool m_serverSupportsLZ4 = false;
         StreamInfo m_streamInfo;
         std::vector<DataSourceContents> m_contentsVec;
+        // Decompressed payload and decoded (index, value) pairs of
+        // CompactEventDataBatch messages.
+        std::vector<uint8_t> m_payloadBuffer;
+        std::vector<uint8_t> m_pairsBuffer;
+        std::vector<size_t> m_pairsOffsets;
 };
 
 inline void Client::reset()
 {
     m_prevMsgType = MessageType::Invalid;
+    m_serverProtocolVersion = MinProtocolVersion;
+    m_serverSupportsLZ4 = false;
     m_streamInfo = {};
     m_contentsVec.clear();
 }
@@ -767,6 +1526,8 @@ inline void Client::handleMessage(const Message &msg)
             case ServerInfo: _serverInfo(msg); break;
             case BeginRun: _beginRun(msg); break;
             case EventData: _eventData(msg); break;
+            case EventDataBatch: _eventDataBatch(msg); break;
+            case CompactEventDataBatch: _compactEventDataBatch(msg); break;
             case EndRun: _endRun(msg); break;
             default: assert(false); break;
         }
@@ -799,6 +1560,8 @@ inline void Client::handleMessage(const Message &msg)
 inline void Client::_serverInfo(const Message &msg)
 {
     auto infoJson = json::parse(msg.contents);
+    m_serverProtocolVersion = infoJson.value("protocol_version", MinProtocolVersion);
+    m_serverSupportsLZ4 = infoJson.value("lz4", false);
     serverInfo(msg, infoJson);
 }
 
@@ -871,6 +1634,198 @@ inline void Client::_eventData(const Message &msg)
     }
 }
 
+// EventDataBatch contents:
+//   u32 eventCount
+//   eventCount times:
+//     u32 eventSize        size of the following event data in bytes
+//     u8  eventIndex
+//     for each data source sent for this event:
+//       u8  dataSourceIndex
+//       u16 elementCount
+//       elementCount (index, value) pairs
+//
+// Data sources the client did not subscribe to are omitted. They are passed
+// to eventData() with a count of 0.
+inline void Client::_eventDataBatch(const Message &msg)
+{
+    try
+    {
+        uint8_t *contentsBegin = const_cast<uint8_t *>(msg.contents.data());
+
+        BufferIterator ci(contentsBegin, msg.contents.size());
+        uint32_t eventCount = ci.extractU32();
+
+        for (uint32_t i = 0; i < eventCount; i++)
+        {
+            uint32_t eventSize = ci.extractU32();
+
+            if (eventSize > ci.bytesLeft() || eventSize == 0)
+                throw end_of_buffer();
+
+            BufferIterator ei(ci.buffp, eventSize);
+            ci.skip(eventSize);
+
+            uint8_t eventIndex = ei.extractU8();
+
+            if (eventIndex >= m_streamInfo.eventDataDescriptions.size())
+                throw data_consistency_error("eventIndex out of range");
+
+            const auto &edd = m_streamInfo.eventDataDescriptions[eventIndex];
+            m_contentsVec.resize(edd.dataSources.size());
+
+            for (size_t dsIndex = 0; dsIndex < edd.dataSources.size(); dsIndex++)
+            {
+                const auto &dsd = edd.dataSources[dsIndex];
+                DataSourceContents dsc;
+                dsc.indexType = dsd.indexType;
+                dsc.valueType = dsd.valueType;
+                m_contentsVec[dsIndex] = dsc;
+            }
+
+            while (!ei.atEnd())
+            {
+                uint8_t dsIndex = ei.extractU8();
+
+                if (dsIndex >= edd.dataSources.size())
+                {
+                    throw data_consistency_error(
+                        "dataSourceIndex out of range in EventDataBatch message: "
+                        + std::to_string(dsIndex));
+                }
+
+                auto &dsc = m_contentsVec[dsIndex];
+                dsc.count = ei.extractU16();
+                dsc.firstIndex = ei.buffp;
+
+                size_t bytes = dsc.count * get_entry_size(dsc);
+
+                if (bytes > ei.bytesLeft())
+                    throw end_of_buffer();
+
+                ei.skip(bytes);
+            }
+
+            eventData(msg, eventIndex, m_contentsVec);
+        }
+
+        m_contentsVec.clear();
+    }
+    catch (const end_of_buffer &)
+    {
+        throw data_consistency_error(
+            "Unexpectedly hit end of buffer while parsing EventDataBatch message");
+    }
+}
+
+// CompactEventDataBatch contents:
+//   u8  flags              CompactBatchFlags
+//   u32 payloadSize        uncompressed size of the payload
+//   payload, a single LZ4 frame if CompactBatch_LZ4 is set:
+//     u32 eventCount
+//     eventCount times:
+//       u32 eventSize
+//       u8  eventIndex
+//       for each data source sent for this event the compact encoding
+//       described at encode_data_source_compact().
+//
+// The data sources are decoded into packed (index, value) pairs so that
+// eventData() receives the same DataSourceContents as for the other event
+// data messages.
+inline void Client::_compactEventDataBatch(const Message &msg)
+{
+    try
+    {
+        uint8_t *contentsBegin = const_cast<uint8_t *>(msg.contents.data());
+
+        BufferIterator ci(contentsBegin, msg.contents.size());
+        uint8_t flags = ci.extractU8();
+        uint32_t payloadSize = ci.extractU32();
+        uint8_t *payload = ci.buffp;
+
+        if (flags & CompactBatch_LZ4)
+        {
+#ifdef MVME_EVENT_SERVER_LZ4
+            if (payloadSize > MaxMessageSize)
+                throw protocol_error("CompactEventDataBatch payload size exceeds the maximum message size");
+
+            m_payloadBuffer.resize(payloadSize);
+            lz4_decompress(ci.buffp, ci.bytesLeft(), m_payloadBuffer.data(), payloadSize);
+            payload = m_payloadBuffer.data();
+#else
+            throw protocol_error("Received LZ4 compressed data but the client was built"
+                                 " without MVME_EVENT_SERVER_LZ4");
+#endif
+        }
+        else if (payloadSize != ci.bytesLeft())
+        {
+            throw end_of_buffer();
+        }
+
+        BufferIterator pi(payload, payloadSize);
+        uint32_t eventCount = pi.extractU32();
+
+        for (uint32_t i = 0; i < eventCount; i++)
+        {
+            uint32_t eventSize = pi.extractU32();
+
+            if (eventSize > pi.bytesLeft() || eventSize == 0)
+                throw end_of_buffer();
+
+            BufferIterator ei(pi.buffp, eventSize);
+            pi.skip(eventSize);
+
+            uint8_t eventIndex = ei.extractU8();
+
+            if (eventIndex >= m_streamInfo.eventDataDescriptions.size())
+                throw data_consistency_error("eventIndex out of range");
+
+            const auto &edd = m_streamInfo.eventDataDescriptions[eventIndex];
+            m_contentsVec.resize(edd.dataSources.size());
+            m_pairsOffsets.assign(edd.dataSources.size(), 0u);
+            m_pairsBuffer.clear();
+
+            for (size_t dsIndex = 0; dsIndex < edd.dataSources.size(); dsIndex++)
+            {
+                const auto &dsd = edd.dataSources[dsIndex];
+                DataSourceContents dsc;
+                dsc.indexType = dsd.indexType;
+                dsc.valueType = dsd.valueType;
+                m_contentsVec[dsIndex] = dsc;
+            }
+
+            while (!ei.atEnd())
+            {
+                uint8_t dsIndex = ei.extractU8();
+
+                if (dsIndex >= edd.dataSources.size())
+                {
+                    throw data_consistency_error(
+                        "dataSourceIndex out of range in CompactEventDataBatch message: "
+                        + std::to_string(dsIndex));
+                }
+
+                m_pairsOffsets[dsIndex] = m_pairsBuffer.size();
+                m_contentsVec[dsIndex].count = decode_data_source_compact(
+                    edd.dataSources[dsIndex], ei, m_pairsBuffer);
+            }
+
+            // Pointers are set up after decoding all data sources as the
+            // pairs buffer may have been reallocated.
+            for (size_t dsIndex = 0; dsIndex < edd.dataSources.size(); dsIndex++)
+                m_contentsVec[dsIndex].firstIndex = m_pairsBuffer.data() + m_pairsOffsets[dsIndex];
+
+            eventData(msg, eventIndex, m_contentsVec);
+        }
+
+        m_contentsVec.clear();
+    }
+    catch (const end_of_buffer &)
+    {
+        throw data_consistency_error(
+            "Unexpectedly hit end of buffer while parsing CompactEventDataBatch message");
+    }
+}
+
 inline void Client::_endRun(const Message &msg)
 {
     auto infoJson = json::parse(msg.contents);
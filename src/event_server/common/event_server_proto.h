@@ -37,14 +37,29 @@ namespace mvme
 namespace event_server
 {
 
-static const int ProtocolVersion = 1;
-
-// Valid transitions:
-// initial      -> ServerInfo
-// ServerInfo   -> BeginRun
-// BeginRun     -> EventData | EndRun
-// EventData    -> EventData | EndRun
-// EndRun       -> BeginRun
+// Version 2 adds the ClientHello and EventDataBatch messages. Servers treat
+// clients as version 1 clients until they receive a ClientHello message so
+// version 1 clients, which never send anything to the server, keep working
+// unchanged.
+// Version 3 adds the CompactEventDataBatch message which is sent instead of
+// EventDataBatch to clients requesting compact payload encodings.
+static const int ProtocolVersion = 3;
+static const int MinProtocolVersion = 1;
+
+// Valid transitions of the messages sent by the server:
+// initial          -> ServerInfo
+// ServerInfo       -> BeginRun
+// BeginRun         -> EventData | EventDataBatch | CompactEventDataBatch | EndRun
+// EventData        -> EventData | EventDataBatch | CompactEventDataBatch | EndRun
+// EventDataBatch   -> EventData | EventDataBatch | CompactEventDataBatch | EndRun
+// CompactEventDataBatch -> EventData | EventDataBatch | CompactEventDataBatch | EndRun
+// EndRun           -> BeginRun
+//
+// ClientHello is the only message sent from the client to the server. It may
+// be sent at any time after the ServerInfo message has been received.
+//
+// New message types must be appended to keep the numeric values of the
+// existing types stable.
 enum MessageType: uint8_t
 {
     Invalid = 0,
@@ -53,6 +68,13 @@ enum MessageType: uint8_t
     EventData,
     EndRun,
 
+    // Protocol version 2
+    EventDataBatch,
+    ClientHello,
+
+    // Protocol version 3
+    CompactEventDataBatch,
+
     MessageTypeCount
 };
 
@@ -60,6 +82,33 @@ enum MessageType: uint8_t
 // value specifying the size of the message contents in bytes.
 static const size_t MessageFrameSize = sizeof(MessageType) + sizeof(uint32_t);
 
+// Limits used by the server when batching events for version 2 clients. A
+// batch is sent out once one of the limits is reached, on every timetick and
+// at the end of a run.
+static const size_t BatchMaxBytes = 256 * 1024;
+static const size_t BatchMaxEvents = 1000;
+
+// Per data source encodings used in CompactEventDataBatch messages. The server
+// picks the smallest encoding for each data source of each event.
+enum class PayloadEncoding: uint8_t
+{
+    // Packed (index, value) pairs as in EventData messages.
+    Pairs,
+    // A bitmap with one bit per data source element followed by the values of
+    // the set bits in ascending index order. Used for dense data.
+    Bitmap,
+    // Zigzag varint encoded index deltas followed by the values. Used for
+    // sparse data.
+    DeltaVarint,
+};
+
+// Flags of CompactEventDataBatch messages.
+enum CompactBatchFlags: uint8_t
+{
+    // The batch payload is compressed into a single LZ4 frame.
+    CompactBatch_LZ4 = 1u << 0,
+};
+
 struct Message
 {
     MessageType type = MessageType::Invalid;
@@ -83,9 +132,12 @@ static TransitionTable make_transition_table()
 
     ret[MessageType::Invalid]    = { { MessageType::ServerInfo } };
     ret[MessageType::ServerInfo] = { { MessageType::BeginRun } };
-    ret[MessageType::BeginRun]   = { { MessageType::EventData, MessageType::EndRun } };
-    ret[MessageType::EventData]  = { { MessageType::EventData, MessageType::EndRun } };
+    ret[MessageType::BeginRun]   = { { MessageType::EventData, MessageType::EventDataBatch, MessageType::CompactEventDataBatch, MessageType::EndRun } };
+    ret[MessageType::EventData]  = { { MessageType::EventData, MessageType::EventDataBatch, MessageType::CompactEventDataBatch, MessageType::EndRun } };
     ret[MessageType::EndRun]     = { { MessageType::BeginRun } };
+    ret[MessageType::EventDataBatch] = { { MessageType::EventData, MessageType::EventDataBatch, MessageType::CompactEventDataBatch, MessageType::EndRun } };
+    ret[MessageType::ClientHello]    = {}; // not part of the server message stream
+    ret[MessageType::CompactEventDataBatch] = { { MessageType::EventData, MessageType::EventDataBatch, MessageType::CompactEventDataBatch, MessageType::EndRun } };
 
     return ret;
 }
@@ -113,6 +165,9 @@ static MessageTypeStringTable make_messagetype_stringtable()
     ret[MessageType::BeginRun]   = "BeginRun";
     ret[MessageType::EventData]  = "EventData";
     ret[MessageType::EndRun]     = "EndRun";
+    ret[MessageType::EventDataBatch] = "EventDataBatch";
+    ret[MessageType::ClientHello]    = "ClientHello";
+    ret[MessageType::CompactEventDataBatch] = "CompactEventDataBatch";
 
     return ret;
 }
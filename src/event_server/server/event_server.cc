@@ -20,21 +20,40 @@
  */
 #include "event_server/server/event_server.h"
 
-#include <QCoreApplication>
-#include <QJsonDocument>
-#include <QJsonObject>
-#include <QJsonArray>
-#include <QTcpServer>
-#include <QTcpSocket>
+#include <algorithm>
+#include <QThread>
 
 #include "analysis/a2/a2.h"
 #include "analysis/a2_adapter.h"
 #include "event_server/common/event_server_proto.h"
+#include "event_server/server/event_server_sender.h"
 #include "event_server/server/event_server_util.h"
-#include "git_sha1.h"
 
 using namespace mvme::event_server;
 
+QString to_string(EventServer::OverflowPolicy policy)
+{
+    switch (policy)
+    {
+        case EventServer::OverflowPolicy::Block:        return QSL("block");
+        case EventServer::OverflowPolicy::DropNewest:   return QSL("drop_newest");
+        case EventServer::OverflowPolicy::Disconnect:   return QSL("disconnect");
+    }
+
+    return {};
+}
+
+EventServer::OverflowPolicy overflow_policy_from_string(const QString &str)
+{
+    if (str == QSL("drop_newest"))
+        return EventServer::OverflowPolicy::DropNewest;
+
+    if (str == QSL("disconnect"))
+        return EventServer::OverflowPolicy::Disconnect;
+
+    return EventServer::OverflowPolicy::Block;
+}
+
 struct EventServer::Private
 {
     struct RunContext
@@ -58,232 +77,239 @@ struct EventServer::Private
         size_t dataBytesPerClient = 0;
     };
 
+    static const size_t InitialOutBufferSize = Kilobytes(10);
+
+    // Analysis side view of a client. The connection itself is handled by the
+    // EventServerSender.
     struct ClientInfo
     {
-        std::unique_ptr<QTcpSocket> socket;
+        std::shared_ptr<EventServerClient> shared;
+
+        // Set from the ClientHello message. Clients which did not send a
+        // ClientHello are treated as protocol version 1 clients.
+        u32 helloGeneration = 0;
+        ClientOptions options;
+        SubscriptionFilter subscription;
+
+        // Events collected for the next batch message.
+        EventBatchBuilder batch;
     };
 
-    static const size_t InitialOutBufferSize = Kilobytes(10);
+    // Interval at which a producer blocked on a full client queue checks if
+    // the client is still connected.
+    static constexpr std::chrono::milliseconds BlockCheckInterval = std::chrono::milliseconds(100);
 
     explicit Private(EventServer *q)
         : m_q(q)
-        , m_server(q)
         , m_outBuf(InitialOutBufferSize)
         , m_enabled(false)
     { }
 
     EventServer *m_q;
-    QTcpServer m_server;
     std::vector<u8> m_outBuf;
-    QHostAddress m_listenAddress = QHostAddress::Any;
-    quint16 m_listenPort = EventServer::Default_ListenPort;
     EventServer::Logger m_logger;
     std::vector<ClientInfo> m_clients;
     bool m_runInProgress = false;
     RunContext m_runContext;
     RunStats m_runStats;
     bool m_enabled;
+    std::atomic<OverflowPolicy> m_overflowPolicy = { OverflowPolicy::Block };
+    // Byte offsets of the data sources in m_outBuf for the current event.
+    std::vector<std::pair<size_t, size_t>> m_dataSourceSpans;
+    // Compact encoding of the current event, shared by all compact clients.
+    std::vector<u8> m_compactBuf;
+    std::vector<std::pair<size_t, size_t>> m_compactSpans;
+    std::vector<std::pair<u32, u64>> m_compactScratch;
+
+    QThread m_senderThread;
+    EventServerSender *m_sender = nullptr; // lives in m_senderThread
 
-    void handleNewConnection();
-    void handleClientSocketError(QTcpSocket *socket, QAbstractSocket::SocketError error);
-    void cleanupClients();
     void logMessage(const QString &msg);
-};
 
-namespace
-{
+    // Picks up new and closed connections from the sender.
+    void updateClients();
+    void updateClientHello(ClientInfo &client);
 
-enum class WriteOption
-{
-    None,
-    Flush
+    bool enqueueControl(ClientInfo &client, const EventServerMessagePtr &msg);
+    bool enqueueData(ClientInfo &client, const EventServerMessagePtr &msg);
+
+    void appendToBatch(ClientInfo &client, s32 eventIndex, const u8 *src,
+                       const std::vector<std::pair<size_t, size_t>> &spans);
+    void flushBatch(ClientInfo &client);
+    void flushBatches();
 };
 
-static const int FlushTimeout_ms = 1000;
+constexpr std::chrono::milliseconds EventServer::Private::BlockCheckInterval;
 
-qint64 write_data(QIODevice &out, const char *data, size_t size)
+void EventServer::Private::logMessage(const QString &msg)
 {
-    const char *curPtr = data;
-    const char *endPtr = data + size;
-
-    while (curPtr < endPtr)
+    if (m_logger)
     {
-        qint64 written = out.write(data, size);
-
-        if (written < 0)
-        {
-            return written;
-        }
-
-        curPtr += written;
+        m_logger(QSL("EventServer: ") + msg);
     }
-
-    assert(curPtr == endPtr);
-
-    return curPtr - data;
 }
 
-/* Write a Plain-Old-Datatype to the output device. */
-template<typename T>
-qint64 write_pod(QIODevice &out, const T &t)
+void EventServer::Private::updateClients()
 {
-    return write_data(out, reinterpret_cast<const char *>(&t), sizeof(T));
-}
+    if (m_sender->testAndClearClientsClosed())
+    {
+        m_clients.erase(
+            std::remove_if(m_clients.begin(), m_clients.end(),
+                           [] (const ClientInfo &ci) { return ci.shared->closed.load(); }),
+            m_clients.end());
+    }
 
-/* Write header and size information, not contents. */
-qint64 write_message_header(QIODevice &out, MessageType type, u32 size)
-{
-    qint64 result = 0, written = 0;
+    if (m_sender->hasNewClients())
+    {
+        for (auto &shared: m_sender->takeNewClients())
+        {
+            ClientInfo client;
+            client.shared = shared;
 
-    if ((written = write_pod(out, type)) < 0) return written; else result += written;
-    if ((written = write_pod(out, size)) < 0) return written; else result += written;
+            // If a run is in progress immediately send out a BeginRun message
+            // to the client. This reuses the information built in beginRun()
+            // when the run started.
+            if (m_runInProgress)
+            {
+                qDebug() << "EventServer: client connected during an active run. Sending"
+                    " outputInfo.";
 
-    return result;
+                auto outputInfo = m_runContext.outputInfoJSON;
+                outputInfo["runInProgress"] = true;
+
+                enqueueControl(client, make_event_server_message(
+                        MessageType::BeginRun, QByteArray::fromStdString(outputInfo.dump())));
+            }
+
+            m_clients.emplace_back(std::move(client));
+        }
+    }
 }
 
-qint64 write_message(QIODevice &out, MessageType type, const char *data, u32 size,
-                     WriteOption opt = WriteOption::None)
+void EventServer::Private::updateClientHello(ClientInfo &client)
 {
-    qint64 result = 0, written = 0;
+    u32 generation = client.shared->helloGeneration.load(std::memory_order_acquire);
 
-    if ((written = write_message_header(out, type, size)) < 0)
-        return written;
-    else
-        result += written;
+    if (generation == client.helloGeneration)
+        return;
 
-    if ((written = write_data(out, data, size)) < 0)
-        return written;
-    else
-        result += written;
+    auto hello = client.shared->getHello();
 
-    if (opt == WriteOption::Flush)
-        out.waitForBytesWritten(FlushTimeout_ms);
+    // Send out events collected so far before switching modes.
+    flushBatch(client);
 
-    return result;
+    client.helloGeneration = generation;
+    client.options = negotiate_client_options(hello);
+    client.batch.setCompact(client.options.compact);
+    client.subscription = make_subscription_filter(hello, a2::MaxVMEEvents);
 }
 
-qint64 write_message(QIODevice &out, MessageType type, const QByteArray &contents,
-                     WriteOption opt = WriteOption::None)
+// BeginRun and EndRun messages are never dropped. Waits for queue space
+// regardless of the overflow policy.
+bool EventServer::Private::enqueueControl(ClientInfo &client, const EventServerMessagePtr &msg)
 {
-    return write_message(out, type, contents.data(),
-                         static_cast<u32>(contents.size()),
-                         opt);
-}
+    auto &shared = *client.shared;
 
-} // end anon namespace
-
-void EventServer::Private::handleNewConnection()
-{
-    if (auto clientSocket = m_server.nextPendingConnection())
+    while (!shared.queue.enqueue(msg, BlockCheckInterval))
     {
-        qDebug() << "DataServer: new connection from" << clientSocket->peerAddress()
-            << ", new client count =" << m_clients.size() + 1;
-
-        ClientInfo clientInfo = { std::unique_ptr<QTcpSocket>(clientSocket) };
-
-        // ugly cast due to overloaded QAbstractSocket::error() method
-        connect(clientInfo.socket.get(),
-                static_cast<void (QAbstractSocket::*)(QAbstractSocket::SocketError)>(
-                    &QAbstractSocket::error),
-                m_q, [this, clientSocket] (QAbstractSocket::SocketError error) {
-                    handleClientSocketError(clientSocket, error);
-        });
-
-        // Initial ServerInfo message
-
-        json serverInfo;
-
-        serverInfo["mvme_version"] = std::string(GIT_VERSION);
-        serverInfo["protocol_version"] = ProtocolVersion;
+        if (shared.closed || shared.disconnectRequested)
+            return false;
+    }
 
-        auto jsonString = QByteArray::fromStdString(serverInfo.dump());
-        write_message(*clientInfo.socket, MessageType::ServerInfo, jsonString, WriteOption::Flush);
+    m_sender->notify();
+    return true;
+}
 
-        // If a run is in progress immediately send out a BeginRun message to
-        // the client. This reuses the information built in beginRun() when the
-        // run started.
-        if (m_runInProgress)
-        {
-            qDebug() << "DataServer: client connected during an active run. Sending"
-                " outputInfo.";
+bool EventServer::Private::enqueueData(ClientInfo &client, const EventServerMessagePtr &msg)
+{
+    auto &shared = *client.shared;
 
-            auto outputInfo = m_runContext.outputInfoJSON;
-            outputInfo["runInProgress"] = true;
+    if (shared.closed || shared.disconnectRequested)
+        return false;
 
-            auto jsonString = QByteArray::fromStdString(outputInfo.dump());
+    switch (m_overflowPolicy.load(std::memory_order_relaxed))
+    {
+        case OverflowPolicy::Block:
+            return enqueueControl(client, msg);
 
-            write_message(*clientSocket, MessageType::BeginRun, jsonString, WriteOption::Flush);
-        }
+        case OverflowPolicy::DropNewest:
+            if (!shared.queue.try_enqueue(msg))
+            {
+                ++shared.messagesDropped;
+                return false;
+            }
+            break;
 
-        if (clientInfo.socket->isValid())
-        {
-            m_clients.emplace_back(std::move(clientInfo));
-        }
+        case OverflowPolicy::Disconnect:
+            if (!shared.queue.try_enqueue(msg))
+            {
+                ++shared.messagesDropped;
+                // The sender thread closes the connection.
+                shared.disconnectRequested = true;
+                m_sender->notify();
+                return false;
+            }
+            break;
     }
-}
 
-void EventServer::Private::handleClientSocketError(
-    QTcpSocket * /*socket*/,
-    QAbstractSocket::SocketError /*error*/)
-{
-    if (!m_runInProgress)
-    {
-        qDebug() << __PRETTY_FUNCTION__ << "calling cleanupClients()";
-        cleanupClients();
-    }
+    m_sender->notify();
+    return true;
 }
 
-// remove invalid clients (error, disconnected, etc)
-void EventServer::Private::cleanupClients()
+// Appends the event to the batch of the client. src and spans are either the
+// EventData message or the compact encoding of the event. Only the data
+// sources the client subscribed to are copied.
+void EventServer::Private::appendToBatch(ClientInfo &client, s32 eventIndex, const u8 *src,
+                                         const std::vector<std::pair<size_t, size_t>> &spans)
 {
-    qDebug() << __PRETTY_FUNCTION__;
-
-    auto to_be_removed = [] (const Private::ClientInfo &ci) -> bool
-    {
-        if (!ci.socket) return true;
-        if (!ci.socket->isValid()) return true;
-        return ci.socket->state() == QAbstractSocket::UnconnectedState;
-    };
+    client.batch.appendEvent(eventIndex, src, spans, client.subscription);
 
-    for (auto &client: m_clients)
-    {
-        if (to_be_removed(client))
-        {
-            if (client.socket)
-            {
-                qDebug() << __PRETTY_FUNCTION__ << "removing client " << client.socket->peerAddress();
-                client.socket->deleteLater();
-                client.socket.release();
-            }
-        }
-    }
+    if (client.batch.isFull())
+        flushBatch(client);
+}
 
-    // Remove the now stale pointers from the list of clients.
-    m_clients.erase(std::remove_if(m_clients.begin(), m_clients.end(), to_be_removed),
-                    m_clients.end());
+// Turns the batch buffer into an EventDataBatch or CompactEventDataBatch
+// message and queues it.
+void EventServer::Private::flushBatch(ClientInfo &client)
+{
+    if (client.batch.eventCount() == 0)
+        return;
 
-    qDebug() << __PRETTY_FUNCTION__ << ", new client count =" << m_clients.size();
+    enqueueData(client, std::make_shared<std::vector<u8>>(
+            client.batch.takeMessage(client.options.lz4)));
 }
 
-void EventServer::Private::logMessage(const QString &msg)
+void EventServer::Private::flushBatches()
 {
-    if (m_logger)
-    {
-        m_logger(QSL("EventServer: ") + msg);
-    }
+    for (auto &client: m_clients)
+        flushBatch(client);
 }
 
 EventServer::EventServer(QObject *parent)
     : QObject(parent)
     , m_d(std::make_unique<Private>(this))
 {
-    connect(&m_d->m_server, &QTcpServer::newConnection,
-            this, [this] { m_d->handleNewConnection(); });
+    m_d->m_senderThread.setObjectName("event_server");
+    m_d->m_sender = new EventServerSender;
+    m_d->m_sender->moveToThread(&m_d->m_senderThread);
+
+    connect(&m_d->m_senderThread, &QThread::finished,
+            m_d->m_sender, &QObject::deleteLater);
+
+    connect(m_d->m_sender, &EventServerSender::clientConnected,
+            this, &EventServer::clientConnected);
+
+    connect(m_d->m_sender, &EventServerSender::clientDisconnected,
+            this, &EventServer::clientDisconnected);
+
+    m_d->m_senderThread.start();
 }
 
 EventServer::~EventServer()
 {
-    //qDebug() << "<<< >>> <<< >>>" << __PRETTY_FUNCTION__ << "<<< >>> <<< >>>";
+    shutdown();
+    m_d->m_senderThread.quit();
+    m_d->m_senderThread.wait();
 }
 
 void EventServer::startup()
@@ -291,23 +317,11 @@ void EventServer::startup()
     qDebug() << __PRETTY_FUNCTION__ << this << "enabled =" << m_d->m_enabled;
     if (m_d->m_enabled)
     {
-        if (!m_d->m_server.isListening())
-        {
-            if (m_d->m_server.listen(m_d->m_listenAddress, m_d->m_listenPort))
-            {
-#if 0
-                m_d->logMessage(QSL("Listening on %1:%2")
-                           .arg(m_d->m_listenAddress.toString())
-                           .arg(m_d->m_listenPort));
-#endif
-            }
-            else
-            {
-                m_d->logMessage(QSL("Error listening on %1:%2")
-                           .arg(m_d->m_listenAddress.toString())
-                           .arg(m_d->m_listenPort));
-            }
-        }
+        bool listening = false;
+
+        QMetaObject::invokeMethod(m_d->m_sender, "listen", Qt::BlockingQueuedConnection,
+                                  Q_RETURN_ARG(bool, listening));
+        (void) listening;
     }
     else
     {
@@ -317,29 +331,68 @@ void EventServer::startup()
 
 void EventServer::shutdown()
 {
-    m_d->m_server.close();
+    QMetaObject::invokeMethod(m_d->m_sender, "close", Qt::BlockingQueuedConnection);
     m_d->m_clients.clear();
 }
 
 void EventServer::setLogger(Logger logger)
 {
     m_d->m_logger = logger;
+    m_d->m_sender->setLogger(logger);
 }
 
 void EventServer::setListeningInfo(const QHostAddress &address, quint16 port)
 {
-    m_d->m_listenAddress = address;
-    m_d->m_listenPort = port;
+    m_d->m_sender->setListeningInfo(address, port);
 }
 
 bool EventServer::isListening() const
 {
-    return m_d->m_server.isListening();
+    return m_d->m_sender->isListening();
 }
 
 size_t EventServer::getNumberOfClients() const
 {
-    return m_d->m_clients.size();
+    return m_d->m_sender->getNumberOfClients();
+}
+
+void EventServer::setOverflowPolicy(OverflowPolicy policy)
+{
+    m_d->m_overflowPolicy = policy;
+}
+
+EventServer::OverflowPolicy EventServer::getOverflowPolicy() const
+{
+    return m_d->m_overflowPolicy;
+}
+
+void EventServer::setQueueCapacity(size_t messages)
+{
+    m_d->m_sender->setQueueCapacity(messages);
+}
+
+size_t EventServer::getQueueCapacity() const
+{
+    return m_d->m_sender->getQueueCapacity();
+}
+
+std::vector<EventServer::ClientCounters> EventServer::getClientCounters() const
+{
+    std::vector<ClientCounters> result;
+
+    for (const auto &client: m_d->m_sender->getClients())
+    {
+        ClientCounters counters;
+        counters.peerAddress = client->peerAddress;
+        counters.bytesSent = client->bytesSent;
+        counters.messagesSent = client->messagesSent;
+        counters.messagesDropped = client->messagesDropped;
+        counters.queueDepth = client->queue.size();
+        counters.queueCapacity = client->queue.capacity();
+        result.emplace_back(counters);
+    }
+
+    return result;
 }
 
 void EventServer::setEnabled(bool b)
@@ -359,8 +412,7 @@ void EventServer::beginRun(const RunInfo &runInfo,
 
     assert(!m_d->m_runInProgress);
 
-    qDebug() << __PRETTY_FUNCTION__ << "calling cleanupClients()";
-    m_d->cleanupClients();
+    m_d->updateClients();
 
     if (!(analysis->getA2AdapterState() && analysis->getA2AdapterState()->a2))
         return;
@@ -398,11 +450,12 @@ void EventServer::beginRun(const RunInfo &runInfo,
     qDebug() << "EventServer::beginRun: outputInfo to be sent to clients:";
     qDebug().noquote() << QString::fromStdString(outputInfo.dump(2));
 
-    auto jsonString = QByteArray::fromStdString(outputInfo.dump());
+    auto msg = make_event_server_message(
+        MessageType::BeginRun, QByteArray::fromStdString(outputInfo.dump()));
 
     for (auto &client: m_d->m_clients)
     {
-        write_message(*client.socket, MessageType::BeginRun, jsonString, WriteOption::Flush);
+        m_d->enqueueControl(client, msg);
     }
 
     m_d->m_runInProgress = true;
@@ -423,15 +476,23 @@ void EventServer::endEvent(s32 eventIndex)
         return;
     }
 
-    if (getNumberOfClients() == 0)
-    {
-        // Allows QTcpServer to accept new connections
-        // FIXME: measure performance without this call. I think this can have
-        // a huge impact. If so only perform it based on a timeout.
-        QCoreApplication::processEvents();
+    m_d->updateClients();
+
+    if (m_d->m_clients.empty())
         return;
+
+    // Skip encoding the event if no client is interested in it.
+    bool anyClientWantsEvent = false;
+
+    for (auto &client: m_d->m_clients)
+    {
+        m_d->updateClientHello(client);
+        anyClientWantsEvent = anyClientWantsEvent || client.subscription.wantsEvent(eventIndex);
     }
 
+    if (!anyClientWantsEvent)
+        return;
+
     const a2::A2 *a2 = m_d->m_runContext.a2;
     const u32 dataSourceCount = a2->dataSourceCounts[eventIndex];
     const auto &edd = m_d->m_runContext.outputDescription.eventDataDescriptions[eventIndex];
@@ -457,12 +518,15 @@ void EventServer::endEvent(s32 eventIndex)
             u32 *msgSizePtr = out.push(static_cast<u32>(0u));
             out.push(static_cast<u8>(eventIndex));
 
+            m_d->m_dataSourceSpans.resize(edd.dataSources.size());
+
             for (size_t dsIndex = 0; dsIndex < edd.dataSources.size(); dsIndex++)
             {
                 // For each data source push its index and space for the number
                 // of following (index, value) pairs.
                 // u8  dataSourceIndex
                 // u16 elementCount
+                const size_t dsBegin = out.used();
                 out.push(static_cast<u8>(dsIndex));
                 u16 *countPtr = out.push(static_cast<u16>(0u));
 
@@ -471,10 +535,16 @@ void EventServer::endEvent(s32 eventIndex)
                 const auto &dsd = edd.dataSources[dsIndex];
                 u16 count = 0u; // Count of valid values.
 
+                // If the data source records its valid parameter indexes only
+                // those are visited, otherwise all parameters are tested.
+                const a2::ValidIndexes *valid = ds->validIndexes;
+                const s32 visitCount = valid ? valid->count : dataPipe.size();
+
                 // Write out the (index, value) pairs for valid parameters
                 // using the data types specified in the DataSourceDescription.
-                for (s32 paramIndex = 0; paramIndex < dataPipe.size(); paramIndex++)
+                for (s32 visitIndex = 0; visitIndex < visitCount; visitIndex++)
                 {
+                    s32 paramIndex = valid ? valid->indexes[visitIndex] : visitIndex;
                     double dParamValue = dataPipe.data[paramIndex];
 
                     if (a2::is_param_valid(dParamValue))
@@ -522,16 +592,48 @@ void EventServer::endEvent(s32 eventIndex)
 
                 // write the element count to the buffer
                 *countPtr = count;
+
+                // Record where the data source is located in the buffer so
+                // that it can be copied into EventDataBatch messages.
+                m_d->m_dataSourceSpans[dsIndex] = { dsBegin, out.used() - dsBegin };
             }
 
             u32 contentsBytes = out.asU8() - reinterpret_cast<u8 *>((msgSizePtr + 1));
             *msgSizePtr = contentsBytes;
 
+            // The EventData message is shared by all unbatched clients.
+            EventServerMessagePtr msg;
+            bool compactEncoded = false;
+
             for (auto &client: m_d->m_clients)
             {
-                if (!client.socket->isValid()) continue;
-                write_data(*client.socket, reinterpret_cast<const char *>(out.data),
-                           out.used());
+                if (!client.subscription.wantsEvent(eventIndex)) continue;
+
+                if (client.options.compact)
+                {
+                    if (!compactEncoded)
+                    {
+                        encode_event_compact(edd, out.data, m_d->m_dataSourceSpans,
+                                             m_d->m_compactBuf, m_d->m_compactSpans,
+                                             m_d->m_compactScratch);
+                        compactEncoded = true;
+                    }
+
+                    m_d->appendToBatch(client, eventIndex, m_d->m_compactBuf.data(),
+                                       m_d->m_compactSpans);
+                }
+                else if (client.options.batched)
+                {
+                    // Copies the data source blocks out of the EventData message.
+                    m_d->appendToBatch(client, eventIndex, out.data, m_d->m_dataSourceSpans);
+                }
+                else
+                {
+                    if (!msg)
+                        msg = std::make_shared<std::vector<u8>>(out.data, out.data + out.used());
+
+                    m_d->enqueueData(client, msg);
+                }
             }
 
             m_d->m_runStats.dataBytesPerClient += out.used();
@@ -547,25 +649,14 @@ void EventServer::endEvent(s32 eventIndex)
         }
     }
 
-    // block if there's enough pending data
-    for (auto &client: m_d->m_clients)
-    {
-        static const qint64 WriteFlushTreshold = Megabytes(10);
-
-        if (client.socket->isValid() && client.socket->bytesToWrite() > WriteFlushTreshold)
-        {
-            client.socket->waitForBytesWritten();
-        }
-    }
-
-    // allow QTcpServer to handle new connections
-    QCoreApplication::processEvents();
 }
 
 void EventServer::endRun(const DAQStats &daqStats, const std::exception *e)
 {
     if (!m_d->m_enabled) return;
 
+    m_d->updateClients();
+
     json endRunInfo;
     // FIXME: I think during a replay these contain the current (real time)
     // time values instead of the values from the replay
@@ -581,19 +672,16 @@ void EventServer::endRun(const DAQStats &daqStats, const std::exception *e)
     qDebug() << "EventServer::endRun: endRunInfo to be sent to clients:";
     qDebug().noquote() << QString::fromStdString(endRunInfo.dump(2));
 
-    auto jsonString = QByteArray::fromStdString(endRunInfo.dump());
+    // Send out partially filled batches before the EndRun message.
+    m_d->flushBatches();
 
-    for (auto &client: m_d->m_clients)
-    {
-        if (!client.socket->isValid()) continue;
-        write_message(*client.socket, MessageType::EndRun, jsonString, WriteOption::Flush);
-    }
+    auto msg = make_event_server_message(
+        MessageType::EndRun, QByteArray::fromStdString(endRunInfo.dump()));
 
-    // flush all data on endrun
+    // The messages are written out by the sender thread in the background.
     for (auto &client: m_d->m_clients)
     {
-        while (client.socket->isValid() && client.socket->bytesToWrite() > 0)
-            client.socket->waitForBytesWritten();
+        m_d->enqueueControl(client, msg);
     }
 
     m_d->m_runContext = {};
@@ -603,8 +691,6 @@ void EventServer::endRun(const DAQStats &daqStats, const std::exception *e)
         << m_d->m_runStats.dataBytesPerClient
         << "bytes, " << m_d->m_runStats.dataBytesPerClient / (1024.0 * 1024.0)
         << "MB";
-
-    m_d->cleanupClients();
 }
 
 void EventServer::beginEvent(s32 eventIndex)
@@ -636,6 +722,8 @@ void EventServer::processModuleSuffix(s32 eventIndex, s32 moduleIndex,
 void EventServer::processTimetick()
 {
     if (!m_d->m_enabled) return;
-    // TODO: how to handle timeticks? handle them at all?
     assert(m_d->m_runInProgress);
+
+    // Bounds the latency of batched event data to one second.
+    m_d->flushBatches();
 }
@@ -24,6 +24,7 @@
 #include "libmvme_export.h"
 #include "mvme_stream_processor.h"
 #include <QHostAddress>
+#include <vector>
 
 class LIBMVME_EXPORT EventServer: public QObject, public IMVMEStreamModuleConsumer
 {
@@ -34,6 +35,27 @@ class LIBMVME_EXPORT EventServer: public QObject, public IMVMEStreamModuleConsum
 
     public:
         static const uint16_t Default_ListenPort = 13801;
+        static const size_t Default_QueueCapacity = 1024;
+
+        // What to do with event data when the send queue of a client is full.
+        // BeginRun and EndRun messages are never dropped.
+        enum class OverflowPolicy
+        {
+            Block,          // Wait for the client, stalling the analysis.
+            DropNewest,     // Drop the message that does not fit.
+            Disconnect,     // Close the connection to the client.
+        };
+
+        // Per client statistics maintained by the sender thread.
+        struct ClientCounters
+        {
+            QString peerAddress;
+            u64 bytesSent = 0;
+            u64 messagesSent = 0;
+            u64 messagesDropped = 0;
+            size_t queueDepth = 0;
+            size_t queueCapacity = 0;
+        };
 
         explicit EventServer(QObject *parent = nullptr);
         virtual ~EventServer();
@@ -65,6 +87,17 @@ class LIBMVME_EXPORT EventServer: public QObject, public IMVMEStreamModuleConsum
         bool isListening() const;
         size_t getNumberOfClients() const;
 
+        void setOverflowPolicy(OverflowPolicy policy);
+        OverflowPolicy getOverflowPolicy() const;
+
+        // Capacity of the per client send queues in number of messages.
+        // Applies to clients connecting after the call.
+        void setQueueCapacity(size_t messages);
+        size_t getQueueCapacity() const;
+
+        // Thread-safe.
+        std::vector<ClientCounters> getClientCounters() const;
+
     public slots:
         void setEnabled(bool b);
 
@@ -73,4 +106,7 @@ class LIBMVME_EXPORT EventServer: public QObject, public IMVMEStreamModuleConsum
         std::unique_ptr<Private> m_d;
 };
 
+QString LIBMVME_EXPORT to_string(EventServer::OverflowPolicy policy);
+EventServer::OverflowPolicy LIBMVME_EXPORT overflow_policy_from_string(const QString &str);
+
 #endif /* __MVME_EVENT_SERVER_H__ */
@@ -0,0 +1,441 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "event_server/server/event_server_sender.h"
+
+#include <algorithm>
+#include <cstring>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+#include "git_sha1.h"
+#include "util/qt_str.h"
+
+using namespace mvme::event_server;
+
+EventServerMessagePtr make_event_server_message(MessageType type, const QByteArray &contents)
+{
+    auto result = std::make_shared<std::vector<u8>>(MessageFrameSize + contents.size());
+    u32 size = contents.size();
+
+    std::memcpy(result->data(), &type, sizeof(type));
+    std::memcpy(result->data() + sizeof(type), &size, sizeof(size));
+    std::memcpy(result->data() + MessageFrameSize, contents.constData(), contents.size());
+
+    return result;
+}
+
+namespace
+{
+
+// Data is only passed to a socket while less than this amount is waiting to
+// be written. Otherwise messages stay in the client queue so that the queue
+// depth reflects how far the client is behind.
+static const qint64 SocketWriteLimit = Megabytes(1);
+
+// Limit for the size of messages sent by clients.
+static const u32 MaxClientMessageSize = Kilobytes(64);
+
+} // end anon namespace
+
+struct EventServerSender::Private
+{
+    struct Connection
+    {
+        std::shared_ptr<EventServerClient> client;
+        QTcpSocket *socket = nullptr; // owned by the QTcpServer
+        QByteArray inBuffer;
+    };
+
+    EventServerSender *q;
+    QTcpServer server;
+    std::vector<Connection> connections;
+    u32 nextClientId = 0;
+
+    mutable std::mutex mutex;
+    Logger logger;
+    QHostAddress listenAddress = QHostAddress::Any;
+    quint16 listenPort = 0;
+    // All open clients and the ones not yet taken by the analysis side.
+    std::vector<std::shared_ptr<EventServerClient>> clients;
+    std::vector<std::shared_ptr<EventServerClient>> newClients;
+
+    std::atomic<bool> listening = { false };
+    std::atomic<bool> hasNewClients = { false };
+    std::atomic<bool> clientsClosed = { false };
+    std::atomic<bool> drainScheduled = { false };
+    std::atomic<size_t> queueCapacity = { 1024 };
+
+    explicit Private(EventServerSender *q_)
+        : q(q_)
+        , server(q_)
+    {}
+
+    void logMessage(const QString &msg)
+    {
+        Logger l;
+
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            l = logger;
+        }
+
+        if (l)
+            l(QSL("EventServer: ") + msg);
+    }
+
+    Connection *findConnection(QTcpSocket *socket)
+    {
+        auto it = std::find_if(connections.begin(), connections.end(),
+                               [socket] (const Connection &c) { return c.socket == socket; });
+        return it != connections.end() ? &*it : nullptr;
+    }
+
+    void handleNewConnection();
+    void handleReadyRead(QTcpSocket *socket);
+    void handleClientHello(Connection &con, const QByteArray &contents);
+    void removeConnection(QTcpSocket *socket);
+    void drain(Connection &con);
+};
+
+void EventServerSender::Private::handleNewConnection()
+{
+    while (auto socket = server.nextPendingConnection())
+    {
+        auto client = std::make_shared<EventServerClient>(
+            nextClientId++, socket->peerAddress().toString(), queueCapacity.load());
+
+        qDebug() << "EventServer: new connection from" << client->peerAddress
+            << ", new client count =" << connections.size() + 1;
+
+        QObject::connect(socket, &QAbstractSocket::disconnected,
+                         q, [this, socket] () { removeConnection(socket); });
+
+        // ugly cast due to overloaded QAbstractSocket::error() method
+        QObject::connect(socket,
+                         static_cast<void (QAbstractSocket::*)(QAbstractSocket::SocketError)>(
+                             &QAbstractSocket::error),
+                         q, [this, socket] (QAbstractSocket::SocketError) {
+                             removeConnection(socket);
+                         });
+
+        QObject::connect(socket, &QIODevice::readyRead,
+                         q, [this, socket] () { handleReadyRead(socket); });
+
+        QObject::connect(socket, &QIODevice::bytesWritten,
+                         q, [this, socket] (qint64 bytes)
+        {
+            if (auto con = findConnection(socket))
+            {
+                con->client->bytesSent += bytes;
+                drain(*con);
+            }
+        });
+
+        // Initial ServerInfo message. Written directly to the socket so that it
+        // precedes everything queued by the analysis side.
+        json serverInfo;
+        serverInfo["mvme_version"] = std::string(GIT_VERSION);
+        serverInfo["protocol_version"] = ProtocolVersion;
+        serverInfo["min_protocol_version"] = MinProtocolVersion;
+#ifdef MVME_EVENT_SERVER_LZ4
+        serverInfo["lz4"] = true;
+#else
+        serverInfo["lz4"] = false;
+#endif
+
+        auto msg = make_event_server_message(
+            MessageType::ServerInfo, QByteArray::fromStdString(serverInfo.dump()));
+        socket->write(reinterpret_cast<const char *>(msg->data()), msg->size());
+
+        connections.push_back({ client, socket, {} });
+
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            clients.push_back(client);
+            newClients.push_back(client);
+            hasNewClients = true;
+        }
+
+        emit q->clientConnected();
+    }
+}
+
+void EventServerSender::Private::handleReadyRead(QTcpSocket *socket)
+{
+    auto con = findConnection(socket);
+
+    if (!con)
+        return;
+
+    con->inBuffer.append(socket->readAll());
+
+    while (static_cast<size_t>(con->inBuffer.size()) >= MessageFrameSize)
+    {
+        MessageType type = MessageType::Invalid;
+        u32 size = 0;
+
+        std::memcpy(&type, con->inBuffer.constData(), sizeof(type));
+        std::memcpy(&size, con->inBuffer.constData() + sizeof(type), sizeof(size));
+
+        if (type != MessageType::ClientHello || size > MaxClientMessageSize)
+        {
+            logMessage(QSL("Received unexpected message (type=%1, size=%2) from %3."
+                           " Closing connection.")
+                       .arg(static_cast<int>(type))
+                       .arg(size)
+                       .arg(con->client->peerAddress));
+            socket->abort();
+            return;
+        }
+
+        if (static_cast<size_t>(con->inBuffer.size()) < MessageFrameSize + size)
+            break;
+
+        handleClientHello(*con, con->inBuffer.mid(MessageFrameSize, size));
+        con->inBuffer.remove(0, MessageFrameSize + size);
+    }
+}
+
+void EventServerSender::Private::handleClientHello(Connection &con, const QByteArray &contents)
+{
+    ClientHelloInfo hello;
+
+    try
+    {
+        hello = parse_client_hello(json::parse(contents.toStdString()));
+    }
+    catch (const std::exception &e)
+    {
+        logMessage(QSL("Error parsing ClientHello message from %1: %2")
+                   .arg(con.client->peerAddress)
+                   .arg(e.what()));
+        return;
+    }
+
+    qDebug() << "EventServer: ClientHello from" << con.client->peerAddress
+        << ": protocolVersion =" << hello.protocolVersion
+        << ", batched =" << hello.batched
+        << ", subscriptions =" << hello.subscriptions.size();
+
+    {
+        std::lock_guard<std::mutex> guard(con.client->helloMutex);
+        con.client->hello = hello;
+    }
+
+    ++con.client->helloGeneration;
+}
+
+void EventServerSender::Private::removeConnection(QTcpSocket *socket)
+{
+    auto it = std::find_if(connections.begin(), connections.end(),
+                           [socket] (const Connection &c) { return c.socket == socket; });
+
+    if (it == connections.end())
+        return;
+
+    auto client = it->client;
+    client->closed = true;
+
+    qDebug() << "EventServer: removing client" << client->peerAddress
+        << ", bytesSent =" << client->bytesSent
+        << ", messagesDropped =" << client->messagesDropped;
+
+    connections.erase(it);
+    socket->deleteLater();
+
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        clients.erase(std::remove(clients.begin(), clients.end(), client), clients.end());
+        newClients.erase(std::remove(newClients.begin(), newClients.end(), client), newClients.end());
+        hasNewClients = !newClients.empty();
+        clientsClosed = true;
+    }
+
+    // Drop the queued messages. Wakes up a producer blocked on the full
+    // queue.
+    EventServerMessagePtr msg;
+    while (client->queue.try_dequeue(msg));
+
+    emit q->clientDisconnected();
+}
+
+void EventServerSender::Private::drain(Connection &con)
+{
+    auto &client = *con.client;
+
+    if (client.disconnectRequested)
+    {
+        logMessage(QSL("Disconnecting client %1: send queue overflow.")
+                   .arg(client.peerAddress));
+        con.socket->abort();
+        return;
+    }
+
+    EventServerMessagePtr msg;
+
+    while (con.socket->bytesToWrite() < SocketWriteLimit
+           && client.queue.try_dequeue(msg))
+    {
+        con.socket->write(reinterpret_cast<const char *>(msg->data()), msg->size());
+        ++client.messagesSent;
+    }
+}
+
+EventServerSender::EventServerSender()
+    : d(std::make_unique<Private>(this))
+{
+    connect(&d->server, &QTcpServer::newConnection,
+            this, [this] { d->handleNewConnection(); });
+}
+
+EventServerSender::~EventServerSender()
+{
+}
+
+void EventServerSender::setLogger(Logger logger)
+{
+    std::lock_guard<std::mutex> guard(d->mutex);
+    d->logger = logger;
+}
+
+void EventServerSender::setQueueCapacity(size_t capacity)
+{
+    d->queueCapacity = std::max(capacity, static_cast<size_t>(2u));
+}
+
+size_t EventServerSender::getQueueCapacity() const
+{
+    return d->queueCapacity;
+}
+
+void EventServerSender::setListeningInfo(const QHostAddress &address, quint16 port)
+{
+    std::lock_guard<std::mutex> guard(d->mutex);
+    d->listenAddress = address;
+    d->listenPort = port;
+}
+
+bool EventServerSender::isListening() const
+{
+    return d->listening;
+}
+
+size_t EventServerSender::getNumberOfClients() const
+{
+    std::lock_guard<std::mutex> guard(d->mutex);
+    return d->clients.size();
+}
+
+bool EventServerSender::hasNewClients() const
+{
+    return d->hasNewClients.load(std::memory_order_relaxed);
+}
+
+std::vector<std::shared_ptr<EventServerClient>> EventServerSender::takeNewClients()
+{
+    std::lock_guard<std::mutex> guard(d->mutex);
+    auto result = std::move(d->newClients);
+    d->newClients.clear();
+    d->hasNewClients = false;
+    return result;
+}
+
+bool EventServerSender::testAndClearClientsClosed()
+{
+    return d->clientsClosed.exchange(false);
+}
+
+std::vector<std::shared_ptr<EventServerClient>> EventServerSender::getClients() const
+{
+    std::lock_guard<std::mutex> guard(d->mutex);
+    return d->clients;
+}
+
+void EventServerSender::notify()
+{
+    if (!d->drainScheduled.exchange(true))
+    {
+        QMetaObject::invokeMethod(this, "drainAll", Qt::QueuedConnection);
+    }
+}
+
+bool EventServerSender::listen()
+{
+    if (d->server.isListening())
+        return true;
+
+    QHostAddress address;
+    quint16 port = 0;
+
+    {
+        std::lock_guard<std::mutex> guard(d->mutex);
+        address = d->listenAddress;
+        port = d->listenPort;
+    }
+
+    if (!d->server.listen(address, port))
+    {
+        d->logMessage(QSL("Error listening on %1:%2")
+                      .arg(address.toString())
+                      .arg(port));
+        return false;
+    }
+
+    d->listening = true;
+    return true;
+}
+
+void EventServerSender::close()
+{
+    d->server.close();
+    d->listening = false;
+
+    // removeConnection() modifies the connection list.
+    std::vector<QTcpSocket *> sockets;
+
+    for (const auto &con: d->connections)
+        sockets.push_back(con.socket);
+
+    for (auto socket: sockets)
+    {
+        d->removeConnection(socket);
+        socket->abort();
+    }
+}
+
+void EventServerSender::drainAll()
+{
+    // Cleared first so that a notify() from the producer during the loop
+    // schedules another call.
+    d->drainScheduled = false;
+
+    // drain() may close connections which removes them from the list.
+    std::vector<QTcpSocket *> sockets;
+
+    for (const auto &con: d->connections)
+        sockets.push_back(con.socket);
+
+    for (auto socket: sockets)
+    {
+        if (auto con = d->findConnection(socket))
+            d->drain(*con);
+    }
+}
@@ -0,0 +1,143 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef __MVME_EVENT_SERVER_SENDER_H__
+#define __MVME_EVENT_SERVER_SENDER_H__
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <QHostAddress>
+#include <QObject>
+
+#include "event_server/common/event_server_lib.h"
+#include "typedefs.h"
+#include "util/lockfree_ring.h"
+
+// A complete serialized message including the message frame. Messages are
+// shared between the queues of all clients receiving the same data.
+using EventServerMessagePtr = std::shared_ptr<const std::vector<u8>>;
+
+EventServerMessagePtr make_event_server_message(
+    mvme::event_server::MessageType type, const QByteArray &contents);
+
+// State of one client connection shared between the analysis thread, which
+// produces messages, and the sender thread, which owns the socket.
+struct EventServerClient
+{
+    using Queue = mesytec::mvme::LockFreeRing<EventServerMessagePtr>;
+
+    EventServerClient(u32 id, const QString &peerAddress, size_t queueCapacity)
+        : id(id)
+        , peerAddress(peerAddress)
+        , queue(queueCapacity)
+    {}
+
+    const u32 id;
+    const QString peerAddress;
+
+    // Serialized messages waiting to be written to the socket. Filled by the
+    // analysis thread, drained by the sender thread.
+    Queue queue;
+
+    // Set by the sender thread once the connection is gone. Messages for
+    // closed clients are discarded.
+    std::atomic<bool> closed = { false };
+
+    // Set by the analysis thread to make the sender close the connection.
+    std::atomic<bool> disconnectRequested = { false };
+
+    std::atomic<u64> bytesSent = { 0 };
+    std::atomic<u64> messagesSent = { 0 };
+    std::atomic<u64> messagesDropped = { 0 };
+
+    // Last ClientHello received from the client. helloGeneration is
+    // incremented each time a new ClientHello has been stored.
+    std::atomic<u32> helloGeneration = { 0 };
+    mutable std::mutex helloMutex;
+    mvme::event_server::ClientHelloInfo hello;
+
+    mvme::event_server::ClientHelloInfo getHello() const
+    {
+        std::lock_guard<std::mutex> guard(helloMutex);
+        return hello;
+    }
+};
+
+/* Network side of the EventServer running in its own thread.
+ *
+ * Owns the listening QTcpServer and the client sockets. New connections are
+ * greeted with a ServerInfo message and are then handed to the analysis side
+ * via takeNewClients(). Messages queued by the analysis side are written to
+ * the sockets as fast as the clients accept them without blocking the
+ * analysis. */
+class EventServerSender: public QObject
+{
+    Q_OBJECT
+    signals:
+        void clientConnected();
+        void clientDisconnected();
+
+    public:
+        using Logger = std::function<void (const QString &)>;
+
+        EventServerSender();
+        ~EventServerSender() override;
+
+        // The methods below are thread-safe.
+        void setLogger(Logger logger);
+        void setQueueCapacity(size_t capacity);
+        size_t getQueueCapacity() const;
+
+        void setListeningInfo(const QHostAddress &address, quint16 port);
+        bool isListening() const;
+        size_t getNumberOfClients() const;
+
+        // True if takeNewClients() would return a non-empty list.
+        bool hasNewClients() const;
+        std::vector<std::shared_ptr<EventServerClient>> takeNewClients();
+
+        // True if a client connection was closed since the last call.
+        bool testAndClearClientsClosed();
+
+        std::vector<std::shared_ptr<EventServerClient>> getClients() const;
+
+        // Called by the producer after queueing messages. Schedules writing
+        // queued data to the sockets.
+        void notify();
+
+    public slots:
+        // Starts listening using the address and port set via
+        // setListeningInfo().
+        bool listen();
+        void close();
+
+    private slots:
+        void drainAll();
+
+    private:
+        struct Private;
+        std::unique_ptr<Private> d;
+};
+
+#endif /* __MVME_EVENT_SERVER_SENDER_H__ */
@@ -96,6 +96,22 @@ double DAQStats::getAnalysisEfficiency() const
     return efficiency;
 }
 
+double DAQStats::getListFileCompressionRatio() const
+{
+    if (listFileBytesCompressed == 0)
+        return 0.0;
+
+    return listFileBytesWritten / static_cast<double>(listFileBytesCompressed);
+}
+
+double DAQStats::CompressorThreadStats::getThroughput() const
+{
+    if (busySeconds <= 0.0)
+        return 0.0;
+
+    return bytesIn / busySeconds;
+}
+
 const char *to_string(const ListfileBufferFormat &fmt)
 {
     switch (fmt)
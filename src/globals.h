@@ -25,6 +25,7 @@
 #include <QMap>
 #include <QString>
 #include <QDateTime>
+#include <QVector>
 
 #include "util.h"
 #include "run_info.h"
@@ -99,6 +100,8 @@ struct DAQStats
         buffersFlushed = 0;
         listFileBytesWritten = 0;
         listFileTotalBytes = 0;
+        listFileBytesCompressed = 0;
+        listFileCompressorThreads.clear();
         startTime = QDateTime::currentDateTime();
         endTime = {};
     }
@@ -123,8 +126,25 @@ struct DAQStats
     u64 listFileTotalBytes = 0; // For replay mode: the size of the replay file
     QString listfileFilename; // For replay mode: the current replay filename
 
+    // Parallel listfile compression. listFileBytesCompressed is 0 if the
+    // listfile is compressed inline by the listfile writer.
+    struct CompressorThreadStats
+    {
+        u64 bytesIn = 0;            // uncompressed bytes handled by the thread
+        u64 bytesOut = 0;           // compressed bytes produced by the thread
+        double busySeconds = 0.0;   // time spent compressing
+
+        // Uncompressed bytes per second of busy time.
+        double getThroughput() const;
+    };
+
+    u64 listFileBytesCompressed = 0;
+    QVector<CompressorThreadStats> listFileCompressorThreads;
+
     u64 getAnalyzedBuffers() const { return totalBuffersRead - droppedBuffers; }
     double getAnalysisEfficiency() const;
+    // Uncompressed / compressed listfile size. 0 if not known.
+    double getListFileCompressionRatio() const;
 };
 
 enum class ListFileFormat
@@ -157,6 +177,10 @@ struct ListFileOutputInfo
 
     int compressionLevel = 1;   // zlib/lz4 compression level
 
+    unsigned compressionThreads = 0; // Number of threads compressing LZ4
+                                     // listfiles in parallel. 0 compresses
+                                     // inline on the listfile writer thread.
+
     QString prefix = QSL("mvmelst");
 
     u32 runNumber = 1;          // Incremented on endRun and if output filename already exists.
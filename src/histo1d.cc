@@ -24,6 +24,7 @@ Histo1D::Histo1D(u32 nBins, double xMin, double xMax, QObject *parent)
     : QObject(parent)
     , m_xAxisBinning(nBins, xMin, xMax)
     , m_data(new double[nBins])
+    , m_tiles(std::make_shared<a2::TileGenerations>(nBins))
 {
     clear();
 }
@@ -32,6 +33,8 @@ Histo1D::Histo1D(AxisBinning binning, const SharedHistoMem &mem, QObject *parent
     : QObject(parent)
     , m_xAxisBinning(binning)
     , m_data(mem.data)
+    , m_compact(mem.compact)
+    , m_tiles(mem.tiles)
     , m_externalMemory(mem)
 {
     clear();
@@ -68,6 +71,7 @@ void Histo1D::resize(u32 nBins)
         }
 
         m_xAxisBinning.setBins(nBins);
+        m_tiles = std::make_shared<a2::TileGenerations>(nBins);
     }
     clear();
 }
@@ -81,6 +85,9 @@ void Histo1D::setData(const SharedHistoMem &mem, AxisBinning newBinning)
 
     m_externalMemory = mem;
     m_data = mem.data;
+    m_compact = mem.compact;
+    m_tiles = mem.tiles;
+    m_pyramid.invalidate();
     setAxisBinning(Qt::XAxis, newBinning);
 }
 
@@ -117,9 +124,25 @@ s32 Histo1D::fill(double x, double weight)
             }
             */
 
-            m_data[bin] += weight;
+            double value = 0.0;
+
+            if (m_compact)
+            {
+                m_compact->add(bin, weight);
+                value = m_compact->get(bin);
+            }
+            else
+            {
+                m_data[bin] += weight;
+                value = m_data[bin];
+            }
+
+            if (m_tiles)
+                m_tiles->mark(bin);
+
+            m_pyramid.add(bin, weight);
+
             m_count += weight;
-            double value = m_data[bin];
             if (value >= m_maxValue)
             {
                 m_maxValue = value;
@@ -156,19 +179,52 @@ void Histo1D::clear()
     m_underflow = 0.0;
     m_overflow = 0.0;
 
+    if (ownsMemory())
+        m_pyramid.reset(getNumberOfBins());
+    else
+        m_pyramid.invalidate();
+
+    if (m_tiles)
+        m_tiles->markAll();
+
+    if (m_compact)
+    {
+        m_compact->clear();
+        return;
+    }
+
     for (u32 i=0; i<m_xAxisBinning.getBins(); ++i)
     {
         m_data[i] = 0.0;
     }
 }
 
+void Histo1D::updateResolutionPyramid()
+{
+    if (ownsMemory() && m_pyramid.isValid())
+        return;
+
+    if (m_compact)
+        m_pyramid.update(*m_compact, getNumberOfBins(), m_tiles.get());
+    else if (m_data)
+        m_pyramid.update(m_data, getNumberOfBins(), m_tiles.get());
+}
+
 bool Histo1D::setBinContent(u32 bin, double value)
 {
     bool result = false;
 
     if (bin < getNumberOfBins())
     {
-        m_data[bin] = value;
+        m_pyramid.add(bin, value - binValue(bin));
+
+        if (m_tiles)
+            m_tiles->mark(bin);
+
+        if (m_compact)
+            m_compact->set(bin, value);
+        else
+            m_data[bin] = value;
         result = true;
     }
 
@@ -183,8 +239,8 @@ void Histo1D::debugDump(bool dumpEmptyBins) const
 
     for (u32 bin = 0; bin < m_xAxisBinning.getBins(); ++bin)
     {
-        if (dumpEmptyBins || m_data[bin] > 0.0)
-            qDebug() << "  bin =" << bin << ", lowEdge=" << m_xAxisBinning.getBinLowEdge(bin) << ", value =" << m_data[bin];
+        if (dumpEmptyBins || binValue(bin) > 0.0)
+            qDebug() << "  bin =" << bin << ", lowEdge=" << m_xAxisBinning.getBinLowEdge(bin) << ", value =" << binValue(bin);
     }
 }
 
@@ -391,8 +447,15 @@ Histo1D::ValueAndBin Histo1D::getMaxValueAndBin(u32 rrf) const
 {
     ValueAndBin result = {};
     const u32 binCount = getNumberOfBins(rrf);
+    const s32 level = Histo1DPyramid::levelForRRF(rrf);
 
-    if (binCount > 0)
+    if (m_pyramid.hasLevel(level))
+    {
+        auto max = m_pyramid.getMax(level, binCount);
+        result.value = max.value;
+        result.bin   = max.bin;
+    }
+    else if (binCount > 0)
     {
         result.value = getBinContent(0, rrf);
 
@@ -24,7 +24,9 @@
 #include <memory>
 #include <QObject>
 
+#include "analysis/a2/a2_compact_bins.h"
 #include "analysis/a2/memory.h"
+#include "histo1d_pyramid.h"
 #include "histo_util.h"
 #include "libmvme_export.h"
 #include "util.h"
@@ -67,6 +69,14 @@ struct SharedHistoMem
     double *data = nullptr;
 
     s32 size = 0;
+
+    // Set instead of data if the histo uses compact u32 bin storage. The
+    // counters are located inside the arena.
+    std::shared_ptr<a2::CompactBins> compact;
+
+    // Optional tile modification counters updated by the analysis when
+    // filling the histogram.
+    std::shared_ptr<a2::TileGenerations> tiles;
 };
 
 class LIBMVME_EXPORT Histo1D: public QObject
@@ -116,14 +126,46 @@ class LIBMVME_EXPORT Histo1D: public QObject
         std::pair<double, double> getValueAndBinLowEdge(double x, u32 rrf = NoRR) const;
 
         void clear();
-        inline double *data() { return m_data; }
+
+        /* Rebuilds the resolution reduction pyramid from the bin storage.
+         *
+         * Histograms using internal memory keep the pyramid up to date on
+         * each modification and this is a no-op. With external memory the
+         * bins are modified directly by the analysis. The pyramid is a
+         * snapshot of the bin contents taken by this method and is used by
+         * the resolution reduced getBinContent(), getMaxValueAndBin() and
+         * calcStatistics() until the next call. Without a snapshot these
+         * methods sum up the physical bins.
+         *
+         * If the memory has tile modification counters only the tiles
+         * modified since the last call are summed up again.
+         *
+         * Call this once before replotting and calculating statistics.
+         * The pyramid is only used for power-of-two resolution reduction
+         * factors. */
+        void updateResolutionPyramid();
+
+        /* Returns the double bin storage. For compact storage this is null
+         * unless the storage has been promoted. */
+        inline double *data() { return m_compact ? m_compact->promoted() : m_data; }
+
+        /* Compact u32 bin storage or nullptr if doubles are used. */
+        a2::CompactBins *getCompactBins() const { return m_compact.get(); }
+        bool usesCompactStorage() const { return m_compact != nullptr; }
+
+        /* Tile modification counters of the bin storage or nullptr if the
+         * external memory does not provide them. */
+        a2::TileGenerations *getTileGenerations() const { return m_tiles.get(); }
 
         inline u32 getNumberOfBins(u32 rrf = NoRR) const
         {
             return m_xAxisBinning.getBins(rrf);
         }
 
-        inline size_t getStorageSize() const { return getNumberOfBins() * sizeof(double); }
+        inline size_t getStorageSize() const
+        {
+            return m_compact ? m_compact->storageSize() : getNumberOfBins() * sizeof(double);
+        }
 
         /* If rrf is in effect the given inputBin is interpreted in terms of the reduced
          * total bin count. Otherwise it represents the physical bin number. */
@@ -134,7 +176,7 @@ class LIBMVME_EXPORT Histo1D: public QObject
             if (rrf == NoRR)
             {
                 // no resolution reduction -> direct indexing
-                return (inputBin < physBins) ? m_data[inputBin] : 0.0;
+                return (inputBin < physBins) ? binValue(inputBin) : 0.0;
             }
 
             // Go from reduced bins to physical bins
@@ -155,8 +197,22 @@ class LIBMVME_EXPORT Histo1D: public QObject
 
             if (beginBin < physBins && endBin <= physBins)
             {
+                // Use the pre-reduced sums if available for this rrf.
+                const s32 level = Histo1DPyramid::levelForRRF(rrf);
+
+                if (m_pyramid.hasLevel(level))
+                    return m_pyramid.getSum(level, inputBin);
+
                 // consecutive summation of the bins in [beginBin, endBin)
-                return std::accumulate(m_data + beginBin, m_data + endBin, 0.0);
+                if (!m_compact)
+                    return std::accumulate(m_data + beginBin, m_data + endBin, 0.0);
+
+                double result = 0.0;
+
+                for (u32 bin = beginBin; bin < endBin; bin++)
+                    result += m_compact->get(bin);
+
+                return result;
             }
 
             // out of range
@@ -277,10 +333,17 @@ class LIBMVME_EXPORT Histo1D: public QObject
         }
 
     private:
+        inline double binValue(u32 bin) const
+        {
+            return m_compact ? m_compact->get(bin) : m_data[bin];
+        }
+
         AxisBinning m_xAxisBinning;
         AxisInfo m_xAxisInfo;
 
         double *m_data = nullptr;
+        std::shared_ptr<a2::CompactBins> m_compact;
+        std::shared_ptr<a2::TileGenerations> m_tiles;
         SharedHistoMem m_externalMemory;
 
         double m_underflow = 0.0;
@@ -292,6 +355,10 @@ class LIBMVME_EXPORT Histo1D: public QObject
 
         QString m_title;
         QString m_footer;
+
+        // Pre-reduced bin sums for resolution reduction. See
+        // updateResolutionPyramid().
+        Histo1DPyramid m_pyramid;
 };
 
 typedef std::shared_ptr<Histo1D> Histo1DPtr;
@@ -0,0 +1,273 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "histo1d_pyramid.h"
+
+#include <algorithm>
+
+s32 Histo1DPyramid::levelForRRF(u32 rrf)
+{
+    if (rrf == 0 || (rrf & (rrf - 1)) != 0)
+        return -1;
+
+    s32 level = 0;
+
+    while (rrf >>= 1)
+        ++level;
+
+    return level;
+}
+
+Histo1DPyramid::ValueAndBin Histo1DPyramid::getMax(s32 level, u32 binCount) const
+{
+    const auto &lvl = m_levels[level - 1];
+
+    if (!lvl.maxValid || lvl.maxBinCount != binCount)
+    {
+        ValueAndBin result = {};
+
+        if (binCount > 0)
+        {
+            result.value = getSum(level, 0);
+
+            for (u32 bin = 1; bin < binCount; bin++)
+            {
+                double v = getSum(level, bin);
+
+                if (v >= result.value)
+                {
+                    result.value = v;
+                    result.bin   = bin;
+                }
+            }
+        }
+
+        lvl.max = result;
+        lvl.maxBinCount = binCount;
+        lvl.maxValid = true;
+    }
+
+    return lvl.max;
+}
+
+void Histo1DPyramid::resizeLevels(u32 binCount)
+{
+    m_binCount = binCount;
+    m_levels.clear();
+
+    for (u32 size = binCount; size > 1;)
+    {
+        size = (size + 1) / 2;
+        Level level = {};
+        level.sums.resize(size);
+        m_levels.emplace_back(std::move(level));
+    }
+}
+
+void Histo1DPyramid::reset(u32 binCount)
+{
+    if (binCount != m_binCount || m_levels.empty())
+    {
+        resizeLevels(binCount);
+    }
+    else
+    {
+        for (auto &level: m_levels)
+        {
+            std::fill(level.sums.begin(), level.sums.end(), 0.0);
+            level.maxValid = false;
+        }
+    }
+
+    m_seenGenerations.clear();
+    m_valid = true;
+}
+
+template<typename GetBin>
+void Histo1DPyramid::sumRange(GetBin getBin, u32 begin, u32 end, s32 levelCount)
+{
+    // Level 1 from the physical bins, the following levels from the
+    // previous one.
+    for (s32 li = 0; li < levelCount; li++)
+    {
+        auto &sums = m_levels[li].sums;
+        const u32 first = begin >> (li + 1);
+        const u32 last = (end - 1) >> (li + 1);
+
+        if (li == 0)
+        {
+            for (u32 i = first; i <= last; i++)
+            {
+                const u32 bin = 2 * i;
+                sums[i] = getBin(bin) + (bin + 1 < m_binCount ? getBin(bin + 1) : 0.0);
+            }
+        }
+        else
+        {
+            const auto &prev = m_levels[li - 1].sums;
+
+            for (u32 i = first; i <= last; i++)
+            {
+                const u32 bin = 2 * i;
+                sums[i] = prev[bin] + (bin + 1 < prev.size() ? prev[bin + 1] : 0.0);
+            }
+        }
+
+        m_levels[li].maxValid = false;
+    }
+}
+
+template<typename GetBin>
+void Histo1DPyramid::rebuild_(GetBin getBin, u32 binCount)
+{
+    if (binCount != m_binCount || m_levels.empty())
+        resizeLevels(binCount);
+
+    if (binCount > 0)
+        sumRange(getBin, 0, binCount, getLevelCount());
+
+    m_valid = true;
+}
+
+template<typename GetBin>
+void Histo1DPyramid::update_(GetBin getBin, u32 binCount, const a2::TileGenerations *tiles)
+{
+    if (!tiles || tiles->binCount() != static_cast<s32>(binCount) || tiles->tileShift() == 0)
+    {
+        m_seenGenerations.clear();
+        rebuild_(getBin, binCount);
+        return;
+    }
+
+    // The counters are loaded before the bins: a tile modified while
+    // summing it up is summed again on the next update.
+    const u32 *generations = tiles->data();
+    const size_t tileCount = tiles->tileCount();
+
+    if (!m_valid || binCount != m_binCount
+        || m_seenGenerations.size() != tileCount)
+    {
+        m_seenGenerations.assign(generations, generations + tileCount);
+        rebuild_(getBin, binCount);
+        return;
+    }
+
+    // Levels up to the tile size are summed up from the bins of modified
+    // tiles. The sums of the higher levels are adjusted by the difference of
+    // the tile sums.
+    const s32 tileShift = tiles->tileShift();
+    const s32 tileLevels = std::min(tileShift, getLevelCount());
+
+    for (size_t tile = 0; tile < tileCount; tile++)
+    {
+        const u32 generation = generations[tile];
+
+        if (generation == m_seenGenerations[tile])
+            continue;
+
+        m_seenGenerations[tile] = generation;
+
+        const u32 begin = tile << tileShift;
+        const u32 end = std::min(begin + (1u << tileShift), binCount);
+        const bool propagate = tileLevels < getLevelCount();
+        double oldTileSum = propagate ? m_levels[tileShift - 1].sums[tile] : 0.0;
+
+        sumRange(getBin, begin, end, tileLevels);
+
+        if (!propagate)
+            continue;
+
+        const double delta = m_levels[tileShift - 1].sums[tile] - oldTileSum;
+
+        if (delta == 0.0)
+            continue;
+
+        for (s32 li = tileShift; li < getLevelCount(); li++)
+        {
+            m_levels[li].sums[tile >> (li + 1 - tileShift)] += delta;
+            m_levels[li].maxValid = false;
+        }
+    }
+}
+
+void Histo1DPyramid::rebuild(const double *bins, u32 binCount)
+{
+    m_seenGenerations.clear();
+    rebuild_([bins] (u32 bin) { return bins[bin]; }, binCount);
+}
+
+void Histo1DPyramid::rebuild(const a2::CompactBins &bins, u32 binCount)
+{
+    if (auto promoted = bins.promoted())
+        return rebuild(promoted, binCount);
+
+    const u32 *data32 = bins.data32();
+    m_seenGenerations.clear();
+    rebuild_([data32] (u32 bin) { return static_cast<double>(data32[bin]); }, binCount);
+}
+
+void Histo1DPyramid::update(const double *bins, u32 binCount, const a2::TileGenerations *tiles)
+{
+    update_([bins] (u32 bin) { return bins[bin]; }, binCount, tiles);
+}
+
+void Histo1DPyramid::update(const a2::CompactBins &bins, u32 binCount, const a2::TileGenerations *tiles)
+{
+    if (auto promoted = bins.promoted())
+        return update(promoted, binCount, tiles);
+
+    const u32 *data32 = bins.data32();
+    update_([data32] (u32 bin) { return static_cast<double>(data32[bin]); }, binCount, tiles);
+}
+
+void Histo1DPyramid::invalidate()
+{
+    m_seenGenerations.clear();
+    m_valid = false;
+}
+
+void Histo1DPyramid::add(u32 bin, double delta)
+{
+    if (!m_valid || bin >= m_binCount)
+        return;
+
+    for (size_t li = 0; li < m_levels.size(); li++)
+    {
+        auto &level = m_levels[li];
+        const u32 levelBin = bin >> (li + 1);
+        double &sum = level.sums[levelBin];
+
+        sum += delta;
+
+        if (!level.maxValid || levelBin >= level.maxBinCount)
+            continue;
+
+        if (delta >= 0.0)
+        {
+            // Increasing a sum can only make it the new maximum.
+            if (sum > level.max.value || (sum == level.max.value && levelBin > level.max.bin))
+                level.max = { sum, levelBin };
+        }
+        else if (levelBin == level.max.bin)
+        {
+            level.maxValid = false;
+        }
+    }
+}
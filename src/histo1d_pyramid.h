@@ -0,0 +1,132 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef __MVME_HISTO1D_PYRAMID_H__
+#define __MVME_HISTO1D_PYRAMID_H__
+
+#include <vector>
+
+#include "analysis/a2/a2_compact_bins.h"
+#include "libmvme_export.h"
+#include "typedefs.h"
+
+/* Pre-reduced bin sums of a 1D histogram at power-of-two resolutions.
+ *
+ * Level k contains the sums of consecutive blocks of 2^k physical bins, i.e.
+ * the bin contents at a resolution reduction factor of 2^k. Level 0 are the
+ * physical bins themselves and is not stored. The last block of a level may
+ * be partial if the bin count is not a multiple of the block size.
+ *
+ * Additionally the maximum bin value and the corresponding bin are cached
+ * for each level. The maxima are kept up to date by add() as long as values
+ * only increase and are recalculated on the next query otherwise.
+ *
+ * The pyramid can be built from the bin storage in one pass using rebuild()
+ * or be maintained incrementally by passing each modification to add().
+ * update() uses the tile modification counters of the storage to only sum up
+ * the tiles that changed since the last update.
+ */
+class LIBMVME_EXPORT Histo1DPyramid
+{
+    public:
+        struct ValueAndBin
+        {
+            double value;
+            u32 bin;
+        };
+
+        /* Returns the level corresponding to the resolution reduction factor
+         * or -1 if rrf is not a power of two. */
+        static s32 levelForRRF(u32 rrf);
+
+        bool isValid() const { return m_valid; }
+        u32 getBinCount() const { return m_binCount; }
+        s32 getLevelCount() const { return static_cast<s32>(m_levels.size()); }
+
+        /* True if sums for the given level are available. Level 0 is never
+         * available as it is the physical bin storage. */
+        bool hasLevel(s32 level) const
+        {
+            return m_valid && level > 0 && level <= getLevelCount();
+        }
+
+        /* Sum of the physical bins [bin * 2^level, (bin + 1) * 2^level).
+         * Returns 0 for out of range bins. Requires hasLevel(level). */
+        inline double getSum(s32 level, u32 bin) const
+        {
+            const auto &sums = m_levels[level - 1].sums;
+            return bin < sums.size() ? sums[bin] : 0.0;
+        }
+
+        /* Maximum of the first binCount bins of the level. If multiple bins
+         * contain the maximum value the highest bin number is returned.
+         * Requires hasLevel(level). */
+        ValueAndBin getMax(s32 level, u32 binCount) const;
+
+        /* Zero initialized pyramid for binCount physical bins. */
+        void reset(u32 binCount);
+
+        /* Rebuilds all levels from the given physical bin storage. */
+        void rebuild(const double *bins, u32 binCount);
+        void rebuild(const a2::CompactBins &bins, u32 binCount);
+
+        /* Like rebuild() but only the tiles whose modification counter
+         * changed since the last update are summed up again. Does a full
+         * rebuild if tiles is null or the pyramid is not valid. */
+        void update(const double *bins, u32 binCount, const a2::TileGenerations *tiles);
+        void update(const a2::CompactBins &bins, u32 binCount, const a2::TileGenerations *tiles);
+
+        void invalidate();
+
+        /* Adds delta to the physical bin and all blocks containing it. */
+        void add(u32 bin, double delta);
+
+    private:
+        struct Level
+        {
+            std::vector<double> sums;
+
+            // Cached maximum of the first maxBinCount sums.
+            mutable ValueAndBin max;
+            mutable u32 maxBinCount;
+            mutable bool maxValid;
+        };
+
+        template<typename GetBin>
+        void rebuild_(GetBin getBin, u32 binCount);
+
+        template<typename GetBin>
+        void update_(GetBin getBin, u32 binCount, const a2::TileGenerations *tiles);
+
+        // Sums the level 1..levelCount blocks covering the physical bins
+        // [begin, end).
+        template<typename GetBin>
+        void sumRange(GetBin getBin, u32 begin, u32 end, s32 levelCount);
+
+        void resizeLevels(u32 binCount);
+
+        std::vector<Level> m_levels;
+        // Tile counters seen by the last update().
+        std::vector<u32> m_seenGenerations;
+        u32 m_binCount = 0;
+        bool m_valid = false;
+};
+
+#endif /* __MVME_HISTO1D_PYRAMID_H__ */
@@ -969,6 +969,11 @@ void Histo1DWidget::replot()
     // ResolutionReduction
     const u32 rrf = m_d->m_rrf;
 
+    // Snapshot the pre-reduced bin sums once per replot. Rendering, the
+    // stats box and the cursor info then need a single lookup per displayed
+    // bin instead of summing up the physical bins.
+    m_d->getCurrentHisto()->updateResolutionPyramid();
+
     m_d->updateStatistics(rrf);
     m_d->updateAxisScales();
     m_d->updateCursorInfoLabel(rrf);
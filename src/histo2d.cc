@@ -27,6 +27,7 @@ Histo2D::Histo2D(u32 xBins, double xMin, double xMax,
                  QObject *parent)
     : QObject(parent)
     , m_data(new double[xBins * yBins])
+    , m_tiles(std::make_shared<a2::TileGenerations>(xBins * yBins))
 {
     m_axisBinnings[Qt::XAxis] = AxisBinning(xBins, xMin, xMax);
     m_axisBinnings[Qt::YAxis] = AxisBinning(yBins, yMin, yMax);
@@ -45,7 +46,12 @@ void Histo2D::resize(s32 xBins, s32 yBins)
     u32 xBinsNew = static_cast<u32>(xBins);
     u32 yBinsNew = static_cast<u32>(yBins);
 
-    if (xBinsNew * yBinsNew != m_axisBinnings[Qt::XAxis].getBins() * m_axisBinnings[Qt::YAxis].getBins())
+    if (m_compact)
+    {
+        if (xBinsNew * yBinsNew != static_cast<u32>(m_compact->size()))
+            m_compact = std::make_shared<a2::CompactBins>(xBinsNew * yBinsNew);
+    }
+    else if (xBinsNew * yBinsNew != m_axisBinnings[Qt::XAxis].getBins() * m_axisBinnings[Qt::YAxis].getBins())
     {
         // Reallocate memory for the new size
         delete[] m_data;
@@ -60,6 +66,9 @@ void Histo2D::resize(s32 xBins, s32 yBins)
         }
     }
 
+    if (xBinsNew * yBinsNew != static_cast<u32>(m_tiles->binCount()))
+        m_tiles = std::make_shared<a2::TileGenerations>(xBinsNew * yBinsNew);
+
     // Always update the number of bins on both axes, even if the total number
     // stayed the same, because 10bit:10bit might become 9bit:11bit.
     m_axisBinnings[Qt::XAxis].setBins(xBinsNew);
@@ -84,8 +93,35 @@ void Histo2D::fill(double x, double y, double weight)
     {
         u32 linearBin = yBin * m_axisBinnings[Qt::XAxis].getBins() + xBin;
 
-        m_data[linearBin] += weight;
+        if (m_compact)
+            m_compact->add(linearBin, weight);
+        else
+            m_data[linearBin] += weight;
+
+        m_tiles->mark(linearBin);
+    }
+}
+
+void Histo2D::setCompactStorage(bool compact)
+{
+    if (compact == usesCompactStorage())
+        return;
+
+    const u32 binCount = m_axisBinnings[Qt::XAxis].getBins() * m_axisBinnings[Qt::YAxis].getBins();
+
+    if (compact)
+    {
+        m_compact = std::make_shared<a2::CompactBins>(binCount);
+        delete[] m_data;
+        m_data = nullptr;
+    }
+    else
+    {
+        m_data = new double[binCount];
+        m_compact.reset();
     }
+
+    clear();
 }
 
 double Histo2D::getValue(double x, double y,
@@ -130,7 +166,8 @@ double Histo2D::getBinContent(u32 xInputBin, u32 yInputBin,
     {
         for (s64 ix = ix1; ix < ix2; ix++)
         {
-            result += m_data[iy * xBinCount + ix];
+            const u32 linearBin = iy * xBinCount + ix;
+            result += m_compact ? m_compact->get(linearBin) : m_data[linearBin];
             nBins++;
         }
     }
@@ -153,9 +190,17 @@ double Histo2D::getBinContent(u32 xInputBin, u32 yInputBin,
 
 void Histo2D::clear()
 {
-    size_t binCount = m_axisBinnings[Qt::XAxis].getBins() * m_axisBinnings[Qt::YAxis].getBins();
-    std::fill(m_data, m_data + binCount, 0.0);
+    if (m_compact)
+    {
+        m_compact->clear();
+    }
+    else
+    {
+        size_t binCount = m_axisBinnings[Qt::XAxis].getBins() * m_axisBinnings[Qt::YAxis].getBins();
+        std::fill(m_data, m_data + binCount, 0.0);
+    }
 
+    m_tiles->markAll();
     m_underflow = 0.0;
     m_overflow = 0.0;
 }
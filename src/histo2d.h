@@ -21,6 +21,7 @@
 #ifndef __HISTO2D_H__
 #define __HISTO2D_H__
 
+#include "analysis/a2/a2_compact_bins.h"
 #include "histo_util.h"
 
 #include <QObject>
@@ -108,11 +109,27 @@ class LIBMVME_EXPORT Histo2D: public QObject
                              const ResolutionReductionFactors &rrf = {}) const;
 
         void clear();
-        inline double *data() { return m_data; }
+
+        /* Returns the double bin storage. For compact storage this is null
+         * unless the storage has been promoted. */
+        inline double *data() { return m_compact ? m_compact->promoted() : m_data; }
+
+        /* Switches between double and compact u32 bin storage. Reallocates
+         * and clears the histogram if the mode changes. */
+        void setCompactStorage(bool compact);
+        bool usesCompactStorage() const { return m_compact != nullptr; }
+        a2::CompactBins *getCompactBins() const { return m_compact.get(); }
+
+        /* Tile modification counters of the bin storage. Tiles are runs of
+         * consecutive bins of the linear storage, i.e. parts of rows. */
+        a2::TileGenerations *getTileGenerations() const { return m_tiles.get(); }
 
         void debugDump() const;
         inline size_t getStorageSize() const
         {
+            if (m_compact)
+                return m_compact->storageSize();
+
             return getAxisBinning(Qt::XAxis).getBins()
                 * getAxisBinning(Qt::YAxis).getBins()
                 * sizeof(double);
@@ -214,6 +231,8 @@ class LIBMVME_EXPORT Histo2D: public QObject
         AxisInfos m_axisInfos;
 
         double *m_data = nullptr;
+        std::shared_ptr<a2::CompactBins> m_compact;
+        std::shared_ptr<a2::TileGenerations> m_tiles;
 
         double m_underflow = 0.0;
         double m_overflow = 0.0;
@@ -0,0 +1,407 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "histo2d_tiled_spectrogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <tuple>
+#include <vector>
+#include <QtConcurrent>
+#include <qwt_color_map.h>
+#include <qwt_raster_data.h>
+#include <qwt_scale_map.h>
+
+#include "util.h"
+
+namespace
+{
+
+struct TileKey
+{
+    u32 rrfX, rrfY;
+    u32 levelX, levelY;
+    u32 tileX, tileY;
+
+    bool operator<(const TileKey &o) const
+    {
+        return (std::tie(rrfX, rrfY, levelX, levelY, tileX, tileY)
+                < std::tie(o.rrfX, o.rrfY, o.levelX, o.levelY, o.tileX, o.tileY));
+    }
+};
+
+struct Tile
+{
+    TileKey key;
+
+    // Maximum bin value of each cell. Floats are plenty for color mapping
+    // and halve the cache size.
+    std::vector<float> cells;
+
+    u64 generation = 0;
+    bool valid = false;
+    bool recomputed = false;
+    u64 lastUsed = 0;
+};
+
+// Geometry of the cell grid used for one render.
+struct CellGrid
+{
+    ResolutionReductionFactors rrf;
+    u32 physBins[2];
+    u32 reducedBins[2];
+    u32 levels[2];
+    u32 cells[2];
+};
+
+// Smallest level for which a cell covers at least binsPerPixel bins.
+u32 level_for(double binsPerPixel)
+{
+    if (!(binsPerPixel > 1.0))
+        return 0u;
+
+    return std::min(30u, static_cast<u32>(std::ceil(std::log2(binsPerPixel))));
+}
+
+// Maps each pixel to the cell containing its sample coordinate or -1 if the
+// coordinate is outside the histogram.
+std::vector<s32> make_pixel_cells(const QwtScaleMap &map, int pixels,
+                                  const AxisBinning &binning, u32 rrf, u32 level)
+{
+    std::vector<s32> result(pixels);
+
+    for (int p = 0; p < pixels; p++)
+    {
+        s64 bin = binning.getBin(map.invTransform(p), rrf);
+        result[p] = bin >= 0 ? static_cast<s32>(bin >> level) : -1;
+    }
+
+    return result;
+}
+
+std::pair<s32, s32> valid_range(const std::vector<s32> &cells)
+{
+    s32 first = -1, last = -1;
+
+    for (s32 c: cells)
+    {
+        if (c < 0)
+            continue;
+
+        if (first < 0 || c < first)
+            first = c;
+
+        last = std::max(last, c);
+    }
+
+    return { first, last };
+}
+
+} // end anon namespace
+
+const u32 TiledSpectrogram::TileSize;
+const size_t TiledSpectrogram::MaxUnusedTiles;
+
+struct TiledSpectrogram::Private
+{
+    std::unique_ptr<SpectrogramTileSource> source;
+    ResolutionReductionFactors rrf;
+    std::map<TileKey, std::unique_ptr<Tile>> tiles;
+    AxisBinning cachedBinnings[2];
+    u64 renderCount = 0;
+    Counters counters = {};
+
+    void computeTile(Tile &tile, const CellGrid &grid) const;
+    void evictTiles(u64 renderStamp);
+};
+
+void TiledSpectrogram::Private::computeTile(Tile &tile, const CellGrid &grid) const
+{
+    const auto &key = tile.key;
+    const u32 factorX = grid.rrf.getXFactor();
+    const u32 factorY = grid.rrf.getYFactor();
+
+    // Cell, reduced bin and physical bin ranges covered by the tile.
+    const u32 cx0 = key.tileX * TileSize;
+    const u32 cy0 = key.tileY * TileSize;
+    const u32 cx1 = std::min(cx0 + TileSize, grid.cells[Qt::XAxis]);
+    const u32 cy1 = std::min(cy0 + TileSize, grid.cells[Qt::YAxis]);
+
+    const u32 bx0 = cx0 << grid.levels[Qt::XAxis];
+    const u32 by0 = cy0 << grid.levels[Qt::YAxis];
+    const u32 bx1 = std::min(cx1 << grid.levels[Qt::XAxis], grid.reducedBins[Qt::XAxis]);
+    const u32 by1 = std::min(cy1 << grid.levels[Qt::YAxis], grid.reducedBins[Qt::YAxis]);
+
+    const u32 px0 = bx0 * factorX;
+    const u32 py0 = by0 * factorY;
+    const u32 px1 = std::min(bx1 * factorX, grid.physBins[Qt::XAxis]);
+    const u32 py1 = std::min(by1 * factorY, grid.physBins[Qt::YAxis]);
+
+    // The generation is determined before reading the bins. Modifications
+    // done while computing the tile lead to another recompute next time.
+    u64 generation = 0;
+    bool hasGeneration = source->getGeneration(px0, px1, py0, py1, generation);
+
+    tile.recomputed = !(tile.valid && hasGeneration && generation == tile.generation);
+
+    if (!tile.recomputed)
+        return;
+
+    tile.cells.assign(TileSize * TileSize, 0.0f);
+
+    for (u32 by = by0; by < by1; by++)
+    {
+        float *cellRow = tile.cells.data() + ((by >> grid.levels[Qt::YAxis]) - cy0) * TileSize;
+
+        for (u32 bx = bx0; bx < bx1; bx++)
+        {
+            float &cell = cellRow[(bx >> grid.levels[Qt::XAxis]) - cx0];
+            float v = source->getBinContent(bx, by, grid.rrf);
+            cell = std::max(cell, v);
+        }
+    }
+
+    tile.generation = generation;
+    tile.valid = true;
+}
+
+void TiledSpectrogram::Private::evictTiles(u64 renderStamp)
+{
+    std::vector<std::pair<u64, TileKey>> unused;
+
+    for (const auto &kv: tiles)
+    {
+        if (kv.second->lastUsed != renderStamp)
+            unused.emplace_back(kv.second->lastUsed, kv.first);
+    }
+
+    if (unused.size() <= MaxUnusedTiles)
+        return;
+
+    std::sort(unused.begin(), unused.end(),
+              [] (const auto &a, const auto &b) { return a.first < b.first; });
+
+    for (size_t i = 0; i < unused.size() - MaxUnusedTiles; i++)
+        tiles.erase(unused[i].second);
+}
+
+TiledSpectrogram::TiledSpectrogram(const QString &title)
+    : QwtPlotSpectrogram(title)
+    , d(std::make_unique<Private>())
+{
+}
+
+TiledSpectrogram::~TiledSpectrogram()
+{
+}
+
+void TiledSpectrogram::setTileSource(std::unique_ptr<SpectrogramTileSource> source)
+{
+    d->source = std::move(source);
+    clearTileCache();
+}
+
+SpectrogramTileSource *TiledSpectrogram::getTileSource() const
+{
+    return d->source.get();
+}
+
+void TiledSpectrogram::setResolutionReductionFactors(const ResolutionReductionFactors &rrf)
+{
+    d->rrf = rrf;
+}
+
+void TiledSpectrogram::clearTileCache()
+{
+    d->tiles.clear();
+    d->counters = {};
+}
+
+TiledSpectrogram::Counters TiledSpectrogram::getCounters() const
+{
+    return d->counters;
+}
+
+QImage TiledSpectrogram::renderImage(
+    const QwtScaleMap &xMap, const QwtScaleMap &yMap,
+    const QRectF &area, const QSize &imageSize) const
+{
+    const auto source = d->source.get();
+    const auto colorMap = this->colorMap();
+
+    if (!source || !colorMap || colorMap->format() != QwtColorMap::RGB)
+        return QwtPlotSpectrogram::renderImage(xMap, yMap, area, imageSize);
+
+    if (imageSize.isEmpty() || !data())
+        return QImage();
+
+    const QwtInterval range = data()->interval(Qt::ZAxis);
+
+    if (!range.isValid())
+        return QImage();
+
+    const AxisBinning binnings[2] =
+    {
+        source->getAxisBinning(Qt::XAxis),
+        source->getAxisBinning(Qt::YAxis)
+    };
+
+    if (d->cachedBinnings[0] != binnings[0] || d->cachedBinnings[1] != binnings[1])
+    {
+        d->tiles.clear();
+        d->cachedBinnings[0] = binnings[0];
+        d->cachedBinnings[1] = binnings[1];
+    }
+
+    const u32 rrfs[2] = { d->rrf.x, d->rrf.y };
+    const double pixelSizes[2] =
+    {
+        area.width() / imageSize.width(),
+        area.height() / imageSize.height()
+    };
+
+    CellGrid grid = {};
+    grid.rrf = d->rrf;
+
+    for (int axis = 0; axis < 2; axis++)
+    {
+        grid.physBins[axis] = binnings[axis].getBins();
+        grid.reducedBins[axis] = binnings[axis].getBins(rrfs[axis]);
+
+        if (grid.reducedBins[axis] == 0)
+            return QImage();
+
+        double binsPerPixel = pixelSizes[axis] / binnings[axis].getBinWidth(rrfs[axis]);
+        grid.levels[axis] = level_for(std::abs(binsPerPixel));
+        grid.cells[axis] = ((grid.reducedBins[axis] - 1) >> grid.levels[axis]) + 1;
+    }
+
+    auto rasterData = const_cast<QwtRasterData *>(data());
+    rasterData->initRaster(area, imageSize);
+
+    const auto colCells = make_pixel_cells(xMap, imageSize.width(), binnings[Qt::XAxis],
+                                           rrfs[Qt::XAxis], grid.levels[Qt::XAxis]);
+    const auto rowCells = make_pixel_cells(yMap, imageSize.height(), binnings[Qt::YAxis],
+                                           rrfs[Qt::YAxis], grid.levels[Qt::YAxis]);
+
+    const auto colRange = valid_range(colCells);
+    const auto rowRange = valid_range(rowCells);
+
+    const QRgb noValueColor = colorMap->rgb(range, make_quiet_nan());
+
+    QImage image(imageSize, QImage::Format_ARGB32);
+    image.fill(noValueColor);
+
+    if (colRange.first < 0 || rowRange.first < 0)
+    {
+        rasterData->discardRaster();
+        return image;
+    }
+
+    // Get or create the tiles covering the visible cells.
+    const u32 tx0 = colRange.first / TileSize;
+    const u32 tx1 = colRange.second / TileSize + 1;
+    const u32 ty0 = rowRange.first / TileSize;
+    const u32 ty1 = rowRange.second / TileSize + 1;
+    const u32 tilesX = tx1 - tx0;
+    const u64 renderStamp = ++d->renderCount;
+
+    QVector<Tile *> visibleTiles;
+    visibleTiles.reserve(tilesX * (ty1 - ty0));
+
+    for (u32 ty = ty0; ty < ty1; ty++)
+    {
+        for (u32 tx = tx0; tx < tx1; tx++)
+        {
+            TileKey key = { grid.rrf.x, grid.rrf.y, grid.levels[0], grid.levels[1], tx, ty };
+            auto &tile = d->tiles[key];
+
+            if (!tile)
+            {
+                tile = std::make_unique<Tile>();
+                tile->key = key;
+            }
+
+            tile->lastUsed = renderStamp;
+            visibleTiles.push_back(tile.get());
+        }
+    }
+
+    const Private *cd = d.get();
+    const CellGrid &cgrid = grid;
+
+    QtConcurrent::blockingMap(visibleTiles, [cd, &cgrid] (Tile *tile) {
+        cd->computeTile(*tile, cgrid);
+    });
+
+    // Compose the image line by line.
+    QVector<int> rows;
+    rows.reserve(imageSize.height());
+
+    for (int y = 0; y < imageSize.height(); y++)
+    {
+        if (rowCells[y] >= 0)
+            rows.push_back(y);
+    }
+
+    // Non-const QImage accessors may detach and are not called from the
+    // worker threads.
+    uchar *imageBits = image.bits();
+    const int bytesPerLine = image.bytesPerLine();
+
+    QtConcurrent::blockingMap(rows, [&] (int y) {
+        const s32 cy = rowCells[y];
+        const u32 tileRow = (cy / TileSize - ty0) * tilesX;
+        const u32 cellRow = (cy % TileSize) * TileSize;
+        auto line = reinterpret_cast<QRgb *>(imageBits + y * bytesPerLine);
+
+        for (int x = 0; x < imageSize.width(); x++)
+        {
+            const s32 cx = colCells[x];
+
+            if (cx < 0)
+                continue;
+
+            const Tile *tile = visibleTiles[tileRow + cx / TileSize - tx0];
+            const float v = tile->cells[cellRow + cx % TileSize];
+
+            if (v > 0.0f)
+                line[x] = colorMap->rgb(range, v);
+        }
+    });
+
+    rasterData->discardRaster();
+
+    d->counters = {};
+
+    for (auto tile: visibleTiles)
+    {
+        if (tile->recomputed)
+            ++d->counters.tilesComputed;
+        else
+            ++d->counters.tilesReused;
+    }
+
+    d->evictTiles(renderStamp);
+    d->counters.tilesCached = d->tiles.size();
+
+    return image;
+}
@@ -0,0 +1,102 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef __MVME_HISTO2D_TILED_SPECTROGRAM_H__
+#define __MVME_HISTO2D_TILED_SPECTROGRAM_H__
+
+#include <memory>
+#include <qwt_plot_spectrogram.h>
+
+#include "histo2d.h"
+#include "libmvme_export.h"
+
+/* Data source for the TiledSpectrogram. Bins are addressed in terms of the
+ * physical bins of the x and y axes. */
+class LIBMVME_EXPORT SpectrogramTileSource
+{
+    public:
+        virtual ~SpectrogramTileSource() {}
+
+        virtual AxisBinning getAxisBinning(Qt::Axis axis) const = 0;
+
+        /* Content of the resolution reduced bin (xBin, yBin). Called from the
+         * renderer threads. */
+        virtual double getBinContent(u32 xBin, u32 yBin,
+                                     const ResolutionReductionFactors &rrf) const = 0;
+
+        /* Stores the sum of the tile modification counters of the physical
+         * bins [x0, x1) x [y0, y1) in dest. Returns false if the source does
+         * not track modifications. Called from the renderer threads. */
+        virtual bool getGeneration(u32 x0, u32 x1, u32 y0, u32 y1, u64 &dest) const = 0;
+};
+
+/* QwtPlotSpectrogram rendering the image from cached tiles.
+ *
+ * The resolution reduced bins are combined into cells of 2^levelX *
+ * 2^levelY bins where the levels are chosen so that a cell covers at least
+ * one pixel of the image. The value of a cell is the maximum of its bins.
+ * This way narrow peaks stay visible when zoomed out.
+ *
+ * Cells are computed in tiles of TileSize * TileSize cells which are cached
+ * per resolution reduction and level. A cached tile is only recomputed if the
+ * tile modification counters of the bins it covers changed. Tiles are
+ * computed and the image is composed using the global QThreadPool.
+ *
+ * Without a tile source or with an indexed color map the QwtPlotSpectrogram
+ * implementation sampling QwtRasterData::value() is used. */
+class LIBMVME_EXPORT TiledSpectrogram: public QwtPlotSpectrogram
+{
+    public:
+        static const u32 TileSize = 128;
+
+        // Number of tiles kept in addition to the ones used by the last
+        // render.
+        static const size_t MaxUnusedTiles = 256;
+
+        struct Counters
+        {
+            size_t tilesComputed;
+            size_t tilesReused;
+            size_t tilesCached;
+        };
+
+        explicit TiledSpectrogram(const QString &title = QString());
+        ~TiledSpectrogram() override;
+
+        void setTileSource(std::unique_ptr<SpectrogramTileSource> source);
+        SpectrogramTileSource *getTileSource() const;
+
+        void setResolutionReductionFactors(const ResolutionReductionFactors &rrf);
+
+        void clearTileCache();
+
+        // Tile statistics of the last render.
+        Counters getCounters() const;
+
+    protected:
+        QImage renderImage(const QwtScaleMap &xMap, const QwtScaleMap &yMap,
+                           const QRectF &area, const QSize &imageSize) const override;
+
+    private:
+        struct Private;
+        std::unique_ptr<Private> d;
+};
+
+#endif /* __MVME_HISTO2D_TILED_SPECTROGRAM_H__ */
@@ -50,6 +50,7 @@
 #include "analysis/analysis.h"
 #include "git_sha1.h"
 #include "histo1d_widget.h"
+#include "histo2d_tiled_spectrogram.h"
 #include "histo_gui_util.h"
 #include "mvme_context.h"
 #include "mvme_context_lib.h"
@@ -210,6 +211,85 @@ struct Histo1DListRasterData: public RasterDataBase
     }
 };
 
+struct Histo2DTileSource: public SpectrogramTileSource
+{
+    Histo2D *m_histo;
+
+    explicit Histo2DTileSource(Histo2D *histo)
+        : m_histo(histo)
+    {}
+
+    AxisBinning getAxisBinning(Qt::Axis axis) const override
+    {
+        return m_histo->getAxisBinning(axis);
+    }
+
+    double getBinContent(u32 xBin, u32 yBin,
+                         const ResolutionReductionFactors &rrf) const override
+    {
+        return m_histo->getBinContent(xBin, yBin, rrf);
+    }
+
+    bool getGeneration(u32 x0, u32 x1, u32 y0, u32 y1, u64 &dest) const override
+    {
+        auto tiles = m_histo->getTileGenerations();
+
+        if (!tiles)
+            return false;
+
+        // Tiles are runs of the linear bin storage: sum up the parts of the
+        // rows covered by the range.
+        const u32 xBins = m_histo->getAxisBinning(Qt::XAxis).getBins();
+        dest = 0;
+
+        for (u32 y = y0; y < y1; y++)
+            dest += tiles->sum(y * xBins + x0, y * xBins + x1);
+
+        return true;
+    }
+};
+
+// X is the histogram index, y the bins of the histograms.
+struct Histo1DListTileSource: public SpectrogramTileSource
+{
+    HistoList m_histos;
+
+    explicit Histo1DListTileSource(const HistoList &histos)
+        : m_histos(histos)
+    {}
+
+    AxisBinning getAxisBinning(Qt::Axis axis) const override
+    {
+        if (axis == Qt::XAxis)
+            return AxisBinning(m_histos.size(), 0.0, m_histos.size());
+
+        return m_histos.isEmpty() ? AxisBinning() : m_histos[0]->getAxisBinning(Qt::XAxis);
+    }
+
+    double getBinContent(u32 xBin, u32 yBin,
+                         const ResolutionReductionFactors &rrf) const override
+    {
+        return m_histos[xBin]->getBinContent(yBin, rrf.y);
+    }
+
+    bool getGeneration(u32 x0, u32 x1, u32 y0, u32 y1, u64 &dest) const override
+    {
+        dest = 0;
+
+        for (u32 x = x0; x < x1; x++)
+        {
+            auto tiles = m_histos[x]->getTileGenerations();
+
+            if (!tiles)
+                return false;
+
+            dest += tiles->sum(y0, y1);
+        }
+
+        return true;
+    }
+};
+
 using Histo1DSinkPtr = Histo2DWidget::Histo1DSinkPtr;
 
 static Histo2DStatistics calc_Histo1DSink_combined_stats(const Histo1DSinkPtr &sink,
@@ -313,7 +393,7 @@ struct Histo2DWidgetPrivate
 
     QComboBox *m_zScaleCombo;
 
-    std::unique_ptr<QwtPlotSpectrogram> m_plotItem;
+    std::unique_ptr<TiledSpectrogram> m_plotItem;
     ScrollZoomer *m_zoomer;
     QwtText *m_waterMarkText;
     QwtPlotTextLabel *m_waterMarkLabel;
@@ -423,7 +503,7 @@ Histo2DWidget::Histo2DWidget(QWidget *parent)
 {
     m_d->m_q = this;
 
-    m_d->m_plotItem = std::make_unique<QwtPlotSpectrogram>();
+    m_d->m_plotItem = std::make_unique<TiledSpectrogram>();
     m_d->m_replotTimer = new QTimer(this);
     m_d->m_cursorPosition = { make_quiet_nan(), make_quiet_nan() };
     m_d->m_labelCursorInfoWidth = -1;
@@ -682,6 +762,7 @@ Histo2DWidget::Histo2DWidget(Histo2D *histo, QWidget *parent)
     m_d->m_histo = histo;
     auto histData = new Histo2DRasterData(m_d->m_histo);
     m_d->m_plotItem->setData(histData);
+    m_d->m_plotItem->setTileSource(std::make_unique<Histo2DTileSource>(m_d->m_histo));
 
     connect(m_d->m_histo, &Histo2D::axisBinningChanged, this, [this] (Qt::Axis) {
         // Handle axis changes by zooming out fully. This will make sure
@@ -716,6 +797,8 @@ Histo2DWidget::Histo2DWidget(const Histo1DSinkPtr &histo1DSink, MVMEContext *con
     m_d->m_histo1DSink = histo1DSink;
     auto histData = new Histo1DListRasterData(m_d->m_histo1DSink->m_histos);
     m_d->m_plotItem->setData(histData);
+    m_d->m_plotItem->setTileSource(
+        std::make_unique<Histo1DListTileSource>(m_d->m_histo1DSink->m_histos));
 
     m_d->m_rrSliderX->setMaximum(histo1DSink->getNumberOfHistos());
     m_d->m_rrSliderX->setValue(m_d->m_rrSliderX->maximum());
@@ -838,6 +921,11 @@ void Histo2DWidget::replot()
     }
     else if (m_d->m_histo1DSink)
     {
+        // The tiled renderer reads the resolution reduced bin contents of
+        // the histograms which are served from their sum pyramids.
+        for (const auto &histo: m_d->m_histo1DSink->m_histos)
+            histo->updateResolutionPyramid();
+
         stats = calc_Histo1DSink_combined_stats(
             m_d->m_histo1DSink,
             { visibleXInterval.minValue(), visibleXInterval.maxValue() },
@@ -851,6 +939,7 @@ void Histo2DWidget::replot()
     // Important: Has to happen before updateCursorInfoLabel() as that calls
     // Histo1DListRasterData::value() internally  which uses the rrf.
     rasterData->setResolutionReductionFactors(rrf);
+    m_d->m_plotItem->setResolutionReductionFactors(rrf);
 
     auto zInterval = rasterData->interval(Qt::ZAxis);
     double zBase = zAxisIsLog() ? 1.0 : 0.0;
@@ -33,7 +33,7 @@
 
 static const int PeriodicRefreshInterval_ms = 1000.0;
 
-static const QStringList NameFilters = { QSL("*.mvmelst"), QSL("*.zip") };
+static const QStringList NameFilters = { QSL("*.mvmelst"), QSL("*.mvlclst"), QSL("*.zip") };
 
 ListfileBrowser::ListfileBrowser(MVMEContext *context, MVMEMainWindow *mainWindow, QWidget *parent)
     : QWidget(parent)
@@ -0,0 +1,296 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "listfile_index.h"
+
+#include <algorithm>
+#include <cstring>
+#include <QDataStream>
+
+#include "util/qt_str.h"
+
+const char *ListfileIndex::ArchiveEntryName = "listfile.idx";
+const char *ListfileIndex::FileSuffix = ".idx";
+
+constexpr u64 ReplayRange::Unlimited;
+
+namespace
+{
+
+const char IndexMagic[] = "MVMEIDX1";
+const size_t IndexMagicLen = 8;
+const quint32 IndexVersion = 1;
+
+using Checkpoint = ListfileIndex::Checkpoint;
+using Checkpoints = std::vector<Checkpoint>;
+
+u64 get_count(const Checkpoint &cp, ReplayRange::Unit unit)
+{
+    return unit == ReplayRange::Timeticks ? cp.timeticks : cp.events;
+}
+
+// Last checkpoint with a count less than or equal to value or nullptr if there
+// is no such checkpoint.
+const Checkpoint *find_last_at_or_before(
+    const Checkpoints &cps, ReplayRange::Unit unit, u64 value)
+{
+    auto it = std::upper_bound(
+        std::begin(cps), std::end(cps), value,
+        [unit] (u64 v, const Checkpoint &cp) { return v < get_count(cp, unit); });
+
+    if (it == std::begin(cps))
+        return nullptr;
+
+    return &*(it - 1);
+}
+
+// First checkpoint with a count greater than or equal to value or nullptr.
+const Checkpoint *find_first_at_or_after(
+    const Checkpoints &cps, ReplayRange::Unit unit, u64 value)
+{
+    auto it = std::lower_bound(
+        std::begin(cps), std::end(cps), value,
+        [unit] (const Checkpoint &cp, u64 v) { return get_count(cp, unit) < v; });
+
+    if (it == std::end(cps))
+        return nullptr;
+
+    return &*it;
+}
+
+} // end anon namespace
+
+QString to_string(const ReplayRange &range)
+{
+    auto endString = [&range] ()
+    {
+        return (range.end == ReplayRange::Unlimited
+                ? QSL("end") : QString::number(range.end));
+    };
+
+    switch (range.unit)
+    {
+        case ReplayRange::All:
+            return QSL("full listfile");
+
+        case ReplayRange::Timeticks:
+            return QString("seconds %1..%2").arg(range.begin).arg(endString());
+
+        case ReplayRange::Events:
+            return QString("events %1..%2").arg(range.begin).arg(endString());
+    }
+
+    return {};
+}
+
+ListfileByteRange resolve_replay_range(
+    const ListfileIndex &index, const ReplayRange &range)
+{
+    ListfileByteRange result;
+
+    if (range.isFullRange())
+        return result;
+
+    const auto &cps = index.checkpoints;
+
+    // Start at the last checkpoint which does not have more timeticks/events
+    // before it than the requested begin value.
+    if (auto cp = find_last_at_or_before(cps, range.unit, range.begin))
+        result.begin = cp->offset;
+
+    if (range.end == ReplayRange::Unlimited)
+        return result;
+
+    if (range.unit == ReplayRange::Timeticks)
+    {
+        // Timetick checkpoints are placed at the timetick itself. The data
+        // of second N is located between timetick N and timetick N+1.
+        if (range.end < index.totalTimeticks)
+        {
+            if (auto cp = find_last_at_or_before(cps, range.unit, range.end))
+                result.end = cp->offset;
+        }
+    }
+    else
+    {
+        // Stop at the first checkpoint having all of the requested events
+        // before it.
+        if (auto cp = find_first_at_or_after(cps, range.unit, range.end))
+            result.end = cp->offset;
+    }
+
+    result.end = std::max(result.begin, result.end);
+
+    return result;
+}
+
+const ListfileIndex::Block *find_block(const ListfileIndex &index, u64 offset)
+{
+    const auto &blocks = index.blocks;
+
+    auto it = std::upper_bound(
+        std::begin(blocks), std::end(blocks), offset,
+        [] (u64 off, const ListfileIndex::Block &block) { return off < block.offset; });
+
+    if (it == std::begin(blocks))
+        return nullptr;
+
+    return &*(it - 1);
+}
+
+// Format:
+//   magic              8 bytes "MVMEIDX1"
+//   version            quint32
+//   listfileName       QString
+//   totals             quint64 bytes, timeticks, events
+//   checkpoints        quint64 count, then count * (offset, timeticks, events)
+//   blocks             quint64 count, then count * (offset, compressedOffset)
+QByteArray serialize_listfile_index(const ListfileIndex &index)
+{
+    QByteArray result;
+    QDataStream out(&result, QIODevice::WriteOnly);
+
+    out.writeRawData(IndexMagic, IndexMagicLen);
+    out << IndexVersion << index.listfileName;
+    out << quint64(index.totalBytes) << quint64(index.totalTimeticks)
+        << quint64(index.totalEvents);
+
+    out << quint64(index.checkpoints.size());
+
+    for (const auto &cp: index.checkpoints)
+        out << quint64(cp.offset) << quint64(cp.timeticks) << quint64(cp.events);
+
+    out << quint64(index.blocks.size());
+
+    for (const auto &block: index.blocks)
+        out << quint64(block.offset) << quint64(block.compressedOffset);
+
+    return result;
+}
+
+bool deserialize_listfile_index(const QByteArray &data, ListfileIndex &dest)
+{
+    QDataStream in(data);
+
+    char magic[IndexMagicLen] = {};
+
+    if (in.readRawData(magic, IndexMagicLen) != static_cast<int>(IndexMagicLen)
+        || std::memcmp(magic, IndexMagic, IndexMagicLen) != 0)
+    {
+        return false;
+    }
+
+    quint32 version = 0;
+    in >> version;
+
+    if (version != IndexVersion)
+        return false;
+
+    ListfileIndex result;
+    quint64 totalBytes = 0, totalTimeticks = 0, totalEvents = 0;
+
+    in >> result.listfileName >> totalBytes >> totalTimeticks >> totalEvents;
+
+    result.totalBytes = totalBytes;
+    result.totalTimeticks = totalTimeticks;
+    result.totalEvents = totalEvents;
+
+    // The element counts are checked against the size of the input to not
+    // allocate huge amounts of memory for corrupted data.
+    auto read_count = [&in, &data] (size_t elementSize, quint64 &count)
+    {
+        in >> count;
+        return (in.status() == QDataStream::Ok
+                && count <= static_cast<quint64>(data.size()) / elementSize);
+    };
+
+    quint64 count = 0;
+
+    if (!read_count(3 * sizeof(quint64), count))
+        return false;
+
+    result.checkpoints.reserve(count);
+
+    for (quint64 i = 0; i < count; i++)
+    {
+        quint64 offset = 0, timeticks = 0, events = 0;
+        in >> offset >> timeticks >> events;
+        result.checkpoints.push_back({ offset, timeticks, events });
+    }
+
+    if (!read_count(2 * sizeof(quint64), count))
+        return false;
+
+    result.blocks.reserve(count);
+
+    for (quint64 i = 0; i < count; i++)
+    {
+        quint64 offset = 0, compressedOffset = 0;
+        in >> offset >> compressedOffset;
+        result.blocks.push_back({ offset, compressedOffset });
+    }
+
+    if (in.status() != QDataStream::Ok)
+        return false;
+
+    dest = std::move(result);
+    return true;
+}
+
+//
+// ListfileIndexBuilder
+//
+ListfileIndexBuilder::ListfileIndexBuilder(u64 checkpointInterval)
+    : m_interval(checkpointInterval)
+{
+}
+
+void ListfileIndexBuilder::addCheckpoint(u64 offset)
+{
+    auto &cps = m_index.checkpoints;
+
+    if (!cps.empty() && cps.back().offset == offset)
+        cps.pop_back();
+
+    cps.push_back({ offset, m_index.totalTimeticks, m_index.totalEvents });
+}
+
+void ListfileIndexBuilder::boundary(u64 offset)
+{
+    const auto &cps = m_index.checkpoints;
+    u64 lastOffset = cps.empty() ? 0u : cps.back().offset;
+
+    if (offset - lastOffset >= m_interval)
+        addCheckpoint(offset);
+}
+
+void ListfileIndexBuilder::timetick(u64 offset)
+{
+    addCheckpoint(offset);
+    ++m_index.totalTimeticks;
+}
+
+ListfileIndex ListfileIndexBuilder::finish(const QString &listfileName, u64 totalBytes)
+{
+    m_index.listfileName = listfileName;
+    m_index.totalBytes = totalBytes;
+
+    return std::move(m_index);
+}
@@ -0,0 +1,155 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef __MVME_LISTFILE_INDEX_H__
+#define __MVME_LISTFILE_INDEX_H__
+
+#include <limits>
+#include <QByteArray>
+#include <QString>
+#include <vector>
+
+#include "libmvme_export.h"
+#include "typedefs.h"
+
+/* Sidecar index allowing replays to start in the middle of a listfile.
+ *
+ * The index is written by the listfile writers next to the listfile data:
+ * as the "listfile.idx" member of ZIP archives or as "<listfile>.idx" for flat
+ * listfiles.
+ *
+ * Checkpoints are positions in the uncompressed listfile data at which a
+ * replay can begin: the start of an MVMELST section, an MVLC_USB stack or
+ * system frame or an MVLC_ETH packet. Each checkpoint stores the number of
+ * timeticks and readout events contained in the data before it. A checkpoint
+ * is created for every timetick and about every megabyte of data.
+ *
+ * Blocks are only present for LZ4 listfiles written by the
+ * ParallelLZ4WriteHandle. Each block is an independently decompressible LZ4
+ * frame so that reading can start at the block containing a checkpoint
+ * instead of decompressing the listfile from the beginning.
+ */
+struct LIBMVME_EXPORT ListfileIndex
+{
+    static const char *ArchiveEntryName;    // "listfile.idx"
+    static const char *FileSuffix;          // ".idx"
+
+    struct Checkpoint
+    {
+        u64 offset;     // uncompressed byte offset from the start of the listfile
+        u64 timeticks;  // timeticks before offset
+        u64 events;     // readout events before offset
+    };
+
+    struct Block
+    {
+        u64 offset;             // uncompressed offset of the first byte in the block
+        u64 compressedOffset;   // offset of the LZ4 frame in the compressed data
+    };
+
+    // Name of the indexed listfile. For ZIP archives the name of the archive
+    // member.
+    QString listfileName;
+
+    u64 totalBytes = 0;
+    u64 totalTimeticks = 0;
+    u64 totalEvents = 0;
+
+    std::vector<Checkpoint> checkpoints;    // sorted by offset
+    std::vector<Block> blocks;              // sorted by offset, may be empty
+
+    bool isValid() const { return totalBytes > 0; }
+};
+
+// Replay selection in timeticks (seconds) or readout events. The selection is
+// rounded outwards to the nearest checkpoints of the listfile index.
+struct LIBMVME_EXPORT ReplayRange
+{
+    enum Unit
+    {
+        All,
+        Timeticks,
+        Events,
+    };
+
+    static constexpr u64 Unlimited = std::numeric_limits<u64>::max();
+
+    Unit unit = All;
+    u64 begin = 0;          // first timetick/event to replay
+    u64 end = Unlimited;    // one past the last timetick/event to replay
+
+    bool isFullRange() const
+    {
+        return unit == All || (begin == 0 && end == Unlimited);
+    }
+};
+
+QString LIBMVME_EXPORT to_string(const ReplayRange &range);
+
+// Uncompressed byte range of the listfile covering a ReplayRange.
+struct LIBMVME_EXPORT ListfileByteRange
+{
+    u64 begin = 0;                          // 0 means start from the beginning
+    u64 end = ReplayRange::Unlimited;       // Unlimited means until the end
+};
+
+ListfileByteRange LIBMVME_EXPORT resolve_replay_range(
+    const ListfileIndex &index, const ReplayRange &range);
+
+// Returns the block containing the given uncompressed offset or nullptr if
+// the index has no blocks.
+LIBMVME_EXPORT const ListfileIndex::Block *find_block(const ListfileIndex &index, u64 offset);
+
+QByteArray LIBMVME_EXPORT serialize_listfile_index(const ListfileIndex &index);
+
+// Returns false if the data is not a listfile index or is truncated.
+bool LIBMVME_EXPORT deserialize_listfile_index(const QByteArray &data, ListfileIndex &dest);
+
+// Used by the listfile writers. The caller reports replay start positions,
+// timeticks and events in the order they appear in the listfile data.
+class LIBMVME_EXPORT ListfileIndexBuilder
+{
+    public:
+        static const u64 DefaultCheckpointInterval = 1u << 20;
+
+        explicit ListfileIndexBuilder(u64 checkpointInterval = DefaultCheckpointInterval);
+
+        // offset is a position at which a replay can start. Creates a
+        // checkpoint if the last one is more than checkpointInterval bytes
+        // before offset.
+        void boundary(u64 offset);
+
+        // A timetick starting at offset. Always creates a checkpoint.
+        void timetick(u64 offset);
+
+        void addEvents(u64 count = 1) { m_index.totalEvents += count; }
+
+        const ListfileIndex &index() const { return m_index; }
+
+        ListfileIndex finish(const QString &listfileName, u64 totalBytes);
+
+    private:
+        void addCheckpoint(u64 offset);
+
+        u64 m_interval;
+        ListfileIndex m_index;
+};
+
+#endif /* __MVME_LISTFILE_INDEX_H__ */
@@ -0,0 +1,337 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "listfile_parallel_compression.h"
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <lz4frame.h>
+
+using namespace mesytec;
+
+namespace
+{
+
+struct Block
+{
+    std::vector<u8> input;
+    std::vector<u8> output;
+    std::string error;
+    bool done = false;
+};
+
+} // end anon namespace
+
+struct ParallelLZ4WriteHandle::Private
+{
+    mvlc::listfile::WriteHandle *dest = nullptr;
+    int compressionLevel = 0;
+    size_t blockSize = DefaultBlockSize;
+    // Maximum number of blocks submitted but not yet written out. Bounds the
+    // memory usage if the compressors cannot keep up.
+    size_t maxInFlight = 0;
+
+    // Block currently being filled by write().
+    std::unique_ptr<Block> current;
+
+    mutable std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable blockDone;
+    bool quit = false;
+
+    // Submitted blocks in write order.
+    std::deque<std::unique_ptr<Block>> inFlight;
+    // Blocks waiting for a compressor.
+    std::deque<Block *> queue;
+    // Written blocks kept for reuse of their storage.
+    std::vector<std::unique_ptr<Block>> freeBlocks;
+
+    Counters counters;
+    std::vector<std::thread> threads;
+
+    // Only accessed by the writing thread.
+    std::vector<ListfileIndex::Block> blocks;
+    u64 blocksInputBytes = 0;
+
+    void compressorLoop(size_t threadIndex);
+    void submitCurrent();
+    // Writes completed blocks at the front of inFlight to the destination. If
+    // wait is true blocks until the oldest block is done.
+    void writeCompleted(bool wait);
+    std::unique_ptr<Block> takeFreeBlock();
+};
+
+void ParallelLZ4WriteHandle::Private::compressorLoop(size_t threadIndex)
+{
+    LZ4F_preferences_t prefs;
+    std::memset(&prefs, 0, sizeof(prefs));
+    prefs.compressionLevel = compressionLevel;
+    prefs.frameInfo.blockMode = LZ4F_blockIndependent;
+
+    while (true)
+    {
+        Block *block = nullptr;
+
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            workAvailable.wait(guard, [this] { return !queue.empty() || quit; });
+
+            if (queue.empty())
+                return;
+
+            block = queue.front();
+            queue.pop_front();
+        }
+
+        auto tStart = std::chrono::steady_clock::now();
+
+        prefs.frameInfo.contentSize = block->input.size();
+        block->output.resize(LZ4F_compressFrameBound(block->input.size(), &prefs));
+
+        size_t res = LZ4F_compressFrame(
+            block->output.data(), block->output.size(),
+            block->input.data(), block->input.size(),
+            &prefs);
+
+        if (LZ4F_isError(res))
+        {
+            block->error = LZ4F_getErrorName(res);
+            block->output.clear();
+        }
+        else
+            block->output.resize(res);
+
+        auto elapsed = std::chrono::steady_clock::now() - tStart;
+
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            auto &tc = counters.threads[threadIndex];
+            tc.bytesIn += block->input.size();
+            tc.bytesOut += block->output.size();
+            tc.busyTime += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed);
+            block->done = true;
+        }
+
+        blockDone.notify_all();
+    }
+}
+
+std::unique_ptr<Block> ParallelLZ4WriteHandle::Private::takeFreeBlock()
+{
+    std::unique_ptr<Block> result;
+
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+
+        if (!freeBlocks.empty())
+        {
+            result = std::move(freeBlocks.back());
+            freeBlocks.pop_back();
+        }
+    }
+
+    if (!result)
+    {
+        result = std::make_unique<Block>();
+        result->input.reserve(blockSize);
+    }
+
+    result->input.clear();
+    result->error.clear();
+    result->done = false;
+
+    return result;
+}
+
+void ParallelLZ4WriteHandle::Private::submitCurrent()
+{
+    if (!current || current->input.empty())
+        return;
+
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        queue.push_back(current.get());
+        inFlight.emplace_back(std::move(current));
+    }
+
+    workAvailable.notify_one();
+
+    writeCompleted(false);
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+
+            if (inFlight.size() < maxInFlight)
+                break;
+        }
+
+        writeCompleted(true);
+    }
+}
+
+void ParallelLZ4WriteHandle::Private::writeCompleted(bool wait)
+{
+    while (true)
+    {
+        std::unique_ptr<Block> block;
+
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+
+            if (inFlight.empty())
+                return;
+
+            if (wait)
+                blockDone.wait(guard, [this] { return inFlight.front()->done; });
+            else if (!inFlight.front()->done)
+                return;
+
+            block = std::move(inFlight.front());
+            inFlight.pop_front();
+        }
+
+        if (!block->error.empty())
+            throw std::runtime_error("LZ4 listfile compression failed: " + block->error);
+
+        // The destination is only ever accessed from the writing thread.
+        dest->write(block->output.data(), block->output.size());
+
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            blocks.push_back({ blocksInputBytes, counters.bytesOut });
+            blocksInputBytes += block->input.size();
+            counters.bytesOut += block->output.size();
+            freeBlocks.emplace_back(std::move(block));
+        }
+
+        // Only wait for a single block.
+        wait = false;
+    }
+}
+
+ParallelLZ4WriteHandle::ParallelLZ4WriteHandle(
+    mvlc::listfile::WriteHandle *dest,
+    int compressionLevel,
+    unsigned threadCount,
+    size_t blockSize)
+    : d(std::make_unique<Private>())
+{
+    assert(dest);
+    assert(blockSize > 0);
+
+    threadCount = std::max(threadCount, 1u);
+
+    d->dest = dest;
+    d->compressionLevel = compressionLevel;
+    d->blockSize = blockSize;
+    d->maxInFlight = threadCount * 2;
+    d->counters.threads.resize(threadCount);
+
+    for (unsigned i = 0; i < threadCount; i++)
+        d->threads.emplace_back(&Private::compressorLoop, d.get(), i);
+}
+
+ParallelLZ4WriteHandle::~ParallelLZ4WriteHandle()
+{
+    try
+    {
+        finish();
+    }
+    catch (const std::exception &)
+    {
+    }
+
+    {
+        std::unique_lock<std::mutex> guard(d->mutex);
+        d->quit = true;
+    }
+
+    d->workAvailable.notify_all();
+
+    for (auto &t: d->threads)
+        if (t.joinable())
+            t.join();
+}
+
+size_t ParallelLZ4WriteHandle::write(const u8 *data, size_t size)
+{
+    {
+        std::unique_lock<std::mutex> guard(d->mutex);
+        d->counters.bytesIn += size;
+    }
+
+    size_t remaining = size;
+
+    while (remaining > 0)
+    {
+        if (!d->current)
+            d->current = d->takeFreeBlock();
+
+        auto &input = d->current->input;
+        size_t toCopy = std::min(remaining, d->blockSize - input.size());
+
+        input.insert(std::end(input), data, data + toCopy);
+        data += toCopy;
+        remaining -= toCopy;
+
+        if (input.size() >= d->blockSize)
+            d->submitCurrent();
+    }
+
+    return size;
+}
+
+void ParallelLZ4WriteHandle::finish()
+{
+    d->submitCurrent();
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> guard(d->mutex);
+
+            if (d->inFlight.empty())
+                return;
+        }
+
+        d->writeCompleted(true);
+    }
+}
+
+ParallelLZ4WriteHandle::Counters ParallelLZ4WriteHandle::counters() const
+{
+    std::unique_lock<std::mutex> guard(d->mutex);
+    return d->counters;
+}
+
+const std::vector<ListfileIndex::Block> &ParallelLZ4WriteHandle::blocks() const
+{
+    return d->blocks;
+}
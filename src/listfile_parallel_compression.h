@@ -0,0 +1,98 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef __MVME_LISTFILE_PARALLEL_COMPRESSION_H__
+#define __MVME_LISTFILE_PARALLEL_COMPRESSION_H__
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include <mesytec-mvlc/mesytec-mvlc.h>
+
+#include "libmvme_export.h"
+#include "listfile_index.h"
+#include "typedefs.h"
+
+/* WriteHandle compressing listfile data on a pool of worker threads.
+ *
+ * Incoming data is collected into blocks of blockSize bytes. Each block is
+ * compressed into a self-contained LZ4 frame by one of the worker threads.
+ * The frames are written to the destination handle in the order the data was
+ * received. A sequence of LZ4 frames is a valid LZ4 stream so the result can
+ * be read like the output of ZipCreator::createLZ4Entry().
+ *
+ * The destination must be an uncompressed (stored) entry, e.g. from
+ * ZipCreator::createZIPEntry(name + ".lz4", 0).
+ *
+ * write() is called by a single thread, usually the listfile writer of the
+ * mvlc::ReadoutWorker. It blocks if the compressors fall behind. Compressed
+ * data is also written to the destination from that thread.
+ */
+class LIBMVME_EXPORT ParallelLZ4WriteHandle: public mesytec::mvlc::listfile::WriteHandle
+{
+    public:
+        static const size_t DefaultBlockSize = 1u << 20;
+
+        struct ThreadCounters
+        {
+            u64 bytesIn = 0;
+            u64 bytesOut = 0;
+            std::chrono::nanoseconds busyTime = {};
+        };
+
+        struct Counters
+        {
+            u64 bytesIn = 0;        // uncompressed bytes passed to write()
+            u64 bytesOut = 0;       // compressed bytes written to the destination
+            std::vector<ThreadCounters> threads;
+        };
+
+        ParallelLZ4WriteHandle(
+            mesytec::mvlc::listfile::WriteHandle *dest,
+            int compressionLevel,
+            unsigned threadCount,
+            size_t blockSize = DefaultBlockSize);
+
+        // Calls finish().
+        ~ParallelLZ4WriteHandle() override;
+
+        // Throws std::runtime_error if compressing a previous block failed.
+        size_t write(const u8 *data, size_t size) override;
+
+        // Compresses any buffered data and waits until all blocks have been
+        // written to the destination. Must be called before the destination
+        // entry is closed.
+        void finish();
+
+        // Thread-safe.
+        Counters counters() const;
+
+        // Offsets of the LZ4 frames written so far. Each frame can be
+        // decompressed on its own. Must be called from the writing thread,
+        // e.g. after finish().
+        const std::vector<ListfileIndex::Block> &blocks() const;
+
+    private:
+        struct Private;
+        std::unique_ptr<Private> d;
+};
+
+#endif /* __MVME_LISTFILE_PARALLEL_COMPRESSION_H__ */
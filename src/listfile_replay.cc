@@ -90,6 +90,12 @@ ListfileReplayHandle open_listfile(const QString &filename)
                 result.runNotes = QString::fromLocal8Bit(f.readAll());
         }
 
+        {
+            QuaZipFile f(filename, ListfileIndex::ArchiveEntryName);
+            if (f.open(QIODevice::ReadOnly))
+                deserialize_listfile_index(f.readAll(), result.index);
+        }
+
         // Now open the archive manually and search for a listfile
         result.archive = std::make_unique<QuaZip>(filename);
 
@@ -116,6 +122,9 @@ ListfileReplayHandle open_listfile(const QString &filename)
         result.listfileFilename = *it;
         auto lfName  = *it;
 
+        if (result.index.listfileName != lfName)
+            result.index = {};
+
         // Check whether we're dealing with an MVLC listfile or with a classic
         // mvmelst listfile.
         if (lfName.endsWith(QSL(".mvlclst"))
@@ -177,6 +186,11 @@ ListfileReplayHandle open_listfile(const QString &filename)
 
         assert(result.listfile);
         result.format = detect_listfile_format(result.listfile.get());
+
+        QFile indexFile(filename + ListfileIndex::FileSuffix);
+
+        if (indexFile.open(QIODevice::ReadOnly))
+            deserialize_listfile_index(indexFile.readAll(), result.index);
     }
 
     return result;
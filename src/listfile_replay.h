@@ -28,6 +28,7 @@
 #include <QDebug>
 
 #include "globals.h"
+#include "listfile_index.h"
 #include "vme_config.h"
 
 struct LIBMVME_EXPORT ListfileReplayHandle
@@ -59,6 +60,10 @@ struct LIBMVME_EXPORT ListfileReplayHandle
     QByteArray analysisBlob;    // Analysis config contents if present in the archive.
     QString runNotes;           // Contents of the mvme_run_notes.txt file stored in the archive.
 
+    // Contents of listfile.idx or the <listfile>.idx file next to a flat
+    // listfile. Invalid if there is no index for the listfile.
+    ListfileIndex index;
+
     ListfileReplayHandle() = default;
 
     ~ListfileReplayHandle()
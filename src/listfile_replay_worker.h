@@ -58,6 +58,11 @@ class LIBMVME_EXPORT ListfileReplayWorker: public QObject
         virtual DAQState getState() const = 0;
         virtual void setEventsToRead(u32 eventsToRead) = 0;
 
+        // Part of the listfile to replay. Requires the listfile index. The
+        // full listfile is replayed if the listfile has no index.
+        void setReplayRange(const ReplayRange &range) { m_replayRange = range; }
+        ReplayRange getReplayRange() const { return m_replayRange; }
+
     public slots:
         // Blocking call which will perform the work
         virtual void start() = 0;
@@ -82,6 +87,7 @@ class LIBMVME_EXPORT ListfileReplayWorker: public QObject
         ThreadSafeDataBufferQueue *m_emptyBufferQueue = nullptr;
         ThreadSafeDataBufferQueue *m_filledBufferQueue = nullptr;
         LoggerFun m_logger;
+        ReplayRange m_replayRange;
 };
 
 #endif /* __MVME_LISTFILE_REPLAY_WORKER_H__ */
@@ -0,0 +1,551 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "mvlc_listfile_index.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include <lz4frame.h>
+#include <mesytec-mvlc/mvlc_impl_eth.h>
+#include <QFile>
+#include <quazip.h>
+#include <quazipfile.h>
+
+using namespace mesytec;
+
+namespace
+{
+
+const size_t FileMagicLen = 8;
+const size_t NoHeader = std::numeric_limits<size_t>::max();
+
+} // end anon namespace
+
+//
+// MVLCIndexingWriteHandle
+//
+struct MVLCIndexingWriteHandle::Private
+{
+    mvlc::listfile::WriteHandle *dest = nullptr;
+    ListfileIndexBuilder builder;
+    mvlc::ConnectionType type = mvlc::ConnectionType::USB;
+    u64 offset = 0;             // bytes passed to write() so far
+    std::string magic;
+    bool failed = false;
+
+    // Stream state carried over between writes.
+    size_t skipWords = 0;       // words left of the current frame
+    size_t payloadWords = 0;    // words left of the current ETH packet payload
+    size_t nextHeader = NoHeader; // payload words up to the next frame header
+    bool haveEthHeader0 = false;
+    u32 ethHeader0 = 0;
+
+    explicit Private(u64 checkpointInterval)
+        : builder(checkpointInterval)
+    {}
+
+    // data must start at a word boundary of the listfile data.
+    void scan(const u32 *data, size_t words, u64 dataOffset);
+};
+
+void MVLCIndexingWriteHandle::Private::scan(const u32 *data, size_t words, u64 dataOffset)
+{
+    using namespace mvlc;
+
+    size_t i = 0;
+
+    while (i < words)
+    {
+        if (skipWords > 0)
+        {
+            size_t n = std::min(skipWords, words - i);
+            skipWords -= n;
+            i += n;
+            continue;
+        }
+
+        if (payloadWords > 0)
+        {
+            // Inside an ETH packet payload: only the frame headers are
+            // looked at. The first one is given by nextHeaderPointer, the
+            // following ones by the frame lengths.
+            if (nextHeader < payloadWords)
+            {
+                size_t n = std::min(nextHeader, words - i);
+                nextHeader -= n;
+                payloadWords -= n;
+                i += n;
+
+                if (nextHeader == 0 && i < words)
+                {
+                    auto frameInfo = extract_frame_info(data[i]);
+
+                    if (frameInfo.type == frame_headers::StackFrame)
+                        builder.addEvents();
+
+                    if (frameInfo.type == frame_headers::StackFrame
+                        || frameInfo.type == frame_headers::StackContinuation)
+                    {
+                        nextHeader = frameInfo.len + 1u;
+                    }
+                    else
+                        nextHeader = NoHeader; // don't get stuck
+                }
+            }
+            else
+            {
+                size_t n = std::min(payloadWords, words - i);
+                payloadWords -= n;
+                i += n;
+                nextHeader = NoHeader;
+            }
+
+            continue;
+        }
+
+        const u32 word = data[i];
+        const u64 wordOffset = dataOffset + i * sizeof(u32);
+
+        if (haveEthHeader0)
+        {
+            eth::PayloadHeaderInfo ethHdrs{ ethHeader0, word };
+            haveEthHeader0 = false;
+            payloadWords = ethHdrs.dataWordCount();
+            nextHeader = (ethHdrs.isNextHeaderPointerPresent()
+                          ? ethHdrs.nextHeaderPointer() : NoHeader);
+            ++i;
+            continue;
+        }
+
+        if (get_frame_type(word) == frame_headers::SystemEvent)
+        {
+            if (system_event::extract_subtype(word) == system_event::subtype::UnixTimetick)
+                builder.timetick(wordOffset);
+            else
+                builder.boundary(wordOffset);
+
+            skipWords = extract_frame_info(word).len + 1u;
+            continue;
+        }
+
+        if (type == ConnectionType::USB)
+        {
+            // Continuation frames cannot be used as replay start positions.
+            if (get_frame_type(word) == frame_headers::StackFrame)
+            {
+                builder.boundary(wordOffset);
+                builder.addEvents();
+            }
+
+            skipWords = extract_frame_info(word).len + 1u;
+            continue;
+        }
+
+        // Start of an ETH packet.
+        builder.boundary(wordOffset);
+        ethHeader0 = word;
+        haveEthHeader0 = true;
+        ++i;
+    }
+}
+
+MVLCIndexingWriteHandle::MVLCIndexingWriteHandle(
+    mvlc::listfile::WriteHandle *dest, u64 checkpointInterval)
+    : d(std::make_unique<Private>(checkpointInterval))
+{
+    assert(dest);
+    d->dest = dest;
+}
+
+MVLCIndexingWriteHandle::~MVLCIndexingWriteHandle()
+{
+}
+
+size_t MVLCIndexingWriteHandle::write(const u8 *data, size_t size)
+{
+    size_t result = d->dest->write(data, size);
+
+    if (!d->failed)
+    {
+        const u8 *scanData = data;
+        size_t scanSize = size;
+        u64 scanOffset = d->offset;
+
+        if (d->magic.size() < FileMagicLen)
+        {
+            size_t n = std::min(FileMagicLen - d->magic.size(), scanSize);
+            d->magic.append(reinterpret_cast<const char *>(scanData), n);
+            scanData += n;
+            scanSize -= n;
+            scanOffset += n;
+
+            if (d->magic.size() == FileMagicLen)
+            {
+                if (d->magic == mvlc::listfile::get_filemagic_eth())
+                    d->type = mvlc::ConnectionType::ETH;
+                else if (d->magic == mvlc::listfile::get_filemagic_usb())
+                    d->type = mvlc::ConnectionType::USB;
+                else
+                    d->failed = true;
+            }
+        }
+
+        // The MVLC data consists of 32-bit words only. Anything else means
+        // the stream cannot be followed anymore.
+        if (scanSize % sizeof(u32) != 0)
+            d->failed = true;
+
+        if (!d->failed && scanSize > 0)
+        {
+            d->scan(reinterpret_cast<const u32 *>(scanData),
+                    scanSize / sizeof(u32), scanOffset);
+        }
+    }
+
+    d->offset += size;
+
+    return result;
+}
+
+bool MVLCIndexingWriteHandle::isIndexValid() const
+{
+    return !d->failed && d->magic.size() == FileMagicLen;
+}
+
+ListfileIndex MVLCIndexingWriteHandle::finish(const QString &listfileName)
+{
+    return d->builder.finish(listfileName, d->offset);
+}
+
+//
+// MVLCRangeReadHandle
+//
+namespace
+{
+
+// Sequential access to the uncompressed listfile data.
+struct DataSource
+{
+    u64 pos = 0;
+
+    virtual ~DataSource() {}
+    virtual void seek(u64 pos) = 0;
+    virtual size_t read(u8 *dest, size_t maxSize) = 0;
+
+    // Reads and discards data until pos reaches the given offset.
+    void skipTo(u64 offset)
+    {
+        std::array<u8, 1u << 16> scratch;
+
+        while (pos < offset)
+        {
+            size_t n = std::min(static_cast<u64>(scratch.size()), offset - pos);
+
+            if (read(scratch.data(), n) == 0)
+                break;
+        }
+    }
+};
+
+struct ReadHandleSource: public DataSource
+{
+    mvlc::listfile::ReadHandle *input;
+
+    explicit ReadHandleSource(mvlc::listfile::ReadHandle *input_)
+        : input(input_)
+    {}
+
+    void seek(u64 offset) override
+    {
+        if (offset < pos)
+        {
+            input->seek(0);
+            pos = 0;
+        }
+
+        skipTo(offset);
+    }
+
+    size_t read(u8 *dest, size_t maxSize) override
+    {
+        size_t n = input->read(dest, maxSize);
+        pos += n;
+        return n;
+    }
+};
+
+struct LZ4BlockSource: public DataSource
+{
+    std::unique_ptr<QIODevice> input;
+    qint64 dataOffset;
+    qint64 dataSize;
+    std::vector<ListfileIndex::Block> blocks;
+    LZ4F_dctx *dctx = nullptr;
+
+    std::vector<u8> inBuffer;
+    size_t inPos = 0;
+    qint64 compressedPos = 0;   // relative to dataOffset
+
+    LZ4BlockSource(std::unique_ptr<QIODevice> input_,
+                   qint64 dataOffset_, qint64 dataSize_,
+                   const std::vector<ListfileIndex::Block> &blocks_)
+        : input(std::move(input_))
+        , dataOffset(dataOffset_)
+        , dataSize(dataSize_)
+        , blocks(blocks_)
+    {
+        auto res = LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION);
+
+        if (LZ4F_isError(res))
+            throw std::runtime_error(std::string("LZ4: ") + LZ4F_getErrorName(res));
+
+        jumpToBlock({ 0, 0 });
+    }
+
+    ~LZ4BlockSource() override
+    {
+        LZ4F_freeDecompressionContext(dctx);
+    }
+
+    // Uncompressed offset of the block containing the given offset.
+    ListfileIndex::Block findBlock(u64 offset) const
+    {
+        auto it = std::upper_bound(
+            std::begin(blocks), std::end(blocks), offset,
+            [] (u64 off, const ListfileIndex::Block &b) { return off < b.offset; });
+
+        if (it == std::begin(blocks))
+            return { 0, 0 };
+
+        return *(it - 1);
+    }
+
+    void jumpToBlock(const ListfileIndex::Block &block)
+    {
+        // Discards any partially decoded frame.
+        LZ4F_freeDecompressionContext(dctx);
+        LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION);
+
+        inBuffer.clear();
+        inPos = 0;
+        compressedPos = block.compressedOffset;
+        input->seek(dataOffset + compressedPos);
+        pos = block.offset;
+    }
+
+    void seek(u64 offset) override
+    {
+        auto block = findBlock(offset);
+
+        // Keep decoding if no block starts between the current position and
+        // the target.
+        if (offset < pos || block.offset > pos)
+            jumpToBlock(block);
+
+        skipTo(offset);
+    }
+
+    size_t read(u8 *dest, size_t maxSize) override
+    {
+        size_t produced = 0;
+
+        while (produced < maxSize)
+        {
+            if (inPos == inBuffer.size())
+            {
+                qint64 toRead = std::min(dataSize - compressedPos, qint64(1) << 16);
+                qint64 bytesRead = 0;
+
+                if (toRead > 0)
+                {
+                    inBuffer.resize(toRead);
+                    bytesRead = input->read(
+                        reinterpret_cast<char *>(inBuffer.data()), toRead);
+                }
+
+                inBuffer.resize(std::max(bytesRead, qint64(0)));
+                inPos = 0;
+                compressedPos += inBuffer.size();
+            }
+
+            // Called with empty input at the end of the data to flush any
+            // output buffered in the decompression context.
+            size_t outSize = maxSize - produced;
+            size_t inSize = inBuffer.size() - inPos;
+
+            auto res = LZ4F_decompress(
+                dctx, dest + produced, &outSize,
+                inBuffer.data() + inPos, &inSize, nullptr);
+
+            if (LZ4F_isError(res))
+                throw std::runtime_error(std::string("LZ4: ") + LZ4F_getErrorName(res));
+
+            inPos += inSize;
+            produced += outSize;
+
+            if (inSize == 0 && outSize == 0)
+                break;
+        }
+
+        pos += produced;
+
+        return produced;
+    }
+};
+
+} // end anon namespace
+
+struct MVLCRangeReadHandle::Private
+{
+    std::unique_ptr<DataSource> source;
+    ListfileByteRange range;
+    std::array<u8, FileMagicLen> magic;
+    size_t magicLen = 0;
+    u64 pos = 0;  // position in the presented listfile
+
+    void init(std::unique_ptr<DataSource> &&src, const ListfileByteRange &range_)
+    {
+        source = std::move(src);
+        range = range_;
+        range.begin = std::max(range.begin, static_cast<u64>(FileMagicLen));
+
+        source->seek(0);
+        magicLen = source->read(magic.data(), magic.size());
+    }
+};
+
+MVLCRangeReadHandle::MVLCRangeReadHandle(
+    mvlc::listfile::ReadHandle *input,
+    const ListfileByteRange &range)
+    : d(std::make_unique<Private>())
+{
+    d->init(std::make_unique<ReadHandleSource>(input), range);
+}
+
+MVLCRangeReadHandle::MVLCRangeReadHandle(
+    std::unique_ptr<QIODevice> compressedInput,
+    qint64 dataOffset, qint64 dataSize,
+    const std::vector<ListfileIndex::Block> &blocks,
+    const ListfileByteRange &range)
+    : d(std::make_unique<Private>())
+{
+    d->init(std::make_unique<LZ4BlockSource>(
+            std::move(compressedInput), dataOffset, dataSize, blocks),
+        range);
+}
+
+MVLCRangeReadHandle::~MVLCRangeReadHandle()
+{
+}
+
+size_t MVLCRangeReadHandle::read(u8 *dest, size_t maxSize)
+{
+    size_t result = 0;
+
+    while (result < maxSize)
+    {
+        if (d->pos < d->magicLen)
+        {
+            size_t n = std::min(maxSize - result, static_cast<size_t>(d->magicLen - d->pos));
+            std::memcpy(dest + result, d->magic.data() + d->pos, n);
+            d->pos += n;
+            result += n;
+            continue;
+        }
+
+        u64 dataPos = d->range.begin + (d->pos - d->magicLen);
+
+        if (dataPos >= d->range.end)
+            break;
+
+        if (d->source->pos != dataPos)
+        {
+            d->source->seek(dataPos);
+
+            if (d->source->pos != dataPos)
+                break; // end of input
+        }
+
+        size_t toRead = std::min(static_cast<u64>(maxSize - result), d->range.end - dataPos);
+        size_t n = d->source->read(dest + result, toRead);
+
+        if (n == 0)
+            break;
+
+        d->pos += n;
+        result += n;
+    }
+
+    return result;
+}
+
+size_t MVLCRangeReadHandle::seek(size_t pos)
+{
+    d->pos = pos;
+    return pos;
+}
+
+std::unique_ptr<MVLCRangeReadHandle> open_lz4_block_range_read_handle(
+    const QString &archiveName,
+    const QString &memberName,
+    const ListfileIndex &index,
+    const ListfileByteRange &range)
+{
+    if (index.blocks.empty())
+        return {};
+
+    QuaZip archive(archiveName);
+
+    if (!archive.open(QuaZip::mdUnzip) || !archive.setCurrentFile(memberName))
+        return {};
+
+    // Open the member in raw mode to get at the position of its data inside
+    // the archive file.
+    QuaZipFile zipFile(&archive);
+    int method = -1;
+    int level = 0;
+
+    if (!zipFile.open(QIODevice::ReadOnly, &method, &level, true))
+        return {};
+
+    // Only uncompressed members contain the LZ4 frames as is.
+    if (method != 0)
+        return {};
+
+    qint64 dataOffset = unzGetCurrentFileZStreamPos64(archive.getUnzFile());
+    qint64 dataSize = zipFile.csize();
+
+    zipFile.close();
+    archive.close();
+
+    auto file = std::make_unique<QFile>(archiveName);
+
+    if (!file->open(QIODevice::ReadOnly))
+        return {};
+
+    return std::make_unique<MVLCRangeReadHandle>(
+        std::move(file), dataOffset, dataSize, index.blocks, range);
+}
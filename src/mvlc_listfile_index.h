@@ -0,0 +1,107 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef __MVME_MVLC_LISTFILE_INDEX_H__
+#define __MVME_MVLC_LISTFILE_INDEX_H__
+
+#include <memory>
+#include <QIODevice>
+
+#include <mesytec-mvlc/mesytec-mvlc.h>
+
+#include "libmvme_export.h"
+#include "listfile_index.h"
+
+/* Passes data through to the destination handle while building a
+ * ListfileIndex of the MVLC_ETH or MVLC_USB data. The format is detected from
+ * the file magic which has to be the first thing written.
+ *
+ * Index checkpoints are placed at MVLC_USB stack frames and MVLC_ETH packets
+ * and at system event frames. Readout events are counted by the number of
+ * StackFrame headers. */
+class LIBMVME_EXPORT MVLCIndexingWriteHandle: public mesytec::mvlc::listfile::WriteHandle
+{
+    public:
+        explicit MVLCIndexingWriteHandle(
+            mesytec::mvlc::listfile::WriteHandle *dest,
+            u64 checkpointInterval = ListfileIndexBuilder::DefaultCheckpointInterval);
+        ~MVLCIndexingWriteHandle() override;
+
+        size_t write(const u8 *data, size_t size) override;
+
+        // False if the written data could not be indexed, e.g. because of an
+        // unknown file magic.
+        bool isIndexValid() const;
+
+        ListfileIndex finish(const QString &listfileName);
+
+    private:
+        struct Private;
+        std::unique_ptr<Private> d;
+};
+
+/* ReadHandle for MVLC replays starting in the middle of a listfile.
+ *
+ * The handle presents a listfile consisting of the file magic followed by the
+ * data in the uncompressed byte range [range.begin, range.end) of the
+ * original listfile. This is what the mvlc::ReplayWorker expects to read.
+ */
+class LIBMVME_EXPORT MVLCRangeReadHandle: public mesytec::mvlc::listfile::ReadHandle
+{
+    public:
+        // Reads through the input handle. Data before range.begin is skipped
+        // by reading and discarding it. This works for all kinds of ZIP
+        // entries but has to decompress the skipped data.
+        MVLCRangeReadHandle(
+            mesytec::mvlc::listfile::ReadHandle *input,
+            const ListfileByteRange &range);
+
+        // Decompresses independent LZ4 frames directly from the compressed
+        // data of the listfile, starting at the frame containing
+        // range.begin. compressedInput contains the compressed data at
+        // [dataOffset, dataOffset + dataSize).
+        MVLCRangeReadHandle(
+            std::unique_ptr<QIODevice> compressedInput,
+            qint64 dataOffset, qint64 dataSize,
+            const std::vector<ListfileIndex::Block> &blocks,
+            const ListfileByteRange &range);
+
+        ~MVLCRangeReadHandle() override;
+
+        // Throws std::runtime_error on LZ4 decompression errors.
+        size_t read(u8 *dest, size_t maxSize) override;
+        size_t seek(size_t pos) override;
+
+    private:
+        struct Private;
+        std::unique_ptr<Private> d;
+};
+
+// Creates a range read handle decompressing the independent LZ4 frames of the
+// given archive member. The member must be stored uncompressed inside the
+// archive as done for listfiles written using the ParallelLZ4WriteHandle.
+// Returns nullptr if the index has no blocks or the member cannot be read raw.
+std::unique_ptr<MVLCRangeReadHandle> LIBMVME_EXPORT open_lz4_block_range_read_handle(
+    const QString &archiveName,
+    const QString &memberName,
+    const ListfileIndex &index,
+    const ListfileByteRange &range);
+
+#endif /* __MVME_MVLC_LISTFILE_INDEX_H__ */
@@ -28,7 +28,10 @@
 #include <mesytec-mvlc/mesytec-mvlc.h>
 #include <mesytec-mvlc/mvlc_impl_eth.h>
 #include <stdexcept>
+#include <thread>
 
+#include "mvlc_listfile_index.h"
+#include "mvlc_mapped_replay.h"
 #include "mvme_mvlc_listfile.h"
 #include "mvlc/mvlc_util.h"
 #include "util_zip.h"
@@ -64,7 +67,7 @@ struct MVLCListfileWorker::Private
 {
     MVLCListfileWorker *q = nullptr;
     mvlc::Protected<DAQStats> stats;
-    DAQState state;
+    std::atomic<DAQState> state;
     std::atomic<DAQState> desiredState;
     u32 eventsToRead = 0;
     bool logBuffers = false;
@@ -75,14 +78,35 @@ struct MVLCListfileWorker::Private
 
     std::unique_ptr<mesytec::mvlc::ReplayWorker> mvlcReplayWorker;
     std::unique_ptr<mesytec::mvlc::listfile::ZipReader> mvlcZipReader;
+    // Presents the selected part of the listfile to the mvlcReplayWorker.
+    std::unique_ptr<MVLCRangeReadHandle> rangeReadHandle;
+
+    // Set by prepareMappedReplay(), taken over by start().
+    std::shared_ptr<MVLCMappedReplay> mappedReplay;
+    // True if the last run was started from a mapped replay.
+    std::atomic<bool> mappedMode;
 
     explicit Private(MVLCListfileWorker *q_)
         : q(q_)
         , stats({})
         , state(DAQState::Idle)
         , desiredState(DAQState::Idle)
+        , mappedMode(false)
     {}
 
+    void runMappedReplay(MVLCMappedReplay &replay, const ListfileByteRange &byteRange);
+    ListfileByteRange resolveReplayRange();
+
+    template<typename Cond>
+    void waitForMappedStateChange(Cond cond)
+    {
+        while (cond(state.load()))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            QCoreApplication::processEvents();
+        }
+    }
+
     void updateDAQStats()
     {
         auto counters = mvlcReplayWorker->counters();
@@ -129,13 +153,41 @@ void MVLCListfileWorker::setListfile(ListfileReplayHandle *handle)
 {
     QIODevice *input = handle->listfile.get();
 
-    if (qobject_cast<QFile *>(input))
-        throw std::runtime_error("MVLC replays from flat file are not supported yet.");
+    if (qobject_cast<QFile *>(input) && !mapped_replay_supported())
+        throw std::runtime_error("MVLC replays from flat file are not supported on this platform.");
 
     d->replayHandle = handle;
+    d->mappedReplay = {};
 
     if (auto inZipFile = qobject_cast<QuaZipFile *>(input))
         d->stats.access()->listfileFilename = inZipFile->getZipName();
+    else
+        d->stats.access()->listfileFilename = handle->inputFilename;
+}
+
+std::shared_ptr<MVLCMappedReplay> MVLCListfileWorker::prepareMappedReplay()
+{
+    d->mappedReplay = {};
+
+    if (!d->replayHandle
+        || !qobject_cast<QFile *>(d->replayHandle->listfile.get())
+        || (d->replayHandle->format != ListfileBufferFormat::MVLC_ETH
+            && d->replayHandle->format != ListfileBufferFormat::MVLC_USB))
+    {
+        return {};
+    }
+
+    try
+    {
+        d->mappedReplay = std::make_shared<MVLCMappedReplay>(
+            d->replayHandle->inputFilename.toStdString());
+    }
+    catch (const std::runtime_error &e)
+    {
+        logError(e.what());
+    }
+
+    return d->mappedReplay;
 }
 
 DAQStats MVLCListfileWorker::getStats() const
@@ -162,8 +214,13 @@ void MVLCListfileWorker::setEventsToRead(u32 eventsToRead)
 
 void MVLCListfileWorker::setState(DAQState newState)
 {
-    d->state = newState;
     d->desiredState = newState;
+    publishState(newState);
+}
+
+void MVLCListfileWorker::publishState(DAQState newState)
+{
+    d->state = newState;
     emit stateChanged(newState);
 
     switch (newState)
@@ -199,9 +256,33 @@ void MVLCListfileWorker::start()
         return;
     }
 
+    // Flat listfiles can only be replayed via memory mapping.
+    auto mappedReplay = std::move(d->mappedReplay);
+    d->mappedMode = static_cast<bool>(mappedReplay);
+
+    if (!mappedReplay && qobject_cast<QFile *>(d->replayHandle->listfile.get()))
+    {
+        logError("Could not map the listfile into memory. Aborting replay.");
+        setState(DAQState::Idle);
+        return;
+    }
+
     setState(DAQState::Starting);
     d->stats.access()->start();
 
+    const auto byteRange = d->resolveReplayRange();
+
+    if (mappedReplay)
+    {
+        logMessage(QString("Starting replay from %1 (memory mapped)")
+                   .arg(d->replayHandle->inputFilename));
+
+        d->runMappedReplay(*mappedReplay, byteRange);
+        d->stats.access()->stop();
+        setState(DAQState::Idle);
+        return;
+    }
+
     try
     {
 
@@ -211,7 +292,24 @@ void MVLCListfileWorker::start()
 
         d->mvlcZipReader = std::make_unique<mvlc::listfile::ZipReader>();
         d->mvlcZipReader->openArchive(d->replayHandle->inputFilename.toStdString());
-        auto readHandle = d->mvlcZipReader->openEntry(d->replayHandle->listfileFilename.toStdString());
+        mvlc::listfile::ReadHandle *readHandle = d->mvlcZipReader->openEntry(
+            d->replayHandle->listfileFilename.toStdString());
+
+        if (byteRange.begin > 0 || byteRange.end != ReplayRange::Unlimited)
+        {
+            // Decompress only the LZ4 frames containing the requested data
+            // if possible. Otherwise skip over the start of the listfile.
+            d->rangeReadHandle = open_lz4_block_range_read_handle(
+                d->replayHandle->inputFilename,
+                d->replayHandle->listfileFilename,
+                d->replayHandle->index,
+                byteRange);
+
+            if (!d->rangeReadHandle)
+                d->rangeReadHandle = std::make_unique<MVLCRangeReadHandle>(readHandle, byteRange);
+
+            readHandle = d->rangeReadHandle.get();
+        }
 
         d->mvlcReplayWorker = std::make_unique<mvlc::ReplayWorker>(
             *d->snoopQueues,
@@ -264,8 +362,123 @@ void MVLCListfileWorker::start()
 
 using namespace mesytec::mvme_mvlc;
 
+ListfileByteRange MVLCListfileWorker::Private::resolveReplayRange()
+{
+    const auto range = q->getReplayRange();
+
+    if (range.isFullRange())
+        return {};
+
+    if (!replayHandle->index.isValid())
+    {
+        q->logMessage(QSL("Listfile has no index, replaying the full listfile instead of %1.")
+                      .arg(to_string(range)));
+        return {};
+    }
+
+    auto result = resolve_replay_range(replayHandle->index, range);
+
+    q->logMessage(QSL("Replaying %1 (listfile bytes %2 to %3)")
+                  .arg(to_string(range))
+                  .arg(result.begin)
+                  .arg(result.end == ReplayRange::Unlimited
+                       ? QSL("end") : QString::number(result.end)));
+
+    return result;
+}
+
+void MVLCListfileWorker::Private::runMappedReplay(
+    MVLCMappedReplay &replay, const ListfileByteRange &byteRange)
+{
+    const auto magicLen = MVLCMappedReplay::FileMagicLen;
+    const auto begin = reinterpret_cast<const u32 *>(replay.file.data() + magicLen);
+    size_t totalWords = (replay.file.size() - magicLen) / sizeof(u32);
+    size_t pos = 0;
+
+    // Index offsets include the file magic.
+    if (byteRange.begin > magicLen)
+        pos = std::min((byteRange.begin - magicLen) / sizeof(u32), static_cast<u64>(totalWords));
+
+    if (byteRange.end != ReplayRange::Unlimited && byteRange.end > magicLen)
+        totalWords = std::min((byteRange.end - magicLen) / sizeof(u32), static_cast<u64>(totalWords));
+
+    totalWords = std::max(pos, totalWords);
+    MVLCBufferView view;
+    bool haveView = false;
+
+    stats.access()->listFileTotalBytes = replay.file.size();
+
+    q->publishState(DAQState::Running);
+
+    while (true)
+    {
+        const DAQState desired = desiredState;
+
+        if (desired == DAQState::Stopping)
+            break;
+
+        if (desired == DAQState::Paused)
+        {
+            if (state != DAQState::Paused)
+                q->publishState(DAQState::Paused);
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            continue;
+        }
+
+        if (state != DAQState::Running)
+            q->publishState(DAQState::Running);
+
+        if (!haveView)
+        {
+            if (pos >= totalWords)
+                break;
+
+            // Views end on frame/packet boundaries so that the readout parser
+            // sees the same structure as with ReadoutBuffers.
+            size_t words = find_view_end(
+                replay.type, begin + pos, totalWords - pos, MVLCMappedReplay::ViewWords);
+
+            view = { replay.type, nextOutputBufferNumber++, begin + pos, words };
+            haveView = true;
+
+            // Take the page faults here instead of in the parsing thread.
+            replay.file.prefetch(magicLen + pos * sizeof(u32), words * sizeof(u32));
+        }
+
+        // The timeout keeps the loop responsive to pause and stop requests
+        // while the stream worker is busy.
+        if (replay.views.enqueue(view, std::chrono::milliseconds(100)))
+        {
+            pos += view.size;
+            haveView = false;
+
+            auto daqStats = stats.access();
+            daqStats->totalBytesRead += view.size * sizeof(u32);
+            daqStats->totalBuffersRead++;
+            daqStats->buffersFlushed++;
+        }
+    }
+
+    // Tell the stream worker that this was the last view. On stop the stream
+    // worker is stopped by the context and will not drain the queue anymore.
+    while (desiredState != DAQState::Stopping)
+    {
+        if (replay.views.enqueue(MVLCBufferView{}, std::chrono::milliseconds(100)))
+            break;
+    }
+}
+
 void MVLCListfileWorker::stop()
 {
+    if (d->mappedMode)
+    {
+        d->desiredState = DAQState::Stopping;
+        d->waitForMappedStateChange([] (DAQState state) { return state != DAQState::Idle; });
+        logMessage(QString(QSL("MVLC replay stopped")));
+        return;
+    }
+
     if (auto ec = d->mvlcReplayWorker->stop())
         logError(ec.message().c_str());
     else
@@ -282,6 +495,14 @@ void MVLCListfileWorker::stop()
 
 void MVLCListfileWorker::pause()
 {
+    if (d->mappedMode)
+    {
+        d->desiredState = DAQState::Paused;
+        d->waitForMappedStateChange([] (DAQState state) { return state == DAQState::Running; });
+        logMessage(QString(QSL("MVLC replay paused")));
+        return;
+    }
+
     if (auto ec = d->mvlcReplayWorker->pause())
         logError(ec.message().c_str());
     else
@@ -298,6 +519,14 @@ void MVLCListfileWorker::pause()
 
 void MVLCListfileWorker::resume()
 {
+    if (d->mappedMode)
+    {
+        d->desiredState = DAQState::Running;
+        d->waitForMappedStateChange([] (DAQState state) { return state == DAQState::Paused; });
+        logMessage(QString(QSL("MVLC replay resumed")));
+        return;
+    }
+
     if (auto ec = d->mvlcReplayWorker->resume())
         logError(ec.message().c_str());
     else
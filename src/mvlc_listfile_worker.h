@@ -21,10 +21,13 @@
 #ifndef __MVLC_LISTFILE_WORKER_H__
 #define __MVLC_LISTFILE_WORKER_H__
 
+#include <memory>
 #include <mesytec-mvlc/mesytec-mvlc.h>
 #include "libmvme_export.h"
 #include "listfile_replay_worker.h"
 
+struct MVLCMappedReplay;
+
 class LIBMVME_EXPORT MVLCListfileWorker: public ListfileReplayWorker
 {
     Q_OBJECT
@@ -42,6 +45,14 @@ class LIBMVME_EXPORT MVLCListfileWorker: public ListfileReplayWorker
         DAQState getState() const override;
         void setEventsToRead(u32 eventsToRead) override;
 
+        // For flat (non-ZIP) listfiles: maps the listfile into memory and
+        // returns the replay object which has to be passed to the
+        // MVLC_StreamWorker before starting. start() then feeds views of the
+        // mapping to the stream worker instead of filling the snoop queues.
+        // Returns nullptr if the current listfile is not a flat MVLC listfile
+        // or if the file could not be mapped.
+        std::shared_ptr<MVLCMappedReplay> prepareMappedReplay();
+
     public slots:
         // Blocking call which will perform the work
         void start() override;
@@ -53,6 +64,8 @@ class LIBMVME_EXPORT MVLCListfileWorker: public ListfileReplayWorker
 
     private:
         void setState(DAQState state);
+        // Like setState() but leaves the desired state untouched.
+        void publishState(DAQState state);
         void logError(const QString &msg);
 
         struct Private;
@@ -0,0 +1,225 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "mvlc_mapped_replay.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <mesytec-mvlc/mvlc_impl_eth.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace mesytec;
+
+namespace
+{
+
+// Amount of consumed data to collect before calling madvise(MADV_DONTNEED).
+const size_t ReleaseStep = 16u << 20;
+
+std::runtime_error make_errno_error(const std::string &what, const std::string &filename)
+{
+    return std::runtime_error(what + " " + filename + ": " + std::strerror(errno));
+}
+
+} // end anon namespace
+
+#ifndef _WIN32
+
+MappedListfile::MappedListfile(const std::string &filename)
+{
+    m_fd = ::open(filename.c_str(), O_RDONLY);
+
+    if (m_fd < 0)
+        throw make_errno_error("Error opening", filename);
+
+    struct stat st = {};
+
+    if (::fstat(m_fd, &st) != 0)
+    {
+        auto err = make_errno_error("Error reading size of", filename);
+        ::close(m_fd);
+        throw err;
+    }
+
+    m_size = static_cast<size_t>(st.st_size);
+
+    // mmap() does not accept zero length mappings.
+    if (m_size == 0)
+        return;
+
+    void *addr = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+
+    if (addr == MAP_FAILED)
+    {
+        auto err = make_errno_error("Error mapping", filename);
+        ::close(m_fd);
+        throw err;
+    }
+
+    m_data = reinterpret_cast<const u8 *>(addr);
+
+    // The data is read exactly once from start to end. Both hints are
+    // optional, errors are ignored.
+    ::posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    ::madvise(addr, m_size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    // Only has an effect if the kernel supports huge pages for the page
+    // cache of the underlying filesystem.
+    ::madvise(addr, m_size, MADV_HUGEPAGE);
+#endif
+}
+
+MappedListfile::~MappedListfile()
+{
+    if (m_data)
+        ::munmap(const_cast<u8 *>(m_data), m_size);
+
+    if (m_fd >= 0)
+        ::close(m_fd);
+}
+
+void MappedListfile::prefetch(size_t byteOffset, size_t bytes)
+{
+    if (byteOffset >= m_size)
+        return;
+
+    static const size_t PageSize = ::sysconf(_SC_PAGESIZE);
+
+    bytes = std::min(bytes, m_size - byteOffset);
+    size_t begin = byteOffset & ~(PageSize - 1);
+    auto addr = const_cast<u8 *>(m_data + begin);
+    size_t len = byteOffset + bytes - begin;
+
+#ifdef MADV_POPULATE_READ
+    if (::madvise(addr, len, MADV_POPULATE_READ) == 0)
+        return;
+#endif
+    ::madvise(addr, len, MADV_WILLNEED);
+}
+
+void MappedListfile::release(size_t byteOffset)
+{
+    byteOffset = std::min(byteOffset, m_size);
+
+    if (byteOffset < m_released + ReleaseStep)
+        return;
+
+    static const size_t PageSize = ::sysconf(_SC_PAGESIZE);
+
+    // m_data is page aligned as returned by mmap().
+    size_t end = byteOffset & ~(PageSize - 1);
+
+    ::madvise(const_cast<u8 *>(m_data + m_released), end - m_released, MADV_DONTNEED);
+    m_released = end;
+}
+
+bool mapped_replay_supported()
+{
+    return true;
+}
+
+#else // _WIN32
+
+MappedListfile::MappedListfile(const std::string &filename)
+{
+    throw std::runtime_error("Memory mapped replay is not supported on this platform: " + filename);
+}
+
+MappedListfile::~MappedListfile()
+{
+}
+
+void MappedListfile::prefetch(size_t, size_t)
+{
+}
+
+void MappedListfile::release(size_t)
+{
+}
+
+bool mapped_replay_supported()
+{
+    return false;
+}
+
+#endif // _WIN32
+
+size_t find_view_end(
+    mvlc::ConnectionType type,
+    const u32 *data, size_t availableWords, size_t maxWords)
+{
+    size_t pos = 0;
+
+    while (pos < availableWords)
+    {
+        const size_t remaining = availableWords - pos;
+        const u32 header = data[pos];
+        size_t frameWords = remaining;
+
+        // Same framing as used by the readout parser: USB data consists of
+        // frames only, ETH data of system event frames and packets.
+        if (type == mvlc::ConnectionType::USB
+            || mvlc::get_frame_type(header) == mvlc::frame_headers::SystemEvent)
+        {
+            frameWords = mvlc::extract_frame_info(header).len + 1u;
+        }
+        else if (remaining >= mvlc::eth::HeaderWords)
+        {
+            mvlc::eth::PayloadHeaderInfo ethHdrs{ data[pos], data[pos + 1] };
+            frameWords = mvlc::eth::HeaderWords + ethHdrs.dataWordCount();
+        }
+
+        frameWords = std::min(frameWords, remaining);
+
+        // Always include the first frame so that the caller makes progress.
+        if (pos > 0 && pos + frameWords > maxWords)
+            break;
+
+        pos += frameWords;
+    }
+
+    return pos;
+}
+
+MVLCMappedReplay::MVLCMappedReplay(const std::string &filename)
+    : file(filename)
+    , views(ViewQueueSize)
+{
+    if (file.size() < FileMagicLen)
+        throw std::runtime_error("File too short to be an MVLC listfile: " + filename);
+
+    auto magic = reinterpret_cast<const char *>(file.data());
+
+    if (std::strncmp(magic, "MVLC_ETH", FileMagicLen) == 0)
+        type = mvlc::ConnectionType::ETH;
+    else if (std::strncmp(magic, "MVLC_USB", FileMagicLen) == 0)
+        type = mvlc::ConnectionType::USB;
+    else
+        throw std::runtime_error("Unknown MVLC listfile format: " + filename);
+}
@@ -0,0 +1,120 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef __MVME_MVLC_MAPPED_REPLAY_H__
+#define __MVME_MVLC_MAPPED_REPLAY_H__
+
+#include <string>
+
+#include <mesytec-mvlc/mesytec-mvlc.h>
+
+#include "libmvme_export.h"
+#include "typedefs.h"
+#include "util/lockfree_ring.h"
+
+/* Zero-copy replay of uncompressed MVLC listfiles (.mvlclst).
+ *
+ * The listfile is memory mapped and cut into views which start and end on
+ * frame (USB) or packet (ETH) boundaries, the same as the buffers produced by
+ * mvlc::ReplayWorker. The views point directly into the mapping and are passed
+ * to the readout parser without copying the data into ReadoutBuffers first.
+ *
+ * The producer (MVLCListfileWorker) enqueues views into MVLCMappedReplay::views,
+ * the consumer (MVLC_StreamWorker) parses them and releases the consumed part
+ * of the mapping. A null view (data == nullptr) marks the end of the replay.
+ *
+ * Only available on POSIX systems. ZIP archives and Windows use the ReplayWorker
+ * path.
+ */
+
+// A range of words to be parsed as one readout buffer.
+struct MVLCBufferView
+{
+    mesytec::mvlc::ConnectionType type = mesytec::mvlc::ConnectionType::USB;
+    size_t bufferNumber = 0;
+    const u32 *data = nullptr;
+    size_t size = 0;    // in words
+};
+
+inline MVLCBufferView make_buffer_view(const mesytec::mvlc::ReadoutBuffer *buffer)
+{
+    auto view = buffer->viewU32();
+    return { buffer->type(), buffer->bufferNumber(), view.data(), view.size() };
+}
+
+// Read-only memory mapping of a whole file. Throws std::runtime_error if the
+// file cannot be opened or mapped.
+class LIBMVME_EXPORT MappedListfile
+{
+    public:
+        explicit MappedListfile(const std::string &filename);
+        ~MappedListfile();
+
+        MappedListfile(const MappedListfile &) = delete;
+        MappedListfile &operator=(const MappedListfile &) = delete;
+
+        const u8 *data() const { return m_data; }
+        size_t size() const { return m_size; }
+
+        // Faults in the pages of the given range so that the reader of the
+        // data does not have to. Falls back to a read-ahead hint on systems
+        // without MADV_POPULATE_READ. Errors are ignored.
+        void prefetch(size_t byteOffset, size_t bytes);
+
+        // Tells the kernel that the pages below byteOffset will not be
+        // accessed again. Done in large steps to keep the number of madvise()
+        // calls low. Only drops our reference to the pages, the page cache is
+        // unaffected.
+        void release(size_t byteOffset);
+
+    private:
+        const u8 *m_data = nullptr;
+        size_t m_size = 0;
+        size_t m_released = 0;
+        int m_fd = -1;
+};
+
+// Returns true if memory mapped replays are supported on this platform.
+bool LIBMVME_EXPORT mapped_replay_supported();
+
+// Returns the number of words, at most maxWords, starting at data which form
+// complete USB frames or ETH packets. System event frames are handled for
+// both formats. If the first frame alone is larger than maxWords its full
+// size is returned, limited by the available number of words.
+size_t LIBMVME_EXPORT find_view_end(
+    mesytec::mvlc::ConnectionType type,
+    const u32 *data, size_t availableWords, size_t maxWords);
+
+struct LIBMVME_EXPORT MVLCMappedReplay
+{
+    static const size_t ViewQueueSize = 64;
+    static const size_t ViewWords = (1u << 20) / sizeof(u32); // 1 MB views
+    // Length of the "MVLC_ETH"/"MVLC_USB" magic at the start of the file.
+    static const size_t FileMagicLen = 8;
+
+    // Maps the file and detects the connection type from the file magic.
+    explicit MVLCMappedReplay(const std::string &filename);
+
+    MappedListfile file;
+    mesytec::mvlc::ConnectionType type;
+    mesytec::mvme::LockFreeRing<MVLCBufferView> views;
+};
+
+#endif /* __MVME_MVLC_MAPPED_REPLAY_H__ */
@@ -0,0 +1,398 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "mvlc_parallel_replay.h"
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace mesytec;
+using namespace mesytec::mvlc;
+
+namespace
+{
+
+struct ChunkBuffer
+{
+    ConnectionType type;
+    size_t number;
+    std::vector<u32> data;
+
+    void assign(const MVLCBufferView &buffer)
+    {
+        type = buffer.type;
+        number = buffer.bufferNumber;
+        data.assign(buffer.data, buffer.data + buffer.size);
+    }
+};
+
+struct Chunk
+{
+    // Last buffer of the previous chunk. Parsed with output suppressed.
+    ChunkBuffer warmup;
+    bool hasWarmup = false;
+
+    // Storage is reused, only the first 'used' entries are valid.
+    std::vector<ChunkBuffer> buffers;
+    size_t used = 0;
+};
+
+struct Worker
+{
+    a2::A2 *a2 = nullptr;
+    Chunk chunk;
+    readout_parser::ReadoutParserState parser;
+    readout_parser::ReadoutParserCallbacks callbacks;
+    MVLCParallelReplay::RoundResult result;
+
+    // False while parsing the warmup buffer.
+    bool deliver = false;
+    // True between a delivered beginEvent and the matching endEvent.
+    bool inEvent = false;
+
+    // Protected by Private::mutex
+    bool busy = false;
+
+    std::thread thread;
+};
+
+} // end anon namespace
+
+struct MVLCParallelReplay::Private
+{
+    readout_parser::ReadoutParserState parserPrototype;
+    ModuleIndexMaps moduleIndexMaps;
+    size_t buffersPerChunk;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable workDone;
+    bool quit = false;
+
+    // Index of the worker whose chunk is currently being filled.
+    size_t current = 0;
+
+    // Copy of the last buffer of the most recently handed off chunk. Becomes
+    // the warmup buffer of the next chunk.
+    ChunkBuffer lastBuffer;
+    bool hasLastBuffer = false;
+
+    void setupCallbacks(Worker *w);
+    void workerLoop(Worker *w);
+    void processChunk(Worker *w);
+    void handOff(Worker *w);
+};
+
+void MVLCParallelReplay::Private::setupCallbacks(Worker *w)
+{
+    auto &maps = moduleIndexMaps;
+    auto &counters = w->result.counters;
+
+    w->callbacks.beginEvent = [w] (int ei)
+    {
+        if (!w->deliver)
+            return;
+
+        w->inEvent = true;
+        a2::a2_begin_event(w->a2, ei);
+    };
+
+    // Same handling as in the MVLC_StreamWorker: prefix data of modules
+    // without a dynamic part is processed as module data.
+    w->callbacks.groupPrefix = [w, &maps, &counters] (
+        int ei, int parserModuleIndex, const u32 *data, u32 size)
+    {
+        if (!w->inEvent
+            || w->parser.readoutStructure[ei][parserModuleIndex].hasDynamic)
+            return;
+
+        int mi = maps[ei][parserModuleIndex];
+        a2::a2_process_module_data(w->a2, ei, mi, data, size);
+        counters.moduleCounters[ei][mi]++;
+    };
+
+    w->callbacks.groupDynamic = [w, &maps, &counters] (
+        int ei, int parserModuleIndex, const u32 *data, u32 size)
+    {
+        if (!w->inEvent)
+            return;
+
+        int mi = maps[ei][parserModuleIndex];
+        a2::a2_process_module_data(w->a2, ei, mi, data, size);
+
+        if (0 <= ei && ei < MaxVMEEvents && 0 <= mi && mi < MaxVMEModules)
+            counters.moduleCounters[ei][mi]++;
+    };
+
+    w->callbacks.groupSuffix = [] (int, int, const u32 *, u32) {};
+
+    w->callbacks.endEvent = [w, &counters] (int ei)
+    {
+        if (!w->inEvent)
+            return;
+
+        w->inEvent = false;
+        a2::a2_end_event(w->a2, ei);
+
+        if (0 <= ei && ei < MaxVMEEvents)
+        {
+            counters.totalEvents++;
+            counters.eventCounters[ei]++;
+        }
+    };
+
+    w->callbacks.systemEvent = [w] (const u32 *header, u32 /*size*/)
+    {
+        if (w->deliver
+            && system_event::extract_subtype(*header) == system_event::subtype::UnixTimetick)
+        {
+            w->result.timeticks++;
+        }
+    };
+}
+
+void MVLCParallelReplay::Private::processChunk(Worker *w)
+{
+    auto parse = [w] (const ChunkBuffer &buffer,
+                      readout_parser::ReadoutParserCounters &counters)
+    {
+        try
+        {
+            auto pr = readout_parser::parse_readout_buffer(
+                buffer.type,
+                w->parser,
+                w->callbacks,
+                counters,
+                buffer.number,
+                buffer.data.data(),
+                buffer.data.size());
+
+            return pr == readout_parser::ParseResult::Ok;
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+    };
+
+    // Each chunk starts from a fresh parser state. Counters of the warmup
+    // buffer belong to the previous chunk and are discarded.
+    w->parser = parserPrototype;
+    w->inEvent = false;
+
+    if (w->chunk.hasWarmup)
+    {
+        readout_parser::ReadoutParserCounters discardedCounters = {};
+        w->deliver = false;
+        parse(w->chunk.warmup, discardedCounters);
+    }
+
+    w->deliver = true;
+
+    for (size_t bi = 0; bi < w->chunk.used; bi++)
+    {
+        if (!parse(w->chunk.buffers[bi], w->result.parserCounters))
+            w->result.counters.buffersWithErrors++;
+    }
+
+    // An event still in progress is completed by the worker processing the
+    // next chunk.
+    w->inEvent = false;
+}
+
+void MVLCParallelReplay::Private::workerLoop(Worker *w)
+{
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            workAvailable.wait(guard, [this, w] { return w->busy || quit; });
+
+            if (!w->busy && quit)
+                return;
+        }
+
+        processChunk(w);
+
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            w->busy = false;
+        }
+
+        workDone.notify_all();
+    }
+}
+
+void MVLCParallelReplay::Private::handOff(Worker *w)
+{
+    // The workers chunk must not be touched once it is busy so the warmup
+    // copy for the next chunk is made here.
+    assert(w->chunk.used > 0);
+    lastBuffer = w->chunk.buffers[w->chunk.used - 1];
+    hasLastBuffer = true;
+
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        assert(!w->busy);
+        w->busy = true;
+    }
+
+    workAvailable.notify_all();
+}
+
+MVLCParallelReplay::MVLCParallelReplay(
+    const std::vector<a2::A2 *> &workers,
+    const readout_parser::ReadoutParserState &parserPrototype,
+    const ModuleIndexMaps &moduleIndexMaps,
+    size_t buffersPerChunk)
+    : m_d(std::make_unique<Private>())
+{
+    assert(!workers.empty());
+    assert(buffersPerChunk > 0);
+
+    m_d->parserPrototype = parserPrototype;
+    m_d->moduleIndexMaps = moduleIndexMaps;
+    m_d->buffersPerChunk = buffersPerChunk;
+
+    for (auto a2: workers)
+    {
+        auto w = std::make_unique<Worker>();
+        w->a2 = a2;
+        w->chunk.buffers.resize(buffersPerChunk);
+        m_d->setupCallbacks(w.get());
+        m_d->workers.emplace_back(std::move(w));
+    }
+
+    for (auto &w: m_d->workers)
+        w->thread = std::thread(&Private::workerLoop, m_d.get(), w.get());
+}
+
+MVLCParallelReplay::~MVLCParallelReplay()
+{
+    {
+        std::unique_lock<std::mutex> guard(m_d->mutex);
+        m_d->quit = true;
+    }
+
+    m_d->workAvailable.notify_all();
+
+    for (auto &w: m_d->workers)
+        if (w->thread.joinable())
+            w->thread.join();
+}
+
+bool MVLCParallelReplay::addBuffer(const MVLCBufferView &buffer)
+{
+    assert(m_d->current < m_d->workers.size());
+
+    auto w = m_d->workers[m_d->current].get();
+    auto &chunk = w->chunk;
+
+    if (chunk.used == 0)
+    {
+        chunk.hasWarmup = m_d->hasLastBuffer;
+
+        if (chunk.hasWarmup)
+            std::swap(chunk.warmup, m_d->lastBuffer);
+    }
+
+    chunk.buffers[chunk.used].assign(buffer);
+
+    if (++chunk.used < m_d->buffersPerChunk)
+        return false;
+
+    m_d->handOff(w);
+
+    return ++m_d->current == m_d->workers.size();
+}
+
+MVLCParallelReplay::RoundResult MVLCParallelReplay::finishRound()
+{
+    if (m_d->current < m_d->workers.size()
+        && m_d->workers[m_d->current]->chunk.used > 0)
+    {
+        m_d->handOff(m_d->workers[m_d->current].get());
+    }
+
+    {
+        std::unique_lock<std::mutex> guard(m_d->mutex);
+        m_d->workDone.wait(guard, [this] {
+            return std::none_of(
+                std::begin(m_d->workers), std::end(m_d->workers),
+                [] (const std::unique_ptr<Worker> &w) { return w->busy; });
+        });
+    }
+
+    RoundResult result = {};
+
+    for (auto &w: m_d->workers)
+    {
+        auto &src = w->result;
+
+        result.counters.totalEvents += src.counters.totalEvents;
+        result.counters.buffersWithErrors += src.counters.buffersWithErrors;
+
+        for (int ei = 0; ei < MaxVMEEvents; ei++)
+        {
+            result.counters.eventCounters[ei] += src.counters.eventCounters[ei];
+
+            for (int mi = 0; mi < MaxVMEModules; mi++)
+                result.counters.moduleCounters[ei][mi] += src.counters.moduleCounters[ei][mi];
+        }
+
+        add_parser_counters(result.parserCounters, src.parserCounters);
+        result.timeticks += src.timeticks;
+
+        src = {};
+        w->chunk.used = 0;
+    }
+
+    m_d->current = 0;
+
+    return result;
+}
+
+size_t MVLCParallelReplay::workerCount() const
+{
+    return m_d->workers.size();
+}
+
+void add_parser_counters(
+    readout_parser::ReadoutParserCounters &dest,
+    const readout_parser::ReadoutParserCounters &src)
+{
+    dest.buffersProcessed += src.buffersProcessed;
+    dest.internalBufferLoss += src.internalBufferLoss;
+    dest.unusedBytes += src.unusedBytes;
+    dest.ethPacketsProcessed += src.ethPacketsProcessed;
+    dest.ethPacketLoss += src.ethPacketLoss;
+    dest.parserExceptions += src.parserExceptions;
+
+    for (size_t i = 0; i < dest.systemEvents.size(); i++)
+        dest.systemEvents[i] += src.systemEvents[i];
+
+    for (size_t i = 0; i < dest.parseResults.size(); i++)
+        dest.parseResults[i] += src.parseResults[i];
+}
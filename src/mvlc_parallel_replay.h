@@ -0,0 +1,115 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef __MVME_MVLC_PARALLEL_REPLAY_H__
+#define __MVME_MVLC_PARALLEL_REPLAY_H__
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#include <mesytec-mvlc/mesytec-mvlc.h>
+#include "mesytec-mvlc/mvlc_readout_parser.h"
+
+#include "analysis/a2/a2.h"
+#include "libmvme_export.h"
+#include "mvlc_mapped_replay.h"
+#include "stream_processor_counters.h"
+#include "vme_config_limits.h"
+
+/* Parallel parsing and analysis of MVLC replay data.
+ *
+ * The buffer stream is split into chunks of consecutive buffers. Each chunk is
+ * parsed by its own readout parser and analysed by its own A2 instance (see
+ * Analysis::takeA2ChunkWorkers()) on one of the worker threads.
+ *
+ * Chunks are processed in rounds: one chunk per worker is filled and handed
+ * off, then finishRound() waits for all workers to become idle. Between rounds
+ * the caller merges the histogram shards and counters in buffer order, e.g.
+ * via Analysis::syncHistograms().
+ *
+ * Events may span buffer boundaries. To not lose these events each chunk
+ * worker first parses the last buffer of the previous chunk with its output
+ * suppressed. This primes the parser state so that an event started in the
+ * previous chunk is completed and delivered by the worker owning the buffer in
+ * which the event ends. The previous worker never sees the end of that event
+ * and thus does not deliver it. Results are the same as with sequential
+ * processing as long as no single event spans more than two buffers.
+ *
+ * Buffers are copied into chunk owned memory so that they can be returned to
+ * the replay (or the pages of a mapped listfile released) immediately.
+ */
+
+class LIBMVME_EXPORT MVLCParallelReplay
+{
+    public:
+        static const size_t DefaultBuffersPerChunk = 8;
+
+        using ModuleIndexMap = std::array<int, MaxVMEModules>;
+        using ModuleIndexMaps = std::array<ModuleIndexMap, MaxVMEEvents>;
+
+        struct RoundResult
+        {
+            // Event and module counters and the number of buffers containing
+            // parse errors.
+            MVMEStreamProcessorCounters counters = {};
+            mesytec::mvlc::readout_parser::ReadoutParserCounters parserCounters = {};
+            // Number of unix timetick system events seen in the data.
+            u32 timeticks = 0;
+        };
+
+        /* Starts one thread per A2 instance. The instances are not owned and
+         * must outlive this object. parserPrototype is copied for each
+         * chunk. moduleIndexMaps maps readout parser module indexes to mvme
+         * module indexes. */
+        MVLCParallelReplay(
+            const std::vector<a2::A2 *> &workers,
+            const mesytec::mvlc::readout_parser::ReadoutParserState &parserPrototype,
+            const ModuleIndexMaps &moduleIndexMaps,
+            size_t buffersPerChunk = DefaultBuffersPerChunk);
+
+        ~MVLCParallelReplay();
+
+        MVLCParallelReplay(const MVLCParallelReplay &) = delete;
+        MVLCParallelReplay &operator=(const MVLCParallelReplay &) = delete;
+
+        /* Copies the buffer data into the currently filled chunk. Full chunks are
+         * handed to their worker immediately. Returns true once each worker
+         * has been handed a chunk. finishRound() must be called then. */
+        bool addBuffer(const MVLCBufferView &buffer);
+
+        /* Hands off the partially filled chunk, if any, and waits for all
+         * workers to finish their chunks. Returns the sum of the counters of
+         * the processed chunks. */
+        RoundResult finishRound();
+
+        size_t workerCount() const;
+
+    private:
+        struct Private;
+        std::unique_ptr<Private> m_d;
+};
+
+/* Adds the readout parser counters displayed in the analysis info window. */
+void LIBMVME_EXPORT add_parser_counters(
+    mesytec::mvlc::readout_parser::ReadoutParserCounters &dest,
+    const mesytec::mvlc::readout_parser::ReadoutParserCounters &src);
+
+#endif /* __MVME_MVLC_PARALLEL_REPLAY_H__ */
@@ -31,7 +31,9 @@
 #include <mesytec-mvlc/mvlc_impl_eth.h>
 #include <mesytec-mvlc/mvlc_impl_usb.h>
 
+#include "listfile_parallel_compression.h"
 #include "mvlc_daq.h"
+#include "mvlc_listfile_index.h"
 #include "mvme_mvlc_listfile.h"
 #include "mvlc/mvlc_qt_object.h"
 #include "mvlc/mvlc_util.h"
@@ -145,6 +147,10 @@ struct MVLCReadoutWorker::Private
 
     std::unique_ptr<mesytec::mvlc::ReadoutWorker> mvlcReadoutWorker;
     std::unique_ptr<mesytec::mvlc::listfile::ZipCreator> mvlcZipCreator;
+    // Wraps the ZIP entry write handle if LZ4 compression runs in parallel.
+    std::unique_ptr<ParallelLZ4WriteHandle> parallelLZ4Writer;
+    // Outermost listfile write handle. Builds the listfile.idx index.
+    std::unique_ptr<MVLCIndexingWriteHandle> listfileIndexer;
     mvlc::ReadoutBufferQueues *snoopQueues = nullptr;
 
     // lots of mvlc api layers
@@ -190,6 +196,27 @@ struct MVLCReadoutWorker::Private
         daqStats.buffersWithErrors = rdoCounters.usbFramingErrors + rdoCounters.ethShortReads;
         daqStats.droppedBuffers = rdoCounters.snoopMissedBuffers;
         daqStats.listFileBytesWritten = rdoCounters.listfileWriterCounters.bytesWritten;
+
+        if (parallelLZ4Writer)
+            updateCompressionStats(daqStats, parallelLZ4Writer->counters());
+    }
+
+    static void updateCompressionStats(
+        DAQStats &daqStats, const ParallelLZ4WriteHandle::Counters &counters)
+    {
+        // Includes the preamble which is written before the readout starts.
+        daqStats.listFileBytesWritten = counters.bytesIn;
+        daqStats.listFileBytesCompressed = counters.bytesOut;
+        daqStats.listFileCompressorThreads.resize(counters.threads.size());
+
+        for (size_t i = 0; i < counters.threads.size(); i++)
+        {
+            auto &src = counters.threads[i];
+            auto &dst = daqStats.listFileCompressorThreads[i];
+            dst.bytesIn = src.bytesIn;
+            dst.bytesOut = src.bytesOut;
+            dst.busySeconds = std::chrono::duration<double>(src.busyTime).count();
+        }
     }
 };
 
@@ -321,6 +348,7 @@ void MVLCReadoutWorker::start(quint32 cycles)
 
         mvlc::listfile::WriteHandle *listfileWriteHandle = nullptr;
         QString listfileArchiveName;
+        QString listfileMemberName;
 
         if (m_workerContext.listfileOutputInfo->enabled)
         {
@@ -350,17 +378,41 @@ void MVLCReadoutWorker::start(quint32 cycles)
             {
                 listfileWriteHandle = d->mvlcZipCreator->createZIPEntry(
                     memberName.toStdString(), outInfo->compressionLevel);
+                listfileMemberName = memberName;
+            }
+            else if (outInfo->format == ListFileFormat::LZ4
+                     && outInfo->compressionThreads > 0)
+            {
+                // Compress on a thread pool and store the resulting LZ4 frames
+                // in an uncompressed entry. createLZ4Entry() appends the same
+                // ".lz4" suffix to the entry name.
+                auto entryHandle = d->mvlcZipCreator->createZIPEntry(
+                    memberName.toStdString() + ".lz4", 0);
+
+                d->parallelLZ4Writer = std::make_unique<ParallelLZ4WriteHandle>(
+                    entryHandle, outInfo->compressionLevel, outInfo->compressionThreads);
+
+                listfileWriteHandle = d->parallelLZ4Writer.get();
+                listfileMemberName = memberName + QSL(".lz4");
+
+                logger(QString("Compressing listfile using %1 threads")
+                       .arg(outInfo->compressionThreads));
             }
             else if (outInfo->format == ListFileFormat::LZ4)
             {
                 listfileWriteHandle = d->mvlcZipCreator->createLZ4Entry(
                     memberName.toStdString(), outInfo->compressionLevel);
+                listfileMemberName = memberName + QSL(".lz4");
             }
 
             assert(listfileWriteHandle);
 
             if (listfileWriteHandle)
             {
+                d->listfileIndexer = std::make_unique<MVLCIndexingWriteHandle>(
+                    listfileWriteHandle);
+                listfileWriteHandle = d->listfileIndexer.get();
+
                 // Standard listfile preamble including a mesytec-mvlc
                 // CrateConfig generated from our VMEConfig.
                 mvlc::listfile::listfile_write_preamble(
@@ -418,12 +470,56 @@ void MVLCReadoutWorker::start(quint32 cycles)
         vme_daq_shutdown(getContext().vmeConfig, d->mvlcCtrl, logger, errorLogger);
         m_workerContext.daqStats.stop();
 
+        ListfileIndex listfileIndex;
+
+        // Write out the remaining compressed blocks before closing the entry.
+        if (d->parallelLZ4Writer)
+        {
+            d->parallelLZ4Writer->finish();
+            d->updateCompressionStats(m_workerContext.daqStats, d->parallelLZ4Writer->counters());
+
+            const auto &stats = m_workerContext.daqStats;
+
+            logMessage(QString("Listfile compression ratio: %1")
+                       .arg(stats.getListFileCompressionRatio(), 0, 'f', 2));
+
+            for (int i = 0; i < stats.listFileCompressorThreads.size(); i++)
+            {
+                logMessage(QString("  Compressor thread %1: %2 MB/s")
+                           .arg(i)
+                           .arg(stats.listFileCompressorThreads[i].getThroughput() / Megabytes(1),
+                                0, 'f', 2));
+            }
+        }
+
+        if (d->listfileIndexer && d->listfileIndexer->isIndexValid())
+        {
+            listfileIndex = d->listfileIndexer->finish(listfileMemberName);
+
+            if (d->parallelLZ4Writer)
+                listfileIndex.blocks = d->parallelLZ4Writer->blocks();
+        }
+
+        d->listfileIndexer.reset();
+        d->parallelLZ4Writer.reset();
+
         // add the log buffer and the analysis configs to the listfile archive
         if (d->mvlcZipCreator && d->mvlcZipCreator->isOpen())
         {
             if (d->mvlcZipCreator->hasOpenEntry())
                 d->mvlcZipCreator->closeCurrentEntry();
 
+            if (listfileIndex.isValid())
+            {
+                if (auto writeHandle = d->mvlcZipCreator->createZIPEntry(
+                        ListfileIndex::ArchiveEntryName, 0))
+                {
+                    auto bytes = serialize_listfile_index(listfileIndex);
+                    writeHandle->write(reinterpret_cast<const u8 *>(bytes.data()), bytes.size());
+                    d->mvlcZipCreator->closeCurrentEntry();
+                }
+            }
+
             if (auto writeHandle = d->mvlcZipCreator->createZIPEntry("messages.log", 0))
             {
                 auto messages = m_workerContext.getLogBuffer().join('\n');
@@ -480,6 +576,11 @@ void MVLCReadoutWorker::start(quint32 cycles)
         logError("Unknown exception during readout");
     }
 
+    // Only non-null if an exception was thrown. The compressor writes into
+    // the current ZIP entry so it must not outlive the ZipCreator.
+    d->listfileIndexer.reset();
+    d->parallelLZ4Writer.reset();
+
     // Reset object pointers to ensure we don't accidentially work with stale
     // pointers on next startup.
     d->mvlcCtrl = nullptr;
@@ -22,16 +22,21 @@
 
 #include <algorithm>
 #include <mutex>
+#include <typeinfo>
 #include <QThread>
 
 #include "analysis/analysis_util.h"
 #include "analysis/analysis_session.h"
 #include "databuffer.h"
+#include "event_server/server/event_server.h"
 #include "mesytec-mvlc/mvlc_command_builders.h"
 #include "mvme_context.h"
 #include "vme_config_scripts.h"
 #include "vme_analysis_common.h"
 #include "mvlc/vmeconfig_to_crateconfig.h"
+#include "mvlc_mapped_replay.h"
+#include "mvlc_parallel_replay.h"
+#include "stream_consumer_pipeline.h"
 #include "vme_script.h"
 
 using namespace vme_analysis_common;
@@ -117,12 +122,14 @@ MVLC_StreamWorker::MVLC_StreamWorker(
     QObject *parent)
 : StreamWorkerBase(parent)
 , m_context(context)
+, m_countersSnapshot({})
 , m_snoopQueues(snoopQueues)
 , m_parserCounters({})
 , m_parserCountersSnapshot({})
 , m_state(MVMEStreamWorkerState::Idle)
 , m_desiredState(MVMEStreamWorkerState::Idle)
 , m_startPaused(false)
+, m_staticConsumerDispatch(true)
 , m_stopFlag(StopWhenQueueEmpty)
 , m_debugInfoRequest(DebugInfoRequest::None)
 {
@@ -205,23 +212,20 @@ void MVLC_StreamWorker::fillModuleIndexMaps(const VMEConfig *vmeConfig)
 #endif
 }
 
-void MVLC_StreamWorker::setupParserCallbacks(
+template<typename Pipeline>
+void MVLC_StreamWorker::installParserCallbacks(
+    Pipeline pipeline,
     const RunInfo &runInfo,
-    const VMEConfig *vmeConfig,
     analysis::Analysis *analysis)
 {
-
     m_parserCallbacks = mesytec::mvlc::readout_parser::ReadoutParserCallbacks();
 
-    m_parserCallbacks.beginEvent = [this, analysis](int ei)
+    m_parserCallbacks.beginEvent = [this, pipeline](int ei) mutable
     {
         this->blockIfPaused();
 
         //qDebug() << "beginEvent" << ei;
-        analysis->beginEvent(ei);
-
-        for (auto c: m_moduleConsumers)
-            c->beginEvent(ei);
+        pipeline.beginEvent(ei);
 
         if (m_state == WorkerState::SingleStepping)
             begin_event_record(m_singleStepEventRecord, ei);
@@ -230,7 +234,8 @@ void MVLC_StreamWorker::setupParserCallbacks(
             m_diag->beginEvent(ei);
     };
 
-    m_parserCallbacks.groupPrefix = [this, analysis](int ei, int parserModuleIndex, const u32 *data, u32 size)
+    m_parserCallbacks.groupPrefix = [this, analysis, pipeline](
+        int ei, int parserModuleIndex, const u32 *data, u32 size) mutable
     {
         //qDebug() << "  modulePrefix" << ei << mi << data << size;
 
@@ -250,14 +255,11 @@ void MVLC_StreamWorker::setupParserCallbacks(
 
         if (!moduleParts.hasDynamic)
         {
-            analysis->processModuleData(ei, mi, data, size);
-            for (auto c: m_moduleConsumers)
-                c->processModuleData(ei, mi, data, size);
+            pipeline.processModuleData(ei, mi, data, size);
 
             if (m_diag)
                 m_diag->processModuleData(ei, mi, data, size);
 
-            UniqueLock guard(m_countersMutex);
             m_counters.moduleCounters[ei][mi]++;
         }
         else
@@ -272,25 +274,18 @@ void MVLC_StreamWorker::setupParserCallbacks(
         }
     };
 
-    m_parserCallbacks.groupDynamic = [this, analysis](int ei, int parserModuleIndex, const u32 *data, u32 size)
+    m_parserCallbacks.groupDynamic = [this, pipeline](
+        int ei, int parserModuleIndex, const u32 *data, u32 size) mutable
     {
         //qDebug() << "  moduleDynamic" << ei << mi << data << size;
         int mi = m_eventModuleIndexMaps[ei][parserModuleIndex];
-        analysis->processModuleData(ei, mi, data, size);
-
-        for (auto c: m_moduleConsumers)
-        {
-            c->processModuleData(ei, mi, data, size);
-        }
+        pipeline.processModuleData(ei, mi, data, size);
 
         if (m_diag)
             m_diag->processModuleData(ei, mi, data, size);
 
         if (0 <= ei && ei < MaxVMEEvents && 0 <= mi && mi < MaxVMEModules)
-        {
-            UniqueLock guard(m_countersMutex);
             m_counters.moduleCounters[ei][mi]++;
-        }
 
         if (m_state == WorkerState::SingleStepping)
         {
@@ -315,26 +310,27 @@ void MVLC_StreamWorker::setupParserCallbacks(
         }
     };
 
-    m_parserCallbacks.endEvent = [this, analysis](int ei)
+    m_parserCallbacks.endEvent = [this, analysis, pipeline](int ei) mutable
     {
         //qDebug() << "endEvent" << ei;
-        analysis->endEvent(ei);
-
-        for (auto c: m_moduleConsumers)
-        {
-            c->endEvent(ei);
-        }
+        pipeline.endEvent(ei);
 
         if (m_diag)
             m_diag->endEvent(ei);
 
         if (0 <= ei && ei < MaxVMEEvents)
         {
-            UniqueLock guard(m_countersMutex);
             m_counters.totalEvents++;
             m_counters.eventCounters[ei]++;
         }
 
+        // Make the histograms and counters reflect the stepped event.
+        if (m_state == WorkerState::SingleStepping)
+        {
+            analysis->syncHistograms();
+            publishCounters();
+        }
+
         this->publishStateIfSingleStepping();
     };
 
@@ -361,6 +357,43 @@ void MVLC_StreamWorker::setupParserCallbacks(
             c->processTimetick();
         }
     };
+}
+
+void MVLC_StreamWorker::setupParserCallbacks(
+    const RunInfo &runInfo,
+    const VMEConfig *vmeConfig,
+    analysis::Analysis *analysis)
+{
+    using namespace ::mvme::consumer_pipeline;
+
+    AnalysisStage analysisStage{ analysis };
+
+    // Pick a statically composed pipeline for the common consumer setups.
+    // Everything else goes through the list of attached consumers.
+    if (m_staticConsumerDispatch && m_moduleConsumers.isEmpty())
+    {
+        logInfo("consumer dispatch: static (analysis)");
+        installParserCallbacks(make_pipeline(analysisStage), runInfo, analysis);
+    }
+    else if (m_staticConsumerDispatch && m_moduleConsumers.size() == 1
+             && typeid(*m_moduleConsumers[0]) == typeid(EventServer))
+    {
+        logInfo("consumer dispatch: static (analysis, EventServer)");
+
+        StaticConsumerStage<EventServer> serverStage{
+            static_cast<EventServer *>(m_moduleConsumers[0]) };
+
+        installParserCallbacks(make_pipeline(analysisStage, serverStage), runInfo, analysis);
+    }
+    else
+    {
+        logInfo(QSL("consumer dispatch: dynamic (analysis, %1 consumers)")
+                .arg(m_moduleConsumers.size()));
+
+        DynamicConsumerStage consumerStage{ &m_moduleConsumers };
+
+        installParserCallbacks(make_pipeline(analysisStage, consumerStage), runInfo, analysis);
+    }
 
     const auto eventConfigs = vmeConfig->getEventConfigs();
 
@@ -459,11 +492,9 @@ void MVLC_StreamWorker::start()
     const auto vmeConfig = m_context->getVMEConfig();
     auto analysis = m_context->getAnalysis();
 
-    {
-        UniqueLock guard(m_countersMutex);
-        m_counters = {};
-        m_counters.startTime = QDateTime::currentDateTime();
-    }
+    m_counters = {};
+    m_counters.startTime = QDateTime::currentDateTime();
+    publishCounters();
 
     fillModuleIndexMaps(vmeConfig);
     setupParserCallbacks(runInfo, vmeConfig, analysis);
@@ -522,6 +553,82 @@ void MVLC_StreamWorker::start()
         c->beginRun(runInfo, vmeConfig, analysis);
     }
 
+    std::unique_ptr<MVLCParallelReplay> parallelReplay;
+
+    if (runInfo.isReplay && analysis->useParallelReplay())
+        parallelReplay = makeParallelReplay(vmeConfig, analysis);
+
+    auto process_buffer = [&] (const MVLCBufferView &buffer)
+    {
+        if (parallelReplay)
+            processBufferParallel(buffer, *parallelReplay, analysis);
+        else
+            processBuffer(buffer, vmeConfig, analysis);
+    };
+
+    // Input comes either from the snoop queues or, for replays from flat
+    // listfiles, directly from the memory mapped file. The mapping is kept
+    // alive until the end of the run.
+    auto mappedReplay = std::move(m_mappedReplay);
+
+    if (!runInfo.isReplay)
+        mappedReplay = {};
+
+    auto &filled = m_snoopQueues.filledBufferQueue();
+    auto &empty = m_snoopQueues.emptyBufferQueue();
+
+    enum class Input
+    {
+        None,
+        Processed,
+        EndOfData,
+    };
+
+    auto process_next = [&] (const std::chrono::milliseconds &timeout)
+    {
+        if (mappedReplay)
+        {
+            MVLCBufferView view;
+
+            if (!mappedReplay->views.dequeue(view, timeout))
+                return Input::None;
+
+            if (!view.data) // sentinel
+                return Input::EndOfData;
+
+            process_buffer(view);
+
+            auto viewEnd = reinterpret_cast<const u8 *>(view.data + view.size);
+            mappedReplay->file.release(viewEnd - mappedReplay->file.data());
+        }
+        else
+        {
+            auto buffer = (timeout.count() > 0
+                           ? filled.dequeue(timeout)
+                           : filled.dequeue());
+
+            if (!buffer)
+                return Input::None;
+
+            if (buffer->empty()) // sentinel
+                return Input::EndOfData;
+
+            try
+            {
+                process_buffer(make_buffer_view(buffer));
+                empty.enqueue(buffer);
+            }
+            catch (...)
+            {
+                empty.enqueue(buffer);
+                throw;
+            }
+        }
+
+        m_parserCountersSnapshot.access().ref() = m_parserCounters;
+        return Input::Processed;
+    };
+
     // Notify the world that we're up and running.
     setState(WorkerState::Running);
 
@@ -531,9 +638,6 @@ void MVLC_StreamWorker::start()
 
     TimetickGenerator timetickGen;
 
-    auto &filled = m_snoopQueues.filledBufferQueue();
-    auto &empty = m_snoopQueues.emptyBufferQueue();
-
     while (true)
     {
         WorkerState state = {};
@@ -550,24 +654,8 @@ void MVLC_StreamWorker::start()
                    || desiredState == WorkerState::Paused
                    || desiredState == WorkerState::SingleStepping))
         {
-            auto buffer = filled.dequeue(std::chrono::milliseconds(100));
-
-            if (buffer && buffer->empty()) // sentinel
+            if (process_next(std::chrono::milliseconds(100)) == Input::EndOfData)
                 break;
-            else if (buffer)
-            {
-                try
-                {
-                    processBuffer(buffer, vmeConfig, analysis);
-                    empty.enqueue(buffer);
-                    m_parserCountersSnapshot.access().ref() = m_parserCounters;
-                }
-                catch (...)
-                {
-                    empty.enqueue(buffer);
-                    throw;
-                }
-            }
         }
         // stopping
         else if (desiredState == WorkerState::Idle)
@@ -575,9 +663,10 @@ void MVLC_StreamWorker::start()
             if (m_stopFlag == StopImmediately)
             {
                 qDebug() << __PRETTY_FUNCTION__ << "immediate stop, buffers left in queue:" <<
-                    filled.size();
+                    (mappedReplay ? mappedReplay->views.size() : filled.size());
 
-                // Move the remaining buffers to the empty queue.
+                // Move the remaining buffers to the empty queue. Views of a
+                // mapped replay do not need to be returned.
                 while (auto buffer = filled.dequeue())
                     empty.enqueue(buffer);
 
@@ -585,21 +674,7 @@ void MVLC_StreamWorker::start()
             }
 
             // The StopWhenQueueEmpty case
-            if (auto buffer = filled.dequeue())
-            {
-                try
-                {
-                    processBuffer(buffer, vmeConfig, analysis);
-                    empty.enqueue(buffer);
-                    m_parserCountersSnapshot.access().ref() = m_parserCounters;
-                }
-                catch (...)
-                {
-                    empty.enqueue(buffer);
-                    throw;
-                }
-            }
-            else
+            if (process_next(std::chrono::milliseconds(0)) != Input::Processed)
                 break;
         }
         else
@@ -628,6 +703,13 @@ void MVLC_StreamWorker::start()
         }
     }
 
+    if (parallelReplay)
+    {
+        finishParallelRound(*parallelReplay, analysis);
+        m_parserCountersSnapshot.access().ref() = m_parserCounters;
+        parallelReplay = {};
+    }
+
     for (auto c: m_moduleConsumers)
     {
         c->endRun(m_context->getDAQStats());
@@ -635,10 +717,8 @@ void MVLC_StreamWorker::start()
 
     analysis->endRun();
 
-    {
-        UniqueLock guard(m_countersMutex);
-        m_counters.stopTime = QDateTime::currentDateTime();
-    }
+    m_counters.stopTime = QDateTime::currentDateTime();
+    publishCounters();
 
     // analysis session auto save
     auto sessionPath = m_context->getWorkspacePath(QSL("SessionDirectory"));
@@ -715,7 +795,7 @@ void MVLC_StreamWorker::publishStateIfSingleStepping()
 }
 
 void MVLC_StreamWorker::processBuffer(
-    const mesytec::mvlc::ReadoutBuffer *buffer,
+    const MVLCBufferView &buffer,
     const VMEConfig *vmeConfig,
     const analysis::Analysis *analysis)
 {
@@ -737,18 +817,16 @@ void MVLC_StreamWorker::processBuffer(
     bool processingOk = false;
     bool exceptionSeen = false;
 
-    auto bufferView = buffer->viewU32();
-
     try
     {
         ParseResult pr = readout_parser::parse_readout_buffer(
-            buffer->type(),
+            buffer.type,
             m_parser,
             m_parserCallbacks,
             m_parserCounters,
-            buffer->bufferNumber(),
-            bufferView.data(),
-            bufferView.size());
+            buffer.bufferNumber,
+            buffer.data,
+            buffer.size);
 
         if (pr == ParseResult::Ok)
         {
@@ -763,7 +841,7 @@ void MVLC_StreamWorker::processBuffer(
     {
         logWarn(QSL("end_of_buffer (%1) when parsing buffer #%2")
                 .arg(e.what())
-                .arg(buffer->bufferNumber()),
+                .arg(buffer.bufferNumber),
                 true);
         exceptionSeen = true;
     }
@@ -771,14 +849,14 @@ void MVLC_StreamWorker::processBuffer(
     {
         logWarn(QSL("exception (%1) when parsing buffer #%2")
                 .arg(e.what())
-                .arg(buffer->bufferNumber()),
+                .arg(buffer.bufferNumber),
                 true);
         exceptionSeen = true;
     }
     catch (...)
     {
         logWarn(QSL("unknown exception when parsing buffer #%1")
-                .arg(buffer->bufferNumber()),
+                .arg(buffer.bufferNumber),
                 true);
         exceptionSeen = true;
     }
@@ -791,16 +869,16 @@ void MVLC_StreamWorker::processBuffer(
     {
         m_debugInfoRequest = DebugInfoRequest::None;
 
-        DataBuffer bufferCopy(bufferView.size() * sizeof(u32));
+        DataBuffer bufferCopy(buffer.size * sizeof(u32));
 
-        std::copy(std::begin(bufferView), std::end(bufferView),
+        std::copy(buffer.data, buffer.data + buffer.size,
                   bufferCopy.asU32());
 
-        bufferCopy.used = bufferView.size() * sizeof(u32);
-        bufferCopy.tag = static_cast<int>(buffer->type() == ConnectionType::ETH
+        bufferCopy.used = buffer.size * sizeof(u32);
+        bufferCopy.tag = static_cast<int>(buffer.type == ConnectionType::ETH
                                           ? ListfileBufferFormat::MVLC_ETH
                                           : ListfileBufferFormat::MVLC_USB);
-        bufferCopy.id = buffer->bufferNumber();
+        bufferCopy.id = buffer.bufferNumber;
 
         emit debugInfoReady(
             bufferCopy,
@@ -810,15 +888,94 @@ void MVLC_StreamWorker::processBuffer(
             analysis);
     }
 
+    m_counters.bytesProcessed += buffer.size * sizeof(u32);
+    m_counters.buffersProcessed++;
+
+    if (!processingOk)
+        m_counters.buffersWithErrors++;
+
+    publishCounters();
+}
+
+std::unique_ptr<MVLCParallelReplay> MVLC_StreamWorker::makeParallelReplay(
+    const VMEConfig *vmeConfig,
+    analysis::Analysis *analysis)
+{
+    const int workerCount = analysis->getA2WorkerCount();
+
+    if (workerCount <= 1)
     {
-        UniqueLock guard(m_countersMutex);
-        m_counters.bytesProcessed += buffer->used();
-        m_counters.buffersProcessed++;
-        if (!processingOk)
-        {
-            m_counters.buffersWithErrors++;
-        }
+        logInfo("parallel replay: requires more than one worker thread,"
+                " using sequential processing");
+        return {};
+    }
+
+    if (uses_multi_event_splitting(*vmeConfig, *analysis))
+    {
+        logInfo("parallel replay: not supported with multi event splitting,"
+                " using sequential processing");
+        return {};
+    }
+
+    auto logger = [this] (const QString &msg) { logInfo(msg); };
+    auto workers = analysis->takeA2ChunkWorkers(workerCount, logger);
+
+    if (workers.empty())
+    {
+        logInfo("parallel replay: analysis contains operators depending on the"
+                " event order, using sequential processing");
+        return {};
+    }
+
+    return std::make_unique<MVLCParallelReplay>(workers, m_parser, m_eventModuleIndexMaps);
+}
+
+void MVLC_StreamWorker::processBufferParallel(
+    const MVLCBufferView &buffer,
+    MVLCParallelReplay &replay,
+    analysis::Analysis *analysis)
+{
+    m_counters.bytesProcessed += buffer.size * sizeof(u32);
+    m_counters.buffersProcessed++;
+
+    if (replay.addBuffer(buffer))
+        finishParallelRound(replay, analysis);
+}
+
+void MVLC_StreamWorker::finishParallelRound(
+    MVLCParallelReplay &replay,
+    analysis::Analysis *analysis)
+{
+    auto result = replay.finishRound();
+
+    m_counters.totalEvents += result.counters.totalEvents;
+    m_counters.buffersWithErrors += result.counters.buffersWithErrors;
+
+    for (int ei = 0; ei < MaxVMEEvents; ei++)
+    {
+        m_counters.eventCounters[ei] += result.counters.eventCounters[ei];
+
+        for (int mi = 0; mi < MaxVMEModules; mi++)
+            m_counters.moduleCounters[ei][mi] += result.counters.moduleCounters[ei][mi];
+    }
+
+    add_parser_counters(m_parserCounters, result.parserCounters);
+
+    // All chunk workers are idle now. Make their results visible.
+    analysis->syncHistograms();
+
+    for (u32 i = 0; i < result.timeticks; i++)
+    {
+        analysis->processTimetick();
+
+        for (auto c: m_moduleConsumers)
+            c->processTimetick();
     }
+
+    publishCounters();
+
+    // Pausing takes effect between rounds.
+    blockIfPaused();
 }
 
 void MVLC_StreamWorker::stop(bool whenQueueEmpty)
@@ -33,6 +33,9 @@
 #include "mvlc/readout_parser_support.h"
 
 class MVMEContext;
+class MVLCParallelReplay;
+struct MVLCBufferView;
+struct MVLCMappedReplay;
 
 struct EventRecord
 {
@@ -112,8 +115,7 @@ class MVLC_StreamWorker: public StreamWorkerBase
 
         virtual MVMEStreamProcessorCounters getCounters() const override
         {
-            mesytec::mvlc::UniqueLock guard(m_countersMutex);
-            return m_counters;
+            return m_countersSnapshot.copy();
         }
 
         mesytec::mvlc::readout_parser::ReadoutParserCounters getReadoutParserCounters() const
@@ -124,6 +126,22 @@ class MVLC_StreamWorker: public StreamWorkerBase
         void setDiagnostics(std::shared_ptr<MesytecDiagnostics> diag) { m_diag = diag; }
         bool hasDiagnostics() const { return m_diag != nullptr; }
 
+        // If enabled (the default) the common consumer setups (analysis only,
+        // analysis + EventServer) are driven through a statically composed
+        // pipeline instead of virtual calls per module. Takes effect on the
+        // next start(). Disabling is meant for benchmarking.
+        void setStaticConsumerDispatch(bool b) { m_staticConsumerDispatch = b; }
+        bool hasStaticConsumerDispatch() const { return m_staticConsumerDispatch; }
+
+        // Makes the next start() read its input from the views of the given
+        // memory mapped replay instead of the snoop queues. Must be called
+        // before start() is invoked. The replay is reset at the end of the
+        // run. See mvlc_mapped_replay.h.
+        void setMappedReplay(const std::shared_ptr<MVLCMappedReplay> &replay)
+        {
+            m_mappedReplay = replay;
+        }
+
     public slots:
         void startupConsumers() override;
         void shutdownConsumers() override;
@@ -180,27 +198,56 @@ class MVLC_StreamWorker: public StreamWorkerBase
             const VMEConfig *vmeConfig,
             analysis::Analysis *analysis);
 
+        template<typename Pipeline>
+        void installParserCallbacks(
+            Pipeline pipeline,
+            const RunInfo &runInfo,
+            analysis::Analysis *analysis);
+
         void processBuffer(
-            const mesytec::mvlc::ReadoutBuffer *buffer,
+            const MVLCBufferView &buffer,
             const VMEConfig *vmeConfig,
             const analysis::Analysis *analysis
             );
 
+        // Chunked parallel replay processing. See mvlc_parallel_replay.h.
+        std::unique_ptr<MVLCParallelReplay> makeParallelReplay(
+            const VMEConfig *vmeConfig,
+            analysis::Analysis *analysis);
+
+        void processBufferParallel(
+            const MVLCBufferView &buffer,
+            MVLCParallelReplay &replay,
+            analysis::Analysis *analysis);
+
+        void finishParallelRound(
+            MVLCParallelReplay &replay,
+            analysis::Analysis *analysis);
+
         void blockIfPaused();
         void publishStateIfSingleStepping();
 
         void logParserInfo(const mesytec::mvlc::readout_parser::ReadoutParserState &parser);
 
+        void publishCounters()
+        {
+            m_countersSnapshot.access().ref() = m_counters;
+        }
+
         MVMEContext *m_context = nullptr;
 
         QVector<IMVMEStreamModuleConsumer *> m_moduleConsumers;
 
-        mutable mesytec::mvlc::TicketMutex m_countersMutex;
+        // Counters updated by the parser callbacks. Only accessed from the
+        // worker thread so no locking is needed. Copied to the snapshot once
+        // per buffer (and per event when single stepping) for getCounters().
         MVMEStreamProcessorCounters m_counters = {};
+        mutable mesytec::mvlc::Protected<MVMEStreamProcessorCounters> m_countersSnapshot;
 
         // Per event mappings of readout_parser -> mvme module indexes.
         std::array<ModuleIndexMap, MaxVMEEvents> m_eventModuleIndexMaps;
         mesytec::mvlc::ReadoutBufferQueues &m_snoopQueues;
+        std::shared_ptr<MVLCMappedReplay> m_mappedReplay;
         mesytec::mvlc::readout_parser::ReadoutParserCallbacks m_parserCallbacks;
         mesytec::mvlc::readout_parser::ReadoutParserState m_parser;
         mesytec::mvlc::readout_parser::ReadoutParserCounters m_parserCounters;
@@ -217,6 +264,7 @@ class MVLC_StreamWorker: public StreamWorkerBase
         std::atomic<MVMEStreamWorkerState> m_desiredState;
 
         std::atomic<bool> m_startPaused;
+        std::atomic<bool> m_staticConsumerDispatch;
         std::atomic<StopFlag> m_stopFlag;
 
         std::atomic<DebugInfoRequest> m_debugInfoRequest;
@@ -494,6 +494,9 @@ MVMEMainWindow::MVMEMainWindow(QWidget *parent)
         connect(dcw, &DAQControlWidget::listFileOutputInfoModified,
                 m_d->m_context, &MVMEContext::setListFileOutputInfo);
 
+        connect(dcw, &DAQControlWidget::replayRangeModified,
+                m_d->m_context, &MVMEContext::setReplayRange);
+
         connect(dcw, &DAQControlWidget::sniffNextInputBuffer,
                 m_d->m_context, &MVMEContext::sniffNextInputBuffer);
 
@@ -1378,7 +1381,7 @@ void MVMEMainWindow::onActionOpenListfile_triggered()
 
     static const QStringList filters =
     {
-        "MVME Listfiles (*.mvmelst *.zip)",
+        "MVME Listfiles (*.mvmelst *.mvlclst *.zip)",
         "All Files (*.*)"
     };
 
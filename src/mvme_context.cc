@@ -181,6 +181,7 @@ struct MVMEContextPrivate
 
     ListfileReplayHandle listfileReplayHandle;
     std::unique_ptr<ListfileReplayWorker> listfileReplayWorker;
+    ReplayRange replayRange;
     mesytec::mvlc::ReadoutBufferQueues mvlcSnoopQueues;
     mutable mesytec::mvlc::Protected<QString> runNotes;
 
@@ -475,6 +476,7 @@ static void writeToSettings(const ListFileOutputInfo &info, QSettings &settings)
     if (!info.directory.isEmpty())
         settings.setValue(QSL("ListFileDirectory"),         info.directory);
     settings.setValue(QSL("ListFileCompressionLevel"),  info.compressionLevel);
+    settings.setValue(QSL("ListFileCompressionThreads"), info.compressionThreads);
     settings.setValue(QSL("ListFilePrefix"),            info.prefix);
     settings.setValue(QSL("ListFileRunNumber"),         info.runNumber);
     settings.setValue(QSL("ListFileOutputFlags"),       info.flags);
@@ -489,6 +491,7 @@ static ListFileOutputInfo readFromSettings(QSettings &settings)
         result.format = ListFileFormat::ZIP;
     result.directory        = settings.value(QSL("ListFileDirectory"), QSL("listfiles")).toString();
     result.compressionLevel = settings.value(QSL("ListFileCompressionLevel"), DefaultListFileCompression).toInt();
+    result.compressionThreads = settings.value(QSL("ListFileCompressionThreads"), 0u).toUInt();
     result.prefix           = settings.value(QSL("ListFilePrefix"), QSL("mvmelst")).toString();
     result.runNumber        = settings.value(QSL("ListFileRunNumber"), 1u).toUInt();
     result.flags            = settings.value(QSL("ListFileOutputFlags"), ListFileOutputInfo::UseRunNumber).toUInt();
@@ -620,8 +623,11 @@ MVMEContext::~MVMEContext()
     delete m_readoutWorker;
 
     Q_ASSERT(queue_size(&m_freeBuffers) + queue_size(&m_fullBuffers) == ReadoutBufferCount);
-    qDeleteAll(m_freeBuffers.queue);
-    qDeleteAll(m_fullBuffers.queue);
+    while (auto buffer = dequeue(&m_freeBuffers))
+        delete buffer;
+
+    while (auto buffer = dequeue(&m_fullBuffers))
+        delete buffer;
 
     m_d->workspaceClosingCleanup();
 
@@ -697,6 +703,18 @@ static std::tuple<bool, QHostInfo, int> get_event_server_listen_info(const QSett
     return std::make_tuple(true, QHostInfo::fromName("127.0.0.1"), port);
 }
 
+static void apply_event_server_queue_settings(EventServer *eventServer,
+                                              const QSettings &workspaceSettings)
+{
+    eventServer->setOverflowPolicy(overflow_policy_from_string(
+            workspaceSettings.value(QSL("EventServer/OverflowPolicy")).toString()));
+
+    auto capacity = workspaceSettings.value(QSL("EventServer/QueueCapacity")).toUInt();
+
+    if (capacity > 0)
+        eventServer->setQueueCapacity(capacity);
+}
+
 bool MVMEContext::setVMEController(VMEController *controller, const QVariantMap &settings)
 {
     //qDebug() << __PRETTY_FUNCTION__ << "begin";
@@ -868,7 +886,10 @@ bool MVMEContext::setVMEController(VMEController *controller, const QVariantMap
         int port = 0;
 
         if (settings)
+        {
             std::tie(enabled, hostInfo, port) = get_event_server_listen_info(*settings);
+            apply_event_server_queue_settings(eventServer, *settings);
+        }
 
         if (enabled && (hostInfo.error() || hostInfo.addresses().isEmpty()))
         {
@@ -1775,6 +1796,7 @@ void MVMEContext::startDAQReplay(quint32 nEvents, bool keepHistoContents)
     m_d->m_runInfo.infoDict["replaySourceFile"] = fi.fileName();
 
     m_d->listfileReplayWorker->setEventsToRead(nEvents);
+    m_d->listfileReplayWorker->setReplayRange(m_d->replayRange);
 
     if (auto mvmeStreamWorker = qobject_cast<MVMEStreamWorker *>(m_streamWorker.get()))
     {
@@ -1783,6 +1805,14 @@ void MVMEContext::startDAQReplay(quint32 nEvents, bool keepHistoContents)
         mvmeStreamWorker->setListFileVersion(lf.getFileVersion());
     }
 
+    // Flat MVLC listfiles are replayed from a memory mapping shared by the
+    // listfile worker and the stream worker.
+    if (auto mvlcListfileWorker = qobject_cast<MVLCListfileWorker *>(m_d->listfileReplayWorker.get()))
+    {
+        if (auto mvlcStreamWorker = qobject_cast<MVLC_StreamWorker *>(m_streamWorker.get()))
+            mvlcStreamWorker->setMappedReplay(mvlcListfileWorker->prepareMappedReplay());
+    }
+
     if (!prepareStart())
     {
         logMessage("Failed to start stream worker (analysis side). Aborting startup");
@@ -2100,6 +2130,9 @@ void MVMEContext::newWorkspace(const QString &dirName)
     workspaceSettings->setValue(QSL("EventServer/Enabled"), false);
     workspaceSettings->setValue(QSL("EventServer/ListenAddress"), QString());
     workspaceSettings->setValue(QSL("EventServer/ListenPort"), EventServer_DefaultListenPort);
+    workspaceSettings->setValue(QSL("EventServer/OverflowPolicy"), QSL("block"));
+    workspaceSettings->setValue(QSL("EventServer/QueueCapacity"),
+                                static_cast<uint>(EventServer::Default_QueueCapacity));
 
 
     // Force sync to create the mvmeworkspace.ini file
@@ -2207,6 +2240,9 @@ void MVMEContext::openWorkspace(const QString &dirName)
         set_default(QSL("EventServer/Enabled"), false);
         set_default(QSL("EventServer/ListenAddress"), QString());
         set_default(QSL("EventServer/ListenPort"), EventServer_DefaultListenPort);
+        set_default(QSL("EventServer/OverflowPolicy"), QSL("block"));
+        set_default(QSL("EventServer/QueueCapacity"),
+                    static_cast<uint>(EventServer::Default_QueueCapacity));
         set_default(QSL("Logs/RunLogsMaxCount"), Default_RunLogsMaxCount);
 
         // listfile subdir
@@ -2678,6 +2714,7 @@ void MVMEContext::reapplyWorkspaceSettings()
         int port;
 
         std::tie(enabled, hostInfo, port) = get_event_server_listen_info(*settings);
+        apply_event_server_queue_settings(m_d->m_eventServer, *settings);
 
         if (enabled && (hostInfo.error() || hostInfo.addresses().isEmpty()))
         {
@@ -2904,6 +2941,21 @@ void MVMEContext::setListFileOutputInfo(const ListFileOutputInfo &info)
     emit ListFileOutputInfoChanged(info);
 }
 
+void MVMEContext::setReplayRange(const ReplayRange &range)
+{
+    m_d->replayRange = range;
+}
+
+ReplayRange MVMEContext::getReplayRange() const
+{
+    return m_d->replayRange;
+}
+
+EventServer *MVMEContext::getEventServer() const
+{
+    return m_d->m_eventServer;
+}
+
 ListFileOutputInfo MVMEContext::getListFileOutputInfo() const
 {
     // Tracing an issue on exit where m_d has already been destroyed but
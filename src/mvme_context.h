@@ -46,6 +46,7 @@
 #include <QSettings>
 #include <QWidget>
 
+class EventServer;
 class MVMEMainWindow;
 class ListFile;
 class QJsonObject;
@@ -284,6 +285,12 @@ class LIBMVME_EXPORT MVMEContext: public QObject
         void setListFileOutputInfo(const ListFileOutputInfo &info);
         ListFileOutputInfo getListFileOutputInfo() const;
 
+        // listfile replay range
+        void setReplayRange(const ReplayRange &range);
+        ReplayRange getReplayRange() const;
+
+        // The EventServer instance attached to the current stream worker.
+        EventServer *getEventServer() const;
 
         bool isWorkspaceModified() const;
 
@@ -315,6 +315,22 @@ bool ListFile::seekToFirstSection()
     return seek(offset);
 }
 
+bool ListFile::seekToSection(qint64 offset)
+{
+    return seek(offset);
+}
+
+bool ListFile::isReadLimitReached() const
+{
+    if (m_readLimit < 0)
+        return false;
+
+    // A saved section header has already been read from the input.
+    qint64 sectionStart = m_input->pos() - (m_sectionHeaderBuffer ? qint64(sizeof(u32)) : 0);
+
+    return sectionStart >= m_readLimit;
+}
+
 bool ListFile::seek(qint64 pos)
 {
     qDebug() << m_input << getFileName() << m_input->isOpen();
@@ -365,11 +381,16 @@ bool ListFile::readNextSection(DataBuffer *buffer)
 {
     const auto &lfc = listfile_constants(m_fileVersion);
 
+    if (isReadLimitReached())
+        return false;
+
     return read_next_section(*m_input, buffer, &m_sectionHeaderBuffer, lfc);
 }
 
+// Stops before the first section starting at or after readLimit if readLimit
+// is not negative.
 s32 read_sections_into_buffer(QIODevice &m_file, DataBuffer *buffer, u32 *savedSectionHeader,
-                              const ListfileConstants &lfc)
+                              const ListfileConstants &lfc, qint64 readLimit = -1)
 {
     Q_ASSERT(savedSectionHeader);
 
@@ -383,6 +404,12 @@ s32 read_sections_into_buffer(QIODevice &m_file, DataBuffer *buffer, u32 *savedS
     {
         u32 sectionHeader = *savedSectionHeader;
 
+        if (readLimit >= 0
+            && m_file.pos() - (sectionHeader ? qint64(sizeof(u32)) : 0) >= readLimit)
+        {
+            break;
+        }
+
         if (sectionHeader == 0)
         {
             // If 0 was passed in there was no previous section header so we have to read one.
@@ -444,7 +471,7 @@ s32 ListFile::readSectionsIntoBuffer(DataBuffer *buffer)
 {
     const auto &lfc = listfile_constants(m_fileVersion);
 
-    return read_sections_into_buffer(*m_input, buffer, &m_sectionHeaderBuffer, lfc);
+    return read_sections_into_buffer(*m_input, buffer, &m_sectionHeaderBuffer, lfc, m_readLimit);
 }
 
 //
@@ -643,9 +670,13 @@ bool ListFileWriter::writePauseSection(ListfileSections::PauseAction pauseAction
     if (m_out->write((const char *)&header, sizeof(header)) != sizeof(header))
         return false;
 
+    m_bytesWritten += sizeof(header);
+
     if (m_out->write((const char *)&content, sizeof(content)) != sizeof(content))
         return false;
 
+    m_bytesWritten += sizeof(content);
+
     return true;
 }
 
@@ -62,18 +62,29 @@ class LIBMVME_EXPORT ListFile
         QString getFullName() const; // filename or zipname:/filename
         u32 getFileVersion() const { return m_fileVersion; }
 
+        // Continues reading at the given offset which has to be the start of
+        // a section, e.g. a ListfileIndex checkpoint. Slow for ZIP archives
+        // as the data before offset has to be decompressed.
+        bool seekToSection(qint64 offset);
+
+        // Reading stops at the first section starting at or after offset.
+        // Negative values disable the limit.
+        void setReadLimit(qint64 offset) { m_readLimit = offset; }
+
         // Will be empty vector for version 0 or contain "MVME<version>" with
         // version being an u32.
         QVector<u8> getPreambleBuffer() const { return m_preambleBuffer; }
 
     private:
         bool seek(qint64 pos);
+        bool isReadLimitReached() const;
 
         QIODevice *m_input = nullptr;
         QJsonObject m_configJson;
         u32 m_fileVersion = 0;
         u32 m_sectionHeaderBuffer = 0;
         QVector<u8> m_preambleBuffer;
+        qint64 m_readLimit = -1;
 };
 
 
@@ -42,6 +42,7 @@ MVMEListfileWorker::~MVMEListfileWorker()
 
 void MVMEListfileWorker::setListfile(ListfileReplayHandle *handle)
 {
+    m_replayHandle = handle;
     m_listfile = ListFile(handle->listfile.get());
     m_stats.listFileTotalBytes = m_listfile.size();
     m_stats.listfileFilename = m_listfile.getFileName();
@@ -65,6 +66,7 @@ void MVMEListfileWorker::start()
 
     m_listfile.open();
     m_listfile.seekToFirstSection();
+    applyReplayRange();
     m_bytesRead = 0;
     m_totalBytes = m_listfile.size();
     m_stats.start();
@@ -90,6 +92,39 @@ void MVMEListfileWorker::resume()
     m_desiredState = DAQState::Running;
 }
 
+void MVMEListfileWorker::applyReplayRange()
+{
+    const auto range = getReplayRange();
+
+    m_listfile.setReadLimit(-1);
+
+    if (range.isFullRange())
+        return;
+
+    const auto &index = m_replayHandle->index;
+
+    if (!index.isValid())
+    {
+        logMessage(QSL("Listfile has no index, replaying the full listfile instead of %1.")
+                   .arg(to_string(range)));
+        return;
+    }
+
+    auto byteRange = resolve_replay_range(index, range);
+
+    logMessage(QSL("Replaying %1 (listfile bytes %2 to %3)")
+               .arg(to_string(range))
+               .arg(byteRange.begin)
+               .arg(byteRange.end == ReplayRange::Unlimited
+                    ? QSL("end") : QString::number(byteRange.end)));
+
+    if (byteRange.begin > 0)
+        m_listfile.seekToSection(byteRange.begin);
+
+    if (byteRange.end != ReplayRange::Unlimited)
+        m_listfile.setReadLimit(byteRange.end);
+}
+
 static const u32 FreeBufferWaitTimeout_ms = 250;
 static const double PauseSleep_ms = 250;
 
@@ -123,21 +158,12 @@ void MVMEListfileWorker::mainLoop()
         // stay in running state
         else if (m_state == DAQState::Running)
         {
-            DataBuffer *buffer = nullptr;
+            DataBuffer *buffer = dequeue(getEmptyQueue());
 
+            while (!buffer && m_desiredState == DAQState::Running)
             {
-                QMutexLocker lock(&getEmptyQueue()->mutex);
-                while (getEmptyQueue()->queue.isEmpty() && m_desiredState == DAQState::Running)
-                {
-                    getEmptyQueue()->wc.wait(&getEmptyQueue()->mutex, FreeBufferWaitTimeout_ms);
-                }
-
-                if (!getEmptyQueue()->queue.isEmpty())
-                {
-                    buffer = getEmptyQueue()->queue.dequeue();
-                }
+                buffer = dequeue(getEmptyQueue(), FreeBufferWaitTimeout_ms);
             }
-            // The mutex is unlocked again at this point
 
             if (buffer)
             {
@@ -213,10 +239,8 @@ void MVMEListfileWorker::mainLoop()
                 if (!isBufferValid)
                 {
                     // Reading did not succeed. Put the previously acquired buffer
-                    // back into the free queue. No need to notfiy the wait
-                    // condition as there's no one else waiting on it.
-                    QMutexLocker lock(&getEmptyQueue()->mutex);
-                    getEmptyQueue()->queue.enqueue(buffer);
+                    // back into the free queue.
+                    enqueue(getEmptyQueue(), buffer);
 
                     setState(DAQState::Stopping);
                 }
@@ -230,10 +254,7 @@ void MVMEListfileWorker::mainLoop()
                         logMessage("<<< End buffer");
                     }
                     // Push the valid buffer onto the output queue.
-                    getFilledQueue()->mutex.lock();
-                    getFilledQueue()->queue.enqueue(buffer);
-                    getFilledQueue()->mutex.unlock();
-                    getFilledQueue()->wc.wakeOne();
+                    enqueue_and_wakeOne(getFilledQueue(), buffer);
                 }
             }
         }
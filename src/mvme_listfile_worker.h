@@ -57,6 +57,7 @@ class LIBMVME_EXPORT MVMEListfileWorker: public ListfileReplayWorker
     private:
         void mainLoop();
         void setState(DAQState state);
+        void applyReplayRange();
 
         DAQStats m_stats;
 
@@ -64,6 +65,7 @@ class LIBMVME_EXPORT MVMEListfileWorker: public ListfileReplayWorker
         std::atomic<DAQState> m_desiredState;
 
         ListFile m_listfile;
+        ListfileReplayHandle *m_replayHandle = nullptr;
 
         qint64 m_bytesRead = 0;
         qint64 m_totalBytes = 0;
@@ -87,26 +87,17 @@ struct MVMEStreamWorkerPrivate
 
 DataBuffer *MVMEStreamWorkerPrivate::dequeueNextBuffer()
 {
-    DataBuffer *buffer = nullptr;
+    DataBuffer *buffer = dequeue(fullBuffers);
 
+    if (!buffer)
     {
-        QMutexLocker lock(&fullBuffers->mutex);
-
-        if (fullBuffers->queue.isEmpty())
+        if (internalState == StopIfQueueEmpty)
         {
-            if (internalState == StopIfQueueEmpty)
-            {
-                //internalState = StopImmediately;
-                return buffer;
-            }
-
-            fullBuffers->wc.wait(&fullBuffers->mutex, FilledBufferWaitTimeout_ms);
+            //internalState = StopImmediately;
+            return buffer;
         }
 
-        if (!fullBuffers->queue.isEmpty())
-        {
-            buffer = fullBuffers->queue.dequeue();
-        }
+        buffer = dequeue(fullBuffers, FilledBufferWaitTimeout_ms);
     }
 
     // Set increasing buffer number for MVMELST buffers only. MVLC buffers have
@@ -489,6 +480,9 @@ void MVMEStreamWorker::start()
                     {
                         single_step_one_event(singleStepProcState, m_d->streamProcessor);
 
+                        // Make the histograms reflect the stepped event.
+                        m_d->context->getAnalysis()->syncHistograms();
+
                         QString logBuffer;
                         QTextStream logStream(&logBuffer);
                         log_processing_step(logStream, singleStepProcState, vatsTemplates, lfc);
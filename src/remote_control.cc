@@ -20,6 +20,7 @@
  */
 #include "remote_control.h"
 
+#include "event_server/server/event_server.h"
 #include "git_sha1.h"
 #include "sis3153_readout_worker.h"
 
@@ -318,6 +319,22 @@ QVariantMap InfoService::getDAQStats()
     r["droppedBuffers"]         = u64_to_var(stats.droppedBuffers);
     r["listFileBytesWritten"]   = u64_to_var(stats.listFileBytesWritten);
     r["listFileFilename"]       = stats.listfileFilename;
+    r["listFileBytesCompressed"] = u64_to_var(stats.listFileBytesCompressed);
+    r["listFileCompressionRatio"] = stats.getListFileCompressionRatio();
+
+    QVariantList compressorThreads;
+
+    for (const auto &ts: stats.listFileCompressorThreads)
+    {
+        QVariantMap m;
+        m["bytesIn"]            = u64_to_var(ts.bytesIn);
+        m["bytesOut"]           = u64_to_var(ts.bytesOut);
+        m["busySeconds"]        = ts.busySeconds;
+        m["bytesPerSecond"]     = ts.getThroughput();
+        compressorThreads.push_back(m);
+    }
+
+    r["listFileCompressorThreads"] = compressorThreads;
     r["analyzedBuffers"]        = u64_to_var(stats.getAnalyzedBuffers());
     r["analysisEfficiency"]     = stats.getAnalysisEfficiency();
     r["runId"]                  = runInfo.runId;
@@ -425,6 +442,37 @@ QString InfoService::getVMEControllerState()
     return to_string(ctrl->getState());
 }
 
+QVariantMap InfoService::getEventServerStats()
+{
+    QVariantMap result;
+    auto eventServer = m_context->getEventServer();
+
+    result["listening"] = eventServer && eventServer->isListening();
+
+    if (!eventServer)
+        return result;
+
+    result["overflowPolicy"] = to_string(eventServer->getOverflowPolicy());
+
+    QVariantList clients;
+
+    for (const auto &counters: eventServer->getClientCounters())
+    {
+        QVariantMap m;
+        m["peerAddress"]        = counters.peerAddress;
+        m["bytesSent"]          = u64_to_var(counters.bytesSent);
+        m["messagesSent"]       = u64_to_var(counters.messagesSent);
+        m["messagesDropped"]    = u64_to_var(counters.messagesDropped);
+        m["queueDepth"]         = u64_to_var(counters.queueDepth);
+        m["queueCapacity"]      = u64_to_var(counters.queueCapacity);
+        clients.append(m);
+    }
+
+    result["clients"] = clients;
+
+    return result;
+}
+
 HostInfoWrapper::HostInfoWrapper(Callback callback, QObject *parent)
     : QObject(parent)
     , m_callback(callback)
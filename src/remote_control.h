@@ -93,6 +93,7 @@ class InfoService: public QObject
         QString getVMEControllerType();
         QVariantMap getVMEControllerStats();
         QString getVMEControllerState();
+        QVariantMap getEventServerStats();
 
     private:
         MVMEContext *m_context;
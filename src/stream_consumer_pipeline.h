@@ -0,0 +1,153 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef __MVME_STREAM_CONSUMER_PIPELINE_H__
+#define __MVME_STREAM_CONSUMER_PIPELINE_H__
+
+#include <QVector>
+
+#include "analysis/analysis.h"
+#include "stream_processor_module_consumer.h"
+#include "typedefs.h"
+
+namespace mvme
+{
+namespace consumer_pipeline
+{
+
+/*
+ * Statically composed fan-out of readout data to the analysis and the
+ * attached IMVMEStreamModuleConsumers.
+ *
+ * The stream workers used to loop over a list of IMVMEStreamModuleConsumer
+ * pointers for every module and every event. With a Pipeline the set of
+ * receivers is fixed at the start of a run and encoded in the type so that the
+ * per module calls are direct calls instead of virtual ones.
+ *
+ * Each stage implements beginEvent(), processModuleData() and endEvent().
+ * A Pipeline<A, B> calls stage A first, then stage B.
+ */
+
+// Drives the analysis. Analysis methods are not virtual.
+struct AnalysisStage
+{
+    analysis::Analysis *analysis;
+
+    void beginEvent(s32 ei) { analysis->beginEvent(ei); }
+    void endEvent(s32 ei) { analysis->endEvent(ei); }
+
+    void processModuleData(s32 ei, s32 mi, const u32 *data, u32 size)
+    {
+        analysis->processModuleData(ei, mi, data, size);
+    }
+};
+
+// Calls a consumer of known concrete type. The qualified calls bypass the
+// vtable. Only use this if the dynamic type of the consumer is exactly
+// Consumer, otherwise overrides in subclasses would be skipped.
+template<typename Consumer>
+struct StaticConsumerStage
+{
+    Consumer *consumer;
+
+    void beginEvent(s32 ei) { consumer->Consumer::beginEvent(ei); }
+    void endEvent(s32 ei) { consumer->Consumer::endEvent(ei); }
+
+    void processModuleData(s32 ei, s32 mi, const u32 *data, u32 size)
+    {
+        consumer->Consumer::processModuleData(ei, mi, data, size);
+    }
+};
+
+// Fallback for arbitrary consumer lists: virtual calls for each consumer.
+struct DynamicConsumerStage
+{
+    const QVector<IMVMEStreamModuleConsumer *> *consumers;
+
+    void beginEvent(s32 ei)
+    {
+        for (auto c: *consumers)
+            c->beginEvent(ei);
+    }
+
+    void endEvent(s32 ei)
+    {
+        for (auto c: *consumers)
+            c->endEvent(ei);
+    }
+
+    void processModuleData(s32 ei, s32 mi, const u32 *data, u32 size)
+    {
+        for (auto c: *consumers)
+            c->processModuleData(ei, mi, data, size);
+    }
+};
+
+template<typename... Stages>
+struct Pipeline;
+
+template<>
+struct Pipeline<>
+{
+    void beginEvent(s32) {}
+    void endEvent(s32) {}
+    void processModuleData(s32, s32, const u32 *, u32) {}
+};
+
+template<typename Head, typename... Tail>
+struct Pipeline<Head, Tail...>
+{
+    Head head;
+    Pipeline<Tail...> tail;
+
+    Pipeline(Head head_, Tail... tail_)
+        : head(head_)
+        , tail(tail_...)
+    {}
+
+    void beginEvent(s32 ei)
+    {
+        head.beginEvent(ei);
+        tail.beginEvent(ei);
+    }
+
+    void endEvent(s32 ei)
+    {
+        head.endEvent(ei);
+        tail.endEvent(ei);
+    }
+
+    void processModuleData(s32 ei, s32 mi, const u32 *data, u32 size)
+    {
+        head.processModuleData(ei, mi, data, size);
+        tail.processModuleData(ei, mi, data, size);
+    }
+};
+
+template<typename... Stages>
+Pipeline<Stages...> make_pipeline(Stages... stages)
+{
+    return Pipeline<Stages...>(stages...);
+}
+
+} // end namespace consumer_pipeline
+} // end namespace mvme
+
+#endif /* __MVME_STREAM_CONSUMER_PIPELINE_H__ */
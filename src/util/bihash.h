@@ -57,6 +57,15 @@ struct BiHash
         return reverse_hash.value(t2, t1);
     }
 
+    inline void remove(const T1 &t1)
+    {
+        if (hash.contains(t1))
+        {
+            reverse_hash.remove(hash.value(t1));
+            hash.remove(t1);
+        }
+    }
+
     inline void clear()
     {
         hash.clear();
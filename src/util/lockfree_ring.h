@@ -0,0 +1,362 @@
+/* mvme - Mesytec VME Data Acquisition
+ *
+ * Copyright (C) 2016-2020 mesytec GmbH & Co. KG <info@mesytec.com>
+ *
+ * Author: Florian Lüke <f.lueke@mesytec.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef __MVME_UTIL_LOCKFREE_RING_H__
+#define __MVME_UTIL_LOCKFREE_RING_H__
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace mesytec
+{
+namespace mvme
+{
+
+// Bounded lock-free ring buffer used to hand off objects (usually DataBuffer
+// pointers) between threads.
+//
+// The ring is designed for a single consumer. The producer side uses per slot
+// sequence numbers (see the mpmc_bounded_queue by Dmitry Vyukov) so that
+// multiple producers are safe. This is needed for the free buffer queue where
+// both the stream worker and the readout worker return buffers.
+//
+// Enqueue and dequeue operations do not take any locks. A mutex and condition
+// variable are only used if the consumer has to wait for the ring to become
+// non-empty or a producer has to wait for it to become non-full. The other
+// side only touches the mutex if it sees a registered waiter, so in the
+// common case no system calls are made.
+template<typename T>
+class LockFreeRing
+{
+    public:
+        static const size_t DefaultCapacity = 256;
+
+        // The capacity is rounded up to the next power of two.
+        explicit LockFreeRing(size_t capacity = DefaultCapacity)
+        {
+            size_t size = 2;
+
+            while (size < capacity)
+                size *= 2;
+
+            m_cells = std::make_unique<Cell[]>(size);
+            m_mask = size - 1;
+
+            for (size_t i = 0; i < size; i++)
+                m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        LockFreeRing(const LockFreeRing &) = delete;
+        LockFreeRing &operator=(const LockFreeRing &) = delete;
+
+        size_t capacity() const { return m_mask + 1; }
+
+        // Returns false if the ring is full.
+        bool try_enqueue(const T &value)
+        {
+            if (!push(value))
+                return false;
+
+            wake_if_waiting(m_consumerWaiting, m_notEmpty);
+            return true;
+        }
+
+        // Returns false if the ring is empty. Must only be called by one
+        // thread at a time.
+        bool try_dequeue(T &dest)
+        {
+            if (!pop(dest))
+                return false;
+
+            wake_if_waiting(m_producersWaiting, m_notFull);
+            return true;
+        }
+
+        // Blocks while the ring is full.
+        void enqueue(const T &value)
+        {
+            if (try_enqueue(value))
+                return;
+
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                ++m_producersWaiting;
+
+                while (true)
+                {
+                    // Pairs with the fence in wake_if_waiting(): either the
+                    // consumer sees the waiter or the retry sees the free slot.
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                    if (push(value))
+                        break;
+
+                    m_notFull.wait(lock);
+                }
+
+                --m_producersWaiting;
+            }
+
+            wake_if_waiting(m_consumerWaiting, m_notEmpty);
+        }
+
+        // Waits up to timeout for a free slot. Returns false if the ring is
+        // still full after the timeout.
+        template<typename Rep, typename Period>
+        bool enqueue(const T &value, const std::chrono::duration<Rep, Period> &timeout)
+        {
+            if (try_enqueue(value))
+                return true;
+
+            auto deadline = std::chrono::steady_clock::now() + timeout;
+            bool result = false;
+
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                ++m_producersWaiting;
+
+                while (true)
+                {
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                    if ((result = push(value)))
+                        break;
+
+                    if (m_notFull.wait_until(lock, deadline) == std::cv_status::timeout)
+                    {
+                        result = push(value);
+                        break;
+                    }
+                }
+
+                --m_producersWaiting;
+            }
+
+            if (result)
+                wake_if_waiting(m_consumerWaiting, m_notEmpty);
+
+            return result;
+        }
+
+        // Waits up to timeout for an element. Returns false if the ring is
+        // still empty after the timeout.
+        template<typename Rep, typename Period>
+        bool dequeue(T &dest, const std::chrono::duration<Rep, Period> &timeout)
+        {
+            if (try_dequeue(dest))
+                return true;
+
+            auto deadline = std::chrono::steady_clock::now() + timeout;
+            bool result = false;
+
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_consumerWaiting.store(1, std::memory_order_relaxed);
+
+                while (true)
+                {
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                    if ((result = pop(dest)))
+                        break;
+
+                    if (m_notEmpty.wait_until(lock, deadline) == std::cv_status::timeout)
+                    {
+                        result = pop(dest);
+                        break;
+                    }
+                }
+
+                m_consumerWaiting.store(0, std::memory_order_relaxed);
+            }
+
+            if (result)
+                wake_if_waiting(m_producersWaiting, m_notFull);
+
+            return result;
+        }
+
+        // Blocks until an element is available.
+        T dequeue_blocking()
+        {
+            T result;
+
+            while (!dequeue(result, std::chrono::seconds(1)));
+
+            return result;
+        }
+
+        // Approximate if called while other threads modify the ring.
+        size_t size() const
+        {
+            size_t enq = m_enqueuePos.load(std::memory_order_acquire);
+            size_t deq = m_dequeuePos.load(std::memory_order_acquire);
+            return enq >= deq ? enq - deq : 0u;
+        }
+
+        bool empty() const { return size() == 0; }
+
+    private:
+        struct Cell
+        {
+            std::atomic<size_t> sequence;
+            T value;
+        };
+
+        bool push(const T &value)
+        {
+            Cell *cell;
+            size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+
+            while (true)
+            {
+                cell = &m_cells[pos & m_mask];
+                size_t seq = cell->sequence.load(std::memory_order_acquire);
+                intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+                if (dif == 0)
+                {
+                    if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (dif < 0)
+                    return false;
+                else
+                    pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+
+            cell->value = value;
+            cell->sequence.store(pos + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        bool pop(T &dest)
+        {
+            size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+            Cell *cell = &m_cells[pos & m_mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+
+            if (seq != pos + 1)
+                return false;
+
+            dest = cell->value;
+            cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+            m_dequeuePos.store(pos + 1, std::memory_order_relaxed);
+
+            return true;
+        }
+
+        void wake_if_waiting(std::atomic<unsigned> &waiting, std::condition_variable &cond)
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if (waiting.load(std::memory_order_relaxed))
+            {
+                // Taking the mutex makes sure the waiter is either blocked
+                // in wait() or has not yet done its final check.
+                { std::lock_guard<std::mutex> guard(m_mutex); }
+                cond.notify_all();
+            }
+        }
+
+        // Padding keeps the producer and consumer positions on separate cache
+        // lines. alignas() is not used as over-aligned heap allocations
+        // require C++17.
+        static const size_t CacheLineSize = 64;
+
+        std::atomic<size_t> m_enqueuePos = { 0 };
+        char m_pad0[CacheLineSize];
+        std::atomic<size_t> m_dequeuePos = { 0 };
+        char m_pad1[CacheLineSize];
+
+        std::atomic<unsigned> m_consumerWaiting = { 0 };
+        std::atomic<unsigned> m_producersWaiting = { 0 };
+
+        std::unique_ptr<Cell[]> m_cells;
+        size_t m_mask;
+
+        std::mutex m_mutex;
+        std::condition_variable m_notEmpty;
+        std::condition_variable m_notFull;
+};
+
+// Free functions mirroring the ThreadSafeQueue interface in threading.h so
+// that the ring can be used as a drop-in replacement.
+
+template<typename T>
+void enqueue(LockFreeRing<T> *ring, T obj)
+{
+    ring->enqueue(obj);
+}
+
+// Waiting consumers are always woken up by the ring.
+template<typename T>
+void enqueue_and_wakeOne(LockFreeRing<T> *ring, T obj)
+{
+    ring->enqueue(obj);
+}
+
+// Returns a default constructed value if the ring is empty.
+template<typename T>
+T dequeue(LockFreeRing<T> *ring)
+{
+    T result = {};
+    ring->try_dequeue(result);
+    return result;
+}
+
+// Waits up to wait_ms for an element. Returns a default constructed value if
+// the ring is still empty after the wait.
+template<typename T>
+T dequeue(LockFreeRing<T> *ring, unsigned long wait_ms)
+{
+    T result = {};
+    ring->dequeue(result, std::chrono::milliseconds(wait_ms));
+    return result;
+}
+
+template<typename T>
+T dequeue_blocking(LockFreeRing<T> *ring)
+{
+    return ring->dequeue_blocking();
+}
+
+template<typename T>
+bool is_empty(LockFreeRing<T> *ring)
+{
+    return ring->empty();
+}
+
+template<typename T>
+int queue_size(LockFreeRing<T> *ring)
+{
+    return static_cast<int>(ring->size());
+}
+
+} // end namespace mvme
+} // end namespace mesytec
+
+#endif /* __MVME_UTIL_LOCKFREE_RING_H__ */
@@ -19,6 +19,9 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
  */
 #include "util_zip.h"
+
+#include <algorithm>
+#include <array>
 #include <cassert>
 
 QString make_zip_error_string(const QString &message, const QuaZip *zip)
@@ -63,14 +66,16 @@ bool seek_in_file(QIODevice *input, qint64 pos)
         if (!inZipFile->open(QIODevice::ReadOnly))
             return false;
 
+        std::array<char, 1u << 16> buffer;
+
         while (pos > 0)
         {
-            char c;
+            qint64 toRead = std::min(pos, static_cast<qint64>(buffer.size()));
 
-            if (inZipFile->read(&c, sizeof(c)) != sizeof(c))
+            if (inZipFile->read(buffer.data(), toRead) != toRead)
                 return false;
 
-            --pos;
+            pos -= toRead;
         }
 
         return true;
@@ -29,8 +29,8 @@ QString make_zip_error_string(const QString &message, const QuaZip *zip);
 QString make_zip_error_string(const QString &message, QuaZipFile *zipFile);
 std::runtime_error make_zip_error(const QString &msg, const QuaZip &zip);
 
-/* Note: this is very inefficient for ZIP files and should be used sparingly
- * and only to look for a position near the start of the file. */
+/* Note: for ZIP files this reopens the file and decompresses all data up to
+ * pos. Use sparingly. */
 bool seek_in_file(QIODevice *input, qint64 pos);
 QString get_filename(const QIODevice *dev);
 
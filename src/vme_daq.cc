@@ -30,6 +30,7 @@
 #include <mmsystem.h>
 #endif
 
+#include "listfile_index.h"
 #include "mvme_listfile_utils.h"
 #include "util/assert.h"
 #include "util_zip.h"
@@ -343,8 +344,36 @@ struct DAQReadoutListfileHelperPrivate
     QuaZip listfileArchive;
     std::unique_ptr<QIODevice> listfileOut;
     std::unique_ptr<ListFileWriter> listfileWriter;
+    std::unique_ptr<ListfileIndexBuilder> indexBuilder;
+    QString indexedListfileName;
 };
 
+namespace
+{
+
+u64 count_event_sections(const u8 *data, size_t size)
+{
+    const auto &lfc = listfile_constants();
+    u64 result = 0;
+    size_t pos = 0;
+
+    while (pos + sizeof(u32) <= size)
+    {
+        u32 sectionHeader = *reinterpret_cast<const u32 *>(data + pos);
+        u32 sectionType = (sectionHeader & lfc.SectionTypeMask) >> lfc.SectionTypeShift;
+        u32 sectionWords = (sectionHeader & lfc.SectionSizeMask) >> lfc.SectionSizeShift;
+
+        if (sectionType == ListfileSections::SectionType_Event)
+            ++result;
+
+        pos += (sectionWords + 1) * sizeof(u32);
+    }
+
+    return result;
+}
+
+} // end anon namespace
+
 //
 // DAQReadoutListfileHelper
 //
@@ -420,6 +449,7 @@ void DAQReadoutListfileHelper::beginRun()
                 }
 
                 m_d->listfileWriter->setOutputDevice(outFile);
+                m_d->indexedListfileName = QFileInfo(outFilename).fileName();
                 m_readoutContext.daqStats.listfileFilename = outFilename;
             } break;
 
@@ -464,6 +494,7 @@ void DAQReadoutListfileHelper::beginRun()
                 }
 
                 m_d->listfileWriter->setOutputDevice(m_d->listfileOut.get());
+                m_d->indexedListfileName = listfileFilename;
                 m_readoutContext.daqStats.listfileFilename = outFilename;
 
             } break;
@@ -471,6 +502,8 @@ void DAQReadoutListfileHelper::beginRun()
             InvalidDefaultCase;
     }
 
+    m_d->indexBuilder = std::make_unique<ListfileIndexBuilder>();
+
     auto doc = mvme::vme_config::serialize_vme_config_to_json_document(*m_readoutContext.vmeConfig);
 
     if (!m_d->listfileWriter->writePreamble() || !m_d->listfileWriter->writeConfig(doc.toJson()))
@@ -496,6 +529,9 @@ void DAQReadoutListfileHelper::endRun()
 
     m_d->listfileOut->close();
 
+    auto listfileIndex = m_d->indexBuilder->finish(
+        m_d->indexedListfileName, m_d->listfileWriter->bytesWritten());
+
     // TODO: more error reporting here (file I/O)
     switch (m_readoutContext.listfileOutputInfo->format)
     {
@@ -516,10 +552,37 @@ void DAQReadoutListfileHelper::endRun()
                         logFile.write("\n");
                     }
                 }
+
+                // Index file
+                QFile indexFile(listFileOut->fileName() + ListfileIndex::FileSuffix);
+                if (indexFile.open(QIODevice::WriteOnly))
+                {
+                    indexFile.write(serialize_listfile_index(listfileIndex));
+                }
             } break;
 
         case ListFileFormat::ZIP:
             {
+                // Listfile index
+                {
+                    QuaZipNewInfo info(ListfileIndex::ArchiveEntryName);
+                    info.setPermissions(static_cast<QFile::Permissions>(0x6644));
+                    QuaZipFile outFile(&m_d->listfileArchive);
+
+                    bool res = outFile.open(QIODevice::WriteOnly, info,
+                                            // password, crc
+                                            nullptr, 0,
+                                            // method (Z_DEFLATED or 0 for no compression)
+                                            0,
+                                            // level
+                                            m_readoutContext.listfileOutputInfo->compressionLevel
+                                           );
+
+                    if (res)
+                    {
+                        outFile.write(serialize_listfile_index(listfileIndex));
+                    }
+                }
 
                 // Logfile
                 {
@@ -617,6 +680,10 @@ void DAQReadoutListfileHelper::writeBuffer(const u8 *buffer, size_t size)
 {
     if (m_d->listfileOut && m_d->listfileOut->isOpen())
     {
+        // Readout buffers start at a section boundary.
+        m_d->indexBuilder->boundary(m_d->listfileWriter->bytesWritten());
+        m_d->indexBuilder->addEvents(count_event_sections(buffer, size));
+
         if (!m_d->listfileWriter->writeBuffer(reinterpret_cast<const char *>(buffer), size))
         {
             throw_io_device_error(m_d->listfileOut);
@@ -629,6 +696,8 @@ void DAQReadoutListfileHelper::writeTimetickSection()
 {
     if (m_d->listfileOut && m_d->listfileOut->isOpen())
     {
+        m_d->indexBuilder->timetick(m_d->listfileWriter->bytesWritten());
+
         if (!m_d->listfileWriter->writeTimetickSection())
         {
             throw_io_device_error(m_d->listfileOut);
@@ -0,0 +1,101 @@
+#include <atomic>
+#include <benchmark/benchmark.h>
+#include <thread>
+#include <vector>
+
+#include "data_buffer_queue.h"
+
+// Compares the mutex based ThreadSafeQueue with the lock-free ring now used as
+// ThreadSafeDataBufferQueue.
+
+using MutexQueue = ThreadSafeQueue<DataBuffer *>;
+using RingQueue = mesytec::mvme::LockFreeRing<DataBuffer *>;
+
+static const unsigned long WaitTimeout_ms = 100;
+
+// Hand-off latency: a single buffer is passed to an echo thread and back.
+// Each iteration measures one round trip, i.e. two hand-offs including the
+// wakeup of the waiting thread.
+template<typename Queue>
+static void BM_HandoffLatency(benchmark::State &state)
+{
+    Queue to, from;
+    DataBuffer buffer(64);
+    std::atomic<bool> quit(false);
+
+    std::thread echo([&] ()
+    {
+        while (!quit)
+        {
+            if (auto b = dequeue(&to, WaitTimeout_ms))
+                enqueue_and_wakeOne(&from, b);
+        }
+    });
+
+    while (state.KeepRunning())
+    {
+        enqueue_and_wakeOne(&to, &buffer);
+        DataBuffer *b = nullptr;
+
+        while (!(b = dequeue(&from, WaitTimeout_ms)));
+
+        benchmark::DoNotOptimize(b);
+    }
+
+    quit = true;
+    echo.join();
+}
+
+BENCHMARK_TEMPLATE(BM_HandoffLatency, MutexQueue)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_HandoffLatency, RingQueue)->UseRealTime();
+
+// Throughput: a producer thread moves buffers from the free queue to the full
+// queue, the benchmark thread consumes them and returns them to the free
+// queue. Same setup as the readout worker and the stream worker.
+template<typename Queue>
+static void BM_HandoffThroughput(benchmark::State &state)
+{
+    const size_t bufferCount = state.range(0);
+
+    Queue freeBuffers, fullBuffers;
+    std::vector<std::unique_ptr<DataBuffer>> buffers;
+    std::atomic<bool> quit(false);
+
+    for (size_t i = 0; i < bufferCount; i++)
+    {
+        buffers.emplace_back(std::make_unique<DataBuffer>(64));
+        enqueue(&freeBuffers, buffers.back().get());
+    }
+
+    std::thread producer([&] ()
+    {
+        while (!quit)
+        {
+            if (auto b = dequeue(&freeBuffers, WaitTimeout_ms))
+            {
+                b->used = b->size;
+                enqueue_and_wakeOne(&fullBuffers, b);
+            }
+        }
+    });
+
+    while (state.KeepRunning())
+    {
+        DataBuffer *b = nullptr;
+
+        while (!(b = dequeue(&fullBuffers, WaitTimeout_ms)));
+
+        benchmark::DoNotOptimize(b->used);
+        enqueue_and_wakeOne(&freeBuffers, b);
+    }
+
+    quit = true;
+    producer.join();
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(BM_HandoffThroughput, MutexQueue)->Arg(1)->Arg(20)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_HandoffThroughput, RingQueue)->Arg(1)->Arg(20)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,340 @@
+#include <arpa/inet.h>
+#include <atomic>
+#include <benchmark/benchmark.h>
+#include <netinet/in.h>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "event_server/common/event_server_lib.h"
+
+// Throughput of the EventServer payload encodings over a local TCP loopback
+// connection. The benchmark thread encodes batches of events the same way the
+// EventServer does and writes them to the socket. A client thread reads the
+// messages and decodes them using the client library.
+//
+// Arguments: encoding (0: EventDataBatch, 1: compact, 2: compact + LZ4) and
+// the percentage of data source elements present in each event.
+
+using namespace mvme::event_server;
+
+namespace
+{
+
+enum Mode
+{
+    Mode_Pairs,
+    Mode_Compact,
+    Mode_CompactLZ4,
+};
+
+static const size_t DataSourceCount = 4;
+static const uint32_t DataSourceSize = 64;
+static const size_t EventCount = 10000;
+
+StreamInfo make_stream_info()
+{
+    StreamInfo result;
+    result.runId = "bench";
+
+    EventDataDescription edd;
+    edd.eventIndex = 0;
+
+    for (size_t i = 0; i < DataSourceCount; i++)
+    {
+        DataSourceDescription dsd;
+        dsd.name = "adc" + std::to_string(i);
+        dsd.moduleIndex = i;
+        dsd.size = DataSourceSize;
+        dsd.upperLimit = 1 << 13;
+        dsd.bits = 13;
+        dsd.indexType = StorageType::st_uint8_t;
+        dsd.valueType = StorageType::st_uint16_t;
+        edd.dataSources.push_back(dsd);
+    }
+
+    result.eventDataDescriptions.push_back(edd);
+
+    VMEEvent event;
+    event.eventIndex = 0;
+    event.name = "event0";
+
+    for (size_t i = 0; i < DataSourceCount; i++)
+        event.modules.push_back({ static_cast<int>(i), "mdpp" + std::to_string(i), "mdpp16_scp" });
+
+    result.vmeTree.events.push_back(event);
+
+    return result;
+}
+
+// Per event (dataSourceIndex, elementCount, pairs) blocks as contained in
+// EventData messages.
+std::vector<std::vector<uint8_t>> make_events(const StreamInfo &info, int occupancyPercent)
+{
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> percent(0, 99);
+    std::uniform_int_distribution<uint16_t> value(0, (1 << 13) - 1);
+    std::vector<std::vector<uint8_t>> result(EventCount);
+
+    for (auto &event: result)
+    {
+        for (const auto &dsd: info.eventDataDescriptions[0].dataSources)
+        {
+            event.push_back(&dsd - info.eventDataDescriptions[0].dataSources.data());
+            size_t countOffset = event.size();
+            event.resize(event.size() + sizeof(uint16_t));
+            uint16_t count = 0;
+
+            for (uint32_t index = 0; index < dsd.size; index++)
+            {
+                if (percent(rng) < occupancyPercent)
+                {
+                    append_storage(dsd.indexType, index, event);
+                    append_storage(dsd.valueType, value(rng), event);
+                    ++count;
+                }
+            }
+
+            memcpy(event.data() + countOffset, &count, sizeof(count));
+        }
+    }
+
+    return result;
+}
+
+void append_frame(MessageType type, uint32_t size, std::vector<uint8_t> &dest)
+{
+    dest.push_back(type);
+    dest.resize(dest.size() + sizeof(size));
+    memcpy(dest.data() + dest.size() - sizeof(size), &size, sizeof(size));
+}
+
+void write_json_message(int fd, MessageType type, const json &j)
+{
+    write_message(fd, type, j.dump());
+}
+
+class CountingClient: public Client
+{
+    public:
+        std::atomic<bool> done = { false };
+        size_t events = 0;
+        size_t values = 0;
+
+    protected:
+        void serverInfo(const Message &, const json &) override {}
+        void beginRun(const Message &, const StreamInfo &) override {}
+
+        void eventData(const Message &, int, const std::vector<DataSourceContents> &contents) override
+        {
+            ++events;
+
+            for (const auto &dsc: contents)
+                values += dsc.count;
+        }
+
+        void endRun(const Message &, const json &) override { done = true; }
+        void error(const Message &, const std::exception &) override {}
+};
+
+// Returns a pair of connected TCP sockets on the loopback interface.
+std::pair<int, int> make_loopback_connection()
+{
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+
+    socklen_t addrLen = sizeof(addr);
+
+    if (bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0
+        || listen(listenFd, 1) != 0
+        || getsockname(listenFd, reinterpret_cast<sockaddr *>(&addr), &addrLen) != 0)
+    {
+        close(listenFd);
+        return { -1, -1 };
+    }
+
+    int clientFd = connect_to("127.0.0.1", ntohs(addr.sin_port));
+    int serverFd = accept(listenFd, nullptr, nullptr);
+    close(listenFd);
+
+    return { serverFd, clientFd };
+}
+
+} // end anon namespace
+
+static void BM_EventServerEncoding(benchmark::State &state)
+{
+    const auto mode = static_cast<Mode>(state.range(0));
+
+#ifndef MVME_EVENT_SERVER_LZ4
+    if (mode == Mode_CompactLZ4)
+    {
+        state.SkipWithError("built without MVME_EVENT_SERVER_LZ4");
+        return;
+    }
+#endif
+
+    const auto info = make_stream_info();
+    const auto &edd = info.eventDataDescriptions[0];
+    const auto events = make_events(info, state.range(1));
+
+    size_t rawBytes = 0;
+
+    for (const auto &event: events)
+        rawBytes += event.size();
+
+    auto fds = make_loopback_connection();
+
+    if (fds.first < 0 || fds.second < 0)
+    {
+        state.SkipWithError("could not create loopback connection");
+        return;
+    }
+
+    const int serverFd = fds.first;
+    CountingClient client;
+
+    std::thread reader([&client, clientFd = fds.second] ()
+    {
+        Message msg;
+
+        try
+        {
+            while (!client.done)
+            {
+                read_message(clientFd, msg);
+                client.handleMessage(msg);
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "client error: " << e.what() << std::endl;
+        }
+    });
+
+    json serverInfo;
+    serverInfo["protocol_version"] = ProtocolVersion;
+    write_json_message(serverFd, MessageType::ServerInfo, serverInfo);
+
+    json beginRun;
+    beginRun["runId"] = info.runId;
+    beginRun["eventDataSources"] = to_json(info.eventDataDescriptions);
+    beginRun["vmeTree"] = to_json(info.vmeTree);
+    write_json_message(serverFd, MessageType::BeginRun, beginRun);
+
+    std::vector<uint8_t> payload;
+    std::vector<uint8_t> message;
+    std::vector<std::pair<uint32_t, uint64_t>> scratch;
+    size_t wireBytes = 0;
+    size_t eventsSent = 0;
+
+    while (state.KeepRunning())
+    {
+        // One batch per iteration.
+        payload.clear();
+        payload.resize(sizeof(uint32_t));
+        uint32_t batchEvents = 0;
+
+        while (batchEvents < BatchMaxEvents && payload.size() < BatchMaxBytes)
+        {
+            const auto &event = events[eventsSent++ % events.size()];
+            const size_t sizeOffset = payload.size();
+
+            payload.resize(payload.size() + sizeof(uint32_t));
+            payload.push_back(0u); // eventIndex
+
+            if (mode == Mode_Pairs)
+            {
+                payload.insert(payload.end(), event.begin(), event.end());
+            }
+            else
+            {
+                const uint8_t *dsBegin = event.data();
+
+                for (const auto &dsd: edd.dataSources)
+                {
+                    DataSourceContents dsc;
+                    dsc.indexType = dsd.indexType;
+                    dsc.valueType = dsd.valueType;
+                    memcpy(&dsc.count, dsBegin + 1, sizeof(dsc.count));
+                    dsc.firstIndex = dsBegin + 1 + sizeof(uint16_t);
+
+                    encode_data_source_compact(dsd, *dsBegin, dsc, payload, scratch);
+                    dsBegin = get_end_pointer(dsc);
+                }
+            }
+
+            uint32_t eventSize = payload.size() - sizeOffset - sizeof(uint32_t);
+            memcpy(payload.data() + sizeOffset, &eventSize, sizeof(eventSize));
+            ++batchEvents;
+        }
+
+        memcpy(payload.data(), &batchEvents, sizeof(batchEvents));
+        message.clear();
+
+        if (mode == Mode_Pairs)
+        {
+            append_frame(MessageType::EventDataBatch, payload.size(), message);
+            message.insert(message.end(), payload.begin(), payload.end());
+        }
+        else
+        {
+            uint8_t flags = 0u;
+            std::vector<uint8_t> contents;
+            contents.push_back(0u);
+            contents.resize(contents.size() + sizeof(uint32_t));
+            uint32_t payloadSize = payload.size();
+            memcpy(contents.data() + 1, &payloadSize, sizeof(payloadSize));
+
+#ifdef MVME_EVENT_SERVER_LZ4
+            if (mode == Mode_CompactLZ4)
+            {
+                lz4_compress(payload.data(), payload.size(), contents);
+                flags |= CompactBatch_LZ4;
+            }
+#endif
+            if (!flags)
+                contents.insert(contents.end(), payload.begin(), payload.end());
+
+            contents[0] = flags;
+            append_frame(MessageType::CompactEventDataBatch, contents.size(), message);
+            message.insert(message.end(), contents.begin(), contents.end());
+        }
+
+        write_data(serverFd, message.data(), message.size());
+        wireBytes += message.size();
+    }
+
+    write_json_message(serverFd, MessageType::EndRun, json::object());
+    reader.join();
+    close(serverFd);
+    close(fds.second);
+
+    if (client.events != eventsSent)
+        state.SkipWithError("client received a different number of events");
+
+    const double rawBytesPerEvent = static_cast<double>(rawBytes) / events.size();
+
+    state.SetItemsProcessed(eventsSent);
+    state.SetBytesProcessed(eventsSent * rawBytesPerEvent);
+    state.counters["wire_bytes_per_event"] = eventsSent ? static_cast<double>(wireBytes) / eventsSent : 0.0;
+    state.counters["raw_bytes_per_event"] = rawBytesPerEvent;
+}
+
+static void encoding_args(benchmark::internal::Benchmark *b)
+{
+    for (int mode: { Mode_Pairs, Mode_Compact, Mode_CompactLZ4 })
+        for (int occupancy: { 5, 50, 95 })
+            b->Args({ mode, occupancy });
+}
+
+BENCHMARK(BM_EventServerEncoding)
+    ->Apply(encoding_args)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,202 @@
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <mesytec-mvlc/mvlc_impl_eth.h>
+
+#include "mvlc_mapped_replay.h"
+
+// Compares reading an uncompressed MVLC listfile through buffered reads, as
+// done by the ReplayWorker, with the memory mapped views used for flat
+// listfile replays.
+//
+// Environment:
+//   MVME_BENCH_REPLAY_FILE     existing .mvlclst file to use
+//   MVME_BENCH_REPLAY_SIZE_MB  size of the generated file if no file is given
+//                              (default 256). Use a size larger than the
+//                              available memory to measure cold reads.
+
+using namespace mesytec;
+
+static const size_t BufferSize = 1u << 20;
+
+static std::string make_test_listfile()
+{
+    if (auto path = std::getenv("MVME_BENCH_REPLAY_FILE"))
+        return path;
+
+    size_t sizeMB = 256;
+
+    if (auto s = std::getenv("MVME_BENCH_REPLAY_SIZE_MB"))
+        sizeMB = std::strtoul(s, nullptr, 0);
+
+    std::string path = "bench_mapped_replay.mvlclst";
+    auto f = std::fopen(path.c_str(), "wb");
+
+    if (!f)
+        return {};
+
+    std::fwrite("MVLC_USB", 1, MVLCMappedReplay::FileMagicLen, f);
+
+    // USB stack frames of 255 data words each.
+    std::vector<u32> frame(256);
+    frame[0] = (0xF3u << 24) | (frame.size() - 1); // StackFrame header
+
+    for (size_t i = 1; i < frame.size(); i++)
+        frame[i] = i;
+
+    const size_t frameBytes = frame.size() * sizeof(u32);
+
+    for (size_t written = 0; written < sizeMB * BufferSize; written += frameBytes)
+        std::fwrite(frame.data(), 1, frameBytes, f);
+
+    std::fclose(f);
+
+    return path;
+}
+
+static const std::string &test_listfile()
+{
+    static const std::string path = make_test_listfile();
+    return path;
+}
+
+static u32 checksum(const u32 *data, size_t size)
+{
+    u32 result = 0;
+
+    for (size_t i = 0; i < size; i++)
+        result += data[i];
+
+    return result;
+}
+
+// Number of words at the start of data forming complete frames/packets.
+static size_t complete_words(mvlc::ConnectionType type, const u32 *data, size_t words)
+{
+    size_t pos = 0;
+
+    while (pos < words)
+    {
+        size_t frameWords = 0;
+
+        if (type == mvlc::ConnectionType::USB
+            || mvlc::get_frame_type(data[pos]) == mvlc::frame_headers::SystemEvent)
+        {
+            frameWords = mvlc::extract_frame_info(data[pos]).len + 1u;
+        }
+        else if (words - pos >= mvlc::eth::HeaderWords)
+        {
+            mvlc::eth::PayloadHeaderInfo ethHdrs{ data[pos], data[pos + 1] };
+            frameWords = mvlc::eth::HeaderWords + ethHdrs.dataWordCount();
+        }
+        else
+            break;
+
+        if (pos + frameWords > words)
+            break;
+
+        pos += frameWords;
+    }
+
+    return pos;
+}
+
+// Current path: read into a buffer, copy the complete frames into the buffer
+// handed to the parser and move the trailing partial frame to the start of
+// the read buffer.
+static void BM_BufferedReadAndCopy(benchmark::State &state)
+{
+    std::vector<u8> readBuffer(BufferSize);
+    std::vector<u32> parserBuffer(BufferSize / sizeof(u32));
+    size_t totalBytes = 0;
+
+    while (state.KeepRunning())
+    {
+        auto f = std::fopen(test_listfile().c_str(), "rb");
+
+        if (!f)
+        {
+            state.SkipWithError("could not open listfile");
+            return;
+        }
+
+        char magic[MVLCMappedReplay::FileMagicLen] = {};
+        std::fread(magic, 1, sizeof(magic), f);
+
+        auto type = (std::strncmp(magic, "MVLC_ETH", sizeof(magic)) == 0
+                     ? mvlc::ConnectionType::ETH : mvlc::ConnectionType::USB);
+
+        size_t carry = 0;
+        u32 sum = 0;
+
+        while (true)
+        {
+            size_t bytesRead = std::fread(readBuffer.data() + carry, 1,
+                                          readBuffer.size() - carry, f);
+            size_t available = carry + bytesRead;
+            auto words = reinterpret_cast<const u32 *>(readBuffer.data());
+            size_t viewWords = complete_words(type, words, available / sizeof(u32));
+
+            if (viewWords == 0)
+                break;
+
+            std::memcpy(parserBuffer.data(), words, viewWords * sizeof(u32));
+            sum += checksum(parserBuffer.data(), viewWords);
+            totalBytes += viewWords * sizeof(u32);
+
+            carry = available - viewWords * sizeof(u32);
+            std::memmove(readBuffer.data(), readBuffer.data() + viewWords * sizeof(u32), carry);
+        }
+
+        std::fclose(f);
+        benchmark::DoNotOptimize(sum);
+    }
+
+    state.SetBytesProcessed(totalBytes);
+}
+
+BENCHMARK(BM_BufferedReadAndCopy)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Mapped path: views into the file mapping are passed on directly.
+static void BM_MappedViews(benchmark::State &state)
+{
+    size_t totalBytes = 0;
+
+    while (state.KeepRunning())
+    {
+        MVLCMappedReplay replay(test_listfile());
+
+        auto begin = reinterpret_cast<const u32 *>(
+            replay.file.data() + MVLCMappedReplay::FileMagicLen);
+        const size_t totalWords = (replay.file.size() - MVLCMappedReplay::FileMagicLen) / sizeof(u32);
+        size_t pos = 0;
+        u32 sum = 0;
+
+        while (pos < totalWords)
+        {
+            size_t viewWords = find_view_end(
+                replay.type, begin + pos, totalWords - pos, MVLCMappedReplay::ViewWords);
+
+            // Done by the listfile worker thread during replays.
+            replay.file.prefetch(
+                MVLCMappedReplay::FileMagicLen + pos * sizeof(u32), viewWords * sizeof(u32));
+
+            sum += checksum(begin + pos, viewWords);
+            pos += viewWords;
+            replay.file.release(pos * sizeof(u32));
+        }
+
+        totalBytes += pos * sizeof(u32);
+        benchmark::DoNotOptimize(sum);
+    }
+
+    state.SetBytesProcessed(totalBytes);
+}
+
+BENCHMARK(BM_MappedViews)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,948 @@
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "event_server/common/event_server_lib.h"
+
+// Encodes events the way the EventServer does for the different client
+// options and checks that the client library decodes all message variants
+// into the same eventData() calls.
+
+using namespace mvme::event_server;
+
+namespace
+{
+
+using Pairs = std::vector<std::pair<uint32_t, uint64_t>>;
+
+// Matches a2::MaxVMEEvents which the EventServer passes to
+// make_subscription_filter().
+static const size_t MaxEvents = 12;
+
+struct DecodedEvent
+{
+    int eventIndex;
+    std::vector<Pairs> dataSources;
+
+    bool operator==(const DecodedEvent &o) const
+    {
+        return eventIndex == o.eventIndex && dataSources == o.dataSources;
+    }
+};
+
+std::ostream &operator<<(std::ostream &out, const DecodedEvent &e)
+{
+    out << "event " << e.eventIndex << ":";
+
+    for (const auto &pairs: e.dataSources)
+        out << " " << pairs.size();
+
+    return out;
+}
+
+DataSourceDescription make_data_source(const std::string &name, int moduleIndex, uint32_t size,
+                                       unsigned bits, StorageType indexType, StorageType valueType)
+{
+    DataSourceDescription dsd;
+    dsd.name = name;
+    dsd.moduleIndex = moduleIndex;
+    dsd.size = size;
+    dsd.upperLimit = 1u << bits;
+    dsd.bits = bits;
+    dsd.indexType = indexType;
+    dsd.valueType = valueType;
+    return dsd;
+}
+
+StreamInfo make_stream_info()
+{
+    StreamInfo result;
+    result.runId = "test";
+
+    EventDataDescription edd0;
+    edd0.eventIndex = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        edd0.dataSources.push_back(make_data_source(
+                "adc" + std::to_string(i), i, 64, 13,
+                StorageType::st_uint8_t, StorageType::st_uint16_t));
+    }
+
+    EventDataDescription edd1;
+    edd1.eventIndex = 1;
+    for (int i = 0; i < 2; i++)
+    {
+        edd1.dataSources.push_back(make_data_source(
+                "tdc" + std::to_string(i), i, 1000, 20,
+                StorageType::st_uint16_t, StorageType::st_uint32_t));
+    }
+
+    result.eventDataDescriptions = { edd0, edd1 };
+
+    for (const auto &edd: result.eventDataDescriptions)
+    {
+        VMEEvent event;
+        event.eventIndex = edd.eventIndex;
+        event.name = "event" + std::to_string(edd.eventIndex);
+
+        for (const auto &dsd: edd.dataSources)
+            event.modules.push_back({ dsd.moduleIndex, "module" + std::to_string(dsd.moduleIndex), "mdpp16_scp" });
+
+        result.vmeTree.events.push_back(event);
+    }
+
+    return result;
+}
+
+// The contents of the EventData message of one event, the locations of its
+// data source blocks and the (index, value) pairs contained in it.
+struct TestEvent
+{
+    int eventIndex;
+    std::vector<uint8_t> contents;
+    std::vector<std::pair<size_t, size_t>> spans;
+    std::vector<Pairs> pairs;
+};
+
+// Data source occupancies vary so that all compact encodings are used.
+TestEvent make_event(const StreamInfo &info, int eventIndex, std::mt19937 &rng)
+{
+    const auto &edd = info.eventDataDescriptions[eventIndex];
+    std::uniform_int_distribution<int> percent(0, 99);
+    std::uniform_int_distribution<int> occupancyChoice(0, 3);
+    static const int Occupancies[] = { 0, 2, 50, 100 };
+
+    TestEvent result;
+    result.eventIndex = eventIndex;
+    result.contents.push_back(eventIndex);
+
+    for (size_t dsIndex = 0; dsIndex < edd.dataSources.size(); dsIndex++)
+    {
+        const auto &dsd = edd.dataSources[dsIndex];
+        const int occupancy = Occupancies[occupancyChoice(rng)];
+        std::uniform_int_distribution<uint64_t> value(0, dsd.upperLimit - 1);
+        const size_t dsBegin = result.contents.size();
+        Pairs pairs;
+
+        result.contents.push_back(dsIndex);
+        result.contents.resize(result.contents.size() + sizeof(uint16_t));
+
+        for (uint32_t index = 0; index < dsd.size; index++)
+        {
+            if (percent(rng) < occupancy)
+            {
+                pairs.emplace_back(index, value(rng));
+                append_storage(dsd.indexType, index, result.contents);
+                append_storage(dsd.valueType, pairs.back().second, result.contents);
+            }
+        }
+
+        uint16_t count = pairs.size();
+        memcpy(result.contents.data() + dsBegin + sizeof(uint8_t), &count, sizeof(count));
+
+        result.spans.emplace_back(dsBegin, result.contents.size() - dsBegin);
+        result.pairs.emplace_back(std::move(pairs));
+    }
+
+    return result;
+}
+
+std::vector<TestEvent> make_events(const StreamInfo &info, size_t count)
+{
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> eventIndex(0, info.eventDataDescriptions.size() - 1);
+    std::vector<TestEvent> result;
+
+    for (size_t i = 0; i < count; i++)
+        result.emplace_back(make_event(info, eventIndex(rng), rng));
+
+    return result;
+}
+
+// Splits a framed message as returned by EventBatchBuilder::takeMessage().
+Message to_message(const std::vector<uint8_t> &framed)
+{
+    EXPECT_GE(framed.size(), MessageFrameSize);
+
+    uint32_t size = 0;
+    memcpy(&size, framed.data() + sizeof(MessageType), sizeof(size));
+    EXPECT_EQ(size, framed.size() - MessageFrameSize);
+
+    Message result;
+    result.type = static_cast<MessageType>(framed[0]);
+    result.contents.assign(framed.begin() + MessageFrameSize, framed.end());
+    return result;
+}
+
+Message make_json_message(MessageType type, const json &j)
+{
+    auto str = j.dump();
+    Message result;
+    result.type = type;
+    result.contents.assign(str.begin(), str.end());
+    return result;
+}
+
+// Produces the data messages the EventServer sends to a client with the
+// given options and subscriptions.
+std::vector<Message> server_encode(const StreamInfo &info, const std::vector<TestEvent> &events,
+                                   const ClientOptions &options, const SubscriptionFilter &filter)
+{
+    std::vector<Message> result;
+    EventBatchBuilder batch(options.compact);
+    std::vector<uint8_t> compactBuf;
+    std::vector<std::pair<size_t, size_t>> compactSpans;
+    Pairs scratch;
+
+    for (const auto &event: events)
+    {
+        if (!filter.wantsEvent(event.eventIndex))
+            continue;
+
+        if (options.compact)
+        {
+            encode_event_compact(info.eventDataDescriptions[event.eventIndex],
+                                 event.contents.data(), event.spans,
+                                 compactBuf, compactSpans, scratch);
+            batch.appendEvent(event.eventIndex, compactBuf.data(), compactSpans, filter);
+        }
+        else if (options.batched)
+        {
+            batch.appendEvent(event.eventIndex, event.contents.data(), event.spans, filter);
+        }
+        else
+        {
+            Message msg;
+            msg.type = MessageType::EventData;
+            msg.contents = event.contents;
+            result.emplace_back(msg);
+            continue;
+        }
+
+        if (batch.isFull())
+            result.emplace_back(to_message(batch.takeMessage(options.lz4)));
+    }
+
+    if (batch.eventCount())
+        result.emplace_back(to_message(batch.takeMessage(options.lz4)));
+
+    return result;
+}
+
+// The eventData() calls expected for the given events. Unbatched clients
+// always receive all data sources of the events they subscribed to.
+std::vector<DecodedEvent> expected_events(const std::vector<TestEvent> &events,
+                                          const SubscriptionFilter &filter,
+                                          bool filterDataSources)
+{
+    std::vector<DecodedEvent> result;
+
+    for (const auto &event: events)
+    {
+        if (!filter.wantsEvent(event.eventIndex))
+            continue;
+
+        DecodedEvent de = { event.eventIndex, event.pairs };
+
+        for (size_t dsIndex = 0; dsIndex < de.dataSources.size(); dsIndex++)
+        {
+            if (filterDataSources && !filter.wantsDataSource(event.eventIndex, dsIndex))
+                de.dataSources[dsIndex].clear();
+        }
+
+        result.emplace_back(de);
+    }
+
+    return result;
+}
+
+class RecordingClient: public Client
+{
+    public:
+        std::vector<DecodedEvent> events;
+        bool runEnded = false;
+
+    protected:
+        void serverInfo(const Message &, const json &) override {}
+        void beginRun(const Message &, const StreamInfo &) override {}
+
+        void eventData(const Message &, int eventIndex, const std::vector<DataSourceContents> &contents) override
+        {
+            DecodedEvent de = { eventIndex, {} };
+
+            for (const auto &dsc: contents)
+            {
+                Pairs pairs;
+
+                for (uint16_t i = 0; i < dsc.count; i++)
+                {
+                    const uint8_t *indexPtr = dsc.firstIndex + i * get_entry_size(dsc);
+                    const uint8_t *valuePtr = indexPtr + get_storage_type_size(dsc.indexType);
+                    pairs.emplace_back(read_storage<uint32_t>(dsc.indexType, indexPtr),
+                                       read_storage<uint64_t>(dsc.valueType, valuePtr));
+                }
+
+                de.dataSources.emplace_back(std::move(pairs));
+            }
+
+            events.emplace_back(std::move(de));
+        }
+
+        void endRun(const Message &, const json &) override { runEnded = true; }
+        void error(const Message &, const std::exception &) override {}
+};
+
+// Feeds a complete run to a client and returns the eventData() calls.
+std::vector<DecodedEvent> client_decode(const StreamInfo &info, const std::vector<Message> &dataMessages)
+{
+    RecordingClient client;
+
+    json serverInfo;
+    serverInfo["protocol_version"] = ProtocolVersion;
+    serverInfo["lz4"] = true;
+    client.handleMessage(make_json_message(MessageType::ServerInfo, serverInfo));
+
+    json beginRun;
+    beginRun["runId"] = info.runId;
+    beginRun["eventDataSources"] = to_json(info.eventDataDescriptions);
+    beginRun["vmeTree"] = to_json(info.vmeTree);
+    client.handleMessage(make_json_message(MessageType::BeginRun, beginRun));
+
+    for (const auto &msg: dataMessages)
+        client.handleMessage(msg);
+
+    client.handleMessage(make_json_message(MessageType::EndRun, json::object()));
+    EXPECT_TRUE(client.runEnded);
+
+    return client.events;
+}
+
+ClientOptions make_options(bool compact, bool lz4)
+{
+    ClientHelloInfo hello;
+    hello.compact = compact;
+    hello.lz4 = lz4;
+    return negotiate_client_options(hello);
+}
+
+} // end anon namespace
+
+TEST(EventServerLib, ClientHelloRoundTrip)
+{
+    ClientHelloInfo hello;
+    hello.protocolVersion = 2;
+    hello.batched = true;
+    hello.compact = true;
+    hello.lz4 = true;
+    hello.subscriptions = { { 0, { 1, 2 } }, { 3, {} } };
+
+    auto parsed = parse_client_hello(to_json(hello));
+
+    ASSERT_EQ(parsed.protocolVersion, 2);
+    ASSERT_TRUE(parsed.batched);
+    ASSERT_TRUE(parsed.compact);
+    ASSERT_TRUE(parsed.lz4);
+    ASSERT_EQ(parsed.subscriptions.size(), 2u);
+    ASSERT_EQ(parsed.subscriptions[0].eventIndex, 0);
+    ASSERT_EQ(parsed.subscriptions[0].dataSourceIndexes, std::vector<int>({ 1, 2 }));
+    ASSERT_EQ(parsed.subscriptions[1].eventIndex, 3);
+    ASSERT_TRUE(parsed.subscriptions[1].dataSourceIndexes.empty());
+}
+
+TEST(EventServerLib, NegotiateClientOptions)
+{
+    ClientHelloInfo hello;
+    hello.compact = true;
+    hello.lz4 = true;
+
+    auto options = negotiate_client_options(hello);
+    ASSERT_EQ(options.protocolVersion, ProtocolVersion);
+    ASSERT_TRUE(options.batched);
+    ASSERT_TRUE(options.compact);
+#ifdef MVME_EVENT_SERVER_LZ4
+    ASSERT_TRUE(options.lz4);
+#else
+    ASSERT_FALSE(options.lz4);
+#endif
+
+    // Newer clients are limited to the server protocol version.
+    hello.protocolVersion = ProtocolVersion + 1;
+    ASSERT_EQ(negotiate_client_options(hello).protocolVersion, ProtocolVersion);
+
+    // Compact batches need protocol version 3.
+    hello.protocolVersion = 2;
+    options = negotiate_client_options(hello);
+    ASSERT_TRUE(options.batched);
+    ASSERT_FALSE(options.compact);
+    ASSERT_FALSE(options.lz4);
+
+    // Compact batches and LZ4 are only used for batched clients.
+    hello.protocolVersion = ProtocolVersion;
+    hello.batched = false;
+    options = negotiate_client_options(hello);
+    ASSERT_FALSE(options.batched);
+    ASSERT_FALSE(options.compact);
+    ASSERT_FALSE(options.lz4);
+
+    hello.batched = true;
+    hello.compact = false;
+    ASSERT_FALSE(negotiate_client_options(hello).lz4);
+}
+
+// Clients without a ClientHello and protocol version 1 clients receive one
+// EventData message per event.
+TEST(EventServerLib, V1Fallback)
+{
+    ClientOptions noHello;
+    ASSERT_EQ(noHello.protocolVersion, MinProtocolVersion);
+    ASSERT_FALSE(noHello.batched);
+
+    auto emptyHello = negotiate_client_options(parse_client_hello(json::object()));
+    ASSERT_EQ(emptyHello.protocolVersion, MinProtocolVersion);
+    ASSERT_FALSE(emptyHello.batched);
+
+    ClientHelloInfo v1Hello;
+    v1Hello.protocolVersion = 1;
+    v1Hello.compact = true;
+    auto v1Options = negotiate_client_options(v1Hello);
+    ASSERT_FALSE(v1Options.batched);
+    ASSERT_FALSE(v1Options.compact);
+
+    const auto info = make_stream_info();
+    const auto events = make_events(info, 100);
+    const SubscriptionFilter all;
+
+    for (const auto &options: { noHello, emptyHello, v1Options })
+    {
+        auto messages = server_encode(info, events, options, all);
+        ASSERT_EQ(messages.size(), events.size());
+
+        for (const auto &msg: messages)
+            ASSERT_EQ(msg.type, MessageType::EventData);
+
+        ASSERT_EQ(client_decode(info, messages), expected_events(events, all, false));
+    }
+}
+
+TEST(EventServerLib, BatchesDecodeLikeEventData)
+{
+    const auto info = make_stream_info();
+    // Enough events to fill more than one batch.
+    const auto events = make_events(info, BatchMaxEvents * 2 + 10);
+    const SubscriptionFilter all;
+    const auto expected = expected_events(events, all, true);
+
+    ASSERT_EQ(client_decode(info, server_encode(info, events, ClientOptions{}, all)), expected);
+
+    struct Variant
+    {
+        ClientOptions options;
+        MessageType expectedType;
+    };
+
+    std::vector<Variant> variants =
+    {
+        { make_options(false, false), MessageType::EventDataBatch },
+        { make_options(true, false), MessageType::CompactEventDataBatch },
+#ifdef MVME_EVENT_SERVER_LZ4
+        { make_options(true, true), MessageType::CompactEventDataBatch },
+#endif
+    };
+
+    for (const auto &variant: variants)
+    {
+        auto messages = server_encode(info, events, variant.options, all);
+        ASSERT_GT(messages.size(), 1u);
+
+        for (const auto &msg: messages)
+        {
+            ASSERT_EQ(msg.type, variant.expectedType);
+
+            if (msg.type == MessageType::CompactEventDataBatch)
+            {
+                ASSERT_EQ(msg.contents[0] == CompactBatch_LZ4, variant.options.lz4);
+            }
+        }
+
+        ASSERT_EQ(client_decode(info, messages), expected);
+    }
+}
+
+TEST(EventServerLib, SubscriptionFilter)
+{
+    ClientHelloInfo hello;
+    // Event 0 data source 2 only plus invalid entries which are ignored.
+    hello.subscriptions = { { 0, { 2, -1 } }, { -1, { 0 } }, { static_cast<int>(MaxEvents), {} } };
+
+    auto filter = make_subscription_filter(hello, MaxEvents);
+    ASSERT_FALSE(filter.all);
+    ASSERT_TRUE(filter.wantsEvent(0));
+    ASSERT_FALSE(filter.wantsEvent(1));
+    ASSERT_FALSE(filter.wantsEvent(-1));
+    ASSERT_FALSE(filter.wantsEvent(MaxEvents));
+    ASSERT_FALSE(filter.wantsDataSource(0, 0));
+    ASSERT_FALSE(filter.wantsDataSource(0, 1));
+    ASSERT_TRUE(filter.wantsDataSource(0, 2));
+    ASSERT_FALSE(filter.wantsDataSource(0, 3));
+
+    // An empty data source list selects all data sources of the event.
+    hello.subscriptions.push_back({ 1, {} });
+    filter = make_subscription_filter(hello, MaxEvents);
+    ASSERT_TRUE(filter.wantsEvent(1));
+    ASSERT_TRUE(filter.wantsDataSource(1, 0));
+    ASSERT_TRUE(filter.wantsDataSource(1, 1));
+
+    // No subscriptions select everything.
+    ASSERT_TRUE(make_subscription_filter(ClientHelloInfo{}, MaxEvents).all);
+
+    const auto info = make_stream_info();
+    const auto events = make_events(info, 500);
+
+    for (auto eventSubscriptions: { std::vector<EventSubscription>{ { 0, { 2 } } },
+                                    std::vector<EventSubscription>{ { 0, { 0, 2 } }, { 1, {} } } })
+    {
+        hello.subscriptions = eventSubscriptions;
+        filter = make_subscription_filter(hello, MaxEvents);
+
+        // Unbatched clients receive all data sources of subscribed events.
+        ASSERT_EQ(client_decode(info, server_encode(info, events, ClientOptions{}, filter)),
+                  expected_events(events, filter, false));
+
+        auto expected = expected_events(events, filter, true);
+
+        for (const auto &options: { make_options(false, false), make_options(true, false),
+                                    make_options(true, true) })
+        {
+            ASSERT_EQ(client_decode(info, server_encode(info, events, options, filter)), expected);
+        }
+    }
+}
+
+TEST(EventServerLib, BatchBuilder)
+{
+    const auto info = make_stream_info();
+    const auto events = make_events(info, 100);
+    const SubscriptionFilter all;
+
+    // Event 0 without any data source values.
+    TestEvent emptyEvent = { 0, { 0u }, {}, {} };
+
+    for (uint8_t dsIndex = 0; dsIndex < 3; dsIndex++)
+    {
+        emptyEvent.spans.emplace_back(emptyEvent.contents.size(), sizeof(uint8_t) + sizeof(uint16_t));
+        emptyEvent.contents.insert(emptyEvent.contents.end(), { dsIndex, 0u, 0u });
+    }
+
+    for (bool compact: { false, true })
+    {
+        EventBatchBuilder batch(compact);
+        const size_t headerSize = batch.size();
+        ASSERT_EQ(headerSize, compact ? CompactBatchHeaderSize : BatchHeaderSize);
+
+        // Limited by the number of events.
+        for (size_t i = 0; i < BatchMaxEvents; i++)
+        {
+            ASSERT_FALSE(batch.isFull());
+            batch.appendEvent(0, emptyEvent.contents.data(), emptyEvent.spans, all);
+        }
+
+        ASSERT_TRUE(batch.isFull());
+        ASSERT_EQ(batch.eventCount(), BatchMaxEvents);
+
+        auto msg = to_message(batch.takeMessage());
+        ASSERT_EQ(msg.type, compact ? MessageType::CompactEventDataBatch : MessageType::EventDataBatch);
+        ASSERT_EQ(batch.eventCount(), 0u);
+        ASSERT_EQ(batch.size(), headerSize);
+
+        // Limited by the size of the collected events.
+        for (size_t i = 0; !batch.isFull(); i++)
+        {
+            ASSERT_LT(batch.eventCount(), BatchMaxEvents);
+            const auto &event = events[i % events.size()];
+            batch.appendEvent(event.eventIndex, event.contents.data(), event.spans, all);
+        }
+
+        ASSERT_GE(batch.size(), BatchMaxBytes);
+
+        // Switching modes discards collected events.
+        batch.setCompact(!compact);
+        ASSERT_EQ(batch.eventCount(), 0u);
+        ASSERT_EQ(batch.size(), compact ? BatchHeaderSize : CompactBatchHeaderSize);
+    }
+}
+
+namespace
+{
+
+// Packed (index, value) pairs as contained in EventData messages.
+std::vector<uint8_t> pack_pairs(const DataSourceDescription &dsd, const Pairs &pairs)
+{
+    std::vector<uint8_t> result;
+
+    for (const auto &entry: pairs)
+    {
+        append_storage(dsd.indexType, entry.first, result);
+        append_storage(dsd.valueType, entry.second, result);
+    }
+
+    return result;
+}
+
+Pairs unpack_pairs(const DataSourceDescription &dsd, const std::vector<uint8_t> &packed)
+{
+    const size_t indexSize = get_storage_type_size(dsd.indexType);
+    const size_t entrySize = indexSize + get_storage_type_size(dsd.valueType);
+    Pairs result;
+
+    for (size_t offset = 0; offset < packed.size(); offset += entrySize)
+    {
+        result.emplace_back(read_storage<uint32_t>(dsd.indexType, packed.data() + offset),
+                            read_storage<uint64_t>(dsd.valueType, packed.data() + offset + indexSize));
+    }
+
+    return result;
+}
+
+static const uint8_t CompactDataSourceIndex = 7;
+
+// Returns the compact encoding of the data source including the leading
+// dataSourceIndex byte.
+std::vector<uint8_t> encode_compact(const DataSourceDescription &dsd, const Pairs &pairs,
+                                    PayloadEncoding &encoding)
+{
+    auto packed = pack_pairs(dsd, pairs);
+
+    DataSourceContents dsc;
+    dsc.indexType = dsd.indexType;
+    dsc.valueType = dsd.valueType;
+    dsc.count = pairs.size();
+    dsc.firstIndex = packed.data();
+
+    std::vector<uint8_t> result;
+    Pairs scratch;
+    encoding = encode_data_source_compact(dsd, CompactDataSourceIndex, dsc, result, scratch);
+    return result;
+}
+
+// Decodes the output of encode_compact(). Checks that the whole buffer is
+// consumed.
+Pairs decode_compact(const DataSourceDescription &dsd, std::vector<uint8_t> encoded)
+{
+    BufferIterator in(encoded.data(), encoded.size());
+    EXPECT_EQ(in.extractU8(), CompactDataSourceIndex);
+
+    std::vector<uint8_t> packed;
+    uint16_t count = decode_data_source_compact(dsd, in, packed);
+
+    EXPECT_TRUE(in.atEnd());
+    EXPECT_EQ(packed.size(), count * (get_storage_type_size(dsd.indexType)
+                                      + get_storage_type_size(dsd.valueType)));
+
+    return unpack_pairs(dsd, packed);
+}
+
+Pairs round_trip(const DataSourceDescription &dsd, const Pairs &pairs, PayloadEncoding expectedEncoding)
+{
+    PayloadEncoding encoding;
+    auto encoded = encode_compact(dsd, pairs, encoding);
+    EXPECT_EQ(encoding, expectedEncoding);
+    return decode_compact(dsd, encoded);
+}
+
+// Offsets into the output of encode_compact().
+static const size_t CompactEncodingOffset = 1;
+static const size_t CompactCountOffset = 2;
+static const size_t CompactDataOffset = 4;
+
+} // end anon namespace
+
+TEST(EventServerLib, CompactEncodingRoundTrip)
+{
+    // Small data sources with 8 bit indexes. A single element is sent as a
+    // pair, full occupancy as a bitmap. 13 elements do not fill the last
+    // bitmap byte.
+    for (uint32_t size: { 64u, 13u })
+    {
+        auto dsd = make_data_source("adc", 0, size, 13, StorageType::st_uint8_t, StorageType::st_uint16_t);
+        const uint64_t maxValue = (1u << dsd.bits) - 1;
+
+        ASSERT_EQ(round_trip(dsd, {}, PayloadEncoding::Pairs), Pairs{});
+
+        for (uint32_t index: { 0u, size / 2, size - 1 })
+        {
+            Pairs single = { { index, maxValue } };
+            ASSERT_EQ(round_trip(dsd, single, PayloadEncoding::Pairs), single);
+        }
+
+        Pairs dense;
+        for (uint32_t index = 0; index < size; index++)
+            dense.emplace_back(index, (index * 37) & maxValue);
+
+        ASSERT_EQ(round_trip(dsd, dense, PayloadEncoding::Bitmap), dense);
+
+        // Every other element including the last one.
+        Pairs odd;
+        for (uint32_t index = 1; index < size - 1; index += 2)
+            odd.emplace_back(index, index);
+        odd.emplace_back(size - 1, 1);
+
+        ASSERT_EQ(round_trip(dsd, odd, PayloadEncoding::Bitmap), odd);
+    }
+
+    // Large data sources with 16 bit indexes and 64 bit values. Few elements
+    // are sent as index deltas, many as a bitmap.
+    {
+        auto dsd = make_data_source("tdc", 0, 1000, 20, StorageType::st_uint16_t, StorageType::st_uint64_t);
+
+        Pairs sparse = { { 0, 1 }, { 5, 2 }, { 700, 3 }, { 999, 0xffffffffffull } };
+        ASSERT_EQ(round_trip(dsd, sparse, PayloadEncoding::DeltaVarint), sparse);
+
+        Pairs last = { { 998, 42 }, { 999, 43 } };
+        ASSERT_EQ(round_trip(dsd, last, PayloadEncoding::DeltaVarint), last);
+
+        // Every third element, ending at index 999.
+        Pairs dense;
+        for (uint32_t index = 0; index < dsd.size; index += 3)
+            dense.emplace_back(index, index * 1000ull);
+
+        ASSERT_EQ(round_trip(dsd, dense, PayloadEncoding::Bitmap), dense);
+    }
+}
+
+TEST(EventServerLib, CompactEncodingUnsorted)
+{
+    std::mt19937 rng(42);
+
+    // The bitmap encoding sends the values in ascending index order.
+    {
+        auto dsd = make_data_source("adc", 0, 64, 13, StorageType::st_uint8_t, StorageType::st_uint16_t);
+
+        Pairs dense;
+        for (uint32_t index = 0; index < dsd.size; index++)
+            dense.emplace_back(index, index + 100);
+
+        Pairs shuffled = dense;
+        std::shuffle(shuffled.begin(), shuffled.end(), rng);
+        ASSERT_NE(shuffled, dense);
+
+        ASSERT_EQ(round_trip(dsd, shuffled, PayloadEncoding::Bitmap), dense);
+
+        // Duplicate indexes do not fit into the bitmap and are kept as pairs.
+        shuffled.push_back(shuffled.front());
+        ASSERT_EQ(round_trip(dsd, shuffled, PayloadEncoding::Pairs), shuffled);
+    }
+
+    // Index deltas may be negative. The element order is kept.
+    {
+        auto dsd = make_data_source("tdc", 0, 1000, 20, StorageType::st_uint16_t, StorageType::st_uint32_t);
+
+        Pairs sparse = { { 10, 1 }, { 5, 2 }, { 20, 3 }, { 0, 4 }, { 20, 5 }, { 999, 6 } };
+        ASSERT_EQ(round_trip(dsd, sparse, PayloadEncoding::DeltaVarint), sparse);
+    }
+}
+
+TEST(EventServerLib, CompactEncodingIndexOutOfRange)
+{
+    auto dsd = make_data_source("adc", 0, 64, 13, StorageType::st_uint8_t, StorageType::st_uint16_t);
+    PayloadEncoding encoding;
+
+    ASSERT_NO_THROW(encode_compact(dsd, { { 63, 1 } }, encoding));
+    ASSERT_THROW(encode_compact(dsd, { { 64, 1 } }, encoding), data_consistency_error);
+    ASSERT_THROW(encode_compact(dsd, { { 0, 1 }, { 255, 1 } }, encoding), data_consistency_error);
+}
+
+TEST(EventServerLib, CompactDecodeTruncated)
+{
+    auto small = make_data_source("adc", 0, 64, 13, StorageType::st_uint8_t, StorageType::st_uint16_t);
+    auto large = make_data_source("tdc", 0, 1000, 20, StorageType::st_uint16_t, StorageType::st_uint32_t);
+
+    Pairs dense;
+    for (uint32_t index = 0; index < small.size; index++)
+        dense.emplace_back(index, index);
+
+    struct Input
+    {
+        DataSourceDescription dsd;
+        Pairs pairs;
+        PayloadEncoding encoding;
+    };
+
+    std::vector<Input> inputs =
+    {
+        { small, { { 10, 1 }, { 63, 2 } }, PayloadEncoding::Pairs },
+        { small, dense, PayloadEncoding::Bitmap },
+        { large, { { 1, 1 }, { 5, 2 }, { 999, 3 } }, PayloadEncoding::DeltaVarint },
+    };
+
+    for (const auto &input: inputs)
+    {
+        PayloadEncoding encoding;
+        auto encoded = encode_compact(input.dsd, input.pairs, encoding);
+        ASSERT_EQ(encoding, input.encoding);
+
+        for (size_t size = 1; size < encoded.size(); size++)
+        {
+            std::vector<uint8_t> truncated(encoded.begin(), encoded.begin() + size);
+            ASSERT_THROW(decode_compact(input.dsd, truncated), end_of_buffer) << "size=" << size;
+        }
+    }
+}
+
+TEST(EventServerLib, CompactDecodeCorrupt)
+{
+    auto small = make_data_source("adc", 0, 13, 13, StorageType::st_uint8_t, StorageType::st_uint16_t);
+    auto large = make_data_source("tdc", 0, 1000, 20, StorageType::st_uint16_t, StorageType::st_uint32_t);
+    PayloadEncoding encoding;
+
+    // Unknown encoding
+    {
+        auto encoded = encode_compact(small, { { 1, 1 } }, encoding);
+        encoded[CompactEncodingOffset] = 3;
+        ASSERT_THROW(decode_compact(small, encoded), data_consistency_error);
+    }
+
+    // Pair index out of range
+    {
+        auto encoded = encode_compact(small, { { 1, 1 } }, encoding);
+        ASSERT_EQ(encoding, PayloadEncoding::Pairs);
+        encoded[CompactDataOffset] = small.size;
+        ASSERT_THROW(decode_compact(small, encoded), data_consistency_error);
+    }
+
+    // Bitmap bits not matching the element count
+    {
+        Pairs dense;
+        for (uint32_t index = 0; index < small.size; index++)
+            dense.emplace_back(index, index);
+
+        auto encoded = encode_compact(small, dense, encoding);
+        ASSERT_EQ(encoding, PayloadEncoding::Bitmap);
+
+        auto missing = encoded;
+        missing[CompactDataOffset] &= ~1u;
+        ASSERT_THROW(decode_compact(small, missing), data_consistency_error);
+
+        dense.pop_back();
+        auto extra = encode_compact(small, dense, encoding);
+        ASSERT_EQ(encoding, PayloadEncoding::Bitmap);
+        extra[CompactDataOffset + 1] |= 1u << ((small.size - 1) % 8);
+        ASSERT_THROW(decode_compact(small, extra), data_consistency_error);
+
+        // Padding bit past the end of the data source.
+        auto padding = encode_compact(small, dense, encoding);
+        padding[CompactDataOffset + 1] |= 0x80u;
+        ASSERT_THROW(decode_compact(small, padding), data_consistency_error);
+    }
+
+    // Index deltas leaving the data source range
+    {
+        auto encoded = encode_compact(large, { { 1, 1 } }, encoding);
+        ASSERT_EQ(encoding, PayloadEncoding::DeltaVarint);
+
+        auto negative = encoded;
+        negative[CompactDataOffset] = zigzag_encode(-1);
+        ASSERT_THROW(decode_compact(large, negative), data_consistency_error);
+
+        // Replace the single byte varint with a two byte varint for index 1000.
+        auto beyond = encoded;
+        uint64_t v = zigzag_encode(large.size);
+        beyond[CompactDataOffset] = static_cast<uint8_t>(v) | 0x80u;
+        beyond.insert(beyond.begin() + CompactDataOffset + 1, static_cast<uint8_t>(v >> 7));
+        ASSERT_THROW(decode_compact(large, beyond), data_consistency_error);
+    }
+
+    // Varint longer than 64 bits
+    {
+        auto encoded = encode_compact(large, { { 1, 1 } }, encoding);
+        encoded.insert(encoded.begin() + CompactDataOffset, 10, 0x80u);
+        ASSERT_THROW(decode_compact(large, encoded), data_consistency_error);
+    }
+
+    // Element count larger than the data
+    {
+        auto encoded = encode_compact(large, { { 1, 1 }, { 2, 2 } }, encoding);
+        uint16_t count = 3;
+        memcpy(encoded.data() + CompactCountOffset, &count, sizeof(count));
+        ASSERT_THROW(decode_compact(large, encoded), end_of_buffer);
+    }
+}
+
+// Broken CompactEventDataBatch messages are reported as data consistency
+// errors by the client.
+TEST(EventServerLib, CompactBatchCorrupt)
+{
+    const auto info = make_stream_info();
+    const auto events = make_events(info, 10);
+    const SubscriptionFilter all;
+
+    std::vector<ClientOptions> variants = { make_options(true, false) };
+#ifdef MVME_EVENT_SERVER_LZ4
+    variants.push_back(make_options(true, true));
+#endif
+
+    for (const auto &options: variants)
+    {
+        auto messages = server_encode(info, events, options, all);
+        ASSERT_EQ(messages.size(), 1u);
+        ASSERT_EQ(client_decode(info, messages), expected_events(events, all, true));
+
+        auto truncated = messages;
+        truncated[0].contents.resize(truncated[0].contents.size() - 1);
+        ASSERT_THROW(client_decode(info, truncated), data_consistency_error);
+
+        // Payload size not matching the contents.
+        auto wrongSize = messages;
+        wrongSize[0].contents[1] ^= 0x01u;
+        ASSERT_THROW(client_decode(info, wrongSize), data_consistency_error);
+
+        // Corrupt compact data: an unknown encoding of the first data source.
+        // The payload starts with u32 eventCount, u32 eventSize, u8
+        // eventIndex and u8 dataSourceIndex.
+        if (!options.lz4)
+        {
+            auto corrupt = messages;
+            corrupt[0].contents[CompactPayloadOffset - MessageFrameSize + 10] = 0xffu;
+            ASSERT_THROW(client_decode(info, corrupt), data_consistency_error);
+        }
+    }
+}
+
+#ifdef MVME_EVENT_SERVER_LZ4
+TEST(EventServerLib, LZ4RoundTrip)
+{
+    std::vector<uint8_t> data(100000);
+
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = (i * 7) % 13;
+
+    // lz4_compress() appends to the destination.
+    std::vector<uint8_t> compressed = { 1, 2, 3 };
+    lz4_compress(data.data(), data.size(), compressed);
+    ASSERT_LT(compressed.size(), data.size());
+
+    std::vector<uint8_t> decompressed(data.size());
+    lz4_decompress(compressed.data() + 3, compressed.size() - 3, decompressed.data(), decompressed.size());
+    ASSERT_EQ(decompressed, data);
+
+    // Wrong expected sizes and broken frames
+    ASSERT_THROW(lz4_decompress(compressed.data() + 3, compressed.size() - 3,
+                                decompressed.data(), decompressed.size() - 1),
+                 data_consistency_error);
+
+    decompressed.resize(data.size() + 1);
+    ASSERT_THROW(lz4_decompress(compressed.data() + 3, compressed.size() - 3,
+                                decompressed.data(), decompressed.size()),
+                 data_consistency_error);
+
+    ASSERT_THROW(lz4_decompress(compressed.data() + 3, compressed.size() / 2,
+                                decompressed.data(), data.size()),
+                 data_consistency_error);
+
+    auto corrupt = compressed;
+    corrupt[3] ^= 0xffu;
+    ASSERT_THROW(lz4_decompress(corrupt.data() + 3, corrupt.size() - 3,
+                                decompressed.data(), data.size()),
+                 data_consistency_error);
+}
+#endif
@@ -0,0 +1,256 @@
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "histo1d.h"
+
+namespace
+{
+
+// Reference implementation summing up the physical bins.
+double reduced_sum(const std::vector<double> &bins, u32 bin, u32 rrf)
+{
+    u32 begin = std::min(static_cast<size_t>(bin * rrf), bins.size());
+    u32 end = std::min(static_cast<size_t>(begin + rrf), bins.size());
+    return std::accumulate(bins.begin() + begin, bins.begin() + end, 0.0);
+}
+
+void expect_levels_match(const Histo1DPyramid &pyramid, const std::vector<double> &bins)
+{
+    ASSERT_TRUE(pyramid.isValid());
+
+    for (s32 level = 1; level <= pyramid.getLevelCount(); level++)
+    {
+        const u32 rrf = 1u << level;
+        const u32 binCount = (bins.size() + rrf - 1) / rrf;
+
+        for (u32 bin = 0; bin < binCount; bin++)
+            ASSERT_EQ(pyramid.getSum(level, bin), reduced_sum(bins, bin, rrf))
+                << "level=" << level << ", bin=" << bin;
+
+        ASSERT_EQ(pyramid.getSum(level, binCount), 0.0);
+    }
+}
+
+}
+
+TEST(histo1d_pyramid, LevelForRRF)
+{
+    ASSERT_EQ(Histo1DPyramid::levelForRRF(0), -1);
+    ASSERT_EQ(Histo1DPyramid::levelForRRF(1), 0);
+    ASSERT_EQ(Histo1DPyramid::levelForRRF(2), 1);
+    ASSERT_EQ(Histo1DPyramid::levelForRRF(3), -1);
+    ASSERT_EQ(Histo1DPyramid::levelForRRF(1024), 10);
+    ASSERT_EQ(Histo1DPyramid::levelForRRF(1536), -1);
+}
+
+TEST(histo1d_pyramid, RebuildAndAdd)
+{
+    // Not a power of two to test partial blocks.
+    const u32 BinCount = 1000;
+    std::vector<double> bins(BinCount);
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<u32> binDist(0, BinCount - 1);
+
+    for (auto &v: bins)
+        v = binDist(rng) % 17;
+
+    Histo1DPyramid pyramid;
+    ASSERT_FALSE(pyramid.isValid());
+
+    pyramid.rebuild(bins.data(), BinCount);
+    ASSERT_EQ(pyramid.getLevelCount(), 10);
+    expect_levels_match(pyramid, bins);
+
+    // Incremental updates including decrements.
+    for (int i = 0; i < 5000; i++)
+    {
+        u32 bin = binDist(rng);
+        double delta = (i % 7 == 0 && bins[bin] > 0) ? -1.0 : 1.0;
+        bins[bin] += delta;
+        pyramid.add(bin, delta);
+
+        if (i % 500 == 0)
+        {
+            for (s32 level = 1; level <= pyramid.getLevelCount(); level++)
+            {
+                const u32 rrf = 1u << level;
+                const u32 visBins = BinCount / rrf;
+                auto max = pyramid.getMax(level, visBins);
+
+                double refValue = visBins ? reduced_sum(bins, 0, rrf) : 0.0;
+                u32 refBin = 0;
+
+                for (u32 b = 1; b < visBins; b++)
+                {
+                    if (reduced_sum(bins, b, rrf) >= refValue)
+                    {
+                        refValue = reduced_sum(bins, b, rrf);
+                        refBin = b;
+                    }
+                }
+
+                ASSERT_EQ(max.value, refValue) << "level=" << level;
+                ASSERT_EQ(max.bin, refBin) << "level=" << level;
+            }
+        }
+    }
+
+    expect_levels_match(pyramid, bins);
+
+    pyramid.reset(BinCount);
+    expect_levels_match(pyramid, std::vector<double>(BinCount));
+}
+
+TEST(histo1d_pyramid, RebuildCompact)
+{
+    const u32 BinCount = 256;
+    a2::CompactBins compact(BinCount);
+    std::vector<double> bins(BinCount);
+
+    for (u32 bin = 0; bin < BinCount; bin++)
+    {
+        compact.set(bin, bin % 5);
+        bins[bin] = bin % 5;
+    }
+
+    Histo1DPyramid pyramid;
+    pyramid.rebuild(compact, BinCount);
+    expect_levels_match(pyramid, bins);
+
+    // Promoted storage
+    compact.add(3, 1e10);
+    bins[3] += 1e10;
+    ASSERT_TRUE(compact.isPromoted());
+
+    pyramid.rebuild(compact, BinCount);
+    expect_levels_match(pyramid, bins);
+}
+
+// Only tiles with modified counters are summed up again.
+TEST(histo1d_pyramid, UpdateModifiedTiles)
+{
+    const u32 BinCount = 5000;
+    std::vector<double> bins(BinCount);
+    a2::TileGenerations tiles(BinCount);
+    std::mt19937 rng(4711);
+    // The first tile is never marked.
+    std::uniform_int_distribution<u32> binDist(1u << tiles.tileShift(), BinCount - 1);
+
+    Histo1DPyramid pyramid;
+    pyramid.update(bins.data(), BinCount, &tiles);
+    expect_levels_match(pyramid, bins);
+
+    for (int round = 0; round < 10; round++)
+    {
+        for (int i = 0; i < 200; i++)
+        {
+            u32 bin = binDist(rng);
+            bins[bin] += 1.0;
+            tiles.mark(bin);
+        }
+
+        // Changed without marking the tile: must not be picked up.
+        if (round == 5)
+            bins[0] += 1000.0;
+
+        pyramid.update(bins.data(), BinCount, &tiles);
+
+        if (round >= 5)
+        {
+            bins[0] -= 1000.0;
+            expect_levels_match(pyramid, bins);
+            bins[0] += 1000.0;
+        }
+        else
+        {
+            expect_levels_match(pyramid, bins);
+        }
+    }
+
+    tiles.markAll();
+    pyramid.update(bins.data(), BinCount, &tiles);
+    expect_levels_match(pyramid, bins);
+}
+
+// The reduced bin contents, maxima and statistics must not change when using
+// the pyramid.
+TEST(histo1d_pyramid, Histo1DInternalMemory)
+{
+    const u32 BinCount = 1u << 12;
+    Histo1D histo(BinCount, 0.0, BinCount);
+    std::vector<double> bins(BinCount);
+    std::mt19937 rng(1234);
+    std::normal_distribution<double> dist(BinCount * 0.5, BinCount * 0.1);
+
+    for (int i = 0; i < 100000; i++)
+    {
+        s32 bin = histo.fill(dist(rng));
+        if (bin >= 0)
+            bins[bin] += 1.0;
+    }
+
+    histo.setBinContent(17, 42.0);
+    bins[17] = 42.0;
+
+    for (u32 rrf: { 2u, 8u, 64u })
+    {
+        const u32 visBins = histo.getNumberOfBins(rrf);
+        Histo1D reference(visBins, 0.0, BinCount);
+
+        for (u32 bin = 0; bin < visBins; bin++)
+        {
+            ASSERT_EQ(histo.getBinContent(bin, rrf), reduced_sum(bins, bin, rrf));
+            reference.setBinContent(bin, reduced_sum(bins, bin, rrf));
+        }
+
+        ASSERT_EQ(histo.getMaxBin(rrf), reference.getMaxBin());
+        ASSERT_EQ(histo.getMaxValue(rrf), reference.getMaxValue());
+
+        auto stats = histo.calcStatistics(BinCount * 0.25, BinCount * 0.75, rrf);
+        auto refStats = reference.calcStatistics(BinCount * 0.25, BinCount * 0.75);
+
+        ASSERT_EQ(stats.entryCount, refStats.entryCount);
+        ASSERT_DOUBLE_EQ(stats.mean, refStats.mean);
+        ASSERT_DOUBLE_EQ(stats.sigma, refStats.sigma);
+        ASSERT_EQ(stats.maxBin, refStats.maxBin);
+        ASSERT_DOUBLE_EQ(stats.fwhm, refStats.fwhm);
+    }
+
+    histo.clear();
+
+    for (u32 bin = 0; bin < histo.getNumberOfBins(8); bin++)
+        ASSERT_EQ(histo.getBinContent(bin, 8), 0.0);
+}
+
+// With external memory the pyramid is a snapshot taken by
+// updateResolutionPyramid().
+TEST(histo1d_pyramid, Histo1DExternalMemory)
+{
+    const u32 BinCount = 1024;
+    auto arena = std::make_shared<memory::Arena>(2 * BinCount * sizeof(double));
+
+    SharedHistoMem mem;
+    mem.arena = arena;
+    mem.data = arena->pushArray<double>(BinCount);
+    mem.size = BinCount;
+
+    Histo1D histo(AxisBinning(BinCount, 0.0, BinCount), mem);
+
+    mem.data[10] = 5.0;
+    mem.data[11] = 2.0;
+
+    // No snapshot: the physical bins are summed up.
+    ASSERT_EQ(histo.getBinContent(5, 2), 7.0);
+
+    histo.updateResolutionPyramid();
+    ASSERT_EQ(histo.getBinContent(5, 2), 7.0);
+    ASSERT_EQ(histo.getMaxBin(4), 2u);
+
+    mem.data[11] = 3.0;
+    ASSERT_EQ(histo.getBinContent(5, 2), 7.0);
+
+    histo.updateResolutionPyramid();
+    ASSERT_EQ(histo.getBinContent(5, 2), 8.0);
+}
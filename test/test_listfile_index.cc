@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <QBuffer>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "listfile_index.h"
+#include "listfile_parallel_compression.h"
+#include "mvlc_listfile_index.h"
+
+using namespace mesytec;
+
+namespace
+{
+
+struct VectorWriteHandle: public mvlc::listfile::WriteHandle
+{
+    std::vector<u8> data;
+
+    size_t write(const u8 *src, size_t size) override
+    {
+        data.insert(std::end(data), src, src + size);
+        return size;
+    }
+};
+
+u32 make_frame_header(u8 type, u16 len)
+{
+    return (static_cast<u32>(type) << mvlc::frame_headers::TypeShift) | len;
+}
+
+u32 make_timetick_header()
+{
+    return (make_frame_header(mvlc::frame_headers::SystemEvent, 0)
+            | (static_cast<u32>(mvlc::system_event::subtype::UnixTimetick)
+               << mvlc::system_event::SubtypeShift));
+}
+
+// MVLC_USB listfile containing eventsPerSecond readout events between
+// consecutive timeticks. Every event is a stack frame with 4 data words.
+std::vector<u32> make_usb_listfile_words(size_t seconds, size_t eventsPerSecond)
+{
+    std::vector<u32> result;
+
+    for (size_t s = 0; s < seconds; ++s)
+    {
+        result.push_back(make_timetick_header());
+
+        for (size_t e = 0; e < eventsPerSecond; ++e)
+        {
+            result.push_back(make_frame_header(mvlc::frame_headers::StackFrame, 4));
+
+            for (u32 i = 0; i < 4; ++i)
+                result.push_back(0x04000000u | static_cast<u32>(e));
+        }
+    }
+
+    return result;
+}
+
+}
+
+TEST(listfile_index, BuilderAndResolve)
+{
+    ListfileIndexBuilder builder(100);
+
+    // 10 seconds with 10 events of 25 bytes each per second.
+    u64 offset = 8;
+
+    for (int s = 0; s < 10; ++s)
+    {
+        builder.timetick(offset);
+        offset += 4;
+
+        for (int e = 0; e < 10; ++e)
+        {
+            builder.boundary(offset);
+            builder.addEvents();
+            offset += 25;
+        }
+    }
+
+    auto index = builder.finish("run.mvmelst", offset);
+
+    ASSERT_TRUE(index.isValid());
+    ASSERT_EQ(index.totalTimeticks, 10u);
+    ASSERT_EQ(index.totalEvents, 100u);
+
+    // Full range
+    {
+        auto br = resolve_replay_range(index, {});
+        ASSERT_EQ(br.begin, 0u);
+        ASSERT_EQ(br.end, ReplayRange::Unlimited);
+    }
+
+    // Seconds [3, 5) start at timetick 3 and end at timetick 5.
+    {
+        ReplayRange range;
+        range.unit = ReplayRange::Timeticks;
+        range.begin = 3;
+        range.end = 5;
+
+        auto br = resolve_replay_range(index, range);
+        ASSERT_EQ(br.begin, 8u + 3 * 254);
+        ASSERT_EQ(br.end, 8u + 5 * 254);
+    }
+
+    // The last second extends to the end of the listfile.
+    {
+        ReplayRange range;
+        range.unit = ReplayRange::Timeticks;
+        range.begin = 9;
+        range.end = 10;
+
+        auto br = resolve_replay_range(index, range);
+        ASSERT_EQ(br.begin, 8u + 9 * 254);
+        ASSERT_EQ(br.end, ReplayRange::Unlimited);
+    }
+
+    // Event ranges are rounded outwards to the surrounding checkpoints.
+    {
+        ReplayRange range;
+        range.unit = ReplayRange::Events;
+        range.begin = 42;
+        range.end = 57;
+
+        auto br = resolve_replay_range(index, range);
+
+        auto cpBegin = std::find_if(
+            index.checkpoints.begin(), index.checkpoints.end(),
+            [&br] (const auto &cp) { return cp.offset == br.begin; });
+
+        auto cpEnd = std::find_if(
+            index.checkpoints.begin(), index.checkpoints.end(),
+            [&br] (const auto &cp) { return cp.offset == br.end; });
+
+        ASSERT_NE(cpBegin, index.checkpoints.end());
+        ASSERT_NE(cpEnd, index.checkpoints.end());
+        ASSERT_LE(cpBegin->events, 42u);
+        ASSERT_GE(cpEnd->events, 57u);
+        ASSERT_LT(br.begin, br.end);
+    }
+}
+
+TEST(listfile_index, SerializeRoundTrip)
+{
+    ListfileIndex index;
+    index.listfileName = "run001.mvlclst";
+    index.totalBytes = 1234567;
+    index.totalTimeticks = 17;
+    index.totalEvents = 4242;
+    index.checkpoints = { { 8, 0, 0 }, { 1000, 1, 10 }, { 20000, 5, 400 } };
+    index.blocks = { { 0, 0 }, { 1u << 20, 4711 } };
+
+    auto data = serialize_listfile_index(index);
+
+    ListfileIndex result;
+    ASSERT_TRUE(deserialize_listfile_index(data, result));
+    ASSERT_EQ(result.listfileName, index.listfileName);
+    ASSERT_EQ(result.totalBytes, index.totalBytes);
+    ASSERT_EQ(result.totalTimeticks, index.totalTimeticks);
+    ASSERT_EQ(result.totalEvents, index.totalEvents);
+    ASSERT_EQ(result.checkpoints.size(), index.checkpoints.size());
+    ASSERT_EQ(result.checkpoints[2].offset, 20000u);
+    ASSERT_EQ(result.checkpoints[2].events, 400u);
+    ASSERT_EQ(result.blocks.size(), index.blocks.size());
+    ASSERT_EQ(result.blocks[1].compressedOffset, 4711u);
+
+    // Truncated and garbage input
+    ASSERT_FALSE(deserialize_listfile_index(data.left(data.size() - 4), result));
+    ASSERT_FALSE(deserialize_listfile_index(QByteArray("not an index"), result));
+}
+
+// Writes an MVLC_USB listfile through the indexing and the parallel LZ4
+// handles, then replays a range of seconds directly from the LZ4 blocks.
+TEST(listfile_index, MVLCUSBRangeReplayFromLZ4Blocks)
+{
+    const size_t Seconds = 20;
+    const auto words = make_usb_listfile_words(Seconds, 500);
+    const std::string magic = mvlc::listfile::get_filemagic_usb();
+
+    VectorWriteHandle dest;
+    ListfileIndex index;
+
+    {
+        ParallelLZ4WriteHandle lz4Handle(&dest, 0, 2, 8192);
+        MVLCIndexingWriteHandle indexer(&lz4Handle, 4096);
+
+        indexer.write(reinterpret_cast<const u8 *>(magic.data()), magic.size());
+
+        // Odd sized chunks of whole words.
+        size_t pos = 0;
+
+        while (pos < words.size())
+        {
+            size_t n = std::min(words.size() - pos, size_t(333));
+            indexer.write(reinterpret_cast<const u8 *>(words.data() + pos), n * sizeof(u32));
+            pos += n;
+        }
+
+        lz4Handle.finish();
+
+        ASSERT_TRUE(indexer.isIndexValid());
+        index = indexer.finish("run.mvlclst");
+        index.blocks = lz4Handle.blocks();
+    }
+
+    ASSERT_EQ(index.totalBytes, magic.size() + words.size() * sizeof(u32));
+    ASSERT_EQ(index.totalTimeticks, Seconds);
+    ASSERT_EQ(index.totalEvents, Seconds * 500);
+    ASSERT_GT(index.blocks.size(), 1u);
+
+    ReplayRange range;
+    range.unit = ReplayRange::Timeticks;
+    range.begin = 7;
+    range.end = 9;
+
+    auto byteRange = resolve_replay_range(index, range);
+
+    auto buffer = std::make_unique<QBuffer>();
+    buffer->setData(reinterpret_cast<const char *>(dest.data.data()), dest.data.size());
+    ASSERT_TRUE(buffer->open(QIODevice::ReadOnly));
+
+    MVLCRangeReadHandle readHandle(
+        std::move(buffer), 0, dest.data.size(), index.blocks, byteRange);
+
+    std::vector<u8> replayed;
+    std::vector<u8> chunk(1000);
+
+    while (size_t n = readHandle.read(chunk.data(), chunk.size()))
+        replayed.insert(replayed.end(), chunk.begin(), chunk.begin() + n);
+
+    ASSERT_GE(replayed.size(), magic.size());
+    ASSERT_EQ(std::string(replayed.begin(), replayed.begin() + magic.size()), magic);
+    ASSERT_EQ((replayed.size() - magic.size()) % sizeof(u32), 0u);
+
+    const u32 *replayedWords = reinterpret_cast<const u32 *>(replayed.data() + magic.size());
+    const size_t replayedWordCount = (replayed.size() - magic.size()) / sizeof(u32);
+
+    // The replayed data must be exactly seconds 7 and 8 of the original.
+    const size_t wordsPerSecond = words.size() / Seconds;
+    ASSERT_EQ(replayedWordCount, 2 * wordsPerSecond);
+    ASSERT_TRUE(std::equal(replayedWords, replayedWords + replayedWordCount,
+                           words.data() + 7 * wordsPerSecond));
+
+    // Rewinding restarts at the beginning of the range.
+    readHandle.seek(0);
+    std::vector<u8> again(replayed.size());
+    ASSERT_EQ(readHandle.read(again.data(), again.size()), replayed.size());
+    ASSERT_EQ(again, replayed);
+}
@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <lz4frame.h>
+
+#include "gtest/gtest.h"
+#include "listfile_parallel_compression.h"
+
+namespace
+{
+
+struct VectorWriteHandle: public mesytec::mvlc::listfile::WriteHandle
+{
+    std::vector<u8> data;
+
+    size_t write(const u8 *src, size_t size) override
+    {
+        data.insert(std::end(data), src, src + size);
+        return size;
+    }
+};
+
+// Decompresses a sequence of LZ4 frames.
+std::vector<u8> lz4_decompress(const std::vector<u8> &input, size_t maxOutputSize)
+{
+    LZ4F_dctx *dctx = nullptr;
+    LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION);
+
+    std::vector<u8> result(maxOutputSize);
+    size_t inPos = 0, outPos = 0;
+
+    while (inPos < input.size() && outPos < result.size())
+    {
+        size_t outSize = result.size() - outPos;
+        size_t inSize = input.size() - inPos;
+
+        size_t res = LZ4F_decompress(
+            dctx, result.data() + outPos, &outSize,
+            input.data() + inPos, &inSize, nullptr);
+
+        if (LZ4F_isError(res))
+            break;
+
+        inPos += inSize;
+        outPos += outSize;
+    }
+
+    LZ4F_freeDecompressionContext(dctx);
+    result.resize(outPos);
+
+    return result;
+}
+
+std::vector<u8> make_input(size_t size)
+{
+    std::mt19937 gen(42);
+    std::vector<u8> result(size);
+
+    // Mostly zeroes so that there is something to compress.
+    for (auto &b: result)
+        b = (gen() % 16) ? 0 : gen() & 0xff;
+
+    return result;
+}
+
+}
+
+TEST(listfile_parallel_compression, RoundTrip)
+{
+    const auto input = make_input(3u << 20);
+    std::mt19937 gen(1);
+
+    for (unsigned threads: { 1u, 3u })
+    {
+        for (size_t blockSize: { size_t(1000), size_t(1u << 20) })
+        {
+            VectorWriteHandle dest;
+
+            {
+                ParallelLZ4WriteHandle handle(&dest, 0, threads, blockSize);
+
+                // Writes of varying sizes, crossing block boundaries.
+                size_t pos = 0;
+
+                while (pos < input.size())
+                {
+                    size_t size = std::min(input.size() - pos, size_t(1 + gen() % 100000));
+                    ASSERT_EQ(handle.write(input.data() + pos, size), size);
+                    pos += size;
+                }
+
+                handle.finish();
+
+                auto counters = handle.counters();
+                ASSERT_EQ(counters.bytesIn, input.size());
+                ASSERT_EQ(counters.bytesOut, dest.data.size());
+                ASSERT_EQ(counters.threads.size(), threads);
+
+                u64 threadBytesIn = 0;
+
+                for (const auto &tc: counters.threads)
+                    threadBytesIn += tc.bytesIn;
+
+                ASSERT_EQ(threadBytesIn, input.size());
+            }
+
+            ASSERT_LT(dest.data.size(), input.size());
+
+            auto output = lz4_decompress(dest.data, input.size() + 1);
+            ASSERT_EQ(output, input) << "threads=" << threads << ", blockSize=" << blockSize;
+        }
+    }
+}
+
+// The destructor writes out data still buffered in the handle.
+TEST(listfile_parallel_compression, FinishOnDestruction)
+{
+    const auto input = make_input(10000);
+    VectorWriteHandle dest;
+
+    {
+        ParallelLZ4WriteHandle handle(&dest, 0, 2);
+        handle.write(input.data(), input.size());
+    }
+
+    ASSERT_EQ(lz4_decompress(dest.data, input.size() + 1), input);
+}
@@ -0,0 +1,121 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "util/lockfree_ring.h"
+
+using namespace mesytec::mvme;
+
+TEST(util_lockfree_ring, SingleThreaded)
+{
+    LockFreeRing<int *> ring(5);
+
+    // Rounded up to the next power of two.
+    ASSERT_EQ(ring.capacity(), 8u);
+    ASSERT_TRUE(is_empty(&ring));
+    ASSERT_EQ(dequeue(&ring), nullptr);
+
+    std::vector<int> values(ring.capacity());
+
+    for (auto &value: values)
+        ASSERT_TRUE(ring.try_enqueue(&value));
+
+    ASSERT_EQ(queue_size(&ring), 8);
+    ASSERT_FALSE(ring.try_enqueue(&values[0]));
+
+    for (auto &value: values)
+        ASSERT_EQ(dequeue(&ring), &value);
+
+    ASSERT_TRUE(is_empty(&ring));
+
+    // Wrap around multiple times.
+    for (int i = 0; i < 100; i++)
+    {
+        enqueue(&ring, &values[i % 8]);
+        enqueue(&ring, &values[(i + 1) % 8]);
+        ASSERT_EQ(dequeue(&ring), &values[i % 8]);
+        ASSERT_EQ(dequeue(&ring), &values[(i + 1) % 8]);
+    }
+}
+
+TEST(util_lockfree_ring, DequeueTimeout)
+{
+    LockFreeRing<int *> ring(4);
+
+    auto tStart = std::chrono::steady_clock::now();
+    ASSERT_EQ(dequeue(&ring, 50), nullptr);
+    auto elapsed = std::chrono::steady_clock::now() - tStart;
+
+    ASSERT_GE(elapsed, std::chrono::milliseconds(50));
+}
+
+TEST(util_lockfree_ring, EnqueueTimeout)
+{
+    LockFreeRing<int> ring(2);
+
+    ASSERT_TRUE(ring.enqueue(1, std::chrono::milliseconds(50)));
+    ASSERT_TRUE(ring.enqueue(2, std::chrono::milliseconds(50)));
+
+    auto tStart = std::chrono::steady_clock::now();
+    ASSERT_FALSE(ring.enqueue(3, std::chrono::milliseconds(50)));
+    auto elapsed = std::chrono::steady_clock::now() - tStart;
+
+    ASSERT_GE(elapsed, std::chrono::milliseconds(50));
+
+    // A slot freed by the consumer wakes up the waiting producer.
+    std::thread consumer([&ring] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        int value = 0;
+        ring.try_dequeue(value);
+    });
+
+    ASSERT_TRUE(ring.enqueue(3, std::chrono::seconds(5)));
+    consumer.join();
+    ASSERT_EQ(queue_size(&ring), 2);
+}
+
+// Multiple producers, one consumer, ring smaller than the number of items in
+// flight so that both the empty and the full waits are exercised.
+TEST(util_lockfree_ring, MultipleProducers)
+{
+    static const size_t ProducerCount = 3;
+    static const size_t ItemsPerProducer = 50000;
+
+    LockFreeRing<size_t> ring(16);
+
+    auto producer = [&ring] (size_t producerIndex)
+    {
+        for (size_t i = 0; i < ItemsPerProducer; i++)
+            ring.enqueue(producerIndex * ItemsPerProducer + i + 1);
+    };
+
+    std::vector<std::thread> producers;
+
+    for (size_t pi = 0; pi < ProducerCount; pi++)
+        producers.emplace_back(producer, pi);
+
+    std::vector<size_t> lastSeen(ProducerCount);
+    size_t received = 0;
+
+    while (received < ProducerCount * ItemsPerProducer)
+    {
+        size_t value = 0;
+
+        if (!ring.dequeue(value, std::chrono::seconds(5)))
+            FAIL() << "timeout waiting for data";
+
+        size_t pi = (value - 1) / ItemsPerProducer;
+        ASSERT_LT(pi, ProducerCount);
+
+        // Items of each producer arrive in order.
+        ASSERT_GT(value, lastSeen[pi]);
+        lastSeen[pi] = value;
+        ++received;
+    }
+
+    for (auto &t: producers)
+        t.join();
+
+    ASSERT_TRUE(ring.empty());
+}